@@ -4,8 +4,9 @@
 
 option (ENABLE_RESOURCE_EMBED "Embed resources inside the executable" OFF)
 
-# Build "bincat" for concatenating files.
+# Build "bincat" for packing files into a resource archive.
 if (NOT ENABLE_RESOURCE_EMBED)
+    find_package (ZLIB REQUIRED) # archive entries are deflated
     message (STATUS "Compiling bincat for merging resource files...")
     set (_catDir ${CMAKE_BINARY_DIR}/res)
     execute_process (COMMAND ${CMAKE_COMMAND} -E make_directory ${_catDir})
@@ -88,77 +89,30 @@ function (embed_make)
                 embed_write (${fn} ${resName} ${EMB_C} ${EMB_H})
             endforeach (fn)
         else ()
-            # Collect resources in a single binary file.
+            # Collect resources in an indexed archive file. The reader is a regular
+            # source file; the header maps resource names to entries in the archive.
             set (EMB_BIN ${CMAKE_CURRENT_BINARY_DIR}/resources.binary)
             file (REMOVE ${EMB_BIN})
-            list (LENGTH ARGV fileCount)            
             execute_process (COMMAND ${BINCAT_COMMAND} ${EMB_BIN} ${ARGV}
                 WORKING_DIRECTORY ${CMAKE_SOURCE_DIR}
-                OUTPUT_VARIABLE fileSizes
+                RESULT_VARIABLE bincatResult
             )
-            set (offsets)
-            set (fpos 0)
-            foreach (fileSize ${fileSizes})
-                list (APPEND offsets "${fpos}")
-                math (EXPR fpos "${fpos} + ${fileSize}")
-            endforeach (fileSize)
+            if (NOT bincatResult EQUAL 0)
+                message (FATAL_ERROR "Failed to write the resource archive")
+            endif ()
+            list (LENGTH ARGV fileCount)
             file (WRITE ${EMB_H} "#include <the_Foundation/block.h>\n
 #define iHaveLoadEmbed 1
-iBool load_Embed(const char *path);\n\n")
-            file (WRITE ${EMB_C} [[
-#include "embedded.h"
-#include <the_Foundation/file.h>
-#include <the_Foundation/fileinfo.h>
-
-iDeclareType(EmbedChunk)
-
-struct Impl_EmbedChunk {
-    size_t pos;
-    size_t size;
-};
-
-static const iEmbedChunk chunks_Embed_[] = {
-]])
+iBool load_Embed(const char *path);
+const iBlock *resource_Embed(size_t index); /* decompressed on first use */\n
+#define numResources_Embed ${fileCount}\n")
             set (index 0)
-            foreach (fn ${ARGV})
-                list (GET fileSizes ${index} fileSize)
-                list (GET offsets ${index} fpos)
-                file (APPEND ${EMB_C} "    { ${fpos}, ${fileSize} },\n")
-                math (EXPR index "${index} + 1")
-            endforeach (fn)
-            file (APPEND ${EMB_C} "};\n\n")
             foreach (fn ${ARGV})
                 embed_getname (resName ${fn})
-                file (APPEND ${EMB_H} "extern iBlock ${resName};\n")
-                file (APPEND ${EMB_C} "iBlock ${resName};\n")
-            endforeach (fn)
-            file (APPEND ${EMB_C} "\nstatic iBlock *blocks_Embed_[] = {\n")
-            foreach (fn ${ARGV})
-                embed_getname (resName ${fn})
-                file (APPEND ${EMB_C} "   &${resName},\n")
+                file (APPEND ${EMB_H} "#define ${resName} (*resource_Embed(${index}))\n")
+                math (EXPR index "${index} + 1")
             endforeach (fn)
-            file (APPEND ${EMB_C} [[
-};
-
-iBool load_Embed(const char *path) {
-    const size_t fileSize = (size_t) fileSizeCStr_FileInfo(path);
-    iFile *f = iClob(newCStr_File(path));
-    if (open_File(f, readOnly_FileMode)) {
-        iForIndices(i, blocks_Embed_) {
-            const iEmbedChunk *chunk = &chunks_Embed_[i];
-            iBlock *data = blocks_Embed_[i];
-            if (chunk->pos + chunk->size > fileSize) {
-                return iFalse;
-            }
-            init_Block(data, chunk->size);
-            seek_File(f, chunk->pos);
-            readData_File(f, chunk->size, data_Block(data));
-        }
-        return iTrue;
-    }
-    return iFalse;
-}
-]])
+            configure_file (${CMAKE_CURRENT_LIST_DIR}/res/embed.c ${EMB_C} COPYONLY)
         endif ()
     endif ()
 endfunction (embed_make)
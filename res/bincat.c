@@ -20,29 +20,146 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
-/* bincat.c: Tiny tool for concatenating binary files */
+/* bincat.c: Tiny tool for packing resource files into an indexed archive.
+
+   The archive begins with a 16-byte header: the magic "lgRA", the format version (U32),
+   the number of entries (U32), and a reserved U32. It is followed by the index, 24 bytes
+   per entry: data offset (U64), stored size (U32), original size (U32), flags (U32), and
+   a reserved U32. All values are little-endian.
+
+   Entries are either deflated (flag 0x1; zlib format) or stored as-is. Fonts and images
+   are stored as-is at page-aligned offsets so they can be used directly from a read-only
+   memory mapping. Every entry is followed by at least one zero byte. */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define pageSize_    4096
+#define headerSize_  16
+#define entrySize_   24
+
+enum EntryFlag {
+    deflate_EntryFlag = 0x1,
+};
+
+struct Entry {
+    unsigned char *data; /* stored bytes */
+    size_t         size;
+    size_t         origSize;
+    unsigned       flags;
+    size_t         pos;
+};
+
+static void writeU32_(FILE *out, unsigned long value) {
+    for (int i = 0; i < 4; i++) {
+        fputc((int) ((value >> (8 * i)) & 0xff), out);
+    }
+}
+
+static void writeU64_(FILE *out, unsigned long long value) {
+    for (int i = 0; i < 8; i++) {
+        fputc((int) ((value >> (8 * i)) & 0xff), out);
+    }
+}
+
+static int isStoredAsIs_(const char *path) {
+    /* These are either compressed already or worth mapping directly. */
+    static const char *exts[] = { ".ttf", ".otf", ".png", ".jpg" };
+    const size_t len = strlen(path);
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        const size_t extLen = strlen(exts[i]);
+        if (len >= extLen && !strcmp(path + len - extLen, exts[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned char *readFile_(const char *path, size_t *size_out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    size_t         size = 0;
+    size_t         cap  = 1024 * 256;
+    unsigned char *buf  = malloc(cap);
+    for (;;) {
+        if (size == cap) {
+            buf = realloc(buf, cap *= 2);
+        }
+        const size_t num = fread(buf + size, 1, cap - size, f);
+        if (num == 0) break;
+        size += num;
+    }
+    fclose(f);
+    *size_out = size;
+    return buf;
+}
 
 int main(int argc, char *argv[]) {
-    const size_t bufSize = 1024 * 256;
-    char *buf = malloc(bufSize);
+    if (argc < 2) {
+        fprintf(stderr, "usage: bincat output [files...]\n");
+        return 1;
+    }
+    const int     count   = argc - 2;
+    struct Entry *entries = calloc(count > 0 ? count : 1, sizeof(struct Entry));
+    size_t        pos     = headerSize_ + (size_t) count * entrySize_;
+    for (int i = 0; i < count; ++i) {
+        struct Entry *entry = &entries[i];
+        unsigned char *src = readFile_(argv[i + 2], &entry->origSize);
+        if (!src) {
+            fprintf(stderr, "bincat: cannot read %s\n", argv[i + 2]);
+            return 1;
+        }
+        entry->data = src;
+        entry->size = entry->origSize;
+        if (!isStoredAsIs_(argv[i + 2])) {
+            uLongf         packedSize = compressBound(entry->origSize);
+            unsigned char *packed     = malloc(packedSize);
+            if (compress2(packed, &packedSize, src, entry->origSize, Z_BEST_COMPRESSION) == Z_OK &&
+                packedSize < entry->origSize) {
+                free(src);
+                entry->data  = packed;
+                entry->size  = packedSize;
+                entry->flags = deflate_EntryFlag;
+            }
+            else {
+                free(packed);
+            }
+        }
+        if (!entry->flags) {
+            pos = (pos + pageSize_ - 1) / pageSize_ * pageSize_;
+        }
+        entry->pos = pos;
+        pos += entry->size + 1; /* zero terminator */
+    }
     FILE *out = fopen(argv[1], "wb");
-    int i;
-    for (i = 2; i < argc; ++i) {
-        FILE *f = fopen(argv[i], "rb");
-        size_t fileSize = 0;
-        for (;;) {
-            size_t num = fread(buf, 1, bufSize, f);
-            if (num <= 0) break;
-            fileSize += num;
-            fwrite(buf, 1, num, out); 
+    if (!out) {
+        fprintf(stderr, "bincat: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    fwrite("lgRA", 1, 4, out);
+    writeU32_(out, 1); /* version */
+    writeU32_(out, count);
+    writeU32_(out, 0);
+    for (int i = 0; i < count; ++i) {
+        writeU64_(out, entries[i].pos);
+        writeU32_(out, entries[i].size);
+        writeU32_(out, entries[i].origSize);
+        writeU32_(out, entries[i].flags);
+        writeU32_(out, 0);
+    }
+    for (int i = 0; i < count; ++i) {
+        while ((size_t) ftell(out) < entries[i].pos) {
+            fputc(0, out);
         }
-        fclose(f);
-        printf("%zu;", fileSize);
+        fwrite(entries[i].data, 1, entries[i].size, out);
+        fputc(0, out);
+        free(entries[i].data);
     }
     fclose(out);
-    free(buf);
+    free(entries);
     return 0;
 }
@@ -0,0 +1,178 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+/* embed.c: Reader for the resource archive written by bincat. This file is copied to the
+   build directory as "embedded.c"; the generated "embedded.h" maps resource names to
+   archive indices.
+
+   Entries stored as-is are used directly from the memory-mapped archive file without
+   copying. Deflated entries are decompressed when they are first accessed. */
+
+#include "embedded.h"
+
+#include <the_Foundation/atomic.h>
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#if !defined (iPlatformMsys)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+iDeclareType(EmbedArchive)
+iDeclareType(EmbedEntry)
+
+enum iEmbedEntryFlag {
+    deflate_EmbedEntryFlag = 0x1,
+};
+
+struct Impl_EmbedEntry {
+    uint64_t pos;
+    uint32_t size; /* stored bytes */
+    uint32_t origSize;
+    uint32_t flags;
+};
+
+struct Impl_EmbedArchive {
+    const uint8_t *data; /* the whole archive */
+    size_t         size;
+    iMutex *       mtx;
+    iEmbedEntry    entries[numResources_Embed];
+    iBlockData     views[numResources_Embed]; /* point inside `data` */
+    iBlock         blocks[numResources_Embed];
+    iAtomicInt     isReady[numResources_Embed];
+};
+
+static iEmbedArchive archive_;
+
+static const char *   magic_EmbedArchive_   = "lgRA";
+static const uint32_t version_EmbedArchive_ = 1;
+static const size_t   headerSize_EmbedArchive_ = 16;
+static const size_t   entrySize_EmbedArchive_  = 24;
+
+static uint32_t u32_EmbedArchive_(const iEmbedArchive *d, size_t pos) {
+    const uint8_t *p = d->data + pos;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t u64_EmbedArchive_(const iEmbedArchive *d, size_t pos) {
+    return u32_EmbedArchive_(d, pos) | ((uint64_t) u32_EmbedArchive_(d, pos + 4) << 32);
+}
+
+static iBool map_EmbedArchive_(iEmbedArchive *d, const char *path) {
+    /* The archive stays mapped for the lifetime of the process. */
+#if defined (iPlatformMsys)
+    iFile *f = iClob(newCStr_File(path));
+    if (!open_File(f, readOnly_FileMode)) {
+        return iFalse;
+    }
+    iBlock *contents = readAll_File(f); /* never released */
+    d->data = constData_Block(contents);
+    d->size = size_Block(contents);
+    return iTrue;
+#else
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return iFalse;
+    }
+    struct stat st;
+    void *      map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd); /* the mapping remains valid */
+    if (map == MAP_FAILED) {
+        return iFalse;
+    }
+    d->data = map;
+    d->size = st.st_size;
+    return iTrue;
+#endif
+}
+
+iBool load_Embed(const char *path) {
+    iEmbedArchive *d = &archive_;
+    if (!map_EmbedArchive_(d, path)) {
+        return iFalse;
+    }
+    if (d->size < headerSize_EmbedArchive_ || memcmp(d->data, magic_EmbedArchive_, 4) ||
+        u32_EmbedArchive_(d, 4) != version_EmbedArchive_ ||
+        u32_EmbedArchive_(d, 8) != numResources_Embed ||
+        d->size < headerSize_EmbedArchive_ + numResources_Embed * entrySize_EmbedArchive_) {
+        fprintf(stderr, "[embed] %s: not a compatible resource archive\n", path);
+        return iFalse;
+    }
+    for (size_t i = 0; i < numResources_Embed; i++) {
+        const size_t indexPos = headerSize_EmbedArchive_ + i * entrySize_EmbedArchive_;
+        iEmbedEntry *entry    = &d->entries[i];
+        entry->pos      = u64_EmbedArchive_(d, indexPos);
+        entry->size     = u32_EmbedArchive_(d, indexPos + 8);
+        entry->origSize = u32_EmbedArchive_(d, indexPos + 12);
+        entry->flags    = u32_EmbedArchive_(d, indexPos + 16);
+        if (entry->pos + entry->size >= d->size) { /* must be followed by a zero */
+            fprintf(stderr, "[embed] %s: entry %zu is truncated\n", path, i);
+            return iFalse;
+        }
+        if (~entry->flags & deflate_EmbedEntryFlag) {
+            /* Views into shared memory are never freed or modified in place. */
+            d->views[i]  = (iBlockData){ .refCount  = 2,
+                                         .data      = iConstCast(char *, d->data + entry->pos),
+                                         .size      = entry->size,
+                                         .allocSize = entry->size };
+            d->blocks[i] = (iBlock){ &d->views[i] };
+            set_Atomic(&d->isReady[i], iTrue);
+        }
+    }
+    d->mtx = new_Mutex();
+    return iTrue;
+}
+
+static void inflate_EmbedArchive_(iEmbedArchive *d, size_t index) {
+    const iEmbedEntry *entry = &d->entries[index];
+    iBlock *           block = &d->blocks[index];
+    init_Block(block, entry->origSize);
+    uLongf outSize = entry->origSize;
+    if (uncompress((Bytef *) data_Block(block), &outSize, d->data + entry->pos, entry->size) !=
+            Z_OK ||
+        outSize != entry->origSize) {
+        fprintf(stderr, "[embed] failed to decompress resource %zu\n", index);
+        clear_Block(block);
+    }
+}
+
+const iBlock *resource_Embed(size_t index) {
+    iEmbedArchive *d = &archive_;
+    if (!value_Atomic(&d->isReady[index])) {
+        iGuardMutex(d->mtx, {
+            if (!value_Atomic(&d->isReady[index])) {
+                inflate_EmbedArchive_(d, index);
+                set_Atomic(&d->isReady[index], iTrue);
+            }
+        });
+    }
+    return &d->blocks[index];
+}
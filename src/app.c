@@ -21,32 +21,41 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "app.h"
+#include "audio/player.h"
 #include "bookmarks.h"
 #include "defs.h"
 #include "embedded.h"
 #include "feeds.h"
 #include "gmcerts.h"
 #include "gmdocument.h"
+#include "gmrequest.h"
 #include "gmutil.h"
 #include "history.h"
+#include "media.h"
+#include "responsecache.h"
+#include "saver.h"
 #include "ui/color.h"
 #include "ui/command.h"
 #include "ui/documentwidget.h"
 #include "ui/inputwidget.h"
 #include "ui/keys.h"
 #include "ui/labelwidget.h"
+#include "ui/profiler.h"
 #include "ui/sidebarwidget.h"
 #include "ui/text.h"
 #include "ui/util.h"
 #include "ui/window.h"
 #include "visited.h"
 
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/commandline.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/process.h>
 #include <the_Foundation/sortedarray.h>
+#include <the_Foundation/thread.h>
 #include <the_Foundation/time.h>
 #include <SDL_events.h>
 #include <SDL_filesystem.h>
@@ -88,14 +97,47 @@ static const char *prefsFileName_App_ = "prefs.cfg";
 static const char *stateFileName_App_ = "state.binary";
 static const char *downloadDir_App_   = "~/Downloads";
 
+static const uint32_t autoSaveInterval_App_ = 2 * 60 * 1000; /* ms */
+static const uint32_t hibernateInterval_App_ = 30 * 1000; /* ms; how often idle tabs are checked */
+static const size_t   tabsMemoryBudget_App_  = 512 * 1024 * 1024; /* background tabs, bytes */
+
+iDeclareType(StartupPhase)
+
+struct Impl_StartupPhase {
+    const char *name;
+    double      time; /* milliseconds since launch */
+};
+
+/* In fast-start mode, these are loaded in background threads after the window is shown. */
+enum iAppLoader {
+    visited_AppLoader,
+    certs_AppLoader,
+    max_AppLoader
+};
+
+iDeclareType(PendingVisit)
+
+/* A visit made in fast-start mode before the history was loaded. */
+struct Impl_PendingVisit {
+    iString *url;
+    uint16_t flags;
+};
+
 struct Impl_App {
     iCommandLine args;
     iString *    execPath;
     iGmCerts *   certs;
     iVisited *   visited;
     iBookmarks * bookmarks;
+    iResponseCache *responseCache;
+    iSaver *     saver;         /* writes files in the background */
+    SDL_TimerID  autoSaveTimer;
+    SDL_TimerID  hibernateTimer;
     iWindow *    window;
-    iSortedArray tickers;
+    iSortedArray tickers;        /* to be called on the next frame */
+    iSortedArray runningTickers; /* being called on the current frame */
+    uint32_t     frameInterval;  /* milliseconds; matches the display refresh rate */
+    uint32_t     nextFrameTime;  /* when tickers should be called next */
     uint32_t     lastTickerTime;
     uint32_t     elapsedSinceLastTicker;
     iBool        running;
@@ -104,9 +146,20 @@ struct Impl_App {
     iStringList *launchCommands;
     iBool        isFinishedLaunching;
     iTime        lastDropTime; /* for detecting drops of multiple items */
+    /* Startup: */
+    uint64_t     launchTime;     /* performance counter */
+    iMutex *     traceMtx;
+    iArray       startupTrace;   /* StartupPhases in the order they finished */
+    iBool        isFirstFrameDrawn;
+    iMutex *     loaderMtx;
+    iThread *    loaders[max_AppLoader];
+    iAtomicInt   pendingLoaders; /* bit mask of loaders not yet joined */
+    iAtomicInt   isLoaded[max_AppLoader]; /* set by the loader when its data is ready */
+    iArray       pendingVisits; /* PendingVisits to record once the history is loaded */
     /* Preferences: */
     iBool        commandEcho;         /* --echo */
     iBool        forceSoftwareRender; /* --sw */
+    iBool        traceStartup;        /* --trace-startup */
     iRect        initialWindowRect;
     iPrefs       prefs;
 };
@@ -171,9 +224,17 @@ static iString *serializePrefs_App_(const iApp *d) {
     appendFormat_String(str, "zoom.set arg:%d\n", d->prefs.zoomPercent);
     appendFormat_String(str, "smoothscroll arg:%d\n", d->prefs.smoothScrolling);
     appendFormat_String(str, "imageloadscroll arg:%d\n", d->prefs.loadImageInsteadOfScrolling);
+    appendFormat_String(str, "prefetch arg:%d\n", d->prefs.prefetchLinks);
+    appendFormat_String(str, "tabs.hibernate.idle arg:%d\n", d->prefs.hibernateMinutes);
+    appendFormat_String(str, "audio.resampling arg:%d\n", d->prefs.resamplerQuality);
+    appendFormat_String(str, "audio.decodeahead arg:%d\n", d->prefs.decodeAheadMs);
+    appendFormat_String(str, "feeds.concurrency arg:%d\n", d->prefs.maxFeedRequests);
+    appendFormat_String(str, "media.concurrency arg:%d\n", d->prefs.maxMediaRequests);
+    appendFormat_String(str, "network.hostconcurrency arg:%d\n", d->prefs.maxRequestsPerHost);
     appendFormat_String(str, "linewidth.set arg:%d\n", d->prefs.lineWidth);
     appendFormat_String(str, "prefs.biglede.changed arg:%d\n", d->prefs.bigFirstParagraph);
     appendFormat_String(str, "prefs.sideicon.changed arg:%d\n", d->prefs.sideIcon);
+    appendFormat_String(str, "prefs.faststart arg:%d\n", d->prefs.fastStart);
     appendFormat_String(str, "quoteicon.set arg:%d\n", d->prefs.quoteIcon ? 1 : 0);
     appendFormat_String(str, "prefs.hoveroutline.changed arg:%d\n", d->prefs.hoverOutline);
     appendFormat_String(str, "theme.set arg:%d auto:1\n", d->prefs.theme);
@@ -229,11 +290,7 @@ static void loadPrefs_App_(iApp *d) {
 
 static void savePrefs_App_(const iApp *d) {
     iString *cfg = serializePrefs_App_(d);
-    iFile *f = new_File(prefsFileName_());
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        write_File(f, &cfg->chars);
-    }
-    iRelease(f);
+    save_Saver(d->saver, collect_String(newCStr_String(prefsFileName_())), &cfg->chars);
     delete_String(cfg);
 }
 
@@ -294,40 +351,196 @@ iObjectList *listDocuments_App(void) {
 }
 
 static void saveState_App_(const iApp *d) {
-    iUnused(d);
-    iFile *f = newCStr_File(concatPath_CStr(dataDir_App_, stateFileName_App_));
-    if (open_File(f, writeOnly_FileMode)) {
-        writeData_File(f, magicState_App_, 4);
-        writeU32_File(f, latest_FileVersion); /* version */
-        iConstForEach(ObjectList, i, iClob(listDocuments_App())) {
-            if (isInstance_Object(i.object, &Class_DocumentWidget)) {
-                writeData_File(f, magicTabDocument_App_, 4);
-                write8_File(f, document_App() == i.object ? 1 : 0);
-                serializeState_DocumentWidget(i.object, stream_File(f));
+    /* The state is serialized in memory, which is quick. Writing it is left to the saver. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    writeData_Stream(outs, magicState_App_, 4);
+    writeU32_Stream(outs, latest_FileVersion); /* version */
+    iConstForEach(ObjectList, i, iClob(listDocuments_App())) {
+        if (isInstance_Object(i.object, &Class_DocumentWidget)) {
+            writeData_Stream(outs, magicTabDocument_App_, 4);
+            write8_Stream(outs, document_App() == i.object ? 1 : 0);
+            serializeState_DocumentWidget(i.object, outs);
+        }
+    }
+    save_Saver(d->saver,
+               collect_String(newCStr_String(concatPath_CStr(dataDir_App_, stateFileName_App_))),
+               data_Buffer(buf));
+    iRelease(buf);
+}
+
+static uint32_t postAutoSave_App_(uint32_t interval, void *param) {
+    iUnused(param);
+    postCommand_App("state.autosave");
+    return interval;
+}
+
+static uint32_t postHibernate_App_(uint32_t interval, void *param) {
+    iUnused(param);
+    postCommand_App("tabs.hibernate");
+    return interval;
+}
+
+static int cmpIdleDescending_DocumentWidgetPtr_(const void *a, const void *b) {
+    const iDocumentWidget *const *d1 = a, *const *d2 = b;
+    return -iCmp(idleTime_DocumentWidget(*d1), idleTime_DocumentWidget(*d2));
+}
+
+static void hibernateTabs_App_(iApp *d, iBool isLowMemory) {
+    /* Background tabs idle for longer than the configured time are hibernated. If the tabs
+       still use more memory than the budget, the longest idle ones are hibernated until they
+       don't. When the system is low on memory, all background tabs are hibernated. */
+    const uint32_t minIdleTime = (uint32_t) d->prefs.hibernateMinutes * 60 * 1000;
+    iPtrArray *    awake       = iClob(new_PtrArray());
+    size_t         totalSize   = 0;
+    iForEach(ObjectList, i, iClob(listDocuments_App())) {
+        iDocumentWidget *doc = i.object;
+        if (doc == document_App() || isHibernated_DocumentWidget(doc)) {
+            continue;
+        }
+        if ((isLowMemory || (minIdleTime && idleTime_DocumentWidget(doc) >= minIdleTime)) &&
+            hibernate_DocumentWidget(doc)) {
+            continue;
+        }
+        totalSize += memorySize_DocumentWidget(doc);
+        pushBack_PtrArray(awake, doc);
+    }
+    sort_Array(awake, cmpIdleDescending_DocumentWidgetPtr_);
+    iConstForEach(PtrArray, j, awake) {
+        if (totalSize <= tabsMemoryBudget_App_) {
+            break;
+        }
+        iDocumentWidget *doc  = j.ptr;
+        const size_t     size = memorySize_DocumentWidget(doc);
+        if (hibernate_DocumentWidget(doc)) {
+            /* The response of the current page is kept in the history. */
+            totalSize -= size - iMin(size, memorySize_DocumentWidget(doc));
+        }
+    }
+}
+
+static void initExecPath_App_(iApp *d) {
+    /* Where was the app started from? */
+    char *exec = SDL_GetBasePath();
+    if (exec) {
+        d->execPath = newCStr_String(concatPath_CStr(
+            exec, cstr_Rangecc(baseName_Path(executablePath_CommandLine(&d->args)))));
+    }
+    else {
+        d->execPath = copy_String(executablePath_CommandLine(&d->args));
+    }
+    SDL_free(exec);
+}
+
+static void loadResources_App_(void) {
+#if defined (iHaveLoadEmbed)
+    /* Load the resources from a file. */ {
+        if (!load_Embed(concatPath_CStr(cstr_String(execPath_App()), EMB_BIN))) {
+            if (!load_Embed(concatPath_CStr(cstr_String(execPath_App()), EMB_BIN2))) {
+                fprintf(stderr, "failed to load resources: %s\n", strerror(errno));
+                exit(-1);
             }
         }
     }
-    iRelease(f);
+#endif
+}
+
+static void tracePhase_App_(iApp *d, const char *name) {
+    /* Called from the loader threads, too. */
+    const iStartupPhase phase = { name,
+                                  (SDL_GetPerformanceCounter() - d->launchTime) * 1000.0 /
+                                      SDL_GetPerformanceFrequency() };
+    iGuardMutex(d->traceMtx, pushBack_Array(&d->startupTrace, &phase));
+    if (d->traceStartup) {
+        printf("[startup] %8.2f ms: %s\n", phase.time, name);
+        fflush(stdout);
+    }
+}
+
+static iThreadResult loadVisited_App_(iThread *thd) {
+    iApp *d = userData_Thread(thd);
+    load_Visited(d->visited, dataDir_App_);
+    set_Atomic(&d->isLoaded[visited_AppLoader], iTrue);
+    tracePhase_App_(d, "visited (background)");
+    postCommand_App("visited.loaded");
+    return 0;
+}
+
+static iThreadResult loadCerts_App_(iThread *thd) {
+    iApp *d = userData_Thread(thd);
+    d->certs = new_GmCerts(dataDir_App_);
+    set_Atomic(&d->isLoaded[certs_AppLoader], iTrue);
+    tracePhase_App_(d, "identities (background)");
+    postCommand_App("idents.loaded");
+    return 0;
+}
+
+static void startLoader_App_(iApp *d, enum iAppLoader loader,
+                             iThreadResult (*run)(iThread *)) {
+    iThread *thd = new_Thread(run);
+    setUserData_Thread(thd, d);
+    iGuardMutex(d->loaderMtx, {
+        d->loaders[loader] = thd;
+        set_Atomic(&d->pendingLoaders, value_Atomic(&d->pendingLoaders) | (1 << loader));
+    });
+    start_Thread(thd);
+}
+
+static iBool isLoaded_App_(iApp *d, enum iAppLoader loader) {
+    return (value_Atomic(&d->pendingLoaders) & (1 << loader)) == 0 ||
+           value_Atomic(&d->isLoaded[loader]);
+}
+
+static void waitForLoader_App_(iApp *d, enum iAppLoader loader) {
+    /* The loaded data must not be accessed before the loader has finished. This is cheap
+       once the loader has been joined. */
+    if (value_Atomic(&d->pendingLoaders) & (1 << loader)) {
+        lock_Mutex(d->loaderMtx);
+        if (d->loaders[loader]) {
+            join_Thread(d->loaders[loader]);
+            iReleasePtr(&d->loaders[loader]);
+            set_Atomic(&d->pendingLoaders, value_Atomic(&d->pendingLoaders) & ~(1 << loader));
+        }
+        unlock_Mutex(d->loaderMtx);
+    }
+}
+
+static void recordPendingVisits_App_(iApp *d) {
+    if (!isEmpty_Array(&d->pendingVisits)) {
+        iVisited *visited = visited_App();
+        iForEach(Array, i, &d->pendingVisits) {
+            iPendingVisit *visit = i.value;
+            visitUrl_Visited(visited, visit->url, visit->flags);
+            delete_String(visit->url);
+        }
+        clear_Array(&d->pendingVisits);
+    }
 }
 
 static void init_App_(iApp *d, int argc, char **argv) {
+    d->launchTime          = SDL_GetPerformanceCounter();
+    d->traceMtx            = new_Mutex();
+    init_Array(&d->startupTrace, sizeof(iStartupPhase));
+    d->isFirstFrameDrawn   = iFalse;
+    d->loaderMtx           = new_Mutex();
+    iZap(d->loaders);
+    set_Atomic(&d->pendingLoaders, 0);
+    iForIndices(i, d->isLoaded) {
+        set_Atomic(&d->isLoaded[i], iFalse);
+    }
+    init_Array(&d->pendingVisits, sizeof(iPendingVisit));
     const iBool isFirstRun = !fileExistsCStr_FileInfo(cleanedPath_CStr(dataDir_App_));
     d->isFinishedLaunching = iFalse;
     d->launchCommands      = new_StringList();
     iZap(d->lastDropTime);
     init_CommandLine(&d->args, argc, argv);
-    /* Where was the app started from? */ {
-        char *exec = SDL_GetBasePath();
-        if (exec) {
-            d->execPath = newCStr_String(concatPath_CStr(
-                exec, cstr_Rangecc(baseName_Path(executablePath_CommandLine(&d->args)))));
-        }
-        else {
-            d->execPath = copy_String(executablePath_CommandLine(&d->args));
-        }
-        SDL_free(exec);
-    }
+    d->traceStartup        = checkArgument_CommandLine(&d->args, "trace-startup") != NULL;
+    initExecPath_App_(d);
     init_SortedArray(&d->tickers, sizeof(iTicker), cmp_Ticker_);
+    init_SortedArray(&d->runningTickers, sizeof(iTicker), cmp_Ticker_);
+    d->frameInterval          = 1000 / 60;
+    d->nextFrameTime          = 0;
     d->lastTickerTime         = SDL_GetTicks();
     d->elapsedSinceLastTicker = 0;
     d->commandEcho            = checkArgument_CommandLine(&d->args, "echo") != NULL;
@@ -342,18 +555,55 @@ static void init_App_(iApp *d, int argc, char **argv) {
     d->running           = iFalse;
     d->window            = NULL;
     set_Atomic(&d->pendingRefresh, iFalse);
-    d->certs             = new_GmCerts(dataDir_App_);
+    init_GmRequestQueue();
+    setTimingLog_GmRequestQueue(checkArgument_CommandLine(&d->args, "log-timing") != NULL);
+    /* Network traces for reproducible performance testing. */ {
+        const iCommandLineArg *record =
+            iClob(checkArgumentValues_CommandLine(&d->args, "record-trace", 1));
+        const iCommandLineArg *replay =
+            iClob(checkArgumentValues_CommandLine(&d->args, "replay-trace", 1));
+        const iCommandLineArg *speed =
+            iClob(checkArgumentValues_CommandLine(&d->args, "replay-speed", 1));
+        if (record && !setRecordTrace_GmRequestQueue(value_CommandLineArg(record, 0))) {
+            fprintf(stderr, "failed to create trace: %s\n",
+                    cstr_String(value_CommandLineArg(record, 0)));
+        }
+        if (replay && !setReplayTrace_GmRequestQueue(
+                          value_CommandLineArg(replay, 0),
+                          speed ? toFloat_String(value_CommandLineArg(speed, 0)) : 1.0f)) {
+            fprintf(stderr, "failed to load trace: %s\n",
+                    cstr_String(value_CommandLineArg(replay, 0)));
+        }
+    }
+    d->certs             = NULL; /* loaded after prefs */
     d->visited           = new_Visited();
     d->bookmarks         = new_Bookmarks();
+    d->saver             = new_Saver(); /* used by the response cache */
+    d->responseCache     = new_ResponseCache(dataDir_App_);
     d->tabEnum           = 0; /* generates unique IDs for tab pages */
     setThemePalette_Color(d->prefs.theme);
 #if defined (iPlatformApple)
     setupApplication_MacOS();
 #endif
     init_Keys();
+    tracePhase_App_(d, "init");
     loadPrefs_App_(d);
     load_Keys(dataDir_App_);
-    load_Visited(d->visited, dataDir_App_);
+    tracePhase_App_(d, "prefs");
+    /* In fast-start mode, the window and the active tab are shown without waiting for
+       the history, identities, and feeds to load. */
+    const iBool isFastStart =
+        d->prefs.fastStart || checkArgument_CommandLine(&d->args, "fast-start") != NULL;
+    if (isFastStart) {
+        startLoader_App_(d, visited_AppLoader, loadVisited_App_);
+        startLoader_App_(d, certs_AppLoader, loadCerts_App_);
+    }
+    else {
+        load_Visited(d->visited, dataDir_App_);
+        tracePhase_App_(d, "visited");
+        d->certs = new_GmCerts(dataDir_App_);
+        tracePhase_App_(d, "identities");
+    }
     load_Bookmarks(d->bookmarks, dataDir_App_);
     if (isFirstRun) {
         /* Create the default bookmarks for a quick start. */
@@ -378,25 +628,30 @@ static void init_App_(iApp *d, int argc, char **argv) {
                       NULL,
                       0x1f306);
     }
-#if defined (iHaveLoadEmbed)
-    /* Load the resources from a file. */ {
-        if (!load_Embed(concatPath_CStr(cstr_String(execPath_App()), EMB_BIN))) {
-            if (!load_Embed(concatPath_CStr(cstr_String(execPath_App()), EMB_BIN2))) {
-                fprintf(stderr, "failed to load resources: %s\n", strerror(errno));
-                exit(-1);
-            }
-        }
-    }
-#endif
+    tracePhase_App_(d, "bookmarks");
+    loadResources_App_();
+    tracePhase_App_(d, "resources");
     d->window = new_Window(d->initialWindowRect);
-    init_Feeds(dataDir_App_);
+    tracePhase_App_(d, "window and fonts");
+    if (isFastStart) {
+        initBackground_Feeds(dataDir_App_);
+    }
+    else {
+        init_Feeds(dataDir_App_);
+        tracePhase_App_(d, "feeds");
+    }
+    init_ImageDecoder();
+    init_MediaCache();
     /* Widget state init. */
     processEvents_App(postedEventsOnly_AppEventMode);
     if (!loadState_App_(d)) {
         postCommand_App("navigate.home");
     }
+    tracePhase_App_(d, "tabs");
     postCommand_App("window.unfreeze");
     d->isFinishedLaunching = iTrue;
+    d->autoSaveTimer = SDL_AddTimer(autoSaveInterval_App_, postAutoSave_App_, NULL);
+    d->hibernateTimer = SDL_AddTimer(hibernateInterval_App_, postHibernate_App_, NULL);
     /* Run any commands that were pending completion of launch. */ {
         iForEach(StringList, i, d->launchCommands) {
             postCommandString_App(i.value);
@@ -406,6 +661,11 @@ static void init_App_(iApp *d, int argc, char **argv) {
         iBool newTab = iFalse;
         for (size_t i = 1; i < size_StringList(args_CommandLine(&d->args)); i++) {
             const iString *arg = constAt_StringList(args_CommandLine(&d->args), i);
+            if (!cmp_String(arg, "--record-trace") || !cmp_String(arg, "--replay-trace") ||
+                !cmp_String(arg, "--replay-speed")) {
+                i++; /* the value is not a URL */
+                continue;
+            }
             const iBool    isKnownScheme =
                 startsWithCase_String(arg, "gemini:") || startsWithCase_String(arg, "gopher:") ||
                 startsWithCase_String(arg, "file:")   || startsWithCase_String(arg, "data:")   ||
@@ -422,8 +682,17 @@ static void init_App_(iApp *d, int argc, char **argv) {
 }
 
 static void deinit_App(iApp *d) {
+    for (int i = 0; i < max_AppLoader; i++) {
+        waitForLoader_App_(d, i);
+    }
+    recordPendingVisits_App_(d);
+    deinit_Array(&d->pendingVisits);
+    SDL_RemoveTimer(d->autoSaveTimer);
+    SDL_RemoveTimer(d->hibernateTimer);
     saveState_App_(d);
     deinit_Feeds();
+    deinit_MediaCache();
+    deinit_ImageDecoder();
     save_Keys(dataDir_App_);
     deinit_Keys();
     savePrefs_App_(d);
@@ -432,14 +701,55 @@ static void deinit_App(iApp *d) {
     delete_Bookmarks(d->bookmarks);
     save_Visited(d->visited, dataDir_App_);
     delete_Visited(d->visited);
+    delete_ResponseCache(d->responseCache);
     delete_GmCerts(d->certs);
+    delete_Saver(d->saver); /* finishes writing */
     deinit_SortedArray(&d->tickers);
+    deinit_SortedArray(&d->runningTickers);
     delete_Window(d->window);
     d->window = NULL;
     deinit_CommandLine(&d->args);
     iRelease(d->launchCommands);
     delete_String(d->execPath);
+    delete_Mutex(d->loaderMtx);
+    deinit_Array(&d->startupTrace);
+    delete_Mutex(d->traceMtx);
+    iRecycle();
+    deinit_GmRequestQueue();
+}
+
+void initHeadless_App(int argc, char **argv) {
+    /* Sets up only what documents need for layout and drawing. Nothing is read from the
+       data directory, so the defaults are used regardless of who runs it. */
+    iApp *d = &app_;
+    d->isFinishedLaunching = iTrue;
+    d->launchCommands      = new_StringList();
+    init_CommandLine(&d->args, argc, argv);
+    initExecPath_App_(d);
+    init_SortedArray(&d->tickers, sizeof(iTicker), cmp_Ticker_);
+    init_SortedArray(&d->runningTickers, sizeof(iTicker), cmp_Ticker_);
+    init_Prefs(&d->prefs);
+    init_GmRequestQueue();
+    d->visited = new_Visited();
+    setThemePalette_Color(d->prefs.theme);
+    loadResources_App_();
+    init_ImageDecoder();
+    init_MediaCache();
+}
+
+void deinitHeadless_App(void) {
+    iApp *d = &app_;
+    deinit_MediaCache();
+    deinit_ImageDecoder();
+    delete_Visited(d->visited);
+    deinit_Prefs(&d->prefs);
+    deinit_SortedArray(&d->tickers);
+    deinit_SortedArray(&d->runningTickers);
+    deinit_CommandLine(&d->args);
+    iRelease(d->launchCommands);
+    delete_String(d->execPath);
     iRecycle();
+    deinit_GmRequestQueue();
 }
 
 const iString *execPath_App(void) {
@@ -454,6 +764,61 @@ const iString *downloadDir_App(void) {
     return collect_String(cleaned_Path(&app_.prefs.downloadDir));
 }
 
+const iString *downloadPathForUrl_App(const iString *url, const iString *mime) {
+    /* Figure out a file name from the URL. */
+    iUrl parts;
+    init_Url(&parts, url);
+    while (startsWith_Rangecc(parts.path, "/")) {
+        parts.path.start++;
+    }
+    while (endsWith_Rangecc(parts.path, "/")) {
+        parts.path.end--;
+    }
+    iString *name = collectNewCStr_String("pagecontent");
+    if (isEmpty_Range(&parts.path)) {
+        if (!isEmpty_Range(&parts.host)) {
+            setRange_String(name, parts.host);
+            replace_Block(&name->chars, '.', '_');
+        }
+    }
+    else {
+        iRangecc fn = { parts.path.start + lastIndexOfCStr_Rangecc(parts.path, "/") + 1,
+                        parts.path.end };
+        if (!isEmpty_Range(&fn)) {
+            setRange_String(name, fn);
+        }
+    }
+    if (startsWith_String(name, "~")) {
+        /* This would be interpreted as a reference to a home directory. */
+        remove_Block(&name->chars, 0, 1);
+    }
+    iString *savePath = collect_String(concat_Path(downloadDir_App(), name));
+    if (lastIndexOfCStr_String(savePath, ".") == iInvalidPos) {
+        /* No extension specified in URL. */
+        if (startsWith_String(mime, "text/gemini")) {
+            appendCStr_String(savePath, ".gmi");
+        }
+        else if (startsWith_String(mime, "text/")) {
+            appendCStr_String(savePath, ".txt");
+        }
+        else if (startsWith_String(mime, "image/")) {
+            appendCStr_String(savePath, cstr_String(mime) + 6);
+        }
+    }
+    if (fileExists_FileInfo(savePath)) {
+        /* Make it unique. */
+        iDate now;
+        initCurrent_Date(&now);
+        size_t insPos = lastIndexOfCStr_String(savePath, ".");
+        if (insPos == iInvalidPos) {
+            insPos = size_String(savePath);
+        }
+        const iString *date = collect_String(format_Date(&now, "_%Y-%m-%d_%H%M%S"));
+        insertData_Block(&savePath->chars, insPos, cstr_String(date), size_String(date));
+    }
+    return savePath;
+}
+
 const iString *debugInfo_App(void) {
     iApp *d = &app_;
     iString *msg = collectNew_String();
@@ -466,24 +831,147 @@ const iString *debugInfo_App(void) {
     iConstForEach(StringList, j, d->launchCommands) {
         appendFormat_String(msg, "%s\n", cstr_String(j.value));
     }
+    appendFormat_String(msg, "## Startup\n");
+    iGuardMutex(d->traceMtx, {
+        iConstForEach(Array, k, &d->startupTrace) {
+            const iStartupPhase *phase = k.value;
+            appendFormat_String(msg, "* %.1f ms: %s\n", phase->time, phase->name);
+        }
+    });
+    appendFormat_String(msg, "## Memory\n");
+    appendFormat_String(msg, "Cached responses: %.1f MB\n", cacheSize_History() / 1.0e6);
+    appendFormat_String(msg, "## Recent requests\n");
+    append_String(msg, recentTimings_GmRequestQueue());
     return msg;
 }
 
-iLocalDef iBool isWaitingAllowed_App_(iApp *d) {
-    return !value_Atomic(&d->pendingRefresh) && isEmpty_SortedArray(&d->tickers);
+static const char *formatBytes_(size_t numBytes) {
+    if (numBytes < 1000) {
+        return cstr_String(collectNewFormat_String("%zu bytes", numBytes));
+    }
+    if (numBytes < 1000000) {
+        return cstr_String(collectNewFormat_String("%.1f KB", numBytes / 1.0e3));
+    }
+    return cstr_String(collectNewFormat_String("%.1f MB", numBytes / 1.0e6));
+}
+
+const iString *memoryInfo_App(void) {
+    iApp *d = &app_;
+    iString *msg = collectNew_String();
+    format_String(msg, "# Memory usage\n");
+    appendCStr_String(msg, "Sizes are approximate. Images shown in several tabs are included "
+                           "in each of them.\n");
+    appendFormat_String(msg, "## Tabs\n");
+    size_t numTab = 0;
+    size_t audioBytes = 0;
+    iForEach(ObjectList, i, iClob(listDocuments_App())) {
+        iDocumentWidget *  doc = i.object;
+        iGmDocumentMemory  docMem;
+        iMediaMemory       mediaMem;
+        memoryUsage_GmDocument(document_DocumentWidget(doc), &docMem);
+        memoryUsage_Media(constMedia_GmDocument(document_DocumentWidget(doc)), &mediaMem);
+        audioBytes += mediaMem.audioBytes;
+        appendFormat_String(msg, "### %zu. %s\n", ++numTab, cstr_String(url_DocumentWidget(doc)));
+        appendFormat_String(msg, "* Source: %s\n", formatBytes_(docMem.sourceBytes));
+        appendFormat_String(msg, "* Layout: %zu runs, %s", docMem.numRuns,
+                            formatBytes_(docMem.layoutBytes));
+        appendFormat_String(msg, " (other widths: %s)\n", formatBytes_(docMem.cachedLayoutBytes));
+        appendFormat_String(msg, "* Links: %zu, %s\n", docMem.numLinks,
+                            formatBytes_(docMem.linkBytes));
+        appendFormat_String(msg, "* Images: %s compressed", formatBytes_(mediaMem.imageBytes));
+        appendFormat_String(msg, ", %s decoding", formatBytes_(mediaMem.decodingBytes));
+        appendFormat_String(msg, ", %s textures\n", formatBytes_(mediaMem.textureBytes));
+        appendFormat_String(msg, "* Audio: %s\n", formatBytes_(mediaMem.audioBytes));
+        appendFormat_String(msg, "* Cached responses: %s\n",
+                            formatBytes_(cachedBytes_History(history_DocumentWidget(doc))));
+    }
+    appendFormat_String(msg, "## Caches\n");
+    appendFormat_String(msg, "* Image textures: %s\n", formatBytes_(textureBytes_MediaCache()));
+    appendFormat_String(msg, "* Media cache: %zu images, %s not shown on any page\n",
+                        numImages_MediaCache(), formatBytes_(releasedBytes_MediaCache()));
+    appendFormat_String(msg, "* Audio buffers: %s\n", formatBytes_(audioBytes));
+    appendFormat_String(msg, "* Cached responses: %s\n", formatBytes_(cacheSize_History()));
+    const iTextCacheStats glyphs = cacheStats_Text();
+    appendFormat_String(msg, "* Glyph cache: %zu pages, %s\n", glyphs.numPages,
+                        formatBytes_(cacheBytes_Text()));
+    appendFormat_String(msg, "* Retained text: %s\n", formatBytes_(retainedBytes_Text()));
+    appendFormat_String(msg, "### Glyph cache occupancy\n");
+    const double cacheArea = (double) glyphs.numPages * cachePageSize_Text();
+    for (int fontId = 0; fontId < max_FontId; fontId++) {
+        const iFontCacheStats font = fontCacheStats_Text(fontId);
+        if (font.numGlyphs) {
+            appendFormat_String(msg, "* Font %d (%d px): %zu glyphs, %.1f%% of the pages\n",
+                                fontId, font.height, font.numGlyphs,
+                                cacheArea > 0 ? 100.0 * font.numPixels / cacheArea : 0.0);
+        }
+    }
+    appendFormat_String(msg, "## Stores\n");
+    appendFormat_String(msg, "* Visited: %zu URLs, %s\n", size_Visited(visited_App()),
+                        formatBytes_(memorySize_Visited(visited_App())));
+    appendFormat_String(msg, "* Bookmarks: %zu, %s\n", size_Bookmarks(d->bookmarks),
+                        formatBytes_(memorySize_Bookmarks(d->bookmarks)));
+    appendFormat_String(msg, "* Feed entries: %zu, %s\n", numEntries_Feeds(),
+                        formatBytes_(memorySize_Feeds()));
+    appendFormat_String(msg, "## Purge\n");
+    appendCStr_String(msg,
+                      "=> about:memory?purge=textures Release image textures\n"
+                      "=> about:memory?purge=images Forget images not shown on any page\n"
+                      "=> about:memory?purge=responses Drop cached responses of past pages\n"
+                      "=> about:memory?purge=layouts Drop layouts of other window widths\n"
+                      "=> about:memory?purge=glyphs Empty the glyph cache\n"
+                      "=> about:memory?purge=all Purge all of the above\n");
+    return msg;
+}
+
+void purgeMemory_App(iRangecc cache) {
+    const iBool isAll = equal_Rangecc(cache, "all");
+    if (isAll || equal_Rangecc(cache, "textures")) {
+        releaseTextures_MediaCache();
+    }
+    if (isAll || equal_Rangecc(cache, "images")) {
+        purge_MediaCache();
+    }
+    if (isAll || equal_Rangecc(cache, "responses")) {
+        purgeCache_History();
+    }
+    if (isAll || equal_Rangecc(cache, "layouts")) {
+        iConstForEach(ObjectList, i, iClob(listDocuments_App())) {
+            purgeLayoutCache_GmDocument(
+                iConstCast(iGmDocument *, document_DocumentWidget(i.object)));
+        }
+    }
+    if (isAll || equal_Rangecc(cache, "glyphs")) {
+        resetFonts_Text();
+    }
+    refresh_App();
+}
+
+static iBool nextEvent_App_(iApp *d, enum iAppEventMode eventMode, SDL_Event *event) {
+    if (eventMode == waitForNewEvents_AppEventMode && !value_Atomic(&d->pendingRefresh)) {
+        if (isEmpty_SortedArray(&d->tickers)) {
+            return SDL_WaitEvent(event);
+        }
+        /* Sleep until the next frame is due, unless an event arrives before that. */
+        const uint32_t now = SDL_GetTicks();
+        if (!SDL_TICKS_PASSED(now, d->nextFrameTime)) {
+            return SDL_WaitEventTimeout(event, d->nextFrameTime - now);
+        }
+    }
+    return SDL_PollEvent(event);
 }
 
 void processEvents_App(enum iAppEventMode eventMode) {
     iApp *d = &app_;
     SDL_Event ev;
-    while ((isWaitingAllowed_App_(d) && eventMode == waitForNewEvents_AppEventMode &&
-            SDL_WaitEvent(&ev)) ||
-           ((!isWaitingAllowed_App_(d) || eventMode == postedEventsOnly_AppEventMode) &&
-            SDL_PollEvent(&ev))) {
+    while (nextEvent_App_(d, eventMode, &ev)) {
         switch (ev.type) {
             case SDL_QUIT:
                 d->running = iFalse;
                 goto backToMainLoop;
+            case SDL_APP_LOWMEMORY:
+                hibernateTabs_App_(d, iTrue);
+                purge_MediaCache();
+                break;
             case SDL_DROPFILE: {
                 iBool newTab = iFalse;
                 if (elapsedSeconds_Time(&d->lastDropTime) < 0.1) {
@@ -502,6 +990,7 @@ void processEvents_App(enum iAppEventMode eventMode) {
                 break;
             }
             default: {
+                iBeginProfile(events);
                 iBool wasUsed = processEvent_Window(d->window, &ev);
                 if (!wasUsed) {
                     /* There may be a key bindings for this. */
@@ -514,13 +1003,16 @@ void processEvents_App(enum iAppEventMode eventMode) {
                     if (isCommand_UserEvent(&ev, "metrics.changed")) {
                         arrange_Widget(d->window->root);
                     }
-                    if (!wasUsed) {
-                        /* No widget handled the command, so we'll do it. */
+                    if (!wasUsed && commandId_UserEvent(&ev) == none_CommandId) {
+                        /* No widget handled the command, so we'll do it. The interned
+                           commands are frequent notifications meant for widgets. The app
+                           handles none of them, so they skip the string comparisons. */
                         handleCommand_App(ev.user.data1);
                     }
                     /* Allocated by postCommand_Apps(). */
                     free(ev.user.data1);
                 }
+                iEndProfile(events);
                 break;
             }
         }
@@ -528,25 +1020,47 @@ void processEvents_App(enum iAppEventMode eventMode) {
 backToMainLoop:;
 }
 
+static uint32_t frameInterval_App_(const iApp *d) {
+    SDL_DisplayMode mode;
+    if (d->window && SDL_GetWindowDisplayMode(d->window->win, &mode) == 0 &&
+        mode.refresh_rate > 0) {
+        return iMax(1, 1000 / mode.refresh_rate);
+    }
+    return 1000 / 60;
+}
+
 static void runTickers_App_(iApp *d) {
     const uint32_t now = SDL_GetTicks();
-    d->elapsedSinceLastTicker = (d->lastTickerTime ? now - d->lastTickerTime : 0);
-    d->lastTickerTime = now;
     if (isEmpty_SortedArray(&d->tickers)) {
+        d->elapsedSinceLastTicker = 0;
         d->lastTickerTime = 0;
         return;
     }
-    /* Tickers may add themselves again, so we'll run off a copy. */
-    iSortedArray *pending = copy_SortedArray(&d->tickers);
+    if (!d->lastTickerTime) {
+        /* Animation is starting; the window may have moved to a different display. */
+        d->frameInterval = frameInterval_App_(d);
+    }
+    else if (!SDL_TICKS_PASSED(now, d->nextFrameTime)) {
+        return; /* woken up early by an event */
+    }
+    d->elapsedSinceLastTicker = (d->lastTickerTime ? now - d->lastTickerTime : 0);
+    d->lastTickerTime = now;
+    /* Keep a steady cadence, but don't try to catch up with missed frames. */
+    d->nextFrameTime += d->frameInterval;
+    if (SDL_TICKS_PASSED(now, d->nextFrameTime)) {
+        d->nextFrameTime = now + d->frameInterval;
+    }
+    /* Tickers may add themselves again, so the ones due now are moved aside. */
+    iSwap(iSortedArray, d->tickers, d->runningTickers);
     clear_SortedArray(&d->tickers);
-    postRefresh_App();
-    iConstForEach(Array, i, &pending->values) {
+    postRefreshDamage_App(); /* tickers refresh the widgets they animate */
+    iConstForEach(Array, i, &d->runningTickers.values) {
         const iTicker *ticker = i.value;
         if (ticker->callback) {
             ticker->callback(ticker->context);
         }
     }
-    delete_SortedArray(pending);
+    clear_SortedArray(&d->runningTickers);
     if (isEmpty_SortedArray(&d->tickers)) {
         d->lastTickerTime = 0;
     }
@@ -589,6 +1103,10 @@ void refresh_App(void) {
     destroyPending_Widget();
     draw_Window(d->window);
     set_Atomic(&d->pendingRefresh, iFalse);
+    if (!d->isFirstFrameDrawn && !d->window->isDrawFrozen) {
+        d->isFirstFrameDrawn = iTrue;
+        tracePhase_App_(d, "first frame");
+    }
 }
 
 iBool isRefreshPending_App(void) {
@@ -642,6 +1160,13 @@ int run_App(int argc, char **argv) {
 }
 
 void postRefresh_App(void) {
+    if (get_Window()) {
+        invalidate_Window(get_Window());
+    }
+    postRefreshDamage_App();
+}
+
+void postRefreshDamage_App(void) {
     iApp *d = &app_;
     const iBool wasPending = exchange_Atomic(&d->pendingRefresh, iTrue);
     if (!wasPending) {
@@ -675,7 +1200,7 @@ void postCommand_App(const char *command) {
     ev.user.code     = command_UserEventCode;
     ev.user.windowID = get_Window() ? SDL_GetWindowID(get_Window()->win) : 0;
     ev.user.data1    = strdup(command);
-    ev.user.data2    = NULL;
+    ev.user.data2    = (void *) (intptr_t) id_Command(command);
     SDL_PushEvent(&ev);
     if (app_.commandEcho) {
         printf("[command] %s\n", command); fflush(stdout);
@@ -701,22 +1226,56 @@ iAny *findWidget_App(const char *id) {
 void addTicker_App(iTickerFunc ticker, iAny *context) {
     iApp *d = &app_;
     insert_SortedArray(&d->tickers, &(iTicker){ context, ticker });
-    postRefresh_App();
+    postRefreshDamage_App();
 }
 
 void removeTicker_App(iTickerFunc ticker, iAny *context) {
     iApp *d = &app_;
-    remove_SortedArray(&d->tickers, &(iTicker){ context, ticker });
+    const iTicker key = { context, ticker };
+    size_t        pos;
+    remove_SortedArray(&d->tickers, &key);
+    /* It may also be waiting to be called on the current frame. */
+    if (locate_SortedArray(&d->runningTickers, &key, &pos)) {
+        ((iTicker *) at_Array(&d->runningTickers.values, pos))->callback = NULL;
+    }
 }
 
 iGmCerts *certs_App(void) {
+    waitForLoader_App_(&app_, certs_AppLoader);
     return app_.certs;
 }
 
+const iGmCerts *loadedCerts_App(void) {
+    return isLoaded_App_(&app_, certs_AppLoader) ? app_.certs : NULL;
+}
+
 iVisited *visited_App(void) {
+    waitForLoader_App_(&app_, visited_AppLoader);
     return app_.visited;
 }
 
+const iVisited *loadedVisited_App(void) {
+    return isLoaded_App_(&app_, visited_AppLoader) ? app_.visited : NULL;
+}
+
+void visitUrl_App(const iString *url, uint16_t visitFlags) {
+    iApp *d = &app_;
+    if (isLoaded_App_(d, visited_AppLoader) && isEmpty_Array(&d->pendingVisits)) {
+        visitUrl_Visited(visited_App(), url, visitFlags);
+    }
+    else if (!isEmpty_String(url)) {
+        pushBack_Array(&d->pendingVisits, &(iPendingVisit){ copy_String(url), visitFlags });
+    }
+}
+
+iResponseCache *responseCache_App(void) {
+    return app_.responseCache;
+}
+
+iSaver *saver_App(void) {
+    return app_.saver;
+}
+
 iBookmarks *bookmarks_App(void) {
     return app_.bookmarks;
 }
@@ -753,6 +1312,8 @@ static iBool handlePrefsCommands_(iWidget *d, const char *cmd) {
                          isSelected_Widget(findChild_Widget(d, "prefs.smoothscroll")));
         postCommandf_App("imageloadscroll arg:%d",
                          isSelected_Widget(findChild_Widget(d, "prefs.imageloadscroll")));
+        postCommandf_App("prefetch arg:%d",
+                         isSelected_Widget(findChild_Widget(d, "prefs.prefetch")));
         postCommandf_App("ostheme arg:%d",
                          isSelected_Widget(findChild_Widget(d, "prefs.ostheme")));
         postCommandf_App("proxy.gemini address:%s",
@@ -894,7 +1455,7 @@ static iBool handleIdentityCreationCommands_(iWidget *dlg, const char *cmd) {
                 }
             }
             /* The input seems fine. */
-            newIdentity_GmCerts(d->certs, isTemp ? temporary_GmIdentityFlag : 0,
+            newIdentity_GmCerts(certs_App(), isTemp ? temporary_GmIdentityFlag : 0,
                                 until, commonName, email, userId, domain, organization, country);
             postCommandf_App("sidebar.mode arg:%d show:1", identities_SidebarMode);
             postCommand_App("idents.changed");
@@ -915,6 +1476,19 @@ iBool handleCommand_App(const char *cmd) {
         d->prefs.dialogTab = arg_Command(cmd);
         return iTrue;
     }
+    else if (equal_Command(cmd, "tabs.hibernate")) {
+        hibernateTabs_App_(d, iFalse);
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "tabs.hibernate.idle")) {
+        d->prefs.hibernateMinutes = iMax(0, arg_Command(cmd));
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "state.autosave")) {
+        saveState_App_(d);
+        savePrefs_App_(d);
+        return iTrue;
+    }
     else if (equal_Command(cmd, "window.retain")) {
         d->prefs.retainWindowSize = arg_Command(cmd);
         return iTrue;
@@ -939,6 +1513,13 @@ iBool handleCommand_App(const char *cmd) {
         postCommand_App("window.unfreeze");
         return iTrue;
     }
+#if defined (LAGRANGE_PROFILER)
+    else if (equal_Command(cmd, "profiler.toggle")) {
+        setVisible_Profiler(!isVisible_Profiler());
+        postRefresh_App();
+        return iTrue;
+    }
+#endif
     else if (equal_Command(cmd, "zoom.set")) {
         setFreezeDraw_Window(get_Window(), iTrue); /* no intermediate draws before docs updated */
         d->prefs.zoomPercent = arg_Command(cmd);
@@ -959,6 +1540,10 @@ iBool handleCommand_App(const char *cmd) {
         postCommand_App("window.unfreeze");
         return iTrue;
     }
+    else if (equal_Command(cmd, "prefs.faststart")) {
+        d->prefs.fastStart = arg_Command(cmd) != 0; /* takes effect on the next launch */
+        return iTrue;
+    }
     else if (equal_Command(cmd, "smoothscroll")) {
         d->prefs.smoothScrolling = arg_Command(cmd);
         return iTrue;
@@ -967,6 +1552,34 @@ iBool handleCommand_App(const char *cmd) {
         d->prefs.loadImageInsteadOfScrolling = arg_Command(cmd);
         return iTrue;
     }
+    else if (equal_Command(cmd, "prefetch")) {
+        d->prefs.prefetchLinks = arg_Command(cmd);
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "feeds.concurrency")) {
+        d->prefs.maxFeedRequests = iClamp(arg_Command(cmd), 1, 32);
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "audio.resampling")) {
+        d->prefs.resamplerQuality =
+            iClamp(arg_Command(cmd), linear_ResamplerQuality, cubic_ResamplerQuality);
+        setResamplerQuality_Player(d->prefs.resamplerQuality);
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "audio.decodeahead")) {
+        d->prefs.decodeAheadMs = iClamp(arg_Command(cmd), 50, 10000);
+        setDecodeAhead_Player(d->prefs.decodeAheadMs);
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "media.concurrency")) {
+        d->prefs.maxMediaRequests = iClamp(arg_Command(cmd), 1, 32);
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "network.hostconcurrency")) {
+        d->prefs.maxRequestsPerHost = iClamp(arg_Command(cmd), 1, 8);
+        setMaxActivePerHost_GmRequestQueue(d->prefs.maxRequestsPerHost);
+        return iTrue;
+    }
     else if (equal_Command(cmd, "theme.set")) {
         const int isAuto = argLabel_Command(cmd, "auto");
         d->prefs.theme = arg_Command(cmd);
@@ -1052,8 +1665,32 @@ iBool handleCommand_App(const char *cmd) {
         setCStr_String(&d->prefs.downloadDir, suffixPtr_Command(cmd, "path"));
         return iTrue;
     }
+    else if (equal_Command(cmd, "visited.loaded")) {
+        /* Loaded in the background in fast-start mode. */
+        recordPendingVisits_App_(d);
+        postCommand_App("visited.changed");
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "idents.loaded")) {
+        waitForLoader_App_(d, certs_AppLoader);
+        postCommand_App("idents.changed");
+        return iTrue;
+    }
+    else if (equal_Command(cmd, "memory.purge")) {
+        purgeMemory_App(range_Command(cmd, "cache"));
+        if (!cmp_String(url_DocumentWidget(document_App()), "about:memory")) {
+            postCommand_App("navigate.reload");
+        }
+        return iTrue;
+    }
     else if (equal_Command(cmd, "open")) {
         const iString *url = collectNewCStr_String(suffixPtr_Command(cmd, "url"));
+        if (startsWithCase_String(url, "about:memory?purge=")) {
+            /* Purge links are not navigated to, so the purge does not repeat on reload or
+               when the page is restored from history. */
+            postCommandf_App("memory.purge cache:%s", cstr_String(url) + 19);
+            return iTrue;
+        }
         const iBool noProxy = argLabel_Command(cmd, "noproxy");
         iUrl parts;
         init_Url(&parts, url);
@@ -1161,6 +1798,7 @@ iBool handleCommand_App(const char *cmd) {
         setToggle_Widget(findChild_Widget(dlg, "prefs.hoveroutline"), d->prefs.hoverOutline);
         setToggle_Widget(findChild_Widget(dlg, "prefs.smoothscroll"), d->prefs.smoothScrolling);
         setToggle_Widget(findChild_Widget(dlg, "prefs.imageloadscroll"), d->prefs.loadImageInsteadOfScrolling);
+        setToggle_Widget(findChild_Widget(dlg, "prefs.prefetch"), d->prefs.prefetchLinks);
         setToggle_Widget(findChild_Widget(dlg, "prefs.ostheme"), d->prefs.useSystemTheme);
         setToggle_Widget(findChild_Widget(dlg, "prefs.retainwindow"), d->prefs.retainWindowSize);
         setText_InputWidget(findChild_Widget(dlg, "prefs.uiscale"),
@@ -1204,9 +1842,7 @@ iBool handleCommand_App(const char *cmd) {
     }
     else if (equal_Command(cmd, "navigate.home")) {
         /* Look for bookmarks tagged "homepage". */
-        iRegExp *pattern = iClob(new_RegExp("\\bhomepage\\b", caseInsensitive_RegExpOption));
-        const iPtrArray *homepages =
-            list_Bookmarks(d->bookmarks, NULL, filterTagsRegExp_Bookmarks, pattern);
+        const iPtrArray *homepages = listTagged_Bookmarks(d->bookmarks, "homepage", NULL);
         if (isEmpty_PtrArray(homepages)) {
             postCommand_App("open url:about:lagrange");
         }
@@ -1246,6 +1882,7 @@ iBool handleCommand_App(const char *cmd) {
             uint32_t id = findUrl_Bookmarks(d->bookmarks, url);
             if (id) {
                 addTag_Bookmark(get_Bookmarks(d->bookmarks, id), cstr_String(tag));
+                markEdited_Bookmarks(d->bookmarks, id);
             }
             else {
                 add_Bookmarks(d->bookmarks, url, bookmarkTitle_DocumentWidget(document_App()),
@@ -1259,8 +1896,8 @@ iBool handleCommand_App(const char *cmd) {
         return iTrue;
     }
     else if (equal_Command(cmd, "bookmarks.changed")) {
-        save_Bookmarks(d->bookmarks, dataDir_App_);
-        return iFalse;
+        bookmarksChanged_Feeds();
+        return iFalse; /* changes have been journaled */
     }
     else if (equal_Command(cmd, "feeds.refresh")) {
         refresh_Feeds();
@@ -1277,10 +1914,6 @@ iBool handleCommand_App(const char *cmd) {
         refresh_App();
         return iFalse;
     }
-    else if (equal_Command(cmd, "visited.changed")) {
-        save_Visited(d->visited, dataDir_App_);
-        return iFalse;
-    }
     else if (equal_Command(cmd, "ident.new")) {
         iWidget *dlg = makeIdentityCreation_Widget();
         setCommandHandler_Widget(dlg, handleIdentityCreationCommands_);
@@ -1289,15 +1922,15 @@ iBool handleCommand_App(const char *cmd) {
     else if (equal_Command(cmd, "ident.signin")) {
         const iString *url = collect_String(suffix_Command(cmd, "url"));
         signIn_GmCerts(
-            d->certs,
-            findIdentity_GmCerts(d->certs, collect_Block(hexDecode_Rangecc(range_Command(cmd, "ident")))),
+            certs_App(),
+            findIdentity_GmCerts(certs_App(), collect_Block(hexDecode_Rangecc(range_Command(cmd, "ident")))),
             url);
         postCommand_App("idents.changed");
         return iTrue;
     }
     else if (equal_Command(cmd, "ident.signout")) {
         iGmIdentity *ident = findIdentity_GmCerts(
-            d->certs, collect_Block(hexDecode_Rangecc(range_Command(cmd, "ident"))));
+            certs_App(), collect_Block(hexDecode_Rangecc(range_Command(cmd, "ident"))));
         if (arg_Command(cmd)) {
             clearUse_GmIdentity(ident);
         }
@@ -34,6 +34,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDeclareType(Bookmarks)
 iDeclareType(DocumentWidget)
 iDeclareType(GmCerts)
+iDeclareType(ResponseCache)
+iDeclareType(Saver)
 iDeclareType(Visited)
 iDeclareType(Window)
 
@@ -50,9 +52,14 @@ enum iUserEventCode {
 const iString *execPath_App     (void);
 const iString *dataDir_App      (void);
 const iString *downloadDir_App  (void);
+const iString *downloadPathForUrl_App(const iString *url, const iString *mime);
 const iString *debugInfo_App    (void);
+const iString *memoryInfo_App   (void);
+void           purgeMemory_App  (iRangecc cache); /* "textures", "images", ..., or "all" */
 
 int         run_App                     (int argc, char **argv);
+void        initHeadless_App            (int argc, char **argv); /* no window or saved state */
+void        deinitHeadless_App          (void);
 void        processEvents_App           (enum iAppEventMode mode);
 iBool       handleCommand_App           (const char *cmd);
 void        refresh_App                 (void);
@@ -65,9 +72,14 @@ enum iColorTheme    colorTheme_App      (void);
 const iString *     schemeProxy_App     (iRangecc scheme);
 iBool               willUseProxy_App    (const iRangecc scheme);
 
-iGmCerts *          certs_App           (void);
-iVisited *          visited_App         (void);
+iGmCerts *          certs_App           (void); /* waits for the identities to load */
+const iGmCerts *    loadedCerts_App     (void); /* NULL until loaded, then "idents.changed" */
+iVisited *          visited_App         (void); /* waits for the history to load */
+const iVisited *    loadedVisited_App   (void); /* NULL until loaded, then "visited.changed" */
+void                visitUrl_App        (const iString *url, uint16_t visitFlags); /* no wait */
 iBookmarks *        bookmarks_App       (void);
+iResponseCache *    responseCache_App   (void);
+iSaver *            saver_App           (void); /* writes files in the background */
 iDocumentWidget *   document_App        (void);
 iObjectList *       listDocuments_App   (void);
 iDocumentWidget *   document_Command    (const char *cmd);
@@ -79,6 +91,7 @@ iAny *      findWidget_App      (const char *id);
 void        addTicker_App       (iTickerFunc ticker, iAny *context);
 void        removeTicker_App    (iTickerFunc ticker, iAny *context);
 void        postRefresh_App     (void);
+void        postRefreshDamage_App (void); /* only the damaged regions of the window */
 void        postCommand_App     (const char *command);
 void        postCommandf_App    (const char *command, ...);
 
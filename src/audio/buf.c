@@ -28,6 +28,7 @@ void init_InputBuf(iInputBuf *d) {
     init_Mutex(&d->mtx);
     init_Condition(&d->changed);
     init_Block(&d->data, 0);
+    d->capacity   = 0;
     d->isComplete = iTrue;
 }
 
@@ -52,18 +53,27 @@ void init_SampleBuf(iSampleBuf *d, SDL_AudioFormat format, size_t numChannels, s
     d->sampleSize  = SDL_AUDIO_BITSIZE(format) / 8 * numChannels;
     d->count       = count + 1; /* considered empty if head==tail */
     d->data        = malloc(d->sampleSize * d->count);
-    d->head        = 0;
-    d->tail        = 0;
-    init_Condition(&d->moreNeeded);
+    set_Atomic(&d->head, 0);
+    set_Atomic(&d->tail, 0);
+    d->moreNeeded  = SDL_CreateSemaphore(0);
 }
 
 void deinit_SampleBuf(iSampleBuf *d) {
-    deinit_Condition(&d->moreNeeded);
+    SDL_DestroySemaphore(d->moreNeeded);
     free(d->data);
 }
 
+iLocalDef size_t head_SampleBuf_(const iSampleBuf *d) {
+    return value_Atomic(iConstCast(iAtomicInt *, &d->head));
+}
+
+iLocalDef size_t tail_SampleBuf_(const iSampleBuf *d) {
+    return value_Atomic(iConstCast(iAtomicInt *, &d->tail));
+}
+
 size_t size_SampleBuf(const iSampleBuf *d) {
-    return d->head - d->tail;
+    /* Both positions wrap around at `count`. */
+    return (head_SampleBuf_(d) + d->count - tail_SampleBuf_(d)) % d->count;
 }
 
 size_t vacancy_SampleBuf(const iSampleBuf *d) {
@@ -76,7 +86,7 @@ iBool isFull_SampleBuf(const iSampleBuf *d) {
 
 void write_SampleBuf(iSampleBuf *d, const void *samples, const size_t n) {
     iAssert(n <= vacancy_SampleBuf(d));
-    const size_t headPos = d->head % d->count;
+    const size_t headPos = head_SampleBuf_(d);
     const size_t avail   = d->count - headPos;
     if (n > avail) {
         const char *in = samples;
@@ -87,12 +97,13 @@ void write_SampleBuf(iSampleBuf *d, const void *samples, const size_t n) {
     else {
         memcpy(ptr_SampleBuf_(d, headPos), samples, d->sampleSize * n);
     }
-    d->head += n;
+    /* The samples become visible to the reader only after they have been copied. */
+    set_Atomic(&d->head, (headPos + n) % d->count);
 }
 
 void read_SampleBuf(iSampleBuf *d, const size_t n, void *samples_out) {
     iAssert(n <= size_SampleBuf(d));
-    const size_t tailPos = d->tail % d->count;
+    const size_t tailPos = tail_SampleBuf_(d);
     const size_t avail   = d->count - tailPos;
     if (n > avail) {
         char *out = samples_out;
@@ -103,5 +114,24 @@ void read_SampleBuf(iSampleBuf *d, const size_t n, void *samples_out) {
     else {
         memcpy(samples_out, ptr_SampleBuf_(d, tailPos), d->sampleSize * n);
     }
-    d->tail += n;
+    set_Atomic(&d->tail, (tailPos + n) % d->count);
+}
+
+void clear_SampleBuf(iSampleBuf *d) {
+    set_Atomic(&d->head, 0);
+    set_Atomic(&d->tail, 0);
+}
+
+void waitMoreNeeded_SampleBuf(iSampleBuf *d) {
+    /* A post made after the check is not lost, because the semaphore keeps count. */
+    if (isFull_SampleBuf(d)) {
+        SDL_SemWait(d->moreNeeded);
+    }
+}
+
+void signalMoreNeeded_SampleBuf(iSampleBuf *d) {
+    /* One pending post is enough to wake the writer. */
+    if (SDL_SemValue(d->moreNeeded) == 0) {
+        SDL_SemPost(d->moreNeeded);
+    }
 }
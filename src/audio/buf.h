@@ -22,10 +22,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #pragma once
 
+#include "the_Foundation/atomic.h"
 #include "the_Foundation/block.h"
 #include "the_Foundation/mutex.h"
 
 #include <SDL_audio.h>
+#include <SDL_mutex.h>
 
 iDeclareType(InputBuf)
 iDeclareType(SampleBuf)
@@ -40,7 +42,8 @@ iDeclareType(SampleBuf)
 struct Impl_InputBuf {
     iMutex     mtx;
     iCondition changed;
-    iBlock     data;
+    iBlock     data; /* shares the source's buffer once complete */
+    size_t     capacity; /* bytes reserved for appending */
     iBool      isComplete;
 };
 
@@ -50,14 +53,18 @@ size_t  size_InputBuf   (const iInputBuf *);
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* Ring buffer of output samples with one writer (the decoder thread) and one reader (the
+   audio callback). The positions are atomic so neither side needs a lock; the writer waits
+   on a semaphore when the buffer is full. */
 struct Impl_SampleBuf {
     SDL_AudioFormat format;
     uint8_t         numChannels;
     uint8_t         sampleSize; /* as bytes; one sample includes values for all channels */
     void *          data;
     size_t          count;
-    size_t          head, tail;
-    iCondition      moreNeeded;
+    iAtomicInt      head; /* next position to write; only modified by the writer */
+    iAtomicInt      tail; /* next position to read; only modified by the reader */
+    SDL_sem *       moreNeeded; /* posted by the reader after consuming samples */
 };
 
 iDeclareTypeConstructionArgs(SampleBuf, SDL_AudioFormat format, size_t numChannels, size_t count)
@@ -72,3 +79,6 @@ iLocalDef void *ptr_SampleBuf_(iSampleBuf *d, size_t pos) {
 
 void    write_SampleBuf     (iSampleBuf *, const void *samples, const size_t n);
 void    read_SampleBuf      (iSampleBuf *, const size_t n, void *samples_out);
+void    clear_SampleBuf     (iSampleBuf *); /* reader must not be running (lock the device) */
+void    waitMoreNeeded_SampleBuf    (iSampleBuf *); /* writer: blocks while the buffer is full */
+void    signalMoreNeeded_SampleBuf  (iSampleBuf *); /* reader: never blocks */
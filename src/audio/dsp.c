@@ -0,0 +1,277 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "dsp.h"
+
+#include <string.h>
+
+#if defined (__SSE2__)
+#   include <emmintrin.h>
+#elif defined (__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+void gain_F32(float *values, size_t count, float gain) {
+    if (gain == 1.0f) {
+        return;
+    }
+    size_t i = 0;
+#if defined (__SSE2__)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(values + i, _mm_mul_ps(_mm_loadu_ps(values + i), g));
+    }
+#elif defined (__ARM_NEON)
+    const float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(values + i, vmulq_f32(vld1q_f32(values + i), g));
+    }
+#endif
+    for (; i < count; i++) {
+        values[i] *= gain;
+    }
+}
+
+iLocalDef int16_t saturate_S16_(float value) {
+    return (int16_t) iClamp(value, -32768.0f, 32767.0f);
+}
+
+void gain_S16(int16_t *values, size_t count, float gain) {
+    if (gain == 1.0f) {
+        return;
+    }
+    size_t i = 0;
+#if defined (__SSE2__)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x  = _mm_loadu_si128((const __m128i *) (values + i));
+        /* Sign-extend to 32 bits. */
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        const __m128i y  = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), g)),
+                                           _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), g)));
+        _mm_storeu_si128((__m128i *) (values + i), y);
+    }
+#elif defined (__ARM_NEON)
+    const float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 8 <= count; i += 8) {
+        const int16x8_t   x  = vld1q_s16(values + i);
+        const float32x4_t lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), g);
+        const float32x4_t hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), g);
+        vst1q_s16(values + i,
+                  vcombine_s16(vqmovn_s32(vcvtq_s32_f32(lo)), vqmovn_s32(vcvtq_s32_f32(hi))));
+    }
+#endif
+    for (; i < count; i++) {
+        values[i] = saturate_S16_(values[i] * gain);
+    }
+}
+
+void convertF64_F32(float *out, const double *in, size_t count, float gain) {
+    size_t i = 0;
+#if defined (__SSE2__)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4) {
+        const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+        const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_movelh_ps(lo, hi), g));
+    }
+#elif defined (__ARM_NEON) && defined (__aarch64__)
+    const float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t x =
+            vcombine_f32(vcvt_f32_f64(vld1q_f64(in + i)), vcvt_f32_f64(vld1q_f64(in + i + 2)));
+        vst1q_f32(out + i, vmulq_f32(x, g));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = gain * (float) in[i];
+    }
+}
+
+void convertS16_F32(float *out, const int16_t *in, size_t count) {
+    const float scale = 1.0f / 32768.0f;
+    size_t      i     = 0;
+#if defined (__SSE2__)
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x  = _mm_loadu_si128((const __m128i *) (in + i));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+    }
+#elif defined (__ARM_NEON)
+    const float32x4_t s = vdupq_n_f32(scale);
+    for (; i + 8 <= count; i += 8) {
+        const int16x8_t x = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), s));
+        vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), s));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+void convertF32_S16(int16_t *out, const float *in, size_t count) {
+    const float scale = 32768.0f;
+    size_t      i     = 0;
+#if defined (__SSE2__)
+    /* Clamped first, because out-of-range floats don't convert to saturated integers. */
+    const __m128 s   = _mm_set1_ps(scale);
+    const __m128 min = _mm_set1_ps(-32768.0f);
+    const __m128 max = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        const __m128 lo = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), s), min), max);
+        const __m128 hi =
+            _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), s), min), max);
+        _mm_storeu_si128((__m128i *) (out + i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+    }
+#elif defined (__ARM_NEON)
+    /* Float-to-integer conversion saturates on NEON. */
+    const float32x4_t s = vdupq_n_f32(scale);
+    for (; i + 8 <= count; i += 8) {
+        const int32x4_t lo = vcvtq_s32_f32(vmulq_f32(vld1q_f32(in + i), s));
+        const int32x4_t hi = vcvtq_s32_f32(vmulq_f32(vld1q_f32(in + i + 4), s));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = saturate_S16_(in[i] * scale);
+    }
+}
+
+void interleave_F32(float *out, float *const *channels, size_t numChannels, size_t numFrames,
+                    float gain) {
+    size_t i = 0;
+    if (numChannels == 1) {
+        memcpy(out, channels[0], sizeof(float) * numFrames);
+        gain_F32(out, numFrames, gain);
+        return;
+    }
+    if (numChannels == 2) {
+        const float *left  = channels[0];
+        const float *right = channels[1];
+#if defined (__SSE2__)
+        const __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= numFrames; i += 4) {
+            const __m128 l = _mm_mul_ps(_mm_loadu_ps(left + i), g);
+            const __m128 r = _mm_mul_ps(_mm_loadu_ps(right + i), g);
+            _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+#elif defined (__ARM_NEON)
+        const float32x4_t g = vdupq_n_f32(gain);
+        for (; i + 4 <= numFrames; i += 4) {
+            float32x4x2_t lr;
+            lr.val[0] = vmulq_f32(vld1q_f32(left + i), g);
+            lr.val[1] = vmulq_f32(vld1q_f32(right + i), g);
+            vst2q_f32(out + 2 * i, lr);
+        }
+#endif
+        for (; i < numFrames; i++) {
+            out[2 * i]     = left[i] * gain;
+            out[2 * i + 1] = right[i] * gain;
+        }
+        return;
+    }
+    for (; i < numFrames; i++) {
+        for (size_t chan = 0; chan < numChannels; chan++) {
+            *out++ = channels[chan][i] * gain;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const size_t numHistory_Resampler_ = 3;
+
+iDefineTypeConstructionArgs(Resampler,
+                            (size_t numChannels, unsigned int inputRate, unsigned int outputRate),
+                            numChannels, inputRate, outputRate)
+
+void init_Resampler(iResampler *d, size_t numChannels, unsigned int inputRate,
+                    unsigned int outputRate) {
+    iAssert(numChannels > 0 && numChannels <= maxChannels_Resampler);
+    d->numChannels = numChannels;
+    d->step        = (double) inputRate / (double) outputRate;
+    d->pos         = 1.0; /* interpolation uses one preceding frame */
+    d->quality     = cubic_ResamplerQuality;
+    iZap(d->history);
+}
+
+void deinit_Resampler(iResampler *d) {
+    iUnused(d);
+}
+
+void setQuality_Resampler(iResampler *d, enum iResamplerQuality quality) {
+    d->quality = quality;
+}
+
+iLocalDef const float *frame_Resampler_(const iResampler *d, const float *input, size_t index) {
+    /* The history frames come before the input. */
+    return index < numHistory_Resampler_ ? d->history + index * d->numChannels
+                                         : input + (index - numHistory_Resampler_) * d->numChannels;
+}
+
+void process_Resampler(iResampler *d, const float *input, size_t numFrames, iArray *output_out) {
+    const size_t nc    = d->numChannels;
+    const size_t total = numHistory_Resampler_ + numFrames;
+    float        out[maxChannels_Resampler];
+    for (;;) {
+        const size_t i = (size_t) d->pos;
+        if (i + 2 >= total) {
+            break;
+        }
+        const float  t  = (float) (d->pos - i);
+        const float *x0 = frame_Resampler_(d, input, i - 1);
+        const float *x1 = frame_Resampler_(d, input, i);
+        const float *x2 = frame_Resampler_(d, input, i + 1);
+        const float *x3 = frame_Resampler_(d, input, i + 2);
+        if (d->quality == linear_ResamplerQuality) {
+            for (size_t c = 0; c < nc; c++) {
+                out[c] = x1[c] + (x2[c] - x1[c]) * t;
+            }
+        }
+        else {
+            /* Catmull-Rom spline through the four neighboring frames. */
+            for (size_t c = 0; c < nc; c++) {
+                const float c1 = 0.5f * (x2[c] - x0[c]);
+                const float c2 = x0[c] - 2.5f * x1[c] + 2.0f * x2[c] - 0.5f * x3[c];
+                const float c3 = 0.5f * (x3[c] - x0[c]) + 1.5f * (x1[c] - x2[c]);
+                out[c] = ((c3 * t + c2) * t + c1) * t + x1[c];
+            }
+        }
+        pushBack_Array(output_out, out);
+        d->pos += d->step;
+    }
+    /* Keep the last frames for the next block. When the block is short, some of them are
+       already in the history; those only move towards the start. */
+    for (size_t k = 0; k < numHistory_Resampler_; k++) {
+        memmove(d->history + k * nc,
+                frame_Resampler_(d, input, total - numHistory_Resampler_ + k),
+                sizeof(float) * nc);
+    }
+    d->pos -= (double) numFrames;
+}
@@ -0,0 +1,64 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/array.h>
+
+/* Sample processing kernels used by the decoders. These are vectorized with SSE2 or NEON
+   when available, with a scalar fallback. Samples are interleaved unless noted. The
+   conversion from doubles may be done in place. */
+
+void    gain_F32            (float *values, size_t count, float gain);
+void    gain_S16            (int16_t *values, size_t count, float gain); /* saturates */
+void    convertF64_F32      (float *out, const double *in, size_t count, float gain);
+void    convertS16_F32      (float *out, const int16_t *in, size_t count);
+void    convertF32_S16      (int16_t *out, const float *in, size_t count); /* saturates */
+void    interleave_F32      (float *out, float *const *channels, size_t numChannels,
+                             size_t numFrames, float gain);
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(Resampler)
+iDeclareTypeConstructionArgs(Resampler, size_t numChannels, unsigned int inputRate,
+                             unsigned int outputRate)
+
+enum iResamplerQuality {
+    linear_ResamplerQuality,
+    cubic_ResamplerQuality,
+};
+
+#define maxChannels_Resampler   8
+
+/* Converts a stream of float frames from one sample rate to another. The last few input
+   frames are kept between calls, so the stream can be processed in blocks of any size. */
+struct Impl_Resampler {
+    size_t                 numChannels;
+    double                 step; /* input frames per output frame */
+    double                 pos;  /* position of the next output frame in the input */
+    enum iResamplerQuality quality;
+    float                  history[3 * maxChannels_Resampler]; /* previous input frames */
+};
+
+void    setQuality_Resampler(iResampler *, enum iResamplerQuality quality);
+void    process_Resampler   (iResampler *, const float *input, size_t numFrames,
+                             iArray *output_out); /* appends frames of float values */
@@ -22,6 +22,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "player.h"
 #include "buf.h"
+#include "dsp.h"
 
 #define STB_VORBIS_HEADER_ONLY
 #include "stb_vorbis.c"
@@ -51,13 +52,23 @@ struct Impl_ContentSpec {
     enum iDecoderType type;
     SDL_AudioFormat   inputFormat;
     SDL_AudioSpec     output;
+    int               deviceFreq; /* obtained from SDL; output is resampled if different */
+    SDL_AudioDeviceID device;
     size_t            totalInputSize;
     uint64_t          totalSamples;
     size_t            inputStartPos;
 };
 
+iDeclareType(SeekPoint)
 iDeclareType(Decoder)
 
+/* Input position where decoding can be (re)started, found by scanning the downloaded data
+   for Ogg pages or MPEG frame headers. */
+struct Impl_SeekPoint {
+    size_t   inputPos;
+    uint64_t sample; /* first sample decoded from `inputPos` */
+};
+
 struct Impl_Decoder {
     enum iDecoderType type;
     float             gain;
@@ -65,13 +76,27 @@ struct Impl_Decoder {
     SDL_AudioFormat   inputFormat;
     iInputBuf *       input;
     size_t            inputPos;
+    size_t            inputStartPos;
     size_t            totalInputSize;
-    unsigned int      outputFreq;
-    iSampleBuf        output;
-    iMutex            outputMutex;
-    iArray            pendingOutput;
+    unsigned int      outputFreq; /* of the decoded content */
+    unsigned int      deviceFreq;
+    iSampleBuf        output; /* read by the audio callback without locking */
+    iArray            pendingOutput; /* at the device's sample rate */
+    iResampler *      resampler; /* NULL if the device uses the content's rate */
+    iArray            resampled; /* float frames, when resampling 16-bit output */
     uint64_t          currentSample;
     uint64_t          totalSamples; /* zero if unknown */
+    iArray            seekIndex; /* SeekPoints in increasing order; only used by the thread */
+    size_t            indexedPos; /* input bytes scanned for seek points */
+    uint64_t          indexedSample;
+    iAtomicInt        seekRequest; /* target in milliseconds, or -1 */
+    iAtomicInt        seekableMs; /* furthest position available for seeking */
+    SDL_AudioDeviceID device;
+    /* Buffering statistics. */
+    iAtomicInt        isAtEnd; /* all input has been decoded */
+    iAtomicInt        isStarved; /* set by the audio callback when output wasn't ready */
+    iAtomicInt        numUnderruns;
+    iAtomicInt        decodeTimeUs; /* moving average per decoded block */
     iMutex            tagMutex;
     iString           tags[max_PlayerTag];
     stb_vorbis *      vorbis;
@@ -87,10 +112,236 @@ enum iDecoderStatus {
     needMoreInput_DecoderStatus,
 };
 
+static enum iResamplerQuality resamplerQuality_Decoder_ = cubic_ResamplerQuality;
+static int                    decodeAheadMs_Decoder_    = 250;
+
+static void output_Decoder_(iDecoder *d, const void *samples, size_t n) {
+    /* Queues decoded samples, converted to the device's sample rate. */
+    if (!d->resampler) {
+        pushBackN_Array(&d->pendingOutput, samples, n);
+        return;
+    }
+    if (d->output.format == AUDIO_F32) {
+        process_Resampler(d->resampler, samples, n, &d->pendingOutput);
+        return;
+    }
+    /* 16-bit samples are resampled as floats. */
+    iAssert(d->output.format == AUDIO_S16);
+    const size_t numChannels = d->output.numChannels;
+    float *      input       = malloc(sizeof(float) * numChannels * n);
+    convertS16_F32(input, samples, numChannels * n);
+    clear_Array(&d->resampled);
+    process_Resampler(d->resampler, input, n, &d->resampled);
+    free(input);
+    const size_t oldSize = size_Array(&d->pendingOutput);
+    resize_Array(&d->pendingOutput, oldSize + size_Array(&d->resampled));
+    convertF32_S16(at_Array(&d->pendingOutput, oldSize),
+                   constData_Array(&d->resampled),
+                   numChannels * size_Array(&d->resampled));
+}
+
+static void writePending_Decoder_(iDecoder *d) {
+    /* Write as much as we can. */
+    size_t avail = vacancy_SampleBuf(&d->output);
+    size_t n = iMin(avail, size_Array(&d->pendingOutput));
+    write_SampleBuf(&d->output, constData_Array(&d->pendingOutput), n);
+    removeN_Array(&d->pendingOutput, 0, n);
+    d->currentSample += n;
+}
+
+static void addSeekPoint_Decoder_(iDecoder *d, size_t inputPos, uint64_t sample) {
+    if (!isEmpty_Array(&d->seekIndex)) {
+        const iSeekPoint *last = constBack_Array(&d->seekIndex);
+        if (sample < last->sample + d->outputFreq / 4) {
+            return; /* a few points per second is precise enough */
+        }
+    }
+    pushBack_Array(&d->seekIndex, &(iSeekPoint){ inputPos, sample });
+}
+
+static void indexOggPages_Decoder_(iDecoder *d, const uint8_t *data, size_t size) {
+    /* A page's granule position is the number of samples at the end of the page, so
+       decoding can resume from the start of the next page. */
+    while (d->indexedPos + 27 <= size) {
+        const uint8_t *page = data + d->indexedPos;
+        if (memcmp(page, "OggS", 4)) {
+            d->indexedPos++; /* resynchronize */
+            continue;
+        }
+        const size_t numSegments = page[26];
+        if (d->indexedPos + 27 + numSegments > size) {
+            break;
+        }
+        size_t pageSize = 27 + numSegments;
+        for (size_t i = 0; i < numSegments; i++) {
+            pageSize += page[27 + i];
+        }
+        uint64_t granule = 0;
+        for (int i = 7; i >= 0; i--) {
+            granule = (granule << 8) | page[6 + i];
+        }
+        d->indexedPos += pageSize;
+        if (granule > 0 && granule != UINT64_MAX) { /* all ones: no packet ends here */
+            addSeekPoint_Decoder_(d, d->indexedPos, granule);
+        }
+    }
+}
+
+#if defined (LAGRANGE_ENABLE_MPG123)
+static size_t mpegFrameSize_(const uint8_t *header, unsigned int *freq_out,
+                             unsigned int *numSamples_out) {
+    static const uint16_t kbps_[5][15] = {
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 }, /* 1, I */
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },    /* 1, II */
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },     /* 1, III */
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },    /* 2, I */
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },         /* 2, II/III */
+    };
+    static const unsigned int freqs_[3] = { 44100, 48000, 32000 };
+    if (header[0] != 0xff || (header[1] & 0xe0) != 0xe0) {
+        return 0;
+    }
+    const int version   = (header[1] >> 3) & 3; /* 0: MPEG-2.5, 2: MPEG-2, 3: MPEG-1 */
+    const int layer     = 4 - ((header[1] >> 1) & 3);
+    const int rateIndex = header[2] >> 4;
+    const int freqIndex = (header[2] >> 2) & 3;
+    const int padding   = (header[2] >> 1) & 1;
+    if (version == 1 || layer == 4 || rateIndex == 0 || rateIndex == 15 || freqIndex == 3) {
+        return 0; /* reserved, free format, or not a frame header at all */
+    }
+    const iBool        isMpeg1 = (version == 3);
+    const unsigned int kbps    = kbps_[isMpeg1 ? layer - 1 : layer == 1 ? 3 : 4][rateIndex];
+    *freq_out = freqs_[freqIndex] >> (isMpeg1 ? 0 : version == 2 ? 1 : 2);
+    if (layer == 1) {
+        *numSamples_out = 384;
+        return (12000 * kbps / *freq_out + padding) * 4;
+    }
+    *numSamples_out = (layer == 3 && !isMpeg1 ? 576 : 1152);
+    return *numSamples_out / 8 * 1000 * kbps / *freq_out + padding;
+}
+
+static void indexMpegFrames_Decoder_(iDecoder *d, const uint8_t *data, size_t size) {
+    if (d->indexedPos == 0) {
+        if (size < 10) {
+            return;
+        }
+        if (!memcmp(data, "ID3", 3)) {
+            /* Skip the ID3v2 tag. The size is a 28-bit syncsafe integer. */
+            d->indexedPos = 10 + (data[5] & 0x10 ? 10 : 0) +
+                            ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14 |
+                             (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+        }
+    }
+    while (d->indexedPos + 4 <= size) {
+        unsigned int freq       = 0;
+        unsigned int numSamples = 0;
+        const size_t frameSize  = mpegFrameSize_(data + d->indexedPos, &freq, &numSamples);
+        if (frameSize < 4 || freq != d->outputFreq) {
+            d->indexedPos++; /* resynchronize */
+            continue;
+        }
+        addSeekPoint_Decoder_(d, d->indexedPos, d->indexedSample);
+        d->indexedPos += frameSize;
+        d->indexedSample += numSamples;
+    }
+}
+#endif
+
+static void updateSeekIndex_Decoder_(iDecoder *d) {
+    lock_Mutex(&d->input->mtx);
+    const uint8_t *data = constData_Block(&d->input->data);
+    const size_t   size = size_Block(&d->input->data);
+    uint64_t seekable = 0;
+    if (d->type == wav_DecoderType) {
+        const size_t sampleSize = d->output.numChannels * SDL_AUDIO_BITSIZE(d->inputFormat) / 8;
+        seekable = iMax(d->inputStartPos, size / sampleSize) - d->inputStartPos;
+    }
+    else {
+        if (d->type == vorbis_DecoderType && d->vorbis) {
+            indexOggPages_Decoder_(d, data, size);
+        }
+#if defined (LAGRANGE_ENABLE_MPG123)
+        else if (d->type == mpeg_DecoderType) {
+            indexMpegFrames_Decoder_(d, data, size);
+        }
+#endif
+        if (!isEmpty_Array(&d->seekIndex)) {
+            seekable = ((const iSeekPoint *) constBack_Array(&d->seekIndex))->sample;
+        }
+    }
+    unlock_Mutex(&d->input->mtx);
+    set_Atomic(&d->seekableMs, (int) (seekable * 1000 / d->outputFreq));
+}
+
+static const iSeekPoint *findSeekPoint_Decoder_(const iDecoder *d, uint64_t sample,
+                                                size_t inputSize) {
+    /* The last point at or before `sample` that has already been downloaded. */
+    const iSeekPoint *found = NULL;
+    iConstForEach(Array, i, &d->seekIndex) {
+        const iSeekPoint *pt = i.value;
+        if (pt->inputPos >= inputSize || (found && pt->sample > sample)) {
+            break;
+        }
+        found = pt;
+    }
+    return found;
+}
+
+static void seek_Decoder_(iDecoder *d, uint64_t sample) {
+    /* `sample` is at the content's sample rate. Seeking past the downloaded part of the
+       input stops at the furthest available position. */
+    lock_Mutex(&d->input->mtx);
+    const size_t inputSize = size_Block(&d->input->data);
+    unlock_Mutex(&d->input->mtx);
+    if (d->type == wav_DecoderType) {
+        const size_t sampleSize = d->output.numChannels * SDL_AUDIO_BITSIZE(d->inputFormat) / 8;
+        const size_t avail = iMax(d->inputStartPos, inputSize / sampleSize) - d->inputStartPos;
+        sample      = iMin(sample, avail);
+        d->inputPos = d->inputStartPos + sample;
+    }
+    else {
+        const iSeekPoint *pt = findSeekPoint_Decoder_(d, sample, inputSize);
+        if (!pt) {
+            return;
+        }
+        if (d->type == vorbis_DecoderType) {
+            if (!d->vorbis) {
+                return;
+            }
+            /* stb_vorbis resynchronizes at the next page. */
+            stb_vorbis_flush_pushdata(d->vorbis);
+        }
+#if defined (LAGRANGE_ENABLE_MPG123)
+        else if (d->type == mpeg_DecoderType) {
+            if (!d->mpeg) {
+                return;
+            }
+            /* Reopening discards the buffered input. The tags have already been read. */
+            mpg123_close(d->mpeg);
+            mpg123_open_feed(d->mpeg);
+        }
+#endif
+        d->inputPos = pt->inputPos;
+        sample      = pt->sample;
+    }
+    clear_Array(&d->pendingOutput);
+    SDL_LockAudioDevice(d->device);
+    clear_SampleBuf(&d->output);
+    set_Atomic(&d->isStarved, iTrue); /* refilling the buffer is not an underrun */
+    SDL_UnlockAudioDevice(d->device);
+    set_Atomic(&d->isAtEnd, iFalse);
+    d->currentSample = sample * d->deviceFreq / d->outputFreq;
+}
+
 static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
     const uint8_t numChannels     = d->output.numChannels;
     const size_t  inputSampleSize = numChannels * SDL_AUDIO_BITSIZE(d->inputFormat) / 8;
-    const size_t  vacancy         = vacancy_SampleBuf(&d->output);
+    writePending_Decoder_(d); /* left over from the previous resampled block */
+    size_t vacancy = isEmpty_Array(&d->pendingOutput) ? vacancy_SampleBuf(&d->output) : 0;
+    if (d->resampler && vacancy) {
+        /* Number of input samples needed to fill the space. */
+        vacancy = iMax(1, (size_t) (vacancy * d->resampler->step));
+    }
     const size_t  inputBytePos    = inputSampleSize * d->inputPos;
     const size_t  avail           = (inputRange.end - inputBytePos) / inputSampleSize;
     if (avail == 0) {
@@ -114,17 +365,10 @@ static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
         const float gain = d->gain;
         if (d->inputFormat == AUDIO_F64LSB) {
             iAssert(d->output.format == AUDIO_F32);
-            double *inValue  = samples;
-            float * outValue = samples;
-            for (size_t count = numChannels * n; count; count--) {
-                *outValue++ = gain * *inValue++;
-            }
+            convertF64_F32(samples, samples, numChannels * n, gain); /* in place */
         }
         else if (d->inputFormat == AUDIO_F32) {
-            float *value = samples;
-            for (size_t count = numChannels * n; count; count--, value++) {
-                *value *= gain;
-            }
+            gain_F32(samples, numChannels * n, gain);
         }
         else if (d->inputFormat == AUDIO_S24LSB) {
             iAssert(d->output.format == AUDIO_S16);
@@ -144,13 +388,9 @@ static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
                     }
                     break;
                 }
-                case 16: {
-                    int16_t *value = samples;
-                    for (size_t count = numChannels * n; count; count--, value++) {
-                        *value *= gain;
-                    }
+                case 16:
+                    gain_S16(samples, numChannels * n, gain);
                     break;
-                }
                 case 32: {
                     int32_t *value = samples;
                     for (size_t count = numChannels * n; count; count--, value++) {
@@ -161,23 +401,12 @@ static enum iDecoderStatus decodeWav_Decoder_(iDecoder *d, iRanges inputRange) {
             }
         }
     }
-    iGuardMutex(&d->outputMutex, write_SampleBuf(&d->output, samples, n));
-    d->currentSample += n;
+    output_Decoder_(d, samples, n);
+    writePending_Decoder_(d);
     free(samples);
     return ok_DecoderStatus;
 }
 
-static void writePending_Decoder_(iDecoder *d) {
-    /* Write as much as we can. */
-    lock_Mutex(&d->outputMutex);
-    size_t avail = vacancy_SampleBuf(&d->output);
-    size_t n = iMin(avail, size_Array(&d->pendingOutput));
-    write_SampleBuf(&d->output, constData_Array(&d->pendingOutput), n);
-    removeN_Array(&d->pendingOutput, 0, n);
-    unlock_Mutex(&d->outputMutex);
-    d->currentSample += n;
-}
-
 static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
     const iBlock *input = &d->input->data;
     if (!d->vorbis) {
@@ -187,10 +416,14 @@ static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
         d->vorbis = stb_vorbis_open_pushdata(
             constData_Block(input), size_Block(input), &consumed, &error, NULL);
         if (!d->vorbis) {
+            unlock_Mutex(&d->input->mtx);
             return needMoreInput_DecoderStatus;
         }
         d->inputPos += consumed;
         unlock_Mutex(&d->input->mtx);
+        /* Audio packets begin after the headers. */
+        d->indexedPos = d->inputPos;
+        addSeekPoint_Decoder_(d, d->inputPos, 0);
         /* Check the metadata. */ {
             const stb_vorbis_comment com = stb_vorbis_get_comment(d->vorbis);
             //        printf("vendor: {%s}\n", comment.vendor);
@@ -245,14 +478,19 @@ static enum iDecoderStatus decodeVorbis_Decoder_(iDecoder *d) {
             }
             else continue;
         }
-        /* Apply gain. */ {
-            const float gain = d->gain;
-            float sample[2];
-            for (size_t i = 0; i < (size_t) count; ++i) {
-                for (size_t chan = 0; chan < d->output.numChannels; chan++) {
-                    sample[chan] = samples[chan][i] * gain;
-                }
-                pushBack_Array(&d->pendingOutput, sample);
+        /* Apply gain and interleave the channels. */ {
+            const size_t numChannels = d->output.numChannels;
+            if (!d->resampler) {
+                const size_t oldSize = size_Array(&d->pendingOutput);
+                resize_Array(&d->pendingOutput, oldSize + count);
+                interleave_F32(
+                    at_Array(&d->pendingOutput, oldSize), samples, numChannels, count, d->gain);
+            }
+            else {
+                float *frames = malloc(sizeof(float) * numChannels * count);
+                interleave_F32(frames, samples, numChannels, count, d->gain);
+                output_Decoder_(d, frames, count);
+                free(frames);
             }
         }
     }
@@ -299,11 +537,8 @@ enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
         int16_t buffer[512];
         size_t bytesRead = 0;
         const int rc = mpg123_read(d->mpeg, (uint8_t *) buffer, sizeof(buffer), &bytesRead);
-        const float gain = d->gain;
-        for (size_t i = 0; i < bytesRead / 2; i++) {
-            buffer[i] *= gain;
-        }
-        pushBackN_Array(&d->pendingOutput, buffer, bytesRead / 2 / d->output.numChannels);
+        gain_S16(buffer, bytesRead / 2, d->gain);
+        output_Decoder_(d, buffer, bytesRead / 2 / d->output.numChannels);
         if (rc == MPG123_NEED_MORE) {
             status = needMoreInput_DecoderStatus;
             break;
@@ -338,6 +573,10 @@ enum iDecoderStatus decodeMpeg_Decoder_(iDecoder *d) {
 static iThreadResult run_Decoder_(iThread *thread) {
     iDecoder *d = userData_Thread(thread);
     while (d->type) {
+        const int seekMs = exchange_Atomic(&d->seekRequest, -1);
+        if (seekMs >= 0) {
+            seek_Decoder_(d, (uint64_t) seekMs * d->outputFreq / 1000);
+        }
         /* Check amount of data available. */
         lock_Mutex(&d->input->mtx);
         size_t inputSize = size_InputBuf(d->input);
@@ -346,7 +585,9 @@ static iThreadResult run_Decoder_(iThread *thread) {
         iAssert(inputRange.start <= inputRange.end);
         if (!d->type) break;
         /* Have data to work on and a place to save output? */
-        enum iDecoderStatus status = ok_DecoderStatus;
+        enum iDecoderStatus status      = ok_DecoderStatus;
+        const uint64_t      startTime   = SDL_GetPerformanceCounter();
+        const uint64_t      startSample = d->currentSample;
         switch (d->type) {
             case wav_DecoderType:
                 status = decodeWav_Decoder_(d, inputRange);
@@ -360,18 +601,28 @@ static iThreadResult run_Decoder_(iThread *thread) {
             default:
                 break;
         }
-        if (status == needMoreInput_DecoderStatus) {
+        if (d->currentSample != startSample) {
+            const int usec = (int) ((SDL_GetPerformanceCounter() - startTime) * 1000000 /
+                                    SDL_GetPerformanceFrequency());
+            const int avg  = value_Atomic(&d->decodeTimeUs);
+            set_Atomic(&d->decodeTimeUs, avg ? (3 * avg + usec) / 4 : usec);
+        }
+        updateSeekIndex_Decoder_(d);
+        if (status == needMoreInput_DecoderStatus && isEmpty_Array(&d->pendingOutput)) {
             lock_Mutex(&d->input->mtx);
             if (size_InputBuf(d->input) == inputSize) {
-                wait_Condition(&d->input->changed, &d->input->mtx);
+                if (d->input->isComplete) {
+                    set_Atomic(&d->isAtEnd, iTrue);
+                }
+                /* A seek request is made before signaling, so it can't be missed here. */
+                if (value_Atomic(&d->seekRequest) < 0) {
+                    wait_Condition(&d->input->changed, &d->input->mtx);
+                }
             }
             unlock_Mutex(&d->input->mtx);
         }
         else {
-            iGuardMutex(
-                &d->outputMutex, if (isFull_SampleBuf(&d->output)) {
-                    wait_Condition(&d->output.moreNeeded, &d->outputMutex);
-                });
+            waitMoreNeeded_SampleBuf(&d->output);
         }
     }
     return 0;
@@ -382,16 +633,35 @@ void init_Decoder(iDecoder *d, iInputBuf *input, const iContentSpec *spec) {
     d->gain           = 1.0f;
     d->input          = input;
     d->inputPos       = spec->inputStartPos;
+    d->inputStartPos  = spec->inputStartPos;
     d->inputFormat    = spec->inputFormat;
     d->totalInputSize = spec->totalInputSize;
     d->outputFreq     = spec->output.freq;
+    d->deviceFreq     = spec->deviceFreq ? spec->deviceFreq : spec->output.freq;
     d->currentSample  = 0;
     d->totalSamples   = spec->totalSamples;
     init_Array(&d->pendingOutput, spec->output.channels * SDL_AUDIO_BITSIZE(spec->output.format) / 8);
     init_SampleBuf(&d->output,
                    spec->output.format,
                    spec->output.channels,
-                   spec->output.samples * 2);
+                   iMax(spec->output.samples * 2,
+                        (size_t) decodeAheadMs_Decoder_ * d->deviceFreq / 1000));
+    d->resampler = NULL;
+    if (spec->deviceFreq && spec->deviceFreq != spec->output.freq) {
+        d->resampler = new_Resampler(spec->output.channels, spec->output.freq, spec->deviceFreq);
+        setQuality_Resampler(d->resampler, resamplerQuality_Decoder_);
+    }
+    init_Array(&d->resampled, sizeof(float) * spec->output.channels);
+    init_Array(&d->seekIndex, sizeof(iSeekPoint));
+    d->indexedPos    = 0;
+    d->indexedSample = 0;
+    d->device        = spec->device;
+    set_Atomic(&d->seekRequest, -1);
+    set_Atomic(&d->seekableMs, 0);
+    set_Atomic(&d->isAtEnd, iFalse);
+    set_Atomic(&d->isStarved, iTrue); /* nothing has been played yet */
+    set_Atomic(&d->numUnderruns, 0);
+    set_Atomic(&d->decodeTimeUs, 0);
     init_Mutex(&d->tagMutex);
     iForIndices(i, d->tags) {
         init_String(&d->tags[i]);
@@ -402,7 +672,6 @@ void init_Decoder(iDecoder *d, iInputBuf *input, const iContentSpec *spec) {
     d->id3v1 = NULL;
     d->id3v2 = NULL;
 #endif
-    init_Mutex(&d->outputMutex);
     d->thread = new_Thread(run_Decoder_);
     setUserData_Thread(d->thread, d);
     start_Thread(d->thread);
@@ -410,13 +679,15 @@ void init_Decoder(iDecoder *d, iInputBuf *input, const iContentSpec *spec) {
 
 void deinit_Decoder(iDecoder *d) {
     d->type = none_DecoderType;
-    signal_Condition(&d->output.moreNeeded);
+    signalMoreNeeded_SampleBuf(&d->output);
     signal_Condition(&d->input->changed);
     join_Thread(d->thread);
     iRelease(d->thread);
-    deinit_Mutex(&d->outputMutex);
     deinit_SampleBuf(&d->output);
     deinit_Array(&d->pendingOutput);
+    deinit_Array(&d->resampled);
+    deinit_Array(&d->seekIndex);
+    delete_Resampler(d->resampler);
     iForIndices(i, d->tags) {
         deinit_String(&d->tags[i]);
     }
@@ -609,15 +880,31 @@ static void writeOutputSamples_Player_(void *plr, Uint8 *stream, int len) {
     iAssert(d->decoder);
     const size_t sampleSize = sampleSize_Player_(d);
     const size_t count      = len / sampleSize;
-    lock_Mutex(&d->decoder->outputMutex);
-    if (size_SampleBuf(&d->decoder->output) >= count) {
-        read_SampleBuf(&d->decoder->output, count, stream);
+    iDecoder *   decoder    = d->decoder;
+    /* This runs in the real-time audio thread, so it must not wait for the decoder. */
+    const size_t avail = size_SampleBuf(&decoder->output);
+    if (avail >= count) {
+        read_SampleBuf(&decoder->output, count, stream);
+        set_Atomic(&decoder->isStarved, iFalse);
     }
     else {
         memset(stream, d->spec.silence, len);
+        if (value_Atomic(&decoder->isAtEnd)) {
+            read_SampleBuf(&decoder->output, avail, stream); /* the last few samples */
+        }
+        else if (!exchange_Atomic(&decoder->isStarved, iTrue)) {
+            add_Atomic(&decoder->numUnderruns, 1);
+        }
     }
-    signal_Condition(&d->decoder->output.moreNeeded);
-    unlock_Mutex(&d->decoder->outputMutex);
+    signalMoreNeeded_SampleBuf(&decoder->output);
+}
+
+void setResamplerQuality_Player(enum iResamplerQuality quality) {
+    resamplerQuality_Decoder_ = quality; /* used by players started afterwards */
+}
+
+void setDecodeAhead_Player(int milliseconds) {
+    decodeAheadMs_Decoder_ = milliseconds; /* used by players started afterwards */
 }
 
 void init_Player(iPlayer *d) {
@@ -660,6 +947,7 @@ void updateSourceData_Player(iPlayer *d, const iString *mimeType, const iBlock *
     switch (update) {
         case replace_PlayerUpdate:
             set_Block(&input->data, data);
+            input->capacity   = 0;
             input->isComplete = iFalse;
             break;
         case append_PlayerUpdate: {
@@ -668,11 +956,26 @@ void updateSourceData_Player(iPlayer *d, const iString *mimeType, const iBlock *
             iAssert(newSize >= oldSize);
             /* The old parts cannot have changed. */
 //            iAssert(memcmp(constData_Block(&input->data), constData_Block(data), oldSize) == 0);
+            if (newSize > input->capacity) {
+                /* Grow geometrically so long streams aren't reallocated on every update. */
+                input->capacity = iMax(newSize, 2 * input->capacity);
+                reserve_Block(&input->data, input->capacity);
+            }
             appendData_Block(&input->data, constBegin_Block(data) + oldSize, newSize - oldSize);
             input->isComplete = iFalse;
             break;
         }
         case complete_PlayerUpdate:
+            if (data) {
+                /* The source won't be modified any more, so its buffer can be shared instead
+                   of keeping a copy. While the data is still streaming in, sharing would
+                   make the writer detach (copy) the whole buffer on each append. The
+                   decoder only reads the data via positions while holding the lock, so
+                   swapping the buffer is safe. */
+                iAssert(size_Block(data) >= size_Block(&input->data));
+                set_Block(&input->data, data);
+                input->capacity = 0;
+            }
             input->isComplete = iTrue;
             break;
     }
@@ -690,10 +993,21 @@ iBool start_Player(iPlayer *d) {
     }
     content.output.callback = writeOutputSamples_Player_;
     content.output.userdata = d;
-    d->device = SDL_OpenAudioDevice(NULL, SDL_FALSE /* playback */, &content.output, &d->spec, 0);
+    /* The decoder converts float and 16-bit content to the device's sample rate itself,
+       so SDL doesn't need to do it in the audio callback. */
+    const iBool canResample =
+        (content.output.format == AUDIO_F32 || content.output.format == AUDIO_S16) &&
+        content.output.channels <= maxChannels_Resampler;
+    d->device = SDL_OpenAudioDevice(NULL,
+                                    SDL_FALSE /* playback */,
+                                    &content.output,
+                                    &d->spec,
+                                    canResample ? SDL_AUDIO_ALLOW_FREQUENCY_CHANGE : 0);
     if (!d->device) {
         return iFalse;
     }
+    content.deviceFreq = d->spec.freq;
+    content.device     = d->device;
     d->decoder = new_Decoder(d->data, &content);
     d->decoder->gain = d->volume;
     SDL_PauseAudioDevice(d->device, SDL_FALSE);
@@ -719,6 +1033,20 @@ void stop_Player(iPlayer *d) {
     }
 }
 
+iBool seek_Player(iPlayer *d, float time) {
+    if (!d->decoder) {
+        return iFalse;
+    }
+    set_Atomic(&d->decoder->seekRequest, iMax(0, (int) (time * 1000)));
+    /* The decoder may be waiting for input or for space in the output buffer. */
+    signalMoreNeeded_SampleBuf(&d->decoder->output);
+    lock_Mutex(&d->data->mtx);
+    signal_Condition(&d->data->changed);
+    unlock_Mutex(&d->data->mtx);
+    setNotIdle_Player(d);
+    return iTrue;
+}
+
 void setVolume_Player(iPlayer *d, float volume) {
     d->volume = iClamp(volume, 0, 1);
     if (d->decoder) {
@@ -752,12 +1080,16 @@ const iString *tag_Player(const iPlayer *d, enum iPlayerTag tag) {
 
 float time_Player(const iPlayer *d) {
     if (!d->decoder) return 0;
-    return (float) ((double) d->decoder->currentSample / (double) d->spec.freq);
+    /* Decoded samples still waiting in the buffer haven't been heard yet. */
+    const uint64_t decoded  = d->decoder->currentSample;
+    const uint64_t buffered = size_SampleBuf(&d->decoder->output);
+    return (float) ((double) (decoded > buffered ? decoded - buffered : 0) /
+                    (double) d->spec.freq);
 }
 
 float duration_Player(const iPlayer *d) {
     if (!d->decoder) return 0;
-    return (float) ((double) d->decoder->totalSamples / (double) d->spec.freq);
+    return (float) ((double) d->decoder->totalSamples / (double) d->decoder->outputFreq);
 }
 
 float streamProgress_Player(const iPlayer *d) {
@@ -770,6 +1102,44 @@ float streamProgress_Player(const iPlayer *d) {
     return 0;
 }
 
+size_t memorySize_Player(const iPlayer *d) {
+    lock_Mutex(&d->data->mtx);
+    size_t size = iMax(size_Block(&d->data->data), d->data->capacity);
+    unlock_Mutex(&d->data->mtx);
+    if (d->decoder) {
+        const iSampleBuf *out = &d->decoder->output;
+        size += out->count * out->sampleSize;
+    }
+    return size;
+}
+
+float seekableTime_Player(const iPlayer *d) {
+    if (!d->decoder) return 0;
+    return value_Atomic(&d->decoder->seekableMs) / 1000.0f;
+}
+
+float bufferFill_Player(const iPlayer *d) {
+    if (!d->decoder) return 0;
+    const size_t size    = size_SampleBuf(&d->decoder->output);
+    const size_t vacancy = vacancy_SampleBuf(&d->decoder->output);
+    return size + vacancy ? (float) size / (float) (size + vacancy) : 0.0f;
+}
+
+iBool isStarved_Player(const iPlayer *d) {
+    if (!d->decoder || isPaused_Player(d)) return iFalse;
+    return value_Atomic(&d->decoder->isStarved) && !value_Atomic(&d->decoder->isAtEnd);
+}
+
+int numUnderruns_Player(const iPlayer *d) {
+    if (!d->decoder) return 0;
+    return value_Atomic(&d->decoder->numUnderruns);
+}
+
+float decodeTimeMs_Player(const iPlayer *d) {
+    if (!d->decoder) return 0;
+    return value_Atomic(&d->decoder->decodeTimeUs) / 1000.0f;
+}
+
 uint32_t idleTimeMs_Player(const iPlayer *d) {
     return SDL_GetTicks() - d->lastInteraction;
 }
@@ -22,6 +22,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #pragma once
 
+#include "dsp.h"
+
 #include <the_Foundation/block.h>
 
 iDeclareType(Player)
@@ -46,12 +48,19 @@ enum iPlayerTag {
     max_PlayerTag,
 };
 
+/* With complete_PlayerUpdate, `data` may be NULL or the complete source. Its buffer is then
+   shared with the player instead of copied (modifying the source afterwards detaches it). */
 void    updateSourceData_Player (iPlayer *, const iString *mimeType, const iBlock *data,
                                  enum iPlayerUpdate update);
 
+/* Content whose sample rate differs from the device's is resampled by the decoder. */
+void    setResamplerQuality_Player  (enum iResamplerQuality quality);
+void    setDecodeAhead_Player       (int milliseconds);
+
 iBool   start_Player            (iPlayer *);
 void    stop_Player             (iPlayer *);
 void    setPaused_Player        (iPlayer *, iBool isPaused);
+iBool   seek_Player             (iPlayer *, float time); /* clamped to the downloaded part */
 void    setVolume_Player        (iPlayer *, float volume);
 void    setFlags_Player         (iPlayer *, int flags, iBool set);
 void    setNotIdle_Player       (iPlayer *);
@@ -64,6 +73,14 @@ float   volume_Player           (const iPlayer *);
 float   time_Player             (const iPlayer *);
 float   duration_Player         (const iPlayer *);
 float   streamProgress_Player   (const iPlayer *); /* normalized 0...1 */
+float   seekableTime_Player     (const iPlayer *);
+
+/* Buffering statistics. */
+float   bufferFill_Player       (const iPlayer *); /* normalized 0...1 */
+iBool   isStarved_Player        (const iPlayer *);
+int     numUnderruns_Player     (const iPlayer *);
+float   decodeTimeMs_Player     (const iPlayer *); /* average per decoded block */
+size_t  memorySize_Player       (const iPlayer *); /* downloaded data and sample buffer */
 
 uint32_t    idleTimeMs_Player       (const iPlayer *);
 iString *   metadataLabel_Player    (const iPlayer *);
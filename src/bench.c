@@ -0,0 +1,592 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+/* Headless benchmark of document layout and rendering. Fixtures are generated, and more
+   can be loaded from a corpus directory. Network traces recorded with --record-trace are
+   replayed through GmRequest while the pages are laid out as they arrive. By default, the
+   trace is replayed without delays but one chunk at a time. The results are printed as JSON:
+
+   lagrange-bench [--corpus DIR] [--iterations N] [--trace FILE] [--trace-speed X] */
+
+#include "app.h"
+#include "embedded.h"
+#include "gmdocument.h"
+#include "gmrequest.h"
+#include "gopher.h"
+#include "stb_image.h"
+#include "visited.h"
+#include "ui/color.h"
+#include "ui/metrics.h"
+#include "ui/text.h"
+
+#include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/ptrarray.h>
+#include <SDL.h>
+#include <stdio.h>
+
+#if defined (LAGRANGE_ENABLE_MPG123)
+#  include <mpg123.h>
+#endif
+
+static const int docWidth_Bench_        = 800;
+static const int viewportHeight_Bench_  = 720;
+static const int numFindRuns_Bench_     = 10000;
+static const int numVisitedUrls_Bench_  = 100000;
+
+iDeclareType(Bench)
+iDeclareType(BenchFixture)
+
+typedef void (*iBenchFunc)(void *context);
+
+struct Impl_Bench {
+    int     numIterations;
+    iString results; /* JSON objects separated by commas */
+};
+
+struct Impl_BenchFixture {
+    iString     name;
+    iString     url;
+    iString     source;
+    enum iGmDocumentFormat format;
+    iBlock      data; /* images */
+    iGmDocument *doc;
+    uint32_t    seed; /* for pseudo-random positions */
+    size_t      counter;
+};
+
+static iBenchFixture *new_BenchFixture_(const char *name, const char *url) {
+    iBenchFixture *d = iMalloc(BenchFixture);
+    initCStr_String(&d->name, name);
+    initCStr_String(&d->url, url);
+    init_String(&d->source);
+    d->format = gemini_GmDocumentFormat;
+    init_Block(&d->data, 0);
+    d->doc     = new_GmDocument();
+    d->seed    = 1;
+    d->counter = 0;
+    setUrl_GmDocument(d->doc, &d->url);
+    return d;
+}
+
+static void delete_BenchFixture_(iBenchFixture *d) {
+    iRelease(d->doc);
+    deinit_Block(&d->data);
+    deinit_String(&d->source);
+    deinit_String(&d->url);
+    deinit_String(&d->name);
+    free(d);
+}
+
+static void drainEvents_Bench_(void) {
+    /* Documents post commands that nobody handles here. */
+    SDL_Event ev;
+    while (SDL_PollEvent(&ev)) {
+        if (ev.type == SDL_USEREVENT && ev.user.code == command_UserEventCode) {
+            free(ev.user.data1);
+        }
+    }
+}
+
+static double nowMs_Bench_(void) {
+    return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void appendJsonString_(iString *d, const iString *str) {
+    appendChar_String(d, '"');
+    iConstForEach(String, i, str) {
+        if (i.value == '"' || i.value == '\\') {
+            appendChar_String(d, '\\');
+        }
+        if (i.value >= 0x20) {
+            appendChar_String(d, i.value);
+        }
+    }
+    appendChar_String(d, '"');
+}
+
+static void measure_Bench_(iBench *d, const char *name, const iString *fixture,
+                           iBenchFunc prepare, iBenchFunc func, void *context) {
+    /* `prepare` is called before each iteration, outside the measured time. */
+    double total = 0.0;
+    double best  = 0.0;
+    for (int i = 0; i < d->numIterations; i++) {
+        if (prepare) {
+            prepare(context);
+        }
+        const double start = nowMs_Bench_();
+        func(context);
+        const double elapsed = nowMs_Bench_() - start;
+        total += elapsed;
+        best = (i == 0 ? elapsed : iMin(best, elapsed));
+        drainEvents_Bench_();
+        iRecycle();
+    }
+    appendFormat_String(&d->results,
+                        "%s\n    { \"name\": \"%s\", \"fixture\": ",
+                        isEmpty_String(&d->results) ? "" : ",",
+                        name);
+    appendJsonString_(&d->results, fixture);
+    appendFormat_String(&d->results,
+                        ", \"iterations\": %d, \"mean_ms\": %.3f, \"min_ms\": %.3f }",
+                        d->numIterations,
+                        total / d->numIterations,
+                        best);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const char *paragraph_Bench_ =
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt "
+    "ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation "
+    "ullamco laboris nisi ut aliquip ex ea commodo consequat. Sisältää myös ääkkösiä, "
+    "ελληνικά γράμματα και кириллицу.";
+
+static void makeGemtext_BenchFixture_(iBenchFixture *d, size_t numSections) {
+    for (size_t i = 0; i < numSections; i++) {
+        appendFormat_String(&d->source, "# Section %zu\n\n%s\n\n", i + 1, paragraph_Bench_);
+        appendFormat_String(&d->source,
+                            "=> gemini://example.com/page/%zu.gmi Link to page %zu\n"
+                            "=> https://example.com/%zu\n\n",
+                            i, i, i);
+        appendCStr_String(&d->source,
+                          "* First item in a list\n"
+                          "* Second item, a little bit longer than the first one\n\n"
+                          "> A quoted line that goes on long enough to wrap at least once "
+                          "when the page is not very wide.\n\n"
+                          "```c\nint main(void) {\n\treturn 0;\n}\n```\n\n");
+        appendFormat_String(&d->source, "## Subsection %zu.1\n\n%s\n\n", i + 1, paragraph_Bench_);
+    }
+}
+
+static void makePlainText_BenchFixture_(iBenchFixture *d, size_t numLines) {
+    d->format = plainText_GmDocumentFormat;
+    for (size_t i = 0; i < numLines; i++) {
+        appendFormat_String(&d->source,
+                            "2020-12-01 12:%02zu:%02zu [info] request %zu served in %zu ms "
+                            "to host-%zu.example.com\n",
+                            (i / 60) % 60, i % 60, i, (i * 7) % 500, i % 97);
+    }
+}
+
+static void makeGopherMenu_BenchFixture_(iBenchFixture *d, size_t numItems) {
+    /* The menu is kept as the source; it's converted to Gemtext by a benchmark. */
+    iBlock *menu = &d->data;
+    for (size_t i = 0; i < numItems; i++) {
+        appendCStr_Block(menu,
+                         cstr_String(collectNewFormat_String(
+                             "iInformation line %zu\t\terror.host\t1\r\n"
+                             "1Directory %zu\t/dir/%zu\texample.com\t70\r\n"
+                             "0Text file %zu\t/file/%zu.txt\texample.com\t70\r\n",
+                             i, i, i, i, i)));
+    }
+    appendCStr_Block(menu, ".\r\n");
+}
+
+static void convertGopher_BenchFixture_(iBenchFixture *d) {
+    iGopher gopher;
+    init_Gopher(&gopher);
+    gopher.type   = '1';
+    gopher.meta   = collectNew_String();
+    gopher.output = &d->source.chars;
+    clear_String(&d->source);
+    processResponse_Gopher(&gopher, &d->data);
+    deinit_Gopher(&gopher);
+}
+
+static void setSource_BenchFixture_(void *context) {
+    iBenchFixture *d = context;
+    setFormat_GmDocument(d->doc, d->format);
+    setSource_GmDocument(d->doc, &d->source, docWidth_Bench_); /* normalizes */
+    extendLayout_GmDocument(d->doc, INT_MAX);
+}
+
+static void layout_BenchFixture_(void *context) {
+    iBenchFixture *d = context;
+    redoLayout_GmDocument(d->doc);
+    extendLayout_GmDocument(d->doc, INT_MAX);
+}
+
+static void countRun_BenchFixture_(void *context, const iGmRun *run) {
+    iBenchFixture *d = context;
+    iUnused(run);
+    d->counter++;
+}
+
+static void render_BenchFixture_(void *context) {
+    /* Scroll through the whole document one viewport at a time. */
+    iBenchFixture *d = context;
+    const int height = size_GmDocument(d->doc).y;
+    for (int y = 0; y < height; y += viewportHeight_Bench_ / 4) {
+        render_GmDocument(
+            d->doc, (iRangei){ y, y + viewportHeight_Bench_ }, countRun_BenchFixture_, d);
+    }
+}
+
+static void findRun_BenchFixture_(void *context) {
+    iBenchFixture *d    = context;
+    const iInt2    size = size_GmDocument(d->doc);
+    for (int i = 0; i < numFindRuns_Bench_; i++) {
+        d->seed = d->seed * 1103515245 + 12345;
+        const iInt2 pos = init_I2((d->seed >> 8) % iMax(1, size.x),
+                                  (d->seed >> 4) % iMax(1, size.y));
+        if (findRun_GmDocument(d->doc, pos)) {
+            d->counter++;
+        }
+    }
+}
+
+static void convertGopherMenu_BenchFixture_(void *context) {
+    convertGopher_BenchFixture_(context);
+}
+
+static void decodeImage_BenchFixture_(void *context) {
+    iBenchFixture *d = context;
+    int w, h, num;
+    stbi_uc *pixels = stbi_load_from_memory(
+        constData_Block(&d->data), size_Block(&d->data), &w, &h, &num, 4);
+    stbi_image_free(pixels);
+}
+
+static void measureDocument_Bench_(iBench *d, iBenchFixture *fix) {
+    measure_Bench_(d, "setSource_GmDocument", &fix->name, NULL, setSource_BenchFixture_, fix);
+    measure_Bench_(d, "doLayout_GmDocument", &fix->name, NULL, layout_BenchFixture_, fix);
+    measure_Bench_(d, "render_GmDocument", &fix->name, NULL, render_BenchFixture_, fix);
+    measure_Bench_(d, "findRun_GmDocument", &fix->name, NULL, findRun_BenchFixture_, fix);
+}
+
+static iBool checkFinishedStream_Bench_(void) {
+    /* Once the stream has finished, a streamed document must be cached per width and laid
+       out lazily like one whose source was set all at once. */
+    iBenchFixture *fix = new_BenchFixture_("streamed.gmi", "gemini://bench/");
+    makeGemtext_BenchFixture_(fix, 500);
+    const size_t chunkSize = 16 * 1024;
+    const char * start     = constBegin_String(&fix->source);
+    iString *    part      = collectNew_String();
+    for (size_t size = 0; size < size_String(&fix->source); ) {
+        size = iMin(size + chunkSize, size_String(&fix->source));
+        setRange_String(part, (iRangecc){ start, start + size });
+        setStreamedSource_GmDocument(fix->doc, part, docWidth_Bench_);
+    }
+    finishStream_GmDocument(fix->doc);
+    setWidth_GmDocument(fix->doc, docWidth_Bench_ / 2);
+    iGmDocumentMemory mem;
+    memoryUsage_GmDocument(fix->doc, &mem);
+    const iBool ok = !isStreaming_GmDocument(fix->doc) && mem.cachedLayoutBytes > 0 &&
+                     isLayoutPartial_GmDocument(fix->doc);
+    if (!ok) {
+        fprintf(stderr, "finished stream is not cached or laid out lazily\n");
+    }
+    delete_BenchFixture_(fix);
+    drainEvents_Bench_();
+    return ok;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void resetFonts_Bench_(void *context) {
+    iUnused(context);
+    resetFonts_Text();
+}
+
+static void fillGlyphCache_Bench_(void *context) {
+    const iString *chars = context;
+    const int fonts[] = { regular_FontId, italic_FontId, monospace_FontId, medium_FontId,
+                          big_FontId, default_FontId };
+    iForIndices(i, fonts) {
+        drawRange_Text(fonts[i], zero_I2(), uiText_ColorId, range_String(chars));
+    }
+}
+
+iDeclareType(VisitedBench)
+
+struct Impl_VisitedBench {
+    iString   dir;
+    iVisited *visited;
+};
+
+static void prepareVisited_Bench_(void *context) {
+    iVisitedBench *d = context;
+    delete_Visited(d->visited);
+    d->visited = new_Visited();
+}
+
+static void loadVisited_Bench_(void *context) {
+    iVisitedBench *d = context;
+    load_Visited(d->visited, cstr_String(&d->dir));
+}
+
+static void measureVisited_Bench_(iBench *d) {
+    iVisitedBench vb;
+    initCStr_String(&vb.dir, "bench-visited");
+    makeDirs_Path(&vb.dir);
+    /* Save a large history for loading. */ {
+        iVisited *visited = new_Visited();
+        iString   url;
+        init_String(&url);
+        for (int i = 0; i < numVisitedUrls_Bench_; i++) {
+            format_String(&url, "gemini://host%d.example.com/path/to/page-%d.gmi", i % 500, i);
+            visitUrl_Visited(visited, &url, 0);
+        }
+        deinit_String(&url);
+        save_Visited(visited, cstr_String(&vb.dir));
+        delete_Visited(visited);
+    }
+    vb.visited = NULL;
+    measure_Bench_(d,
+                   "load_Visited",
+                   collectNewFormat_String("%d URLs", numVisitedUrls_Bench_),
+                   prepareVisited_Bench_,
+                   loadVisited_Bench_,
+                   &vb);
+    delete_Visited(vb.visited);
+    iForEach(DirFileInfo, i, iClob(directoryContents_FileInfo(iClob(new_FileInfo(&vb.dir))))) {
+        remove(cstr_String(path_FileInfo(i.value)));
+    }
+    remove(cstr_String(&vb.dir));
+    deinit_String(&vb.dir);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(TraceBench)
+
+struct Impl_TraceBench {
+    const iString *url;
+    iGmDocument *  doc;
+};
+
+static void prepareTrace_Bench_(void *context) {
+    iTraceBench *d = context;
+    iRelease(d->doc);
+    d->doc = new_GmDocument();
+    setUrl_GmDocument(d->doc, d->url);
+}
+
+static void replayTrace_Bench_(void *context) {
+    /* Like a page being opened in a tab: text is laid out as it streams in, and images are
+       decoded when complete. */
+    iTraceBench *d   = context;
+    iGmRequest * req = new_GmRequest(NULL);
+    iString *    src = new_String();
+    setUrl_GmRequest(req, d->url);
+    submit_GmRequest(req);
+    size_t numBytes = 0;
+    for (iBool isDone = iFalse; !isDone; ) {
+        isDone = isFinished_GmRequest(req);
+        iGmResponse *resp = lockResponse_GmRequest(req);
+        if (isDone || size_Block(&resp->body) != numBytes) {
+            numBytes = size_Block(&resp->body);
+            if (startsWithCase_String(&resp->meta, "text/")) {
+                setFormat_GmDocument(d->doc,
+                                     startsWithCase_String(&resp->meta, "text/gemini")
+                                         ? gemini_GmDocumentFormat
+                                         : plainText_GmDocumentFormat);
+                set_Block(&src->chars, &resp->body);
+                if (isDone) {
+                    setSource_GmDocument(d->doc, src, docWidth_Bench_);
+                }
+                else {
+                    setStreamedSource_GmDocument(d->doc, src, docWidth_Bench_);
+                }
+                extendLayout_GmDocument(d->doc, INT_MAX);
+            }
+            else if (isDone && startsWithCase_String(&resp->meta, "image/")) {
+                int w, h, num;
+                stbi_image_free(stbi_load_from_memory(
+                    constData_Block(&resp->body), size_Block(&resp->body), &w, &h, &num, 4));
+            }
+        }
+        unlockResponse_GmRequest(req);
+        if (!isDone) {
+            SDL_Delay(0);
+        }
+    }
+    delete_String(src);
+    iRelease(req);
+}
+
+static void measureTrace_Bench_(iBench *d) {
+    iConstForEach(StringList, i, tracedUrls_GmRequestQueue()) {
+        iTraceBench tb = { i.value, NULL };
+        measure_Bench_(d, "replay_GmRequest", i.value, prepareTrace_Bench_, replayTrace_Bench_,
+                       &tb);
+        iRelease(tb.doc);
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void loadCorpus_Bench_(iPtrArray *fixtures, const iString *dir) {
+    iForEach(DirFileInfo, i, iClob(directoryContents_FileInfo(iClob(new_FileInfo(dir))))) {
+        const iString *path = path_FileInfo(i.value);
+        const char *   name = cstr_Rangecc(baseName_Path(path));
+        iFile *        f    = iClob(new_File(path));
+        if (!open_File(f, readOnly_FileMode)) {
+            continue;
+        }
+        iBenchFixture *fix = NULL;
+        if (endsWithCase_String(path, ".gmi") || endsWithCase_String(path, ".gemini")) {
+            fix = new_BenchFixture_(name, "gemini://bench/");
+            set_Block(&fix->source.chars, collect_Block(readAll_File(f)));
+        }
+        else if (endsWithCase_String(path, ".txt")) {
+            fix = new_BenchFixture_(name, "gemini://bench/");
+            fix->format = plainText_GmDocumentFormat;
+            set_Block(&fix->source.chars, collect_Block(readAll_File(f)));
+        }
+        else if (endsWithCase_String(path, ".gophermap") || endsWithCase_String(path, ".gph")) {
+            fix = new_BenchFixture_(name, "gopher://bench/1/");
+            set_Block(&fix->data, collect_Block(readAll_File(f)));
+        }
+        else if (endsWithCase_String(path, ".png") || endsWithCase_String(path, ".jpg") ||
+                 endsWithCase_String(path, ".jpeg") || endsWithCase_String(path, ".gif")) {
+            fix = new_BenchFixture_(name, "gemini://bench/");
+            set_Block(&fix->data, collect_Block(readAll_File(f)));
+        }
+        if (fix) {
+            pushBack_PtrArray(fixtures, fix);
+        }
+    }
+}
+
+static void run_Bench_(iBench *d, const iString *corpusDir) {
+    iPtrArray *fixtures = collectNew_PtrArray();
+    /* Generated fixtures. */ {
+        iBenchFixture *gemtext = new_BenchFixture_("generated.gmi", "gemini://bench/");
+        makeGemtext_BenchFixture_(gemtext, 500);
+        pushBack_PtrArray(fixtures, gemtext);
+        iBenchFixture *plain = new_BenchFixture_("generated.txt", "gemini://bench/");
+        makePlainText_BenchFixture_(plain, 20000);
+        pushBack_PtrArray(fixtures, plain);
+        iBenchFixture *gopher = new_BenchFixture_("generated.gophermap", "gopher://bench/1/");
+        makeGopherMenu_BenchFixture_(gopher, 3000);
+        pushBack_PtrArray(fixtures, gopher);
+#if defined (iPlatformLinux)
+        iBenchFixture *icon = new_BenchFixture_("lagrange-64.png", "gemini://bench/");
+        set_Block(&icon->data, &imageLagrange64_Embedded);
+        pushBack_PtrArray(fixtures, icon);
+#endif
+    }
+    if (corpusDir) {
+        loadCorpus_Bench_(fixtures, corpusDir);
+    }
+    iForEach(PtrArray, i, fixtures) {
+        iBenchFixture *fix = i.ptr;
+        if (startsWith_String(&fix->url, "gopher:")) {
+            measure_Bench_(
+                d, "processResponse_Gopher", &fix->name, NULL, convertGopherMenu_BenchFixture_, fix);
+            measureDocument_Bench_(d, fix);
+        }
+        else if (!isEmpty_Block(&fix->data)) {
+            measure_Bench_(d, "stbi_load_from_memory", &fix->name, NULL, decodeImage_BenchFixture_,
+                           fix);
+        }
+        else {
+            measureDocument_Bench_(d, fix);
+        }
+    }
+    /* Glyph cache. */ {
+        iString *chars = collectNew_String();
+        for (iChar ch = 0x20; ch < 0x7f; ch++) {
+            appendChar_String(chars, ch);
+        }
+        for (iChar ch = 0xa1; ch <= 0xff; ch++) {
+            appendChar_String(chars, ch);
+        }
+        for (iChar ch = 0x391; ch <= 0x3c9; ch++) {
+            appendChar_String(chars, ch);
+        }
+        for (iChar ch = 0x410; ch <= 0x44f; ch++) {
+            appendChar_String(chars, ch);
+        }
+        measure_Bench_(d,
+                       "glyphCacheFill",
+                       collectNewFormat_String("%zu characters", length_String(chars)),
+                       resetFonts_Bench_,
+                       fillGlyphCache_Bench_,
+                       chars);
+    }
+    measureVisited_Bench_(d);
+    measureTrace_Bench_(d);
+    iForEach(PtrArray, j, fixtures) {
+        delete_BenchFixture_(j.ptr);
+    }
+}
+
+int main(int argc, char **argv) {
+#if defined (LAGRANGE_ENABLE_MPG123)
+    mpg123_init();
+#endif
+    init_Foundation();
+    if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER)) {
+        fprintf(stderr, "SDL init failed: %s\n", SDL_GetError());
+        return -1;
+    }
+    iBench bench;
+    bench.numIterations = 5;
+    init_String(&bench.results);
+    const iString *corpusDir  = NULL;
+    const iString *tracePath  = NULL;
+    float          traceSpeed = 0.0f;
+    for (int i = 1; i < argc; i++) {
+        if (!iCmpStr(argv[i], "--corpus") && i + 1 < argc) {
+            corpusDir = collectNewCStr_String(argv[++i]);
+        }
+        else if (!iCmpStr(argv[i], "--iterations") && i + 1 < argc) {
+            bench.numIterations = iMax(1, atoi(argv[++i]));
+        }
+        else if (!iCmpStr(argv[i], "--trace") && i + 1 < argc) {
+            tracePath = collectNewCStr_String(argv[++i]);
+        }
+        else if (!iCmpStr(argv[i], "--trace-speed") && i + 1 < argc) {
+            traceSpeed = (float) atof(argv[++i]);
+        }
+    }
+    initHeadless_App(argc, argv);
+    if (tracePath && !setReplayTrace_GmRequestQueue(tracePath, traceSpeed)) {
+        fprintf(stderr, "failed to load trace: %s\n", cstr_String(tracePath));
+    }
+    /* Everything is drawn to an offscreen surface. */
+    SDL_Surface * surface = SDL_CreateRGBSurfaceWithFormat(
+        0, docWidth_Bench_, viewportHeight_Bench_, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer *render = SDL_CreateSoftwareRenderer(surface);
+    setPixelRatio_Metrics(1.0f);
+    init_Text(render);
+    run_Bench_(&bench, corpusDir);
+    const iBool isStreamOk = checkFinishedStream_Bench_();
+    printf("{\n  \"version\": \"%s\",\n  \"results\": [%s\n  ]\n}\n",
+           LAGRANGE_APP_VERSION,
+           cstr_String(&bench.results));
+    deinit_String(&bench.results);
+    deinit_Text();
+    SDL_DestroyRenderer(render);
+    SDL_FreeSurface(surface);
+    deinitHeadless_App();
+    SDL_Quit();
+#if defined (LAGRANGE_ENABLE_MPG123)
+    mpg123_exit();
+#endif
+    deinit_Foundation();
+    return isStreamOk ? 0 : 1;
+}
@@ -21,12 +21,18 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "bookmarks.h"
+#include "journal.h"
+#include "saver.h"
+#include "trigramindex.h"
 
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/regexp.h>
+#include <the_Foundation/sortedarray.h>
+#include <string.h>
 
 void init_Bookmark(iBookmark *d) {
     init_String(&d->url);
@@ -41,13 +47,45 @@ void deinit_Bookmark(iBookmark *d) {
     deinit_String(&d->url);
 }
 
+static iBool isTagChar_(char ch) {
+    /* Same as a word character in a regular expression, so tags are found like with \b. */
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+           ch == '_' || (uint8_t) ch >= 0x80;
+}
+
+static iBool nextTag_(iRangecc tags, iRangecc *tag) {
+    const char *pos = tag->start ? tag->end : tags.start;
+    while (pos != tags.end && !isTagChar_(*pos)) pos++;
+    if (pos == tags.end) {
+        return iFalse;
+    }
+    tag->start = pos;
+    while (pos != tags.end && isTagChar_(*pos)) pos++;
+    tag->end = pos;
+    return iTrue;
+}
+
+static iBool equalTag_(iRangecc tag, const char *other, iBool isCaseSensitive) {
+    const size_t len = strlen(other);
+    if (size_Range(&tag) != len) {
+        return iFalse;
+    }
+    return cmpCStrNSc_Rangecc(
+               tag, other, len, isCaseSensitive ? &iCaseSensitive : &iCaseInsensitive) == 0;
+}
+
+static iBool hasTag_Bookmark_(const iBookmark *d, const char *tag, iBool isCaseSensitive) {
+    iRangecc t = iNullRange;
+    while (nextTag_(range_String(&d->tags), &t)) {
+        if (equalTag_(t, tag, isCaseSensitive)) {
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
 iBool hasTag_Bookmark(const iBookmark *d, const char *tag) {
-    iRegExp *pattern = new_RegExp(format_CStr("\\b%s\\b", tag), caseSensitive_RegExpOption);
-    iRegExpMatch m;
-    init_RegExpMatch(&m);
-    const iBool found = matchString_RegExp(pattern, &d->tags, &m);
-    iRelease(pattern);
-    return found;
+    return hasTag_Bookmark_(d, tag, iTrue);
 }
 
 void addTag_Bookmark(iBookmark *d, const char *tag) {
@@ -73,10 +111,43 @@ static int cmpTimeDescending_Bookmark_(const iBookmark **a, const iBookmark **b)
 
 static const char *fileName_Bookmarks_ = "bookmarks.txt";
 
+/* The URLs and tags of the bookmarks are indexed by their hashes. An index is sorted by hash
+   and then by bookmark ID, so all the bookmarks with a given hash are found with a binary
+   search. A hit is confirmed by comparing the actual URL or tag. */
+
+iDeclareType(BookmarkKey)
+
+struct Impl_BookmarkKey {
+    uint32_t hash;
+    uint32_t id;
+};
+
+static int cmp_BookmarkKey_(const void *a, const void *b) {
+    const iBookmarkKey *s = a, *t = b;
+    const int cmp = iCmp(s->hash, t->hash);
+    return cmp ? cmp : iCmp(s->id, t->id);
+}
+
+static uint32_t hashCase_(iRangecc text) {
+    uint32_t hash = 0x811c9dc5; /* FNV-1a */
+    for (const char *ch = text.start; ch != text.end; ch++) {
+        const char lower = (*ch >= 'A' && *ch <= 'Z') ? *ch - 'A' + 'a' : *ch;
+        hash = (hash ^ (uint8_t) lower) * 0x01000193;
+    }
+    return hash;
+}
+
 struct Impl_Bookmarks {
-    iMutex *mtx;
-    int     idEnum;
-    iHash   bookmarks; /* bookmark ID is the hash key */
+    iMutex *     mtx;
+    int          idEnum;
+    iHash        bookmarks; /* bookmark ID is the hash key */
+    iSortedArray urlIndex;  /* BookmarkKeys of case-folded URLs */
+    iSortedArray tagIndex;  /* BookmarkKeys of case-folded tags */
+    iTrigramIndex *trigrams; /* IDs by trigrams of URL, title, and tags */
+    iBool        isTrigramsValid;
+    iAtomicInt   revision; /* incremented when bookmarks are added, edited, or removed */
+    iString      saveDir;
+    iJournal *   journal; /* changes since the file was last saved */
 };
 
 iDefineTypeConstruction(Bookmarks)
@@ -85,32 +156,205 @@ void init_Bookmarks(iBookmarks *d) {
     d->mtx = new_Mutex();
     d->idEnum = 0;
     init_Hash(&d->bookmarks);
+    init_SortedArray(&d->urlIndex, sizeof(iBookmarkKey), cmp_BookmarkKey_);
+    init_SortedArray(&d->tagIndex, sizeof(iBookmarkKey), cmp_BookmarkKey_);
+    d->trigrams = new_TrigramIndex();
+    d->isTrigramsValid = iTrue;
+    set_Atomic(&d->revision, 0);
+    init_String(&d->saveDir);
+    d->journal = NULL;
 }
 
 void deinit_Bookmarks(iBookmarks *d) {
+    delete_Journal(d->journal); /* waits for an ongoing compaction */
+    d->journal = NULL;
     clear_Bookmarks(d);
     deinit_Hash(&d->bookmarks);
+    deinit_SortedArray(&d->tagIndex);
+    deinit_SortedArray(&d->urlIndex);
+    delete_TrigramIndex(d->trigrams);
+    deinit_String(&d->saveDir);
     delete_Mutex(d->mtx);
 }
 
+/* Bookmark IDs are renumbered when the file is loaded, so journal records identify the
+   bookmark by its creation time instead. It is written with the same precision as in the
+   file, and never changes. */
+
+static const iString *key_Bookmark_(const iBookmark *d) {
+    return collect_String(newFormat_String("%lf", seconds_Time(&d->when)));
+}
+
+static iBookmark *findKey_Bookmarks_(const iBookmarks *d, const iString *key) {
+    /* Called while locked. */
+    iConstForEach(Hash, i, &d->bookmarks) {
+        iBookmark *bm = (iBookmark *) i.value;
+        if (equal_String(key_Bookmark_(bm), key)) {
+            return bm;
+        }
+    }
+    return NULL;
+}
+
+static void journal_Bookmarks_(iBookmarks *d, const char *type, const iBookmark *bm,
+                               iBool withFields) {
+    /* Called while locked so the journal is ordered the same way as the changes. */
+    if (!d->journal) return;
+    iStringList *fields = new_StringList();
+    pushBackCStr_StringList(fields, type);
+    pushBack_StringList(fields, key_Bookmark_(bm));
+    if (withFields) {
+        pushBack_StringList(fields,
+                            collect_String(newFormat_String(
+                                "%08x %lf", bm->icon, seconds_Time(&bm->when))));
+        pushBack_StringList(fields, &bm->url);
+        pushBack_StringList(fields, &bm->title);
+        pushBack_StringList(fields, &bm->tags);
+    }
+    append_Journal(d->journal, fields);
+    iRelease(fields);
+}
+
+static void indexTrigrams_Bookmarks_(iBookmarks *d, const iBookmark *bm) {
+    const uint32_t id = id_Bookmark(bm);
+    add_TrigramIndex(d->trigrams, range_String(&bm->url), id);
+    add_TrigramIndex(d->trigrams, range_String(&bm->title), id);
+    add_TrigramIndex(d->trigrams, range_String(&bm->tags), id);
+}
+
+static void index_Bookmarks_(iBookmarks *d, const iBookmark *bm) {
+    /* Called while locked. */
+    const uint32_t id = id_Bookmark(bm);
+    add_Atomic(&d->revision, 1);
+    if (d->isTrigramsValid) {
+        indexTrigrams_Bookmarks_(d, bm);
+    }
+    insert_SortedArray(&d->urlIndex, &(iBookmarkKey){ hashCase_(range_String(&bm->url)), id });
+    iRangecc tag = iNullRange;
+    while (nextTag_(range_String(&bm->tags), &tag)) {
+        insert_SortedArray(&d->tagIndex, &(iBookmarkKey){ hashCase_(tag), id });
+    }
+}
+
+static void removeKeys_(iSortedArray *index, uint32_t id) {
+    iArray *keys = &index->values;
+    size_t  dst  = 0;
+    for (size_t i = 0; i < size_Array(keys); i++) {
+        const iBookmarkKey *key = constAt_Array(keys, i);
+        if (key->id != id) {
+            if (dst != i) {
+                *(iBookmarkKey *) at_Array(keys, dst) = *key;
+            }
+            dst++;
+        }
+    }
+    resize_Array(keys, dst);
+}
+
+static void unindex_Bookmarks_(iBookmarks *d, uint32_t id) {
+    /* Called while locked. The keys aren't computed from the bookmark because it may have
+       been modified already. */
+    removeKeys_(&d->urlIndex, id);
+    removeKeys_(&d->tagIndex, id);
+    add_Atomic(&d->revision, 1);
+    /* Trigrams are rebuilt when next needed, since the old texts are gone. */
+    d->isTrigramsValid = iFalse;
+}
+
+static void updateTrigrams_Bookmarks_(iBookmarks *d) {
+    /* Called while locked. */
+    if (!d->isTrigramsValid) {
+        clear_TrigramIndex(d->trigrams);
+        iConstForEach(Hash, i, &d->bookmarks) {
+            indexTrigrams_Bookmarks_(d, (const iBookmark *) i.value);
+        }
+        d->isTrigramsValid = iTrue;
+    }
+}
+
+static void compact_Bookmarks_(void *context) {
+    iBookmarks *d = context;
+    save_Bookmarks(d, cstr_String(&d->saveDir));
+}
+
 void clear_Bookmarks(iBookmarks *d) {
     lock_Mutex(d->mtx);
     iForEach(Hash, i, &d->bookmarks) {
         delete_Bookmark((iBookmark *) i.value);
     }
     clear_Hash(&d->bookmarks);
+    clear_SortedArray(&d->urlIndex);
+    clear_SortedArray(&d->tagIndex);
+    clear_TrigramIndex(d->trigrams);
+    d->isTrigramsValid = iTrue;
     d->idEnum = 0;
+    add_Atomic(&d->revision, 1);
     unlock_Mutex(d->mtx);
 }
 
+static void setFields_Bookmark_(iBookmark *d, const iStringList *fields) {
+    /* Fields of an "add" or "edit" record. */
+    char *endPos;
+    d->icon = strtoul(cstr_String(constAt_StringList(fields, 2)), &endPos, 16);
+    initSeconds_Time(&d->when, strtod(endPos, NULL));
+    set_String(&d->url, constAt_StringList(fields, 3));
+    set_String(&d->title, constAt_StringList(fields, 4));
+    set_String(&d->tags, constAt_StringList(fields, 5));
+}
+
+static void insert_Bookmarks_(iBookmarks *d, iBookmark *bookmark);
+
+static void replay_Bookmarks_(void *context, const iStringList *fields) {
+    iBookmarks *   d    = context;
+    const iString *type = constAt_StringList(fields, 0);
+    if (size_StringList(fields) < 2) {
+        return;
+    }
+    const iString *key = constAt_StringList(fields, 1);
+    uint32_t       id  = 0;
+    if (!contains_String(key, '.')) {
+        /* Written by an earlier version that used the bookmark ID. */
+        id = strtoul(cstr_String(key), NULL, 10);
+    }
+    else {
+        iGuardMutex(d->mtx, {
+            const iBookmark *bm = findKey_Bookmarks_(d, key);
+            id = bm ? id_Bookmark(bm) : 0;
+        });
+    }
+    if (!cmp_String(type, "remove")) {
+        remove_Bookmarks(d, id);
+    }
+    else if (size_StringList(fields) == 6) {
+        if (!cmp_String(type, "add")) {
+            iBookmark *bm = new_Bookmark();
+            setFields_Bookmark_(bm, fields);
+            insert_Bookmarks_(d, bm);
+        }
+        else if (!cmp_String(type, "edit")) {
+            iBookmark *bm = get_Bookmarks(d, id);
+            if (bm) {
+                setFields_Bookmark_(bm, fields);
+                iGuardMutex(d->mtx, {
+                    unindex_Bookmarks_(d, id);
+                    index_Bookmarks_(d, bm);
+                });
+            }
+        }
+    }
+}
+
 static void insert_Bookmarks_(iBookmarks *d, iBookmark *bookmark) {
     lock_Mutex(d->mtx);
     bookmark->node.key = ++d->idEnum;
     insert_Hash(&d->bookmarks, &bookmark->node);
+    index_Bookmarks_(d, bookmark);
     unlock_Mutex(d->mtx);
 }
 
 void load_Bookmarks(iBookmarks *d, const char *dirPath) {
+    delete_Journal(d->journal);
+    d->journal = NULL;
     clear_Bookmarks(d);
     iFile *f = newCStr_File(concatPath_CStr(dirPath, fileName_Bookmarks_));
     if (open_File(f, readOnly_FileMode | text_FileMode)) {
@@ -139,26 +383,35 @@ void load_Bookmarks(iBookmarks *d, const char *dirPath) {
         }
     }
     iRelease(f);
+    /* Apply the changes made after the file was saved. */
+    setCStr_String(&d->saveDir, dirPath);
+    iJournal *journal =
+        new_Journal(collect_String(newCStr_String(concatPath_CStr(dirPath, "bookmarks.journal"))),
+                    compact_Bookmarks_,
+                    d);
+    replay_Journal(journal, replay_Bookmarks_, d);
+    d->journal = journal;
 }
 
 void save_Bookmarks(const iBookmarks *d, const char *dirPath) {
     lock_Mutex(d->mtx);
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, fileName_Bookmarks_));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        iString *str = collectNew_String();
-        iConstForEach(Hash, i, &d->bookmarks) {
-            const iBookmark *bm = (const iBookmark *) i.value;
-            format_String(str,
-                          "%08x %lf %s\n%s\n%s\n",
-                          bm->icon,
-                          seconds_Time(&bm->when),
-                          cstr_String(&bm->url),
-                          cstr_String(&bm->title),
-                          cstr_String(&bm->tags));
-            writeData_File(f, cstr_String(str), size_String(str));
-        }
+    iString *str = new_String();
+    iConstForEach(Hash, i, &d->bookmarks) {
+        const iBookmark *bm = (const iBookmark *) i.value;
+        appendFormat_String(str,
+                            "%08x %lf %s\n%s\n%s\n",
+                            bm->icon,
+                            seconds_Time(&bm->when),
+                            cstr_String(&bm->url),
+                            cstr_String(&bm->title),
+                            cstr_String(&bm->tags));
     }
-    iRelease(f);
+    /* The journal is kept if the file could not be written. */
+    const iString *path = collectNewCStr_String(concatPath_CStr(dirPath, fileName_Bookmarks_));
+    if (writeAtomically_Saver(path, utf8_String(str)) && d->journal) {
+        clear_Journal(d->journal); /* all changes are in the file now */
+    }
+    delete_String(str);
     unlock_Mutex(d->mtx);
 }
 
@@ -171,7 +424,12 @@ void add_Bookmarks(iBookmarks *d, const iString *url, const iString *title, cons
     if (tags) set_String(&bm->tags, tags);
     bm->icon = icon;
     initCurrent_Time(&bm->when);
+    while (findKey_Bookmarks_(d, key_Bookmark_(bm))) {
+        /* The creation time identifies the bookmark in the journal. */
+        initSeconds_Time(&bm->when, seconds_Time(&bm->when) + 0.000001);
+    }
     insert_Bookmarks_(d, bm);
+    journal_Bookmarks_(d, "add", bm, iTrue);
     unlock_Mutex(d->mtx);
 }
 
@@ -179,12 +437,25 @@ iBool remove_Bookmarks(iBookmarks *d, uint32_t id) {
     lock_Mutex(d->mtx);
     iBookmark *bm = (iBookmark *) remove_Hash(&d->bookmarks, id);
     if (bm) {
+        unindex_Bookmarks_(d, id);
+        journal_Bookmarks_(d, "remove", bm, iFalse);
         delete_Bookmark(bm);
     }
     unlock_Mutex(d->mtx);
     return bm != NULL;
 }
 
+void markEdited_Bookmarks(iBookmarks *d, uint32_t id) {
+    lock_Mutex(d->mtx);
+    const iBookmark *bm = get_Bookmarks(d, id);
+    if (bm) {
+        unindex_Bookmarks_(d, id);
+        index_Bookmarks_(d, bm);
+        journal_Bookmarks_(d, "edit", bm, iTrue);
+    }
+    unlock_Mutex(d->mtx);
+}
+
 iBookmark *get_Bookmarks(iBookmarks *d, uint32_t id) {
     return (iBookmark *) value_Hash(&d->bookmarks, id);
 }
@@ -195,15 +466,117 @@ iBool filterTagsRegExp_Bookmarks(void *regExp, const iBookmark *bm) {
     return matchString_RegExp(regExp, &bm->tags, &m);
 }
 
-static iBool matchUrl_(void *url, const iBookmark *bm) {
-    return equalCase_String(url, &bm->url);
+static size_t firstKey_(const iSortedArray *index, uint32_t hash) {
+    size_t pos;
+    locate_SortedArray(index, &(iBookmarkKey){ hash, 0 }, &pos); /* IDs start from 1 */
+    return pos;
+}
+
+size_t size_Bookmarks(const iBookmarks *d) {
+    size_t size;
+    iGuardMutex(d->mtx, size = size_Hash(&d->bookmarks));
+    return size;
+}
+
+size_t memorySize_Bookmarks(const iBookmarks *d) {
+    size_t size = 0;
+    lock_Mutex(d->mtx);
+    iConstForEach(Hash, i, &d->bookmarks) {
+        const iBookmark *bm = (const iBookmark *) i.value;
+        size += sizeof(iBookmark) + size_String(&bm->url) + size_String(&bm->title) +
+                size_String(&bm->tags);
+    }
+    unlock_Mutex(d->mtx);
+    return size;
 }
 
 uint32_t findUrl_Bookmarks(const iBookmarks *d, const iString *url) {
-    /* TODO: O(n), boo */
-    const iPtrArray *found = list_Bookmarks(d, NULL, matchUrl_, (void *) url);
-    if (isEmpty_PtrArray(found)) return 0;
-    return id_Bookmark(constFront_PtrArray(found));
+    /* The newest bookmark is returned if the URL has been bookmarked more than once. */
+    const uint32_t hash  = hashCase_(range_String(url));
+    const iBookmark *found = NULL;
+    lock_Mutex(d->mtx);
+    for (size_t i = firstKey_(&d->urlIndex, hash); i < size_SortedArray(&d->urlIndex); i++) {
+        const iBookmarkKey *key = constAt_SortedArray(&d->urlIndex, i);
+        if (key->hash != hash) break;
+        const iBookmark *bm = (const iBookmark *) value_Hash(&d->bookmarks, key->id);
+        if (bm && equalCase_String(url, &bm->url) &&
+            (!found || cmpTimeDescending_Bookmark_(&bm, &found) < 0)) {
+            found = bm;
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return found ? id_Bookmark(found) : 0;
+}
+
+static void pushSnapshot_Bookmark_(const iBookmark *bm, iArray *bookmarks_out) {
+    iBookmark copy;
+    iZap(copy.node);
+    copy.node.key = bm->node.key;
+    initCopy_String(&copy.url, &bm->url);
+    initCopy_String(&copy.title, &bm->title);
+    initCopy_String(&copy.tags, &bm->tags);
+    copy.icon = bm->icon;
+    copy.when = bm->when;
+    pushBack_Array(bookmarks_out, &copy);
+}
+
+static void snapshot_Bookmarks_(const iBookmarks *d, iArray *bookmarks_out) {
+    /* Called while locked. */
+    reserve_Array(bookmarks_out, size_Array(bookmarks_out) + size_Hash(&d->bookmarks));
+    iConstForEach(Hash, i, &d->bookmarks) {
+        pushSnapshot_Bookmark_((const iBookmark *) i.value, bookmarks_out);
+    }
+}
+
+void snapshot_Bookmarks(const iBookmarks *d, iArray *bookmarks_out) {
+    iGuardMutex(d->mtx, snapshot_Bookmarks_(d, bookmarks_out));
+}
+
+void snapshotMatching_Bookmarks(const iBookmarks *d, const iStringList *words,
+                                iArray *bookmarks_out) {
+    lock_Mutex(d->mtx);
+    updateTrigrams_Bookmarks_(iConstCast(iBookmarks *, d));
+    iArray ids;
+    init_Array(&ids, sizeof(uint32_t));
+    if (query_TrigramIndex(d->trigrams, words, &ids)) {
+        iConstForEach(Array, i, &ids) {
+            const iBookmark *bm =
+                (const iBookmark *) value_Hash(&d->bookmarks, *(const uint32_t *) i.value);
+            if (bm) {
+                pushSnapshot_Bookmark_(bm, bookmarks_out);
+            }
+        }
+    }
+    else {
+        snapshot_Bookmarks_(d, bookmarks_out);
+    }
+    deinit_Array(&ids);
+    unlock_Mutex(d->mtx);
+}
+
+int revision_Bookmarks(const iBookmarks *d) {
+    return value_Atomic(&d->revision);
+}
+
+const iPtrArray *listTagged_Bookmarks(const iBookmarks *d, const char *tag,
+                                      iBookmarksCompareFunc cmp) {
+    iPtrArray *list = collectNew_PtrArray();
+    const uint32_t hash = hashCase_(range_CStr(tag));
+    lock_Mutex(d->mtx);
+    for (size_t i = firstKey_(&d->tagIndex, hash); i < size_SortedArray(&d->tagIndex); i++) {
+        const iBookmarkKey *key = constAt_SortedArray(&d->tagIndex, i);
+        if (key->hash != hash) break;
+        const iBookmark *bm = (const iBookmark *) value_Hash(&d->bookmarks, key->id);
+        /* A bookmark may have the same tag multiple times. */
+        if (bm && hasTag_Bookmark_(bm, tag, iFalse) &&
+            (isEmpty_PtrArray(list) || constBack_PtrArray(list) != bm)) {
+            pushBack_PtrArray(list, bm);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    if (!cmp) cmp = cmpTimeDescending_Bookmark_;
+    sort_Array(list, (int (*)(const void *, const void *)) cmp);
+    return list;
 }
 
 const iPtrArray *list_Bookmarks(const iBookmarks *d, iBookmarksCompareFunc cmp,
@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/hash.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/string.h>
+#include <the_Foundation/stringlist.h>
 #include <the_Foundation/time.h>
 
 iDeclareType(Bookmark)
@@ -54,8 +55,11 @@ void    save_Bookmarks      (const iBookmarks *, const char *dirPath);
 
 void    add_Bookmarks       (iBookmarks *, const iString *url, const iString *title, const iString *tags, iChar icon);
 iBool   remove_Bookmarks    (iBookmarks *, uint32_t id);
+void    markEdited_Bookmarks(iBookmarks *, uint32_t id); /* call after modifying a bookmark */
 iBookmark *get_Bookmarks    (iBookmarks *, uint32_t id);
-uint32_t findUrl_Bookmarks  (const iBookmarks *, const iString *url); /* O(n) */
+uint32_t findUrl_Bookmarks  (const iBookmarks *, const iString *url);
+size_t  size_Bookmarks      (const iBookmarks *);
+size_t  memorySize_Bookmarks(const iBookmarks *); /* approximate, excluding the indices */
 
 typedef iBool (*iBookmarksFilterFunc) (void *context, const iBookmark *);
 typedef int   (*iBookmarksCompareFunc)(const iBookmark **, const iBookmark **);
@@ -75,3 +79,29 @@ iBool   filterTagsRegExp_Bookmarks  (void *regExp, const iBookmark *);
  */
 const iPtrArray *list_Bookmarks(const iBookmarks *, iBookmarksCompareFunc cmp,
                                 iBookmarksFilterFunc filter, void *context);
+
+/**
+ * Lists the bookmarks that have a tag, using the tag index instead of checking every
+ * bookmark. Tags are matched as whole words, ignoring case.
+ *
+ * @param cmp  Sort function as in list_Bookmarks().
+ */
+const iPtrArray *listTagged_Bookmarks(const iBookmarks *, const char *tag,
+                                      iBookmarksCompareFunc cmp);
+
+/**
+ * Copies all the bookmarks. The copies share their strings with the originals, so this is
+ * cheap, and they remain valid even if the bookmarks are modified or removed.
+ *
+ * @param bookmarks_out  Array of Bookmark. Each element must be deinitialized by the caller.
+ */
+void    snapshot_Bookmarks  (const iBookmarks *, iArray *bookmarks_out);
+
+/**
+ * Copies the bookmarks whose URL, title, or tags may contain all of the words, found with
+ * a trigram index. The copies still need to be matched against the words. If the words are
+ * too short to be looked up in the index, all the bookmarks are copied.
+ */
+void    snapshotMatching_Bookmarks  (const iBookmarks *, const iStringList *words,
+                                     iArray *bookmarks_out);
+int     revision_Bookmarks  (const iBookmarks *); /* changes when any bookmark changes */
@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "feeds.h"
 #include "bookmarks.h"
 #include "gmrequest.h"
+#include "prefs.h"
 #include "visited.h"
 #include "app.h"
 
@@ -38,7 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <ctype.h>
 
 iDeclareType(Feeds)
-iDeclareType(FeedJob)
+iDeclareClass(FeedJob)
 
 iDefineTypeConstruction(FeedEntry)
 
@@ -48,6 +49,7 @@ void init_FeedEntry(iFeedEntry *d) {
     init_String(&d->url);
     init_String(&d->title);
     d->bookmarkId = 0;
+    d->isRead = iFalse;
 }
 
 void deinit_FeedEntry(iFeedEntry *d) {
@@ -58,22 +60,32 @@ void deinit_FeedEntry(iFeedEntry *d) {
 /*----------------------------------------------------------------------------------------------*/
 
 struct Impl_FeedJob {
+    iObject     object;
     iString     url;
     uint32_t    bookmarkId;
     iTime       startTime;
     iGmRequest *request;
+    iBool       isFinished;  /* set in the request's thread; protected by the feeds mutex */
+    uint32_t    cancelledAt; /* SDL ticks when the request was cancelled for taking too long */
     iPtrArray   results;
 };
 
-static void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
+static void finished_FeedJob_(iAnyObject *);
+
+void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
     initCopy_String(&d->url, &bookmark->url);
     d->bookmarkId = id_Bookmark(bookmark);
     d->request = NULL;
+    d->isFinished = iFalse;
+    d->cancelledAt = 0;
     init_PtrArray(&d->results);
     iZap(d->startTime);
 }
 
-static void deinit_FeedJob(iFeedJob *d) {
+void deinit_FeedJob(iFeedJob *d) {
+    if (d->request) {
+        iDisconnect(GmRequest, d->request, finished, d, finished_FeedJob_);
+    }
     iRelease(d->request);
     iForEach(PtrArray, i, &d->results) {
         delete_FeedEntry(i.ptr);
@@ -82,52 +94,179 @@ static void deinit_FeedJob(iFeedJob *d) {
     deinit_String(&d->url);
 }
 
-iDefineTypeConstructionArgs(FeedJob, (const iBookmark *bm), bm)
+iDefineObjectConstructionArgs(FeedJob, (const iBookmark *bm), bm)
+iDefineClass(FeedJob)
 
 /*----------------------------------------------------------------------------------------------*/
 
-static const char *feedsFilename_Feeds_         = "feeds.txt";
-static const int   updateIntervalSeconds_Feeds_ = 4 * 60 * 60;
+static const char *   feedsFilename_Feeds_         = "feeds.txt";
+static const int      updateIntervalSeconds_Feeds_ = 4 * 60 * 60;
+static const int      maxFeedInterval_Feeds_       = 4 * 24 * 60 * 60;
+static const int      dueMarginSeconds_Feeds_      = 10 * 60;
+static const uint32_t jobTimeout_Feeds_            = 15 * 1000; /* milliseconds after starting */
+
+static const size_t   entriesPerPage_Feeds_        = 100; /* pages only break between days */
+
+enum iFeedEntryFlag {
+    read_FeedEntryFlag = 0x1, /* saved in feeds.txt */
+};
+
+iDeclareType(FeedState)
+
+/* What was learned about a subscribed feed when it was last fetched. A feed whose page
+   hasn't changed is fetched less and less often, up to a few days apart. */
+struct Impl_FeedState {
+    iHashNode node;        /* key is the bookmark ID */
+    uint32_t  contentHash; /* of the page body */
+    iTime     lastFetched;
+    int       interval;    /* seconds from the last fetch until the feed is due again */
+};
+
+iDeclareType(FeedDay)
+
+/* The entry list page is cached as Gemtext sections of the entries posted on each day.
+   When entries are added or changed, only the sections of their days are rebuilt. */
+struct Impl_FeedDay {
+    int     day; /* days since the epoch */
+    size_t  numEntries;
+    iString source;
+};
 
 struct Impl_Feeds {
     iMutex *  mtx;
     iString   saveDir;
     iTime     lastRefreshedAt;
     int       refreshTimer;
+    iThread * loader; /* initial load in the background */
     iThread * worker;
     iBool     stopWorker;
+    iCondition jobFinished; /* wakes up the worker */
     iPtrArray jobs; /* pending */
+    iHash     states; /* FeedStates of the subscribed feeds */
+    iArray    days;   /* FeedDays, newest first */
+    iSortedArray staleDays; /* days whose sections need rebuilding */
+    iBool     isAllDaysStale;
+    size_t    numUnread; /* entries not marked as read */
     iSortedArray entries; /* pointers to all discovered feed entries, sorted by entry ID (URL) */
 };
 
 static iFeeds feeds_;
 
-#define maxConcurrentRequests_Feeds 4
+static iFeedState *state_Feeds_(iFeeds *d, uint32_t bookmarkId) {
+    /* Called while locked. */
+    iFeedState *state = (iFeedState *) value_Hash(&d->states, bookmarkId);
+    if (!state) {
+        state = iMalloc(FeedState);
+        state->node.key    = bookmarkId;
+        state->contentHash = 0;
+        iZap(state->lastFetched);
+        state->interval = updateIntervalSeconds_Feeds_;
+        insert_Hash(&d->states, &state->node);
+    }
+    return state;
+}
+
+static iBool isDue_Feeds_(const iFeeds *d, uint32_t bookmarkId, const iTime *now) {
+    /* Called while locked. */
+    const iFeedState *state = (const iFeedState *) value_Hash(&d->states, bookmarkId);
+    return !state || !isValid_Time(&state->lastFetched) ||
+           secondsSince_Time(now, &state->lastFetched) + dueMarginSeconds_Feeds_ >=
+               state->interval;
+}
+
+static uint32_t contentHash_(const iBlock *data) {
+    uint32_t hash = 0x811c9dc5; /* FNV-1a */
+    const char *end = constEnd_Block(data);
+    for (const char *ch = constBegin_Block(data); ch != end; ch++) {
+        hash = (hash ^ (uint8_t) *ch) * 0x01000193;
+    }
+    return hash;
+}
+
+static iBool updateState_FeedJob_(const iFeedJob *d, iFeeds *feeds) {
+    /* Returns iTrue if the page has changed and needs to be parsed. */
+    const uint32_t hash = contentHash_(body_GmRequest(d->request));
+    iBool isChanged;
+    lock_Mutex(feeds->mtx);
+    iFeedState *state = state_Feeds_(feeds, d->bookmarkId);
+    isChanged = !isValid_Time(&state->lastFetched) || state->contentHash != hash;
+    state->contentHash = hash;
+    initCurrent_Time(&state->lastFetched);
+    state->interval =
+        isChanged ? updateIntervalSeconds_Feeds_
+                  : iMin(2 * state->interval, maxFeedInterval_Feeds_); /* back off */
+    unlock_Mutex(feeds->mtx);
+    return isChanged;
+}
+
+static void finished_FeedJob_(iAnyObject *obj) {
+    /* Called in the request's thread. */
+    iFeedJob *job = obj;
+    iFeeds *  d   = &feeds_;
+    iGuardMutex(d->mtx, {
+        job->isFinished = iTrue;
+        signal_Condition(&d->jobFinished);
+    });
+}
 
 static void submit_FeedJob_(iFeedJob *d) {
     d->request = new_GmRequest(certs_App());
     setUrl_GmRequest(d->request, &d->url);
+    setPriority_GmRequest(d->request, feeds_GmRequestPriority);
+    iConnect(GmRequest, d->request, finished, d, finished_FeedJob_);
     initCurrent_Time(&d->startTime);
     submit_GmRequest(d->request);
 }
 
-static iBool isSubscribed_(void *context, const iBookmark *bm) {
-    iUnused(context);
-    return indexOfCStr_String(&bm->tags, "subscribed") != iInvalidPos; /* TODO: RegExp with \b */
+static iBool isTimedOut_FeedJob_(const iFeedJob *d, uint32_t now) {
+    /* The time spent waiting in the request queue doesn't count. */
+    const uint32_t started = timing_GmRequest(d->request).started;
+    return started && now - started > jobTimeout_Feeds_;
 }
 
 static const iPtrArray *listSubscriptions_(void) {
-    return list_Bookmarks(bookmarks_App(), NULL, isSubscribed_, NULL);
+    return listTagged_Bookmarks(bookmarks_App(), "subscribed", NULL);
 }
 
-static iFeedJob *startNextJob_Feeds_(iFeeds *d) {
-    if (isEmpty_PtrArray(&d->jobs)) {
-        return NULL;
+static int day_FeedEntry_(const iFeedEntry *d) {
+    /* Sections are headed by the local date, so the key must change at local midnight.
+       Ordering is all that matters: later days have larger keys. */
+    iDate date;
+    init_Date(&date, &d->posted);
+    return (date.year * 12 + date.month) * 32 + date.day;
+}
+
+static int cmpDay_(const void *a, const void *b) {
+    return iCmp(*(const int *) a, *(const int *) b);
+}
+
+static iBool isStale_Feeds_(const iFeeds *d, int day) {
+    /* Called while locked. */
+    size_t pos;
+    return d->isAllDaysStale || locate_SortedArray(&d->staleDays, &day, &pos);
+}
+
+static iBool setRead_Feeds_(iFeeds *d, iFeedEntry *entry, iBool isRead) {
+    /* Called while locked. Returns True if the flag was changed. */
+    if (entry->isRead != isRead) {
+        entry->isRead = isRead;
+        if (isRead) {
+            d->numUnread--;
+        }
+        else {
+            d->numUnread++;
+        }
+        return iTrue;
+    }
+    return iFalse;
+}
+
+static void markStale_Feeds_(iFeeds *d, const iFeedEntry *entry) {
+    /* Called while locked. */
+    const int day = day_FeedEntry_(entry);
+    if (!isStale_Feeds_(d, day)) {
+        insert_SortedArray(&d->staleDays, &day);
     }
-    iFeedJob *job;
-    take_PtrArray(&d->jobs, 0, (void **) &job);
-    submit_FeedJob_(job);
-    return job;
 }
 
 static void trimTitle_(iString *title) {
@@ -188,41 +327,60 @@ static void parseResult_FeedJob_(iFeedJob *d) {
     }
 }
 
-static void save_Feeds_(iFeeds *d) {
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
-    if (open_File(f, write_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
-        iString *str = new_String();
-        format_String(str, "%llu\n# Feeds\n", integralSeconds_Time(&d->lastRefreshedAt));
-        write_File(f, utf8_String(str));
-        /* Index of feeds for IDs. */ {
-            iConstForEach(PtrArray, i, listSubscriptions_()) {
-                const iBookmark *bm = i.ptr;
-                format_String(str, "%08x %s\n", id_Bookmark(bm), cstr_String(&bm->url));
-                write_File(f, utf8_String(str));
-            }
+static void serialize_Feeds_(iFeeds *d, iString *out) {
+    /* Called while locked. */
+    iString *str = new_String();
+    format_String(out, "%llu\n# Feeds\n", integralSeconds_Time(&d->lastRefreshedAt));
+    /* Index of feeds for IDs. */ {
+        iConstForEach(PtrArray, i, listSubscriptions_()) {
+            const iBookmark *bm = i.ptr;
+            appendFormat_String(out, "%08x %s\n", id_Bookmark(bm), cstr_String(&bm->url));
         }
-        writeData_File(f, "# Entries\n", 10);
-        iTime now;
-        initCurrent_Time(&now);
-        iConstForEach(Array, i, &d->entries.values) {
-            const iFeedEntry *entry = *(const iFeedEntry **) i.value;
-            if (secondsSince_Time(&now, &entry->discovered) > maxAge_Visited) {
-                continue; /* Forget entries discovered long ago. */
+    }
+    appendCStr_String(out, "# Entries\n");
+    iTime now;
+    initCurrent_Time(&now);
+    iConstForEach(Array, i, &d->entries.values) {
+        const iFeedEntry *entry = *(const iFeedEntry **) i.value;
+        if (secondsSince_Time(&now, &entry->discovered) > maxAge_Visited) {
+            continue; /* Forget entries discovered long ago. */
+        }
+        /* The flags are ignored by older versions. */
+        format_String(str, "%x %x\n%llu\n%llu\n%s\n%s\n",
+                      entry->bookmarkId,
+                      entry->isRead ? read_FeedEntryFlag : 0,
+                      integralSeconds_Time(&entry->posted),
+                      integralSeconds_Time(&entry->discovered),
+                      cstr_String(&entry->url),
+                      cstr_String(&entry->title));
+        append_String(out, str);
+    }
+    /* State of each feed. Older versions stop reading at this line. */ {
+        appendCStr_String(out, "# State\n");
+        iConstForEach(PtrArray, i, listSubscriptions_()) {
+            const uint32_t    id    = id_Bookmark(i.ptr);
+            const iFeedState *state = (const iFeedState *) value_Hash(&d->states, id);
+            if (state && isValid_Time(&state->lastFetched)) {
+                appendFormat_String(out, "%08x %08x %llu %d\n",
+                                    id,
+                                    state->contentHash,
+                                    integralSeconds_Time(&state->lastFetched),
+                                    state->interval);
             }
-            format_String(str, "%x\n%llu\n%llu\n%s\n%s\n",
-                          entry->bookmarkId,
-                          integralSeconds_Time(&entry->posted),
-                          integralSeconds_Time(&entry->discovered),
-                          cstr_String(&entry->url),
-                          cstr_String(&entry->title));
-            write_File(f, utf8_String(str));
         }
-        delete_String(str);
-        close_File(f);
-        unlock_Mutex(d->mtx);
     }
-    iRelease(f);
+    delete_String(str);
+}
+
+static void save_Feeds_(iFeeds *d) {
+    /* The file is written by the saver in the background. Saving again before that only
+       replaces the pending contents, so changing many read flags in a row is cheap. */
+    iString *str = new_String();
+    iGuardMutex(d->mtx, serialize_Feeds_(d, str));
+    save_Saver(saver_App(),
+               collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)),
+               utf8_String(str));
+    delete_String(str);
 }
 
 static iBool updateEntries_Feeds_(iFeeds *d, iPtrArray *incoming) {
@@ -244,17 +402,24 @@ static iBool updateEntries_Feeds_(iFeeds *d, iPtrArray *incoming) {
                  newDate.day != oldDate.day)) {
                 changed = iTrue;
             }
+            markStale_Feeds_(d, existing);
             set_String(&existing->title, &entry->title);
             existing->posted = entry->posted;
+            markStale_Feeds_(d, existing);
             delete_FeedEntry(entry);
             if (changed) {
-                /* TODO: better to use a new flag for read feed entries? */
-                removeUrl_Visited(visited_App(), &existing->url);
+                setRead_Feeds_(d, existing, iFalse);
                 gotNew = iTrue;
             }
         }
         else {
+            /* The entry may have been seen before it appeared in the feed. */
+            entry->isRead = containsUrl_Visited(visited_App(), &entry->url);
+            if (!entry->isRead) {
+                d->numUnread++;
+            }
             insert_SortedArray(&d->entries, &entry);
+            markStale_Feeds_(d, entry);
             gotNew = iTrue;
         }
         remove_PtrArrayIterator(&i);
@@ -266,55 +431,97 @@ static iBool updateEntries_Feeds_(iFeeds *d, iPtrArray *incoming) {
 static iThreadResult fetch_Feeds_(iThread *thread) {
     iFeeds *d = &feeds_;
     iUnused(thread);
-    iFeedJob *work[maxConcurrentRequests_Feeds]; /* We'll do a couple of concurrent requests. */
-    iZap(work);
+    iPtrArray work; /* submitted jobs */
+    iPtrArray done;
+    iPtrArray expired;
+    init_PtrArray(&work);
+    init_PtrArray(&done);
+    init_PtrArray(&expired);
     iBool gotNew = iFalse;
     postCommand_App("feeds.update.started");
+    lock_Mutex(d->mtx);
     while (!d->stopWorker) {
-        /* Start new jobs. */
-        iForIndices(i, work) {
-            if (!work[i]) {
-                work[i] = startNextJob_Feeds_(d);
-            }
-        }
-        sleep_Thread(0.5); /* TODO: wait on a Condition so we can exit quickly */
-        if (d->stopWorker) break;
-        size_t ongoing = 0;
-        iForIndices(i, work) {
-            if (work[i]) {
-                if (isFinished_GmRequest(work[i]->request)) {
-                    /* TODO: Handle redirects. Need to resubmit the job with new URL. */
-                    parseResult_FeedJob_(work[i]);
-                    gotNew |= updateEntries_Feeds_(d, &work[i]->results);
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
-                }
-                else {
-                    ongoing++;
-                }
-                /* TODO: abort job if it takes too long (> 15 seconds?) */
-            }
+        /* Only a few jobs are submitted at a time so the request queue isn't flooded;
+           the queue also limits how many of these run concurrently. */
+        const size_t maxSubmitted = iMax(1, prefs_App()->maxFeedRequests);
+        while (size_PtrArray(&work) < maxSubmitted && !isEmpty_PtrArray(&d->jobs)) {
+            iFeedJob *job;
+            take_PtrArray(&d->jobs, 0, (void **) &job);
+            pushBack_PtrArray(&work, job);
+            unlock_Mutex(d->mtx); /* may finish immediately */
+            submit_FeedJob_(job);
+            lock_Mutex(d->mtx);
         }
         /* Stop if everything has finished. */
-        if (ongoing == 0 && isEmpty_PtrArray(&d->jobs)) {
+        if (isEmpty_PtrArray(&work)) {
             break;
         }
+        const uint32_t now = SDL_GetTicks();
+        iForEach(PtrArray, i, &work) {
+            iFeedJob *job = i.ptr;
+            if (job->isFinished ||
+                (job->cancelledAt && now - job->cancelledAt > jobTimeout_Feeds_)) {
+                /* A cancelled request that doesn't finish is given up on eventually. */
+                pushBack_PtrArray(&done, job);
+                remove_PtrArrayIterator(&i);
+            }
+            else if (!job->cancelledAt && isTimedOut_FeedJob_(job, now)) {
+                job->cancelledAt = now;
+                pushBack_PtrArray(&expired, job);
+            }
+        }
+        if (isEmpty_PtrArray(&done) && isEmpty_PtrArray(&expired)) {
+            /* Wake up once a second to check the timeouts. */
+            waitTimeout_Condition(&d->jobFinished, d->mtx, 1.0);
+            continue;
+        }
+        unlock_Mutex(d->mtx);
+        iForEach(PtrArray, j, &expired) {
+            cancel_GmRequest(((iFeedJob *) j.ptr)->request);
+        }
+        clear_PtrArray(&expired);
+        iForEach(PtrArray, k, &done) {
+            iFeedJob *job = k.ptr;
+            if (job->isFinished && isSuccess_GmStatusCode(status_GmRequest(job->request)) &&
+                updateState_FeedJob_(job, d)) {
+                /* TODO: Handle redirects. Need to resubmit the job with new URL. */
+                parseResult_FeedJob_(job);
+                gotNew |= updateEntries_Feeds_(d, &job->results);
+            }
+            iRelease(job);
+        }
+        clear_PtrArray(&done);
+        lock_Mutex(d->mtx);
+    }
+    unlock_Mutex(d->mtx);
+    /* Jobs still unfinished when stopping. */
+    iForEach(PtrArray, i, &work) {
+        iRelease(i.ptr);
     }
+    deinit_PtrArray(&expired);
+    deinit_PtrArray(&done);
+    deinit_PtrArray(&work);
     initCurrent_Time(&d->lastRefreshedAt);
     save_Feeds_(d);
     postCommandf_App("feeds.update.finished arg:%d", gotNew ? 1 : 0);
     return 0;
 }
 
-static iBool startWorker_Feeds_(iFeeds *d) {
+static iBool startWorker_Feeds_(iFeeds *d, iBool onlyDue) {
     if (d->worker) {
         return iFalse; /* Refresh is already ongoing. */
     }
-    /* Queue up all the subscriptions for the worker. */
+    /* Queue up the subscriptions for the worker. */
+    iTime now;
+    initCurrent_Time(&now);
+    lock_Mutex(d->mtx);
     iConstForEach(PtrArray, i, listSubscriptions_()) {
-        iFeedJob* job = new_FeedJob(i.ptr);
-        pushBack_PtrArray(&d->jobs, job);
+        if (!onlyDue || isDue_Feeds_(d, id_Bookmark(i.ptr), &now)) {
+            iFeedJob* job = new_FeedJob(i.ptr);
+            pushBack_PtrArray(&d->jobs, job);
+        }
     }
+    unlock_Mutex(d->mtx);
     if (!isEmpty_Array(&d->jobs)) {
         d->worker = new_Thread(fetch_Feeds_);
         d->stopWorker = iFalse;
@@ -326,19 +533,22 @@ static iBool startWorker_Feeds_(iFeeds *d) {
 
 static uint32_t refresh_Feeds_(uint32_t interval, void *data) {
     /* Called in the SDL timer thread, so let's start a worker thread for running the update. */
-    startWorker_Feeds_(&feeds_);
+    startWorker_Feeds_(&feeds_, iTrue);
     return 1000 * updateIntervalSeconds_Feeds_;
 }
 
 static void stopWorker_Feeds_(iFeeds *d) {
     if (d->worker) {
-        d->stopWorker = iTrue;
+        iGuardMutex(d->mtx, {
+            d->stopWorker = iTrue;
+            signal_Condition(&d->jobFinished);
+        });
         join_Thread(d->worker);
         iReleasePtr(&d->worker);
     }
     /* Clear remaining jobs. */
     iForEach(PtrArray, i, &d->jobs) {
-        delete_FeedJob(i.ptr);
+        iRelease(i.ptr);
     }
     clear_PtrArray(&d->jobs);
 }
@@ -372,6 +582,10 @@ static void load_Feeds_(iFeeds *d) {
                 section = 2;
                 continue;
             }
+            else if (equal_Rangecc(line, "# State")) {
+                section = 3;
+                continue;
+            }
             switch (section) {
                 case 0: {
                     unsigned long long ts = 0;
@@ -398,7 +612,12 @@ static void load_Feeds_(iFeeds *d) {
                 case 2: {
                     /* TODO: All right, this could maybe use a bit more robust, structured
                        format. The code below is messy. */
-                    const uint32_t feedId = strtoul(line.start, NULL, 16);
+                    char *flagsPos;
+                    const uint32_t feedId = strtoul(line.start, &flagsPos, 16);
+                    int flags = -1; /* not saved by older versions */
+                    if (*flagsPos == ' ') {
+                        flags = strtoul(flagsPos + 1, NULL, 16);
+                    }
                     if (!nextSplit_Rangecc(range_Block(src), "\n", &line)) {
                         goto aborted;
                     }
@@ -432,12 +651,34 @@ static void load_Feeds_(iFeeds *d) {
                         entry->discovered.ts.tv_sec = discovered;
                         set_String(&entry->url, url);
                         set_String(&entry->title, title);
+                        entry->isRead = flags >= 0 ? (flags & read_FeedEntryFlag) != 0
+                                                   : containsUrl_Visited(visited_App(), url);
+                        if (!entry->isRead) {
+                            d->numUnread++;
+                        }
                         insert_SortedArray(&d->entries, &entry);
                     }
                     delete_String(title);
                     delete_String(url);
                     break;
                 }
+                case 3: {
+                    uint32_t           feedId = 0, hash = 0;
+                    unsigned long long fetched = 0;
+                    int                interval = 0;
+                    if (sscanf(line.start, "%08x %08x %llu %d", &feedId, &hash, &fetched,
+                               &interval) == 4) {
+                        const iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, feedId);
+                        if (node) {
+                            iFeedState *state = state_Feeds_(d, node->bookmarkId);
+                            state->contentHash           = hash;
+                            state->lastFetched.ts.tv_sec = fetched;
+                            state->interval              = iClamp(
+                                interval, updateIntervalSeconds_Feeds_, maxFeedInterval_Feeds_);
+                        }
+                    }
+                    break;
+                }
             }
         }
     aborted:
@@ -453,15 +694,7 @@ static void load_Feeds_(iFeeds *d) {
 
 /*----------------------------------------------------------------------------------------------*/
 
-void init_Feeds(const char *saveDir) {
-    iFeeds *d = &feeds_;
-    d->mtx = new_Mutex();
-    initCStr_String(&d->saveDir, saveDir);
-    iZap(d->lastRefreshedAt);
-    d->worker = NULL;
-    init_PtrArray(&d->jobs);
-    init_SortedArray(&d->entries, sizeof(iFeedEntry *), cmp_FeedEntryPtr_);
-    load_Feeds_(d);
+static void startRefreshTimer_Feeds_(iFeeds *d) {
     /* Update feeds if it has been a while. */
     int intervalSec = updateIntervalSeconds_Feeds_;
     if (isValid_Time(&d->lastRefreshedAt)) {
@@ -471,12 +704,74 @@ void init_Feeds(const char *saveDir) {
     d->refreshTimer = SDL_AddTimer(1000 * intervalSec, refresh_Feeds_, NULL);
 }
 
+static void init_Feeds_(iFeeds *d, const char *saveDir) {
+    d->mtx = new_Mutex();
+    initCStr_String(&d->saveDir, saveDir);
+    iZap(d->lastRefreshedAt);
+    d->refreshTimer = 0;
+    d->loader = NULL;
+    d->worker = NULL;
+    d->stopWorker = iFalse;
+    init_Condition(&d->jobFinished);
+    init_PtrArray(&d->jobs);
+    init_Hash(&d->states);
+    init_Array(&d->days, sizeof(iFeedDay));
+    init_SortedArray(&d->staleDays, sizeof(int), cmpDay_);
+    d->isAllDaysStale = iTrue;
+    d->numUnread = 0;
+    init_SortedArray(&d->entries, sizeof(iFeedEntry *), cmp_FeedEntryPtr_);
+}
+
+void init_Feeds(const char *saveDir) {
+    iFeeds *d = &feeds_;
+    init_Feeds_(d, saveDir);
+    load_Feeds_(d);
+    startRefreshTimer_Feeds_(d);
+}
+
+static iThreadResult runLoader_Feeds_(iThread *thd) {
+    iFeeds *d = userData_Thread(thd);
+    /* The read states of old entries come from the history. Wait for it to load before
+       locking, so the lock is only held while the entries are being read. */
+    visited_App();
+    /* Everything else waits for the lock while the entries are being loaded. */
+    iGuardMutex(d->mtx, {
+        load_Feeds_(d);
+        startRefreshTimer_Feeds_(d);
+    });
+    postCommand_App("feeds.read.changed"); /* sidebar will update */
+    return 0;
+}
+
+void initBackground_Feeds(const char *saveDir) {
+    iFeeds *d = &feeds_;
+    init_Feeds_(d, saveDir);
+    d->loader = new_Thread(runLoader_Feeds_);
+    setUserData_Thread(d->loader, d);
+    start_Thread(d->loader);
+}
+
 void deinit_Feeds(void) {
     iFeeds *d = &feeds_;
+    if (d->loader) {
+        join_Thread(d->loader);
+        iReleasePtr(&d->loader);
+    }
     SDL_RemoveTimer(d->refreshTimer);
     stopWorker_Feeds_(d);
+    save_Feeds_(d); /* read flags may have changed since the last refresh */
     iAssert(isEmpty_PtrArray(&d->jobs));
     deinit_PtrArray(&d->jobs);
+    deinit_Condition(&d->jobFinished);
+    iForEach(Hash, s, &d->states) {
+        free(s.value);
+    }
+    deinit_Hash(&d->states);
+    iForEach(Array, y, &d->days) {
+        deinit_String(&((iFeedDay *) y.value)->source);
+    }
+    deinit_Array(&d->days);
+    deinit_SortedArray(&d->staleDays);
     deinit_String(&d->saveDir);
     delete_Mutex(d->mtx);
     iForEach(Array, i, &d->entries.values) {
@@ -487,22 +782,109 @@ void deinit_Feeds(void) {
 }
 
 void refresh_Feeds(void) {
-    startWorker_Feeds_(&feeds_);
+    startWorker_Feeds_(&feeds_, iFalse); /* requested by the user, so fetch everything */
 }
 
 void refreshFinished_Feeds(void) {
     stopWorker_Feeds_(&feeds_);
 }
 
+void bookmarksChanged_Feeds(void) {
+    /* Feed titles are shown on the entry list page. */
+    iFeeds *d = &feeds_;
+    iGuardMutex(d->mtx, d->isAllDaysStale = iTrue);
+}
+
 void removeEntries_Feeds(uint32_t feedBookmarkId) {
     iFeeds *d = &feeds_;
+    lock_Mutex(d->mtx);
+    free(remove_Hash(&d->states, feedBookmarkId));
+    d->isAllDaysStale = iTrue;
     iForEach(Array, i, &d->entries.values) {
         iFeedEntry **entry = i.value;
         if ((*entry)->bookmarkId == feedBookmarkId) {
+            setRead_Feeds_(d, *entry, iTrue); /* no longer counted */
             delete_FeedEntry(*entry);
             remove_ArrayIterator(&i);
         }
     }
+    unlock_Mutex(d->mtx);
+}
+
+static iFeedEntry *findEntry_Feeds_(iFeeds *d, const iString *url) {
+    /* Called while locked. Entries are sorted by URL. */
+    iFeedEntry key;
+    key.url = *url; /* only the URL is compared */
+    const iFeedEntry *keyPtr = &key;
+    size_t pos;
+    if (locate_SortedArray(&d->entries, &keyPtr, &pos)) {
+        return *(iFeedEntry **) at_SortedArray(&d->entries, pos);
+    }
+    return NULL;
+}
+
+iBool isEntryRead_Feeds(const iString *entryUrl) {
+    iFeeds *d = &feeds_;
+    iBool isRead = iFalse;
+    iGuardMutex(d->mtx, {
+        const iFeedEntry *entry = findEntry_Feeds_(d, entryUrl);
+        isRead = entry && entry->isRead;
+    });
+    return isRead;
+}
+
+void setEntryRead_Feeds(const iString *entryUrl, iBool isRead) {
+    iFeeds *d = &feeds_;
+    iBool isChanged = iFalse;
+    iGuardMutex(d->mtx, {
+        iFeedEntry *entry = findEntry_Feeds_(d, entryUrl);
+        if (entry) {
+            isChanged = setRead_Feeds_(d, entry, isRead);
+        }
+    });
+    if (isChanged) {
+        save_Feeds_(d);
+    }
+}
+
+void markAllRead_Feeds(void) {
+    iFeeds *d = &feeds_;
+    iBool isChanged = iFalse;
+    iGuardMutex(d->mtx, {
+        iForEach(Array, i, &d->entries.values) {
+            isChanged |= setRead_Feeds_(d, *(iFeedEntry **) i.value, iTrue);
+        }
+    });
+    if (isChanged) {
+        save_Feeds_(d);
+    }
+}
+
+size_t numUnread_Feeds(void) {
+    size_t num;
+    iGuardMutex(feeds_.mtx, num = feeds_.numUnread);
+    return num;
+}
+
+size_t numEntries_Feeds(void) {
+    size_t num;
+    iGuardMutex(feeds_.mtx, num = size_SortedArray(&feeds_.entries));
+    return num;
+}
+
+size_t memorySize_Feeds(void) {
+    iFeeds *d = &feeds_;
+    size_t size = 0;
+    lock_Mutex(d->mtx);
+    iConstForEach(Array, i, &d->entries.values) {
+        const iFeedEntry *entry = *(const iFeedEntry **) i.value;
+        size += sizeof(iFeedEntry) + size_String(&entry->url) + size_String(&entry->title);
+    }
+    iConstForEach(Array, j, &d->days) {
+        size += sizeof(iFeedDay) + size_String(&((const iFeedDay *) j.value)->source);
+    }
+    unlock_Mutex(d->mtx);
+    return size;
 }
 
 static int cmpTimeDescending_FeedEntryPtr_(const void *a, const void *b) {
@@ -527,7 +909,86 @@ size_t numSubscribed_Feeds(void) {
 
 #define iPluralS(c) ((c) != 1 ? "s" : "")
 
-const iString *entryListPage_Feeds(void) {
+static int cmpPostedDescending_FeedEntryPtr_(const void *a, const void *b) {
+    const iFeedEntry * const *e1 = a, * const *e2 = b;
+    const int cmp = -cmp_Time(&(*e1)->posted, &(*e2)->posted);
+    return cmp ? cmp : cmpString_String(&(*e1)->url, &(*e2)->url);
+}
+
+static void buildDay_Feeds_(iFeedDay *day, iPtrArray *entries) {
+    /* Entries are all posted on the same day. */
+    sort_Array(entries, cmpPostedDescending_FeedEntryPtr_);
+    iDate date;
+    const iFeedEntry *first = constAt_PtrArray(entries, 0);
+    init_Date(&date, &first->posted);
+    day->day        = day_FeedEntry_(first);
+    day->numEntries = 0;
+    init_String(&day->source);
+    format_String(&day->source, "## %s\n", cstrCollect_String(format_Date(&date, "%Y-%m-%d")));
+    iConstForEach(PtrArray, i, entries) {
+        const iFeedEntry *entry = i.ptr;
+        const iBookmark *bm = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
+        if (bm) {
+            appendFormat_String(&day->source,
+                                "=> %s %s - %s\n",
+                                cstr_String(&entry->url),
+                                cstr_String(&bm->title),
+                                cstr_String(&entry->title));
+            day->numEntries++;
+        }
+    }
+}
+
+static void updateDays_Feeds_(iFeeds *d) {
+    /* Called while locked. */
+    if (!d->isAllDaysStale && isEmpty_SortedArray(&d->staleDays)) {
+        return;
+    }
+    /* Find the entries of the stale days. */
+    iPtrArray stale;
+    init_PtrArray(&stale);
+    iConstForEach(Array, i, &d->entries.values) {
+        const iFeedEntry *entry = *(const iFeedEntry **) i.value;
+        const int         day   = day_FeedEntry_(entry);
+        if (isStale_Feeds_(d, day)) {
+            pushBack_PtrArray(&stale, entry);
+        }
+    }
+    sort_Array(&stale, cmpPostedDescending_FeedEntryPtr_);
+    /* Drop the old sections. */
+    iForEach(Array, j, &d->days) {
+        iFeedDay *day = j.value;
+        if (isStale_Feeds_(d, day->day)) {
+            deinit_String(&day->source);
+            remove_ArrayIterator(&j);
+        }
+    }
+    /* Rebuild the sections and merge them in, keeping the newest days first. */
+    iPtrArray dayEntries;
+    init_PtrArray(&dayEntries);
+    size_t pos = 0;
+    for (size_t i = 0; i < size_PtrArray(&stale); ) {
+        const int day = day_FeedEntry_(constAt_PtrArray(&stale, i));
+        clear_PtrArray(&dayEntries);
+        for (; i < size_PtrArray(&stale) &&
+               day_FeedEntry_(constAt_PtrArray(&stale, i)) == day; i++) {
+            pushBack_PtrArray(&dayEntries, at_PtrArray(&stale, i));
+        }
+        iFeedDay built;
+        buildDay_Feeds_(&built, &dayEntries);
+        while (pos < size_Array(&d->days) &&
+               ((const iFeedDay *) constAt_Array(&d->days, pos))->day > day) {
+            pos++;
+        }
+        insert_Array(&d->days, pos++, &built);
+    }
+    deinit_PtrArray(&dayEntries);
+    deinit_PtrArray(&stale);
+    clear_SortedArray(&d->staleDays);
+    d->isAllDaysStale = iFalse;
+}
+
+const iString *entryListPage_Feeds(size_t page) {
     iFeeds *d = &feeds_;
     iString *src = collectNew_String();
     format_String(src, "# Feed entries\n\n");
@@ -541,6 +1002,10 @@ const iString *entryListPage_Feeds(void) {
         iPluralS(size_PtrArray(subs)),
         size_PtrArray(subs) == 1 ? "s" : "",
         size_SortedArray(&d->entries));
+    if (d->numUnread) {
+        appendFormat_String(src, "%zu of the entries %s unread.\n", d->numUnread,
+                            d->numUnread == 1 ? "is" : "are");
+    }
     if (isValid_Time(&d->lastRefreshedAt)) {
         appendFormat_String(src,
             "\nThe latest refresh occurred %s.\n",
@@ -550,26 +1015,35 @@ const iString *entryListPage_Feeds(void) {
                              : format_CStr("%d day%s ago", elapsed / 1440,
                                            iPluralS(elapsed / 1440)));
     }
-    iDate on;
-    iZap(on);
-    iConstForEach(PtrArray, i, listEntries_Feeds()) {
-        const iFeedEntry *entry = i.ptr;
-        iDate entryDate;
-        init_Date(&entryDate, &entry->posted);
-        if (on.year != entryDate.year || on.month != entryDate.month || on.day != entryDate.day) {
-            appendFormat_String(
-                src, "## %s\n", cstrCollect_String(format_Date(&entryDate, "%Y-%m-%d")));
-            on = entryDate;
+    updateDays_Feeds_(d);
+    /* Pages end at the first day boundary after enough entries. */
+    size_t pageIndex  = 0;
+    size_t numOnPage  = 0;
+    iBool  hasOlder   = iFalse;
+    iConstForEach(Array, i, &d->days) {
+        const iFeedDay *day = i.value;
+        if (numOnPage >= entriesPerPage_Feeds_) {
+            pageIndex++;
+            numOnPage = 0;
         }
-        const iBookmark *bm = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
-        if (bm) {
-            appendFormat_String(src,
-                                "=> %s %s - %s\n",
-                                cstr_String(&entry->url),
-                                cstr_String(&bm->title),
-                                cstr_String(&entry->title));
+        if (pageIndex > page) {
+            hasOlder = iTrue;
+            break;
+        }
+        if (pageIndex == page) {
+            append_String(src, &day->source);
         }
+        numOnPage += day->numEntries;
     }
     unlock_Mutex(d->mtx);
+    if (page > 0 || hasOlder) {
+        appendCStr_String(src, "\n");
+        if (page > 0) {
+            appendFormat_String(src, "=> about:feeds?page=%zu Newer entries\n", page);
+        }
+        if (hasOlder) {
+            appendFormat_String(src, "=> about:feeds?page=%zu Older entries\n", page + 2);
+        }
+    }
     return src;
 }
@@ -33,15 +33,25 @@ struct Impl_FeedEntry {
     iString url;
     iString title;
     uint32_t bookmarkId; /* note: runtime only, not a persistent ID */
+    iBool isRead;
 };
 
 void    init_Feeds              (const char *saveDir);
+void    initBackground_Feeds    (const char *saveDir); /* entries loaded in a background thread */
 void    deinit_Feeds            (void);
 void    refresh_Feeds           (void);
 void    removeEntries_Feeds     (uint32_t feedBookmarkId);
 
 void    refreshFinished_Feeds   (void); /* called on "feeds.update.finished" */
+void    bookmarksChanged_Feeds  (void); /* called on "bookmarks.changed" */
 
 const iPtrArray *   listEntries_Feeds   (void);
-const iString *     entryListPage_Feeds (void);
+const iString *     entryListPage_Feeds (size_t page); /* zero-based; newest entries first */
 size_t              numSubscribed_Feeds (void);
+size_t              numUnread_Feeds     (void);
+size_t              numEntries_Feeds    (void);
+size_t              memorySize_Feeds    (void); /* entries and cached page sections */
+
+iBool   isEntryRead_Feeds       (const iString *entryUrl);
+void    setEntryRead_Feeds      (const iString *entryUrl, iBool isRead); /* no-op if not an entry */
+void    markAllRead_Feeds       (void);
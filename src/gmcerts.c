@@ -22,7 +22,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "gmcerts.h"
 #include "defs.h"
+#include "journal.h"
+#include "saver.h"
+#include "trigramindex.h"
 
+#include <the_Foundation/atomic.h>
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
 #include <the_Foundation/mutex.h>
@@ -34,7 +39,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/time.h>
 #include <ctype.h>
 
-static const char *filename_GmCerts_       = "trusted.txt";
+static const char *filename_GmCerts_       = "trusted.txt"; /* older format */
+static const char *binFilename_GmCerts_    = "trusted.binary";
 static const char *identsDir_GmCerts_      = "idents";
 static const char *identsFilename_GmCerts_ = "idents.binary";
 
@@ -66,6 +72,14 @@ static int cmpUrl_GmIdentity_(const iString *a, const iString *b) {
     return cmpStringCase_String(a, b);
 }
 
+/* Incremented whenever the URLs of any identity change, so GmCerts knows when its index of
+   the URLs is out of date. */
+static iAtomicInt useRevision_GmIdentity_;
+
+static void changedUse_GmIdentity_(void) {
+    add_Atomic(&useRevision_GmIdentity_, 1);
+}
+
 void init_GmIdentity(iGmIdentity *d) {
     d->icon  = 0x1f511; /* key */
     d->flags = 0;
@@ -106,6 +120,7 @@ void deserialize_GmIdentity(iGmIdentity *d, iStream *ins) {
         insert_StringSet(d->useUrls, &url);
         deinit_String(&url);
     }
+    changedUse_GmIdentity_();
 }
 
 static iBool isValid_GmIdentity_(const iGmIdentity *d) {
@@ -173,10 +188,12 @@ void setUse_GmIdentity(iGmIdentity *d, const iString *url, iBool use) {
     else {
         remove_StringSet(d->useUrls, url);
     }
+    changedUse_GmIdentity_();
 }
 
 void clearUse_GmIdentity(iGmIdentity *d) {
     clear_StringSet(d->useUrls);
+    changedUse_GmIdentity_();
 }
 
 const iString *name_GmIdentity(const iGmIdentity *d) {
@@ -185,15 +202,96 @@ const iString *name_GmIdentity(const iGmIdentity *d) {
 
 iDefineTypeConstruction(GmIdentity)
 
+static void init_GmIdentityInfo_(iGmIdentityInfo *d, const iGmIdentity *ident) {
+    initCopy_Block(&d->fingerprint, &ident->fingerprint);
+    init_String(&d->subject);
+    iString *subject = subject_TlsCertificate(ident->cert);
+    set_String(&d->subject, subject);
+    delete_String(subject);
+    initCopy_String(&d->notes, &ident->notes);
+    d->icon = ident->icon;
+}
+
+void deinit_GmIdentityInfo(iGmIdentityInfo *d) {
+    deinit_String(&d->notes);
+    deinit_String(&d->subject);
+    deinit_Block(&d->fingerprint);
+}
+
 /*-----------------------------------------------------------------------------------------------*/
 
+/* The URLs where identities are used are indexed in a trie of case-folded characters, so
+   the identity for a URL is found by walking the URL once. Each node that ends a used URL
+   knows the first identity that uses it. */
+
+iDeclareType(UseTrieNode)
+
+struct Impl_UseTrieNode {
+    uint32_t firstChild;  /* node index; zero if none (the root is never a child) */
+    uint32_t nextSibling;
+    int      identIndex;  /* -1 if no used URL ends here */
+    char     ch;
+};
+
+static char foldCase_(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a' : ch;
+}
+
+static uint32_t child_UseTrie_(iArray *trie, uint32_t node, char ch, iBool create) {
+    for (uint32_t i = ((const iUseTrieNode *) constAt_Array(trie, node))->firstChild; i;
+         i = ((const iUseTrieNode *) constAt_Array(trie, i))->nextSibling) {
+        if (((const iUseTrieNode *) constAt_Array(trie, i))->ch == ch) {
+            return i;
+        }
+    }
+    if (!create) {
+        return 0;
+    }
+    const uint32_t added = (uint32_t) size_Array(trie);
+    iUseTrieNode *parent = at_Array(trie, node);
+    const iUseTrieNode child = { 0, parent->firstChild, -1, ch };
+    parent->firstChild = added;
+    pushBack_Array(trie, &child);
+    return added;
+}
+
 struct Impl_GmCerts {
     iMutex *mtx;
     iString saveDir;
     iStringHash *trusted;
     iPtrArray idents;
+    iJournal *journal; /* trust changes since trusted.binary was last saved */
+    iArray useTrie; /* UseTrieNodes; index zero is the root */
+    int useTrieRevision;
+    iAtomicInt identsRevision; /* incremented when identities are added, removed, or edited */
+    iTrigramIndex *identIndex; /* identity indices by trigrams of subjects and notes */
+    int identIndexRevision;
 };
 
+static void updateUseTrie_GmCerts_(iGmCerts *d) {
+    /* Called while locked. */
+    const int revision = value_Atomic(&useRevision_GmIdentity_);
+    if (!isEmpty_Array(&d->useTrie) && d->useTrieRevision == revision) {
+        return;
+    }
+    clear_Array(&d->useTrie);
+    pushBack_Array(&d->useTrie, &(iUseTrieNode){ 0, 0, -1, 0 });
+    for (size_t i = 0; i < size_PtrArray(&d->idents); i++) {
+        const iGmIdentity *ident = constAt_PtrArray(&d->idents, i);
+        iConstForEach(StringSet, j, ident->useUrls) {
+            uint32_t node = 0;
+            for (const char *ch = cstr_String(j.value); *ch; ch++) {
+                node = child_UseTrie_(&d->useTrie, node, foldCase_(*ch), iTrue);
+            }
+            iUseTrieNode *end = at_Array(&d->useTrie, node);
+            if (end->identIndex < 0) {
+                end->identIndex = (int) i;
+            }
+        }
+    }
+    d->useTrieRevision = revision;
+}
+
 static const char *magicIdMeta_GmCerts_   = "lgL2";
 static const char *magicIdentity_GmCerts_ = "iden";
 
@@ -215,27 +313,107 @@ static void saveIdentities_GmCerts_(const iGmCerts *d) {
     iRelease(f);
 }
 
+/* trusted.binary has a header (magic, version, number of entries) followed by the entries.
+   An entry is the domain (U16 length and bytes), the expiration time in seconds (U64), and
+   the fingerprint (U8 length and bytes). */
+
+static const char *magicTrusted_GmCerts_ = "lgTR";
+
 static void save_GmCerts_(const iGmCerts *d) {
     iBeginCollect();
-    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, filename_GmCerts_)));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        iString line;
-        init_String(&line);
-        iConstForEach(StringHash, i, d->trusted) {
-            const iTrustEntry *trust = value_StringHashNode(i.value);
-            format_String(&line,
-                          "%s %ld %s\n",
-                          cstr_String(key_StringHashConstIterator(&i)),
-                          integralSeconds_Time(&trust->validUntil),
-                          cstrCollect_String(hexEncode_Block(&trust->fingerprint)));
-            write_File(f, &line.chars);
+    iBuffer *buf = iClob(new_Buffer());
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    writeData_Stream(outs, magicTrusted_GmCerts_, 4);
+    writeU32_Stream(outs, latest_FileVersion);
+    writeU32_Stream(outs, (uint32_t) size_StringHash(d->trusted));
+    iConstForEach(StringHash, i, d->trusted) {
+        const iString *    domain = key_StringHashConstIterator(&i);
+        const iTrustEntry *trust  = value_StringHashNode(i.value);
+        writeU16_Stream(outs, (uint16_t) size_String(domain));
+        writeData_Stream(outs, cstr_String(domain), size_String(domain));
+        writeU64_Stream(outs, (uint64_t) integralSeconds_Time(&trust->validUntil));
+        write8_Stream(outs, (uint8_t) size_Block(&trust->fingerprint));
+        writeData_Stream(outs, constData_Block(&trust->fingerprint), size_Block(&trust->fingerprint));
+    }
+    if (writeAtomically_Saver(collect_String(concatCStr_Path(&d->saveDir, binFilename_GmCerts_)),
+                              data_Buffer(buf))) {
+        remove(cstrCollect_String(concatCStr_Path(&d->saveDir, filename_GmCerts_)));
+        if (d->journal) {
+            clear_Journal(d->journal); /* all changes are in the file now */
         }
-        deinit_String(&line);
     }
-    iRelease(f);
     iEndCollect();
 }
 
+static iBool loadBinary_GmCerts_(iGmCerts *d) {
+    iFile *f = iClob(new_File(collect_String(concatCStr_Path(&d->saveDir, binFilename_GmCerts_))));
+    if (!open_File(f, readOnly_FileMode)) {
+        return iFalse;
+    }
+    iBuffer *buf = iClob(new_Buffer());
+    open_Buffer(buf, collect_Block(readAll_File(f)));
+    iStream *ins = stream_Buffer(buf);
+    char magic[4];
+    readData_Stream(ins, 4, magic);
+    if (memcmp(magic, magicTrusted_GmCerts_, 4) || readU32_Stream(ins) > latest_FileVersion) {
+        printf("%s: format not recognized\n", cstr_String(path_File(f)));
+        return iFalse;
+    }
+    uint32_t count = readU32_Stream(ins);
+    iString *domain = collectNew_String();
+    iBlock * fingerprint = collect_Block(new_Block(0));
+    while (count-- && !atEnd_Stream(ins)) {
+        resize_Block(&domain->chars, readU16_Stream(ins));
+        readData_Stream(ins, size_Block(&domain->chars), data_Block(&domain->chars));
+        iDate untilDate;
+        initSinceEpoch_Date(&untilDate, (time_t) readU64_Stream(ins));
+        resize_Block(fingerprint, read8_Stream(ins));
+        readData_Stream(ins, size_Block(fingerprint), data_Block(fingerprint));
+        insert_StringHash(d->trusted, domain, iClob(new_TrustEntry(fingerprint, &untilDate)));
+    }
+    return iTrue;
+}
+
+static void journal_GmCerts_(const iGmCerts *d, const iString *domain) {
+    /* Called while locked so the journal is ordered the same way as the changes. */
+    const iTrustEntry *trust = value_StringHash(d->trusted, domain);
+    if (!d->journal || !trust) return;
+    iStringList *fields = new_StringList();
+    pushBackCStr_StringList(fields, "trust");
+    pushBack_StringList(fields, domain);
+    pushBack_StringList(
+        fields, collect_String(newFormat_String("%ld", integralSeconds_Time(&trust->validUntil))));
+    pushBack_StringList(fields, collect_String(hexEncode_Block(&trust->fingerprint)));
+    append_Journal(d->journal, fields);
+    iRelease(fields);
+}
+
+static void compact_GmCerts_(void *context) {
+    iGmCerts *d = context;
+    iGuardMutex(d->mtx, save_GmCerts_(d));
+}
+
+static void replay_GmCerts_(void *context, const iStringList *fields) {
+    iGmCerts *d = context;
+    if (size_StringList(fields) == 4 && !cmp_String(constAt_StringList(fields, 0), "trust")) {
+        const iString *domain = constAt_StringList(fields, 1);
+        const iBlock * fingerprint =
+            collect_Block(hexDecode_Rangecc(range_String(constAt_StringList(fields, 3))));
+        iDate untilDate;
+        initSinceEpoch_Date(&untilDate,
+                            strtol(cstr_String(constAt_StringList(fields, 2)), NULL, 10));
+        iTrustEntry *trust = value_StringHash(d->trusted, domain);
+        if (trust) {
+            init_Time(&trust->validUntil, &untilDate);
+            set_Block(&trust->fingerprint, fingerprint);
+        }
+        else {
+            insert_StringHash(d->trusted, domain, iClob(new_TrustEntry(fingerprint, &untilDate)));
+        }
+    }
+}
+
 static void loadIdentities_GmCerts_(iGmCerts *d) {
     iFile *f =
         iClob(new_File(collect_String(concatCStr_Path(&d->saveDir, identsFilename_GmCerts_))));
@@ -303,7 +481,7 @@ static void loadIdentityFromCertificate_GmCerts_(iGmCerts *d, const iString *crt
 
 static void load_GmCerts_(iGmCerts *d) {
     iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, filename_GmCerts_)));
-    if (open_File(f, readOnly_FileMode | text_FileMode)) {
+    if (!loadBinary_GmCerts_(d) && open_File(f, readOnly_FileMode | text_FileMode)) {
         iRegExp *      pattern = new_RegExp("([^\\s]+) ([0-9]+) ([a-z0-9]+)", 0);
         const iRangecc src     = range_Block(collect_Block(readAll_File(f)));
         iRangecc       line    = iNullRange;
@@ -320,8 +498,8 @@ static void load_GmCerts_(iGmCerts *d) {
                 initSinceEpoch_Date(&untilDate, sec);
                 insert_StringHash(d->trusted,
                                   collect_String(newRange_String(domain)),
-                                  new_TrustEntry(collect_Block(hexDecode_Rangecc(fp)),
-                                                 &untilDate));
+                                  iClob(new_TrustEntry(collect_Block(hexDecode_Rangecc(fp)),
+                                                       &untilDate)));
             }
         }
         iRelease(pattern);
@@ -355,16 +533,32 @@ void init_GmCerts(iGmCerts *d, const char *saveDir) {
     initCStr_String(&d->saveDir, saveDir);
     d->trusted = new_StringHash();
     init_PtrArray(&d->idents);
+    d->journal = NULL;
+    init_Array(&d->useTrie, sizeof(iUseTrieNode));
+    d->useTrieRevision = 0;
+    set_Atomic(&d->identsRevision, 0);
+    d->identIndex = new_TrigramIndex();
+    d->identIndexRevision = -1;
     load_GmCerts_(d);
+    /* Apply the trust changes made after trusted.binary was saved. */
+    iJournal *journal = new_Journal(
+        collect_String(concatCStr_Path(&d->saveDir, "trusted.journal")), compact_GmCerts_, d);
+    replay_Journal(journal, replay_GmCerts_, d);
+    d->journal = journal;
 }
 
 void deinit_GmCerts(iGmCerts *d) {
+    iGuardMutex(d->mtx, save_GmCerts_(d));
+    delete_Journal(d->journal); /* waits for an ongoing compaction */
+    d->journal = NULL;
     iGuardMutex(d->mtx, {
         saveIdentities_GmCerts_(d);
         iForEach(PtrArray, i, &d->idents) {
             delete_GmIdentity(i.ptr);
         }
         deinit_PtrArray(&d->idents);
+        deinit_Array(&d->useTrie);
+        delete_TrigramIndex(d->identIndex);
         iRelease(d->trusted);
         deinit_String(&d->saveDir);
     });
@@ -409,7 +603,7 @@ iBool checkTrust_GmCerts(iGmCerts *d, iRangecc domain, const iTlsCertificate *ce
     else {
         insert_StringHash(d->trusted, key, iClob(new_TrustEntry(fingerprint, &until)));
     }
-    save_GmCerts_(d);
+    journal_GmCerts_(d, key);
     unlock_Mutex(d->mtx);
     delete_Block(fingerprint);
     delete_String(key);
@@ -428,7 +622,7 @@ void setTrusted_GmCerts(iGmCerts *d, iRangecc domain, const iBlock *fingerprint,
     else {
         insert_StringHash(d->trusted, key, iClob(trust = new_TrustEntry(fingerprint, validUntil)));
     }
-    save_GmCerts_(d);
+    journal_GmCerts_(d, key);
     unlock_Mutex(d->mtx);
 }
 
@@ -442,20 +636,23 @@ const iGmIdentity *constIdentity_GmCerts(const iGmCerts *d, unsigned int id) {
 
 const iGmIdentity *identityForUrl_GmCerts(const iGmCerts *d, const iString *url) {
     lock_Mutex(d->mtx);
-    const iGmIdentity *found = NULL;
-    iConstForEach(PtrArray, i, &d->idents) {
-        const iGmIdentity *ident = i.ptr;
-        iConstForEach(StringSet, j, ident->useUrls) {
-            const iString *used = j.value;
-            if (startsWithCase_String(url, cstr_String(used))) {
-                found = ident;
-                goto done;
-            }
+    iGmCerts *m = iConstCast(iGmCerts *, d);
+    updateUseTrie_GmCerts_(m);
+    /* Every used URL that is a prefix of the URL is on the path. The identity that comes
+       first in the list of identities wins. */
+    int found = -1;
+    uint32_t node = 0;
+    for (const char *ch = cstr_String(url); *ch; ch++) {
+        node = child_UseTrie_(&m->useTrie, node, foldCase_(*ch), iFalse);
+        if (!node) break;
+        const int index = ((const iUseTrieNode *) constAt_Array(&d->useTrie, node))->identIndex;
+        if (index >= 0 && (found < 0 || index < found)) {
+            found = index;
         }
     }
-done:
+    const iGmIdentity *ident = found >= 0 ? constAt_PtrArray(&d->idents, found) : NULL;
     unlock_Mutex(d->mtx);
-    return found;
+    return ident;
 }
 
 iGmIdentity *newIdentity_GmCerts(iGmCerts *d, int flags, iDate validUntil, const iString *commonName,
@@ -489,7 +686,10 @@ iGmIdentity *newIdentity_GmCerts(iGmCerts *d, int flags, iDate validUntil, const
             return NULL;
         }
     }
-    iGuardMutex(d->mtx, pushBack_PtrArray(&d->idents, id));
+    iGuardMutex(d->mtx, {
+        pushBack_PtrArray(&d->idents, id);
+        add_Atomic(&d->identsRevision, 1);
+    });
     return id;
 }
 
@@ -511,6 +711,8 @@ void deleteIdentity_GmCerts(iGmCerts *d, iGmIdentity *identity) {
     }
     removeOne_PtrArray(&d->idents, identity);
     collect_GmIdentity(identity);
+    changedUse_GmIdentity_(); /* indices have changed */
+    add_Atomic(&d->identsRevision, 1);
     unlock_Mutex(d->mtx);
 }
 
@@ -539,6 +741,70 @@ void signOut_GmCerts(iGmCerts *d, const iString *url) {
     }
 }
 
+void setNotes_GmCerts(iGmCerts *d, iGmIdentity *identity, const iString *notes) {
+    iGuardMutex(d->mtx, {
+        set_String(&identity->notes, notes);
+        add_Atomic(&d->identsRevision, 1);
+    });
+}
+
+static void pushInfo_GmIdentity_(const iGmIdentity *d, iArray *infos_out) {
+    iGmIdentityInfo info;
+    init_GmIdentityInfo_(&info, d);
+    pushBack_Array(infos_out, &info);
+}
+
+void snapshotIdentities_GmCerts(const iGmCerts *d, iArray *infos_out) {
+    lock_Mutex(d->mtx);
+    iConstForEach(PtrArray, i, &d->idents) {
+        pushInfo_GmIdentity_(i.ptr, infos_out);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void updateIdentIndex_GmCerts_(iGmCerts *d) {
+    /* Called while locked. Formatting the subjects is slow, so it is only done when the
+       identities have changed. */
+    const int revision = value_Atomic(&d->identsRevision);
+    if (d->identIndexRevision == revision) {
+        return;
+    }
+    clear_TrigramIndex(d->identIndex);
+    for (size_t i = 0; i < size_PtrArray(&d->idents); i++) {
+        const iGmIdentity *ident   = constAt_PtrArray(&d->idents, i);
+        iString *          subject = subject_TlsCertificate(ident->cert);
+        add_TrigramIndex(d->identIndex, range_String(subject), (uint32_t) i);
+        add_TrigramIndex(d->identIndex, range_String(&ident->notes), (uint32_t) i);
+        delete_String(subject);
+    }
+    d->identIndexRevision = revision;
+}
+
+void snapshotMatchingIdentities_GmCerts(const iGmCerts *d, const iStringList *words,
+                                        iArray *infos_out) {
+    iArray ids;
+    init_Array(&ids, sizeof(uint32_t));
+    lock_Mutex(d->mtx);
+    updateIdentIndex_GmCerts_(iConstCast(iGmCerts *, d));
+    if (query_TrigramIndex(d->identIndex, words, &ids)) {
+        iConstForEach(Array, i, &ids) {
+            pushInfo_GmIdentity_(constAt_PtrArray(&d->idents, *(const uint32_t *) i.value),
+                                 infos_out);
+        }
+    }
+    else {
+        iConstForEach(PtrArray, i, &d->idents) {
+            pushInfo_GmIdentity_(i.ptr, infos_out);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_Array(&ids);
+}
+
+int identitiesRevision_GmCerts(const iGmCerts *d) {
+    return value_Atomic(&d->identsRevision);
+}
+
 const iPtrArray *listIdentities_GmCerts(const iGmCerts *d, iGmCertsIdentityFilterFunc filter,
                                         void *context) {
     iPtrArray *list = collectNew_PtrArray();
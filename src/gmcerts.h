@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #pragma once
 
 #include <the_Foundation/ptrarray.h>
+#include <the_Foundation/stringlist.h>
 #include <the_Foundation/stringset.h>
 #include <the_Foundation/tlsrequest.h>
 
@@ -52,6 +53,19 @@ void    clearUse_GmIdentity (iGmIdentity *);
 
 const iString *name_GmIdentity(const iGmIdentity *);
 
+/* Copy of the descriptive parts of an identity. Remains valid after the identity has been
+   deleted. */
+iDeclareType(GmIdentityInfo)
+
+struct Impl_GmIdentityInfo {
+    iBlock  fingerprint;
+    iString subject;
+    iString notes;
+    iChar   icon;
+};
+
+void    deinit_GmIdentityInfo   (iGmIdentityInfo *);
+
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(GmCerts)
@@ -88,6 +102,11 @@ const iGmIdentity * constIdentity_GmCerts   (const iGmCerts *, unsigned int id);
 const iGmIdentity * identityForUrl_GmCerts  (const iGmCerts *, const iString *url);
 const iPtrArray *   identities_GmCerts      (const iGmCerts *);
 const iPtrArray *   listIdentities_GmCerts  (const iGmCerts *, iGmCertsIdentityFilterFunc filter, void *context);
+void                snapshotIdentities_GmCerts  (const iGmCerts *, iArray *infos_out); /* GmIdentityInfo */
+void                snapshotMatchingIdentities_GmCerts  (const iGmCerts *, const iStringList *words,
+                                                         iArray *infos_out);
+int                 identitiesRevision_GmCerts  (const iGmCerts *); /* changes on any edit */
+void                setNotes_GmCerts        (iGmCerts *, iGmIdentity *, const iString *notes);
 
 void                signIn_GmCerts          (iGmCerts *, iGmIdentity *identity, const iString *url);
 void                signOut_GmCerts         (iGmCerts *, const iString *url);
@@ -25,14 +25,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "ui/color.h"
 #include "ui/text.h"
 #include "ui/metrics.h"
+#include "ui/profiler.h"
 #include "ui/window.h"
 #include "visited.h"
 #include "app.h"
 
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/regexp.h>
+#include <the_Foundation/thread.h>
 
 #include <ctype.h>
+#include <limits.h>
+#include <string.h>
 
 iDeclareType(GmLink)
 
@@ -56,17 +61,148 @@ void deinit_GmLink(iGmLink *d) {
 
 iDefineTypeConstruction(GmLink)
 
+#define swapMember_GmDocument_(type, a, b, member) {     \
+        type tmp_ = (a)->member;                         \
+        (a)->member = (b)->member;                       \
+        (b)->member = tmp_;                              \
+    }
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(GmLayoutPrefs)
+iDeclareType(GmLayoutJob)
+
+/* The preferences that affect the layout. */
+struct Impl_GmLayoutPrefs {
+    iBool quoteIcon;
+    iBool bigFirstParagraph;
+    iBool isForcedMonospace;
+};
+
+/* Background layout of a new source. The job has a private document that gets normalized
+   and laid out in a worker thread; the results are then moved to the owner document in
+   the main thread. */
+struct Impl_GmLayoutJob {
+    iGmDocument *owner;
+    iGmDocument *doc;
+    iThread *    thread;
+    iBool        isNormalized;
+    iAtomicInt   isFinished;
+    iAtomicInt   isCancelled; /* polled by the layout of `doc` */
+    iGmLayoutPrefs prefs;     /* copied in the main thread when the job is started */
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
+enum iGmLineType {
+    text_GmLineType,
+    bullet_GmLineType,
+    preformatted_GmLineType,
+    quote_GmLineType,
+    heading1_GmLineType,
+    heading2_GmLineType,
+    heading3_GmLineType,
+    link_GmLineType,
+    max_GmLineType,
+};
+
+iDeclareType(GmLine)
+
+/* Entry in the line table of the normalized source. */
+struct Impl_GmLine {
+    uint32_t offset; /* in the normalized source */
+    uint32_t length; /* excluding the newline */
+    uint8_t  type;   /* iGmLineType when outside a preformatted block */
+};
+
+iDeclareType(GmLayoutState)
+
+/* Layout state at the start of a line. When more source is appended to a document, for
+   example while a response is being received, the layout is resumed from a saved state
+   instead of being redone from the beginning. */
+struct Impl_GmLayoutState {
+    size_t           lineIndex;
+    size_t           sourcePos; /* offset of the line in the normalized source */
+    size_t           numRuns;
+    size_t           numLinks;
+    size_t           numHeadings;
+    iBool            hasTitle;
+    iInt2            pos;
+    iBool            isFirstText;
+    iBool            addQuoteIcon;
+    iBool            isPreformat;
+    int              preFont;
+    uint16_t         preId;
+    iBool            enableIndents;
+    iBool            addSiteBanner;
+    enum iGmLineType prevType;
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(GmCachedLayout)
+
+/* Finished layout of the current source at some other width or font size. */
+struct Impl_GmCachedLayout {
+    int            width;
+    uint64_t       layoutKey;
+    int            height;
+    iArray         layout;
+    iArray         visSpans;
+    iArray         hitSpans;
+    iArray         locSpans;
+    iPtrArray      links;
+    iArray         headings;
+    iString        title;
+    iString        bannerText;
+    iGmLayoutState resume;
+    iBool          isLayoutPartial;
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(GmRunSpan)
+
+/* Index entry for locating runs by Y coordinate. `bottom` is the running maximum of all the
+   bottom edges up to and including this run, so the entries are sorted and can be searched
+   with a binary search even though individual runs may be shorter than their predecessors.
+   `top` is a copy of the run's own top edge, so vertical scans can skip runs without reading
+   them. This is the only hot/cold split of the layout: the runs themselves keep all of their
+   attributes and are as large as before. Each run has one or two of these 12-byte entries. */
+struct Impl_GmRunSpan {
+    uint32_t runIndex;
+    int      top;
+    int      bottom;
+};
+
+iDeclareType(GmRunLoc)
+
+/* Index entry for locating runs by source position. Text runs are laid out in source
+   order, so the entries are sorted by offset. The offsets are relative to the beginning
+   of the source, which keeps them valid if the source buffer is moved. */
+struct Impl_GmRunLoc {
+    uint32_t runIndex;
+    uint32_t start;
+    uint32_t end;
+};
+
 /*----------------------------------------------------------------------------------------------*/
 
 struct Impl_GmDocument {
     iObject object;
     enum iGmDocumentFormat format;
     iString   source;
+    iArray    lines; /* GmLine for each line of the normalized source */
+    iString   findQuery;
+    iArray    findMatches; /* uint32_t source offsets of all matches of findQuery, ascending */
     iString   url; /* for resolving relative links */
     iString   localHost;
     iBool     siteBannerEnabled;
     iInt2     size;
     iArray    layout; /* contents of source, laid out in document space */
+    iArray    visSpans; /* GmRunSpan for each run in layout, using visBounds */
+    iArray    hitSpans; /* GmRunSpan for each non-decoration run, using bounds */
+    iArray    locSpans; /* GmRunLoc for each non-decoration run with source text */
     iPtrArray links;
     iString   bannerText;
     iString   title; /* the first top-level title */
@@ -74,22 +210,24 @@ struct Impl_GmDocument {
     uint32_t  themeSeed;
     iChar     siteIcon;
     iMedia *  media;
+    iGmLayoutJob * layoutJob;      /* background layout in progress */
+    const iGmLayoutJob *job; /* set if this is the private copy of a layout job */
+    iGmLayoutState resume;         /* latest line where the layout can be continued */
+    iBool          isStreaming;    /* source is being appended to */
+    size_t         streamRawSize;  /* bytes of the raw streamed source already normalized */
+    size_t         streamNormSize; /* normalized size of the complete lines */
+    size_t         streamNumLines;
+    size_t         streamReserved;
+    iBool          streamPreformat;
+    uint64_t       layoutKey;      /* fonts and preferences of the current layout */
+    iBool          enableLazyLayout;
+    iBool          isLayoutPartial; /* lazy layout hasn't reached the end of the source yet */
+    int            lazyBottom;     /* lazy layout continues until this Y coordinate */
+    iPtrArray      layoutCache;    /* GmCachedLayouts, most recently used first */
 };
 
 iDefineObjectConstruction(GmDocument)
 
-enum iGmLineType {
-    text_GmLineType,
-    bullet_GmLineType,
-    preformatted_GmLineType,
-    quote_GmLineType,
-    heading1_GmLineType,
-    heading2_GmLineType,
-    heading3_GmLineType,
-    link_GmLineType,
-    max_GmLineType,
-};
-
 static enum iGmLineType lineType_GmDocument_(const iGmDocument *d, const iRangecc line) {
     if (d->format == plainText_GmDocumentFormat) {
         return text_GmLineType;
@@ -138,29 +276,69 @@ static int lastVisibleRunBottom_GmDocument_(const iGmDocument *d) {
     return 0;
 }
 
-static iInt2 measurePreformattedBlock_GmDocument_(const iGmDocument *d, const char *start, int font) {
-    const iRangecc content = { start, constEnd_String(&d->source) };
-    iRangecc line = iNullRange;
-    nextSplit_Rangecc(content, "\n", &line);
-    iAssert(startsWith_Rangecc(line, "```"));
-    iRangecc preBlock = { line.end + 1, line.end + 1 };
-    while (nextSplit_Rangecc(content, "\n", &line)) {
-        if (startsWith_Rangecc(line, "```")) {
+static iInt2 measurePreformattedBlock_GmDocument_(const iGmDocument *d, size_t lineIndex,
+                                                  int font) {
+    const char *   src     = constBegin_String(&d->source);
+    const iGmLine *opening = constAt_Array(&d->lines, lineIndex);
+    iAssert(opening->type == preformatted_GmLineType);
+    const char *blockStart = src + opening->offset + opening->length + 1;
+    iRangecc    preBlock   = { blockStart, blockStart };
+    for (size_t i = lineIndex + 1; i < size_Array(&d->lines); i++) {
+        const iGmLine *line = constAt_Array(&d->lines, i);
+        if (line->type == preformatted_GmLineType) {
             break;
         }
-        preBlock.end = line.end;
+        preBlock.end = src + line->offset + line->length;
     }
     return measureRange_Text(font, preBlock);
 }
 
-static iRangecc addLink_GmDocument_(iGmDocument *d, iRangecc line, iGmLinkId *linkId) {
-    static iRegExp *pattern_;
-    if (!pattern_) {
-        pattern_ = new_RegExp("=>\\s*([^\\s]+)(\\s.*)?", caseInsensitive_RegExpOption);
+static iRegExp *linkPattern_; /* compiled in the main thread, shared by layout workers */
+
+/* Looks up the visit times of links starting from `firstLink` with a single query of the
+   visited URLs, and updates the colors of the link icons starting from `firstRun`. */
+static void updateVisitedLinks_GmDocument_(iGmDocument *d, size_t firstLink, size_t firstRun) {
+    const size_t numLinks = size_PtrArray(&d->links);
+    if (firstLink >= numLinks) {
+        return;
+    }
+    iPtrArray *urls = new_PtrArray();
+    for (size_t i = firstLink; i < numLinks; i++) {
+        pushBack_PtrArray(urls, &((const iGmLink *) constAt_PtrArray(&d->links, i))->url);
     }
+    iTime *times = calloc(size_PtrArray(urls), sizeof(iTime));
+    if (loadedVisited_App()) {
+        visitTimes_Visited(loadedVisited_App(), urls, times); /* else "visited.changed" follows */
+    }
+    for (size_t i = firstLink; i < numLinks; i++) {
+        iGmLink *link = at_PtrArray(&d->links, i);
+        link->flags &= ~visited_GmLinkFlag;
+        iZap(link->when);
+        /* The document's own URL doesn't count as visited. */
+        if (cmpString_String(&link->url, &d->url) && isValid_Time(&times[i - firstLink])) {
+            link->when = times[i - firstLink];
+            link->flags |= visited_GmLinkFlag;
+        }
+    }
+    free(times);
+    delete_PtrArray(urls);
+    /* Link icons are the only decorations with a link. */
+    for (size_t i = firstRun; i < size_Array(&d->layout); i++) {
+        iGmRun *run = at_Array(&d->layout, i);
+        if (run->linkId > firstLink && run->flags & decoration_GmRunFlag) {
+            run->color = linkColor_GmDocument(d, run->linkId, icon_GmLinkPart);
+        }
+    }
+}
+
+void updateVisitedLinks_GmDocument(iGmDocument *d) {
+    updateVisitedLinks_GmDocument_(d, 0, 0);
+}
+
+static iRangecc addLink_GmDocument_(iGmDocument *d, iRangecc line, iGmLinkId *linkId) {
     iRegExpMatch m;
     init_RegExpMatch(&m);
-    if (matchRange_RegExp(pattern_, line, &m)) {
+    if (matchRange_RegExp(linkPattern_, line, &m)) {
         iGmLink *link = new_GmLink();
         link->urlRange = capturedRange_RegExpMatch(&m, 1);
         setRange_String(&link->url, link->urlRange);
@@ -210,13 +388,7 @@ static iRangecc addLink_GmDocument_(iGmDocument *d, iRangecc line, iGmLinkId *li
                 }
                 delete_String(path);
             }
-            /* Check if visited. */
-            if (cmpString_String(&link->url, &d->url)) {
-                link->when = urlVisitTime_Visited(visited_App(), &link->url);
-                if (isValid_Time(&link->when)) {
-                    link->flags |= visited_GmLinkFlag;
-                }
-            }
+            /* Visit times are looked up afterwards for all new links at once. */
         }
         pushBack_PtrArray(&d->links, link);
         *linkId = size_PtrArray(&d->links); /* index + 1 */
@@ -240,6 +412,38 @@ static void clearLinks_GmDocument_(iGmDocument *d) {
     clear_PtrArray(&d->links);
 }
 
+void init_GmCachedLayout(iGmCachedLayout *d) {
+    d->width    = 0;
+    d->layoutKey = 0;
+    d->height    = 0;
+    d->isLayoutPartial = iFalse;
+    init_Array(&d->layout, sizeof(iGmRun));
+    init_Array(&d->visSpans, sizeof(iGmRunSpan));
+    init_Array(&d->hitSpans, sizeof(iGmRunSpan));
+    init_Array(&d->locSpans, sizeof(iGmRunLoc));
+    init_PtrArray(&d->links);
+    init_Array(&d->headings, sizeof(iGmHeading));
+    init_String(&d->title);
+    init_String(&d->bannerText);
+    iZap(d->resume);
+}
+
+void deinit_GmCachedLayout(iGmCachedLayout *d) {
+    deinit_String(&d->bannerText);
+    deinit_String(&d->title);
+    deinit_Array(&d->headings);
+    iForEach(PtrArray, i, &d->links) {
+        delete_GmLink(i.ptr);
+    }
+    deinit_PtrArray(&d->links);
+    deinit_Array(&d->locSpans);
+    deinit_Array(&d->hitSpans);
+    deinit_Array(&d->visSpans);
+    deinit_Array(&d->layout);
+}
+
+iDefineTypeConstruction(GmCachedLayout)
+
 static iBool isForcedMonospace_GmDocument_(const iGmDocument *d) {
     const iRangecc scheme = urlScheme_String(&d->url);
     if (equalCase_Rangecc(scheme, "gemini")) {
@@ -251,8 +455,102 @@ static iBool isForcedMonospace_GmDocument_(const iGmDocument *d) {
     return iFalse;
 }
 
-static void doLayout_GmDocument_(iGmDocument *d) {
-    const iBool isMono = isForcedMonospace_GmDocument_(d);
+static iGmLayoutPrefs layoutPrefs_GmDocument_(const iGmDocument *d) {
+    /* The app's preferences may change in the main thread at any time, so a layout job
+       uses the ones that were current when it was started. */
+    if (d->job) {
+        return d->job->prefs;
+    }
+    const iPrefs *prefs = prefs_App();
+    return (iGmLayoutPrefs){ .quoteIcon         = prefs->quoteIcon,
+                             .bigFirstParagraph = prefs->bigFirstParagraph,
+                             .isForcedMonospace = isForcedMonospace_GmDocument_(d) };
+}
+
+/* Identifies the fonts and preferences that affect the layout. */
+static uint64_t layoutKey_GmDocument_(const iGmDocument *d) {
+    const iGmLayoutPrefs prefs = layoutPrefs_GmDocument_(d);
+    return fontsKey_Text() | (uint64_t) prefs.quoteIcon << 32 |
+           (uint64_t) prefs.bigFirstParagraph << 33 | (uint64_t) prefs.isForcedMonospace << 34;
+}
+
+static void pushSpan_GmDocument_(iArray *spans, size_t runIndex, iRect bounds) {
+    int bottom = bottom_Rect(bounds);
+    if (!isEmpty_Array(spans)) {
+        bottom = iMax(bottom, ((const iGmRunSpan *) constBack_Array(spans))->bottom);
+    }
+    pushBack_Array(spans, &(iGmRunSpan){ (uint32_t) runIndex, top_Rect(bounds), bottom });
+}
+
+static void indexRuns_GmDocument_(iGmDocument *d, size_t firstRun) {
+    /* New runs are only ever appended to the layout, so the index can be extended. */
+    const iRangecc src = range_String(&d->source);
+    for (size_t i = firstRun; i < size_Array(&d->layout); i++) {
+        const iGmRun *run = constAt_Array(&d->layout, i);
+        pushSpan_GmDocument_(&d->visSpans, i, run->visBounds);
+        if (~run->flags & decoration_GmRunFlag) {
+            pushSpan_GmDocument_(&d->hitSpans, i, run->bounds);
+            if (run->text.start >= src.start && run->text.end <= src.end) {
+                pushBack_Array(&d->locSpans,
+                               &(iGmRunLoc){ (uint32_t) i,
+                                             (uint32_t) (run->text.start - src.start),
+                                             (uint32_t) (run->text.end - src.start) });
+            }
+        }
+    }
+}
+
+static void clearRunIndex_GmDocument_(iGmDocument *d) {
+    clear_Array(&d->visSpans);
+    clear_Array(&d->hitSpans);
+    clear_Array(&d->locSpans);
+}
+
+/* Returns the position of the first span whose bottom is greater than `y` (or equal, if
+   `inclusive` is set). Returns the size of the array if there is no such span. */
+static size_t findSpan_GmDocument_(const iArray *spans, int y, iBool inclusive) {
+    size_t lo = 0, hi = size_Array(spans);
+    while (lo < hi) {
+        const size_t mid    = (lo + hi) / 2;
+        const int    bottom = ((const iGmRunSpan *) constAt_Array(spans, mid))->bottom;
+        if (bottom > y || (inclusive && bottom == y)) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+static void initLayoutState_GmDocument_(const iGmDocument *d, iGmLayoutState *st) {
+    const iGmLayoutPrefs prefs = layoutPrefs_GmDocument_(d);
+    iZap(*st);
+    st->isFirstText   = prefs.bigFirstParagraph;
+    st->addQuoteIcon  = prefs.quoteIcon;
+    st->preFont       = preformatted_FontId;
+    st->addSiteBanner = d->siteBannerEnabled;
+    st->prevType      = text_GmLineType;
+    if (d->format == plainText_GmDocumentFormat) {
+        st->isPreformat = iTrue;
+        st->isFirstText = iFalse;
+    }
+}
+
+static const size_t lazyLayoutMinSize_GmDocument_ = 128 * 1024; /* normalized source bytes */
+
+static iBool isLazyLayout_GmDocument_(const iGmDocument *d) {
+    return d->enableLazyLayout && !d->isStreaming &&
+           size_String(&d->source) >= lazyLayoutMinSize_GmDocument_;
+}
+
+/* Lays out the source starting from the line described by `start`. The runs, links, and
+   headings created before that line must already be in place. The layout stops at the
+   first line that begins below `untilY` and after source offset `untilPos`. */
+static void layout_GmDocument_(iGmDocument *d, const iGmLayoutState start, int untilY,
+                               size_t untilPos) {
+    const iGmLayoutPrefs prefs  = layoutPrefs_GmDocument_(d);
+    const iBool          isMono = prefs.isForcedMonospace;
     /* TODO: Collect these parameters into a GmTheme. */
     const int fonts[max_GmLineType] = {
         isMono ? regularMonospace_FontId : paragraph_FontId,
@@ -291,40 +589,65 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     static const char *quote           = "\u201c";
     static const char *magnifyingGlass = "\U0001f50d";
     const float midRunSkip = 0; /*0.120f;*/ /* extra space between wrapped text/quote lines */
-    const iPrefs *prefs = prefs_App();
-    clear_Array(&d->layout);
-    clearLinks_GmDocument_(d);
-    clear_Array(&d->headings);
-    clear_String(&d->title);
-    clear_String(&d->bannerText);
-    if (d->size.x <= 0 || isEmpty_String(&d->source)) {
-        return;
-    }
-    const iRangecc   content       = range_String(&d->source);
-    iRangecc         contentLine   = iNullRange;
-    iInt2            pos           = zero_I2();
-    iBool            isFirstText   = prefs->bigFirstParagraph;
-    iBool            addQuoteIcon  = prefs->quoteIcon;
-    iBool            isPreformat   = iFalse;
+    const char *     sourceStart   = constBegin_String(&d->source);
+    /* While streaming, the last line is incomplete and will be laid out again. */
+    const char *     resumeLimit   = sourceStart + (d->isStreaming ? d->streamNormSize
+                                                                   : size_String(&d->source));
+    const size_t     firstRun      = start.numRuns;
+    iInt2            pos           = start.pos;
+    iBool            isFirstText   = start.isFirstText;
+    iBool            addQuoteIcon  = start.addQuoteIcon;
+    iBool            isPreformat   = start.isPreformat;
     iRangecc         preAltText    = iNullRange;
-    int              preFont       = preformatted_FontId;
-    uint16_t         preId         = 0;
-    iBool            enableIndents = iFalse;
-    iBool            addSiteBanner = d->siteBannerEnabled;
-    enum iGmLineType prevType      = text_GmLineType;
-    if (d->format == plainText_GmDocumentFormat) {
-        isPreformat = iTrue;
-        isFirstText = iFalse;
-    }
-    while (nextSplit_Rangecc(content, "\n", &contentLine)) {
-        iRangecc line = contentLine; /* `line` will be trimmed later; would confuse nextSplit */
+    int              preFont       = start.preFont;
+    uint16_t         preId         = start.preId;
+    iBool            enableIndents = start.enableIndents;
+    iBool            addSiteBanner = start.addSiteBanner;
+    enum iGmLineType prevType      = start.prevType;
+    iBool            isStopped     = iFalse;
+    for (size_t lineIndex = start.lineIndex; ; lineIndex++) {
+        if (d->job && value_Atomic(&d->job->isCancelled)) {
+            break; /* result will be discarded */
+        }
+        const iBool    isEnd     = (lineIndex == size_Array(&d->lines));
+        const iGmLine *srcLine   = isEnd ? NULL : constAt_Array(&d->lines, lineIndex);
+        const char *   lineStart = isEnd ? constEnd_String(&d->source)
+                                         : sourceStart + srcLine->offset;
+        /* Remember where to continue if more source is appended. Preformatted blocks are
+           laid out again as a whole because their font depends on the widest line. */
+        if ((!isPreformat || d->format == plainText_GmDocumentFormat) &&
+            lineStart <= resumeLimit) {
+            d->resume = (iGmLayoutState){ .lineIndex     = lineIndex,
+                                          .sourcePos     = lineStart - sourceStart,
+                                          .numRuns       = size_Array(&d->layout),
+                                          .numLinks      = size_PtrArray(&d->links),
+                                          .numHeadings   = size_Array(&d->headings),
+                                          .hasTitle      = !isEmpty_String(&d->title),
+                                          .pos           = pos,
+                                          .isFirstText   = isFirstText,
+                                          .addQuoteIcon  = addQuoteIcon,
+                                          .isPreformat   = isPreformat,
+                                          .preFont       = preFont,
+                                          .preId         = preId,
+                                          .enableIndents = enableIndents,
+                                          .addSiteBanner = addSiteBanner,
+                                          .prevType      = prevType };
+            if (!isEnd && pos.y > untilY && d->resume.sourcePos > untilPos) {
+                isStopped = iTrue; /* rest of the document is laid out lazily */
+                break;
+            }
+        }
+        if (isEnd) {
+            break;
+        }
+        iRangecc line = { lineStart, lineStart + srcLine->length };
         iGmRun run = { .color = white_ColorId };
         enum iGmLineType type;
         int indent = 0;
         /* Detect the type of the line. */
         if (!isPreformat) {
-            type = lineType_GmDocument_(d, line);
-            if (contentLine.start == content.start) {
+            type = srcLine->type;
+            if (lineIndex == 0) {
                 prevType = type;
             }
             indent = indents[type];
@@ -333,7 +656,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
                 preId++;
                 preFont = preformatted_FontId;
                 /* Use a smaller font if the block contents are wide. */
-                if (measurePreformattedBlock_GmDocument_(d, line.start, preFont).x >
+                if (measurePreformattedBlock_GmDocument_(d, lineIndex, preFont).x >
                     d->size.x - indents[preformatted_GmLineType]) {
                     preFont = preformattedSmall_FontId;
                 }
@@ -353,19 +676,29 @@ static void doLayout_GmDocument_(iGmDocument *d) {
             run.font = fonts[type];
             /* Remember headings for the document outline. */
             if (type == heading1_GmLineType || type == heading2_GmLineType || type == heading3_GmLineType) {
-                pushBack_Array(
-                    &d->headings,
-                    &(iGmHeading){ .text = line, .level = type - heading1_GmLineType });
+                const int level   = type - heading1_GmLineType;
+                size_t    section = iInvalidPos;
+                if (level == 0) {
+                    section = size_Array(&d->headings);
+                }
+                else if (!isEmpty_Array(&d->headings)) {
+                    section = ((const iGmHeading *) constBack_Array(&d->headings))->section;
+                }
+                pushBack_Array(&d->headings,
+                               &(iGmHeading){ .text    = line,
+                                              .level   = level,
+                                              .top     = pos.y, /* updated below */
+                                              .section = section });
             }
         }
         else {
             /* Preformatted line. */
             type = preformatted_GmLineType;
-            if (contentLine.start == content.start) {
+            if (lineIndex == 0) {
                 prevType = type;
             }
             if (d->format == gemini_GmDocumentFormat &&
-                startsWithSc_Rangecc(line, "```", &iCaseSensitive)) {
+                srcLine->type == preformatted_GmLineType) {
                 isPreformat = iFalse;
                 preAltText = iNullRange;
                 addSiteBanner = iFalse; /* overrides the banner */
@@ -384,7 +717,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
                 banner.bounds    = zero_Rect();
                 banner.visBounds = init_Rect(0, 0, d->size.x, lineHeight_Text(banner_FontId) * 2);
                 banner.font      = banner_FontId;
-                banner.text      = bannerText;
+                banner.text      = range_String(&d->bannerText);
                 banner.color     = tmBannerTitle_ColorId;
                 pushBack_Array(&d->layout, &banner);
                 pos.y += height_Rect(banner.visBounds) + lineHeight_Text(paragraph_FontId);
@@ -422,6 +755,11 @@ static void doLayout_GmDocument_(iGmDocument *d) {
                 pos.y += required - delta;
             }
         }
+        if (!isPreformat &&
+            (type == heading1_GmLineType || type == heading2_GmLineType ||
+             type == heading3_GmLineType)) {
+            ((iGmHeading *) back_Array(&d->headings))->top = pos.y; /* after the margin */
+        }
         /* Save the document title (first high-level heading). */
         if ((type == heading1_GmLineType || type == heading2_GmLineType) &&
             isEmpty_String(&d->title)) {
@@ -458,7 +796,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
             pushBack_Array(&d->layout, &quoteRun);
         }
         else if (type != quote_GmLineType) {
-            addQuoteIcon = prefs->quoteIcon;
+            addQuoteIcon = prefs.quoteIcon;
         }
         /* Link icon. */
         if (type == link_GmLineType) {
@@ -498,7 +836,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         iRangecc runLine = line;
         /* Create one or more text runs for this line. */
         run.flags |= startOfLine_GmRunFlag;
-        if (!prefs->quoteIcon && type == quote_GmLineType) {
+        if (!prefs.quoteIcon && type == quote_GmLineType) {
             run.flags |= quoteBorder_GmRunFlag;
         }
         iAssert(!isEmpty_Range(&runLine)); /* must have something at this point */
@@ -598,31 +936,119 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         }
         prevType = type;
     }
+    d->isLayoutPartial = isStopped;
     d->size.y = pos.y;
-    /* Go over the preformatted blocks and mark them wide if at least one run is wide. */ {
+    if (d->isLayoutPartial && d->resume.sourcePos > 0) {
+        /* Estimate the height of the rest based on what has been laid out so far. */
+        d->size.y = (int) ((int64_t) pos.y * size_String(&d->source) / d->resume.sourcePos);
+    }
+    /* Go over the preformatted blocks and mark them wide if at least one run is wide.
+       Blocks before `firstRun` are complete and have already been marked. */ {
         /* TODO: Store the dimensions and ranges for later access. */
-        iForEach(Array, i, &d->layout) {
-            iGmRun *run = i.value;
+        for (size_t i = firstRun; i < size_Array(&d->layout); i++) {
+            const iGmRun *run = constAt_Array(&d->layout, i);
             if (run->preId && run->flags & wide_GmRunFlag) {
                 iGmRunRange block = findPreformattedRange_GmDocument(d, run);
                 for (const iGmRun *j = block.start; j != block.end; j++) {
                     iConstCast(iGmRun *, j)->flags |= wide_GmRunFlag;
                 }
                 /* Skip to the end of the block. */
-                i.pos = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
+                i = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
             }
         }
     }
+    if (!d->job) {
+        /* The visited URLs are not looked up in a layout job's thread. The links are
+           updated when the results are moved to the owner. */
+        updateVisitedLinks_GmDocument_(d, start.numLinks, firstRun);
+    }
+    indexRuns_GmDocument_(d, firstRun);
+}
+
+static void doLayout_GmDocument_(iGmDocument *d) {
+    clear_Array(&d->layout);
+    clearRunIndex_GmDocument_(d);
+    clearLinks_GmDocument_(d);
+    clear_Array(&d->headings);
+    clear_String(&d->title);
+    clear_String(&d->bannerText);
+    initLayoutState_GmDocument_(d, &d->resume);
+    d->isLayoutPartial = iFalse;
+    d->layoutKey = layoutKey_GmDocument_(d);
+    if (d->size.x <= 0 || isEmpty_String(&d->source)) {
+        return;
+    }
+    iBeginProfile(layout);
+    layout_GmDocument_(d, d->resume, isLazyLayout_GmDocument_(d) ? d->lazyBottom : INT_MAX, 0);
+    iEndProfile(layout);
+}
+
+static void resumeLayout_GmDocument_(iGmDocument *d) {
+    const iGmLayoutState *st = &d->resume;
+    if (d->size.x <= 0 || st->numRuns == 0) {
+        doLayout_GmDocument_(d);
+        return;
+    }
+    /* Discard everything that was laid out after the saved state. */
+    resize_Array(&d->layout, st->numRuns);
+    resize_Array(&d->visSpans, st->numRuns); /* one per run */
+    while (!isEmpty_Array(&d->hitSpans) &&
+           ((const iGmRunSpan *) constBack_Array(&d->hitSpans))->runIndex >= st->numRuns) {
+        popBack_Array(&d->hitSpans);
+    }
+    while (!isEmpty_Array(&d->locSpans) &&
+           ((const iGmRunLoc *) constBack_Array(&d->locSpans))->runIndex >= st->numRuns) {
+        popBack_Array(&d->locSpans);
+    }
+    while (size_PtrArray(&d->links) > st->numLinks) {
+        iGmLink *link;
+        take_PtrArray(&d->links, size_PtrArray(&d->links) - 1, (void **) &link);
+        delete_GmLink(link);
+    }
+    resize_Array(&d->headings, st->numHeadings);
+    if (!st->hasTitle) {
+        clear_String(&d->title);
+    }
+    layout_GmDocument_(d, *st, INT_MAX, 0);
+}
+
+static void rebaseRange_(iRangecc *range, iRangecc oldBuffer, const char *newStart) {
+    if (range->start >= oldBuffer.start && range->end <= oldBuffer.end) {
+        range->start = newStart + (range->start - oldBuffer.start);
+        range->end   = newStart + (range->end   - oldBuffer.start);
+    }
+}
+
+/* Updates ranges that refer to the old source buffer after it has been reallocated. */
+static void rebaseRanges_GmDocument_(iGmDocument *d, iRangecc oldBuffer, const char *newStart) {
+    iForEach(Array, i, &d->layout) {
+        rebaseRange_(&((iGmRun *) i.value)->text, oldBuffer, newStart);
+    }
+    iForEach(PtrArray, j, &d->links) {
+        rebaseRange_(&((iGmLink *) j.ptr)->urlRange, oldBuffer, newStart);
+    }
+    iForEach(Array, k, &d->headings) {
+        rebaseRange_(&((iGmHeading *) k.value)->text, oldBuffer, newStart);
+    }
 }
 
 void init_GmDocument(iGmDocument *d) {
+    if (!linkPattern_) {
+        linkPattern_ = new_RegExp("=>\\s*([^\\s]+)(\\s.*)?", caseInsensitive_RegExpOption);
+    }
     d->format = gemini_GmDocumentFormat;
     init_String(&d->source);
+    init_Array(&d->lines, sizeof(iGmLine));
+    init_String(&d->findQuery);
+    init_Array(&d->findMatches, sizeof(uint32_t));
     init_String(&d->url);
     init_String(&d->localHost);
     d->siteBannerEnabled = iTrue;
     d->size = zero_I2();
     init_Array(&d->layout, sizeof(iGmRun));
+    init_Array(&d->visSpans, sizeof(iGmRunSpan));
+    init_Array(&d->hitSpans, sizeof(iGmRunSpan));
+    init_Array(&d->locSpans, sizeof(iGmRunLoc));
     init_PtrArray(&d->links);
     init_String(&d->bannerText);
     init_String(&d->title);
@@ -630,21 +1056,92 @@ void init_GmDocument(iGmDocument *d) {
     d->themeSeed = 0;
     d->siteIcon = 0;
     d->media = new_Media();
+    d->layoutJob = NULL;
+    d->job = NULL;
+    initLayoutState_GmDocument_(d, &d->resume);
+    d->isStreaming = iFalse;
+    d->streamRawSize = 0;
+    d->streamNormSize = 0;
+    d->streamNumLines = 0;
+    d->streamReserved = 0;
+    d->streamPreformat = iFalse;
+    d->layoutKey = 0;
+    init_PtrArray(&d->layoutCache);
+    d->enableLazyLayout = iTrue;
+    d->isLayoutPartial = iFalse;
+    d->lazyBottom = 0;
 }
 
+static void cancelLayout_GmDocument_(iGmDocument *d);
+
+static void clearLayoutCache_GmDocument_(iGmDocument *d);
+
 void deinit_GmDocument(iGmDocument *d) {
+    cancelLayout_GmDocument_(d);
+    clearLayoutCache_GmDocument_(d);
+    deinit_PtrArray(&d->layoutCache);
     delete_Media(d->media);
     deinit_String(&d->bannerText);
     deinit_String(&d->title);
     clearLinks_GmDocument_(d);
     deinit_PtrArray(&d->links);
     deinit_Array(&d->headings);
+    deinit_Array(&d->locSpans);
+    deinit_Array(&d->hitSpans);
+    deinit_Array(&d->visSpans);
     deinit_Array(&d->layout);
     deinit_String(&d->localHost);
     deinit_String(&d->url);
+    deinit_Array(&d->findMatches);
+    deinit_String(&d->findQuery);
+    deinit_Array(&d->lines);
     deinit_String(&d->source);
 }
 
+iGmDocument *duplicate_GmDocument(const iGmDocument *d) {
+    if (d->layoutJob || d->isStreaming || d->size.x <= 0 || !canShare_Media(d->media)) {
+        return NULL;
+    }
+    iGmDocument *dup = new_GmDocument();
+    dup->format = d->format;
+    /* The copy gets private buffers for the texts that runs point to. Shared buffers would
+       leave the copied ranges dangling once the original is modified or deleted. */
+    setRange_String(&dup->source, range_String(&d->source));
+    set_String(&dup->url, &d->url);
+    set_String(&dup->localHost, &d->localHost);
+    setRange_String(&dup->bannerText, range_String(&d->bannerText));
+    set_String(&dup->title, &d->title);
+    setCopy_Array(&dup->lines, &d->lines);
+    dup->siteBannerEnabled = d->siteBannerEnabled;
+    dup->size = d->size;
+    setCopy_Array(&dup->layout, &d->layout);
+    setCopy_Array(&dup->visSpans, &d->visSpans);
+    setCopy_Array(&dup->hitSpans, &d->hitSpans);
+    setCopy_Array(&dup->locSpans, &d->locSpans);
+    setCopy_Array(&dup->headings, &d->headings);
+    iConstForEach(PtrArray, i, &d->links) {
+        const iGmLink *link = i.ptr;
+        iGmLink *      copy = new_GmLink();
+        set_String(&copy->url, &link->url);
+        copy->urlRange = link->urlRange;
+        copy->when     = link->when;
+        copy->flags    = link->flags;
+        pushBack_PtrArray(&dup->links, copy);
+    }
+    rebaseRanges_GmDocument_(dup, range_String(&d->source), constBegin_String(&dup->source));
+    rebaseRanges_GmDocument_(dup, range_String(&d->bannerText),
+                             constBegin_String(&dup->bannerText));
+    dup->themeSeed = d->themeSeed;
+    dup->siteIcon  = d->siteIcon;
+    share_Media(dup->media, d->media);
+    dup->resume           = d->resume;
+    dup->layoutKey        = d->layoutKey;
+    dup->enableLazyLayout = d->enableLazyLayout;
+    dup->isLayoutPartial  = d->isLayoutPartial;
+    dup->lazyBottom       = d->lazyBottom;
+    return dup;
+}
+
 iMedia *media_GmDocument(iGmDocument *d) {
     return d->media;
 }
@@ -653,15 +1150,27 @@ const iMedia *constMedia_GmDocument(const iGmDocument *d) {
     return d->media;
 }
 
+static void clearMatches_GmDocument_(iGmDocument *d) {
+    clear_String(&d->findQuery);
+    clear_Array(&d->findMatches);
+}
+
 void reset_GmDocument(iGmDocument *d) {
+    cancelLayout_GmDocument_(d);
+    clearMatches_GmDocument_(d);
+    clearLayoutCache_GmDocument_(d);
     clear_Media(d->media);
     clearLinks_GmDocument_(d);
     clear_Array(&d->layout);
+    clearRunIndex_GmDocument_(d);
     clear_Array(&d->headings);
     clear_String(&d->url);
     clear_String(&d->localHost);
     d->themeSeed = 0;
     d->siteBannerEnabled = iTrue;
+    d->isStreaming = iFalse;
+    d->isLayoutPartial = iFalse;
+    d->lazyBottom = 0;
 }
 
 static void setDerivedThemeColors_(enum iGmDocumentTheme theme) {
@@ -699,6 +1208,62 @@ static void setDerivedThemeColors_(enum iGmDocumentTheme theme) {
     }
 }
 
+/* The palette only depends on the seed, the selected themes, and the saturation, so
+   recently derived palettes are kept for switching between tabs and sites. */
+iDeclareType(CachedPalette)
+
+struct Impl_CachedPalette {
+    uint32_t              seed;
+    enum iGmDocumentTheme theme;
+    enum iColorTheme      colorTheme;
+    float                 saturation;
+    iColor                colors[max_ColorId - tmFirst_ColorId];
+};
+
+#define maxCachedPalettes_GmDocument_   16
+
+static iCachedPalette cachedPalettes_[maxCachedPalettes_GmDocument_]; /* most recent first */
+static size_t         numCachedPalettes_;
+
+static iBool restoreCachedPalette_GmDocument_(uint32_t seed, enum iGmDocumentTheme theme) {
+    const enum iColorTheme colorTheme = colorTheme_App();
+    const float            saturation = prefs_App()->saturation;
+    for (size_t i = 0; i < numCachedPalettes_; i++) {
+        const iCachedPalette *pal = &cachedPalettes_[i];
+        if (pal->seed == seed && pal->theme == theme && pal->colorTheme == colorTheme &&
+            pal->saturation == saturation) {
+            for (int c = tmFirst_ColorId; c < max_ColorId; c++) {
+                set_Color(c, pal->colors[c - tmFirst_ColorId]);
+            }
+            if (i > 0) {
+                const iCachedPalette found = *pal;
+                memmove(&cachedPalettes_[1], &cachedPalettes_[0], sizeof(iCachedPalette) * i);
+                cachedPalettes_[0] = found;
+            }
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static void cachePalette_GmDocument_(uint32_t seed, enum iGmDocumentTheme theme) {
+    if (numCachedPalettes_ < maxCachedPalettes_GmDocument_) {
+        numCachedPalettes_++;
+    }
+    /* The least recently used one drops off the end. */
+    memmove(&cachedPalettes_[1],
+            &cachedPalettes_[0],
+            sizeof(iCachedPalette) * (numCachedPalettes_ - 1));
+    iCachedPalette *pal = &cachedPalettes_[0];
+    pal->seed       = seed;
+    pal->theme      = theme;
+    pal->colorTheme = colorTheme_App();
+    pal->saturation = prefs_App()->saturation;
+    for (int c = tmFirst_ColorId; c < max_ColorId; c++) {
+        pal->colors[c - tmFirst_ColorId] = get_Color(c);
+    }
+}
+
 void setThemeSeed_GmDocument(iGmDocument *d, const iBlock *seed) {
     const iPrefs *        prefs = prefs_App();
     enum iGmDocumentTheme theme =
@@ -711,6 +1276,23 @@ void setThemeSeed_GmDocument(iGmDocument *d, const iBlock *seed) {
         0x1f306, 0x1f308, 0x1f30a, 0x1f319, 0x1f31f, 0x1f320, 0x1f340, 0x1f4cd, 0x1f4e1, 0x1f531,
         0x1f533, 0x1f657, 0x1f659, 0x1f665, 0x1f668, 0x1f66b, 0x1f78b, 0x1f796, 0x1f79c,
     };
+    if (seed && !isEmpty_Block(seed)) {
+        d->themeSeed = crc32_Block(seed);
+        d->siteIcon  = siteIcons[(d->themeSeed >> 7) % iElemCount(siteIcons)];
+    }
+    else {
+        d->themeSeed = 0;
+        d->siteIcon  = 0;
+    }
+    /* Special exceptions. */
+    if (seed) {
+        if (equal_CStr(cstr_Block(seed), "gemini.circumlunar.space")) {
+            d->siteIcon = 0x264a; /* gemini symbol */
+        }
+    }
+    if (restoreCachedPalette_GmDocument_(d->themeSeed, theme)) {
+        return;
+    }
     /* Default colors. These are used on "about:" pages and local files, for example. */ {
         /* Link colors are generally the same in all themes. */
         set_Color(tmBadLink_ColorId, get_Color(red_ColorId));
@@ -870,14 +1452,6 @@ void setThemeSeed_GmDocument(iGmDocument *d, const iBlock *seed) {
             }
         }
     }
-    if (seed && !isEmpty_Block(seed)) {
-        d->themeSeed = crc32_Block(seed);
-        d->siteIcon  = siteIcons[(d->themeSeed >> 7) % iElemCount(siteIcons)];
-    }
-    else {
-        d->themeSeed = 0;
-        d->siteIcon  = 0;
-    }
     /* Set up colors. */
     if (d->themeSeed) {
         enum iHue {
@@ -1066,12 +1640,7 @@ void setThemeSeed_GmDocument(iGmDocument *d, const iBlock *seed) {
     }
     /* Derived colors. */
     setDerivedThemeColors_(theme);
-    /* Special exceptions. */
-    if (seed) {
-        if (equal_CStr(cstr_Block(seed), "gemini.circumlunar.space")) {
-            d->siteIcon = 0x264a; /* gemini symbol */
-        }
-    }
+    cachePalette_GmDocument_(d->themeSeed, theme);
 #if 0
     for (int i = tmFirst_ColorId; i < max_ColorId; ++i) {
         const iColor tc = get_Color(i);
@@ -1089,12 +1658,82 @@ void setSiteBannerEnabled_GmDocument(iGmDocument *d, iBool siteBannerEnabled) {
     d->siteBannerEnabled = siteBannerEnabled;
 }
 
+static const size_t maxCachedLayouts_GmDocument_ = 4;
+
+static void swapCachedLayout_GmDocument_(iGmDocument *d, iGmCachedLayout *cached) {
+    swapMember_GmDocument_(iArray,         d, cached, layout);
+    swapMember_GmDocument_(iArray,         d, cached, visSpans);
+    swapMember_GmDocument_(iArray,         d, cached, hitSpans);
+    swapMember_GmDocument_(iArray,         d, cached, locSpans);
+    swapMember_GmDocument_(iPtrArray,      d, cached, links);
+    swapMember_GmDocument_(iArray,         d, cached, headings);
+    swapMember_GmDocument_(iString,        d, cached, title);
+    swapMember_GmDocument_(iString,        d, cached, bannerText);
+    swapMember_GmDocument_(iGmLayoutState, d, cached, resume);
+    swapMember_GmDocument_(uint64_t,       d, cached, layoutKey);
+    swapMember_GmDocument_(iBool,          d, cached, isLayoutPartial);
+    iSwap(int, d->size.x, cached->width);
+    iSwap(int, d->size.y, cached->height);
+}
+
+static void clearLayoutCache_GmDocument_(iGmDocument *d) {
+    iForEach(PtrArray, i, &d->layoutCache) {
+        delete_GmCachedLayout(i.ptr);
+    }
+    clear_PtrArray(&d->layoutCache);
+}
+
+void purgeLayoutCache_GmDocument(iGmDocument *d) {
+    clearLayoutCache_GmDocument_(d);
+}
+
+static void cacheLayout_GmDocument_(iGmDocument *d) {
+    /* A streamed layout is incomplete, and the source it refers to is about to change. */
+    if (d->size.x <= 0 || isEmpty_Array(&d->layout) || d->isStreaming) {
+        return;
+    }
+    iGmCachedLayout *cached;
+    if (size_PtrArray(&d->layoutCache) == maxCachedLayouts_GmDocument_) {
+        /* Reuse the least recently used one. */
+        take_PtrArray(&d->layoutCache, maxCachedLayouts_GmDocument_ - 1, (void **) &cached);
+        deinit_GmCachedLayout(cached);
+        init_GmCachedLayout(cached);
+    }
+    else {
+        cached = new_GmCachedLayout();
+    }
+    swapCachedLayout_GmDocument_(d, cached);
+    pushFront_PtrArray(&d->layoutCache, cached);
+}
+
+static iBool restoreCachedLayout_GmDocument_(iGmDocument *d, int width, uint64_t layoutKey) {
+    iForEach(PtrArray, i, &d->layoutCache) {
+        iGmCachedLayout *cached = i.ptr;
+        if (cached->width == width && cached->layoutKey == layoutKey) {
+            remove_PtrArrayIterator(&i);
+            swapCachedLayout_GmDocument_(d, cached);
+            delete_GmCachedLayout(cached);
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
 void setWidth_GmDocument(iGmDocument *d, int width) {
+    const uint64_t layoutKey = layoutKey_GmDocument_(d);
+    if (!d->layoutJob && (width != d->size.x || layoutKey != d->layoutKey)) {
+        /* Layouts are kept per width and fonts so switching back and forth is quick. */
+        cacheLayout_GmDocument_(d);
+        if (restoreCachedLayout_GmDocument_(d, width, layoutKey)) {
+            return;
+        }
+    }
     d->size.x = width;
     doLayout_GmDocument_(d); /* TODO: just flag need-layout and do it later */
 }
 
 void redoLayout_GmDocument(iGmDocument *d) {
+    clearLayoutCache_GmDocument_(d);
     doLayout_GmDocument_(d);
 }
 
@@ -1102,42 +1741,45 @@ iLocalDef iBool isNormalizableSpace_(char ch) {
     return ch == ' ' || ch == '\t';
 }
 
-static void normalize_GmDocument(iGmDocument *d) {
-    iString *normalized = new_String();
-    iRangecc src = range_String(&d->source);
-    iRangecc line = iNullRange;
-    iBool isPreformat = iFalse;
-    if (d->format == plainText_GmDocumentFormat) { // || isGopher_GmDocument_(d)) {
-        isPreformat = iTrue; /* Cannot be turned off. */
+/* Appends the normalized `line` and a newline to `out`, and adds the line to the line table.
+   `isPreformat` tracks whether the line is inside a preformatted block. `capacity` is the
+   space reserved for `out`; it grows geometrically so lines are written without reallocs. */
+static void normalizeLine_GmDocument_(iGmDocument *d, iRangecc line, iBool *isPreformat,
+                                      iBlock *out, size_t *capacity) {
+    const int    preTabWidth = 4; /* TODO: user-configurable parameter */
+    const size_t start       = size_Block(out);
+    const size_t maxSize     = start + size_Range(&line) * (*isPreformat ? preTabWidth : 1) + 1;
+    if (maxSize > *capacity) {
+        *capacity = iMax(maxSize, 2 * *capacity);
+        reserve_Block(out, *capacity);
     }
-    const int preTabWidth = 4; /* TODO: user-configurable parameter */
-    while (nextSplit_Rangecc(src, "\n", &line)) {
-        if (isPreformat) {
-            /* Replace any tab characters with spaces for visualization. */
-            for (const char *ch = line.start; ch != line.end; ch++) {
-                if (*ch == '\t') {
-                    int column = ch - line.start;
-                    int numSpaces = (column / preTabWidth + 1) * preTabWidth - column;
-                    while (numSpaces-- > 0) {
-                        appendCStrN_String(normalized, " ", 1);
-                    }
-                }
-                else if (*ch != '\r') {
-                    appendCStrN_String(normalized, ch, 1);
+    resize_Block(out, maxSize);
+    char *const begin = (char *) data_Block(out) + start;
+    char *      dst   = begin;
+    if (*isPreformat) {
+        /* Replace any tab characters with spaces for visualization. */
+        for (const char *ch = line.start; ch != line.end; ch++) {
+            if (*ch == '\t') {
+                int column = ch - line.start;
+                int numSpaces = (column / preTabWidth + 1) * preTabWidth - column;
+                while (numSpaces-- > 0) {
+                    *dst++ = ' ';
                 }
             }
-            appendCStr_String(normalized, "\n");
-            if (lineType_GmDocument_(d, line) == preformatted_GmLineType) {
-                isPreformat = iFalse;
+            else if (*ch != '\r') {
+                *dst++ = *ch;
             }
-            continue;
         }
         if (lineType_GmDocument_(d, line) == preformatted_GmLineType) {
-            isPreformat = iTrue;
-            appendRange_String(normalized, line);
-            appendCStr_String(normalized, "\n");
-            continue;
+            *isPreformat = iFalse;
         }
+    }
+    else if (lineType_GmDocument_(d, line) == preformatted_GmLineType) {
+        *isPreformat = iTrue;
+        memcpy(dst, line.start, size_Range(&line));
+        dst += size_Range(&line);
+    }
+    else {
         iBool isPrevSpace = iFalse;
         int spaceCount = 0;
         for (const char *ch = line.start; ch != line.end; ch++) {
@@ -1148,8 +1790,7 @@ static void normalize_GmDocument(iGmDocument *d) {
                     if (++spaceCount == 8) {
                         /* There are several consecutive space characters. The author likely
                            really wants to have some space here, so normalize to a tab stop. */
-                        popBack_Block(&normalized->chars);
-                        pushBack_Block(&normalized->chars, '\t');
+                        dst[-1] = '\t';
                     }
                     continue; /* skip repeated spaces */
                 }
@@ -1160,9 +1801,32 @@ static void normalize_GmDocument(iGmDocument *d) {
                 isPrevSpace = iFalse;
                 spaceCount = 0;
             }
-            appendCStrN_String(normalized, &c, 1);
+            *dst++ = c;
         }
-        appendCStr_String(normalized, "\n");
+    }
+    const iRangecc normLine = { begin, dst };
+    *dst++ = '\n';
+    truncate_Block(out, dst - (const char *) constData_Block(out));
+    pushBack_Array(&d->lines,
+                   &(iGmLine){ .offset = start,
+                               .length = size_Range(&normLine),
+                               .type   = lineType_GmDocument_(d, normLine) });
+}
+
+static void normalize_GmDocument(iGmDocument *d) {
+    iString *normalized = new_String();
+    iRangecc src = range_String(&d->source);
+    iRangecc line = iNullRange;
+    iBool isPreformat = iFalse;
+    if (d->format == plainText_GmDocumentFormat) { // || isGopher_GmDocument_(d)) {
+        isPreformat = iTrue; /* Cannot be turned off. */
+    }
+    /* Normalization usually shrinks the source; leave some room for expanded tabs. */
+    size_t capacity = size_Range(&src) + size_Range(&src) / 16 + 1;
+    reserve_Block(&normalized->chars, capacity);
+    clear_Array(&d->lines);
+    while (nextSplit_Rangecc(src, "\n", &line)) {
+        normalizeLine_GmDocument_(d, line, &isPreformat, &normalized->chars, &capacity);
     }
     set_String(&d->source, collect_String(normalized));
 }
@@ -1175,27 +1839,236 @@ void setUrl_GmDocument(iGmDocument *d, const iString *url) {
 }
 
 void setSource_GmDocument(iGmDocument *d, const iString *source, int width) {
+    cancelLayout_GmDocument_(d);
+    clearMatches_GmDocument_(d);
+    d->isStreaming = iFalse;
+    clearLayoutCache_GmDocument_(d);
     set_String(&d->source, source);
     normalize_GmDocument(d);
-    setWidth_GmDocument(d, width); /* re-do layout */
+    d->size.x = width;
+    doLayout_GmDocument_(d);
+}
+
+void setStreamedSource_GmDocument(iGmDocument *d, const iString *source, int width) {
+    cancelLayout_GmDocument_(d);
+    clearMatches_GmDocument_(d);
+    clearLayoutCache_GmDocument_(d);
+    const iBool isNewStream = !d->isStreaming || size_String(source) < d->streamRawSize;
+    if (isNewStream) {
+        clear_String(&d->source);
+        clear_Array(&d->lines);
+        d->streamNumLines  = 0;
+        d->isStreaming     = iTrue;
+        d->streamRawSize   = 0;
+        d->streamNormSize  = 0;
+        d->streamReserved  = 0;
+        d->streamPreformat = (d->format == plainText_GmDocumentFormat);
+    }
+    const iRangecc oldBuffer = range_String(&d->source);
+    const iRangecc appended  = { constBegin_String(source) + d->streamRawSize,
+                                 constEnd_String(source) };
+    /* The incomplete last line from the previous update is normalized again. */
+    truncate_Block(&d->source.chars, d->streamNormSize);
+    resize_Array(&d->lines, d->streamNumLines);
+    const char *lineStart = appended.start;
+    for (;;) {
+        const char *lineEnd = memchr(lineStart, '\n', appended.end - lineStart);
+        if (!lineEnd) break;
+        normalizeLine_GmDocument_(d, (iRangecc){ lineStart, lineEnd }, &d->streamPreformat,
+                                  &d->source.chars, &d->streamReserved);
+        lineStart = lineEnd + 1;
+    }
+    d->streamRawSize  = lineStart - constBegin_String(source);
+    d->streamNormSize = size_String(&d->source);
+    d->streamNumLines = size_Array(&d->lines);
+    if (lineStart != appended.end) {
+        iBool isPreformat = d->streamPreformat;
+        normalizeLine_GmDocument_(d, (iRangecc){ lineStart, appended.end }, &isPreformat,
+                                  &d->source.chars, &d->streamReserved);
+    }
+    if (!isNewStream && constBegin_String(&d->source) != oldBuffer.start) {
+        rebaseRanges_GmDocument_(d, oldBuffer, constBegin_String(&d->source));
+    }
+    if (isNewStream || width != d->size.x) {
+        d->size.x = width;
+        doLayout_GmDocument_(d);
+    }
+    else {
+        resumeLayout_GmDocument_(d);
+    }
+}
+
+void finishStream_GmDocument(iGmDocument *d) {
+    /* The last update contained the complete source, so the layout is already final. From
+       now on the document is cached and laid out lazily like any other. */
+    if (d->isStreaming) {
+        d->isStreaming    = iFalse;
+        d->streamNumLines = 0;
+        d->streamRawSize  = 0;
+        d->streamNormSize = 0;
+        d->streamReserved = 0;
+    }
+}
+
+iBool isStreaming_GmDocument(const iGmDocument *d) {
+    return d->isStreaming;
+}
+
+static iThreadResult run_GmLayoutJob_(iThread *thread) {
+    iGmLayoutJob *d = userData_Thread(thread);
+    iBeginCollect();
+    if (!d->isNormalized) {
+        normalize_GmDocument(d->doc);
+        d->isNormalized = iTrue;
+    }
+    doLayout_GmDocument_(d->doc);
+    iEndCollect();
+    set_Atomic(&d->isFinished, iTrue);
+    if (!value_Atomic(&d->isCancelled)) {
+        postCommandf_App("document.layout.finished gmdoc:%p", d->owner);
+    }
+    return 0;
+}
+
+static void startLayout_GmDocument_(iGmDocument *d, iGmLayoutJob *job) {
+    iAssert(!d->layoutJob);
+    d->layoutJob = job;
+    set_Atomic(&job->isFinished, iFalse);
+    set_Atomic(&job->isCancelled, iFalse);
+    job->prefs    = layoutPrefs_GmDocument_(d);
+    job->doc->job = job;
+    job->thread  = new_Thread(run_GmLayoutJob_);
+    setUserData_Thread(job->thread, job);
+    start_Thread(job->thread);
+}
+
+static void deleteLayoutJob_(iGmLayoutJob *job) {
+    iRelease(job->thread);
+    iRelease(job->doc);
+    free(job);
+}
+
+static void cancelLayout_GmDocument_(iGmDocument *d) {
+    iGmLayoutJob *job = d->layoutJob;
+    if (job) {
+        set_Atomic(&job->isCancelled, iTrue);
+        join_Thread(job->thread);
+        deleteLayoutJob_(job);
+        d->layoutJob = NULL;
+    }
+}
+
+static void startSourceLayout_GmDocument_(iGmDocument *d) {
+    iGmLayoutJob *job = iMalloc(GmLayoutJob);
+    job->owner        = d;
+    job->isNormalized = iTrue;
+    job->doc          = new_GmDocument();
+    job->doc->format  = d->format;
+    job->doc->siteBannerEnabled = d->siteBannerEnabled;
+    job->doc->enableLazyLayout  = iFalse;
+    job->doc->size.x  = d->size.x;
+    set_String(&job->doc->url, &d->url);
+    set_String(&job->doc->localHost, &d->localHost);
+    setRange_String(&job->doc->source, range_String(&d->source)); /* private copy */
+    setCopy_Array(&job->doc->lines, &d->lines);
+    startLayout_GmDocument_(d, job);
+}
+
+void setSourceAsync_GmDocument(iGmDocument *d, const iString *source, int width) {
+    /* The beginning is laid out right away so there is something to show. */
+    setSource_GmDocument(d, source, width);
+    if (d->isLayoutPartial &&
+        !numImages_Media(d->media) && !numAudio_Media(d->media)) {
+        /* Layout of media content depends on the media objects, which are not thread-safe,
+           so in that case the rest is laid out lazily in the main thread. */
+        startSourceLayout_GmDocument_(d);
+    }
+}
+
+iBool isLayoutPartial_GmDocument(const iGmDocument *d) {
+    return d->isLayoutPartial;
+}
+
+iBool extendLayout_GmDocument(iGmDocument *d, int bottom) {
+    d->lazyBottom = bottom;
+    if (!d->isLayoutPartial || bottom < d->resume.pos.y) {
+        return iFalse;
+    }
+    iBeginProfile(layout);
+    layout_GmDocument_(d, d->resume, bottom, 0);
+    iEndProfile(layout);
+    if (!d->isLayoutPartial) {
+        cancelLayout_GmDocument_(d); /* nothing left for the background job to do */
+    }
+    return iTrue;
+}
+
+iBool extendLayoutToLoc_GmDocument(iGmDocument *d, const char *loc) {
+    const char *start = constBegin_String(&d->source);
+    if (!d->isLayoutPartial || !loc || loc < start + d->resume.sourcePos) {
+        return iFalse;
+    }
+    iBeginProfile(layout);
+    layout_GmDocument_(d, d->resume, 0, loc - start);
+    iEndProfile(layout);
+    if (!d->isLayoutPartial) {
+        cancelLayout_GmDocument_(d);
+    }
+    return iTrue;
+}
+
+iBool isLayoutPending_GmDocument(const iGmDocument *d) {
+    return d->layoutJob != NULL;
+}
+
+iBool finishLayout_GmDocument(iGmDocument *d) {
+    iGmLayoutJob *job = d->layoutJob;
+    if (!job || !value_Atomic(&job->isFinished)) {
+        return iFalse; /* notification was for an earlier job */
+    }
+    join_Thread(job->thread);
+    d->layoutJob = NULL;
+    iGmDocument *res = job->doc;
+    if (res->size.x != d->size.x) {
+        /* Width changed while the layout was being done. */
+        iRelease(job->thread);
+        res->size.x = d->size.x;
+        startLayout_GmDocument_(d, job);
+        return iFalse;
+    }
+    clearLayoutCache_GmDocument_(d); /* partial layouts */
+    /* Move the results to the owner. The job's source is an identical copy, so the ranges
+       are moved to the owner's source buffer. This way ranges that refer to the owner's
+       source (e.g., a selection) remain valid. */
+    rebaseRanges_GmDocument_(res, range_String(&res->source), constBegin_String(&d->source));
+    swapMember_GmDocument_(iArray,    d, res, layout);
+    swapMember_GmDocument_(iArray,    d, res, visSpans);
+    swapMember_GmDocument_(iArray,    d, res, hitSpans);
+    swapMember_GmDocument_(iArray,    d, res, locSpans);
+    swapMember_GmDocument_(iPtrArray, d, res, links);
+    swapMember_GmDocument_(iArray,    d, res, headings);
+    swapMember_GmDocument_(iString,   d, res, title);
+    swapMember_GmDocument_(iString,   d, res, bannerText);
+    d->resume = res->resume;
+    d->layoutKey = res->layoutKey;
+    d->isLayoutPartial = iFalse;
+    d->size = res->size;
+    deleteLayoutJob_(job);
+    updateVisitedLinks_GmDocument_(d, 0, 0);
+    return iTrue;
 }
 
 void render_GmDocument(const iGmDocument *d, iRangei visRangeY, iGmDocumentRenderFunc render,
                        void *context) {
-    iBool isInside = iFalse;
-    /* TODO: Check lookup table for quick starting position. */
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
-        if (isInside) {
-            if (top_Rect(run->visBounds) > visRangeY.end) {
-                break;
-            }
-            render(context, run);
-        }
-        else if (bottom_Rect(run->visBounds) >= visRangeY.start) {
-            isInside = iTrue;
-            render(context, run);
+    /* The first visible run is the first one whose bottom reaches the visible range. */
+    for (size_t pos = findSpan_GmDocument_(&d->visSpans, visRangeY.start, iTrue);
+         pos < size_Array(&d->visSpans);
+         pos++) {
+        const iGmRunSpan *span = constAt_Array(&d->visSpans, pos);
+        if (span->top > visRangeY.end) {
+            break;
         }
+        render(context, constAt_Array(&d->layout, span->runIndex));
     }
 }
 
@@ -1226,10 +2099,58 @@ const iArray *headings_GmDocument(const iGmDocument *d) {
     return &d->headings;
 }
 
+size_t findHeading_GmDocument(const iGmDocument *d, int y) {
+    /* Binary search for the last heading that begins at or above `y`. */
+    size_t lo = 0, hi = size_Array(&d->headings);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (((const iGmHeading *) constAt_Array(&d->headings, mid))->top <= y) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? lo - 1 : iInvalidPos;
+}
+
 const iString *source_GmDocument(const iGmDocument *d) {
     return &d->source;
 }
 
+static size_t layoutBytes_GmDocument_(const iArray *layout, const iArray *visSpans,
+                                      const iArray *hitSpans, const iArray *locSpans) {
+    return size_Array(layout) * sizeof(iGmRun) +
+           (size_Array(visSpans) + size_Array(hitSpans)) * sizeof(iGmRunSpan) +
+           size_Array(locSpans) * sizeof(iGmRunLoc);
+}
+
+static size_t linkBytes_GmDocument_(const iPtrArray *links) {
+    size_t size = 0;
+    iConstForEach(PtrArray, i, links) {
+        const iGmLink *link = i.ptr;
+        size += sizeof(iGmLink) + size_String(&link->url);
+    }
+    return size;
+}
+
+void memoryUsage_GmDocument(const iGmDocument *d, iGmDocumentMemory *usage_out) {
+    iZap(*usage_out);
+    usage_out->sourceBytes = size_String(&d->source) + size_Array(&d->lines) * sizeof(iGmLine);
+    usage_out->numRuns     = size_Array(&d->layout);
+    usage_out->layoutBytes =
+        layoutBytes_GmDocument_(&d->layout, &d->visSpans, &d->hitSpans, &d->locSpans);
+    usage_out->numLinks  = size_PtrArray(&d->links);
+    usage_out->linkBytes = linkBytes_GmDocument_(&d->links);
+    iConstForEach(PtrArray, i, &d->layoutCache) {
+        const iGmCachedLayout *cached = i.ptr;
+        usage_out->cachedLayoutBytes +=
+            layoutBytes_GmDocument_(
+                &cached->layout, &cached->visSpans, &cached->hitSpans, &cached->locSpans) +
+            linkBytes_GmDocument_(&cached->links);
+    }
+}
+
 iRangecc findText_GmDocument(const iGmDocument *d, const iString *text, const char *start) {
     const char * src      = constBegin_String(&d->source);
     const size_t startPos = (start ? start - src : 0);
@@ -1254,6 +2175,107 @@ iRangecc findTextBefore_GmDocument(const iGmDocument *d, const iString *text, co
     return found;
 }
 
+static iBool equalCaseN_(const char *a, const char *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char) a[i]) != tolower((unsigned char) b[i])) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+static void scanMatches_GmDocument_(iGmDocument *d) {
+    const char * src   = constBegin_String(&d->source);
+    const char * end   = constEnd_String(&d->source);
+    const char * query = cstr_String(&d->findQuery);
+    const size_t len   = size_String(&d->findQuery);
+    clear_Array(&d->findMatches);
+    if (len == 0 || (size_t) (end - src) < len) {
+        return;
+    }
+    /* Candidates are located with memchr, which the C library vectorizes. Both cases of the
+       first character need to be looked for. */
+    const int   lower     = tolower((unsigned char) query[0]);
+    const int   upper     = toupper((unsigned char) query[0]);
+    const char *nextLower = memchr(src, lower, end - src);
+    const char *nextUpper = (upper != lower ? memchr(src, upper, end - src) : NULL);
+    while (nextLower || nextUpper) {
+        const char *pos;
+        if (!nextUpper || (nextLower && nextLower < nextUpper)) {
+            pos       = nextLower;
+            nextLower = memchr(pos + 1, lower, end - pos - 1);
+        }
+        else {
+            pos       = nextUpper;
+            nextUpper = memchr(pos + 1, upper, end - pos - 1);
+        }
+        if ((size_t) (end - pos) >= len && equalCaseN_(pos + 1, query + 1, len - 1)) {
+            pushBack_Array(&d->findMatches, &(uint32_t){ pos - src });
+        }
+    }
+}
+
+size_t updateMatches_GmDocument(iGmDocument *d, const iString *query) {
+    const size_t oldLen = size_String(&d->findQuery);
+    if (size_String(query) == oldLen &&
+        equalCaseN_(cstr_String(query), cstr_String(&d->findQuery), oldLen)) {
+        return size_Array(&d->findMatches); /* no change */
+    }
+    if (oldLen > 0 && size_String(query) > oldLen &&
+        equalCaseN_(cstr_String(query), cstr_String(&d->findQuery), oldLen)) {
+        /* The query was extended, so the new matches are a subset of the old ones. */
+        const char * src   = constBegin_String(&d->source);
+        const size_t avail = size_String(&d->source);
+        const size_t len   = size_String(query);
+        uint32_t *   dst   = data_Array(&d->findMatches);
+        iConstForEach(Array, i, &d->findMatches) {
+            const uint32_t offset = *(const uint32_t *) i.value;
+            if (offset + len <= avail && equalCaseN_(src + offset, cstr_String(query), len)) {
+                *dst++ = offset;
+            }
+        }
+        resize_Array(&d->findMatches, dst - (uint32_t *) data_Array(&d->findMatches));
+        set_String(&d->findQuery, query);
+    }
+    else {
+        set_String(&d->findQuery, query);
+        scanMatches_GmDocument_(d);
+    }
+    return size_Array(&d->findMatches);
+}
+
+size_t numMatches_GmDocument(const iGmDocument *d) {
+    return size_Array(&d->findMatches);
+}
+
+iRangecc match_GmDocument(const iGmDocument *d, size_t index) {
+    if (index >= size_Array(&d->findMatches)) {
+        return iNullRange;
+    }
+    const char *start =
+        constBegin_String(&d->source) + *(const uint32_t *) constAt_Array(&d->findMatches, index);
+    return (iRangecc){ start, start + size_String(&d->findQuery) };
+}
+
+size_t findMatch_GmDocument(const iGmDocument *d, const char *pos) {
+    const char *src = constBegin_String(&d->source);
+    if (pos <= src) {
+        return 0;
+    }
+    const uint32_t offset = (uint32_t) iMin((size_t) (pos - src), size_String(&d->source) + 1);
+    size_t lo = 0, hi = size_Array(&d->findMatches);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (*(const uint32_t *) constAt_Array(&d->findMatches, mid) < offset) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 iGmRunRange findPreformattedRange_GmDocument(const iGmDocument *d, const iGmRun *run) {
     iAssert(run->preId);
     iGmRunRange range = { run, run };
@@ -1272,30 +2294,23 @@ iGmRunRange findPreformattedRange_GmDocument(const iGmDocument *d, const iGmRun
 }
 
 const iGmRun *findRun_GmDocument(const iGmDocument *d, iInt2 pos) {
-    /* TODO: Perf optimization likely needed; use a block map? */
-    const iGmRun *last = NULL;
-    iBool isFirstNonDecoration = iTrue;
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
-        if (run->flags & decoration_GmRunFlag) continue;
-        const iRangei span = ySpan_Rect(run->bounds);
-        if (contains_Range(&span, pos.y)) {
-            last = run;
-            break;
-        }
-        if (isFirstNonDecoration && pos.y < top_Rect(run->bounds)) {
-            last = run;
-            break;
-        }
-        if (top_Rect(run->bounds) > pos.y) break; /* Below the point. */
-        last = run;
-        isFirstNonDecoration = iFalse;
+    const iArray *spans = &d->hitSpans;
+    if (isEmpty_Array(spans)) {
+        return NULL;
+    }
+    /* Non-decoration runs are in top-to-bottom order. The run at `pos` is the first one that
+       reaches below the point; if that one starts below the point, the previous run is the
+       closest one (except at the very top of the document). */
+    const size_t index = findSpan_GmDocument_(spans, pos.y, iFalse);
+    if (index == size_Array(spans)) {
+        return constAt_Array(&d->layout,
+                             ((const iGmRunSpan *) constBack_Array(spans))->runIndex);
     }
-//    if (last) {
-//        printf("found run at (%d,%d): %p [%s]\n", pos.x, pos.y, last, cstr_Rangecc(last->text));
-//        fflush(stdout);
-//    }
-    return last;
+    const iGmRunSpan *span = constAt_Array(spans, index);
+    if (pos.y < span->top && index > 0) {
+        span--; /* previous one */
+    }
+    return constAt_Array(&d->layout, span->runIndex);
 }
 
 const char *findLoc_GmDocument(const iGmDocument *d, iInt2 pos) {
@@ -1306,17 +2321,28 @@ const char *findLoc_GmDocument(const iGmDocument *d, iInt2 pos) {
     return NULL;
 }
 
-const iGmRun *findRunAtLoc_GmDocument(const iGmDocument *d, const char *textCStr) {
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
-        if (run->flags & decoration_GmRunFlag) {
-            continue;
+size_t findRunIndexAtOffset_GmDocument(const iGmDocument *d, size_t offset) {
+    /* The first run that ends after `offset` either contains it or is the next one after it. */
+    const iArray *locs = &d->locSpans;
+    size_t lo = 0, hi = size_Array(locs);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (((const iGmRunLoc *) constAt_Array(locs, mid))->end > offset) {
+            hi = mid;
         }
-        if (contains_Range(&run->text, textCStr) || run->text.start > textCStr /* went past */) {
-            return run;
+        else {
+            lo = mid + 1;
         }
     }
-    return NULL;
+    return lo < size_Array(locs) ? ((const iGmRunLoc *) constAt_Array(locs, lo))->runIndex
+                                 : iInvalidPos;
+}
+
+const iGmRun *findRunAtLoc_GmDocument(const iGmDocument *d, const char *textCStr) {
+    const char *src = constBegin_String(&d->source);
+    const size_t index =
+        findRunIndexAtOffset_GmDocument(d, textCStr > src ? (size_t) (textCStr - src) : 0);
+    return index != iInvalidPos ? constAt_Array(&d->layout, index) : NULL;
 }
 
 static const iGmLink *link_GmDocument_(const iGmDocument *d, iGmLinkId id) {
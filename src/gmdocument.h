@@ -73,6 +73,8 @@ enum iGmLinkFlags {
 struct Impl_GmHeading {
     iRangecc text;
     int level; /* 0, 1, 2 */
+    int top; /* in document space; headings are in ascending order */
+    size_t section; /* index of the closest level 0 heading at or before this one */
 };
 
 enum iGmRunFlags {
@@ -109,6 +111,17 @@ const char *    findLoc_GmRun   (const iGmRun *, iInt2 pos);
 iDeclareClass(GmDocument)
 iDeclareObjectConstruction(GmDocument)
 
+iDeclareType(GmDocumentMemory)
+
+struct Impl_GmDocumentMemory {
+    size_t sourceBytes; /* including the line index */
+    size_t numRuns;
+    size_t layoutBytes; /* runs and their spatial indices */
+    size_t numLinks;
+    size_t linkBytes;
+    size_t cachedLayoutBytes; /* layouts kept for other widths */
+};
+
 enum iGmDocumentFormat {
     undefined_GmDocumentFormat = -1,
     gemini_GmDocumentFormat    = 0,
@@ -122,9 +135,24 @@ void    setWidth_GmDocument     (iGmDocument *, int width);
 void    redoLayout_GmDocument   (iGmDocument *);
 void    setUrl_GmDocument       (iGmDocument *, const iString *url);
 void    setSource_GmDocument    (iGmDocument *, const iString *source, int width);
+void    setStreamedSource_GmDocument(iGmDocument *, const iString *source, int width); /* grows between calls */
+void    finishStream_GmDocument     (iGmDocument *); /* after the complete source was set */
+iBool   isStreaming_GmDocument      (const iGmDocument *);
+void    setSourceAsync_GmDocument   (iGmDocument *, const iString *source, int width);
+iBool   isLayoutPending_GmDocument  (const iGmDocument *);
+iBool   finishLayout_GmDocument     (iGmDocument *); /* call on "document.layout.finished" */
+iBool   isLayoutPartial_GmDocument  (const iGmDocument *);
+iBool   extendLayout_GmDocument     (iGmDocument *, int bottom); /* returns True if runs were added */
+iBool   extendLayoutToLoc_GmDocument(iGmDocument *, const char *loc);
 
 void    reset_GmDocument        (iGmDocument *); /* free images */
 
+/* Returns a new document that shares the source and images of `d` and has a copy of its
+   layout, so nothing needs to be parsed or laid out again. Returns NULL if `d` is still
+   being laid out or received, or has media that can't be shared. */
+iGmDocument *   duplicate_GmDocument    (const iGmDocument *);
+void    purgeLayoutCache_GmDocument (iGmDocument *); /* forget layouts of other widths */
+
 typedef void (*iGmDocumentRenderFunc)(void *, const iGmRun *);
 
 iMedia *        media_GmDocument            (iGmDocument *);
@@ -137,12 +165,20 @@ const iGmRun *  siteBanner_GmDocument       (const iGmDocument *);
 iBool           hasSiteBanner_GmDocument    (const iGmDocument *);
 const iString * bannerText_GmDocument       (const iGmDocument *);
 const iArray *  headings_GmDocument         (const iGmDocument *); /* array of GmHeadings */
+size_t          findHeading_GmDocument      (const iGmDocument *, int y); /* last at or above */
 const iString * source_GmDocument           (const iGmDocument *);
+void            memoryUsage_GmDocument      (const iGmDocument *, iGmDocumentMemory *usage_out);
 
 iRangecc        findText_GmDocument                 (const iGmDocument *, const iString *text, const char *start);
 iRangecc        findTextBefore_GmDocument           (const iGmDocument *, const iString *text, const char *before);
 iGmRunRange     findPreformattedRange_GmDocument    (const iGmDocument *, const iGmRun *run);
 
+/* Find-in-page: all matches of the query are located at once (case-insensitively). */
+size_t          updateMatches_GmDocument            (iGmDocument *, const iString *query); /* returns number of matches */
+size_t          numMatches_GmDocument               (const iGmDocument *);
+iRangecc        match_GmDocument                    (const iGmDocument *, size_t index);
+size_t          findMatch_GmDocument                (const iGmDocument *, const char *pos); /* first at or after `pos` */
+
 enum iGmLinkPart {
     icon_GmLinkPart,
     text_GmLinkPart,
@@ -154,12 +190,14 @@ enum iGmLinkPart {
 const iGmRun *  findRun_GmDocument      (const iGmDocument *, iInt2 pos);
 const char *    findLoc_GmDocument      (const iGmDocument *, iInt2 pos);
 const iGmRun *  findRunAtLoc_GmDocument (const iGmDocument *, const char *loc);
+size_t          findRunIndexAtOffset_GmDocument (const iGmDocument *, size_t offset); /* iInvalidPos if past the end */
 const iString * linkUrl_GmDocument      (const iGmDocument *, iGmLinkId linkId);
 iRangecc        linkUrlRange_GmDocument (const iGmDocument *, iGmLinkId linkId);
 iMediaId        linkImage_GmDocument    (const iGmDocument *, iGmLinkId linkId);
 iMediaId        linkAudio_GmDocument    (const iGmDocument *, iGmLinkId linkId);
 int             linkFlags_GmDocument    (const iGmDocument *, iGmLinkId linkId);
 enum iColorId   linkColor_GmDocument    (const iGmDocument *, iGmLinkId linkId, enum iGmLinkPart part);
+void            updateVisitedLinks_GmDocument (iGmDocument *); /* one query for all links */
 const iTime *   linkTime_GmDocument     (const iGmDocument *, iGmLinkId linkId);
 iBool           isMediaLink_GmDocument  (const iGmDocument *, iGmLinkId linkId);
 const iString * title_GmDocument        (const iGmDocument *);
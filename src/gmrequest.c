@@ -35,12 +35,49 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/path.h>
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/socket.h>
+#include <the_Foundation/stringhash.h>
+#include <the_Foundation/stringlist.h>
+#include <the_Foundation/thread.h>
 #include <the_Foundation/tlsrequest.h>
 
 #include <SDL_timer.h>
+#include <stdio.h>
 
 iDefineTypeConstruction(GmResponse)
 
+const iString *describe_GmRequestTiming(const iGmRequestTiming *d) {
+    iString *str = collectNew_String();
+    if (!d->submitted) {
+        return str;
+    }
+    const uint32_t started   = d->started ? d->started : d->submitted;
+    const uint32_t firstByte = d->firstByte ? d->firstByte : started;
+    const uint32_t header    = d->header ? d->header : firstByte;
+    const uint32_t end       = d->finished ? d->finished : SDL_GetTicks();
+    if (d->started) {
+        appendFormat_String(str, "queued %u ms, ", started - d->submitted);
+    }
+    if (d->firstByte) {
+        /* The TLS request resolves, connects, and handshakes internally. */
+        appendFormat_String(str, "first byte %u ms, ", firstByte - started);
+    }
+    if (d->header) {
+        appendFormat_String(str, "header %u ms, ", header - firstByte);
+    }
+    appendFormat_String(str, "transfer %u ms; ", end - header);
+    const double seconds = (end - firstByte) / 1000.0;
+    if (d->numBytes >= 1000000) {
+        appendFormat_String(str, "%.2f MB", d->numBytes / 1.0e6);
+    }
+    else {
+        appendFormat_String(str, "%.1f KB", d->numBytes / 1.0e3);
+    }
+    if (seconds > 0) {
+        appendFormat_String(str, " at %.1f KB/s", d->numBytes / 1.0e3 / seconds);
+    }
+    return str;
+}
+
 void init_GmResponse(iGmResponse *d) {
     d->statusCode = none_GmStatusCode;
     init_String(&d->meta);
@@ -114,6 +151,69 @@ void deserialize_GmResponse(iGmResponse *d, iStream *ins) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* Network traces record the raw bytes of Gemini and Gopher responses with their arrival
+   times, so loading a page can be repeated offline at the original or a scaled pace. Records
+   of concurrent requests are interleaved in the file. */
+
+static const char *    magic_GmRequestTrace_   = "ltrc";
+static const uint32_t version_GmRequestTrace_ = 1;
+
+enum iTraceRecordType {
+    gemini_TraceRecordType = 1, /* begins a response */
+    gopher_TraceRecordType = 2,
+    chunk_TraceRecordType  = 3,
+    end_TraceRecordType    = 4,
+};
+
+iDeclareType(TraceChunk)
+
+struct Impl_TraceChunk {
+    uint32_t time; /* milliseconds since the request was started */
+    size_t   end;  /* position in the response data */
+};
+
+iDeclareClass(TracedResponse)
+
+struct Impl_TracedResponse {
+    iObject  object;
+    uint32_t id;
+    iBool    isGopher;
+    iString  url;
+    iBlock   data; /* everything received */
+    iArray   chunks;
+    uint32_t finishTime;
+    int      certFlags;
+    enum iGmStatusCode failure; /* none_GmStatusCode unless the request failed */
+    iString  errorMessage;
+    iTracedResponse *next; /* the following response to the same URL */
+};
+
+void init_TracedResponse(iTracedResponse *d, uint32_t id, iBool isGopher) {
+    d->id       = id;
+    d->isGopher = isGopher;
+    init_String(&d->url);
+    init_Block(&d->data, 0);
+    init_Array(&d->chunks, sizeof(iTraceChunk));
+    d->finishTime = 0;
+    d->certFlags  = 0;
+    d->failure    = none_GmStatusCode;
+    init_String(&d->errorMessage);
+    d->next = NULL;
+}
+
+void deinit_TracedResponse(iTracedResponse *d) {
+    iRelease(d->next);
+    deinit_String(&d->errorMessage);
+    deinit_Array(&d->chunks);
+    deinit_Block(&d->data);
+    deinit_String(&d->url);
+}
+
+iDefineObjectConstructionArgs(TracedResponse, (uint32_t id, iBool isGopher), id, isGopher)
+iDefineClass(TracedResponse)
+
+/*----------------------------------------------------------------------------------------------*/
+
 enum iGmRequestState {
     initialized_GmRequestState,
     receivingHeader_GmRequestState,
@@ -127,10 +227,24 @@ struct Impl_GmRequest {
     iMutex *             mtx;
     iGmCerts *           certs; /* not owned */
     enum iGmRequestState state;
+    enum iGmRequestPriority priority;
     iString              url;
+    iString              host;
+    uint16_t             port;
     iTlsRequest *        req;
     iGopher              gopher;
     iGmResponse *        resp;
+    size_t               bodyCapacity; /* bytes reserved for the response body */
+    iGmRequestTiming     timing;
+    iBool                isDownloadEnabled;
+    iBool                isIdentityUsed;
+    iFile *              download; /* body is written here instead of memory */
+    size_t               downloadSize;
+    iFile *              localFile; /* file:// contents are read in chunks by `localReader` */
+    iThread *            localReader;
+    uint32_t             traceId; /* nonzero while the response is being recorded */
+    iTracedResponse *    replay; /* response comes from a network trace */
+    iThread *            replayer;
     iBool                respLocked;
     iAtomicInt           allowUpdate;
     iAudience *          updated;
@@ -141,9 +255,313 @@ iDefineObjectConstructionArgs(GmRequest, (iGmCerts *certs), certs)
 iDefineAudienceGetter(GmRequest, updated)
 iDefineAudienceGetter(GmRequest, finished)
 
+iDeclareType(GmRequestQueue)
+
+/* All Gemini requests share a queue that limits the number of simultaneous connections,
+   so background work like refreshing feeds doesn't slow down the page being opened. */
+struct Impl_GmRequestQueue {
+    iMutex *  mtx;
+    iPtrArray pending; /* in submission order */
+    iPtrArray active;
+    size_t    maxActivePerHost;
+    iBool     isTimingLogged;
+    iString   recentTimings[16]; /* ring buffer of finished requests */
+    size_t    recentPos;
+    iMutex *  traceMtx;
+    iFile *   traceOut; /* responses are recorded here */
+    uint32_t  lastTraceId;
+    iStringHash *replays; /* URL -> TracedResponse */
+    float     replaySpeed;
+};
+
+static iGmRequestQueue queue_;
+
+static const size_t maxActive_GmRequestQueue_        = 8;
+
+static void start_GmRequest_(iGmRequest *d);
+
+void init_GmRequestQueue(void) {
+    iGmRequestQueue *d = &queue_;
+    d->mtx = new_Mutex();
+    init_PtrArray(&d->pending);
+    init_PtrArray(&d->active);
+    d->maxActivePerHost = 2;
+    d->isTimingLogged = iFalse;
+    iForIndices(i, d->recentTimings) {
+        init_String(&d->recentTimings[i]);
+    }
+    d->recentPos = 0;
+    d->traceMtx    = new_Mutex();
+    d->traceOut    = NULL;
+    d->lastTraceId = 0;
+    d->replays     = NULL;
+    d->replaySpeed = 1.0f;
+}
+
+void deinit_GmRequestQueue(void) {
+    iGmRequestQueue *d = &queue_;
+    iRelease(d->traceOut);
+    iRelease(d->replays);
+    delete_Mutex(d->traceMtx);
+    iForIndices(i, d->recentTimings) {
+        deinit_String(&d->recentTimings[i]);
+    }
+    deinit_PtrArray(&d->active);
+    deinit_PtrArray(&d->pending);
+    delete_Mutex(d->mtx);
+}
+
+static iBool canStart_GmRequestQueue_(const iGmRequestQueue *d, const iGmRequest *req) {
+    if (req->priority == foreground_GmRequestPriority) {
+        return iTrue;
+    }
+    if (size_PtrArray(&d->active) >= maxActive_GmRequestQueue_) {
+        return iFalse;
+    }
+    size_t numSameHost = 0;
+    iConstForEach(PtrArray, i, &d->active) {
+        const iGmRequest *active = i.ptr;
+        if (req->priority >= background_GmRequestPriority &&
+            active->priority == foreground_GmRequestPriority) {
+            /* The user is navigating; background work waits. */
+            return iFalse;
+        }
+        if (equalCase_String(&active->host, &req->host)) {
+            numSameHost++;
+        }
+    }
+    return numSameHost < d->maxActivePerHost;
+}
+
+static void startPending_GmRequestQueue_(iGmRequestQueue *d) {
+    for (int prio = 0; prio < max_GmRequestPriority; prio++) {
+        for (size_t i = 0; i < size_PtrArray(&d->pending); ) {
+            iGmRequest *req = at_PtrArray(&d->pending, i);
+            if (req->priority == prio && canStart_GmRequestQueue_(d, req)) {
+                remove_PtrArray(&d->pending, i);
+                pushBack_PtrArray(&d->active, req);
+                start_GmRequest_(req);
+            }
+            else {
+                i++;
+            }
+        }
+    }
+}
+
+static void enqueue_GmRequestQueue_(iGmRequestQueue *d, iGmRequest *req) {
+    lock_Mutex(d->mtx);
+    pushBack_PtrArray(&d->pending, req);
+    startPending_GmRequestQueue_(d);
+    unlock_Mutex(d->mtx);
+}
+
+static iBool remove_GmRequestQueue_(iGmRequestQueue *d, iGmRequest *req) {
+    /* Returns true if the request was still waiting to be started. */
+    lock_Mutex(d->mtx);
+    const iBool wasPending = removeOne_PtrArray(&d->pending, req);
+    if (removeOne_PtrArray(&d->active, req)) {
+        startPending_GmRequestQueue_(d);
+    }
+    unlock_Mutex(d->mtx);
+    return wasPending;
+}
+
+static iTracedResponse *findTraced_(const iPtrArray *responses, uint32_t id) {
+    /* Recent responses are the likeliest to be still receiving. */
+    for (size_t i = size_PtrArray(responses); i > 0; i--) {
+        iTracedResponse *resp = at_PtrArray(responses, i - 1);
+        if (resp->id == id) {
+            return resp;
+        }
+    }
+    return NULL;
+}
+
+static iStringHash *loadTrace_GmRequestQueue_(const iString *path) {
+    iFile *f = iClob(new_File(path));
+    if (!open_File(f, readOnly_FileMode)) {
+        return NULL;
+    }
+    char magic[4];
+    readData_File(f, 4, magic);
+    if (memcmp(magic, magic_GmRequestTrace_, 4) || readU32_File(f) > version_GmRequestTrace_) {
+        return NULL;
+    }
+    iStringHash *replays   = new_StringHash();
+    iPtrArray *  responses = collectNew_PtrArray(); /* in the order they were started */
+    iString *    url       = collectNew_String();
+    iBlock *     data      = collect_Block(new_Block(0));
+    while (!atEnd_File(f)) {
+        const int      type = read32_Stream(stream_File(f));
+        const uint32_t id   = readU32_File(f);
+        const uint32_t time = readU32_File(f);
+        if (type == gemini_TraceRecordType || type == gopher_TraceRecordType) {
+            deserialize_String(url, stream_File(f));
+            iTracedResponse *resp =
+                iClob(new_TracedResponse(id, type == gopher_TraceRecordType));
+            set_String(&resp->url, url);
+            pushBack_PtrArray(responses, resp);
+        }
+        else if (type == chunk_TraceRecordType) {
+            deserialize_Block(data, stream_File(f));
+            iTracedResponse *resp = findTraced_(responses, id);
+            if (resp) {
+                append_Block(&resp->data, data);
+                pushBack_Array(&resp->chunks, &(iTraceChunk){ time, size_Block(&resp->data) });
+            }
+        }
+        else if (type == end_TraceRecordType) {
+            const int certFlags = read32_Stream(stream_File(f));
+            const int failure   = read32_Stream(stream_File(f));
+            deserialize_String(url, stream_File(f)); /* error message */
+            iTracedResponse *resp = findTraced_(responses, id);
+            if (resp) {
+                /* Only complete responses are replayed. */
+                resp->finishTime = time;
+                resp->certFlags  = certFlags;
+                resp->failure    = failure;
+                set_String(&resp->errorMessage, url);
+                iTracedResponse *prev = value_StringHash(replays, &resp->url);
+                if (!prev) {
+                    insert_StringHash(replays, &resp->url, resp);
+                }
+                else {
+                    while (prev->next) {
+                        prev = prev->next;
+                    }
+                    prev->next = ref_Object(resp);
+                }
+            }
+        }
+        else {
+            break; /* unknown record, possibly truncated */
+        }
+    }
+    return replays;
+}
+
+iBool setRecordTrace_GmRequestQueue(const iString *path) {
+    iGmRequestQueue *d = &queue_;
+    iBool ok = iTrue;
+    lock_Mutex(d->traceMtx);
+    iReleasePtr(&d->traceOut);
+    if (path) {
+        d->traceOut = new_File(path);
+        if (open_File(d->traceOut, writeOnly_FileMode)) {
+            writeData_File(d->traceOut, magic_GmRequestTrace_, 4);
+            writeU32_File(d->traceOut, version_GmRequestTrace_);
+        }
+        else {
+            iReleasePtr(&d->traceOut);
+            ok = iFalse;
+        }
+    }
+    unlock_Mutex(d->traceMtx);
+    return ok;
+}
+
+iBool setReplayTrace_GmRequestQueue(const iString *path, float speed) {
+    iGmRequestQueue *d = &queue_;
+    iStringHash *replays = path ? loadTrace_GmRequestQueue_(path) : NULL;
+    lock_Mutex(d->traceMtx);
+    iRelease(d->replays);
+    d->replays     = replays;
+    d->replaySpeed = iMax(0.0f, speed);
+    unlock_Mutex(d->traceMtx);
+    return replays != NULL || path == NULL;
+}
+
+const iStringList *tracedUrls_GmRequestQueue(void) {
+    iGmRequestQueue *d = &queue_;
+    iStringList *urls = iClob(new_StringList());
+    lock_Mutex(d->traceMtx);
+    if (d->replays) {
+        iConstForEach(StringHash, i, d->replays) {
+            pushBack_StringList(urls, key_StringHashConstIterator(&i));
+        }
+    }
+    unlock_Mutex(d->traceMtx);
+    return urls;
+}
+
+static iTracedResponse *takeReplay_GmRequestQueue_(iGmRequestQueue *d, const iString *url) {
+    /* Repeated requests get the recorded responses in order. The last one is replayed
+       again after that. */
+    iTracedResponse *replay = NULL;
+    lock_Mutex(d->traceMtx);
+    if (d->replays) {
+        iTracedResponse *first = value_StringHash(d->replays, url);
+        if (first) {
+            replay = ref_Object(first);
+            if (first->next) {
+                insert_StringHash(d->replays, url, first->next);
+            }
+        }
+    }
+    unlock_Mutex(d->traceMtx);
+    return replay;
+}
+
+static void writeTraceRecord_GmRequest_(const iGmRequest *d, enum iTraceRecordType type) {
+    /* Called while `traceMtx` is locked. */
+    iStream *outs = stream_File(queue_.traceOut);
+    write32_Stream(outs, type);
+    writeU32_Stream(outs, d->traceId);
+    writeU32_Stream(outs, SDL_GetTicks() - d->timing.started);
+}
+
+static void traceBegin_GmRequest_(iGmRequest *d, enum iTraceRecordType type) {
+    iGmRequestQueue *q = &queue_;
+    d->traceId = 0;
+    lock_Mutex(q->traceMtx);
+    if (q->traceOut) {
+        d->traceId = ++q->lastTraceId;
+        writeTraceRecord_GmRequest_(d, type);
+        serialize_String(&d->url, stream_File(q->traceOut));
+    }
+    unlock_Mutex(q->traceMtx);
+}
+
+static void traceChunk_GmRequest_(const iGmRequest *d, const iBlock *data) {
+    iGmRequestQueue *q = &queue_;
+    if (d->traceId && !isEmpty_Block(data)) {
+        lock_Mutex(q->traceMtx);
+        if (q->traceOut) {
+            writeTraceRecord_GmRequest_(d, chunk_TraceRecordType);
+            serialize_Block(data, stream_File(q->traceOut));
+        }
+        unlock_Mutex(q->traceMtx);
+    }
+}
+
+static void traceEnd_GmRequest_(iGmRequest *d) {
+    /* Called while the request is locked. */
+    iGmRequestQueue *q = &queue_;
+    if (d->traceId) {
+        const iBool isFailure = (d->state == failure_GmRequestState);
+        lock_Mutex(q->traceMtx);
+        if (q->traceOut) {
+            iStream *outs = stream_File(q->traceOut);
+            writeTraceRecord_GmRequest_(d, end_TraceRecordType);
+            write32_Stream(outs, d->resp->certFlags & ~haveFingerprint_GmCertFlag);
+            write32_Stream(outs, isFailure ? d->resp->statusCode : none_GmStatusCode);
+            serialize_String(isFailure ? &d->resp->meta : collectNew_String(), outs);
+        }
+        unlock_Mutex(q->traceMtx);
+        d->traceId = 0;
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
 static void checkServerCertificate_GmRequest_(iGmRequest *d) {
-    const iTlsCertificate *cert = serverCertificate_TlsRequest(d->req);
     iGmResponse *resp = d->resp;
+    if (d->replay) {
+        resp->certFlags = d->replay->certFlags; /* as it was when recorded */
+        return;
+    }
+    const iTlsCertificate *cert = serverCertificate_TlsRequest(d->req);
     resp->certFlags = 0;
     if (cert) {
         const iRangecc domain = range_String(hostName_Address(address_TlsRequest(d->req)));
@@ -164,13 +582,109 @@ static void checkServerCertificate_GmRequest_(iGmRequest *d) {
     }
 }
 
-static void readIncoming_GmRequest_(iGmRequest *d, iTlsRequest *req) {
+static const size_t minBodyCapacity_GmRequest_ = 64 * 1024;
+static const size_t localChunkSize_GmRequest_  = 256 * 1024;
+static const size_t maxLocalBodySize_GmRequest_ = 64 * 1024 * 1024; /* rest is not read */
+
+static void appendBody_GmRequest_(iGmRequest *d, const iBlock *data) {
+    iBlock *     body   = &d->resp->body;
+    const size_t needed = size_Block(body) + size_Block(data);
+    if (needed > d->bodyCapacity) {
+        /* Grow geometrically so large responses aren't reallocated and copied on every read. */
+        d->bodyCapacity = iMax(needed, iMax(2 * d->bodyCapacity, minBodyCapacity_GmRequest_));
+        reserve_Block(body, d->bodyCapacity);
+    }
+    append_Block(body, data);
+}
+
+void setMaxActivePerHost_GmRequestQueue(size_t maxActive) {
+    iGmRequestQueue *d = &queue_;
+    lock_Mutex(d->mtx);
+    d->maxActivePerHost = iClamp(maxActive, 1, maxActive_GmRequestQueue_);
+    startPending_GmRequestQueue_(d);
+    unlock_Mutex(d->mtx);
+}
+
+void setTimingLog_GmRequestQueue(iBool enable) {
+    queue_.isTimingLogged = enable;
+}
+
+const iString *recentTimings_GmRequestQueue(void) {
+    iGmRequestQueue *d = &queue_;
+    iString *list = collectNew_String();
+    const size_t count = iElemCount(d->recentTimings);
+    lock_Mutex(d->mtx);
+    for (size_t i = 0; i < count; i++) {
+        /* Newest first. */
+        const iString *entry = &d->recentTimings[(d->recentPos + count - 1 - i) % count];
+        if (!isEmpty_String(entry)) {
+            appendFormat_String(list, "* %s\n", cstr_String(entry));
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return list;
+}
+
+static void recordTiming_GmRequestQueue_(iGmRequestQueue *d, const iGmRequest *req) {
+    const iString *desc = describe_GmRequestTiming(&req->timing);
+    lock_Mutex(d->mtx);
+    iString *entry = &d->recentTimings[d->recentPos];
+    format_String(entry, "%s: %s", cstr_String(&req->url), cstr_String(desc));
+    d->recentPos = (d->recentPos + 1) % iElemCount(d->recentTimings);
+    if (d->isTimingLogged) {
+        printf("[timing] %s\n", cstr_String(entry));
+        fflush(stdout);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void notifyFinished_GmRequest_(iGmRequest *d) {
+    lock_Mutex(d->mtx);
+    d->timing.finished = SDL_GetTicks();
+    traceEnd_GmRequest_(d);
+    unlock_Mutex(d->mtx);
+    recordTiming_GmRequestQueue_(&queue_, d);
+    iNotifyAudience(d, finished, GmRequestFinished);
+}
+
+static iBool isRenderable_GmRequest_(const iString *mime) {
+    return startsWithCase_String(mime, "text/") || startsWithCase_String(mime, "image/") ||
+           startsWithCase_String(mime, "audio/");
+}
+
+static void beginDownload_GmRequest_(iGmRequest *d) {
+    iGmResponse *resp = d->resp;
+    iFile *      f    = new_File(downloadPathForUrl_App(&d->url, &resp->meta));
+    if (!open_File(f, writeOnly_FileMode)) {
+        iRelease(f); /* keep the body in memory instead */
+        return;
+    }
+    d->download     = f;
+    d->downloadSize = size_Block(&resp->body);
+    write_File(f, &resp->body);
+    clear_Block(&resp->body);
+}
+
+static void discardDownload_GmRequest_(iGmRequest *d) {
+    if (d->download) {
+        /* Don't leave a partial file behind. */
+        close_File(d->download);
+        remove(cstr_String(path_File(d->download)));
+        iReleasePtr(&d->download);
+    }
+}
+
+static void processIncoming_GmRequest_(iGmRequest *d, const iBlock *data) {
     iBool notifyUpdate = iFalse;
     iBool notifyDone   = iFalse;
     lock_Mutex(d->mtx);
     iGmResponse *resp =d->resp;
     iAssert(d->state != finished_GmRequestState); /* notifications out of order? */
-    iBlock *data = readAll_TlsRequest(req);
+    if (!d->timing.firstByte && !isEmpty_Block(data)) {
+        d->timing.firstByte = SDL_GetTicks();
+    }
+    traceChunk_GmRequest_(d, data);
+    d->timing.numBytes += size_Block(data);
     if (d->state == receivingHeader_GmRequestState) {
         appendCStrN_String(&resp->meta, constData_Block(data), size_Block(data));
         /* Check if the header line is complete. */
@@ -181,6 +695,7 @@ static void readIncoming_GmRequest_(iGmRequest *d, iTlsRequest *req) {
                           constBegin_String(&resp->meta) + endPos + 2,
                           size_String(&resp->meta) - endPos - 2);
             remove_Block(&resp->meta.chars, endPos, iInvalidSize);
+            d->timing.header = SDL_GetTicks();
             /* Parse and remove the code. */
             iRegExp *metaPattern = new_RegExp("^([0-9][0-9])(( )(.*))?", 0);
             /* TODO: Empty <META> means no <SPACE>? Not according to the spec? */
@@ -208,17 +723,26 @@ static void readIncoming_GmRequest_(iGmRequest *d, iTlsRequest *req) {
                 resp->statusCode = code;
                 d->state         = receivingBody_GmRequestState;
                 notifyUpdate     = iTrue;
+                if (d->isDownloadEnabled && code == success_GmStatusCode &&
+                    !isRenderable_GmRequest_(&resp->meta)) {
+                    beginDownload_GmRequest_(d);
+                }
             }
             checkServerCertificate_GmRequest_(d);
             iRelease(metaPattern);
         }
     }
     else if (d->state == receivingBody_GmRequestState) {
-        append_Block(&resp->body, data);
+        if (d->download) {
+            write_File(d->download, data);
+            d->downloadSize += size_Block(data);
+        }
+        else {
+            appendBody_GmRequest_(d, data);
+        }
         notifyUpdate = iTrue;
     }
     initCurrent_Time(&resp->when);
-    delete_Block(data);
     unlock_Mutex(d->mtx);
     if (notifyUpdate) {
         const iBool allowed = exchange_Atomic(&d->allowUpdate, iFalse);
@@ -227,10 +751,16 @@ static void readIncoming_GmRequest_(iGmRequest *d, iTlsRequest *req) {
         }
     }
     if (notifyDone) {
-        iNotifyAudience(d, finished, GmRequestFinished);
+        notifyFinished_GmRequest_(d);
     }
 }
 
+static void readIncoming_GmRequest_(iGmRequest *d, iTlsRequest *req) {
+    iBlock *data = readAll_TlsRequest(req);
+    processIncoming_GmRequest_(d, data);
+    delete_Block(data);
+}
+
 static void requestFinished_GmRequest_(iGmRequest *d, iTlsRequest *req) {
     iAssert(req == d->req);
     lock_Mutex(d->mtx);
@@ -245,13 +775,18 @@ static void requestFinished_GmRequest_(iGmRequest *d, iTlsRequest *req) {
     if (d->state == failure_GmRequestState) {
         d->resp->statusCode = tlsFailure_GmStatusCode;
         set_String(&d->resp->meta, errorMessage_TlsRequest(req));
+        discardDownload_GmRequest_(d);
+    }
+    else if (d->download) {
+        close_File(d->download);
     }
     checkServerCertificate_GmRequest_(d);
     unlock_Mutex(d->mtx);
-    iNotifyAudience(d, finished, GmRequestFinished);
+    remove_GmRequestQueue_(&queue_, d);
+    notifyFinished_GmRequest_(d);
 }
 
-static const iBlock *aboutPageSource_(iRangecc path) {
+static const iBlock *aboutPageSource_(iRangecc path, iRangecc query) {
     const iBlock *src = NULL;
     if (equalCase_Rangecc(path, "lagrange")) {
         return &blobLagrange_Embedded;
@@ -268,8 +803,16 @@ static const iBlock *aboutPageSource_(iRangecc path) {
     if (equalCase_Rangecc(path, "debug")) {
         return utf8_String(debugInfo_App());
     }
+    if (equalCase_Rangecc(path, "memory")) {
+        return utf8_String(memoryInfo_App());
+    }
     if (equalCase_Rangecc(path, "feeds")) {
-        return utf8_String(entryListPage_Feeds());
+        /* Pages are numbered from one in the URL: "about:feeds?page=2". */
+        size_t page = 1;
+        if (startsWith_Rangecc(query, "?page=")) {
+            page = iMax(1, strtoul(query.start + 6, NULL, 10));
+        }
+        return utf8_String(entryListPage_Feeds(page - 1));
     }
     if (equalCase_Rangecc(path, "blank")) {
         return utf8_String(collectNewCStr_String("\n"));
@@ -358,21 +901,166 @@ static const iBlock *replaceVariables_(const iBlock *block) {
     return block;
 }
 
-static void gopherRead_GmRequest_(iGmRequest *d, iSocket *socket) {
+static const char *mediaTypeFromPath_(const iString *path) {
+    if (endsWithCase_String(path, ".gmi") || endsWithCase_String(path, ".gemini")) {
+        return "text/gemini; charset=utf-8";
+    }
+    else if (endsWithCase_String(path, ".txt")) {
+        return "text/plain";
+    }
+    else if (endsWithCase_String(path, ".png")) {
+        return "image/png";
+    }
+    else if (endsWithCase_String(path, ".jpg") || endsWithCase_String(path, ".jpeg")) {
+        return "image/jpeg";
+    }
+    else if (endsWithCase_String(path, ".gif")) {
+        return "image/gif";
+    }
+    else if (endsWithCase_String(path, ".wav")) {
+        return "audio/wave";
+    }
+    else if (endsWithCase_String(path, ".ogg")) {
+        return "audio/ogg";
+    }
+    else if (endsWithCase_String(path, ".mp3")) {
+        return "audio/mpeg";
+    }
+    return NULL;
+}
+
+static iBool isUtf8Text_(const iBlock *data) {
+    const uint8_t *ch  = constData_Block(data);
+    const uint8_t *end = ch + size_Block(data);
+    while (ch < end) {
+        if (*ch < 0x80) {
+            /* Binary files usually have control characters that text doesn't. */
+            if (*ch < 0x20 && (*ch == 0 || !strchr("\t\n\v\f\r\x1b", *ch))) {
+                return iFalse;
+            }
+            ch++;
+            continue;
+        }
+        const size_t len = ((*ch & 0xe0) == 0xc0 ? 2 : (*ch & 0xf0) == 0xe0 ? 3
+                            : (*ch & 0xf8) == 0xf0 ? 4 : 0);
+        if (len == 0 || *ch == 0xc0 || *ch == 0xc1 || *ch > 0xf4) {
+            return iFalse;
+        }
+        for (size_t i = 1; i < len; i++) {
+            if (ch + i == end) {
+                return iTrue; /* only the beginning of the file was checked */
+            }
+            if ((ch[i] & 0xc0) != 0x80) {
+                return iFalse;
+            }
+        }
+        ch += len;
+    }
+    return iTrue;
+}
+
+static const char *sniffMediaType_(const iBlock *head) {
+    /* Detects the type of a file from its first bytes. */
+    const char * data = constData_Block(head);
+    const size_t size = size_Block(head);
+    if (size >= 8 && !memcmp(data, "\x89PNG\r\n\x1a\n", 8)) {
+        return "image/png";
+    }
+    if (size >= 3 && !memcmp(data, "\xff\xd8\xff", 3)) {
+        return "image/jpeg";
+    }
+    if (size >= 6 && (!memcmp(data, "GIF87a", 6) || !memcmp(data, "GIF89a", 6))) {
+        return "image/gif";
+    }
+    if (size >= 12 && !memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WAVE", 4)) {
+        return "audio/wave";
+    }
+    if (size >= 4 && !memcmp(data, "OggS", 4)) {
+        return "audio/ogg";
+    }
+    if (size >= 3 && (!memcmp(data, "ID3", 3) ||
+                      ((uint8_t) data[0] == 0xff && ((uint8_t) data[1] & 0xe6) == 0xe2))) {
+        return "audio/mpeg"; /* tag or Layer III frame sync */
+    }
+    if (isUtf8Text_(head)) {
+        return "text/plain; charset=utf-8";
+    }
+    return "application/octet-stream";
+}
+
+static void finishTruncatedLocalBody_GmRequest_(iGmRequest *d) {
+    /* Called while locked. The user is told about the missing part if it will be seen. */
+    if (startsWithCase_String(&d->resp->meta, "text/")) {
+        appendCStr_Block(&d->resp->body,
+                         format_CStr("\n\n(Only the first %zu MB of the file are shown.)\n",
+                                     maxLocalBodySize_GmRequest_ / (1024 * 1024)));
+    }
+}
+
+static iThreadResult readLocalFile_GmRequest_(iThread *thread) {
+    iGmRequest *d     = userData_Thread(thread);
+    iBlock *    chunk = new_Block(localChunkSize_GmRequest_);
+    for (;;) {
+        /* Only the reader appends to the body, so its size can be checked without locking. */
+        const size_t numLeft = maxLocalBodySize_GmRequest_ - size_Block(&d->resp->body);
+        resize_Block(chunk, iMin(localChunkSize_GmRequest_, numLeft));
+        truncate_Block(chunk, readData_File(d->localFile, size_Block(chunk), data_Block(chunk)));
+        lock_Mutex(d->mtx);
+        if (d->state != receivingBody_GmRequestState) {
+            unlock_Mutex(d->mtx); /* cancelled */
+            break;
+        }
+        appendBody_GmRequest_(d, chunk);
+        d->timing.numBytes += size_Block(chunk);
+        const iBool isTruncated = size_Block(&d->resp->body) == maxLocalBodySize_GmRequest_ &&
+                                  size_File(d->localFile) > maxLocalBodySize_GmRequest_;
+        const iBool isDone = size_Block(chunk) < localChunkSize_GmRequest_ || isTruncated;
+        if (isTruncated) {
+            finishTruncatedLocalBody_GmRequest_(d);
+        }
+        if (isDone) {
+            d->state = finished_GmRequestState;
+            initCurrent_Time(&d->resp->when);
+        }
+        unlock_Mutex(d->mtx);
+        if (isDone) {
+            notifyFinished_GmRequest_(d);
+            break;
+        }
+        if (exchange_Atomic(&d->allowUpdate, iFalse)) {
+            iNotifyAudience(d, updated, GmRequestUpdated);
+        }
+    }
+    delete_Block(chunk);
+    return 0;
+}
+
+static void processGopher_GmRequest_(iGmRequest *d, const iBlock *data) {
     iBool notifyUpdate = iFalse;
     lock_Mutex(d->mtx);
     d->resp->statusCode = success_GmStatusCode;
-    iBlock *data = readAll_Socket(socket);
+    if (!d->timing.firstByte && !isEmpty_Block(data)) {
+        d->timing.firstByte = d->timing.header = SDL_GetTicks(); /* Gopher has no header */
+    }
+    d->timing.numBytes += size_Block(data);
+    traceChunk_GmRequest_(d, data);
     if (!isEmpty_Block(data)) {
-        processResponse_Gopher(&d->gopher, data);
+        /* Menus are converted line by line, so the output grows only by complete lines
+           that can be laid out incrementally. */
+        notifyUpdate = processResponse_Gopher(&d->gopher, data);
     }
-    delete_Block(data);
     unlock_Mutex(d->mtx);
-    if (notifyUpdate) {
+    if (notifyUpdate && exchange_Atomic(&d->allowUpdate, iFalse)) {
         iNotifyAudience(d, updated, GmRequestUpdated);
     }
 }
 
+static void gopherRead_GmRequest_(iGmRequest *d, iSocket *socket) {
+    iBlock *data = readAll_Socket(socket);
+    processGopher_GmRequest_(d, data);
+    delete_Block(data);
+}
+
 static void gopherDisconnected_GmRequest_(iGmRequest *d, iSocket *socket) {
     iUnused(socket);
     iBool notify = iFalse;
@@ -383,7 +1071,7 @@ static void gopherDisconnected_GmRequest_(iGmRequest *d, iSocket *socket) {
     }
     unlock_Mutex(d->mtx);
     if (notify) {
-        iNotifyAudience(d, finished, GmRequestFinished);
+        notifyFinished_GmRequest_(d);
     }
 }
 
@@ -395,7 +1083,7 @@ static void gopherError_GmRequest_(iGmRequest *d, iSocket *socket, int error, co
     format_String(&d->resp->meta, "%s (errno %d)", msg, error);
     clear_Block(&d->resp->body);
     unlock_Mutex(d->mtx);
-    iNotifyAudience(d, finished, GmRequestFinished);
+    notifyFinished_GmRequest_(d);
 }
 
 static void beginGopherConnection_GmRequest_(iGmRequest *d, const iString *host, uint16_t port) {
@@ -408,16 +1096,120 @@ static void beginGopherConnection_GmRequest_(iGmRequest *d, const iString *host,
     d->gopher.output = &resp->body;
     d->state         = receivingBody_GmRequestState;
     d->gopher.socket = new_Socket(cstr_String(host), port);
+    d->timing.started = SDL_GetTicks();
     iConnect(Socket, d->gopher.socket, readyRead,    d, gopherRead_GmRequest_);
     iConnect(Socket, d->gopher.socket, disconnected, d, gopherDisconnected_GmRequest_);
     iConnect(Socket, d->gopher.socket, error,        d, gopherError_GmRequest_);
+    traceBegin_GmRequest_(d, gopher_TraceRecordType);
     open_Gopher(&d->gopher, &d->url);
     if (d->gopher.needQueryArgs) {
         resp->statusCode = input_GmStatusCode;
         setCStr_String(&resp->meta, "Enter query:");
+        d->state   = finished_GmRequestState;
+        d->traceId = 0; /* not a response from the server */
+        notifyFinished_GmRequest_(d);
+    }
+}
+
+static const uint32_t maxLockstepWait_GmRequest_ = 1000; /* milliseconds */
+
+static iBool isReceiving_GmRequest_(const iGmRequest *d) {
+    iBool receiving;
+    iGuardMutex(d->mtx,
+                receiving = (d->state == receivingHeader_GmRequestState ||
+                             d->state == receivingBody_GmRequestState));
+    return receiving;
+}
+
+static iBool waitForReplay_GmRequest_(iGmRequest *d, uint32_t recordedTime) {
+    /* Returns false if the request was cancelled meanwhile. With a speed of zero, the next
+       chunk is delivered as soon as the previous update has been handled, so each chunk is
+       seen separately regardless of how fast the consumer is. */
+    const float    speed = queue_.replaySpeed;
+    const uint32_t start = SDL_GetTicks();
+    for (;;) {
+        if (!isReceiving_GmRequest_(d)) {
+            return iFalse;
+        }
+        const uint32_t now = SDL_GetTicks();
+        if (speed <= 0.0f) {
+            if (value_Atomic(&d->allowUpdate) || now - start >= maxLockstepWait_GmRequest_) {
+                return iTrue;
+            }
+            SDL_Delay(1);
+            continue;
+        }
+        const uint32_t elapsed = now - d->timing.started;
+        const uint32_t due     = (uint32_t) (recordedTime / speed);
+        if (elapsed >= due) {
+            return iTrue;
+        }
+        SDL_Delay(iMin(due - elapsed, 10)); /* notice cancellation soon enough */
+    }
+}
+
+static iThreadResult replayTrace_GmRequest_(iThread *thread) {
+    iGmRequest *           d      = userData_Thread(thread);
+    const iTracedResponse *replay = d->replay;
+    iBlock *               chunk  = new_Block(0);
+    size_t                 pos    = 0;
+    iConstForEach(Array, i, &replay->chunks) {
+        const iTraceChunk *rec = i.value;
+        if (!waitForReplay_GmRequest_(d, rec->time)) {
+            break;
+        }
+        setData_Block(chunk, constData_Block(&replay->data) + pos, rec->end - pos);
+        pos = rec->end;
+        if (replay->isGopher) {
+            processGopher_GmRequest_(d, chunk);
+        }
+        else {
+            processIncoming_GmRequest_(d, chunk);
+        }
+    }
+    delete_Block(chunk);
+    if (!waitForReplay_GmRequest_(d, replay->finishTime)) {
+        return 0; /* cancelled, or an invalid header already finished it */
+    }
+    lock_Mutex(d->mtx);
+    initCurrent_Time(&d->resp->when);
+    if (replay->failure != none_GmStatusCode) {
+        d->state            = failure_GmRequestState;
+        d->resp->statusCode = replay->failure;
+        set_String(&d->resp->meta, &replay->errorMessage);
+        discardDownload_GmRequest_(d);
+    }
+    else {
         d->state = finished_GmRequestState;
-        iNotifyAudience(d, finished, GmRequestFinished);
+        if (d->download) {
+            close_File(d->download);
+        }
     }
+    unlock_Mutex(d->mtx);
+    notifyFinished_GmRequest_(d);
+    return 0;
+}
+
+static iBool beginReplay_GmRequest_(iGmRequest *d) {
+    d->replay = takeReplay_GmRequestQueue_(&queue_, &d->url);
+    if (!d->replay) {
+        return iFalse;
+    }
+    d->timing.started = SDL_GetTicks();
+    if (d->replay->isGopher) {
+        clear_Block(&d->gopher.source);
+        d->gopher.meta   = &d->resp->meta;
+        d->gopher.output = &d->resp->body;
+        open_Gopher(&d->gopher, &d->url); /* no socket; just the content type */
+        d->state = receivingBody_GmRequestState;
+    }
+    else {
+        d->state = receivingHeader_GmRequestState;
+    }
+    d->replayer = new_Thread(replayTrace_GmRequest_);
+    setUserData_Thread(d->replayer, d);
+    start_Thread(d->replayer);
+    return iTrue;
 }
 
 /*----------------------------------------------------------------------------------------------*/
@@ -426,8 +1218,22 @@ void init_GmRequest(iGmRequest *d, iGmCerts *certs) {
     d->mtx = new_Mutex();
     d->resp = new_GmResponse();
     d->respLocked = iFalse;
+    d->bodyCapacity = 0;
+    iZap(d->timing);
+    d->isDownloadEnabled = iFalse;
+    d->isIdentityUsed    = iFalse;
+    d->download     = NULL;
+    d->downloadSize = 0;
+    d->localFile    = NULL;
+    d->localReader  = NULL;
+    d->traceId      = 0;
+    d->replay       = NULL;
+    d->replayer     = NULL;
     set_Atomic(&d->allowUpdate, iTrue);
     init_String(&d->url);
+    init_String(&d->host);
+    d->port       = 0;
+    d->priority   = foreground_GmRequestPriority;
     init_Gopher(&d->gopher);
     d->certs      = certs;
     d->req        = NULL;
@@ -437,6 +1243,7 @@ void init_GmRequest(iGmRequest *d, iGmCerts *certs) {
 }
 
 void deinit_GmRequest(iGmRequest *d) {
+    remove_GmRequestQueue_(&queue_, d);
     if (d->req) {
         iDisconnectObject(TlsRequest, d->req, readyRead, d);
         iDisconnectObject(TlsRequest, d->req, finished, d);
@@ -450,13 +1257,25 @@ void deinit_GmRequest(iGmRequest *d) {
     else {
         unlock_Mutex(d->mtx);
     }
+    if (d->localReader) {
+        join_Thread(d->localReader);
+        iRelease(d->localReader);
+    }
+    if (d->replayer) {
+        join_Thread(d->replayer);
+        iRelease(d->replayer);
+    }
+    iRelease(d->replay);
+    iRelease(d->localFile);
     iReleasePtr(&d->req);
+    iRelease(d->download);
     deinit_Gopher(&d->gopher);
     delete_Audience(d->finished);
     delete_Audience(d->updated);
 //    delete_GmResponse(d->respPub);
 //    deinit_GmResponse(&d->respInt);
     delete_GmResponse(d->resp);
+    deinit_String(&d->host);
     deinit_String(&d->url);
     delete_Mutex(d->mtx);
 }
@@ -466,6 +1285,31 @@ void setUrl_GmRequest(iGmRequest *d, const iString *url) {
     urlEncodeSpaces_String(&d->url);
 }
 
+void enableDownload_GmRequest(iGmRequest *d) {
+    d->isDownloadEnabled = iTrue;
+}
+
+void setPriority_GmRequest(iGmRequest *d, enum iGmRequestPriority priority) {
+    d->priority = priority;
+}
+
+static void start_GmRequest_(iGmRequest *d) {
+    d->timing.started = SDL_GetTicks();
+    d->req = new_TlsRequest();
+    const iGmIdentity *identity = identityForUrl_GmCerts(d->certs, &d->url);
+    if (identity) {
+        setCertificate_TlsRequest(d->req, identity->cert);
+        d->isIdentityUsed = iTrue;
+    }
+    iConnect(TlsRequest, d->req, readyRead, d, readIncoming_GmRequest_);
+    iConnect(TlsRequest, d->req, finished, d, requestFinished_GmRequest_);
+    traceBegin_GmRequest_(d, gemini_TraceRecordType);
+    setUrl_TlsRequest(d->req, &d->host, d->port);
+    setContent_TlsRequest(d->req,
+                          utf8_String(collectNewFormat_String("%s\r\n", cstr_String(&d->url))));
+    submit_TlsRequest(d->req);
+}
+
 void submit_GmRequest(iGmRequest *d) {
     iAssert(d->state == initialized_GmRequestState);
     if (d->state != initialized_GmRequestState) {
@@ -474,6 +1318,9 @@ void submit_GmRequest(iGmRequest *d) {
     set_Atomic(&d->allowUpdate, iTrue);
     iGmResponse *resp = d->resp;
     clear_GmResponse(resp);
+    d->bodyCapacity = 0;
+    iZap(d->timing);
+    d->timing.submitted = SDL_GetTicks();
     iUrl url;
     init_Url(&url, &d->url);
     /* Check for special schemes. */
@@ -482,7 +1329,7 @@ void submit_GmRequest(iGmRequest *d) {
     const iString *host = collect_String(newRange_String(url.host));
     uint16_t       port = toInt_String(collect_String(newRange_String(url.port)));
     if (equalCase_Rangecc(url.scheme, "about")) {
-        const iBlock *src = aboutPageSource_(url.path);
+        const iBlock *src = aboutPageSource_(url.path, url.query);
         if (src) {
             resp->statusCode = success_GmStatusCode;
             setCStr_String(&resp->meta, "text/gemini; charset=utf-8");
@@ -494,46 +1341,38 @@ void submit_GmRequest(iGmRequest *d) {
             resp->statusCode = invalidLocalResource_GmStatusCode;
         }
         d->state = finished_GmRequestState;
-        iNotifyAudience(d, finished, GmRequestFinished);
+        notifyFinished_GmRequest_(d);
         return;
     }
     else if (equalCase_Rangecc(url.scheme, "file")) {
         iString *path = collect_String(urlDecode_String(collect_String(newRange_String(url.path))));
         iFile *  f    = new_File(path);
         if (open_File(f, readOnly_FileMode)) {
-            /* TODO: Check supported file types: images, audio */
-            /* TODO: Detect text files based on contents? E.g., is the content valid UTF-8. */
-            resp->statusCode = success_GmStatusCode;
-            if (endsWithCase_String(path, ".gmi") || endsWithCase_String(path, ".gemini")) {
-                setCStr_String(&resp->meta, "text/gemini; charset=utf-8");
-            }
-            else if (endsWithCase_String(path, ".txt")) {
-                setCStr_String(&resp->meta, "text/plain");
-            }
-            else if (endsWithCase_String(path, ".png")) {
-                setCStr_String(&resp->meta, "image/png");
-            }
-            else if (endsWithCase_String(path, ".jpg") || endsWithCase_String(path, ".jpeg")) {
-                setCStr_String(&resp->meta, "image/jpeg");
-            }
-            else if (endsWithCase_String(path, ".gif")) {
-                setCStr_String(&resp->meta, "image/gif");
-            }
-            else if (endsWithCase_String(path, ".wav")) {
-                setCStr_String(&resp->meta, "audio/wave");
-            }
-            else if (endsWithCase_String(path, ".ogg")) {
-                setCStr_String(&resp->meta, "audio/ogg");
-            }
-            else if (endsWithCase_String(path, ".mp3")) {
-                setCStr_String(&resp->meta, "audio/mpeg");
-            }
-            else {
-                setCStr_String(&resp->meta, "application/octet-stream");
-            }
-            set_Block(&resp->body, collect_Block(readAll_File(f)));
+            resp->statusCode  = success_GmStatusCode;
+            d->timing.started = SDL_GetTicks();
+            /* The body is reserved once, and the beginning is read right away for detecting
+               the content type. Files are only read up to a maximum size, so a huge log or
+               dataset doesn't have to fit in memory. */
+            d->bodyCapacity = iMin(size_File(f), maxLocalBodySize_GmRequest_);
+            reserve_Block(&resp->body, d->bodyCapacity);
+            resize_Block(&resp->body, localChunkSize_GmRequest_);
+            truncate_Block(&resp->body,
+                           readData_File(f, size_Block(&resp->body), data_Block(&resp->body)));
+            const char *mime = mediaTypeFromPath_(path);
+            setCStr_String(&resp->meta, mime ? mime : sniffMediaType_(&resp->body));
+            d->timing.firstByte = d->timing.header = SDL_GetTicks();
+            d->timing.numBytes  = size_Block(&resp->body);
             d->state = receivingBody_GmRequestState;
             iNotifyAudience(d, updated, GmRequestUpdated);
+            if (size_Block(&resp->body) == localChunkSize_GmRequest_) {
+                /* Large files are read in the background so the document can be laid out
+                   while the rest arrives. */
+                d->localFile   = f;
+                d->localReader = new_Thread(readLocalFile_GmRequest_);
+                setUserData_Thread(d->localReader, d);
+                start_Thread(d->localReader);
+                return;
+            }
         }
         else {
             resp->statusCode = failedToOpenFile_GmStatusCode;
@@ -541,7 +1380,7 @@ void submit_GmRequest(iGmRequest *d) {
         }
         iRelease(f);
         d->state = finished_GmRequestState;
-        iNotifyAudience(d, finished, GmRequestFinished);
+        notifyFinished_GmRequest_(d);
         return;
     }
     else if (equalCase_Rangecc(url.scheme, "data")) {
@@ -572,9 +1411,12 @@ void submit_GmRequest(iGmRequest *d) {
         d->state = receivingBody_GmRequestState;
         iNotifyAudience(d, updated, GmRequestUpdated);
         d->state = finished_GmRequestState;
-        iNotifyAudience(d, finished, GmRequestFinished);
+        notifyFinished_GmRequest_(d);
         return;
     }
+    else if (beginReplay_GmRequest_(d)) {
+        return; /* recorded response instead of the network */
+    }
     else if (schemeProxy_App(url.scheme)) {
         /* User has configured a proxy server for this scheme. */
         const iString *proxy = schemeProxy_App(url.scheme);
@@ -595,31 +1437,50 @@ void submit_GmRequest(iGmRequest *d) {
     else if (!equalCase_Rangecc(url.scheme, "gemini")) {
         resp->statusCode = unsupportedProtocol_GmStatusCode;
         d->state = finished_GmRequestState;
-        iNotifyAudience(d, finished, GmRequestFinished);
+        notifyFinished_GmRequest_(d);
         return;
     }
     d->state = receivingHeader_GmRequestState;
-    d->req = new_TlsRequest();
-    const iGmIdentity *identity = identityForUrl_GmCerts(d->certs, &d->url);
-    if (identity) {
-        setCertificate_TlsRequest(d->req, identity->cert);
-    }
-    iConnect(TlsRequest, d->req, readyRead, d, readIncoming_GmRequest_);
-    iConnect(TlsRequest, d->req, finished, d, requestFinished_GmRequest_);
     if (port == 0) {
         port = 1965; /* default Gemini port */
     }
-    setUrl_TlsRequest(d->req, host, port);
-    setContent_TlsRequest(d->req,
-                          utf8_String(collectNewFormat_String("%s\r\n", cstr_String(&d->url))));
-    submit_TlsRequest(d->req);
+    set_String(&d->host, host);
+    d->port = port;
+    enqueue_GmRequestQueue_(&queue_, d);
 }
 
 void cancel_GmRequest(iGmRequest *d) {
+    if (remove_GmRequestQueue_(&queue_, d)) {
+        /* Never started. */
+        lock_Mutex(d->mtx);
+        d->state            = failure_GmRequestState;
+        d->resp->statusCode = tlsFailure_GmStatusCode;
+        setCStr_String(&d->resp->meta, "Cancelled");
+        unlock_Mutex(d->mtx);
+        notifyFinished_GmRequest_(d);
+        return;
+    }
     if (d->req) {
         cancel_TlsRequest(d->req);
     }
     cancel_Gopher(&d->gopher);
+    iGuardMutex(d->mtx, discardDownload_GmRequest_(d));
+    if (d->localReader || d->replayer) {
+        /* The reader thread stops before the next chunk. */
+        iBool notify = iFalse;
+        lock_Mutex(d->mtx);
+        if (d->state == receivingHeader_GmRequestState ||
+            d->state == receivingBody_GmRequestState) {
+            d->state            = failure_GmRequestState;
+            d->resp->statusCode = tlsFailure_GmStatusCode;
+            setCStr_String(&d->resp->meta, "Cancelled");
+            notify = iTrue;
+        }
+        unlock_Mutex(d->mtx);
+        if (notify) {
+            notifyFinished_GmRequest_(d);
+        }
+    }
 }
 
 iGmResponse *lockResponse_GmRequest(iGmRequest *d) {
@@ -663,14 +1524,30 @@ const iBlock *body_GmRequest(const iGmRequest *d) {
 
 size_t bodySize_GmRequest(const iGmRequest *d) {
     size_t size;
-    iGuardMutex(d->mtx, size = size_Block(&d->resp->body));
+    iGuardMutex(d->mtx, size = d->download ? d->downloadSize : size_Block(&d->resp->body));
     return size;
 }
 
+iGmRequestTiming timing_GmRequest(const iGmRequest *d) {
+    iGmRequestTiming timing;
+    iGuardMutex(d->mtx, timing = d->timing);
+    return timing;
+}
+
+const iString *downloadPath_GmRequest(const iGmRequest *d) {
+    const iString *path = NULL;
+    iGuardMutex(d->mtx, if (d->download) { path = path_File(d->download); });
+    return path;
+}
+
 const iString *url_GmRequest(const iGmRequest *d) {
     return &d->url;
 }
 
+iBool isIdentityUsed_GmRequest(const iGmRequest *d) {
+    return d->isIdentityUsed;
+}
+
 int certFlags_GmRequest(const iGmRequest *d) {
     int flags;
     iGuardMutex(d->mtx, flags = d->resp->certFlags);
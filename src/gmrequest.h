@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #pragma once
 
 #include <the_Foundation/audience.h>
+#include <the_Foundation/stringlist.h>
 #include <the_Foundation/tlsrequest.h>
 
 #include "gmutil.h"
@@ -54,17 +55,44 @@ iDeclareTypeSerialization(GmResponse)
 
 iGmResponse *       copy_GmResponse             (const iGmResponse *);
 
+iDeclareType(GmRequestTiming)
+
+/* SDL ticks when each phase of a request was reached; zero if it wasn't. Name resolution,
+   connecting, and the TLS handshake all happen before the first byte. */
+struct Impl_GmRequestTiming {
+    uint32_t submitted;
+    uint32_t started;   /* left the request queue */
+    uint32_t firstByte;
+    uint32_t header;    /* response header complete */
+    uint32_t finished;
+    size_t   numBytes;  /* received in total */
+};
+
+const iString *     describe_GmRequestTiming    (const iGmRequestTiming *);
+
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareClass(GmRequest)
 iDeclareObjectConstructionArgs(GmRequest, iGmCerts *)
 
+/* Requests are started in priority order. Foreground requests start immediately, others
+   wait for a free connection. */
+enum iGmRequestPriority {
+    foreground_GmRequestPriority, /* page in the current tab */
+    media_GmRequestPriority,      /* inline media of a visible page */
+    background_GmRequestPriority, /* pages in background tabs */
+    feeds_GmRequestPriority,
+    max_GmRequestPriority
+};
+
 iDeclareNotifyFunc(GmRequest, Updated)
 iDeclareNotifyFunc(GmRequest, Finished)
 iDeclareAudienceGetter(GmRequest, updated)
 iDeclareAudienceGetter(GmRequest, finished)
 
 void                setUrl_GmRequest            (iGmRequest *, const iString *url);
+void                setPriority_GmRequest       (iGmRequest *, enum iGmRequestPriority priority);
+void                enableDownload_GmRequest    (iGmRequest *); /* save unrenderable bodies to Downloads */
 void                submit_GmRequest            (iGmRequest *);
 void                cancel_GmRequest            (iGmRequest *);
 
@@ -77,6 +105,30 @@ const iString *     meta_GmRequest              (const iGmRequest *);
 const iBlock  *     body_GmRequest              (const iGmRequest *);
 size_t              bodySize_GmRequest          (const iGmRequest *);
 const iString *     url_GmRequest               (const iGmRequest *);
+const iString *     downloadPath_GmRequest      (const iGmRequest *); /* NULL if kept in memory */
+iGmRequestTiming    timing_GmRequest            (const iGmRequest *);
 
 int                 certFlags_GmRequest         (const iGmRequest *);
+iBool               isIdentityUsed_GmRequest    (const iGmRequest *); /* client certificate sent */
 iDate               certExpirationDate_GmRequest(const iGmRequest *);
+
+/*----------------------------------------------------------------------------------------------*/
+
+void                init_GmRequestQueue         (void);
+void                deinit_GmRequestQueue       (void);
+
+/* Limits the number of simultaneous connections to one host (except foreground pages). */
+void                setMaxActivePerHost_GmRequestQueue  (size_t maxActive);
+void                setTimingLog_GmRequestQueue (iBool enable); /* print finished requests to stdout */
+const iString *     recentTimings_GmRequestQueue(void); /* Gemtext list, newest first */
+
+/**
+ * Network traces. When recording, the bytes of each Gemini and Gopher response are written
+ * to a file together with their arrival times. When replaying, requests to the recorded URLs
+ * are answered from the trace instead of the network. A `speed` of 1 keeps the original
+ * pace and 2 is twice as fast. Zero delivers each chunk as soon as the previous update has
+ * been handled. Passing NULL stops recording or replaying.
+ */
+iBool               setRecordTrace_GmRequestQueue   (const iString *path);
+iBool               setReplayTrace_GmRequestQueue   (const iString *path, float speed);
+const iStringList * tracedUrls_GmRequestQueue       (void); /* recorded URLs being replayed */
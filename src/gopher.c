@@ -66,10 +66,15 @@ static void setPre_Gopher_(iGopher *d, iBool pre) {
 }
 
 static iBool convertSource_Gopher_(iGopher *d) {
+    /* Complete lines are converted and appended to the output; only the incomplete last
+       line remains in the source buffer. */
     iBool    converted = iFalse;
     iRangecc body      = range_Block(&d->source);
-    iRegExp *pattern   = new_RegExp("(.)([^\t]*)\t([^\t]*)\t([^\t]*)\t([0-9]+)",
+    if (!d->menuPattern) {
+        d->menuPattern = new_RegExp("(.)([^\t]*)\t([^\t]*)\t([^\t]*)\t([0-9]+)",
                                     caseInsensitive_RegExpOption);
+    }
+    iRegExp *pattern = d->menuPattern;
     for (;;) {
         /* Find the end of the line. */
         iRangecc line = { body.start, body.start };
@@ -96,6 +101,7 @@ static iBool convertSource_Gopher_(iGopher *d) {
                     setPre_Gopher_(d, isPreformatted_(text));
                     appendData_Block(d->output, text.start, size_Range(&text));
                     appendCStr_Block(d->output, "\n");
+                    converted = iTrue;
                     break;
                 }
                 case '0':
@@ -118,6 +124,7 @@ static iBool convertSource_Gopher_(iGopher *d) {
                                   cstr_Rangecc(text));
                     appendData_Block(d->output, constBegin_String(buf), size_String(buf));
                     iEndCollect();
+                    converted = iTrue;
                     break;
                 }
                 default:
@@ -126,7 +133,6 @@ static iBool convertSource_Gopher_(iGopher *d) {
             delete_String(buf);
         }
     }
-    iRelease(pattern);
     remove_Block(&d->source, 0, body.start - constBegin_Block(&d->source));
     return converted;
 }
@@ -135,6 +141,7 @@ void init_Gopher(iGopher *d) {
     d->socket = NULL;
     d->type = 0;
     init_Block(&d->source, 0);
+    d->menuPattern = NULL;
     d->needQueryArgs = iFalse;
     d->isPre = iFalse;
     d->meta = NULL;
@@ -143,6 +150,7 @@ void init_Gopher(iGopher *d) {
 
 void deinit_Gopher(iGopher *d) {
     deinit_Block(&d->source);
+    iRelease(d->menuPattern);
     iReleasePtr(&d->socket);
 }
 
@@ -197,6 +205,9 @@ void open_Gopher(iGopher *d, const iString *url) {
             break;
     }
     d->isPre = iFalse;
+    if (!d->socket) {
+        return; /* response comes from a network trace */
+    }
     open_Socket(d->socket);
     writeData_Socket(d->socket, parts.path.start, size_Range(&parts.path));
     if (!isEmpty_Range(&parts.query)) {
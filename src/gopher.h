@@ -32,7 +32,8 @@ iDeclareType(Gopher)
 struct Impl_Gopher {
     iSocket *socket;
     char     type;
-    iBlock   source;
+    iBlock   source;      /* unconverted input: the incomplete last line of a menu */
+    iRegExp *menuPattern;
     iBool    isPre;
     iBool    needQueryArgs;
     iString *meta;
@@ -23,31 +23,104 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "history.h"
 #include "app.h"
 
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/stringset.h>
+#include <string.h>
 
 static const size_t maxStack_History_ = 50; /* back/forward navigable items */
+static const size_t maxCacheSize_History_ = 64 * 1024 * 1024; /* all tabs combined */
+
+/* The text index of a cached response is a bit set of hashed trigrams. A page can only match
+   a search if it has all the trigrams of the searched words, so most pages can be skipped
+   without running the regular expression on their contents. */
+
+#define numIndexBits_History_ 65536
+
+static uint32_t trigramBit_(uint8_t a, uint8_t b, uint8_t c) {
+    const uint32_t tri = ((uint32_t) a << 16) | ((uint32_t) b << 8) | c;
+    return (tri * 0x9e3779b1u) >> 16;
+}
+
+static uint8_t foldCase_(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a' : (uint8_t) ch;
+}
+
+static void addTrigrams_(uint32_t *bits, iRangecc text) {
+    /* Non-ASCII characters are not folded to lower case, so they are left out of the index;
+       otherwise case-insensitive searches could miss them. */
+    uint8_t win[3] = { 0, 0, 0 };
+    size_t  len    = 0;
+    for (const char *ch = text.start; ch != text.end; ch++) {
+        if ((uint8_t) *ch >= 0x80) {
+            len = 0;
+            continue;
+        }
+        win[0] = win[1];
+        win[1] = win[2];
+        win[2] = foldCase_(*ch);
+        if (++len >= 3) {
+            const uint32_t bit = trigramBit_(win[0], win[1], win[2]);
+            bits[bit / 32] |= 1u << (bit % 32);
+        }
+    }
+}
+
+static uint32_t *newTextIndex_(const iBlock *text) {
+    uint32_t *bits = calloc(numIndexBits_History_ / 32, sizeof(uint32_t));
+    addTrigrams_(bits, range_Block(text));
+    return bits;
+}
+
+static iBool mayContain_TextIndex_(const uint32_t *bits, const uint32_t *query) {
+    for (size_t i = 0; i < numIndexBits_History_ / 32; i++) {
+        if ((bits[i] & query[i]) != query[i]) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+static void setCachedResponse_RecentUrl_(iRecentUrl *d, iGmResponse *response) {
+    delete_GmResponse(d->cachedResponse);
+    free(d->textIndex);
+    d->cachedResponse = response;
+    d->textIndex = NULL;
+}
 
 void init_RecentUrl(iRecentUrl *d) {
     init_String(&d->url);
     d->normScrollY = 0;
     d->cachedResponse = NULL;
+    d->cacheUsed = 0;
+    d->textIndex = NULL;
 }
 
 void deinit_RecentUrl(iRecentUrl *d) {
     deinit_String(&d->url);
-    delete_GmResponse(d->cachedResponse);
+    setCachedResponse_RecentUrl_(d, NULL);
 }
 
 iDefineTypeConstruction(RecentUrl)
 
+static void initCopy_RecentUrl_(iRecentUrl *d, const iRecentUrl *other) {
+    initCopy_String(&d->url, &other->url);
+    d->normScrollY = other->normScrollY;
+    /* The response body is not duplicated: blocks are shared until modified. */
+    d->cachedResponse = other->cachedResponse ? copy_GmResponse(other->cachedResponse) : NULL;
+    d->cacheUsed = other->cacheUsed;
+    d->textIndex = NULL;
+    if (other->textIndex) {
+        d->textIndex = malloc(numIndexBits_History_ / 8);
+        memcpy(d->textIndex, other->textIndex, numIndexBits_History_ / 8);
+    }
+}
+
 iRecentUrl *copy_RecentUrl(const iRecentUrl *d) {
-    iRecentUrl *copy = new_RecentUrl();
-    set_String(&copy->url, &d->url);
-    copy->normScrollY = d->normScrollY;
-    copy->cachedResponse = d->cachedResponse ? copy_GmResponse(d->cachedResponse) : NULL;
+    iRecentUrl *copy = iMalloc(RecentUrl);
+    initCopy_RecentUrl_(copy, d);
     return copy;
 }
 
@@ -59,15 +132,185 @@ struct Impl_History {
     size_t recentPos; /* zero at the latest item */
 };
 
+/* Cached responses of all tabs share a memory budget. When it is exceeded, the least
+   recently used responses are dropped, regardless of which tab they belong to. The lock
+   order is always the global cache lock first, then the lock of an individual History. */
+
+static iMutex     cacheMutex_History_;
+static iPtrArray  allHistories_History_;
+static iAtomicInt cacheUseCounter_History_;
+static iBool      isCacheInitialized_History_;
+
+static void initCache_History_(void) {
+    /* Histories are created in the main thread, so the first one sets this up. */
+    if (!isCacheInitialized_History_) {
+        init_Mutex(&cacheMutex_History_);
+        init_PtrArray(&allHistories_History_);
+        isCacheInitialized_History_ = iTrue;
+    }
+}
+
+static uint32_t nextCacheUse_History_(void) {
+    /* No lock needed, so this can be called while a History is locked. */
+    return (uint32_t) add_Atomic(&cacheUseCounter_History_, 1) + 1;
+}
+
+iDeclareType(CachedEntry)
+
+struct Impl_CachedEntry {
+    iHistory *         history;
+    const iGmResponse *response;
+    const void *       bodyData; /* identifies shared bodies */
+    size_t             size;
+    uint32_t           used;
+};
+
+static int cmpUsed_CachedEntry_(const void *a, const void *b) {
+    const iCachedEntry *s = a, *t = b;
+    return iCmp(s->used, t->used);
+}
+
+static int cmpBody_CachedEntry_(const void *a, const void *b) {
+    const iCachedEntry *s = a, *t = b;
+    if (s->bodyData != t->bodyData) {
+        return (uintptr_t) s->bodyData < (uintptr_t) t->bodyData ? -1 : 1;
+    }
+    /* The most recently used reference to each body comes first. */
+    return -iCmp(s->used, t->used);
+}
+
+static size_t collectCache_History_(iArray *entries) {
+    /* Called with cacheMutex_History_ locked. Returns the total size of the cached bodies,
+       with shared bodies counted only once. */
+    iConstForEach(PtrArray, i, &allHistories_History_) {
+        iHistory *hist = i.ptr;
+        lock_Mutex(hist->mtx);
+        iConstForEach(Array, j, &hist->recent) {
+            const iRecentUrl *item = j.value;
+            if (item->cachedResponse && !isEmpty_Block(&item->cachedResponse->body)) {
+                const iBlock *body = &item->cachedResponse->body;
+                pushBack_Array(entries,
+                               &(iCachedEntry){ hist,
+                                                item->cachedResponse,
+                                                constData_Block(body),
+                                                size_Block(body),
+                                                item->cacheUsed });
+            }
+        }
+        unlock_Mutex(hist->mtx);
+    }
+    /* A body is only freed when its last reference is dropped, so each body is removed
+       from the accounting along with its most recently used reference. */
+    sort_Array(entries, cmpBody_CachedEntry_);
+    size_t total = 0;
+    const void *prevBody = NULL;
+    iForEach(Array, k, entries) {
+        iCachedEntry *entry = k.value;
+        if (entry->bodyData == prevBody) {
+            entry->size = 0;
+            continue;
+        }
+        prevBody = entry->bodyData;
+        total += entry->size;
+    }
+    sort_Array(entries, cmpUsed_CachedEntry_);
+    return total;
+}
+
+static iBool uncache_History_(iHistory *d, const iGmResponse *response) {
+    /* Called with cacheMutex_History_ locked. */
+    iBool found = iFalse;
+    lock_Mutex(d->mtx);
+    iForEach(Array, i, &d->recent) {
+        iRecentUrl *item = i.value;
+        if (item->cachedResponse == response) {
+            setCachedResponse_RecentUrl_(item, NULL);
+            found = iTrue;
+            break;
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return found;
+}
+
+static void enforceCacheBudget_History_(void) {
+    iArray entries;
+    init_Array(&entries, sizeof(iCachedEntry));
+    lock_Mutex(&cacheMutex_History_);
+    size_t total = collectCache_History_(&entries);
+    iConstForEach(Array, i, &entries) {
+        if (total <= maxCacheSize_History_) {
+            break;
+        }
+        const iCachedEntry *entry = i.value;
+        if (uncache_History_(entry->history, entry->response)) {
+            total -= entry->size;
+        }
+    }
+    unlock_Mutex(&cacheMutex_History_);
+    deinit_Array(&entries);
+}
+
+size_t cacheSize_History(void) {
+    if (!isCacheInitialized_History_) {
+        return 0;
+    }
+    iArray entries;
+    init_Array(&entries, sizeof(iCachedEntry));
+    size_t total;
+    iGuardMutex(&cacheMutex_History_, total = collectCache_History_(&entries));
+    deinit_Array(&entries);
+    return total;
+}
+
+size_t cachedBytes_History(const iHistory *d) {
+    size_t total = 0;
+    lock_Mutex(d->mtx);
+    iConstForEach(Array, i, &d->recent) {
+        const iRecentUrl *item = i.value;
+        if (item->cachedResponse) {
+            total += size_Block(&item->cachedResponse->body);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return total;
+}
+
+void purgeCachedResponses_History(iHistory *d) {
+    lock_Mutex(d->mtx);
+    const iRecentUrl *current = constMostRecentUrl_History(d);
+    iForEach(Array, i, &d->recent) {
+        iRecentUrl *item = i.value;
+        if (item != current) {
+            setCachedResponse_RecentUrl_(item, NULL);
+        }
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void purgeCache_History(void) {
+    if (!isCacheInitialized_History_) {
+        return;
+    }
+    lock_Mutex(&cacheMutex_History_);
+    iConstForEach(PtrArray, i, &allHistories_History_) {
+        purgeCachedResponses_History(i.ptr);
+    }
+    unlock_Mutex(&cacheMutex_History_);
+}
+
 iDefineTypeConstruction(History)
 
 void init_History(iHistory *d) {
     d->mtx = new_Mutex();
     init_Array(&d->recent, sizeof(iRecentUrl));
     d->recentPos = 0;
+    initCache_History_();
+    iGuardMutex(&cacheMutex_History_, pushBack_PtrArray(&allHistories_History_, d));
 }
 
 void deinit_History(iHistory *d) {
+    iGuardMutex(&cacheMutex_History_, removeOne_PtrArray(&allHistories_History_, d));
     iGuardMutex(d->mtx, {
         clear_History(d);
         deinit_Array(&d->recent);
@@ -76,10 +319,14 @@ void deinit_History(iHistory *d) {
 }
 
 iHistory *copy_History(const iHistory *d) {
-    lock_Mutex(d->mtx);
+    /* new_History() locks cacheMutex_History_, which is always locked before any
+       history's own mutex. */
     iHistory *copy = new_History();
+    lock_Mutex(d->mtx);
     iConstForEach(Array, i, &d->recent) {
-        pushBack_Array(&copy->recent, copy_RecentUrl(i.value));
+        iRecentUrl item;
+        initCopy_RecentUrl_(&item, i.value);
+        pushBack_Array(&copy->recent, &item);
     }
     copy->recentPos = d->recentPos;
     unlock_Mutex(d->mtx);
@@ -118,10 +365,12 @@ void deserialize_History(iHistory *d, iStream *ins) {
         if (read8_Stream(ins)) {
             item.cachedResponse = new_GmResponse();
             deserialize_GmResponse(item.cachedResponse, ins);
+            item.cacheUsed = nextCacheUse_History_();
         }
         pushBack_Array(&d->recent, &item);
     }
     unlock_Mutex(d->mtx);
+    enforceCacheBudget_History_();
 }
 
 void clear_History(iHistory *d) {
@@ -162,9 +411,13 @@ const iString *url_History(const iHistory *d, size_t pos) {
 iRecentUrl *findUrl_History(iHistory *d, const iString *url) {
     lock_Mutex(d->mtx);
     iReverseForEach(Array, i, &d->recent) {
-        if (cmpStringCase_String(url, &((iRecentUrl *) i.value)->url) == 0) {
+        iRecentUrl *item = i.value;
+        if (cmpStringCase_String(url, &item->url) == 0) {
+            if (item->cachedResponse) {
+                item->cacheUsed = nextCacheUse_History_();
+            }
             unlock_Mutex(d->mtx);
-            return i.value;
+            return item;
         }
     }
     unlock_Mutex(d->mtx);
@@ -244,27 +497,46 @@ void setCachedResponse_History(iHistory *d, const iGmResponse *response) {
     lock_Mutex(d->mtx);
     iRecentUrl *item = mostRecentUrl_History(d);
     if (item) {
-        delete_GmResponse(item->cachedResponse);
-        item->cachedResponse = NULL;
+        setCachedResponse_RecentUrl_(item, NULL);
         if (category_GmStatusCode(response->statusCode) == categorySuccess_GmStatusCode) {
             item->cachedResponse = copy_GmResponse(response);
+            item->cacheUsed = nextCacheUse_History_();
         }
     }
     unlock_Mutex(d->mtx);
+    enforceCacheBudget_History_();
 }
 
-const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pattern) {
+const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pattern,
+                                          const iStringList *words) {
     iStringArray *urls = iClob(new_StringArray());
+    uint32_t *query = NULL;
+    if (words) {
+        query = calloc(numIndexBits_History_ / 32, sizeof(uint32_t));
+        iConstForEach(StringList, w, words) {
+            addTrigrams_(query, range_String(w.value));
+        }
+    }
     lock_Mutex(d->mtx);
     iStringSet inserted;
     init_StringSet(&inserted);
-    iReverseConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
+    iReverseForEach(Array, i, &iConstCast(iHistory *, d)->recent) {
+        iRecentUrl *url = i.value;
         const iGmResponse *resp = url->cachedResponse;
         if (resp && category_GmStatusCode(resp->statusCode) == categorySuccess_GmStatusCode) {
             if (indexOfCStrSc_String(&resp->meta, "text/", &iCaseInsensitive) == iInvalidPos) {
                 continue;
             }
+            if (query) {
+                /* The index is built on the first search and kept until the response
+                   is dropped from the cache. */
+                if (!url->textIndex) {
+                    url->textIndex = newTextIndex_(&resp->body);
+                }
+                if (!mayContain_TextIndex_(url->textIndex, query)) {
+                    continue;
+                }
+            }
             iRegExpMatch m;
             init_RegExpMatch(&m);
             if (matchRange_RegExp(pattern, range_Block(&resp->body), &m)) {
@@ -301,5 +573,6 @@ const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pat
     }
     deinit_StringSet(&inserted);
     unlock_Mutex(d->mtx);
+    free(query);
     return urls;
 }
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/string.h>
 #include <the_Foundation/stringarray.h>
+#include <the_Foundation/stringlist.h>
 #include <the_Foundation/time.h>
 
 iDeclareType(RecentUrl)
@@ -37,6 +38,8 @@ struct Impl_RecentUrl {
     iString      url;
     float        normScrollY;    /* normalized to document height */
     iGmResponse *cachedResponse; /* kept in memory for quicker back navigation */
+    uint32_t     cacheUsed;      /* when cachedResponse was last set or used (LRU order) */
+    uint32_t *   textIndex;      /* trigrams of cachedResponse; built when first searched */
 };
 
 /*----------------------------------------------------------------------------------------------*/
@@ -57,7 +60,8 @@ iRecentUrl *recentUrl_History           (iHistory *, size_t pos);
 iRecentUrl *mostRecentUrl_History       (iHistory *);
 iRecentUrl *findUrl_History             (iHistory *, const iString *url);
 
-const iStringArray *   searchContents_History   (const iHistory *, const iRegExp *pattern); /* chronologically ascending */
+const iStringArray *   searchContents_History   (const iHistory *, const iRegExp *pattern,
+                                                 const iStringList *words); /* chronologically ascending */
 
 const iString *
             url_History                 (const iHistory *, size_t pos);
@@ -68,3 +72,8 @@ const iRecentUrl *
 const iGmResponse *
             cachedResponse_History      (const iHistory *);
 
+size_t      cacheSize_History           (void); /* total of all tabs, in bytes */
+size_t      cachedBytes_History         (const iHistory *); /* shared bodies counted in each */
+void        purgeCachedResponses_History(iHistory *); /* except the current page */
+void        purgeCache_History          (void); /* keeps only the current page of each tab */
+
@@ -0,0 +1,173 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "journal.h"
+
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/thread.h>
+
+static const size_t compactThreshold_Journal_ = 256 * 1024; /* bytes */
+
+struct Impl_Journal {
+    iMutex *            mtx;
+    iString             path;
+    size_t              size;
+    iJournalCompactFunc compact;
+    void *              context;
+    iThread *           compactor;
+};
+
+iJournal *new_Journal(const iString *path, iJournalCompactFunc compact, void *context) {
+    iJournal *d = iMalloc(Journal);
+    d->mtx = new_Mutex();
+    initCopy_String(&d->path, path);
+    d->size      = 0;
+    d->compact   = compact;
+    d->context   = context;
+    d->compactor = NULL;
+    iFile *f = new_File(&d->path);
+    if (open_File(f, readOnly_FileMode)) {
+        d->size = size_File(f);
+    }
+    iRelease(f);
+    return d;
+}
+
+void delete_Journal(iJournal *d) {
+    if (d) {
+        if (d->compactor) {
+            join_Thread(d->compactor);
+            iRelease(d->compactor);
+        }
+        deinit_String(&d->path);
+        delete_Mutex(d->mtx);
+        free(d);
+    }
+}
+
+/* Fields are separated by tabs. Backslashes, tabs, and newlines inside fields are escaped
+   so that each record stays on a single line. */
+
+static void appendEscaped_Journal_(iString *line, const iString *field) {
+    iConstForEach(String, i, field) {
+        switch (i.value) {
+            case '\\':
+                appendCStr_String(line, "\\\\");
+                break;
+            case '\t':
+                appendCStr_String(line, "\\t");
+                break;
+            case '\n':
+                appendCStr_String(line, "\\n");
+                break;
+            default:
+                appendChar_String(line, i.value);
+                break;
+        }
+    }
+}
+
+static void unescape_Journal_(iString *field, iRangecc range) {
+    clear_String(field);
+    for (const char *ch = range.start; ch < range.end; ch++) {
+        if (*ch == '\\' && ch + 1 < range.end) {
+            ch++;
+            appendData_Block(&field->chars, *ch == 't' ? "\t" : *ch == 'n' ? "\n" : ch, 1);
+        }
+        else {
+            appendData_Block(&field->chars, ch, 1);
+        }
+    }
+}
+
+void replay_Journal(const iJournal *d, iJournalRecordFunc func, void *context) {
+    iFile *f = new_File(&d->path);
+    if (open_File(f, readOnly_FileMode | text_FileMode)) {
+        const iRangecc src    = range_Block(collect_Block(readAll_File(f)));
+        iStringList *  fields = new_StringList();
+        iString *      field  = new_String();
+        iRangecc       line   = iNullRange;
+        while (nextSplit_Rangecc(src, "\n", &line)) {
+            if (isEmpty_Range(&line)) continue;
+            clear_StringList(fields);
+            iRangecc seg = iNullRange;
+            while (nextSplit_Rangecc(line, "\t", &seg)) {
+                unescape_Journal_(field, seg);
+                pushBack_StringList(fields, field);
+            }
+            func(context, fields);
+        }
+        delete_String(field);
+        iRelease(fields);
+    }
+    iRelease(f);
+}
+
+static iThreadResult compact_Journal_(iThread *thread) {
+    iJournal *d = userData_Thread(thread);
+    d->compact(d->context);
+    return 0;
+}
+
+void append_Journal(iJournal *d, const iStringList *fields) {
+    iString *line = new_String();
+    iConstForEach(StringList, i, fields) {
+        if (i.pos > 0) {
+            appendChar_String(line, '\t');
+        }
+        appendEscaped_Journal_(line, i.value);
+    }
+    appendChar_String(line, '\n');
+    iBool needCompact = iFalse;
+    lock_Mutex(d->mtx);
+    iFile *f = new_File(&d->path);
+    if (open_File(f, append_FileMode | text_FileMode)) {
+        write_File(f, &line->chars);
+        d->size += size_String(line);
+    }
+    iRelease(f); /* closing flushes the record to disk */
+    if (d->size >= compactThreshold_Journal_ && d->compact) {
+        if (d->compactor && isFinished_Thread(d->compactor)) {
+            join_Thread(d->compactor);
+            iReleasePtr(&d->compactor);
+        }
+        needCompact = (d->compactor == NULL);
+    }
+    if (needCompact) {
+        d->compactor = new_Thread(compact_Journal_);
+        setUserData_Thread(d->compactor, d);
+        start_Thread(d->compactor);
+    }
+    unlock_Mutex(d->mtx);
+    delete_String(line);
+}
+
+void clear_Journal(iJournal *d) {
+    lock_Mutex(d->mtx);
+    iFile *f = new_File(&d->path);
+    if (open_File(f, writeOnly_FileMode)) {
+        d->size = 0; /* truncated */
+    }
+    iRelease(f);
+    unlock_Mutex(d->mtx);
+}
@@ -0,0 +1,47 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/stringlist.h>
+
+/* A journal is an append-only log of changes made to a data store since its snapshot file
+   was last written. Each change is saved by appending a single record. Once the journal
+   grows large enough, the store's snapshot is rewritten in a background thread and the
+   journal is cleared. */
+
+iDeclareType(Journal)
+
+typedef void (*iJournalRecordFunc)  (void *context, const iStringList *fields);
+typedef void (*iJournalCompactFunc) (void *context);
+
+/**
+ * @param compact  Called in a background thread when the journal has grown large. It must
+ *                 write the store's snapshot and clear the journal while holding the
+ *                 store's lock.
+ */
+iJournal *  new_Journal         (const iString *path, iJournalCompactFunc compact, void *context);
+void        delete_Journal      (iJournal *);
+
+void        replay_Journal      (const iJournal *, iJournalRecordFunc func, void *context);
+void        append_Journal      (iJournal *, const iStringList *fields);
+void        clear_Journal       (iJournal *);
@@ -23,14 +23,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "media.h"
 #include "gmdocument.h"
 #include "gmrequest.h"
+#include "ui/profiler.h"
 #include "ui/window.h"
 #include "audio/player.h"
 #include "app.h"
 
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/ptrarray.h>
+#include <the_Foundation/stringhash.h>
+#include <the_Foundation/thread.h>
 #include <stb_image.h>
+#include <SDL_cpuinfo.h>
 #include <SDL_hints.h>
 #include <SDL_render.h>
+#include <limits.h>
+#include <string.h>
 
 iDeclareType(GmMediaProps)
 
@@ -52,55 +59,592 @@ static void deinit_GmMediaProps_(iGmMediaProps *d) {
 
 /*----------------------------------------------------------------------------------------------*/
 
-iDeclareType(GmImage)
+iDeclareType(ImageDecoder)
+iDeclareClass(ImageDecodeJob)
 
+/* Pixels of an image being decoded in a background thread. */
+struct Impl_ImageDecodeJob {
+    iObject    object;
+    iBlock     data;
+    iInt2      maxSize;     /* larger images are scaled down */
+    iInt2      size;        /* of the decoded pixels */
+    int        numChannels; /* 3 (RGB) or 4 (RGBA) */
+    iBlock     pixels;      /* valid after `isFinished` is set; empty if decoding failed */
+    iAtomicInt isFinished;
+    iAtomicInt isCancelled; /* the image was deleted, no need to decode */
+};
+
+void init_ImageDecodeJob(iImageDecodeJob *d, const iBlock *data, iInt2 maxSize) {
+    initCopy_Block(&d->data, data);
+    d->maxSize     = maxSize;
+    d->size        = zero_I2();
+    d->numChannels = 0;
+    init_Block(&d->pixels, 0);
+    set_Atomic(&d->isFinished, iFalse);
+    set_Atomic(&d->isCancelled, iFalse);
+}
+
+void deinit_ImageDecodeJob(iImageDecodeJob *d) {
+    deinit_Block(&d->pixels);
+    deinit_Block(&d->data);
+}
+
+iDefineObjectConstructionArgs(ImageDecodeJob, (const iBlock *data, iInt2 maxSize), data, maxSize)
+iDefineClass(ImageDecodeJob)
+
+static iBool isOpaque_(const uint8_t *rgba, size_t numPixels) {
+    for (size_t i = 0; i < numPixels; i++) {
+        if (rgba[4 * i + 3] != 0xff) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+static void downscale_(const uint8_t *src, iInt2 srcSize, uint8_t *dst, iInt2 dstSize,
+                       int numChannels) {
+    /* Box filter: each destination pixel is the average of the source pixels it covers.
+       Colors are weighted by alpha so transparent pixels don't darken the edges. */
+    for (int dy = 0; dy < dstSize.y; dy++) {
+        const int sy0 = (int) ((int64_t) dy * srcSize.y / dstSize.y);
+        const int sy1 = iMax(sy0 + 1, (int) ((int64_t) (dy + 1) * srcSize.y / dstSize.y));
+        for (int dx = 0; dx < dstSize.x; dx++) {
+            const int sx0 = (int) ((int64_t) dx * srcSize.x / dstSize.x);
+            const int sx1 = iMax(sx0 + 1, (int) ((int64_t) (dx + 1) * srcSize.x / dstSize.x));
+            uint64_t  sum[4] = { 0, 0, 0, 0 };
+            for (int sy = sy0; sy < sy1; sy++) {
+                const uint8_t *p = src + ((size_t) sy * srcSize.x + sx0) * numChannels;
+                for (int sx = sx0; sx < sx1; sx++, p += numChannels) {
+                    const uint32_t alpha = (numChannels == 4 ? p[3] : 0xff);
+                    sum[0] += p[0] * alpha;
+                    sum[1] += p[1] * alpha;
+                    sum[2] += p[2] * alpha;
+                    sum[3] += alpha;
+                }
+            }
+            uint8_t *out = dst + ((size_t) dy * dstSize.x + dx) * numChannels;
+            for (int c = 0; c < 3; c++) {
+                out[c] = sum[3] ? (uint8_t) (sum[c] / sum[3]) : 0;
+            }
+            if (numChannels == 4) {
+                out[3] = (uint8_t) (sum[3] / ((uint64_t) (sy1 - sy0) * (sx1 - sx0)));
+            }
+        }
+    }
+}
+
+static void decode_ImageDecodeJob_(iImageDecodeJob *d) {
+    const uint8_t *src = constData_Block(&d->data);
+    iInt2          size;
+    int            comp;
+    if (!stbi_info_from_memory(src, size_Block(&d->data), &size.x, &size.y, &comp)) {
+        return;
+    }
+    /* Grayscale images are expanded to RGB, and the alpha channel is only kept if some of
+       the pixels actually are transparent. */
+    int      numChannels = (comp == 2 || comp == 4 ? 4 : 3);
+    uint8_t *pixels =
+        stbi_load_from_memory(src, size_Block(&d->data), &size.x, &size.y, NULL, numChannels);
+    clear_Block(&d->data);
+    if (!pixels) {
+        return;
+    }
+    const size_t numPixels = (size_t) size.x * size.y;
+    if (numChannels == 4 && isOpaque_(pixels, numPixels)) {
+        for (size_t i = 0; i < numPixels; i++) {
+            memmove(pixels + 3 * i, pixels + 4 * i, 3);
+        }
+        numChannels = 3;
+    }
+    /* Images are not shown larger than the window, so there is no need to keep the full
+       resolution in texture memory. */
+    iInt2 scaled = size;
+    if (scaled.x > d->maxSize.x) {
+        scaled = init_I2(d->maxSize.x, (int) ((int64_t) size.y * d->maxSize.x / size.x));
+    }
+    if (scaled.y > d->maxSize.y) {
+        scaled = init_I2((int) ((int64_t) size.x * d->maxSize.y / size.y), d->maxSize.y);
+    }
+    scaled = max_I2(scaled, one_I2());
+    resize_Block(&d->pixels, (size_t) scaled.x * scaled.y * numChannels);
+    if (scaled.x == size.x && scaled.y == size.y) {
+        memcpy(data_Block(&d->pixels), pixels, size_Block(&d->pixels));
+    }
+    else {
+        downscale_(pixels, size, data_Block(&d->pixels), scaled, numChannels);
+    }
+    stbi_image_free(pixels);
+    d->size        = scaled;
+    d->numChannels = numChannels;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static const int maxThreads_ImageDecoder_ = 4;
+
+struct Impl_ImageDecoder {
+    iMutex *   mtx;
+    iCondition jobAvailable;
+    iBool      isStopping;
+    iPtrArray  threads;
+    iPtrArray  jobs; /* pending; referenced */
+};
+
+static iImageDecoder decoder_;
+
+static iThreadResult run_ImageDecoder_(iThread *thread) {
+    iImageDecoder *d = userData_Thread(thread);
+    for (;;) {
+        iImageDecodeJob *job = NULL;
+        lock_Mutex(d->mtx);
+        while (!d->isStopping && isEmpty_PtrArray(&d->jobs)) {
+            wait_Condition(&d->jobAvailable, d->mtx);
+        }
+        if (!d->isStopping) {
+            take_PtrArray(&d->jobs, 0, (void **) &job);
+        }
+        unlock_Mutex(d->mtx);
+        if (!job) {
+            break;
+        }
+        if (!value_Atomic(&job->isCancelled)) {
+            decode_ImageDecodeJob_(job);
+            set_Atomic(&job->isFinished, iTrue);
+            postCommand_App("media.decoded");
+        }
+        iRelease(job);
+    }
+    return 0;
+}
+
+void init_ImageDecoder(void) {
+    iImageDecoder *d = &decoder_;
+    d->mtx = new_Mutex();
+    init_Condition(&d->jobAvailable);
+    d->isStopping = iFalse;
+    init_PtrArray(&d->threads);
+    init_PtrArray(&d->jobs);
+    /* Leave some cores for the main thread and the layout and network threads. */
+    const int numThreads = iClamp(SDL_GetCPUCount() / 2, 1, maxThreads_ImageDecoder_);
+    for (int i = 0; i < numThreads; i++) {
+        iThread *thread = new_Thread(run_ImageDecoder_);
+        setUserData_Thread(thread, d);
+        pushBack_PtrArray(&d->threads, thread);
+        start_Thread(thread);
+    }
+}
+
+void deinit_ImageDecoder(void) {
+    iImageDecoder *d = &decoder_;
+    iGuardMutex(d->mtx, {
+        d->isStopping = iTrue;
+        broadcast_Condition(&d->jobAvailable);
+    });
+    iForEach(PtrArray, i, &d->threads) {
+        join_Thread(i.ptr);
+        iRelease(i.ptr);
+    }
+    deinit_PtrArray(&d->threads);
+    iForEach(PtrArray, j, &d->jobs) {
+        iRelease(j.ptr);
+    }
+    deinit_PtrArray(&d->jobs);
+    deinit_Condition(&d->jobAvailable);
+    delete_Mutex(d->mtx);
+}
+
+static void submit_ImageDecoder_(iImageDecoder *d, iImageDecodeJob *job) {
+    iGuardMutex(d->mtx, {
+        pushBack_PtrArray(&d->jobs, ref_Object(job));
+        signal_Condition(&d->jobAvailable);
+    });
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareClass(GmImage)
+
+/* Image content that may be shown on several pages at once. Complete images are shared
+   via the media cache by resolved URL. */
 struct Impl_GmImage {
-    iGmMediaProps props;
-    iBlock        partialData; /* cleared when image is converted to texture */
-    iInt2         size;
-    size_t        numBytes;
-    SDL_Texture * texture;
+    iObject           object;
+    iString           url;  /* empty if not in the cache */
+    iString           mime;
+    int               numUsers; /* pages showing the image */
+    iBool             isComplete; /* all data received; no longer modified */
+    iBlock            partialData; /* compressed source; kept for decoding again */
+    iInt2             size;
+    size_t            numBytes;
+    iInt2             decodedMaxSize;
+    size_t            previewBytes; /* amount of partial data decoded for a preview */
+    iBool             isDecodeFailed;
+    iImageDecodeJob * decoding; /* pixels are converted to a texture when finished */
+    SDL_Texture *     texture;
+    size_t            textureBytes;
+    unsigned int      textureVersion; /* incremented when a new texture is created */
+    uint32_t          lastDrawn; /* SDL ticks */
+    iGmImage *        prevTextured; /* more recently drawn */
+    iGmImage *        nextTextured; /* less recently drawn */
+    iGmImage *        prevReleased; /* more recently released by the last page */
+    iGmImage *        nextReleased;
 };
 
+/* All images that have a texture, in the order they were last drawn. When the textures
+   use more memory than the budget, the least recently drawn ones are released. They are
+   decoded again from the compressed source when they are needed. Only accessed in the
+   main thread. */
+static struct {
+    iGmImage *first;
+    iGmImage *last;
+    size_t    numBytes;
+} textured_;
+
+static const size_t   textureBudget_GmImage_ = 256 * 1024 * 1024; /* bytes */
+static const uint32_t minIdleTime_GmImage_   = 1000; /* ms; visible images are never released */
+static const size_t   previewMinBytes_GmImage_ = 32 * 1024;
+
+static void unlinkTextured_GmImage_(iGmImage *d) {
+    if (!d->texture) {
+        return;
+    }
+    if (d->prevTextured) {
+        d->prevTextured->nextTextured = d->nextTextured;
+    }
+    else {
+        textured_.first = d->nextTextured;
+    }
+    if (d->nextTextured) {
+        d->nextTextured->prevTextured = d->prevTextured;
+    }
+    else {
+        textured_.last = d->prevTextured;
+    }
+    d->prevTextured = d->nextTextured = NULL;
+}
+
+static void linkTextured_GmImage_(iGmImage *d) {
+    /* Becomes the most recently drawn one. */
+    d->prevTextured = NULL;
+    d->nextTextured = textured_.first;
+    if (textured_.first) {
+        textured_.first->prevTextured = d;
+    }
+    else {
+        textured_.last = d;
+    }
+    textured_.first = d;
+}
+
+static void releaseTexture_GmImage_(iGmImage *d) {
+    if (d->texture) {
+        unlinkTextured_GmImage_(d);
+        textured_.numBytes -= d->textureBytes;
+        SDL_DestroyTexture(d->texture);
+        d->texture      = NULL;
+        d->textureBytes = 0;
+    }
+}
+
+static void enforceTextureBudget_GmImage_(void) {
+    const uint32_t now = SDL_GetTicks();
+    while (textured_.numBytes > textureBudget_GmImage_ && textured_.last) {
+        iGmImage *oldest = textured_.last;
+        if (now - oldest->lastDrawn < minIdleTime_GmImage_) {
+            break; /* everything remaining is in use */
+        }
+        releaseTexture_GmImage_(oldest);
+    }
+}
+
 void init_GmImage(iGmImage *d, const iBlock *data) {
-    init_GmMediaProps_(&d->props);
+    init_String(&d->url);
+    init_String(&d->mime);
+    d->numUsers       = 0;
+    d->isComplete     = iFalse;
     initCopy_Block(&d->partialData, data);
-    d->size     = zero_I2();
-    d->numBytes = 0;
-    d->texture  = NULL;
+    d->size           = zero_I2();
+    d->numBytes       = 0;
+    d->decodedMaxSize = zero_I2();
+    d->previewBytes   = 0;
+    d->isDecodeFailed = iFalse;
+    d->decoding       = NULL;
+    d->texture        = NULL;
+    d->textureBytes   = 0;
+    d->textureVersion = 0;
+    d->lastDrawn      = 0;
+    d->prevTextured   = NULL;
+    d->nextTextured   = NULL;
+    d->prevReleased   = NULL;
+    d->nextReleased   = NULL;
+}
+
+static void cancelDecoding_GmImage_(iGmImage *d) {
+    if (d->decoding) {
+        set_Atomic(&d->decoding->isCancelled, iTrue);
+        iReleasePtr(&d->decoding);
+    }
 }
 
 void deinit_GmImage(iGmImage *d) {
+    cancelDecoding_GmImage_(d);
+    releaseTexture_GmImage_(d);
     deinit_Block(&d->partialData);
-    SDL_DestroyTexture(d->texture);
-    deinit_GmMediaProps_(&d->props);
+    deinit_String(&d->mime);
+    deinit_String(&d->url);
 }
 
-void makeTexture_GmImage(iGmImage *d) {
-    iBlock *data     = &d->partialData;
-    d->numBytes      = size_Block(data);
-    uint8_t *imgData = stbi_load_from_memory(
-        constData_Block(data), size_Block(data), &d->size.x, &d->size.y, NULL, 4);
-    if (!imgData) {
-        d->size    = zero_I2();
-        d->texture = NULL;
+static iBool readSize_GmImage_(iGmImage *d) {
+    int comp;
+    if (!stbi_info_from_memory(constData_Block(&d->partialData),
+                               size_Block(&d->partialData),
+                               &d->size.x,
+                               &d->size.y,
+                               &comp)) {
+        d->size = zero_I2();
+        return iFalse;
     }
-    else {
-        /* TODO: Save some memory by checking if the alpha channel is actually in use. */
-        /* TODO: Resize down to min(maximum texture size, window size). */
-        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
-            imgData, d->size.x, d->size.y, 32, d->size.x * 4, SDL_PIXELFORMAT_ABGR8888);
+    return iTrue;
+}
+
+static iInt2 maxDecodedSize_GmImage_(void) {
+    /* Rounded up so that small changes in window size don't cause decoding again. */
+    iWindow *        win  = get_Window();
+    const int        step = 256;
+    iInt2            size = init_I2((rootSize_Window(win).x + step - 1) / step * step, INT_MAX);
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer_Window(win), &info) == 0 && info.max_texture_width > 0) {
+        size = min_I2(size, init_I2(info.max_texture_width, info.max_texture_height));
+    }
+    return size;
+}
+
+void startDecoding_GmImage(iGmImage *d) {
+    iBlock *data = &d->partialData;
+    d->numBytes  = size_Block(data);
+    d->isDecodeFailed = iFalse;
+    cancelDecoding_GmImage_(d);
+    /* Only the header is read here, so the image can be laid out right away. The pixels
+       are decoded in a background thread and shown when ready. The previous texture, if
+       any, is shown until then. */
+    if (!readSize_GmImage_(d)) {
+        d->isDecodeFailed = iTrue;
+        clear_Block(data);
+        return;
+    }
+    d->decodedMaxSize = maxDecodedSize_GmImage_();
+    d->decoding       = new_ImageDecodeJob(data, d->decodedMaxSize);
+    submit_ImageDecoder_(&decoder_, d->decoding);
+}
+
+void updatePreview_GmImage(iGmImage *d) {
+    /* Called when more of the image has been received. Truncated JPEGs (both baseline and
+       progressive) decode into a partial image, so a preview can be shown while the rest
+       is still coming. PNGs can't be decoded partially, so those previews fail and only
+       the reserved space is shown. The amount of data must double between previews to
+       keep the number of decodes small. */
+    const size_t size = size_Block(&d->partialData);
+    d->numBytes = size;
+    if (d->decoding || d->isDecodeFailed ||
+        size < iMax(previewMinBytes_GmImage_, 2 * d->previewBytes)) {
+        return;
+    }
+    if (!d->size.x && !readSize_GmImage_(d)) {
+        return;
+    }
+    d->previewBytes   = size;
+    d->decodedMaxSize = maxDecodedSize_GmImage_();
+    d->decoding       = new_ImageDecodeJob(&d->partialData, d->decodedMaxSize);
+    submit_ImageDecoder_(&decoder_, d->decoding);
+}
+
+iBool rescale_GmImage(iGmImage *d) {
+    /* Decode again if a larger window would show more detail than the texture has. Images
+       without a texture are decoded at the right size when they are next drawn. */
+    if (!d->texture || d->decodedMaxSize.x == 0 ||
+        (d->size.x <= d->decodedMaxSize.x && d->size.y <= d->decodedMaxSize.y)) {
+        return iFalse; /* full resolution already */
+    }
+    const iInt2 maxSize = maxDecodedSize_GmImage_();
+    if (maxSize.x <= d->decodedMaxSize.x && maxSize.y <= d->decodedMaxSize.y) {
+        return iFalse;
+    }
+    startDecoding_GmImage(d);
+    return iTrue;
+}
+
+iBool finishDecoding_GmImage(iGmImage *d) {
+    if (!d->decoding || !value_Atomic(&d->decoding->isFinished)) {
+        return iFalse;
+    }
+    iImageDecodeJob *job = d->decoding;
+    if (!isEmpty_Block(&job->pixels)) {
+        const iBool  hasAlpha = (job->numChannels == 4);
+        SDL_Surface *surface  = SDL_CreateRGBSurfaceWithFormatFrom(
+            data_Block(&job->pixels),
+            job->size.x,
+            job->size.y,
+            8 * job->numChannels,
+            job->size.x * job->numChannels,
+            hasAlpha ? SDL_PIXELFORMAT_ABGR8888 : SDL_PIXELFORMAT_RGB24);
         /* TODO: In multiwindow case, all windows must have the same shared renderer?
            Or at least a shared context. */
+        iBeginProfile(imageTexture);
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"); /* linear scaling */
+        releaseTexture_GmImage_(d);
+        /* Opaque surfaces produce textures that are drawn without blending. */
         d->texture = SDL_CreateTextureFromSurface(renderer_Window(get_Window()), surface);
         SDL_FreeSurface(surface);
-        stbi_image_free(imgData);
+        iEndProfile(imageTexture);
+        if (d->texture) {
+            /* Renderers usually store textures with four bytes per pixel. */
+            d->textureBytes = (size_t) job->size.x * job->size.y * 4;
+            d->lastDrawn    = SDL_GetTicks();
+            d->textureVersion++;
+            textured_.numBytes += d->textureBytes;
+            linkTextured_GmImage_(d);
+            enforceTextureBudget_GmImage_();
+        }
+    }
+    else {
+        d->isDecodeFailed = iTrue;
     }
-    clear_Block(data);
+    iReleasePtr(&d->decoding);
+    return iTrue;
 }
 
-iDefineTypeConstructionArgs(GmImage, (const iBlock *data), data)
+SDL_Texture *texture_GmImage(iGmImage *d) {
+    if (d->texture) {
+        d->lastDrawn = SDL_GetTicks();
+        if (textured_.first != d) {
+            unlinkTextured_GmImage_(d);
+            linkTextured_GmImage_(d);
+        }
+    }
+    else if (!d->decoding && !d->isDecodeFailed && d->decodedMaxSize.x) {
+        /* The texture was released to save memory. "media.decoded" is posted when ready. */
+        startDecoding_GmImage(d);
+    }
+    return d->texture;
+}
+
+iDefineObjectConstructionArgs(GmImage, (const iBlock *data), data)
+iDefineClass(GmImage)
+
+/*----------------------------------------------------------------------------------------------*/
+
+/* Complete images by resolved URL, so the same image is downloaded and decoded only once
+   even if it appears on many pages. Images that no page is showing any more are kept in
+   a list of recently released ones, and forgotten in that order when the list exceeds its
+   budget. Only accessed in the main thread. */
+static struct {
+    iStringHash *images; /* URL -> GmImage */
+    iGmImage *   firstReleased; /* most recently released */
+    iGmImage *   lastReleased;
+    size_t       releasedBytes; /* compressed sizes of released images */
+} cache_;
+
+static const size_t releasedBudget_MediaCache_ = 32 * 1024 * 1024; /* bytes */
+
+void init_MediaCache(void) {
+    iZap(cache_);
+    cache_.images = new_StringHash();
+}
+
+void deinit_MediaCache(void) {
+    /* Images still shown on pages are deleted with the pages. */
+    iReleasePtr(&cache_.images);
+    iZap(cache_);
+}
+
+static void unlinkReleased_MediaCache_(iGmImage *img) {
+    if (img->prevReleased) {
+        img->prevReleased->nextReleased = img->nextReleased;
+    }
+    else {
+        cache_.firstReleased = img->nextReleased;
+    }
+    if (img->nextReleased) {
+        img->nextReleased->prevReleased = img->prevReleased;
+    }
+    else {
+        cache_.lastReleased = img->prevReleased;
+    }
+    img->prevReleased = img->nextReleased = NULL;
+    cache_.releasedBytes -= img->numBytes;
+}
+
+static void linkReleased_MediaCache_(iGmImage *img) {
+    img->prevReleased = NULL;
+    img->nextReleased = cache_.firstReleased;
+    if (cache_.firstReleased) {
+        cache_.firstReleased->prevReleased = img;
+    }
+    else {
+        cache_.lastReleased = img;
+    }
+    cache_.firstReleased = img;
+    cache_.releasedBytes += img->numBytes;
+    while (cache_.releasedBytes > releasedBudget_MediaCache_ && cache_.lastReleased) {
+        iGmImage *oldest = cache_.lastReleased;
+        unlinkReleased_MediaCache_(oldest);
+        remove_StringHash(cache_.images, &oldest->url); /* deleted */
+    }
+}
+
+static iGmImage *acquire_MediaCache_(const iString *url) {
+    if (!cache_.images || !url) {
+        return NULL;
+    }
+    iGmImage *img = value_StringHash(cache_.images, url);
+    if (img) {
+        if (img->numUsers++ == 0) {
+            unlinkReleased_MediaCache_(img);
+        }
+        ref_Object(img);
+    }
+    return img;
+}
+
+static void insert_MediaCache_(iGmImage *img, const iString *url) {
+    if (cache_.images && url && !isEmpty_String(url) && !img->isDecodeFailed &&
+        !value_StringHash(cache_.images, url)) {
+        set_String(&img->url, url);
+        insert_StringHash(cache_.images, url, img);
+    }
+}
+
+size_t numImages_MediaCache(void) {
+    return cache_.images ? size_StringHash(cache_.images) : 0;
+}
+
+size_t releasedBytes_MediaCache(void) {
+    return cache_.releasedBytes;
+}
+
+size_t textureBytes_MediaCache(void) {
+    return textured_.numBytes;
+}
+
+void purge_MediaCache(void) {
+    while (cache_.lastReleased) {
+        iGmImage *oldest = cache_.lastReleased;
+        unlinkReleased_MediaCache_(oldest);
+        remove_StringHash(cache_.images, &oldest->url); /* deleted */
+    }
+}
+
+void releaseTextures_MediaCache(void) {
+    while (textured_.last) {
+        releaseTexture_GmImage_(textured_.last);
+    }
+}
+
+static void releaseUser_GmImage_(iGmImage *d) {
+    if (--d->numUsers == 0 && cache_.images && !isEmpty_String(&d->url)) {
+        linkReleased_MediaCache_(d); /* may be deleted if the list is full */
+    }
+    iRelease(d);
+}
 
 /*----------------------------------------------------------------------------------------------*/
 
@@ -125,8 +669,36 @@ iDefineTypeConstruction(GmAudio)
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(MediaImage)
+
+/* An image link on a page. */
+struct Impl_MediaImage {
+    iGmMediaProps props;
+    iGmImage *    image; /* possibly shared with other pages */
+    unsigned int  textureVersion; /* last one seen by the page */
+};
+
+static iMediaImage *new_MediaImage_(iGmImage *img, iGmLinkId linkId, iBool isPermanent) {
+    iMediaImage *d = iMalloc(MediaImage);
+    init_GmMediaProps_(&d->props);
+    d->props.linkId      = linkId; /* TODO: use a hash? */
+    d->props.isPermanent = isPermanent;
+    set_String(&d->props.mime, &img->mime);
+    d->image          = img; /* reference taken by caller */
+    d->textureVersion = img->textureVersion;
+    return d;
+}
+
+static void delete_MediaImage_(iMediaImage *d) {
+    releaseUser_GmImage_(d->image);
+    deinit_GmMediaProps_(&d->props);
+    free(d);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
 struct Impl_Media {
-    iPtrArray images;
+    iPtrArray images; /* MediaImage */
     iPtrArray audio;   
 };
 
@@ -145,7 +717,7 @@ void deinit_Media(iMedia *d) {
 
 void clear_Media(iMedia *d) {
     iForEach(PtrArray, i, &d->images) {
-        deinit_GmImage(i.ptr);
+        delete_MediaImage_(i.ptr);
     }
     clear_PtrArray(&d->images);
     iForEach(PtrArray, a, &d->audio) {
@@ -154,25 +726,42 @@ void clear_Media(iMedia *d) {
     clear_PtrArray(&d->audio);
 }
 
-iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlock *data,
-                    int flags) {
+iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *url, const iString *mime,
+                    const iBlock *data, int flags) {
     const iBool isPartial  = (flags & partialData_MediaFlag) != 0;
     const iBool allowHide  = (flags & allowHide_MediaFlag) != 0;
     const iBool isDeleting = (!mime || !data);
     iMediaId    existing   = findLinkImage_Media(d, linkId);
     iBool       isNew      = iFalse;
     if (existing) {
-        iGmImage *img;
+        iMediaImage *mi;
         if (isDeleting) {
-            take_PtrArray(&d->images, existing - 1, (void **) &img);
-            delete_GmImage(img);
+            take_PtrArray(&d->images, existing - 1, (void **) &mi);
+            delete_MediaImage_(mi);
         }
         else {
-            img = at_PtrArray(&d->images, existing - 1);
-            iAssert(equal_String(&img->props.mime, mime)); /* MIME cannot change */
-            set_Block(&img->partialData, data);
-            if (!isPartial) {
-                makeTexture_GmImage(img);
+            mi = at_PtrArray(&d->images, existing - 1);
+            iAssert(equal_String(&mi->props.mime, mime)); /* MIME cannot change */
+            iGmImage *shared;
+            if (mi->image->isComplete) {
+                /* Shared images stay as they are. */
+            }
+            else if (!isPartial && (shared = acquire_MediaCache_(url)) != NULL) {
+                /* Another page finished receiving the same image first. */
+                releaseUser_GmImage_(mi->image);
+                mi->image = shared;
+            }
+            else {
+                iGmImage *img = mi->image;
+                set_Block(&img->partialData, data);
+                if (!isPartial) {
+                    img->isComplete = iTrue;
+                    startDecoding_GmImage(img);
+                    insert_MediaCache_(img, url);
+                }
+                else {
+                    updatePreview_GmImage(img);
+                }
             }
         }
     }
@@ -185,27 +774,37 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
         else {
             audio = at_PtrArray(&d->audio, existing - 1);
             iAssert(equal_String(&audio->props.mime, mime)); /* MIME cannot change */
-            updateSourceData_Player(audio->player, mime, data, append_PlayerUpdate);
+            updateSourceData_Player(
+                audio->player, mime, data, isPartial ? append_PlayerUpdate : complete_PlayerUpdate);
             if (!isStarted_Player(audio->player)) {
                 /* Maybe the previous updates didn't have enough data. */
                 start_Player(audio->player);
             }
-            if (!isPartial) {
-                updateSourceData_Player(audio->player, NULL, NULL, complete_PlayerUpdate);
-            }
         }
     }
     else if (!isDeleting) {
         if (startsWith_String(mime, "image/")) {
-            /* Copy the image to a texture. */
-            iGmImage *img = new_GmImage(data);
-            img->props.linkId = linkId; /* TODO: use a hash? */
-            img->props.isPermanent = !allowHide;
-            set_String(&img->props.mime, mime);
-            pushBack_PtrArray(&d->images, img);
-            if (!isPartial) {
-                makeTexture_GmImage(img);
+            iGmImage *img = acquire_MediaCache_(url);
+            if (!img) {
+                /* Decode the image and copy it to a texture. */
+                img = new_GmImage(data);
+                if (isPartial && !readSize_GmImage_(img)) {
+                    /* The image is added once its size is known, so it can be laid out. */
+                    iRelease(img);
+                    return iFalse;
+                }
+                set_String(&img->mime, mime);
+                img->numUsers = 1;
+                if (!isPartial) {
+                    img->isComplete = iTrue;
+                    startDecoding_GmImage(img);
+                    insert_MediaCache_(img, url);
+                }
+                else {
+                    updatePreview_GmImage(img);
+                }
             }
+            pushBack_PtrArray(&d->images, new_MediaImage_(img, linkId, !allowHide));
             isNew = iTrue;
         }
         else if (startsWith_String(mime, "audio/")) {
@@ -213,10 +812,8 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
             audio->props.linkId = linkId; /* TODO: use a hash? */
             audio->props.isPermanent = !allowHide;
             set_String(&audio->props.mime, mime);
-            updateSourceData_Player(audio->player, mime, data, replace_PlayerUpdate);
-            if (!isPartial) {
-                updateSourceData_Player(audio->player, NULL, NULL, complete_PlayerUpdate);
-            }
+            updateSourceData_Player(
+                audio->player, mime, data, isPartial ? replace_PlayerUpdate : complete_PlayerUpdate);
             pushBack_PtrArray(&d->audio, audio);
             /* Start playing right away. */
             start_Player(audio->player);
@@ -227,10 +824,76 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     return isNew;
 }
 
+iBool canShare_Media(const iMedia *d) {
+    if (!isEmpty_PtrArray(&d->audio)) {
+        return iFalse;
+    }
+    iConstForEach(PtrArray, i, &d->images) {
+        const iMediaImage *mi = i.ptr;
+        if (!mi->image->isComplete) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+void share_Media(iMedia *d, const iMedia *source) {
+    iAssert(canShare_Media(source));
+    clear_Media(d);
+    /* Image IDs stay the same, so the layout of the source page remains valid. */
+    iConstForEach(PtrArray, i, &source->images) {
+        const iMediaImage *mi  = i.ptr;
+        iGmImage *         img = mi->image;
+        img->numUsers++; /* the source page is still showing it */
+        ref_Object(img);
+        pushBack_PtrArray(&d->images,
+                          new_MediaImage_(img, mi->props.linkId, mi->props.isPermanent));
+    }
+}
+
+iBool setCachedData_Media(iMedia *d, iGmLinkId linkId, const iString *url, int flags) {
+    if (findLinkImage_Media(d, linkId)) {
+        return iFalse;
+    }
+    iGmImage *img = acquire_MediaCache_(url);
+    if (!img) {
+        return iFalse;
+    }
+    pushBack_PtrArray(&d->images,
+                      new_MediaImage_(img, linkId, (flags & allowHide_MediaFlag) == 0));
+    return iTrue;
+}
+
+iBool finishDecoding_Media(iMedia *d) {
+    iBool isChanged = iFalse;
+    iForEach(PtrArray, i, &d->images) {
+        iMediaImage *mi = i.ptr;
+        if (finishDecoding_GmImage(mi->image)) {
+            isChanged = iTrue;
+        }
+        /* The decoding of a shared image may have been finished via another page. */
+        if (mi->textureVersion != mi->image->textureVersion) {
+            mi->textureVersion = mi->image->textureVersion;
+            isChanged = iTrue;
+        }
+    }
+    return isChanged;
+}
+
+void rescaleImages_Media(iMedia *d) {
+    iForEach(PtrArray, i, &d->images) {
+        rescale_GmImage(((iMediaImage *) i.ptr)->image);
+    }
+}
+
+size_t numImages_Media(const iMedia *d) {
+    return size_PtrArray(&d->images);
+}
+
 iMediaId findLinkImage_Media(const iMedia *d, iGmLinkId linkId) {
     /* TODO: use a hash */
     iConstForEach(PtrArray, i, &d->images) {
-        const iGmImage *img = i.ptr;
+        const iMediaImage *img = i.ptr;
         if (img->props.linkId == linkId) {
             return index_PtrArrayConstIterator(&i) + 1;
         }
@@ -253,27 +916,37 @@ iMediaId findLinkAudio_Media(const iMedia *d, iGmLinkId linkId) {
     return 0;
 }
 
-SDL_Texture *imageTexture_Media(const iMedia *d, uint16_t imageId) {
+SDL_Texture *imageTexture_Media(iMedia *d, uint16_t imageId) {
     if (imageId > 0 && imageId <= size_PtrArray(&d->images)) {
-        const iGmImage *img = constAt_PtrArray(&d->images, imageId - 1);
-        return img->texture;
+        iMediaImage *mi = at_PtrArray(&d->images, imageId - 1);
+        return texture_GmImage(mi->image);
     }
     return NULL;
 }
 
 iBool imageInfo_Media(const iMedia *d, iMediaId imageId, iGmImageInfo *info_out) {
     if (imageId > 0 && imageId <= size_PtrArray(&d->images)) {
-        const iGmImage *img   = constAt_PtrArray(&d->images, imageId - 1);
-        info_out->size        = img->size;
-        info_out->numBytes    = img->numBytes;
-        info_out->mime        = cstr_String(&img->props.mime);
-        info_out->isPermanent = img->props.isPermanent;
+        const iMediaImage *mi = constAt_PtrArray(&d->images, imageId - 1);
+        info_out->size        = mi->image->size;
+        info_out->numBytes    = mi->image->numBytes;
+        info_out->mime        = cstr_String(&mi->props.mime);
+        info_out->isPermanent = mi->props.isPermanent;
         return iTrue;
     }
     iZap(*info_out);
     return iFalse;
 }
 
+const iBlock *imageData_Media(const iMedia *d, iMediaId imageId) {
+    if (imageId > 0 && imageId <= size_PtrArray(&d->images)) {
+        const iMediaImage *mi = constAt_PtrArray(&d->images, imageId - 1);
+        if (mi->image->isComplete) {
+            return &mi->image->partialData; /* the complete compressed source */
+        }
+    }
+    return NULL;
+}
+
 iPlayer *audioData_Media(const iMedia *d, iMediaId audioId) {
     if (audioId > 0 && audioId <= size_PtrArray(&d->audio)) {
         const iGmAudio *audio = constAt_PtrArray(&d->audio, audioId - 1);
@@ -301,6 +974,26 @@ iPlayer *audioPlayer_Media(const iMedia *d, iMediaId audioId) {
     return NULL;
 }
 
+void memoryUsage_Media(const iMedia *d, iMediaMemory *usage_out) {
+    iZap(*usage_out);
+    iConstForEach(PtrArray, i, &d->images) {
+        const iMediaImage *mi  = i.ptr;
+        const iGmImage *   img = mi->image;
+        usage_out->imageBytes += size_Block(&img->partialData);
+        usage_out->textureBytes += img->textureBytes;
+        if (img->decoding) {
+            usage_out->decodingBytes += size_Block(&img->decoding->data);
+            if (value_Atomic(&img->decoding->isFinished)) {
+                usage_out->decodingBytes += size_Block(&img->decoding->pixels);
+            }
+        }
+    }
+    iConstForEach(PtrArray, a, &d->audio) {
+        const iGmAudio *audio = a.ptr;
+        usage_out->audioBytes += memorySize_Player(audio->player);
+    }
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 static void updated_MediaRequest_(iAnyObject *obj) {
@@ -318,6 +1011,9 @@ void init_MediaRequest(iMediaRequest *d, iDocumentWidget *doc, unsigned int link
     d->linkId = linkId;
     d->req    = new_GmRequest(certs_App());
     setUrl_GmRequest(d->req, url);
+    setPriority_GmRequest(d->req,
+                          document_App() == doc ? media_GmRequestPriority
+                                                : background_GmRequestPriority);
     iConnect(GmRequest, d->req, updated, d, updated_MediaRequest_);
     iConnect(GmRequest, d->req, finished, d, finished_MediaRequest_);
     submit_GmRequest(d->req);
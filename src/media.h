@@ -32,6 +32,7 @@ typedef uint16_t iMediaId;
 iDeclareType(Player)
 iDeclareType(GmImageInfo)
 iDeclareType(GmAudioInfo)
+iDeclareType(MediaMemory)
 
 struct Impl_GmImageInfo {
     iInt2       size;
@@ -45,6 +46,14 @@ struct Impl_GmAudioInfo {
     iBool       isPermanent;
 };
 
+/* Images shared with other pages are included in the usage of each of them. */
+struct Impl_MediaMemory {
+    size_t imageBytes; /* compressed sources */
+    size_t decodingBytes; /* pixels waiting to become textures */
+    size_t textureBytes;
+    size_t audioBytes; /* downloaded data and decoded samples */
+};
+
 iDeclareType(Media)
 iDeclareTypeConstruction(Media)
 
@@ -54,17 +63,46 @@ enum iMediaFlags {
 };
 
 void    clear_Media     (iMedia *);
-iBool   setData_Media   (iMedia *, uint16_t linkId, const iString *mime, const iBlock *data, int flags);
-
+/* `url` is the resolved address of the content; NULL if it shouldn't be shared.
+   setCachedData_Media() shows an image from the media cache without any data. */
+iBool   setData_Media   (iMedia *, uint16_t linkId, const iString *url, const iString *mime,
+                         const iBlock *data, int flags);
+iBool   setCachedData_Media  (iMedia *, uint16_t linkId, const iString *url, int flags);
+iBool   finishDecoding_Media (iMedia *); /* returns iTrue if new image textures were created */
+void    rescaleImages_Media  (iMedia *); /* decodes downscaled images again if window grew */
+/* A copy of a page uses the same images. Pages with audio or incomplete images can't be
+   copied this way, because their players and downloads belong to one page. */
+iBool   canShare_Media       (const iMedia *);
+void    share_Media          (iMedia *, const iMedia *source);
+
+size_t          numImages_Media     (const iMedia *);
 iMediaId        findLinkImage_Media (const iMedia *, uint16_t linkId);
 iBool           imageInfo_Media     (const iMedia *, iMediaId imageId, iGmImageInfo *info_out);
-SDL_Texture *   imageTexture_Media  (const iMedia *, iMediaId imageId);
+const iBlock *  imageData_Media     (const iMedia *, iMediaId imageId); /* NULL if incomplete */
+SDL_Texture *   imageTexture_Media  (iMedia *, iMediaId imageId); /* may start decoding */
 
 size_t          numAudio_Media      (const iMedia *);
 iMediaId        findLinkAudio_Media (const iMedia *, uint16_t linkId);
 iBool           audioInfo_Media     (const iMedia *, iMediaId audioId, iGmAudioInfo *info_out);
 iPlayer *       audioPlayer_Media   (const iMedia *, iMediaId audioId);
 
+void            memoryUsage_Media   (const iMedia *, iMediaMemory *usage_out);
+
+
+/* Background threads that decode the pixels of downloaded images. Completed images are
+   announced with the "media.decoded" command. */
+void    init_ImageDecoder   (void);
+void    deinit_ImageDecoder (void);
+
+/* Complete images are shared by all pages via a cache keyed by resolved URL. */
+void    init_MediaCache     (void);
+void    deinit_MediaCache   (void);
+
+size_t  numImages_MediaCache    (void);
+size_t  releasedBytes_MediaCache(void); /* images that no page is showing */
+size_t  textureBytes_MediaCache (void); /* all image textures */
+void    purge_MediaCache        (void); /* forgets the released images */
+void    releaseTextures_MediaCache  (void); /* decoded again when next drawn */
 
 /*----------------------------------------------------------------------------------------------*/
 
@@ -30,9 +30,17 @@ void init_Prefs(iPrefs *d) {
     d->uiScale           = 1.0f; /* default set elsewhere */
     d->zoomPercent       = 100;
     d->sideIcon          = iTrue;
+    d->fastStart         = iFalse;
     d->hoverOutline      = iFalse;
     d->smoothScrolling   = iTrue;
     d->loadImageInsteadOfScrolling = iFalse;
+    d->prefetchLinks     = iFalse;
+    d->hibernateMinutes  = 30;
+    d->resamplerQuality  = 1; /* cubic */
+    d->decodeAheadMs     = 250;
+    d->maxFeedRequests   = 4;
+    d->maxMediaRequests  = 6;
+    d->maxRequestsPerHost = 2;
     d->font              = nunito_TextFont;
     d->headingFont       = nunito_TextFont;
     d->monospaceGemini   = iFalse;
@@ -42,15 +42,23 @@ struct Impl_Prefs {
     float            uiScale;
     int              zoomPercent;
     iBool            sideIcon;
+    iBool            fastStart; /* load history, identities, and feeds after showing the window */
     /* Behavior */
     iString          downloadDir;
     iBool            hoverOutline;
     iBool            smoothScrolling;
     iBool            loadImageInsteadOfScrolling;
+    iBool            prefetchLinks;
+    int              hibernateMinutes; /* idle background tabs are hibernated; zero for never */
+    int              resamplerQuality; /* enum iResamplerQuality */
+    int              decodeAheadMs; /* audio decoded ahead of playback */
     /* Network */
     iString          geminiProxy;
     iString          gopherProxy;
     iString          httpProxy;
+    int              maxFeedRequests; /* submitted at the same time when refreshing feeds */
+    int              maxMediaRequests; /* inline media fetched at the same time on a page */
+    int              maxRequestsPerHost; /* simultaneous connections to one host */
     /* Style */
     enum iTextFont   font;
     enum iTextFont   headingFont;
@@ -0,0 +1,327 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "responsecache.h"
+#include "defs.h"
+#include "saver.h"
+#include "app.h"
+
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/stringhash.h>
+#include <the_Foundation/time.h>
+#include <stdio.h>
+
+const size_t defaultBudget_ResponseCache = 64 * 1024 * 1024;
+
+static const char *cacheDir_ResponseCache_      = "cache";
+static const char *indexFilename_ResponseCache_ = "index.binary";
+static const char *magicIndex_ResponseCache_    = "lgRI";
+static const char *magicEntry_ResponseCache_    = "lgRC";
+
+iDeclareClass(CacheEntry)
+
+struct Impl_CacheEntry {
+    iObject object;
+    size_t  size; /* bytes on disk */
+    iTime   received;
+    iTime   lastUsed;
+};
+
+void init_CacheEntry(iCacheEntry *d, size_t size, const iTime *received) {
+    d->size     = size;
+    d->received = *received;
+    initCurrent_Time(&d->lastUsed);
+}
+
+void deinit_CacheEntry(iCacheEntry *d) {
+    iUnused(d);
+}
+
+iDefineObjectConstructionArgs(CacheEntry,
+                              (size_t size, const iTime *received),
+                              size, received)
+iDefineClass(CacheEntry)
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_ResponseCache {
+    iMutex *     mtx;
+    iString      dir;
+    iStringHash *entries; /* URL -> CacheEntry */
+    size_t       totalSize;
+    size_t       budget;
+};
+
+iDefineTypeConstructionArgs(ResponseCache, (const char *saveDir), saveDir)
+
+static const iString *entryPath_ResponseCache_(const iResponseCache *d, const iString *url) {
+    /* Entry files are named after a hash of the URL. The URL is also stored in the file
+       so collisions can be detected. */
+    uint64_t hash = 0xcbf29ce484222325ull; /* FNV-1a */
+    for (const char *ch = cstr_String(url); *ch; ch++) {
+        hash ^= (uint8_t) *ch;
+        hash *= 0x100000001b3ull;
+    }
+    return collectNewCStr_String(
+        concatPath_CStr(cstr_String(&d->dir),
+                        cstrFormat_String("%016llx.binary", (unsigned long long) hash)));
+}
+
+static void removeEntry_ResponseCache_(iResponseCache *d, const iString *url) {
+    const iCacheEntry *entry = value_StringHash(d->entries, url);
+    if (entry) {
+        d->totalSize -= entry->size;
+        /* Queued after any pending write of the same file. */
+        remove_Saver(saver_App(), entryPath_ResponseCache_(d, url));
+        remove_StringHash(d->entries, url);
+    }
+}
+
+static void evict_ResponseCache_(iResponseCache *d) {
+    while (d->totalSize > d->budget) {
+        /* Find the least recently used entry. */
+        const iString *    oldestUrl = NULL;
+        const iCacheEntry *oldest    = NULL;
+        iConstForEach(StringHash, i, d->entries) {
+            const iCacheEntry *entry = value_StringHashNode(i.value);
+            if (!oldest || cmp_Time(&entry->lastUsed, &oldest->lastUsed) < 0) {
+                oldest    = entry;
+                oldestUrl = key_StringHashConstIterator(&i);
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        iString *url = copy_String(oldestUrl);
+        removeEntry_ResponseCache_(d, url);
+        delete_String(url);
+    }
+}
+
+static void load_ResponseCache_(iResponseCache *d) {
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->dir, indexFilename_ResponseCache_)));
+    if (open_File(f, readOnly_FileMode)) {
+        char magic[4];
+        readData_File(f, 4, magic);
+        if (!memcmp(magic, magicIndex_ResponseCache_, 4) &&
+            readU32_File(f) <= latest_FileVersion) {
+            iString url;
+            init_String(&url);
+            while (!atEnd_File(f)) {
+                deserialize_String(&url, stream_File(f));
+                const size_t size = readU32_File(f);
+                iTime received, lastUsed;
+                iZap(received);
+                iZap(lastUsed);
+                received.ts.tv_sec = readU64_Stream(stream_File(f));
+                lastUsed.ts.tv_sec = readU64_Stream(stream_File(f));
+                iCacheEntry *entry = new_CacheEntry(size, &received);
+                entry->lastUsed    = lastUsed;
+                insert_StringHash(d->entries, &url, iClob(entry));
+                d->totalSize += size;
+            }
+            deinit_String(&url);
+        }
+    }
+    iRelease(f);
+}
+
+static void saveIndex_ResponseCache_(const iResponseCache *d) {
+    /* Called while locked. The index is written in the background after every change,
+       so it stays in sync with the entry files even if the app doesn't exit cleanly. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    writeData_Stream(outs, magicIndex_ResponseCache_, 4);
+    writeU32_Stream(outs, latest_FileVersion); /* version */
+    iConstForEach(StringHash, i, d->entries) {
+        const iCacheEntry *entry = value_StringHashNode(i.value);
+        serialize_String(key_StringHashConstIterator(&i), outs);
+        writeU32_Stream(outs, (uint32_t) entry->size);
+        writeU64_Stream(outs, entry->received.ts.tv_sec);
+        writeU64_Stream(outs, entry->lastUsed.ts.tv_sec);
+    }
+    save_Saver(saver_App(),
+               collect_String(concatCStr_Path(&d->dir, indexFilename_ResponseCache_)),
+               data_Buffer(buf));
+    iRelease(buf);
+}
+
+void save_ResponseCache(const iResponseCache *d) {
+    iGuardMutex(d->mtx, saveIndex_ResponseCache_(d));
+}
+
+void init_ResponseCache(iResponseCache *d, const char *saveDir) {
+    d->mtx = new_Mutex();
+    init_String(&d->dir);
+    set_String(&d->dir, collect_String(concatCStr_Path(collectNewCStr_String(saveDir),
+                                                       cacheDir_ResponseCache_)));
+    makeDirs_Path(&d->dir);
+    d->entries   = new_StringHash();
+    d->totalSize = 0;
+    d->budget    = defaultBudget_ResponseCache;
+    load_ResponseCache_(d);
+}
+
+void deinit_ResponseCache(iResponseCache *d) {
+    save_ResponseCache(d);
+    iGuardMutex(d->mtx, {
+        iRelease(d->entries);
+        deinit_String(&d->dir);
+    });
+    delete_Mutex(d->mtx);
+}
+
+void setBudget_ResponseCache(iResponseCache *d, size_t maxBytes) {
+    iGuardMutex(d->mtx, {
+        d->budget = maxBytes;
+        evict_ResponseCache_(d);
+        saveIndex_ResponseCache_(d);
+    });
+}
+
+void clear_ResponseCache(iResponseCache *d) {
+    iGuardMutex(d->mtx, {
+        const size_t budget = d->budget;
+        d->budget = 0;
+        evict_ResponseCache_(d);
+        d->budget = budget;
+        saveIndex_ResponseCache_(d);
+    });
+}
+
+void put_ResponseCache(iResponseCache *d, const iString *url, const iGmResponse *response) {
+    iUrl parts;
+    init_Url(&parts, url);
+    if (!isEmpty_Range(&parts.query)) {
+        return; /* the response depends on user input */
+    }
+    /* The entry is serialized without locking, and the saver writes it to disk. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    writeData_Stream(outs, magicEntry_ResponseCache_, 4);
+    writeU32_Stream(outs, latest_FileVersion); /* version */
+    serialize_String(url, outs);
+    serialize_GmResponse(response, outs);
+    const size_t size = size_Block(data_Buffer(buf));
+    lock_Mutex(d->mtx);
+    removeEntry_ResponseCache_(d, url);
+    if (size < d->budget) {
+        save_Saver(saver_App(), entryPath_ResponseCache_(d, url), data_Buffer(buf));
+        insert_StringHash(d->entries, url, iClob(new_CacheEntry(size, &response->when)));
+        d->totalSize += size;
+        evict_ResponseCache_(d);
+    }
+    saveIndex_ResponseCache_(d);
+    unlock_Mutex(d->mtx);
+    iRelease(buf);
+}
+
+iGmResponse *get_ResponseCache(iResponseCache *d, const iString *url, double maxAge) {
+    iGmResponse *resp = NULL;
+    lock_Mutex(d->mtx);
+    iCacheEntry *entry = value_StringHash(d->entries, url);
+    if (entry) {
+        iTime now;
+        initCurrent_Time(&now);
+        if (maxAge > 0 && secondsSince_Time(&now, &entry->received) > maxAge) {
+            unlock_Mutex(d->mtx);
+            return NULL; /* Too old, but may still be used with a longer maximum age. */
+        }
+        /* A recently put entry may still be waiting to be written. */
+        const iString *path    = entryPath_ResponseCache_(d, url);
+        iBlock *       pending = pendingData_Saver(saver_App(), path);
+        iStream *      ins     = NULL;
+        iBuffer *      buf     = NULL;
+        iFile *        f       = NULL;
+        if (pending) {
+            buf = new_Buffer();
+            open_Buffer(buf, pending);
+            ins = stream_Buffer(buf);
+        }
+        else {
+            f = new_File(path);
+            if (open_File(f, readOnly_FileMode)) {
+                ins = stream_File(f);
+            }
+        }
+        if (ins) {
+            char magic[4];
+            readData_Stream(ins, 4, magic);
+            const uint32_t version = readU32_Stream(ins);
+            if (!memcmp(magic, magicEntry_ResponseCache_, 4) && version <= latest_FileVersion) {
+                setVersion_Stream(ins, version);
+                iString fileUrl;
+                init_String(&fileUrl);
+                deserialize_String(&fileUrl, ins);
+                if (equal_String(&fileUrl, url)) {
+                    resp = new_GmResponse();
+                    deserialize_GmResponse(resp, ins);
+                    entry->lastUsed = now;
+                }
+                deinit_String(&fileUrl);
+            }
+        }
+        iRelease(f);
+        iRelease(buf);
+        if (pending) {
+            delete_Block(pending);
+        }
+        if (!resp) {
+            /* Missing or unreadable file. */
+            removeEntry_ResponseCache_(d, url);
+            saveIndex_ResponseCache_(d);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return resp;
+}
+
+void remove_ResponseCache(iResponseCache *d, const iString *url) {
+    iGuardMutex(d->mtx, {
+        removeEntry_ResponseCache_(d, url);
+        saveIndex_ResponseCache_(d);
+    });
+}
+
+double age_ResponseCache(const iResponseCache *d, const iString *url) {
+    double age = -1.0;
+    lock_Mutex(d->mtx);
+    const iCacheEntry *entry = constValue_StringHash(d->entries, url);
+    if (entry) {
+        iTime now;
+        initCurrent_Time(&now);
+        age = iMax(0.0, secondsSince_Time(&now, &entry->received));
+    }
+    unlock_Mutex(d->mtx);
+    return age;
+}
+
+size_t size_ResponseCache(const iResponseCache *d) {
+    size_t size;
+    iGuardMutex(d->mtx, size = d->totalSize);
+    return size;
+}
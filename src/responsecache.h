@@ -0,0 +1,57 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include "gmrequest.h"
+
+#include <the_Foundation/string.h>
+
+iDeclareType(ResponseCache)
+iDeclareTypeConstructionArgs(ResponseCache, const char *saveDir)
+
+extern const size_t defaultBudget_ResponseCache; /* bytes */
+
+void            setBudget_ResponseCache (iResponseCache *, size_t maxBytes);
+void            save_ResponseCache      (const iResponseCache *);
+void            clear_ResponseCache     (iResponseCache *);
+
+/**
+ * Stores a response on disk. An existing entry for the same URL is replaced. If the cache
+ * then exceeds its budget, the least recently used entries are removed. The file is written
+ * by the app's saver in the background. URLs with a query are not cached, and neither
+ * should be responses to requests made with a client certificate.
+ */
+void            put_ResponseCache       (iResponseCache *, const iString *url, const iGmResponse *response);
+
+/**
+ * Reads a cached response from disk.
+ *
+ * @param maxAge  Maximum age of the cached response in seconds. Zero means any age.
+ *
+ * @returns New response object (caller gets ownership), or NULL if the URL is not cached.
+ */
+iGmResponse *   get_ResponseCache       (iResponseCache *, const iString *url, double maxAge);
+
+void            remove_ResponseCache    (iResponseCache *, const iString *url);
+double          age_ResponseCache       (const iResponseCache *, const iString *url); /* seconds; negative if not cached */
+size_t          size_ResponseCache      (const iResponseCache *); /* bytes on disk */
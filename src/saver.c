@@ -0,0 +1,229 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "saver.h"
+
+#include <the_Foundation/file.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/thread.h>
+#include <stdio.h>
+
+iDeclareType(SaveJob)
+
+struct Impl_SaveJob {
+    iString path;
+    iBlock  data;
+    iBool   isRemoval;
+};
+
+static iSaveJob *new_SaveJob_(const iString *path, const iBlock *data) {
+    iSaveJob *d = iMalloc(SaveJob);
+    initCopy_String(&d->path, path);
+    if (data) {
+        initCopy_Block(&d->data, data); /* shared until modified */
+    }
+    else {
+        init_Block(&d->data, 0);
+    }
+    d->isRemoval = (data == NULL);
+    return d;
+}
+
+static void delete_SaveJob_(iSaveJob *d) {
+    deinit_String(&d->path);
+    deinit_Block(&d->data);
+    free(d);
+}
+
+struct Impl_Saver {
+    iMutex *   mtx;
+    iThread *  thread;
+    iCondition jobAvailable; /* wakes up the thread */
+    iCondition finished;     /* signaled when the pending jobs have been written */
+    iPtrArray  pending;      /* SaveJob pointers, at most one for each path */
+    iPtrArray  writing;      /* jobs taken by the thread */
+    iBool      isBusy;       /* thread is writing */
+    iBool      isQuitting;
+};
+
+iDefineTypeConstruction(Saver)
+
+iBool writeAtomically_Saver(const iString *path, const iBlock *data) {
+    iString *tmpPath = newFormat_String("%s.tmp", cstr_String(path));
+    iFile *  f       = new_File(tmpPath);
+    iBool    ok      = iFalse;
+    if (open_File(f, writeOnly_FileMode)) {
+        ok = (write_File(f, data) == size_Block(data));
+        close_File(f);
+    }
+    iRelease(f);
+    if (ok) {
+#if defined (iPlatformMsys)
+        remove(cstr_String(path)); /* rename() doesn't replace existing files */
+#endif
+        ok = (rename(cstr_String(tmpPath), cstr_String(path)) == 0);
+    }
+    if (!ok) {
+        fprintf(stderr, "[Saver] failed to write %s\n", cstr_String(path));
+        remove(cstr_String(tmpPath));
+    }
+    delete_String(tmpPath);
+    return ok;
+}
+
+static iThreadResult run_Saver_(iThread *thread) {
+    iSaver *d = userData_Thread(thread);
+    lock_Mutex(d->mtx);
+    for (;;) {
+        while (isEmpty_PtrArray(&d->pending) && !d->isQuitting) {
+            wait_Condition(&d->jobAvailable, d->mtx);
+        }
+        if (isEmpty_PtrArray(&d->pending)) {
+            break; /* quitting, and everything has been written */
+        }
+        /* Take the pending jobs so more can be queued while writing. */
+        iConstForEach(PtrArray, i, &d->pending) {
+            pushBack_PtrArray(&d->writing, i.ptr);
+        }
+        clear_PtrArray(&d->pending);
+        d->isBusy = iTrue;
+        unlock_Mutex(d->mtx);
+        /* The jobs are not modified while being written, only looked up. */
+        iConstForEach(PtrArray, i, &d->writing) {
+            const iSaveJob *job = i.ptr;
+            if (job->isRemoval) {
+                remove(cstr_String(&job->path));
+            }
+            else {
+                writeAtomically_Saver(&job->path, &job->data);
+            }
+        }
+        lock_Mutex(d->mtx);
+        iForEach(PtrArray, j, &d->writing) {
+            delete_SaveJob_(j.ptr);
+        }
+        clear_PtrArray(&d->writing);
+        d->isBusy = iFalse;
+        if (isEmpty_PtrArray(&d->pending)) {
+            signalAll_Condition(&d->finished);
+        }
+    }
+    signalAll_Condition(&d->finished);
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+void init_Saver(iSaver *d) {
+    d->mtx = new_Mutex();
+    init_Condition(&d->jobAvailable);
+    init_Condition(&d->finished);
+    init_PtrArray(&d->pending);
+    init_PtrArray(&d->writing);
+    d->isBusy     = iFalse;
+    d->isQuitting = iFalse;
+    d->thread     = new_Thread(run_Saver_);
+    setUserData_Thread(d->thread, d);
+    start_Thread(d->thread);
+}
+
+void deinit_Saver(iSaver *d) {
+    /* Pending files are written before the thread exits. */
+    iGuardMutex(d->mtx, {
+        d->isQuitting = iTrue;
+        signal_Condition(&d->jobAvailable);
+    });
+    join_Thread(d->thread);
+    iRelease(d->thread);
+    iForEach(PtrArray, i, &d->pending) {
+        delete_SaveJob_(i.ptr);
+    }
+    deinit_PtrArray(&d->pending);
+    deinit_PtrArray(&d->writing);
+    deinit_Condition(&d->finished);
+    deinit_Condition(&d->jobAvailable);
+    delete_Mutex(d->mtx);
+}
+
+static const iSaveJob *findJob_Saver_(const iPtrArray *jobs, const iString *path) {
+    /* Called while locked. */
+    iConstForEach(PtrArray, i, jobs) {
+        const iSaveJob *job = i.ptr;
+        if (equal_String(&job->path, path)) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void queue_Saver_(iSaver *d, const iString *path, const iBlock *data) {
+    /* A NULL `data` removes the file. */
+    lock_Mutex(d->mtx);
+    iSaveJob *job = (iSaveJob *) findJob_Saver_(&d->pending, path);
+    if (job) {
+        /* The older contents were not written yet, so they can be skipped. */
+        if (data) {
+            set_Block(&job->data, data);
+        }
+        else {
+            clear_Block(&job->data);
+        }
+        job->isRemoval = (data == NULL);
+    }
+    else {
+        pushBack_PtrArray(&d->pending, new_SaveJob_(path, data));
+    }
+    signal_Condition(&d->jobAvailable);
+    unlock_Mutex(d->mtx);
+}
+
+void save_Saver(iSaver *d, const iString *path, const iBlock *data) {
+    iAssert(data);
+    queue_Saver_(d, path, data);
+}
+
+void remove_Saver(iSaver *d, const iString *path) {
+    queue_Saver_(d, path, NULL);
+}
+
+iBlock *pendingData_Saver(const iSaver *d, const iString *path) {
+    iBlock *data = NULL;
+    lock_Mutex(d->mtx);
+    /* Pending jobs are newer than the ones being written. */
+    const iSaveJob *job = findJob_Saver_(&d->pending, path);
+    if (!job) {
+        job = findJob_Saver_(&d->writing, path);
+    }
+    if (job && !job->isRemoval) {
+        data = copy_Block(&job->data);
+    }
+    unlock_Mutex(d->mtx);
+    return data;
+}
+
+void flush_Saver(iSaver *d) {
+    lock_Mutex(d->mtx);
+    while (!isEmpty_PtrArray(&d->pending) || d->isBusy) {
+        wait_Condition(&d->finished, d->mtx);
+    }
+    unlock_Mutex(d->mtx);
+}
@@ -0,0 +1,50 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/block.h>
+#include <the_Foundation/string.h>
+
+/* The saver writes files in a background thread. Callers hand over a snapshot of the
+   file contents, so the data can't change while it is being written. A file is first
+   written under a temporary name and then renamed over the old one, so an interrupted
+   write never leaves a truncated file behind. If the same file is saved again before
+   the previous contents were written, only the newest contents are written. Removing a
+   file is queued the same way, so it can't be undone by an earlier save finishing late. */
+
+iDeclareType(Saver)
+iDeclareTypeConstruction(Saver)
+
+void    save_Saver      (iSaver *, const iString *path, const iBlock *data);
+void    remove_Saver    (iSaver *, const iString *path);
+void    flush_Saver     (iSaver *); /* waits until all pending files have been written */
+
+/**
+ * Returns the contents of a file that has been saved but may not be on disk yet.
+ *
+ * @returns Copy of the newest contents (caller gets ownership), or NULL if nothing is
+ * pending for `path` or the file is being removed.
+ */
+iBlock *pendingData_Saver       (const iSaver *, const iString *path);
+
+iBool   writeAtomically_Saver   (const iString *path, const iBlock *data);
@@ -0,0 +1,200 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "trigramindex.h"
+
+#include <the_Foundation/hash.h>
+#include <ctype.h>
+
+iDeclareType(TrigramPosting)
+
+struct Impl_TrigramPosting {
+    iHashNode node; /* key is the trigram */
+    iArray    ids;  /* uint32_t, ascending */
+};
+
+struct Impl_TrigramIndex {
+    iHash postings;
+};
+
+iDefineTypeConstruction(TrigramIndex)
+
+void init_TrigramIndex(iTrigramIndex *d) {
+    init_Hash(&d->postings);
+}
+
+void deinit_TrigramIndex(iTrigramIndex *d) {
+    clear_TrigramIndex(d);
+    deinit_Hash(&d->postings);
+}
+
+static void delete_TrigramPosting_(iTrigramPosting *d) {
+    deinit_Array(&d->ids);
+    free(d);
+}
+
+void clear_TrigramIndex(iTrigramIndex *d) {
+    iForEach(Hash, i, &d->postings) {
+        iTrigramPosting *post = (iTrigramPosting *) i.value;
+        remove_HashIterator(&i);
+        delete_TrigramPosting_(post);
+    }
+}
+
+static iBool trigramAt_(const char *pos, uint32_t *trigram_out) {
+    uint32_t tri = 0;
+    for (int i = 0; i < 3; i++) {
+        const uint8_t ch = (uint8_t) pos[i];
+        if (ch & 0x80) {
+            return iFalse; /* case-insensitive matching of other characters isn't known */
+        }
+        tri = (tri << 8) | (uint8_t) tolower(ch);
+    }
+    *trigram_out = tri;
+    return iTrue;
+}
+
+static size_t lowerBound_(const iArray *ids, uint32_t id) {
+    const uint32_t *values = constData_Array(ids);
+    size_t lo = 0, hi = size_Array(ids);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (values[mid] < id) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void add_TrigramIndex(iTrigramIndex *d, iRangecc text, uint32_t id) {
+    for (const char *pos = text.start; pos + 3 <= text.end; pos++) {
+        uint32_t tri;
+        if (!trigramAt_(pos, &tri)) {
+            continue;
+        }
+        iTrigramPosting *post = (iTrigramPosting *) value_Hash(&d->postings, tri);
+        if (!post) {
+            post = iMalloc(TrigramPosting);
+            post->node.key = tri;
+            init_Array(&post->ids, sizeof(uint32_t));
+            insert_Hash(&d->postings, &post->node);
+        }
+        const size_t count = size_Array(&post->ids);
+        if (count == 0 || *(const uint32_t *) constBack_Array(&post->ids) < id) {
+            pushBack_Array(&post->ids, &id); /* IDs are usually added in ascending order */
+            continue;
+        }
+        const size_t at = lowerBound_(&post->ids, id);
+        if (*(const uint32_t *) constAt_Array(&post->ids, at) != id) {
+            insert_Array(&post->ids, at, &id);
+        }
+    }
+}
+
+void remove_TrigramIndex(iTrigramIndex *d, iRangecc text, uint32_t id) {
+    for (const char *pos = text.start; pos + 3 <= text.end; pos++) {
+        uint32_t tri;
+        if (!trigramAt_(pos, &tri)) {
+            continue;
+        }
+        iTrigramPosting *post = (iTrigramPosting *) value_Hash(&d->postings, tri);
+        if (!post) {
+            continue; /* the same trigram occurred earlier in the text */
+        }
+        const size_t at = lowerBound_(&post->ids, id);
+        if (at < size_Array(&post->ids) &&
+            *(const uint32_t *) constAt_Array(&post->ids, at) == id) {
+            remove_Array(&post->ids, at);
+            if (isEmpty_Array(&post->ids)) {
+                remove_Hash(&d->postings, tri);
+                delete_TrigramPosting_(post);
+            }
+        }
+    }
+}
+
+static int cmpSize_TrigramPosting_(const void *a, const void *b) {
+    const iTrigramPosting *s = *(const iTrigramPosting **) a;
+    const iTrigramPosting *t = *(const iTrigramPosting **) b;
+    return iCmp(size_Array(&s->ids), size_Array(&t->ids));
+}
+
+iBool query_TrigramIndex(const iTrigramIndex *d, const iStringList *words, iArray *ids_out) {
+    iArray posts;
+    init_Array(&posts, sizeof(const iTrigramPosting *));
+    iBool hasTrigrams = iFalse;
+    iBool isMissing   = iFalse;
+    iConstForEach(StringList, w, words) {
+        const iRangecc word = range_String(w.value);
+        for (const char *pos = word.start; pos + 3 <= word.end && !isMissing; pos++) {
+            uint32_t tri;
+            if (!trigramAt_(pos, &tri)) {
+                continue;
+            }
+            hasTrigrams = iTrue;
+            const iTrigramPosting *post =
+                (const iTrigramPosting *) value_Hash(&d->postings, tri);
+            if (post) {
+                pushBack_Array(&posts, &post);
+            }
+            else {
+                isMissing = iTrue; /* nothing can match */
+            }
+        }
+    }
+    if (hasTrigrams && !isMissing) {
+        /* Intersect the posting lists, shortest first so the result shrinks quickly. */
+        sort_Array(&posts, cmpSize_TrigramPosting_);
+        iArray result;
+        init_Array(&result, sizeof(uint32_t));
+        iConstForEach(Array, i, &posts) {
+            const iArray *ids = &(*(const iTrigramPosting **) i.value)->ids;
+            if (i.pos == 0) {
+                pushBackN_Array(&result, constData_Array(ids), size_Array(ids));
+                continue;
+            }
+            uint32_t *values  = data_Array(&result);
+            size_t    numKept = 0;
+            size_t    at      = 0;
+            for (size_t j = 0; j < size_Array(&result); j++) {
+                const uint32_t *other = constData_Array(ids);
+                while (at < size_Array(ids) && other[at] < values[j]) {
+                    at++;
+                }
+                if (at < size_Array(ids) && other[at] == values[j]) {
+                    values[numKept++] = values[j];
+                }
+            }
+            resize_Array(&result, numKept);
+            if (numKept == 0) {
+                break;
+            }
+        }
+        pushBackN_Array(ids_out, constData_Array(&result), size_Array(&result));
+        deinit_Array(&result);
+    }
+    deinit_Array(&posts);
+    return hasTrigrams;
+}
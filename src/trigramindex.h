@@ -0,0 +1,50 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/array.h>
+#include <the_Foundation/range.h>
+#include <the_Foundation/stringlist.h>
+
+/* Maps the trigrams of short texts to the IDs of the entries that contain them. Only
+   trigrams of ASCII characters are indexed, case-insensitively. The index is used to find
+   the candidates that may match a search, so that the actual matching only needs to be
+   done on those. The index is not thread-safe; the owner must lock it. */
+
+iDeclareType(TrigramIndex)
+iDeclareTypeConstruction(TrigramIndex)
+
+void    clear_TrigramIndex  (iTrigramIndex *);
+void    add_TrigramIndex    (iTrigramIndex *, iRangecc text, uint32_t id);
+void    remove_TrigramIndex (iTrigramIndex *, iRangecc text, uint32_t id);
+
+/**
+ * Finds the entries whose indexed texts contain all the trigrams of the words.
+ *
+ * @param words    Search words.
+ * @param ids_out  Array of uint32_t. The IDs of the candidates are appended in ascending
+ *                 order.
+ *
+ * @returns iFalse if the words have no trigrams, so any entry may match.
+ */
+iBool   query_TrigramIndex  (const iTrigramIndex *, const iStringList *words, iArray *ids_out);
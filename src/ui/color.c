@@ -690,49 +690,8 @@ static const iColor ansi8BitColors_[256] = {
     { 255, 255, 255, 255 }
 };
 
-iColor ansiForeground_Color(iRangecc escapeSequence, int fallback) {
-    iColor clr = get_Color(fallback);
-    for (const char *ch = escapeSequence.start; ch < escapeSequence.end; ch++) {
-        char *endPtr;
-        unsigned long arg = strtoul(ch, &endPtr, 10);
-        ch = endPtr;
-        switch (arg) {
-            default:
-                break;
-            case 30:
-            case 31:
-            case 32:
-            case 33:
-            case 34:
-            case 35:
-            case 36:
-            case 37:
-                clr = ansi8BitColors_[arg - 30];
-                break;
-            case 38: {
-                /* Extended foreground color. */
-                arg = strtoul(ch + 1, &endPtr, 10);
-                ch  = endPtr;
-                if (arg == 5) /* 8-bit palette */ {
-                    arg = strtoul(ch + 1, &endPtr, 10);
-                    ch  = endPtr;
-                    clr = ansi8BitColors_[iClamp(arg, 0, 255)];
-                }
-                break;
-            }
-            case 90:
-            case 91:
-            case 92:
-            case 93:
-            case 94:
-            case 95:
-            case 96:
-            case 97:
-                clr = ansi8BitColors_[8 + arg - 90];
-                break;
-        }
-    }
-    /* On light backgrounds, darken the colors to make them more legible. */
+/* On light backgrounds, darken the colors to make them more legible. */
+static iColor legibleAnsi_Color_(iColor clr) {
     if (get_HSLColor(tmBackground_ColorId).lum > 0.5f) {
         clr.r /= 2;
         clr.g /= 2;
@@ -740,3 +699,73 @@ iColor ansiForeground_Color(iRangecc escapeSequence, int fallback) {
     }
     return clr;
 }
+
+static void applySgr_Color_(const int *args, size_t numArgs, int fallback, iColor *clr) {
+    for (size_t i = 0; i < numArgs; i++) {
+        const int arg = args[i];
+        if (arg == 0 || arg == 39) {
+            *clr = get_Color(fallback);
+        }
+        else if (arg >= 30 && arg <= 37) {
+            *clr = legibleAnsi_Color_(ansi8BitColors_[arg - 30]);
+        }
+        else if (arg >= 90 && arg <= 97) {
+            *clr = legibleAnsi_Color_(ansi8BitColors_[8 + arg - 90]);
+        }
+        else if (arg == 38 || arg == 48) {
+            /* Extended color: 8-bit palette or 24-bit RGB. Backgrounds are not supported, but
+               their arguments must be skipped. */
+            if (i + 2 < numArgs && args[i + 1] == 5) {
+                if (arg == 38) {
+                    *clr = legibleAnsi_Color_(ansi8BitColors_[iClamp(args[i + 2], 0, 255)]);
+                }
+                i += 2;
+            }
+            else if (i + 4 < numArgs && args[i + 1] == 2) {
+                if (arg == 38) {
+                    *clr = legibleAnsi_Color_((iColor){ iMin(args[i + 2], 255),
+                                                        iMin(args[i + 3], 255),
+                                                        iMin(args[i + 4], 255),
+                                                        255 });
+                }
+                i += 4;
+            }
+        }
+    }
+}
+
+const char *ansiEscape_Color(iRangecc text, int fallback, iColor *clr) {
+    const char *pos = text.start;
+    if (size_Range(&text) < 3 || pos[0] != 0x1b || pos[1] != '[') {
+        return text.start;
+    }
+    int    args[16];
+    size_t numArgs = 0;
+    int    value   = 0;
+    for (pos += 2; pos != text.end; pos++) {
+        const char ch = *pos;
+        if (ch >= '0' && ch <= '9') {
+            value = iMin(value * 10 + (ch - '0'), 0xffff);
+        }
+        else if (ch == ';' || ch == ':') {
+            if (numArgs < iElemCount(args)) {
+                args[numArgs++] = value;
+            }
+            value = 0;
+        }
+        else if (ch >= 0x40 && ch <= 0x7e) {
+            /* Final byte. Sequences other than SGR are skipped. */
+            if (ch == 'm' && clr) {
+                if (numArgs < iElemCount(args)) {
+                    args[numArgs++] = value;
+                }
+                applySgr_Color_(args, numArgs, fallback, clr);
+            }
+            return pos + 1;
+        }
+        else if (ch < 0x20 || ch > 0x3f) {
+            break; /* not a control sequence */
+        }
+    }
+    return text.start;
+}
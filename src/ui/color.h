@@ -228,5 +228,8 @@ iLocalDef void setHsl_Color(int color, iHSLColor hsl) {
 
 void            setThemePalette_Color   (enum iColorTheme theme);
 
-iColor          ansiForeground_Color    (iRangecc escapeSequence, int fallback);
+/* Parses the ANSI control sequence at the start of `text`, updating `clr` if it is an SGR
+   color sequence (8-bit palette and 24-bit colors are supported). Returns the position
+   after the sequence, or `text.start` if there is no valid sequence. */
+const char *    ansiEscape_Color        (iRangecc text, int fallback, iColor *clr);
 const char *    escape_Color            (int color);
@@ -33,15 +33,106 @@ iBool equal_Command(const char *cmdWithArgs, const char *cmd) {
     return equal_CStr(cmdWithArgs, cmd);
 }
 
-static const iString *tokenString_(const char *label) {
-    return collectNewFormat_String(" %s:", label);
+static const char *commandNames_[max_CommandId] = {
+    "", /* unknown */
+    "", /* none */
+    "copy",
+    "document.copylink",
+    "document.goto",
+    "document.input.submit",
+    "document.layout.changed",
+    "document.layout.finished",
+    "document.linkkeys",
+    "document.reload",
+    "document.save",
+    "document.stop",
+    "find.clearmark",
+    "find.next",
+    "find.prev",
+    "font.changed",
+    "media.decoded",
+    "media.finished",
+    "media.player.started",
+    "media.player.update",
+    "media.updated",
+    "navigate.back",
+    "navigate.forward",
+    "navigate.parent",
+    "navigate.root",
+    "scroll.bottom",
+    "scroll.page",
+    "scroll.step",
+    "scroll.top",
+    "server.showcert",
+    "server.trustcert",
+    "tabs.changed",
+    "theme.changed",
+    "valueinput.cancelled",
+    "visited.changed",
+    "window.focus.lost",
+    "window.mouse.exited",
+    "window.resized",
+};
+
+static int cmpName_(iRangecc name, const char *cstr) {
+    const size_t len = size_Range(&name);
+    const int    cmp = strncmp(name.start, cstr, len);
+    if (cmp) {
+        return cmp;
+    }
+    return cstr[len] ? -1 : 0;
+}
+
+int id_Command(const char *cmdWithArgs) {
+    /* Same matching rules as equal_Command(): arguments are only present if there is
+       a colon somewhere in the command. */
+    iRangecc name = { cmdWithArgs, NULL };
+    if (strchr(cmdWithArgs, ':')) {
+        name.end = strchr(cmdWithArgs, ' ');
+        if (!name.end) {
+            return none_CommandId;
+        }
+    }
+    else {
+        name.end = cmdWithArgs + strlen(cmdWithArgs);
+    }
+    int lo = none_CommandId + 1, hi = max_CommandId - 1;
+    while (lo <= hi) {
+        const int mid = (lo + hi) / 2;
+        const int cmp = cmpName_(name, commandNames_[mid]);
+        if (cmp == 0) {
+            return mid;
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return none_CommandId;
+}
+
+const char *name_Command(int id) {
+    iAssert(id > unknown_CommandId && id < max_CommandId);
+    return commandNames_[id];
+}
+
+static const char *findLabel_(const char *cmd, const char *label) {
+    /* Looks for " label:" without composing the token first. */
+    const size_t len = strlen(label);
+    for (const char *ptr = strstr(cmd, label); ptr; ptr = strstr(ptr + 1, label)) {
+        if (ptr > cmd && ptr[-1] == ' ' && ptr[len] == ':') {
+            return ptr + len + 1;
+        }
+    }
+    return NULL;
 }
 
 int argLabel_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
+    const char *ptr = findLabel_(cmd, label);
     if (ptr) {
-        return atoi(ptr + size_String(tok));
+        return atoi(ptr);
     }
     return 0;
 }
@@ -51,10 +142,9 @@ int arg_Command(const char *cmd) {
 }
 
 float argfLabel_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
+    const char *ptr = findLabel_(cmd, label);
     if (ptr) {
-        return strtof(ptr + size_String(tok), NULL);
+        return strtof(ptr, NULL);
     }
     return 0.0f;
 }
@@ -68,11 +158,10 @@ float argf_Command(const char *cmd) {
 }
 
 void *pointerLabel_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
+    const char *ptr = findLabel_(cmd, label);
     if (ptr) {
         void *val = NULL;
-        sscanf(ptr + size_String(tok), "%p", &val);
+        sscanf(ptr, "%p", &val);
         return val;
     }
     return NULL;
@@ -83,12 +172,7 @@ void *pointer_Command(const char *cmd) {
 }
 
 const char *suffixPtr_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
-    if (ptr) {
-        return ptr + size_String(tok);
-    }
-    return NULL;
+    return findLabel_(cmd, label);
 }
 
 iString *suffix_Command(const char *cmd, const char *label) {
@@ -27,6 +27,56 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 iBool   equal_Command           (const char *commandWithArgs, const char *command);
 
+/* Frequently dispatched commands have interned integer IDs so that handlers can
+   compare integers instead of strings. The IDs are in alphabetical order of the
+   command names (see command.c). Commands without an ID map to none_CommandId and
+   must be compared with equal_Command(). unknown_CommandId is zero so that it matches
+   a command event whose ID was never looked up. */
+enum iCommandId {
+    unknown_CommandId,
+    none_CommandId,
+    copy_CommandId,
+    documentCopylink_CommandId,
+    documentGoto_CommandId,
+    documentInputSubmit_CommandId,
+    documentLayoutChanged_CommandId,
+    documentLayoutFinished_CommandId,
+    documentLinkkeys_CommandId,
+    documentReload_CommandId,
+    documentSave_CommandId,
+    documentStop_CommandId,
+    findClearmark_CommandId,
+    findNext_CommandId,
+    findPrev_CommandId,
+    fontChanged_CommandId,
+    mediaDecoded_CommandId,
+    mediaFinished_CommandId,
+    mediaPlayerStarted_CommandId,
+    mediaPlayerUpdate_CommandId,
+    mediaUpdated_CommandId,
+    navigateBack_CommandId,
+    navigateForward_CommandId,
+    navigateParent_CommandId,
+    navigateRoot_CommandId,
+    scrollBottom_CommandId,
+    scrollPage_CommandId,
+    scrollStep_CommandId,
+    scrollTop_CommandId,
+    serverShowcert_CommandId,
+    serverTrustcert_CommandId,
+    tabsChanged_CommandId,
+    themeChanged_CommandId,
+    valueinputCancelled_CommandId,
+    visitedChanged_CommandId,
+    windowFocusLost_CommandId,
+    windowMouseExited_CommandId,
+    windowResized_CommandId,
+    max_CommandId
+};
+
+int             id_Command          (const char *commandWithArgs);
+const char *    name_Command        (int id);
+
 int     arg_Command             (const char *); /* arg: */
 float   argf_Command            (const char *); /* arg: */
 int     argLabel_Command        (const char *, const char *label);
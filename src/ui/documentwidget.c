@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "audio/player.h"
 #include "command.h"
 #include "defs.h"
+#include "feeds.h"
 #include "gmcerts.h"
 #include "gmdocument.h"
 #include "gmrequest.h"
@@ -38,11 +39,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "media.h"
 #include "paint.h"
 #include "playerui.h"
+#include "profiler.h"
+#include "responsecache.h"
 #include "scrollwidget.h"
 #include "util.h"
 #include "visbuf.h"
 #include "visited.h"
 
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
 #include <the_Foundation/objectlist.h>
@@ -56,6 +60,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <SDL_render.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 
 /*----------------------------------------------------------------------------------------------*/
 
@@ -102,6 +108,7 @@ iDeclareType(OutlineItem)
 
 struct Impl_OutlineItem {
     iRangecc text;
+    size_t   sourcePos; /* offset of the heading text in the document source */
     int      font;
     iRect    rect;
 };
@@ -110,11 +117,20 @@ struct Impl_OutlineItem {
 
 static void animatePlayers_DocumentWidget_      (iDocumentWidget *d);
 static void updateSideIconBuf_DocumentWidget_   (iDocumentWidget *d);
+static iBool updateOutline_DocumentWidget_      (iDocumentWidget *d);
+static void updateWindowTitle_DocumentWidget_   (const iDocumentWidget *d);
+static void invalidate_DocumentWidget_          (iDocumentWidget *d);
+static void restorePending_DocumentWidget_      (iDocumentWidget *d);
 
 static const int smoothDuration_DocumentWidget_  = 600; /* milliseconds */
 static const int outlineMinWidth_DocumentWdiget_ = 45;  /* times gap_UI */
 static const int outlineMaxWidth_DocumentWidget_ = 65;  /* times gap_UI */
 static const int outlinePadding_DocumentWidget_  = 3;   /* times gap_UI */
+static const size_t backgroundLayoutMinSize_DocumentWidget_ = 256 * 1024; /* source bytes */
+static const size_t prepareGlyphsMaxSize_DocumentWidget_    = 64 * 1024;  /* source bytes */
+static const double freshAge_DocumentWidget_ = 60 * 60; /* seconds; cached pages used when navigating */
+static const uint32_t streamRenderMinInterval_DocumentWidget_ = 100;  /* milliseconds */
+static const uint32_t streamRenderMaxInterval_DocumentWidget_ = 1000; /* milliseconds */
 
 enum iRequestState {
     blank_RequestState,
@@ -127,6 +143,8 @@ enum iDocumentWidgetFlag {
     selecting_DocumentWidgetFlag             = iBit(1),
     noHoverWhileScrolling_DocumentWidgetFlag = iBit(2),
     showLinkNumbers_DocumentWidgetFlag       = iBit(3),
+    pendingInitialScroll_DocumentWidgetFlag  = iBit(4),
+    pendingRestore_DocumentWidgetFlag        = iBit(5), /* restored or hibernated, not shown yet */
 };
 
 enum iDocumentLinkOrdinalMode {
@@ -141,9 +159,21 @@ struct Impl_DocumentWidget {
     int            flags;
     enum iDocumentLinkOrdinalMode ordinalMode;
     iString *      titleUser;
+    iBlock *       pendingState;   /* serialized state of a restored tab; parsed when shown */
+    int            pendingStateVersion;
+    iString *      pendingTitle;   /* document title of a restored tab that wasn't shown yet */
+    uint32_t       hiddenTime;     /* SDL ticks when the tab was last hidden; zero while shown */
     iGmRequest *   request;
     iAtomicInt     isRequestUpdated; /* request has new content, need to parse it */
+    iGmRequestTiming requestTiming; /* of the latest finished request */
+    uint32_t       streamRenderTime; /* SDL ticks of the previous progressive render */
+    uint32_t       streamRenderCost; /* milliseconds spent on the previous progressive render */
+    SDL_TimerID    streamTimer;      /* deferred progressive render */
+    iGmRequest *   prefetch; /* speculatively fetching a link into the response cache */
+    iGmLinkId      prefetchLinkId;
+    SDL_TimerID    prefetchTimer;
     iObjectList *  media;
+    iArray         pendingMedia; /* iGmLinkId; waiting for a free request slot */
     iString        sourceMime;
     iBlock         sourceContent; /* original content as received, for saving */
     iTime          sourceTime;
@@ -162,7 +192,13 @@ struct Impl_DocumentWidget {
     iAnim          animWideRunOffset;
     uint16_t       animWideRunId;
     iGmRunRange    animWideRunRange;
+    SDL_Texture *  wideBlockBuf; /* the scrolled wide block, drawn without an offset */
+    uint16_t       wideBlockId;
+    iGmRunRange    wideBlockRange;
+    iRangei        wideBlockSpan;
+    int            wideBlockWidth;
     iPtrArray      visiblePlayers; /* currently playing audio */
+    iPtrArray      visibleImages;
     const iGmRun * grabbedPlayer; /* currently adjusting volume in a player */
     float          grabbedStartVolume;
     int            playerTimer;
@@ -176,6 +212,7 @@ struct Impl_DocumentWidget {
     iAnim          sideOpacity;
     iAnim          outlineOpacity;
     iArray         outline;
+    int            outlineWidth; /* width used for measuring the `outline` items */
     iScrollWidget *scroll;
     iWidget *      menu;
     iWidget *      playerMenu;
@@ -200,15 +237,32 @@ void init_DocumentWidget(iDocumentWidget *d) {
     d->certSubject      = new_String();
     d->state            = blank_RequestState;
     d->titleUser        = new_String();
+    d->pendingState     = NULL;
+    d->pendingStateVersion = 0;
+    d->pendingTitle     = new_String();
+    d->hiddenTime       = iMax(1, SDL_GetTicks());
     d->request          = NULL;
     d->isRequestUpdated = iFalse;
+    iZap(d->requestTiming);
+    d->streamRenderTime = 0;
+    d->streamRenderCost = 0;
+    d->streamTimer      = 0;
+    d->prefetch         = NULL;
+    d->prefetchLinkId   = 0;
+    d->prefetchTimer    = 0;
     d->media            = new_ObjectList();
+    init_Array(&d->pendingMedia, sizeof(iGmLinkId));
     d->doc              = new_GmDocument();
     d->redirectCount    = 0;
     d->initNormScrollY  = 0;
     init_Anim(&d->scrollY, 0);
     d->animWideRunId = 0;
     init_Anim(&d->animWideRunOffset, 0);
+    d->wideBlockBuf   = NULL;
+    d->wideBlockId    = 0;
+    iZap(d->wideBlockRange);
+    iZap(d->wideBlockSpan);
+    d->wideBlockWidth = 0;
     d->selectMark       = iNullRange;
     d->foundMark        = iNullRange;
     d->pageMargin       = 5;
@@ -219,6 +273,7 @@ void init_DocumentWidget(iDocumentWidget *d) {
     d->visBuf           = new_VisBuf();
     d->invalidRuns      = new_PtrSet();
     init_Array(&d->outline, sizeof(iOutlineItem));
+    d->outlineWidth     = 0;
     init_Anim(&d->sideOpacity, 0);
     init_Anim(&d->outlineOpacity, 0);
     init_String(&d->sourceMime);
@@ -228,6 +283,7 @@ void init_DocumentWidget(iDocumentWidget *d) {
     init_PtrArray(&d->visibleWideRuns);
     init_Array(&d->wideRunOffsets, sizeof(int));
     init_PtrArray(&d->visiblePlayers);
+    init_PtrArray(&d->visibleImages);
     d->grabbedPlayer = NULL;
     d->playerTimer   = 0;
     init_Click(&d->click, d, SDL_BUTTON_LEFT);
@@ -253,12 +309,23 @@ void deinit_DocumentWidget(iDocumentWidget *d) {
     if (d->sideIconBuf) {
         SDL_DestroyTexture(d->sideIconBuf);
     }
+    if (d->wideBlockBuf) {
+        SDL_DestroyTexture(d->wideBlockBuf);
+    }
     delete_TextBuf(d->timestampBuf);
     delete_VisBuf(d->visBuf);
     delete_PtrSet(d->invalidRuns);
     deinit_Array(&d->outline);
     iRelease(d->media);
+    deinit_Array(&d->pendingMedia);
     iRelease(d->request);
+    if (d->streamTimer) {
+        SDL_RemoveTimer(d->streamTimer);
+    }
+    if (d->prefetchTimer) {
+        SDL_RemoveTimer(d->prefetchTimer);
+    }
+    iRelease(d->prefetch);
     deinit_Block(&d->sourceContent);
     deinit_String(&d->sourceMime);
     iRelease(d->doc);
@@ -266,16 +333,29 @@ void deinit_DocumentWidget(iDocumentWidget *d) {
         SDL_RemoveTimer(d->playerTimer);
     }
     deinit_Array(&d->wideRunOffsets);
+    deinit_PtrArray(&d->visibleImages);
     deinit_PtrArray(&d->visiblePlayers);
     deinit_PtrArray(&d->visibleWideRuns);
     deinit_PtrArray(&d->visibleLinks);
     delete_Block(d->certFingerprint);
     delete_String(d->certSubject);
     delete_String(d->titleUser);
+    delete_String(d->pendingTitle);
+    delete_Block(d->pendingState);
     deinit_PersistentDocumentState(&d->mod);
 }
 
+static void releaseWideBlockBuf_DocumentWidget_(iDocumentWidget *d) {
+    if (d->wideBlockBuf) {
+        SDL_DestroyTexture(d->wideBlockBuf);
+        d->wideBlockBuf = NULL;
+    }
+    d->wideBlockId = 0;
+    iZap(d->wideBlockRange);
+}
+
 static void resetWideRuns_DocumentWidget_(iDocumentWidget *d) {
+    releaseWideBlockBuf_DocumentWidget_(d);
     clear_Array(&d->wideRunOffsets);
     d->animWideRunId = 0;
     init_Anim(&d->animWideRunOffset, 0);
@@ -290,6 +370,20 @@ static void requestUpdated_DocumentWidget_(iAnyObject *obj) {
     }
 }
 
+static uint32_t postStreamRender_DocumentWidget_(uint32_t interval, void *context) {
+    /* Called in timer thread; don't access the widget. */
+    iUnused(interval);
+    postCommandf_App("document.stream doc:%p", context);
+    return 0;
+}
+
+static void cancelStreamRender_DocumentWidget_(iDocumentWidget *d) {
+    if (d->streamTimer) {
+        SDL_RemoveTimer(d->streamTimer);
+        d->streamTimer = 0;
+    }
+}
+
 static void requestFinished_DocumentWidget_(iAnyObject *obj) {
     iDocumentWidget *d = obj;
     postCommand_Widget(obj, "document.request.finished doc:%p request:%p", d, d->request);
@@ -361,6 +455,9 @@ static void addVisible_DocumentWidget_(void *context, const iGmRun *run) {
     if (run->audioId) {
         pushBack_PtrArray(&d->visiblePlayers, run);
     }
+    if (run->imageId) {
+        pushBack_PtrArray(&d->visibleImages, run);
+    }
     if (run->linkId && linkFlags_GmDocument(d->doc, run->linkId) & supportedProtocol_GmLinkFlag) {
         pushBack_PtrArray(&d->visibleLinks, run);
     }
@@ -387,6 +484,16 @@ static void invalidateLink_DocumentWidget_(iDocumentWidget *d, iGmLinkId id) {
             insert_PtrSet(d->invalidRuns, run);
         }
     }
+    if (d->wideBlockBuf) {
+        /* The buffered wide block is drawn again if the link is in it. */
+        for (const iGmRun *r = d->wideBlockRange.start; r != d->wideBlockRange.end; r++) {
+            if (r->linkId == id) {
+                SDL_DestroyTexture(d->wideBlockBuf);
+                d->wideBlockBuf = NULL;
+                break;
+            }
+        }
+    }
 }
 
 static void invalidateVisibleLinks_DocumentWidget_(iDocumentWidget *d) {
@@ -413,6 +520,10 @@ static int runOffset_DocumentWidget_(const iDocumentWidget *d, const iGmRun *run
 }
 
 static void invalidateWideRunsWithNonzeroOffset_DocumentWidget_(iDocumentWidget *d) {
+    /* The buffered block was not redrawn in the VisBuf while it was being scrolled. */
+    for (const iGmRun *r = d->wideBlockRange.start; r != d->wideBlockRange.end; r++) {
+        insert_PtrSet(d->invalidRuns, r);
+    }
     iConstForEach(PtrArray, i, &d->visibleWideRuns) {
         const iGmRun *run = i.ptr;
         if (runOffset_DocumentWidget_(d, run)) {
@@ -421,6 +532,8 @@ static void invalidateWideRunsWithNonzeroOffset_DocumentWidget_(iDocumentWidget
     }
 }
 
+static void schedulePrefetch_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId);
+
 static void updateHover_DocumentWidget_(iDocumentWidget *d, iInt2 mouse) {
     const iWidget *w            = constAs_Widget(d);
     const iRect    docBounds    = documentBounds_DocumentWidget_(d);
@@ -444,6 +557,7 @@ static void updateHover_DocumentWidget_(iDocumentWidget *d, iInt2 mouse) {
         if (d->hoverLink) {
             invalidateLink_DocumentWidget_(d, d->hoverLink->linkId);
         }
+        schedulePrefetch_DocumentWidget_(d, d->hoverLink ? d->hoverLink->linkId : 0);
         refresh_Widget(as_Widget(d));
     }
     if (isHover_Widget(w) && !contains_Widget(constAs_Widget(d->scroll), mouse)) {
@@ -458,6 +572,7 @@ static void updateHover_DocumentWidget_(iDocumentWidget *d, iInt2 mouse) {
 
 static void animate_DocumentWidget_(void *ticker) {
     iDocumentWidget *d = ticker;
+    refresh_Widget(d);
     if (!isFinished_Anim(&d->sideOpacity) || !isFinished_Anim(&d->outlineOpacity)) {
         addTicker_App(animate_DocumentWidget_, d);
     }
@@ -544,24 +659,37 @@ static void animatePlayers_DocumentWidget_(iDocumentWidget *d) {
 static iRangecc currentHeading_DocumentWidget_(const iDocumentWidget *d) {
     iRangecc heading = iNullRange;
     if (d->firstVisibleRun) {
-        iConstForEach(Array, i, headings_GmDocument(d->doc)) {
-            const iGmHeading *head = i.value;
-            if (head->level == 0) {
-                if (head->text.start <= d->firstVisibleRun->text.start) {
-                    heading = head->text;
-                }
-                if (d->lastVisibleRun && head->text.start > d->lastVisibleRun->text.start) {
-                    break;
-                }
+        const iArray *headings = headings_GmDocument(d->doc);
+        const size_t  index =
+            findHeading_GmDocument(d->doc, top_Rect(d->firstVisibleRun->visBounds));
+        if (index != iInvalidPos) {
+            const size_t section = ((const iGmHeading *) constAt_Array(headings, index))->section;
+            if (section != iInvalidPos) {
+                heading = ((const iGmHeading *) constAt_Array(headings, section))->text;
             }
         }
     }
     return heading;
 }
 
+static void layoutExtended_DocumentWidget_(iDocumentWidget *d) {
+    /* The source is unchanged, but runs may have moved in memory. */
+    d->hoverLink       = NULL;
+    d->contextLink     = NULL;
+    d->firstVisibleRun = NULL;
+    d->lastVisibleRun  = NULL;
+    invalidate_DocumentWidget_(d);
+    updateWindowTitle_DocumentWidget_(d);
+    updateOutline_DocumentWidget_(d);
+}
+
 static void updateVisible_DocumentWidget_(iDocumentWidget *d) {
     const iRangei visRange = visibleRange_DocumentWidget_(d);
     const iRect   bounds   = bounds_Widget(as_Widget(d));
+    if (isLayoutPartial_GmDocument(d->doc) &&
+        extendLayout_GmDocument(d->doc, visRange.end + height_Rect(bounds) /* prefetch */)) {
+        layoutExtended_DocumentWidget_(d);
+    }
     setRange_ScrollWidget(d->scroll, (iRangei){ 0, scrollMax_DocumentWidget_(d) });
     const int docSize = size_GmDocument(d->doc).y;
     setThumb_ScrollWidget(d->scroll,
@@ -570,6 +698,7 @@ static void updateVisible_DocumentWidget_(iDocumentWidget *d) {
     clear_PtrArray(&d->visibleLinks);
     clear_PtrArray(&d->visibleWideRuns);
     clear_PtrArray(&d->visiblePlayers);
+    clear_PtrArray(&d->visibleImages);
     const iRangecc oldHeading = currentHeading_DocumentWidget_(d);
     /* Scan for visible runs. */ {
         d->firstVisibleRun = NULL;
@@ -600,6 +729,9 @@ static void updateWindowTitle_DocumentWidget_(const iDocumentWidget *d) {
     if (!isEmpty_String(title_GmDocument(d->doc))) {
         pushBack_StringArray(title, title_GmDocument(d->doc));
     }
+    else if (!isEmpty_String(d->pendingTitle)) {
+        pushBack_StringArray(title, d->pendingTitle);
+    }
     if (!isEmpty_String(d->titleUser)) {
         pushBack_StringArray(title, d->titleUser);
     }
@@ -671,6 +803,8 @@ static void updateTimestampBuf_DocumentWidget_(iDocumentWidget *d) {
 static void invalidate_DocumentWidget_(iDocumentWidget *d) {
     invalidate_VisBuf(d->visBuf);
     clear_PtrSet(d->invalidRuns);
+    /* Runs may have moved, and everything will be redrawn anyway. */
+    releaseWideBlockBuf_DocumentWidget_(d);
 }
 
 static int outlineWidth_DocumentWidget_(const iDocumentWidget *d) {
@@ -691,25 +825,49 @@ static iRangecc bannerText_DocumentWidget_(const iDocumentWidget *d) {
                                         : range_String(d->titleUser);
 }
 
-static void updateOutline_DocumentWidget_(iDocumentWidget *d) {
+/* Returns iTrue if the previous outline items were kept and only new ones were appended. */
+static iBool updateOutline_DocumentWidget_(iDocumentWidget *d) {
     iWidget *w = as_Widget(d);
     int outWidth = outlineWidth_DocumentWidget_(d);
-    clear_Array(&d->outline);
-    if (outWidth == 0 || d->state != ready_RequestState) {
-        return;
+    if (outWidth == 0 ||
+        (d->state != ready_RequestState && d->state != receivedPartialResponse_RequestState) ||
+        size_GmDocument(d->doc).y < height_Rect(bounds_Widget(w)) * 2 /* too short */) {
+        clear_Array(&d->outline);
+        return iFalse;
     }
-    if (size_GmDocument(d->doc).y < height_Rect(bounds_Widget(w)) * 2) {
-        return; /* Too short */
+    /* While a document is being received, its source is only appended to. The items
+       already measured can be kept as long as their headings are unchanged. The source
+       buffer may have been reallocated, so the text ranges are updated. */
+    const iArray *headings = headings_GmDocument(d->doc);
+    const char *  srcStart = constBegin_String(source_GmDocument(d->doc));
+    size_t        numKept  = 0;
+    if (outWidth == d->outlineWidth) {
+        while (numKept < size_Array(&d->outline) && numKept < size_Array(headings)) {
+            iOutlineItem *    item = at_Array(&d->outline, numKept);
+            const iGmHeading *head = constAt_Array(headings, numKept);
+            if (item->sourcePos != (size_t) (head->text.start - srcStart) ||
+                size_Range(&item->text) != size_Range(&head->text) ||
+                item->rect.pos.x != head->level * 5 * gap_UI) {
+                break;
+            }
+            item->text = head->text;
+            numKept++;
+        }
     }
-    iInt2 pos  = zero_I2();
+    const iBool isExtended = numKept > 0 && numKept == size_Array(&d->outline);
+    resize_Array(&d->outline, numKept);
+    d->outlineWidth = outWidth;
+    iInt2 pos = numKept ? init_I2(0, bottom_Rect(((const iOutlineItem *) constBack_Array(
+                                                      &d->outline))->rect))
+                        : zero_I2();
 //    const iRangecc topText = urlHost_String(d->mod.url);
 //    iInt2 size = advanceWrapRange_Text(uiContent_FontId, outWidth, topText);
 //    pushBack_Array(&d->outline, &(iOutlineItem){ topText, uiContent_FontId, (iRect){ pos, size },
 //                                                 tmBannerTitle_ColorId, none_ColorId });
 //    pos.y += size.y;
     iInt2 size;
-    iConstForEach(Array, i, headings_GmDocument(d->doc)) {
-        const iGmHeading *head = i.value;
+    for (size_t i = numKept; i < size_Array(headings); i++) {
+        const iGmHeading *head = constAt_Array(headings, i);
         const int indent = head->level * 5 * gap_UI;
         size = advanceWrapRange_Text(uiLabel_FontId, outWidth - indent, head->text);
         if (head->level == 0) {
@@ -717,29 +875,95 @@ static void updateOutline_DocumentWidget_(iDocumentWidget *d) {
         }
         pushBack_Array(
             &d->outline,
-            &(iOutlineItem){ head->text, uiLabel_FontId, (iRect){ addX_I2(pos, indent), size } });
+            &(iOutlineItem){ head->text,
+                             head->text.start - srcStart,
+                             uiLabel_FontId,
+                             (iRect){ addX_I2(pos, indent), size } });
         pos.y += size.y;
     }
+    return isExtended;
 }
 
-static void setSource_DocumentWidget_(iDocumentWidget *d, const iString *source) {
-    setUrl_GmDocument(d->doc, d->mod.url);
-    setSource_GmDocument(d->doc, source, documentWidth_DocumentWidget_(d));
+static void documentRunsInvalidated_DocumentWidget_(iDocumentWidget *d) {
     d->foundMark       = iNullRange;
     d->selectMark      = iNullRange;
     d->hoverLink       = NULL;
     d->contextLink     = NULL;
     d->firstVisibleRun = NULL;
     d->lastVisibleRun  = NULL;
-    setValue_Anim(&d->outlineOpacity, 0.0f, 0);
     updateWindowTitle_DocumentWidget_(d);
     updateVisible_DocumentWidget_(d);
     updateSideIconBuf_DocumentWidget_(d);
-    updateOutline_DocumentWidget_(d);
+    if (!updateOutline_DocumentWidget_(d)) {
+        setValue_Anim(&d->outlineOpacity, 0.0f, 0); /* appended outlines stay visible */
+    }
     invalidate_DocumentWidget_(d);
     refresh_Widget(as_Widget(d));
 }
 
+static void prepareGlyphs_DocumentWidget_(const iString *source) {
+    /* Rasterize the characters near the beginning while the document is being laid out. */
+    iRangecc text = range_String(source);
+    text.end = text.start + iMin(size_String(source), prepareGlyphsMaxSize_DocumentWidget_);
+    prepareGlyphs_Text(paragraph_FontId, text);
+}
+
+static void setSource_DocumentWidget_(iDocumentWidget *d, const iString *source) {
+    clear_Array(&d->outline); /* measured for the previous source */
+    setUrl_GmDocument(d->doc, d->mod.url);
+    prepareGlyphs_DocumentWidget_(source);
+    if (size_String(source) >= backgroundLayoutMinSize_DocumentWidget_) {
+        /* Large documents are laid out in the background. The beginning is laid out
+           right away and the rest of it lazily until the background layout is ready. */
+        setSourceAsync_GmDocument(d->doc, source, documentWidth_DocumentWidget_(d));
+    }
+    else {
+        setSource_GmDocument(d->doc, source, documentWidth_DocumentWidget_(d));
+    }
+    documentRunsInvalidated_DocumentWidget_(d);
+}
+
+static iRangei markOffsets_DocumentWidget_(const iDocumentWidget *d, iRangecc mark) {
+    if (!mark.start) {
+        return (iRangei){ -1, -1 };
+    }
+    const char *src = constBegin_String(source_GmDocument(d->doc));
+    return (iRangei){ mark.start - src, mark.end - src };
+}
+
+static iRangecc markAtOffsets_DocumentWidget_(const iDocumentWidget *d, iRangei offsets) {
+    const iString *src = source_GmDocument(d->doc);
+    if (offsets.start < 0 || iMax(offsets.start, offsets.end) > (int) size_String(src)) {
+        return iNullRange;
+    }
+    return (iRangecc){ constBegin_String(src) + offsets.start,
+                       constBegin_String(src) + offsets.end };
+}
+
+static void setStreamedSource_DocumentWidget_(iDocumentWidget *d, const iString *source) {
+    /* Only the lines received since the previous update need to be laid out. */
+    setUrl_GmDocument(d->doc, d->mod.url);
+    prepareGlyphs_DocumentWidget_(source);
+    /* The source is only appended to, but its buffer may be reallocated. The marks are
+       kept as offsets and moved to the new buffer. */
+    const iRangei foundOffsets  = markOffsets_DocumentWidget_(d, d->foundMark);
+    const iRangei selectOffsets = markOffsets_DocumentWidget_(d, d->selectMark);
+    setStreamedSource_GmDocument(d->doc, source, documentWidth_DocumentWidget_(d));
+    documentRunsInvalidated_DocumentWidget_(d);
+    d->foundMark  = markAtOffsets_DocumentWidget_(d, foundOffsets);
+    d->selectMark = markAtOffsets_DocumentWidget_(d, selectOffsets);
+}
+
+static void restoreInitialScroll_DocumentWidget_(iDocumentWidget *d) {
+    if (isLayoutPending_GmDocument(d->doc)) {
+        /* Document size is not known yet; scroll after the layout is finished. */
+        d->flags |= pendingInitialScroll_DocumentWidgetFlag;
+        return;
+    }
+    d->flags &= ~pendingInitialScroll_DocumentWidgetFlag;
+    init_Anim(&d->scrollY, d->initNormScrollY * size_GmDocument(d->doc).y);
+}
+
 static void updateTheme_DocumentWidget_(iDocumentWidget *d) {
     if (isEmpty_String(d->titleUser)) {
         setThemeSeed_GmDocument(d->doc,
@@ -801,6 +1025,21 @@ static void showErrorPage_DocumentWidget_(iDocumentWidget *d, enum iGmStatusCode
     d->state = ready_RequestState;
 }
 
+static void showDownloadPage_DocumentWidget_(iDocumentWidget *d, const iString *path,
+                                             const iString *mime, iBool isFinished) {
+    iString *src = collectNewFormat_String("# %s\n```\n%s\n```\n",
+                                           isFinished ? "File Saved" : "Downloading\u2026",
+                                           cstr_String(mime));
+    appendFormat_String(src,
+                        "The file %s saved to your Downloads folder:\n> %s\n",
+                        isFinished ? "was" : "is being",
+                        cstr_String(path));
+    setSiteBannerEnabled_GmDocument(d->doc, iTrue);
+    setFormat_GmDocument(d->doc, gemini_GmDocumentFormat);
+    setSource_DocumentWidget_(d, src);
+    init_Anim(&d->scrollY, 0);
+}
+
 static void updateFetchProgress_DocumentWidget_(iDocumentWidget *d) {
     iLabelWidget *prog   = findWidget_App("document.progress");
     const size_t  dlSize = d->request ? bodySize_GmRequest(d->request) : 0;
@@ -815,17 +1054,26 @@ static void updateFetchProgress_DocumentWidget_(iDocumentWidget *d) {
     }
 }
 
+static const iString *sharedUrl_(const iString *url, const iGmRequest *req) {
+    /* Content fetched with a client certificate may be private, so it isn't shared with
+       other pages via the media cache. Without a request, check if one would use it. Until
+       the identities have loaded, that is not known. */
+    const iGmCerts *certs = loadedCerts_App();
+    const iBool isIdentityUsed = req ? isIdentityUsed_GmRequest(req)
+                                     : !certs || identityForUrl_GmCerts(certs, url) != NULL;
+    return isIdentityUsed ? NULL : url;
+}
+
 static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse *response,
                                            const iBool isInitialUpdate) {
     if (d->state == ready_RequestState) {
         return;
     }
     const iBool isRequestFinished = !d->request || isFinished_GmRequest(d->request);
-    /* TODO: Do document update in the background. However, that requires a text metrics calculator
-       that does not try to cache the glyph bitmaps. */
     const enum iGmStatusCode statusCode = response->statusCode;
     if (category_GmStatusCode(statusCode) != categoryInput_GmStatusCode) {
         iBool setSource = iTrue;
+        iBool isStreamable = iFalse; /* source grows as more of the response arrives */
         iString str;
         invalidate_DocumentWidget_(d);
         if (document_App() == d) {
@@ -848,10 +1096,12 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
                 trim_Rangecc(&param);
                 if (equal_Rangecc(param, "text/plain")) {
                     docFormat = plainText_GmDocumentFormat;
+                    isStreamable = iTrue;
                     setRange_String(&d->sourceMime, param);
                 }
                 else if (equal_Rangecc(param, "text/gemini")) {
                     docFormat = gemini_GmDocumentFormat;
+                    isStreamable = iTrue;
                     setRange_String(&d->sourceMime, param);
                 }
                 else if (startsWith_Rangecc(param, "image/") ||
@@ -872,6 +1122,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
                         format_String(&str, "=> %s %s\n", cstr_String(d->mod.url), linkTitle);
                         setData_Media(media_GmDocument(d->doc),
                                       1,
+                                      sharedUrl_(d->mod.url, d->request),
                                       mimeStr,
                                       &response->body,
                                       !isRequestFinished ? partialData_MediaFlag : 0);
@@ -881,6 +1132,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
                         /* Update the audio content. */
                         setData_Media(media_GmDocument(d->doc),
                                       1,
+                                      sharedUrl_(d->mod.url, d->request),
                                       mimeStr,
                                       &response->body,
                                       !isRequestFinished ? partialData_MediaFlag : 0);
@@ -901,6 +1153,16 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
                     }
                 }
             }
+            if (docFormat == undefined_GmDocumentFormat && d->request &&
+                downloadPath_GmRequest(d->request)) {
+                /* The body is going straight to a file. */
+                if (isInitialUpdate || isRequestFinished) {
+                    showDownloadPage_DocumentWidget_(
+                        d, downloadPath_GmRequest(d->request), &response->meta, isRequestFinished);
+                }
+                deinit_String(&str);
+                return;
+            }
             if (docFormat == undefined_GmDocumentFormat) {
                 showErrorPage_DocumentWidget_(d, unsupportedMimeType_GmStatusCode, &response->meta);
                 deinit_String(&str);
@@ -914,7 +1176,12 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d, const iGmResponse
             }
         }
         if (setSource) {
-            setSource_DocumentWidget_(d, &str);
+            if (isStreamable && !(isInitialUpdate && isRequestFinished)) {
+                setStreamedSource_DocumentWidget_(d, &str);
+            }
+            else {
+                setSource_DocumentWidget_(d, &str);
+            }
         }
         deinit_String(&str);
     }
@@ -926,19 +1193,165 @@ static void fetch_DocumentWidget_(iDocumentWidget *d) {
         iRelease(d->request);
         d->request = NULL;
     }
+    cancelStreamRender_DocumentWidget_(d);
+    d->streamRenderTime = 0;
+    d->streamRenderCost = 0;
     postCommandf_App("document.request.started doc:%p url:%s", d, cstr_String(d->mod.url));
     clear_ObjectList(d->media);
+    clear_Array(&d->pendingMedia);
     d->certFlags = 0;
     d->flags &= ~showLinkNumbers_DocumentWidgetFlag;
     d->state = fetching_RequestState;
     set_Atomic(&d->isRequestUpdated, iFalse);
     d->request = new_GmRequest(certs_App());
     setUrl_GmRequest(d->request, d->mod.url);
+    setPriority_GmRequest(d->request,
+                          document_App() == d ? foreground_GmRequestPriority
+                                              : background_GmRequestPriority);
+    enableDownload_GmRequest(d->request);
     iConnect(GmRequest, d->request, updated, d, requestUpdated_DocumentWidget_);
     iConnect(GmRequest, d->request, finished, d, requestFinished_DocumentWidget_);
     submit_GmRequest(d->request);
 }
 
+/* Prefetching is opt-in. Links hovered for a moment, and the "next" link of a page, are
+   fetched into the response cache so that opening them doesn't need to wait for the
+   network. */
+static const uint32_t prefetchHoverDelay_DocumentWidget_   = 400;        /* milliseconds */
+static const size_t   prefetchMaxSize_DocumentWidget_      = 512 * 1024; /* bytes */
+static const uint32_t prefetchHostInterval_DocumentWidget_ = 5000;       /* milliseconds */
+
+iDeclareType(PrefetchHost)
+
+struct Impl_PrefetchHost {
+    uint32_t hostHash;
+    uint32_t startedAt; /* SDL ticks */
+};
+
+static iPrefetchHost prefetchHosts_[8]; /* most recently used first */
+
+static iBool acceptPrefetchHost_(iRangecc host) {
+    /* Each host gets at most one prefetch per interval. */
+    uint32_t hash = 0x811c9dc5; /* FNV-1a */
+    for (const char *ch = host.start; ch != host.end; ch++) {
+        hash ^= (uint8_t) tolower(*ch);
+        hash *= 0x01000193;
+    }
+    const uint32_t now = SDL_GetTicks();
+    size_t pos = iElemCount(prefetchHosts_) - 1;
+    iForIndices(i, prefetchHosts_) {
+        if (prefetchHosts_[i].startedAt && prefetchHosts_[i].hostHash == hash) {
+            if (now - prefetchHosts_[i].startedAt < prefetchHostInterval_DocumentWidget_) {
+                return iFalse;
+            }
+            pos = i;
+            break;
+        }
+    }
+    memmove(prefetchHosts_ + 1, prefetchHosts_, sizeof(prefetchHosts_[0]) * pos);
+    prefetchHosts_[0] = (iPrefetchHost){ hash, iMax(1u, now) };
+    return iTrue;
+}
+
+static uint32_t postPrefetch_DocumentWidget_(uint32_t interval, void *context) {
+    /* Called in timer thread; don't access the widget. */
+    iUnused(interval);
+    postCommandf_App("document.prefetch doc:%p", context);
+    return 0;
+}
+
+static void prefetchFinished_DocumentWidget_(iAnyObject *obj) {
+    iDocumentWidget *d = obj;
+    postCommand_Widget(obj, "document.prefetch.finished doc:%p request:%p", d, d->prefetch);
+}
+
+static void schedulePrefetch_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId) {
+    if (d->prefetchTimer) {
+        SDL_RemoveTimer(d->prefetchTimer);
+        d->prefetchTimer = 0;
+    }
+    d->prefetchLinkId = 0;
+    if (linkId && prefs_App()->prefetchLinks && !d->prefetch &&
+        linkFlags_GmDocument(d->doc, linkId) & gemini_GmLinkFlag) {
+        d->prefetchLinkId = linkId;
+        d->prefetchTimer =
+            SDL_AddTimer(prefetchHoverDelay_DocumentWidget_, postPrefetch_DocumentWidget_, d);
+    }
+}
+
+static void prefetch_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId) {
+    if (d->prefetch || !prefs_App()->prefetchLinks ||
+        ~linkFlags_GmDocument(d->doc, linkId) & gemini_GmLinkFlag ||
+        isMediaLink_GmDocument(d->doc, linkId)) {
+        return;
+    }
+    const iString *url = absoluteUrl_String(d->mod.url, linkUrl_GmDocument(d->doc, linkId));
+    const double   age = age_ResponseCache(responseCache_App(), url);
+    if ((age >= 0 && age < freshAge_DocumentWidget_) || equal_String(url, d->mod.url)) {
+        return; /* Already available. */
+    }
+    iUrl parts;
+    init_Url(&parts, url);
+    if (!isEmpty_Range(&parts.query)) {
+        return; /* may have side effects, and isn't cached anyway */
+    }
+    if (!loadedCerts_App() || identityForUrl_GmCerts(loadedCerts_App(), url)) {
+        /* A speculative request must not present the user's identity. Fetching the page
+           without it would give a different page than following the link. */
+        return;
+    }
+    if (!acceptPrefetchHost_(parts.host)) {
+        return;
+    }
+    d->prefetch = new_GmRequest(certs_App());
+    setUrl_GmRequest(d->prefetch, url);
+    setPriority_GmRequest(d->prefetch, background_GmRequestPriority);
+    iConnect(GmRequest, d->prefetch, finished, d, prefetchFinished_DocumentWidget_);
+    submit_GmRequest(d->prefetch);
+}
+
+static iBool containsWord_(const iString *text, const char *word) {
+    /* `text` is lowercase. Words are separated by anything but letters and digits. */
+    const size_t len = strlen(word);
+    for (size_t pos = indexOfCStr_String(text, word); pos != iInvalidPos;
+         pos = indexOfCStrFrom_String(text, word, pos + 1)) {
+        const char *start = cstr_String(text) + pos;
+        const iBool isWordStart = (pos == 0 || !isalnum((unsigned char) start[-1]));
+        const iBool isWordEnd   = !isalnum((unsigned char) start[len]);
+        if (isWordStart && isWordEnd) {
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static void findNextLink_DocumentWidget_(void *context, const iGmRun *run) {
+    iGmLinkId *found = context;
+    if (!*found && run->linkId) {
+        iString *label = newRange_String(run->text);
+        iString *lower = lower_String(label);
+        if (containsWord_(lower, "next")) { /* but not "nextcloud" or "context" */
+            *found = run->linkId;
+        }
+        delete_String(lower);
+        delete_String(label);
+    }
+}
+
+static void prefetchNextLink_DocumentWidget_(iDocumentWidget *d) {
+    /* A gemlog series often has a link to the next post. */
+    if (prefs_App()->prefetchLinks) {
+        iGmLinkId next = 0;
+        render_GmDocument(d->doc,
+                          (iRangei){ 0, size_GmDocument(d->doc).y },
+                          findNextLink_DocumentWidget_,
+                          &next);
+        if (next) {
+            prefetch_DocumentWidget_(d, next);
+        }
+    }
+}
+
 static void updateTrust_DocumentWidget_(iDocumentWidget *d, const iGmResponse *response) {
     if (response) {
         d->certFlags  = response->certFlags;
@@ -978,41 +1391,124 @@ static void parseUser_DocumentWidget_(iDocumentWidget *d) {
     }
 }
 
+static void updateFromCachedResponse_DocumentWidget_(iDocumentWidget *d, float normScrollY,
+                                                     const iGmResponse *resp) {
+    clear_ObjectList(d->media);
+    clear_Array(&d->pendingMedia);
+    reset_GmDocument(d->doc);
+    d->state = fetching_RequestState;
+    d->initNormScrollY = normScrollY;
+    resetWideRuns_DocumentWidget_(d);
+    /* Use the cached response data. */
+    updateTrust_DocumentWidget_(d, resp);
+    d->sourceTime = resp->when;
+    updateTimestampBuf_DocumentWidget_(d);
+    set_Block(&d->sourceContent, &resp->body);
+    updateDocument_DocumentWidget_(d, resp, iTrue);
+    restoreInitialScroll_DocumentWidget_(d);
+    d->state = ready_RequestState;
+    updateSideOpacity_DocumentWidget_(d, iFalse);
+    updateSideIconBuf_DocumentWidget_(d);
+    updateOutline_DocumentWidget_(d);
+    updateVisible_DocumentWidget_(d);
+    postCommandf_App("document.changed doc:%p url:%s", d, cstr_String(d->mod.url));
+}
+
+static iBool updateFromResponseCache_DocumentWidget_(iDocumentWidget *d, float normScrollY,
+                                                     double maxAge) {
+    iGmResponse *resp = get_ResponseCache(responseCache_App(), d->mod.url, maxAge);
+    if (resp) {
+        updateFromCachedResponse_DocumentWidget_(d, normScrollY, resp);
+        delete_GmResponse(resp);
+        return iTrue;
+    }
+    return iFalse;
+}
+
 static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d) {
     const iRecentUrl *recent = findUrl_History(d->mod.history, d->mod.url);
     if (recent && recent->cachedResponse) {
-        const iGmResponse *resp = recent->cachedResponse;
-        clear_ObjectList(d->media);
-        reset_GmDocument(d->doc);
-        d->state = fetching_RequestState;
-        d->initNormScrollY = recent->normScrollY;
-        resetWideRuns_DocumentWidget_(d);
-        /* Use the cached response data. */
-        updateTrust_DocumentWidget_(d, resp);
-        d->sourceTime = resp->when;
-        updateTimestampBuf_DocumentWidget_(d);
-        set_Block(&d->sourceContent, &resp->body);
-        updateDocument_DocumentWidget_(d, resp, iTrue);
-        init_Anim(&d->scrollY, d->initNormScrollY * size_GmDocument(d->doc).y);
-        d->state = ready_RequestState;
-        updateSideOpacity_DocumentWidget_(d, iFalse);
-        updateSideIconBuf_DocumentWidget_(d);
-        updateOutline_DocumentWidget_(d);
-        updateVisible_DocumentWidget_(d);
-        postCommandf_App("document.changed doc:%p url:%s", d, cstr_String(d->mod.url));
+        updateFromCachedResponse_DocumentWidget_(d, recent->normScrollY, recent->cachedResponse);
         return iTrue;
     }
-    else if (!isEmpty_String(d->mod.url)) {
-        fetch_DocumentWidget_(d);
+    /* The memory cache may have been dropped, or this is a restored or new tab. */
+    return updateFromResponseCache_DocumentWidget_(d, recent ? recent->normScrollY : 0.0f, 0);
+}
+
+static iBool shareDocument_DocumentWidget_(iDocumentWidget *d, const iDocumentWidget *other) {
+    /* Shows the page of another tab. The source, response body, and images are shared, and
+       the layout is copied, so nothing is parsed, laid out, or decoded again. */
+    if (other->state != ready_RequestState || other->request ||
+        other->flags & pendingRestore_DocumentWidgetFlag || isEmpty_String(&other->sourceMime)) {
+        return iFalse;
     }
-    return iFalse;
+    iGmDocument *doc = duplicate_GmDocument(other->doc);
+    if (!doc) {
+        return iFalse;
+    }
+    if (!equalCase_String(d->mod.url, other->mod.url)) {
+        set_String(d->mod.url, other->mod.url);
+        parseUser_DocumentWidget_(d);
+    }
+    clear_ObjectList(d->media);
+    clear_Array(&d->pendingMedia);
+    iRelease(d->doc);
+    d->doc = doc;
+    resetWideRuns_DocumentWidget_(d);
+    d->certFlags  = other->certFlags;
+    d->certExpiry = other->certExpiry;
+    set_Block(d->certFingerprint, other->certFingerprint);
+    set_String(d->certSubject, other->certSubject);
+    set_String(&d->sourceMime, &other->sourceMime);
+    set_Block(&d->sourceContent, &other->sourceContent);
+    d->sourceTime = other->sourceTime;
+    updateTimestampBuf_DocumentWidget_(d);
+    const iRecentUrl *otherRecent = constMostRecentUrl_History(other->mod.history);
+    if (!cachedResponse_History(d->mod.history) && otherRecent && otherRecent->cachedResponse &&
+        equalCase_String(&otherRecent->url, d->mod.url)) {
+        /* The body is shared, too. */
+        setCachedResponse_History(d->mod.history, otherRecent->cachedResponse);
+    }
+    const iRecentUrl *recent = findUrl_History(d->mod.history, d->mod.url);
+    d->initNormScrollY = recent ? recent->normScrollY : normScrollPos_DocumentWidget_(other);
+    d->state = ready_RequestState;
+    clear_Array(&d->outline);
+    documentRunsInvalidated_DocumentWidget_(d);
+    restoreInitialScroll_DocumentWidget_(d);
+    updateSideOpacity_DocumentWidget_(d, iFalse);
+    updateVisible_DocumentWidget_(d);
+    postCommandf_App("document.changed doc:%p url:%s", d, cstr_String(d->mod.url));
+    return iTrue;
+}
+
+static const iDocumentWidget *findSamePage_DocumentWidget_(const iDocumentWidget *d,
+                                                           iBool isFromCache) {
+    /* Another tab may already be showing the content that would be loaded from a cache. */
+    if (equalCase_Rangecc(urlScheme_String(d->mod.url), "about")) {
+        return NULL;
+    }
+    const iRecentUrl *recent = isFromCache ? findUrl_History(d->mod.history, d->mod.url) : NULL;
+    if (isFromCache && (!recent || !recent->cachedResponse)) {
+        return NULL;
+    }
+    iConstForEach(ObjectList, i, iClob(listDocuments_App())) {
+        const iDocumentWidget *other = i.object;
+        if (other == d || !equalCase_String(other->mod.url, d->mod.url)) {
+            continue;
+        }
+        if (recent ? cmp_Time(&other->sourceTime, &recent->cachedResponse->when) == 0
+                   : elapsedSeconds_Time(&other->sourceTime) < freshAge_DocumentWidget_) {
+            return other;
+        }
+    }
+    return NULL;
 }
 
 static void refreshWhileScrolling_DocumentWidget_(iAny *ptr) {
     iDocumentWidget *d = ptr;
     updateVisible_DocumentWidget_(d);
     refresh_Widget(d);
-    if (d->animWideRunId) {
+    if (d->animWideRunId && d->animWideRunId != d->wideBlockId) {
         for (const iGmRun *r = d->animWideRunRange.start; r != d->animWideRunRange.end; r++) {
             insert_PtrSet(d->invalidRuns, r);
         }
@@ -1070,6 +1566,48 @@ static void scrollTo_DocumentWidget_(iDocumentWidget *d, int documentY, iBool ce
     scroll_DocumentWidget_(d, 0); /* clamp it */
 }
 
+static const int maxWideBlockBufPixels_DocumentWidget_ = 16 * 1024 * 1024;
+
+static iBool bufferWideBlock_DocumentWidget_(iDocumentWidget *d, uint16_t preId,
+                                             iGmRunRange range, int maxOffset) {
+    /* While a wide block is scrolled, it is drawn once into a texture wide enough for all
+       the offsets, and composited on top of the VisBuf with the current offset. */
+    if (d->wideBlockId == preId) {
+        return iTrue;
+    }
+    if (d->wideBlockId) {
+        /* The VisBuf still has the previously buffered block with a stale offset. */
+        for (const iGmRun *r = d->wideBlockRange.start; r != d->wideBlockRange.end; r++) {
+            insert_PtrSet(d->invalidRuns, r);
+        }
+        releaseWideBlockBuf_DocumentWidget_(d);
+    }
+    iRangei span = { top_Rect(range.start->visBounds), top_Rect(range.start->visBounds) };
+    for (const iGmRun *r = range.start; r != range.end; r++) {
+        span.start = iMin(span.start, top_Rect(r->visBounds));
+        span.end   = iMax(span.end, bottom_Rect(r->visBounds));
+    }
+    const int width = width_Rect(bounds_Widget(as_Widget(d))) + maxOffset;
+    SDL_RendererInfo info;
+    SDL_GetRendererInfo(renderer_Window(get_Window()), &info);
+    if (isEmpty_Rangei(span) ||
+        (int64_t) width * size_Range(&span) > maxWideBlockBufPixels_DocumentWidget_ ||
+        (info.max_texture_width && width > info.max_texture_width) ||
+        (info.max_texture_height && size_Range(&span) > info.max_texture_height)) {
+        return iFalse;
+    }
+    /* The texture is drawn when the widget is drawn the next time. The VisBuf then has the
+       block without an offset, entirely under the area covered by the texture. */
+    for (const iGmRun *r = range.start; r != range.end; r++) {
+        insert_PtrSet(d->invalidRuns, r);
+    }
+    d->wideBlockId    = preId;
+    d->wideBlockRange = range;
+    d->wideBlockSpan  = span;
+    d->wideBlockWidth = width;
+    return iTrue;
+}
+
 static void scrollWideBlock_DocumentWidget_(iDocumentWidget *d, iInt2 mousePos, int delta,
                                             int duration) {
     if (delta == 0) {
@@ -1092,10 +1630,12 @@ static void scrollWideBlock_DocumentWidget_(iDocumentWidget *d, iInt2 mousePos,
             int *offset = at_Array(&d->wideRunOffsets, run->preId - 1);
             const int oldOffset = *offset;
             *offset = iClamp(*offset + delta, 0, maxOffset);
-            /* Make sure the whole block gets redraw. */
             if (oldOffset != *offset) {
-                for (const iGmRun *r = range.start; r != range.end; r++) {
-                    insert_PtrSet(d->invalidRuns, r);
+                if (!bufferWideBlock_DocumentWidget_(d, run->preId, range, maxOffset)) {
+                    /* Make sure the whole block gets redraw. */
+                    for (const iGmRun *r = range.start; r != range.end; r++) {
+                        insert_PtrSet(d->invalidRuns, r);
+                    }
                 }
                 refresh_Widget(d);
                 d->selectMark = iNullRange;
@@ -1153,6 +1693,7 @@ static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
             case categorySuccess_GmStatusCode:
                 init_Anim(&d->scrollY, 0);
                 reset_GmDocument(d->doc); /* new content incoming */
+                clear_Array(&d->outline);
                 resetWideRuns_DocumentWidget_(d);
                 updateDocument_DocumentWidget_(d, resp, iTrue);
                 break;
@@ -1169,7 +1710,8 @@ static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
                     else if (equalCase_Rangecc(urlScheme_String(dstUrl),
                                                cstr_Rangecc(urlScheme_String(d->mod.url)))) {
                         /* Redirects with the same scheme are automatic. */
-                        visitUrl_Visited(visited_App(), d->mod.url, transient_VisitedUrlFlag);
+                        visitUrl_App(d->mod.url, transient_VisitedUrlFlag);
+                        setEntryRead_Feeds(d->mod.url, iTrue);
                         postCommandf_App(
                             "open redirect:%d url:%s", d->redirectCount + 1, cstr_String(dstUrl));
                     }
@@ -1214,6 +1756,39 @@ static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
     unlockResponse_GmRequest(d->request);
 }
 
+static uint32_t streamRenderDelay_DocumentWidget_(const iDocumentWidget *d) {
+    if (d->state != receivedPartialResponse_RequestState ||
+        !startsWith_String(&d->sourceMime, "text/")) {
+        return 0; /* header, media, or not rendered yet */
+    }
+    if (size_GmDocument(d->doc).y < height_Rect(bounds_Widget(constAs_Widget(d)))) {
+        return 0; /* first screenful is still being filled */
+    }
+    /* The new content is below the visible area, so renders can be spaced out. Back off
+       when layout is expensive and as the body grows. */
+    uint32_t interval = iMax(streamRenderMinInterval_DocumentWidget_, 4 * d->streamRenderCost);
+    interval = iMax(interval, (uint32_t) (bodySize_GmRequest(d->request) / 100000) * 10);
+    interval = iMin(interval, streamRenderMaxInterval_DocumentWidget_);
+    const uint32_t elapsed = SDL_GetTicks() - d->streamRenderTime;
+    return elapsed >= interval ? 0 : interval - elapsed;
+}
+
+static void renderStreamed_DocumentWidget_(iDocumentWidget *d) {
+    const uint32_t delay = streamRenderDelay_DocumentWidget_(d);
+    if (delay) {
+        /* Further updates are not notified until the deferred render has been done. */
+        if (!d->streamTimer) {
+            d->streamTimer = SDL_AddTimer(delay, postStreamRender_DocumentWidget_, d);
+        }
+        return;
+    }
+    const uint32_t startTime = SDL_GetTicks();
+    checkResponse_DocumentWidget_(d);
+    d->streamRenderTime = SDL_GetTicks();
+    d->streamRenderCost = d->streamRenderTime - startTime;
+    set_Atomic(&d->isRequestUpdated, iFalse); /* ready to be notified again */
+}
+
 static const char *sourceLoc_DocumentWidget_(const iDocumentWidget *d, iInt2 pos) {
     return findLoc_GmDocument(d->doc, documentPos_DocumentWidget_(d, pos));
 }
@@ -1265,16 +1840,183 @@ static iMediaRequest *findMediaRequest_DocumentWidget_(const iDocumentWidget *d,
     return NULL;
 }
 
+static iBool removePendingMedia_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId) {
+    iConstForEach(Array, i, &d->pendingMedia) {
+        if (*(const iGmLinkId *) i.value == linkId) {
+            remove_Array(&d->pendingMedia, index_ArrayConstIterator(&i));
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static const iString *mediaUrl_DocumentWidget_(const iDocumentWidget *d, iGmLinkId linkId) {
+    return absoluteUrl_String(d->mod.url, linkUrl_GmDocument(d->doc, linkId));
+}
+
+static const iString *sharedMediaUrl_DocumentWidget_(const iDocumentWidget *d,
+                                                     const iMediaRequest *req) {
+    return sharedUrl_(mediaUrl_DocumentWidget_(d, req->linkId), req->req);
+}
+
 static iBool requestMedia_DocumentWidget_(iDocumentWidget *d, iGmLinkId linkId) {
-    if (!findMediaRequest_DocumentWidget_(d, linkId)) {
-        const iString *imageUrl = absoluteUrl_String(d->mod.url, linkUrl_GmDocument(d->doc, linkId));
-        pushBack_ObjectList(d->media, iClob(new_MediaRequest(d, linkId, imageUrl)));
+    removePendingMedia_DocumentWidget_(d, linkId);
+    if (findMediaRequest_DocumentWidget_(d, linkId) ||
+        linkFlags_GmDocument(d->doc, linkId) & content_GmLinkFlag) {
+        return iFalse;
+    }
+    const iString *imageUrl = mediaUrl_DocumentWidget_(d, linkId);
+    if (setCachedData_Media(media_GmDocument(d->doc),
+                            linkId,
+                            sharedUrl_(imageUrl, NULL),
+                            allowHide_MediaFlag)) {
+        /* Already downloaded and decoded for another page. */
+        redoLayout_GmDocument(d->doc);
+        updateVisible_DocumentWidget_(d);
         invalidate_DocumentWidget_(d);
+        refresh_Widget(as_Widget(d));
         return iTrue;
     }
+    pushBack_ObjectList(d->media, iClob(new_MediaRequest(d, linkId, imageUrl)));
+    invalidate_DocumentWidget_(d);
+    return iTrue;
+}
+
+static const iBlock *savableMedia_DocumentWidget_(const iDocumentWidget *d, iGmLinkId linkId,
+                                                  const iString **mime_out) {
+    /* Images shown from the media cache have no request of their own, but the cached
+       image keeps the complete source. */
+    const iMediaRequest *req = findMediaRequest_DocumentWidget_(d, linkId);
+    if (req) {
+        if (!isFinished_GmRequest(req->req)) {
+            return NULL;
+        }
+        *mime_out = meta_GmRequest(req->req);
+        return body_GmRequest(req->req);
+    }
+    const iMedia * media   = constMedia_GmDocument(d->doc);
+    const iMediaId imageId = findLinkImage_Media(media, linkId);
+    const iBlock * data    = imageData_Media(media, imageId);
+    if (data) {
+        iGmImageInfo info;
+        imageInfo_Media(media, imageId, &info);
+        *mime_out = collectNewCStr_String(info.mime);
+    }
+    return data;
+}
+
+static size_t numActiveMedia_DocumentWidget_(const iDocumentWidget *d) {
+    size_t count = 0;
+    iConstForEach(ObjectList, i, d->media) {
+        if (!isFinished_GmRequest(((const iMediaRequest *) i.object)->req)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+iDeclareType(PendingMediaParams)
+
+struct Impl_PendingMediaParams {
+    const iArray *pending;
+    iRangei       visRange;
+    int *         distances; /* parallel to the pending array */
+};
+
+static void measure_PendingMediaParams_(void *params, const iGmRun *run) {
+    iPendingMediaParams *d = params;
+    if (!run->linkId || run->imageId || run->flags & decoration_GmRunFlag) {
+        return;
+    }
+    iConstForEach(Array, i, d->pending) {
+        if (*(const iGmLinkId *) i.value == run->linkId) {
+            const iRangei span = { top_Rect(run->visBounds), bottom_Rect(run->visBounds) };
+            const int dist = span.end < d->visRange.start ? d->visRange.start - span.end
+                             : span.start > d->visRange.end ? span.start - d->visRange.end
+                                                            : 0;
+            int *best = &d->distances[index_ArrayConstIterator(&i)];
+            *best = iMin(*best, dist);
+            break;
+        }
+    }
+}
+
+static iBool startNextPendingMedia_DocumentWidget_(iDocumentWidget *d) {
+    size_t numActive = numActiveMedia_DocumentWidget_(d);
+    const size_t maxActive = iMax(1, prefs_App()->maxMediaRequests);
+    if (isEmpty_Array(&d->pendingMedia) || numActive >= maxActive) {
+        return iFalse;
+    }
+    const size_t numPending = size_Array(&d->pendingMedia);
+    iPendingMediaParams params = { &d->pendingMedia,
+                                   visibleRange_DocumentWidget_(d),
+                                   malloc(sizeof(int) * numPending) };
+    for (size_t i = 0; i < numPending; i++) {
+        params.distances[i] = INT_MAX; /* not laid out */
+    }
+    render_GmDocument(d->doc,
+                      (iRangei){ 0, size_GmDocument(d->doc).y },
+                      measure_PendingMediaParams_,
+                      &params);
+    iArray *picked = collectNew_Array(sizeof(iGmLinkId));
+    while (numActive + size_Array(picked) < maxActive) {
+        size_t nearest = iInvalidPos;
+        for (size_t i = 0; i < numPending; i++) {
+            if (params.distances[i] >= 0 &&
+                (nearest == iInvalidPos || params.distances[i] < params.distances[nearest])) {
+                nearest = i;
+            }
+        }
+        if (nearest == iInvalidPos) {
+            break;
+        }
+        params.distances[nearest] = -1; /* taken */
+        pushBack_Array(picked, constAt_Array(&d->pendingMedia, nearest));
+    }
+    free(params.distances);
+    iConstForEach(Array, i, picked) {
+        requestMedia_DocumentWidget_(d, *(const iGmLinkId *) i.value);
+    }
+    return !isEmpty_Array(picked);
+}
+
+static void startPendingMedia_DocumentWidget_(iDocumentWidget *d) {
+    /* Pending requests are submitted in order of distance to the viewport, so the images
+       being looked at arrive first. The rest stay queued here and get ranked again as
+       the earlier requests finish and the page is scrolled. Images found in the media
+       cache don't need a request, so their slots are filled again right away. */
+    while (startNextPendingMedia_DocumentWidget_(d)) {}
+}
+
+static iBool isUnfetchedImageLink_DocumentWidget_(const iDocumentWidget *d, iGmLinkId linkId) {
+    const int linkFlags = linkFlags_GmDocument(d->doc, linkId);
+    return isMediaLink_GmDocument(d->doc, linkId) && linkFlags & imageFileExtension_GmLinkFlag &&
+           ~linkFlags & content_GmLinkFlag && ~linkFlags & permanent_GmLinkFlag;
+}
+
+static iBool hasUnfetchedImages_DocumentWidget_(const iDocumentWidget *d) {
+    for (iGmLinkId linkId = 1; linkUrl_GmDocument(d->doc, linkId); linkId++) {
+        if (isUnfetchedImageLink_DocumentWidget_(d, linkId) &&
+            !findMediaRequest_DocumentWidget_(d, linkId)) {
+            return iTrue;
+        }
+    }
     return iFalse;
 }
 
+static void fetchAllImages_DocumentWidget_(iDocumentWidget *d) {
+    /* Queue every image link on the page; they are fetched in parallel, subject to the
+       overall and per-host limits. */
+    for (iGmLinkId linkId = 1; linkUrl_GmDocument(d->doc, linkId); linkId++) {
+        if (isUnfetchedImageLink_DocumentWidget_(d, linkId) &&
+            !findMediaRequest_DocumentWidget_(d, linkId)) {
+            removePendingMedia_DocumentWidget_(d, linkId);
+            pushBack_Array(&d->pendingMedia, &linkId);
+        }
+    }
+    startPendingMedia_DocumentWidget_(d);
+}
+
 static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
     iMediaRequest *req = pointerLabel_Command(cmd, "request");
     iBool isOurRequest = iFalse;
@@ -1293,10 +2035,26 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
         const enum iGmStatusCode code = status_GmRequest(req->req);
         if (isSuccess_GmStatusCode(code)) {
             iGmResponse *resp = lockResponse_GmRequest(req->req);
-            if (startsWith_String(&resp->meta, "audio/")) {
+            if (startsWith_String(&resp->meta, "image/")) {
+                /* Space is reserved once the image size is known, and previews are shown
+                   as they get decoded. */
+                if (setData_Media(media_GmDocument(d->doc),
+                                  req->linkId,
+                                  sharedMediaUrl_DocumentWidget_(d, req),
+                                  &resp->meta,
+                                  &resp->body,
+                                  partialData_MediaFlag | allowHide_MediaFlag)) {
+                    redoLayout_GmDocument(d->doc);
+                    updateVisible_DocumentWidget_(d);
+                    invalidate_DocumentWidget_(d);
+                    refresh_Widget(as_Widget(d));
+                }
+            }
+            else if (startsWith_String(&resp->meta, "audio/")) {
                 /* TODO: Use a helper? This is same as below except for the partialData flag. */
                 if (setData_Media(media_GmDocument(d->doc),
                                   req->linkId,
+                                  sharedMediaUrl_DocumentWidget_(d, req),
                                   &resp->meta,
                                   &resp->body,
                                   partialData_MediaFlag | allowHide_MediaFlag)) {
@@ -1321,6 +2079,7 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
                 startsWith_String(meta_GmRequest(req->req), "audio/")) {
                 setData_Media(media_GmDocument(d->doc),
                               req->linkId,
+                              sharedMediaUrl_DocumentWidget_(d, req),
                               meta_GmRequest(req->req),
                               body_GmRequest(req->req),
                               allowHide_MediaFlag);
@@ -1335,17 +2094,26 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
             makeMessage_Widget(format_CStr(uiTextCaution_ColorEscape "%s", err->title), err->info);
             removeMediaRequest_DocumentWidget_(d, req->linkId);
         }
+        startPendingMedia_DocumentWidget_(d);
         return iTrue;
     }
     return iFalse;
 }
 
+/* The visible buffers cover half a page each; the ones not needed for the visible range
+   are prerendered ahead of it in the scrolling direction. */
+static const size_t numVisBuffers_DocumentWidget_     = 5;
+static const int    visBufGranularity_DocumentWidget_ = 1;
+
 static void allocVisBuffer_DocumentWidget_(const iDocumentWidget *d) {
     const iWidget *w         = constAs_Widget(d);
     const iBool    isVisible = isVisible_Widget(w);
     const iInt2    size      = bounds_Widget(w).size;
     if (isVisible) {
-        alloc_VisBuf(d->visBuf, size, 1);
+        alloc_VisBuf(d->visBuf,
+                     size,
+                     visBufGranularity_DocumentWidget_,
+                     numVisBuffers_DocumentWidget_);
     }
     else {
         dealloc_VisBuf(d->visBuf);
@@ -1355,14 +2123,10 @@ static void allocVisBuffer_DocumentWidget_(const iDocumentWidget *d) {
 static iBool fetchNextUnfetchedImage_DocumentWidget_(iDocumentWidget *d) {
     iConstForEach(PtrArray, i, &d->visibleLinks) {
         const iGmRun *run = i.ptr;
-        if (run->linkId && !run->imageId && ~run->flags & decoration_GmRunFlag) {
-            const int linkFlags = linkFlags_GmDocument(d->doc, run->linkId);
-            if (isMediaLink_GmDocument(d->doc, run->linkId) &&
-                linkFlags & imageFileExtension_GmLinkFlag &&
-                ~linkFlags & content_GmLinkFlag && ~linkFlags & permanent_GmLinkFlag ) {
-                if (requestMedia_DocumentWidget_(d, run->linkId)) {
-                    return iTrue;
-                }
+        if (run->linkId && !run->imageId && ~run->flags & decoration_GmRunFlag &&
+            isUnfetchedImageLink_DocumentWidget_(d, run->linkId)) {
+            if (requestMedia_DocumentWidget_(d, run->linkId)) {
+                return iTrue;
             }
         }
     }
@@ -1370,57 +2134,7 @@ static iBool fetchNextUnfetchedImage_DocumentWidget_(iDocumentWidget *d) {
 }
 
 static void saveToDownloads_(const iString *url, const iString *mime, const iBlock *content) {
-    /* Figure out a file name from the URL. */
-    iUrl parts;
-    init_Url(&parts, url);
-    while (startsWith_Rangecc(parts.path, "/")) {
-        parts.path.start++;
-    }
-    while (endsWith_Rangecc(parts.path, "/")) {
-        parts.path.end--;
-    }
-    iString *name = collectNewCStr_String("pagecontent");
-    if (isEmpty_Range(&parts.path)) {
-        if (!isEmpty_Range(&parts.host)) {
-            setRange_String(name, parts.host);
-            replace_Block(&name->chars, '.', '_');
-        }
-    }
-    else {
-        iRangecc fn = { parts.path.start + lastIndexOfCStr_Rangecc(parts.path, "/") + 1,
-                        parts.path.end };
-        if (!isEmpty_Range(&fn)) {
-            setRange_String(name, fn);
-        }
-    }
-    if (startsWith_String(name, "~")) {
-        /* This would be interpreted as a reference to a home directory. */
-        remove_Block(&name->chars, 0, 1);
-    }
-    iString *savePath = concat_Path(downloadDir_App(), name);
-    if (lastIndexOfCStr_String(savePath, ".") == iInvalidPos) {
-        /* No extension specified in URL. */
-        if (startsWith_String(mime, "text/gemini")) {
-            appendCStr_String(savePath, ".gmi");
-        }
-        else if (startsWith_String(mime, "text/")) {
-            appendCStr_String(savePath, ".txt");
-        }
-        else if (startsWith_String(mime, "image/")) {
-            appendCStr_String(savePath, cstr_String(mime) + 6);
-        }
-    }
-    if (fileExists_FileInfo(savePath)) {
-        /* Make it unique. */
-        iDate now;
-        initCurrent_Date(&now);
-        size_t insPos = lastIndexOfCStr_String(savePath, ".");
-        if (insPos == iInvalidPos) {
-            insPos = size_String(savePath);
-        }
-        const iString *date = collect_String(format_Date(&now, "_%Y-%m-%d_%H%M%S"));
-        insertData_Block(&savePath->chars, insPos, cstr_String(date), size_String(date));
-    }
+    iString *savePath = copy_String(downloadPathForUrl_App(url, mime));
     /* Write the file. */ {
         iFile *f = new_File(savePath);
         if (open_File(f, writeOnly_FileMode)) {
@@ -1441,9 +2155,30 @@ static void saveToDownloads_(const iString *url, const iString *mime, const iBlo
     delete_String(savePath);
 }
 
-static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
+static void updateMatchCount_DocumentWidget_(const iDocumentWidget *d) {
+    iLabelWidget *counter = findWidget_App("find.matches");
+    if (!counter) {
+        return;
+    }
+    const size_t numMatches = numMatches_GmDocument(d->doc);
+    if (!d->foundMark.start) {
+        updateTextCStr_LabelWidget(counter, numMatches == 0 &&
+                                   !isEmpty_String(text_InputWidget(findWidget_App("find.input")))
+                                       ? uiTextCaution_ColorEscape "No matches"
+                                       : "");
+    }
+    else {
+        updateTextCStr_LabelWidget(
+            counter,
+            format_CStr("%zu of %zu",
+                        findMatch_GmDocument(d->doc, d->foundMark.start) + 1,
+                        numMatches));
+    }
+}
+
+static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd, int cmdId) {
     iWidget *w = as_Widget(d);
-    if (equal_Command(cmd, "window.resized") || equal_Command(cmd, "font.changed")) {
+    if (cmdId == windowResized_CommandId || cmdId == fontChanged_CommandId) {
         const iGmRun *mid = middleRun_DocumentWidget_(d);
         const char *midLoc = (mid ? mid->text.start : NULL);
         /* Alt/Option key may be involved in window size changes. */
@@ -1451,11 +2186,15 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         setWidth_GmDocument(d->doc, documentWidth_DocumentWidget_(d));
         scroll_DocumentWidget_(d, 0);
         if (midLoc) {
+            if (extendLayoutToLoc_GmDocument(d->doc, midLoc)) {
+                layoutExtended_DocumentWidget_(d);
+            }
             mid = findRunAtLoc_GmDocument(d->doc, midLoc);
             if (mid) {
                 scrollTo_DocumentWidget_(d, mid_Rect(mid->bounds).y, iTrue);
             }
         }
+        rescaleImages_Media(media_GmDocument(d->doc));
         updateSideIconBuf_DocumentWidget_(d);
         updateOutline_DocumentWidget_(d);
         invalidate_DocumentWidget_(d);
@@ -1463,7 +2202,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         updateWindowTitle_DocumentWidget_(d);
         refresh_Widget(w);
     }
-    else if (equal_Command(cmd, "window.focus.lost")) {
+    else if (cmdId == windowFocusLost_CommandId) {
         if (d->flags & showLinkNumbers_DocumentWidgetFlag) {
             d->flags &= ~showLinkNumbers_DocumentWidgetFlag;
             invalidateVisibleLinks_DocumentWidget_(d);
@@ -1471,28 +2210,38 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iFalse;
     }
-    else if (equal_Command(cmd, "window.mouse.exited")) {
+    else if (cmdId == windowMouseExited_CommandId) {
         updateOutlineOpacity_DocumentWidget_(d);
         return iFalse;
     }
-    else if (equal_Command(cmd, "theme.changed") && document_App() == d) {
+    else if (cmdId == themeChanged_CommandId && document_App() == d) {
         updateTheme_DocumentWidget_(d);
         updateSideIconBuf_DocumentWidget_(d);
         invalidate_DocumentWidget_(d);
         refresh_Widget(w);
     }
-    else if (equal_Command(cmd, "document.layout.changed") && document_App() == d) {
+    else if (cmdId == documentLayoutChanged_CommandId && document_App() == d) {
         updateSize_DocumentWidget(d);
     }
-    else if (equal_Command(cmd, "tabs.changed")) {
+    else if (cmdId == visitedChanged_CommandId) {
+        updateVisitedLinks_GmDocument(d->doc);
+        invalidate_DocumentWidget_(d);
+        refresh_Widget(w);
+    }
+    else if (cmdId == tabsChanged_CommandId) {
         iChangeFlags(d->flags, showLinkNumbers_DocumentWidgetFlag, iFalse);
         if (cmp_String(id_Widget(w), suffixPtr_Command(cmd, "id")) == 0) {
+            d->hiddenTime = 0;
+            restorePending_DocumentWidget_(d);
             /* Set palette for our document. */
             updateTheme_DocumentWidget_(d);
             updateTrust_DocumentWidget_(d, NULL);
             updateSize_DocumentWidget(d);
             updateFetchProgress_DocumentWidget_(d);
         }
+        else if (!d->hiddenTime) {
+            d->hiddenTime = iMax(1, SDL_GetTicks());
+        }
         init_Anim(&d->sideOpacity, 0);
         updateSideOpacity_DocumentWidget_(d, iFalse);
         updateOutlineOpacity_DocumentWidget_(d);
@@ -1501,7 +2250,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         animatePlayers_DocumentWidget_(d);
         return iFalse;
     }
-    else if (equal_Command(cmd, "server.showcert") && d == document_App()) {
+    else if (cmdId == serverShowcert_CommandId && d == document_App()) {
         const char *unchecked      = red_ColorEscape "\u2610";
         const char *checked        = green_ColorEscape "\u2611";
         const char *actionLabels[] = { "Dismiss", uiTextCaution_ColorEscape "Trust" };
@@ -1513,7 +2262,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             uiHeading_ColorEscape "CERTIFICATE STATUS",
             format_CStr("%s%s  Domain name %s%s\n"
                         "%s%s  %s (%04d-%02d-%02d %02d:%02d:%02d)\n"
-                        "%s%s  %s",
+                        "%s%s  %s%s",
                         d->certFlags & domainVerified_GmCertFlag ? checked : unchecked,
                         uiText_ColorEscape,
                         d->certFlags & domainVerified_GmCertFlag ? "matches" : "mismatch",
@@ -1531,7 +2280,12 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
                         d->certExpiry.second,
                         d->certFlags & trusted_GmCertFlag ? checked : unchecked,
                         uiText_ColorEscape,
-                        d->certFlags & trusted_GmCertFlag ? "Trusted" : "Not trusted"),
+                        d->certFlags & trusted_GmCertFlag ? "Trusted" : "Not trusted",
+                        d->requestTiming.submitted
+                            ? format_CStr("\n\n%sLoaded: %s",
+                                          uiText_ColorEscape,
+                                          cstr_String(describe_GmRequestTiming(&d->requestTiming)))
+                            : ""),
             actionLabels,
             actionCmds,
             canTrust ? 2 : 1);
@@ -1539,7 +2293,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         addAction_Widget(dlg, SDLK_SPACE, 0, "message.ok");
         return iTrue;
     }
-    else if (equal_Command(cmd, "server.trustcert")) {
+    else if (cmdId == serverTrustcert_CommandId) {
         const iRangecc host = urlHost_String(d->mod.url);
         if (!isEmpty_Block(d->certFingerprint) && !isEmpty_Range(&host)) {
             setTrusted_GmCerts(certs_App(), host, d->certFingerprint, &d->certExpiry);
@@ -1548,7 +2302,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "copy") && document_App() == d && !focus_Widget()) {
+    else if (cmdId == copy_CommandId && document_App() == d && !focus_Widget()) {
         iString *copied;
         if (d->selectMark.start) {
             iRangecc mark = d->selectMark;
@@ -1565,7 +2319,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         delete_String(copied);
         return iTrue;
     }
-    else if (equal_Command(cmd, "document.copylink") && document_App() == d) {
+    else if (cmdId == documentCopylink_CommandId && document_App() == d) {
         if (d->contextLink) {
             SDL_SetClipboardText(cstr_String(
                 absoluteUrl_String(d->mod.url, linkUrl_GmDocument(d->doc, d->contextLink->linkId))));
@@ -1575,7 +2329,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "document.input.submit") && document_App() == d) {
+    else if (cmdId == documentInputSubmit_CommandId && document_App() == d) {
         iString *value = collect_String(suffix_Command(cmd, "value"));
         urlEncode_String(value);
         iString *url = collect_String(copy_String(d->mod.url));
@@ -1588,33 +2342,49 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         postCommandf_App("open url:%s", cstr_String(url));
         return iTrue;
     }
-    else if (equal_Command(cmd, "valueinput.cancelled") &&
+    else if (cmdId == valueinputCancelled_CommandId &&
              equal_Rangecc(range_Command(cmd, "id"), "document.input.submit") && document_App() == d) {
         postCommand_App("navigate.back");
         return iTrue;
     }
     else if (equalWidget_Command(cmd, w, "document.request.updated") &&
              d->request && pointerLabel_Command(cmd, "request") == d->request) {
-        set_Block(&d->sourceContent, &lockResponse_GmRequest(d->request)->body);
-        unlockResponse_GmRequest(d->request);
+        /* The source content is not shared with the response body until the request
+           finishes, or every subsequent append to the body would have to copy it. */
         if (document_App() == d) {
             updateFetchProgress_DocumentWidget_(d);
         }
-        checkResponse_DocumentWidget_(d);
-        set_Atomic(&d->isRequestUpdated, iFalse); /* ready to be notified again */
+        renderStreamed_DocumentWidget_(d);
         return iFalse;
     }
+    else if (equal_Command(cmd, "document.stream") && pointerLabel_Command(cmd, "doc") == d) {
+        if (d->streamTimer) {
+            d->streamTimer = 0;
+            if (d->request) {
+                renderStreamed_DocumentWidget_(d);
+            }
+        }
+        return iTrue;
+    }
     else if (equalWidget_Command(cmd, w, "document.request.finished") &&
              pointerLabel_Command(cmd, "request") == d->request) {
+        cancelStreamRender_DocumentWidget_(d);
+        d->requestTiming = timing_GmRequest(d->request);
         set_Block(&d->sourceContent, body_GmRequest(d->request));
         updateFetchProgress_DocumentWidget_(d);
         checkResponse_DocumentWidget_(d);
-        init_Anim(&d->scrollY, d->initNormScrollY * size_GmDocument(d->doc).y);
+        finishStream_GmDocument(d->doc); /* the complete source has been set */
+        restoreInitialScroll_DocumentWidget_(d);
         d->state = ready_RequestState;
         /* The response may be cached. */ {
             if (!equal_Rangecc(urlScheme_String(d->mod.url), "about") &&
                 startsWithCase_String(meta_GmRequest(d->request), "text/")) {
-                setCachedResponse_History(d->mod.history, lockResponse_GmRequest(d->request));
+                const iGmResponse *resp = lockResponse_GmRequest(d->request);
+                setCachedResponse_History(d->mod.history, resp);
+                if (isSuccess_GmStatusCode(resp->statusCode) &&
+                    !isIdentityUsed_GmRequest(d->request)) {
+                    put_ResponseCache(responseCache_App(), d->mod.url, resp);
+                }
                 unlockResponse_GmRequest(d->request);
             }
         }
@@ -1622,13 +2392,55 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         updateVisible_DocumentWidget_(d);
         updateSideIconBuf_DocumentWidget_(d);
         updateOutline_DocumentWidget_(d);
+        prefetchNextLink_DocumentWidget_(d);
         postCommandf_App("document.changed url:%s", cstr_String(d->mod.url));
         return iFalse;
     }
-    else if (equal_Command(cmd, "media.updated") || equal_Command(cmd, "media.finished")) {
+    else if (equal_Command(cmd, "document.prefetch") && pointerLabel_Command(cmd, "doc") == d) {
+        d->prefetchTimer = 0;
+        if (d->prefetchLinkId && d->hoverLink && d->hoverLink->linkId == d->prefetchLinkId) {
+            prefetch_DocumentWidget_(d, d->prefetchLinkId);
+        }
+        return iTrue;
+    }
+    else if (equalWidget_Command(cmd, w, "document.prefetch.finished") &&
+             d->prefetch && pointerLabel_Command(cmd, "request") == d->prefetch) {
+        const iGmResponse *resp = lockResponse_GmRequest(d->prefetch);
+        if (isSuccess_GmStatusCode(resp->statusCode) && startsWithCase_String(&resp->meta, "text/") &&
+            size_Block(&resp->body) <= prefetchMaxSize_DocumentWidget_ &&
+            !isIdentityUsed_GmRequest(d->prefetch)) {
+            put_ResponseCache(responseCache_App(), url_GmRequest(d->prefetch), resp);
+        }
+        unlockResponse_GmRequest(d->prefetch);
+        iReleasePtr(&d->prefetch);
+        return iFalse;
+    }
+    else if (cmdId == documentLayoutFinished_CommandId &&
+             pointerLabel_Command(cmd, "gmdoc") == d->doc) {
+        if (finishLayout_GmDocument(d->doc)) {
+            layoutExtended_DocumentWidget_(d);
+            updateVisible_DocumentWidget_(d);
+            updateSideIconBuf_DocumentWidget_(d);
+            refresh_Widget(as_Widget(d));
+            if (d->flags & pendingInitialScroll_DocumentWidgetFlag) {
+                restoreInitialScroll_DocumentWidget_(d);
+                updateVisible_DocumentWidget_(d);
+            }
+        }
+        return iTrue;
+    }
+    else if (cmdId == mediaUpdated_CommandId || cmdId == mediaFinished_CommandId) {
         return handleMediaCommand_DocumentWidget_(d, cmd);
     }
-    else if (equal_Command(cmd, "media.player.started")) {
+    else if (cmdId == mediaDecoded_CommandId) {
+        /* Any document may have images waiting for their textures. */
+        if (finishDecoding_Media(media_GmDocument(d->doc))) {
+            invalidate_DocumentWidget_(d);
+            refresh_Widget(as_Widget(d));
+        }
+        return iFalse;
+    }
+    else if (cmdId == mediaPlayerStarted_CommandId) {
         /* When one media player starts, pause the others that may be playing. */
         const iPlayer *startedPlr = pointerLabel_Command(cmd, "player");
         const iMedia * media  = media_GmDocument(d->doc);
@@ -1640,11 +2452,11 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             }
         }
     }
-    else if (equal_Command(cmd, "media.player.update")) {
+    else if (cmdId == mediaPlayerUpdate_CommandId) {
         updatePlayers_DocumentWidget_(d);
         return iFalse;
     }
-    else if (equal_Command(cmd, "document.stop") && document_App() == d) {
+    else if (cmdId == documentStop_CommandId && document_App() == d) {
         if (d->request) {
             postCommandf_App(
                 "document.request.cancelled doc:%p url:%s", d, cstr_String(d->mod.url));
@@ -1658,14 +2470,18 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
     }
     else if (equalWidget_Command(cmd, w, "document.media.save")) {
-        const iGmLinkId      linkId = argLabel_Command(cmd, "link");
-        const iMediaRequest *media  = findMediaRequest_DocumentWidget_(d, linkId);
-        if (media) {
-            saveToDownloads_(url_GmRequest(media->req), meta_GmRequest(media->req),
-                             body_GmRequest(media->req));
+        const iGmLinkId linkId = argLabel_Command(cmd, "link");
+        const iString * mime   = NULL;
+        const iBlock *  data   = savableMedia_DocumentWidget_(d, linkId, &mime);
+        if (data) {
+            saveToDownloads_(mediaUrl_DocumentWidget_(d, linkId), mime, data);
         }
     }
-    else if (equal_Command(cmd, "document.save") && document_App() == d) {
+    else if (equalWidget_Command(cmd, w, "document.media.loadall")) {
+        fetchAllImages_DocumentWidget_(d);
+        return iTrue;
+    }
+    else if (cmdId == documentSave_CommandId && document_App() == d) {
         if (d->request) {
             makeMessage_Widget(uiTextCaution_ColorEscape "PAGE INCOMPLETE",
                                "The page contents are still being downloaded.");
@@ -1675,12 +2491,12 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "document.reload") && document_App() == d) {
+    else if (cmdId == documentReload_CommandId && document_App() == d) {
         d->initNormScrollY = normScrollPos_DocumentWidget_(d);
         fetch_DocumentWidget_(d);
         return iTrue;
     }
-    else if (equal_Command(cmd, "document.linkkeys") && document_App() == d) {
+    else if (cmdId == documentLinkkeys_CommandId && document_App() == d) {
         if (argLabel_Command(cmd, "release")) {
             iChangeFlags(d->flags, showLinkNumbers_DocumentWidgetFlag, iFalse);
         }
@@ -1692,7 +2508,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         refresh_Widget(d);
         return iTrue;
     }
-    else if (equal_Command(cmd, "navigate.back") && document_App() == d) {
+    else if (cmdId == navigateBack_CommandId && document_App() == d) {
         if (d->request) {
             postCommandf_App(
                 "document.request.cancelled doc:%p url:%s", d, cstr_String(d->mod.url));
@@ -1702,11 +2518,11 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         goBack_History(d->mod.history);
         return iTrue;
     }
-    else if (equal_Command(cmd, "navigate.forward") && document_App() == d) {
+    else if (cmdId == navigateForward_CommandId && document_App() == d) {
         goForward_History(d->mod.history);
         return iTrue;
     }
-    else if (equal_Command(cmd, "navigate.parent") && document_App() == d) {
+    else if (cmdId == navigateParent_CommandId && document_App() == d) {
         iUrl parts;
         init_Url(&parts, d->mod.url);
         /* Remove the last path segment. */
@@ -1724,7 +2540,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "navigate.root") && document_App() == d) {
+    else if (cmdId == navigateRoot_CommandId && document_App() == d) {
         iUrl parts;
         init_Url(&parts, d->mod.url);
         postCommandf_App(
@@ -1737,7 +2553,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         updateVisible_DocumentWidget_(d);
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.page") && document_App() == d) {
+    else if (cmdId == scrollPage_CommandId && document_App() == d) {
         const int dir = arg_Command(cmd);
         if (dir > 0 && !argLabel_Command(cmd, "repeat") &&
             prefs_App()->loadImageInsteadOfScrolling &&
@@ -1750,7 +2566,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
                                      smoothDuration_DocumentWidget_);
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.top") && document_App() == d) {
+    else if (cmdId == scrollTop_CommandId && document_App() == d) {
         init_Anim(&d->scrollY, 0);
         invalidate_VisBuf(d->visBuf);
         scroll_DocumentWidget_(d, 0);
@@ -1758,7 +2574,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         refresh_Widget(w);
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.bottom") && document_App() == d) {
+    else if (cmdId == scrollBottom_CommandId && document_App() == d) {
         init_Anim(&d->scrollY, scrollMax_DocumentWidget_(d));
         invalidate_VisBuf(d->visBuf);
         scroll_DocumentWidget_(d, 0);
@@ -1766,7 +2582,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         refresh_Widget(w);
         return iTrue;
     }
-    else if (equal_Command(cmd, "scroll.step") && document_App() == d) {
+    else if (cmdId == scrollStep_CommandId && document_App() == d) {
         const int dir = arg_Command(cmd);
         if (dir > 0 && !argLabel_Command(cmd, "repeat") &&
             prefs_App()->loadImageInsteadOfScrolling &&
@@ -1778,7 +2594,7 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
                                      smoothDuration_DocumentWidget_);
         return iTrue;
     }
-    else if (equal_Command(cmd, "document.goto") && document_App() == d) {
+    else if (cmdId == documentGoto_CommandId && document_App() == d) {
         const iRangecc heading = range_Command(cmd, "heading");
         if (heading.start) {
             const char *target = cstr_Rangecc(heading);
@@ -1793,31 +2609,50 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             return iTrue;
         }
         const char *loc = pointerLabel_Command(cmd, "loc");
+        if (extendLayoutToLoc_GmDocument(d->doc, loc)) {
+            layoutExtended_DocumentWidget_(d);
+        }
         const iGmRun *run = findRunAtLoc_GmDocument(d->doc, loc);
         if (run) {
             scrollTo_DocumentWidget_(d, run->visBounds.pos.y, iFalse);
         }
         return iTrue;
     }
-    else if ((equal_Command(cmd, "find.next") || equal_Command(cmd, "find.prev")) &&
+    else if ((cmdId == findNext_CommandId || cmdId == findPrev_CommandId) &&
              document_App() == d) {
-        const int dir = equal_Command(cmd, "find.next") ? +1 : -1;
-        iRangecc (*finder)(const iGmDocument *, const iString *, const char *) =
-            dir > 0 ? findText_GmDocument : findTextBefore_GmDocument;
+        const int dir = cmdId == findNext_CommandId ? +1 : -1;
         iInputWidget *find = findWidget_App("find.input");
         if (isEmpty_String(text_InputWidget(find))) {
             d->foundMark = iNullRange;
+            updateMatchCount_DocumentWidget_(d);
         }
         else {
-            const iBool wrap = d->foundMark.start != NULL;
-            d->foundMark     = finder(d->doc, text_InputWidget(find), dir > 0 ? d->foundMark.end
-                                                                          : d->foundMark.start);
-            if (!d->foundMark.start && wrap) {
-                /* Wrap around. */
-                d->foundMark = finder(d->doc, text_InputWidget(find), NULL);
+            /* All matches are indexed at once; stepping is then just moving to a neighbor. */
+            const size_t numMatches = updateMatches_GmDocument(d->doc, text_InputWidget(find));
+            size_t index = 0;
+            if (numMatches == 0) {
+                d->foundMark = iNullRange;
             }
+            else if (!d->foundMark.start) {
+                index = (dir > 0 ? 0 : numMatches - 1);
+            }
+            else if (dir > 0) {
+                index = findMatch_GmDocument(d->doc, d->foundMark.start + 1);
+                if (index == numMatches) {
+                    index = 0; /* Wrap around. */
+                }
+            }
+            else {
+                index = findMatch_GmDocument(d->doc, d->foundMark.start);
+                index = (index == 0 ? numMatches : index) - 1;
+            }
+            d->foundMark = match_GmDocument(d->doc, index);
+            updateMatchCount_DocumentWidget_(d);
             if (d->foundMark.start) {
                 const iGmRun *found;
+                if (extendLayoutToLoc_GmDocument(d->doc, d->foundMark.start)) {
+                    layoutExtended_DocumentWidget_(d);
+                }
                 if ((found = findRunAtLoc_GmDocument(d->doc, d->foundMark.start)) != NULL) {
                     scrollTo_DocumentWidget_(d, mid_Rect(found->bounds).y, iTrue);
                 }
@@ -1828,11 +2663,14 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         refresh_Widget(w);
         return iTrue;
     }
-    else if (equal_Command(cmd, "find.clearmark")) {
+    else if (cmdId == findClearmark_CommandId) {
         if (d->foundMark.start) {
             d->foundMark = iNullRange;
             refresh_Widget(w);
         }
+        if (document_App() == d) {
+            updateMatchCount_DocumentWidget_(d);
+        }
         return iTrue;
     }
     return iFalse;
@@ -1935,6 +2773,14 @@ static iBool processPlayerEvents_DocumentWidget_(iDocumentWidget *d, const SDL_E
                 refresh_Widget(d);
                 return iTrue;
             }
+            else if (contains_Rect(ui.scrubberRect, mouse)) {
+                const float time = scrubberTime_PlayerUI(&ui, mouse);
+                if (time >= 0 && seek_Player(plr, time)) {
+                    animatePlayers_DocumentWidget_(d);
+                }
+                refresh_Widget(d);
+                return iTrue;
+            }
             else if (contains_Rect(ui.volumeRect, mouse)) {
                 setFlags_Player(plr,
                                 adjustingVolume_PlayerFlag,
@@ -1957,8 +2803,10 @@ static iBool processPlayerEvents_DocumentWidget_(iDocumentWidget *d, const SDL_E
                     as_Widget(d),
                     (iMenuItem[]){
                         { cstrCollect_String(metadataLabel_Player(plr)), 0, 0, NULL },
+                        { "---", 0, 0, NULL },
+                        { cstrCollect_String(bufferingLabel_PlayerUI(&ui)), 0, 0, NULL },
                     },
-                    1);
+                    3);
                 openMenu_Widget(d->playerMenu,
                                 localCoord_Widget(constAs_Widget(d), bottomLeft_Rect(ui.menuRect)));
                 return iTrue;
@@ -2043,7 +2891,7 @@ static iChar linkOrdinalChar_DocumentWidget_(const iDocumentWidget *d, size_t or
 static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *ev) {
     iWidget *w = as_Widget(d);
     if (ev->type == SDL_USEREVENT && ev->user.code == command_UserEventCode) {
-        if (!handleCommand_DocumentWidget_(d, command_UserEvent(ev))) {
+        if (!handleCommand_DocumentWidget_(d, command_UserEvent(ev), commandId_UserEvent(ev))) {
             /* Base class commands. */
             return processEvent_Widget(w, ev);
         }
@@ -2243,16 +3091,14 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
                                     (iMenuItem[]){ { "---", 0, 0, NULL },
                                                    { "Copy Link", 0, 0, "document.copylink" } },
                                     2);
-                    iMediaRequest *mediaReq;
-                    if ((mediaReq = findMediaRequest_DocumentWidget_(d, d->contextLink->linkId)) != NULL) {
-                        if (isFinished_GmRequest(mediaReq->req)) {
-                            pushBack_Array(&items,
-                                           &(iMenuItem){ "Save to Downloads",
-                                                         0,
-                                                         0,
-                                                         format_CStr("document.media.save link:%u",
-                                                                     d->contextLink->linkId) });
-                        }
+                    const iString *mediaMime;
+                    if (savableMedia_DocumentWidget_(d, d->contextLink->linkId, &mediaMime)) {
+                        pushBack_Array(&items,
+                                       &(iMenuItem){ "Save to Downloads",
+                                                     0,
+                                                     0,
+                                                     format_CStr("document.media.save link:%u",
+                                                                 d->contextLink->linkId) });
                     }
                 }
                 else {
@@ -2282,6 +3128,13 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
                                 { "Save to Downloads", SDLK_s, KMOD_PRIMARY, "document.save" } },
                             2);
                     }
+                    if (hasUnfetchedImages_DocumentWidget_(d)) {
+                        pushBackN_Array(
+                            &items,
+                            (iMenuItem[]){ { "---", 0, 0, NULL },
+                                           { "Load All Images", 0, 0, "document.media.loadall" } },
+                            2);
+                    }
                 }
                 d->menu = makeMenu_Widget(w, data_Array(&items), size_Array(&items));
                 deinit_Array(&items);
@@ -2359,14 +3212,16 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
                                               linkId,
                                               NULL,
                                               NULL,
+                                              NULL,
                                               allowHide_MediaFlag);
                                 /* Cancel a partially received request. */ {
                                     iMediaRequest *req = findMediaRequest_DocumentWidget_(d, linkId);
-                                    if (!isFinished_GmRequest(req->req)) {
+                                    if (req && !isFinished_GmRequest(req->req)) {
                                         cancel_GmRequest(req->req);
                                         removeMediaRequest_DocumentWidget_(d, linkId);
                                         /* Note: Some of the audio IDs have changed now, layout must
                                            be redone. */
+                                        startPendingMedia_DocumentWidget_(d);
                                     }
                                 }
                                 redoLayout_GmDocument(d->doc);
@@ -2383,6 +3238,7 @@ static iBool processEvent_DocumentWidget_(iDocumentWidget *d, const SDL_Event *e
                                 if (req) {
                                     setData_Media(media_GmDocument(d->doc),
                                                   linkId,
+                                                  sharedMediaUrl_DocumentWidget_(d, req),
                                                   meta_GmRequest(req->req),
                                                   body_GmRequest(req->req),
                                                   allowHide_MediaFlag);
@@ -2439,6 +3295,7 @@ struct Impl_DrawContext {
     iBool inSelectMark;
     iBool inFoundMark;
     iBool showLinkNumbers;
+    iBool ignoreWideOffsets; /* drawing into the wide block buffer */
 };
 
 static void fillRange_DrawContext_(iDrawContext *d, const iGmRun *run, enum iColorId color,
@@ -2484,9 +3341,36 @@ static void fillRange_DrawContext_(iDrawContext *d, const iGmRun *run, enum iCol
     }
 }
 
+static void drawOtherMatches_DrawContext_(iDrawContext *d, const iGmRun *run) {
+    const iGmDocument *doc = d->widget->doc;
+    if (!d->widget->foundMark.start || run->flags & decoration_GmRunFlag ||
+        isEmpty_Range(&run->text)) {
+        return;
+    }
+    const iInt2 visPos =
+        add_I2(run->bounds.pos, addY_I2(d->viewPos, -value_Anim(&d->widget->scrollY)));
+    for (size_t i = findMatch_GmDocument(doc, run->text.start); i < numMatches_GmDocument(doc);
+         i++) {
+        const iRangecc match = match_GmDocument(doc, i);
+        if (match.start >= run->text.end) {
+            break;
+        }
+        if (match.start == d->widget->foundMark.start) {
+            continue;
+        }
+        const int x = advanceRange_Text(run->font, (iRangecc){ run->text.start, match.start }).x;
+        const int w = advanceRange_Text(
+                          run->font, (iRangecc){ match.start, iMin(match.end, run->text.end) }).x;
+        drawRect_Paint(&d->paint,
+                       (iRect){ addX_I2(visPos, x), init_I2(w, height_Rect(run->bounds)) },
+                       uiMatching_ColorId);
+    }
+}
+
 static void drawMark_DrawContext_(void *context, const iGmRun *run) {
     iDrawContext *d = context;
     if (!run->imageId) {
+        drawOtherMatches_DrawContext_(d, run);
         fillRange_DrawContext_(d, run, uiMatching_ColorId, d->widget->foundMark, &d->inFoundMark);
         fillRange_DrawContext_(d, run, uiMarked_ColorId, d->widget->selectMark, &d->inSelectMark);
     }
@@ -2497,12 +3381,16 @@ static void drawRun_DrawContext_(void *context, const iGmRun *run) {
     const iInt2   origin = d->viewPos;
     if (run->imageId) {
         SDL_Texture *tex = imageTexture_Media(media_GmDocument(d->widget->doc), run->imageId);
+        const iRect  dst = moved_Rect(run->visBounds, origin);
         if (tex) {
-            const iRect dst = moved_Rect(run->visBounds, origin);
             fillRect_Paint(&d->paint, dst, tmBackground_ColorId); /* in case the image has alpha */
             SDL_RenderCopy(d->paint.dst->render, tex, NULL,
                            &(SDL_Rect){ dst.pos.x, dst.pos.y, dst.size.x, dst.size.y });
         }
+        else {
+            /* Placeholder while the image is being decoded. */
+            fillRect_Paint(&d->paint, dst, tmBannerBackground_ColorId);
+        }
         return;
     }
     else if (run->audioId) {
@@ -2514,9 +3402,11 @@ static void drawRun_DrawContext_(void *context, const iGmRun *run) {
     const iBool        isHover =
         (run->linkId && d->widget->hoverLink && run->linkId == d->widget->hoverLink->linkId &&
          ~run->flags & decoration_GmRunFlag);
+    const iBool isBuffered = d->ignoreWideOffsets ||
+                             (run->preId && run->preId == d->widget->wideBlockId);
     const iInt2 visPos = addX_I2(add_I2(run->visBounds.pos, origin),
                                  /* Preformatted runs can be scrolled. */
-                                 runOffset_DocumentWidget_(d->widget, run));
+                                 isBuffered ? 0 : runOffset_DocumentWidget_(d->widget, run));
     fillRect_Paint(&d->paint, (iRect){ visPos, run->visBounds.size }, tmBackground_ColorId);
     if (run->linkId && ~run->flags & decoration_GmRunFlag) {
         fg = linkColor_GmDocument(doc, run->linkId, isHover ? textHover_GmLinkPart : text_GmLinkPart);
@@ -2886,12 +3776,75 @@ static void drawPlayers_DocumentWidget_(const iDocumentWidget *d, iPaint *p) {
     }
 }
 
+static void drawWideBlock_DocumentWidget_(const iDocumentWidget *d, int yTop) {
+    if (!d->wideBlockId || !isOverlapping_Rangei(d->wideBlockSpan, visibleRange_DocumentWidget_(d))) {
+        return;
+    }
+    const iRect   bounds    = bounds_Widget(constAs_Widget(d));
+    const iRect   docBounds = documentBounds_DocumentWidget_(d);
+    SDL_Renderer *render    = renderer_Window(get_Window());
+    const iInt2   bufSize   = init_I2(d->wideBlockWidth, size_Range(&d->wideBlockSpan));
+    if (!d->wideBlockBuf) {
+        iDocumentWidget *m = iConstCast(iDocumentWidget *, d);
+        m->wideBlockBuf = SDL_CreateTexture(render,
+                                            SDL_PIXELFORMAT_RGBA8888,
+                                            SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
+                                            bufSize.x,
+                                            bufSize.y);
+        if (!m->wideBlockBuf) {
+            /* Fall back to drawing the block in the VisBuf with its offset. */
+            for (const iGmRun *r = d->wideBlockRange.start; r != d->wideBlockRange.end; r++) {
+                insert_PtrSet(m->invalidRuns, r);
+            }
+            releaseWideBlockBuf_DocumentWidget_(m);
+            refresh_Widget(m);
+            return;
+        }
+        SDL_SetTextureBlendMode(m->wideBlockBuf, SDL_BLENDMODE_NONE);
+        iDrawContext ctx = {
+            .widget            = d,
+            .widgetBounds      = init_Rect(0, -d->wideBlockSpan.start, bufSize.x, bufSize.y),
+            .viewPos           = init_I2(left_Rect(docBounds) - left_Rect(bounds),
+                                         -d->wideBlockSpan.start),
+            .ignoreWideOffsets = iTrue,
+        };
+        init_Paint(&ctx.paint);
+        beginTarget_Paint(&ctx.paint, m->wideBlockBuf);
+        fillRect_Paint(&ctx.paint, (iRect){ zero_I2(), bufSize }, tmBackground_ColorId);
+        for (const iGmRun *r = d->wideBlockRange.start; r != d->wideBlockRange.end; r++) {
+            drawRun_DrawContext_(&ctx, r);
+        }
+        endTarget_Paint(&ctx.paint);
+    }
+    /* Only the block's own column is covered, so the margins keep what the VisBuf has. */
+    int blockLeft = left_Rect(d->wideBlockRange.start->visBounds);
+    for (const iGmRun *r = d->wideBlockRange.start; r != d->wideBlockRange.end; r++) {
+        blockLeft = iMin(blockLeft, left_Rect(r->visBounds));
+    }
+    const int offset = -runOffset_DocumentWidget_(d, d->wideBlockRange.start);
+    const int srcX   = left_Rect(docBounds) - left_Rect(bounds) + blockLeft + offset;
+    const int dstX   = left_Rect(docBounds) + blockLeft;
+    const int width  = iMin(right_Rect(bounds) - width_Widget(d->scroll) - dstX, bufSize.x - srcX);
+    if (width > 0) {
+        SDL_RenderCopy(render,
+                       d->wideBlockBuf,
+                       &(SDL_Rect){ srcX, 0, width, bufSize.y },
+                       &(SDL_Rect){ dstX, yTop + d->wideBlockSpan.start, width, bufSize.y });
+    }
+}
+
 static void draw_DocumentWidget_(const iDocumentWidget *d) {
+    iBeginProfile(document);
     const iWidget *w        = constAs_Widget(d);
     const iRect    bounds   = bounds_Widget(w);
     iVisBuf *      visBuf   = d->visBuf; /* will be updated now */
     draw_Widget(w);
     allocVisBuffer_DocumentWidget_(d);
+    /* Images in view may be shown from the buffers, but their textures must not be released
+       under the texture memory budget. */
+    iConstForEach(PtrArray, img, &d->visibleImages) {
+        imageTexture_Media(media_GmDocument(d->doc), ((const iGmRun *) img.ptr)->imageId);
+    }
     const iRect ctxWidgetBounds = init_Rect(
         0, 0, width_Rect(bounds) - constAs_Widget(d->scroll)->rect.size.x, height_Rect(bounds));
     const iRect  docBounds = documentBounds_DocumentWidget_(d);
@@ -2903,12 +3856,13 @@ static void draw_DocumentWidget_(const iDocumentWidget *d) {
     const iRangei vis  = visibleRange_DocumentWidget_(d);
     const iRangei full = { 0, size_GmDocument(d->doc).y };
     reposition_VisBuf(visBuf, vis);
-    iRangei invalidRange[3];
+    iRangei invalidRange[maxBuffers_VisBuf];
     invalidRanges_VisBuf(visBuf, full, invalidRange);
     /* Redraw the invalid ranges. */ {
         iPaint *p = &ctx.paint;
         init_Paint(p);
-        iForIndices(i, visBuf->buffers) {
+        int drawnHeight = 0;
+        for (size_t i = 0; i < visBuf->numBuffers; i++) {
             iVisBufTexture *buf = &visBuf->buffers[i];
             ctx.widgetBounds = moved_Rect(ctxWidgetBounds, init_I2(0, -buf->origin));
             ctx.viewPos      = init_I2(left_Rect(docBounds) - left_Rect(bounds), -buf->origin);
@@ -2918,6 +3872,7 @@ static void draw_DocumentWidget_(const iDocumentWidget *d) {
                     fillRect_Paint(p, (iRect){ zero_I2(), visBuf->texSize }, tmBackground_ColorId);
                 }
                 render_GmDocument(d->doc, invalidRange[i], drawRun_DrawContext_, &ctx);
+                drawnHeight += size_Range(&invalidRange[i]);
             }
             /* Draw any invalidated runs that fall within this buffer. */ {
                 const iRangei bufRange = { buf->origin, buf->origin + visBuf->texSize.y };
@@ -2947,10 +3902,29 @@ static void draw_DocumentWidget_(const iDocumentWidget *d) {
         }
         validate_VisBuf(visBuf);
         clear_PtrSet(d->invalidRuns);
+        /* Use the rest of the frame's budget to prerender the buffers ahead of the visible
+           range, so they are ready when scrolled into view. */
+        const int budget = visBuf->texSize.y / 2 - drawnHeight;
+        size_t    index;
+        iRangei   range;
+        if (budget > 0 && prerenderRange_VisBuf(visBuf, full, budget, &index, &range)) {
+            iVisBufTexture *buf = &visBuf->buffers[index];
+            ctx.widgetBounds = moved_Rect(ctxWidgetBounds, init_I2(0, -buf->origin));
+            ctx.viewPos      = init_I2(left_Rect(docBounds) - left_Rect(bounds), -buf->origin);
+            beginTarget_Paint(p, buf->texture);
+            if (isEmpty_Rangei(buf->validRange)) {
+                fillRect_Paint(p, (iRect){ zero_I2(), visBuf->texSize }, tmBackground_ColorId);
+            }
+            render_GmDocument(d->doc, range, drawRun_DrawContext_, &ctx);
+            endTarget_Paint(p);
+            validateRange_VisBuf(visBuf, index, range);
+            refresh_Widget(w); /* continue in the next frame */
+        }
     }
     setClip_Paint(&ctx.paint, bounds);
     const int yTop = docBounds.pos.y - value_Anim(&d->scrollY);
     draw_VisBuf(visBuf, init_I2(bounds.pos.x, yTop));
+    drawWideBlock_DocumentWidget_(d, yTop);
     /* Text markers. */
     if (!isEmpty_Range(&d->foundMark) || !isEmpty_Range(&d->selectMark)) {
         SDL_SetRenderDrawBlendMode(renderer_Window(get_Window()),
@@ -2990,6 +3964,7 @@ static void draw_DocumentWidget_(const iDocumentWidget *d) {
     }
     drawSideElements_DocumentWidget_(d);
     draw_Widget(w);
+    iEndProfile(document);
 }
 
 /*----------------------------------------------------------------------------------------------*/
@@ -3011,6 +3986,9 @@ const iString *bookmarkTitle_DocumentWidget(const iDocumentWidget *d) {
     if (!isEmpty_String(title_GmDocument(d->doc))) {
         pushBack_StringArray(title, title_GmDocument(d->doc));
     }
+    else if (!isEmpty_String(d->pendingTitle)) {
+        pushBack_StringArray(title, d->pendingTitle);
+    }
     if (!isEmpty_String(d->titleUser)) {
         pushBack_StringArray(title, d->titleUser);
     }
@@ -3027,14 +4005,165 @@ const iString *bookmarkTitle_DocumentWidget(const iDocumentWidget *d) {
     return collect_String(joinCStr_StringArray(title, " \u2014 "));
 }
 
+/* Restored tabs are only parsed, laid out, and fetched when they are first shown. The URL
+   and title of each tab are saved before the rest of its state, which is prefixed with its
+   size. This lets the state of a tab be kept unparsed until needed, so the startup time
+   doesn't depend on how many tabs there are. */
+
+static void loadPendingState_DocumentWidget_(iDocumentWidget *d) {
+    if (d->pendingState) {
+        iBuffer *buf = new_Buffer();
+        open_Buffer(buf, d->pendingState);
+        setVersion_Stream(stream_Buffer(buf), d->pendingStateVersion);
+        deserialize_PersistentDocumentState(&d->mod, stream_Buffer(buf));
+        iRelease(buf);
+        delete_Block(d->pendingState);
+        d->pendingState = NULL;
+        parseUser_DocumentWidget_(d);
+    }
+}
+
+static void restorePending_DocumentWidget_(iDocumentWidget *d) {
+    if (d->flags & pendingRestore_DocumentWidgetFlag) {
+        d->flags &= ~pendingRestore_DocumentWidgetFlag;
+        loadPendingState_DocumentWidget_(d);
+        clear_String(d->pendingTitle);
+        if (!updateFromHistory_DocumentWidget_(d) && !isEmpty_String(d->mod.url)) {
+            fetch_DocumentWidget_(d);
+        }
+    }
+}
+
+/* A hibernated tab frees its document, media, and buffers, keeping only the history with
+   the current page's response. It is then restored like a tab that was never shown. */
+
+static iBool isPlayingAudio_DocumentWidget_(const iDocumentWidget *d) {
+    const iMedia *media = constMedia_GmDocument(d->doc);
+    for (iMediaId id = 1; id <= numAudio_Media(media); id++) {
+        const iPlayer *plr = audioPlayer_Media(media, id);
+        if (isStarted_Player(plr) && !isPaused_Player(plr)) {
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static iBool canRestore_DocumentWidget_(const iDocumentWidget *d) {
+    /* The page must be available without fetching it again. */
+    if (equalCase_Rangecc(urlScheme_String(d->mod.url), "about")) {
+        return iTrue;
+    }
+    const iRecentUrl *recent = constMostRecentUrl_History(d->mod.history);
+    return (recent && recent->cachedResponse) ||
+           age_ResponseCache(responseCache_App(), d->mod.url) >= 0;
+}
+
+iBool hibernate_DocumentWidget(iDocumentWidget *d) {
+    if (d == document_App() || d->flags & pendingRestore_DocumentWidgetFlag || d->request ||
+        d->state != ready_RequestState || isPlayingAudio_DocumentWidget_(d) ||
+        !canRestore_DocumentWidget_(d)) {
+        return iFalse;
+    }
+    set_String(d->pendingTitle, title_GmDocument(d->doc));
+    if (d->prefetchTimer) {
+        SDL_RemoveTimer(d->prefetchTimer);
+        d->prefetchTimer = 0;
+    }
+    iReleasePtr(&d->prefetch);
+    if (d->playerTimer) {
+        SDL_RemoveTimer(d->playerTimer);
+        d->playerTimer = 0;
+    }
+    clear_ObjectList(d->media);
+    clear_Array(&d->pendingMedia);
+    resetWideRuns_DocumentWidget_(d);
+    clear_PtrArray(&d->visibleLinks);
+    clear_PtrArray(&d->visibleWideRuns);
+    clear_PtrArray(&d->visiblePlayers);
+    clear_PtrArray(&d->visibleImages);
+    clear_PtrSet(d->invalidRuns);
+    d->hoverLink       = NULL;
+    d->contextLink     = NULL;
+    d->firstVisibleRun = NULL;
+    d->lastVisibleRun  = NULL;
+    d->grabbedPlayer   = NULL;
+    d->selectMark      = iNullRange;
+    d->foundMark       = iNullRange;
+    clear_Array(&d->outline);
+    if (d->sideIconBuf) {
+        SDL_DestroyTexture(d->sideIconBuf);
+        d->sideIconBuf = NULL;
+    }
+    delete_TextBuf(d->timestampBuf);
+    d->timestampBuf = NULL;
+    dealloc_VisBuf(d->visBuf);
+    deinit_Block(&d->sourceContent);
+    init_Block(&d->sourceContent, 0);
+    iRelease(d->doc);
+    d->doc = new_GmDocument();
+    purgeCachedResponses_History(d->mod.history);
+    d->state = blank_RequestState;
+    d->flags |= pendingRestore_DocumentWidgetFlag;
+    updateWindowTitle_DocumentWidget_(d);
+    return iTrue;
+}
+
+iBool isHibernated_DocumentWidget(const iDocumentWidget *d) {
+    return (d->flags & pendingRestore_DocumentWidgetFlag) != 0;
+}
+
+uint32_t idleTime_DocumentWidget(const iDocumentWidget *d) {
+    return d->hiddenTime ? SDL_GetTicks() - d->hiddenTime : 0;
+}
+
+size_t memorySize_DocumentWidget(const iDocumentWidget *d) {
+    iGmDocumentMemory docMem;
+    iMediaMemory      mediaMem;
+    memoryUsage_GmDocument(d->doc, &docMem);
+    memoryUsage_Media(constMedia_GmDocument(d->doc), &mediaMem);
+    return docMem.sourceBytes + docMem.layoutBytes + docMem.linkBytes +
+           docMem.cachedLayoutBytes + mediaMem.imageBytes + mediaMem.decodingBytes +
+           mediaMem.textureBytes + mediaMem.audioBytes + size_Block(&d->sourceContent) +
+           cachedBytes_History(d->mod.history);
+}
+
 void serializeState_DocumentWidget(const iDocumentWidget *d, iStream *outs) {
-    serialize_PersistentDocumentState(&d->mod, outs);
+    serialize_String(d->mod.url, outs);
+    serialize_String(isEmpty_String(title_GmDocument(d->doc)) ? d->pendingTitle
+                                                              : title_GmDocument(d->doc),
+                     outs);
+    if (d->pendingState && d->pendingStateVersion == latest_FileVersion) {
+        /* Never shown, so the state can be written back as it was read. */
+        writeU32_Stream(outs, (uint32_t) size_Block(d->pendingState));
+        writeData_Stream(outs, constData_Block(d->pendingState), size_Block(d->pendingState));
+        return;
+    }
+    loadPendingState_DocumentWidget_(iConstCast(iDocumentWidget *, d));
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    serialize_PersistentDocumentState(&d->mod, stream_Buffer(buf));
+    writeU32_Stream(outs, (uint32_t) size_Block(data_Buffer(buf)));
+    writeData_Stream(outs, constData_Block(data_Buffer(buf)), size_Block(data_Buffer(buf)));
+    iRelease(buf);
 }
 
 void deserializeState_DocumentWidget(iDocumentWidget *d, iStream *ins) {
-    deserialize_PersistentDocumentState(&d->mod, ins);
-    parseUser_DocumentWidget_(d);
-    updateFromHistory_DocumentWidget_(d);
+    if (version_Stream(ins) >= indexedTabDocuments_FileVersion) {
+        deserialize_String(d->mod.url, ins);
+        deserialize_String(d->pendingTitle, ins);
+        const size_t size = readU32_Stream(ins);
+        delete_Block(d->pendingState);
+        d->pendingState = new_Block(size);
+        readData_Stream(ins, size, data_Block(d->pendingState));
+        d->pendingStateVersion = version_Stream(ins);
+    }
+    else {
+        /* Older state files have to be parsed to find where the next tab begins. */
+        deserialize_PersistentDocumentState(&d->mod, ins);
+        parseUser_DocumentWidget_(d);
+    }
+    d->flags |= pendingRestore_DocumentWidgetFlag;
+    updateWindowTitle_DocumentWidget_(d);
 }
 
 void setUrlFromCache_DocumentWidget(iDocumentWidget *d, const iString *url, iBool isFromCache) {
@@ -3043,7 +4172,15 @@ void setUrlFromCache_DocumentWidget(iDocumentWidget *d, const iString *url, iBoo
         set_String(d->mod.url, url);
         /* See if there a username in the URL. */
         parseUser_DocumentWidget_(d);
-        if (!isFromCache || !updateFromHistory_DocumentWidget_(d)) {
+        /* Recently fetched pages are shown from the response cache even when navigating
+           to them anew. The timestamp shows the age; reloading fetches the page again. */
+        const iDocumentWidget *samePage = findSamePage_DocumentWidget_(d, isFromCache);
+        if (samePage && shareDocument_DocumentWidget_(d, samePage)) {
+            /* Already open in another tab. */
+        }
+        else if (isFromCache ? !updateFromHistory_DocumentWidget_(d)
+                             : !updateFromResponseCache_DocumentWidget_(
+                                   d, 0.0f, freshAge_DocumentWidget_)) {
             fetch_DocumentWidget_(d);
         }
     }
@@ -3057,7 +4194,9 @@ iDocumentWidget *duplicate_DocumentWidget(const iDocumentWidget *orig) {
     delete_History(d->mod.history);
     d->initNormScrollY = normScrollPos_DocumentWidget_(d);
     d->mod.history = copy_History(orig->mod.history);
-    setUrlFromCache_DocumentWidget(d, orig->mod.url, iTrue);
+    if (!shareDocument_DocumentWidget_(d, orig)) {
+        setUrlFromCache_DocumentWidget(d, orig->mod.url, iTrue);
+    }
     return d;
 }
 
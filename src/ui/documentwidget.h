@@ -48,3 +48,10 @@ void    setInitialScroll_DocumentWidget (iDocumentWidget *, float normScrollY);
 void    setRedirectCount_DocumentWidget (iDocumentWidget *, int count);
 
 void    updateSize_DocumentWidget       (iDocumentWidget *);
+
+/* Frees everything but the history of a background tab, which is restored when shown.
+   Returns iFalse if the tab is busy or its page would have to be fetched again. */
+iBool       hibernate_DocumentWidget        (iDocumentWidget *);
+iBool       isHibernated_DocumentWidget     (const iDocumentWidget *);
+uint32_t    idleTime_DocumentWidget         (const iDocumentWidget *); /* ms since hidden */
+size_t      memorySize_DocumentWidget       (const iDocumentWidget *); /* approximate */
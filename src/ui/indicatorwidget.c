@@ -32,8 +32,10 @@ static int timerId_;   /* common timer for all indicators */
 static int animCount_; /* number of animating indicators */
 
 static uint32_t postRefresh_(uint32_t interval, void *context) {
+    /* Called in timer thread. Animating indicators add their damage when the refresh
+       event is dispatched. */
     iUnused(context);
-    postRefresh_App();
+    postRefreshDamage_App();
     return interval;
 }
 
@@ -114,6 +116,9 @@ void draw_IndicatorWidget_(const iIndicatorWidget *d) {
 iBool processEvent_IndicatorWidget_(iIndicatorWidget *d, const SDL_Event *ev) {
     iWidget *w = &d->widget;
     if (ev->type == SDL_USEREVENT && ev->user.code == refresh_UserEventCode) {
+        if (isActive_IndicatorWidget_(d)) {
+            refresh_Widget(w);
+        }
         if (isFinished_Anim(&d->pos)) {
             stopTimer_IndicatorWidget_(d);
         }
@@ -35,18 +35,49 @@ static const size_t maxUndo_InputWidget_         = 64;
 
 iDeclareType(InputUndo)
 
+/* Undo steps only record the edited region of the text, so the cost of an edit does not
+   depend on the length of the text. */
 struct Impl_InputUndo {
-    iArray text;
+    iBool  isEdited;
+    size_t pos;         /* start of the edited region */
+    size_t numInserted; /* current length of the edited region */
+    iArray removed;     /* iChar[]: original contents of the edited region */
     size_t cursor;
 };
 
-static void init_InputUndo_(iInputUndo *d, const iArray *text, size_t cursor) {
-    initCopy_Array(&d->text, text);
+static void init_InputUndo_(iInputUndo *d, size_t cursor) {
+    d->isEdited    = iFalse;
+    d->pos         = 0;
+    d->numInserted = 0;
+    init_Array(&d->removed, sizeof(iChar));
     d->cursor = cursor;
 }
 
 static void deinit_InputUndo_(iInputUndo *d) {
-    deinit_Array(&d->text);
+    deinit_Array(&d->removed);
+}
+
+static void recordEdit_InputUndo_(iInputUndo *d, const iArray *text, size_t pos,
+                                  size_t numRemoved, size_t numInserted) {
+    if (!d->isEdited) {
+        d->isEdited    = iTrue;
+        d->pos         = pos;
+        d->numInserted = 0;
+    }
+    /* Grow the region to cover the new edit. The parts being added to the region are
+       still unmodified, so they are copied from the current text. */
+    const size_t start = iMin(pos, d->pos);
+    const size_t end   = iMax(pos + numRemoved, d->pos + d->numInserted);
+    if (end > d->pos + d->numInserted) {
+        pushBackN_Array(&d->removed,
+                        constAt_Array(text, d->pos + d->numInserted),
+                        end - d->pos - d->numInserted);
+    }
+    if (start < d->pos) {
+        insertN_Array(&d->removed, 0, constAt_Array(text, start), d->pos - start);
+    }
+    d->pos         = start;
+    d->numInserted = end - start - numRemoved + numInserted;
 }
 
 struct Impl_InputWidget {
@@ -59,6 +90,9 @@ struct Impl_InputWidget {
     size_t          maxLen;
     iArray          text;    /* iChar[] */
     iArray          oldText; /* iChar[] */
+    iString         visText;
+    iArray          visTextEnds; /* uint32_t[]: byte offsets where up-to-date characters end */
+    iBool           isVisTextDirty;
     iString         hint;
     size_t          cursor;
     size_t          lastCursor;
@@ -91,6 +125,9 @@ void init_InputWidget(iInputWidget *d, size_t maxLen) {
     setFlags_Widget(w, focusable_WidgetFlag | hover_WidgetFlag, iTrue);
     init_Array(&d->text, sizeof(iChar));
     init_Array(&d->oldText, sizeof(iChar));
+    init_String(&d->visText);
+    init_Array(&d->visTextEnds, sizeof(uint32_t));
+    d->isVisTextDirty   = iFalse;
     init_String(&d->hint);
     init_Array(&d->undoStack, sizeof(iInputUndo));
     d->font             = uiInput_FontId;
@@ -120,13 +157,37 @@ void deinit_InputWidget(iInputWidget *d) {
         SDL_RemoveTimer(d->timer);
     }
     deinit_String(&d->hint);
+    deinit_Array(&d->visTextEnds);
+    deinit_String(&d->visText);
     deinit_Array(&d->oldText);
     deinit_Array(&d->text);
 }
 
+static void invalidateVisText_InputWidget_(iInputWidget *d, size_t pos) {
+    if (pos < size_Array(&d->visTextEnds)) {
+        resize_Array(&d->visTextEnds, pos);
+    }
+    d->isVisTextDirty = iTrue;
+}
+
+static void replace_InputWidget_(iInputWidget *d, size_t pos, size_t numRemoved,
+                                 const iChar *inserted, size_t numInserted) {
+    if (!isEmpty_Array(&d->undoStack)) {
+        /* Edits are part of the latest undo step. */
+        recordEdit_InputUndo_(back_Array(&d->undoStack), &d->text, pos, numRemoved, numInserted);
+    }
+    if (numRemoved) {
+        removeN_Array(&d->text, pos, numRemoved);
+    }
+    if (numInserted) {
+        insertN_Array(&d->text, pos, inserted, numInserted);
+    }
+    invalidateVisText_InputWidget_(d, pos);
+}
+
 static void pushUndo_InputWidget_(iInputWidget *d) {
     iInputUndo undo;
-    init_InputUndo_(&undo, &d->text, d->cursor);
+    init_InputUndo_(&undo, d->cursor);
     pushBack_Array(&d->undoStack, &undo);
     if (size_Array(&d->undoStack) > maxUndo_InputWidget_) {
         deinit_InputUndo_(front_Array(&d->undoStack));
@@ -137,7 +198,16 @@ static void pushUndo_InputWidget_(iInputWidget *d) {
 static iBool popUndo_InputWidget_(iInputWidget *d) {
     if (!isEmpty_Array(&d->undoStack)) {
         iInputUndo *undo = back_Array(&d->undoStack);
-        setCopy_Array(&d->text, &undo->text);
+        if (undo->isEdited) {
+            removeN_Array(&d->text, undo->pos, undo->numInserted);
+            if (!isEmpty_Array(&undo->removed)) {
+                insertN_Array(&d->text,
+                              undo->pos,
+                              constData_Array(&undo->removed),
+                              size_Array(&undo->removed));
+            }
+            invalidateVisText_InputWidget_(d, undo->pos);
+        }
         d->cursor = undo->cursor;
         deinit_InputUndo_(undo);
         popBack_Array(&d->undoStack);
@@ -153,6 +223,7 @@ void setMode_InputWidget(iInputWidget *d, enum iInputMode mode) {
 
 void setSensitive_InputWidget(iInputWidget *d, iBool isSensitive) {
     d->isSensitive = isSensitive;
+    invalidateVisText_InputWidget_(d, 0);
 }
 
 const iString *text_InputWidget(const iInputWidget *d) {
@@ -163,6 +234,8 @@ void setMaxLen_InputWidget(iInputWidget *d, size_t maxLen) {
     d->maxLen = maxLen;
     d->mode   = (maxLen == 0 ? insert_InputMode : overwrite_InputMode);
     resize_Array(&d->text, maxLen);
+    clearUndo_InputWidget_(d);
+    invalidateVisText_InputWidget_(d, 0);
     if (maxLen) {
         /* Set a fixed size. */
         iBlock *content = new_Block(maxLen);
@@ -180,18 +253,23 @@ void setHint_InputWidget(iInputWidget *d, const char *hintText) {
 
 static const iChar sensitiveChar_ = 0x25cf; /* black circle */
 
-static iString *visText_InputWidget_(const iInputWidget *d) {
-    iString *text;
-    if (!d->isSensitive) {
-        text = newUnicodeN_String(constData_Array(&d->text), size_Array(&d->text));
-    }
-    else {
-        text = new_String();
-        for (size_t i = 0; i < size_Array(&d->text); ++i) {
-            appendChar_String(text, sensitiveChar_);
+static const iString *visText_InputWidget_(const iInputWidget *d) {
+    if (d->isVisTextDirty) {
+        /* Re-encode only the characters starting from the first edited one. */
+        iInputWidget *m        = iConstCast(iInputWidget *, d);
+        const size_t  numValid = size_Array(&d->visTextEnds);
+        truncate_Block(&m->visText.chars,
+                       numValid ? constValue_Array(&d->visTextEnds, numValid - 1, uint32_t) : 0);
+        for (size_t i = numValid; i < size_Array(&d->text); ++i) {
+            appendChar_String(&m->visText,
+                              d->isSensitive ? sensitiveChar_
+                                             : constValue_Array(&d->text, i, iChar));
+            const uint32_t end = size_String(&d->visText);
+            pushBack_Array(&m->visTextEnds, &end);
         }
+        m->isVisTextDirty = iFalse;
     }
-    return text;
+    return &d->visText;
 }
 
 static void invalidateBuffered_InputWidget_(iInputWidget *d) {
@@ -203,9 +281,7 @@ static void invalidateBuffered_InputWidget_(iInputWidget *d) {
 
 static void updateBuffered_InputWidget_(iInputWidget *d) {
     invalidateBuffered_InputWidget_(d);
-    iString *visText = visText_InputWidget_(d);
-    d->buffered = new_TextBuf(d->font, cstr_String(visText));
-    delete_String(visText);
+    d->buffered = new_TextBuf(d->font, cstr_String(visText_InputWidget_(d)));
 }
 
 void setText_InputWidget(iInputWidget *d, const iString *text) {
@@ -214,6 +290,7 @@ void setText_InputWidget(iInputWidget *d, const iString *text) {
     iConstForEach(String, i, text) {
         pushBack_Array(&d->text, &i.value);
     }
+    invalidateVisText_InputWidget_(d, 0);
     if (isFocused_Widget(d)) {
         d->cursor = size_Array(&d->text);
         selectAll_InputWidget(d);
@@ -235,15 +312,19 @@ void setTextCStr_InputWidget(iInputWidget *d, const char *cstr) {
 }
 
 static uint32_t cursorTimer_(uint32_t interval, void *w) {
-    iInputWidget *d = w;
+    /* Called in timer thread; don't access the widget. */
+    postCommand_Widget(w, "input.blink");
+    return interval;
+}
+
+static void blinkCursor_InputWidget_(iInputWidget *d) {
     if (d->cursorVis > 1) {
         d->cursorVis--;
     }
     else {
         d->cursorVis ^= 1;
     }
-    refresh_Widget(w);
-    return interval;
+    refresh_Widget(as_Widget(d));
 }
 
 void selectAll_InputWidget(iInputWidget *d) {
@@ -288,6 +369,8 @@ void end_InputWidget(iInputWidget *d, iBool accept) {
     }
     if (!accept) {
         setCopy_Array(&d->text, &d->oldText);
+        clearUndo_InputWidget_(d);
+        invalidateVisText_InputWidget_(d, 0);
     }
     updateBuffered_InputWidget_(d);
     SDL_RemoveTimer(d->timer);
@@ -303,14 +386,12 @@ void end_InputWidget(iInputWidget *d, iBool accept) {
 
 static void insertChar_InputWidget_(iInputWidget *d, iChar chr) {
     if (d->mode == insert_InputMode) {
-        insert_Array(&d->text, d->cursor, &chr);
+        replace_InputWidget_(d, d->cursor, 0, &chr, 1);
         d->cursor++;
     }
     else if (d->maxLen == 0 || d->cursor < d->maxLen) {
-        if (d->cursor >= size_Array(&d->text)) {
-            resize_Array(&d->text, d->cursor + 1);
-        }
-        set_Array(&d->text, d->cursor++, &chr);
+        replace_InputWidget_(d, d->cursor, d->cursor < size_Array(&d->text) ? 1 : 0, &chr, 1);
+        d->cursor++;
         if (d->maxLen && d->cursor == d->maxLen) {
             setFocus_Widget(NULL);
         }
@@ -374,7 +455,7 @@ static void contentsWereChanged_InputWidget_(iInputWidget *d) {
 static iBool deleteMarked_InputWidget_(iInputWidget *d) {
     const iRanges m = mark_InputWidget_(d);
     if (!isEmpty_Range(&m)) {
-        removeRange_Array(&d->text, m);
+        replace_InputWidget_(d, m.start, size_Range(&m), NULL, 0);
         setCursor_InputWidget(d, m.start);
         iZap(d->mark);
         return iTrue;
@@ -457,9 +538,9 @@ static iInt2 textOrigin_InputWidget_(const iInputWidget *d, const char *visText)
 }
 
 static size_t coordIndex_InputWidget_(const iInputWidget *d, iInt2 coord) {
-    iString *visText = visText_InputWidget_(d);
-    iInt2    pos     = sub_I2(coord, textOrigin_InputWidget_(d, cstr_String(visText)));
-    size_t   index   = 0;
+    const iString *visText = visText_InputWidget_(d);
+    iInt2          pos     = sub_I2(coord, textOrigin_InputWidget_(d, cstr_String(visText)));
+    size_t         index   = 0;
     if (pos.x > 0) {
         const char *endPos;
         tryAdvanceNoWrap_Text(d->font, range_String(visText), pos.x, &endPos);
@@ -467,15 +548,21 @@ static size_t coordIndex_InputWidget_(const iInputWidget *d, iInt2 coord) {
             index = cursorMax_InputWidget_(d);
         }
         else {
-            /* Need to know the actual character index. */
-            /* TODO: tryAdvance could tell us this directly with an extra return value */
-            iConstForEach(String, i, visText) {
-                if (i.pos >= endPos) break;
-                index++;
+            /* Need to know the actual character index: the number of characters that
+               end before the position. */
+            const uint32_t offset = endPos - cstr_String(visText);
+            size_t         hi     = size_Array(&d->visTextEnds);
+            while (index < hi) {
+                const size_t mid = (index + hi) / 2;
+                if (constValue_Array(&d->visTextEnds, mid, uint32_t) <= offset) {
+                    index = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
             }
         }
     }
-    delete_String(visText);
     return index;
 }
 
@@ -504,6 +591,12 @@ static iBool processEvent_InputWidget_(iInputWidget *d, const SDL_Event *ev) {
         end_InputWidget(d, iTrue);
         return iFalse;
     }
+    else if (isCommand_Widget(w, ev, "input.blink")) {
+        if (d->timer) {
+            blinkCursor_InputWidget_(d);
+        }
+        return iTrue;
+    }
     else if (isCommand_UserEvent(ev, "theme.changed")) {
         if (d->buffered) {
             updateBuffered_InputWidget_(d);
@@ -599,7 +692,8 @@ static iBool processEvent_InputWidget_(iInputWidget *d, const SDL_Event *ev) {
                 }
                 else if (d->cursor > 0) {
                     pushUndo_InputWidget_(d);
-                    remove_Array(&d->text, --d->cursor);
+                    d->cursor--;
+                    replace_InputWidget_(d, d->cursor, 1, NULL, 0);
                     contentsWereChanged_InputWidget_(d);
                 }
                 showCursor_InputWidget_(d);
@@ -622,7 +716,7 @@ static iBool processEvent_InputWidget_(iInputWidget *d, const SDL_Event *ev) {
                 }
                 else if (d->cursor < size_Array(&d->text)) {
                     pushUndo_InputWidget_(d);
-                    remove_Array(&d->text, d->cursor);
+                    replace_InputWidget_(d, d->cursor, 1, NULL, 0);
                     contentsWereChanged_InputWidget_(d);
                 }
                 showCursor_InputWidget_(d);
@@ -637,7 +731,8 @@ static iBool processEvent_InputWidget_(iInputWidget *d, const SDL_Event *ev) {
                     }
                     else {
                         pushUndo_InputWidget_(d);
-                        removeN_Array(&d->text, d->cursor, size_Array(&d->text) - d->cursor);
+                        replace_InputWidget_(
+                            d, d->cursor, size_Array(&d->text) - d->cursor, NULL, 0);
                         contentsWereChanged_InputWidget_(d);
                     }
                     showCursor_InputWidget_(d);
@@ -730,9 +825,9 @@ static void draw_InputWidget_(const iInputWidget *d) {
                                contains_Widget(w, mouseCoord_Window(get_Window()));
     iPaint p;
     init_Paint(&p);
-    iString *text = visText_InputWidget_(d);
+    const iString *text = visText_InputWidget_(d);
     if (isWhite_(text) && !isEmpty_String(&d->hint)) {
-        set_String(text, &d->hint);
+        text   = &d->hint;
         isHint = iTrue;
     }
     fillRect_Paint(
@@ -788,7 +883,6 @@ static void draw_InputWidget_(const iInputWidget *d) {
         draw_Text(d->font, curPos, uiInputCursorText_ColorId, "%s", cstr_String(&cur));
         deinit_String(&cur);
     }
-    delete_String(text);
     drawChildren_Widget(w);
 }
 
@@ -21,6 +21,7 @@ ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "keys.h"
+#include "profiler.h"
 #include "util.h"
 #include "app.h"
 
@@ -78,6 +79,9 @@ static const struct { int id; iMenuItem bind; int flags; } defaultBindings_[] =
     { 41, { "Open link via modifier key", SDLK_LALT, 0,                 "document.linkkeys arg:0" }, argRelease_BindFlag },
     { 80, { "Previous tab",              prevTab_KeyShortcut,           "tabs.prev"          }, 0 },
     { 81, { "Next tab",                  nextTab_KeyShortcut,           "tabs.next"          }, 0 },
+#if defined (LAGRANGE_PROFILER)
+    { 90, { "Toggle frame profiler",     SDLK_F12, 0,                   "profiler.toggle"    }, 0 },
+#endif
     /* The following cannot currently be changed (built-in duplicates). */
     { 1000, { NULL, SDLK_SPACE, KMOD_SHIFT, "scroll.page arg:-1" }, argRepeat_BindFlag },
     { 1001, { NULL, SDLK_SPACE, 0, "scroll.page arg:1" }, argRepeat_BindFlag },
@@ -218,29 +218,32 @@ static void draw_LabelWidget_(const iLabelWidget *d) {
         drawWrapRange_Text(d->font, topLeft_Rect(inner), wrap, fg, range_String(&d->label));
     }
     else if (flags & alignLeft_WidgetFlag) {
-        draw_Text(d->font, add_I2(bounds.pos, padding_(flags)), fg, cstr_String(&d->label));
+        drawRetained_Text(d->font,
+                          add_I2(bounds.pos, padding_(flags)),
+                          fg,
+                          left_Alignment,
+                          range_String(&d->label));
         if ((flags & drawKey_WidgetFlag) && d->key) {
             iString str;
             init_String(&str);
             keyStr_LabelWidget_(d, &str);
-            drawAlign_Text(uiShortcuts_FontId,
-                           add_I2(topRight_Rect(bounds), negX_I2(padding_(flags))),
-                           flags & pressed_WidgetFlag ? fg : uiTextShortcut_ColorId,
-                           right_Alignment,
-                           cstr_String(&str));
+            drawRetained_Text(uiShortcuts_FontId,
+                              add_I2(topRight_Rect(bounds), negX_I2(padding_(flags))),
+                              flags & pressed_WidgetFlag ? fg : uiTextShortcut_ColorId,
+                              right_Alignment,
+                              range_String(&str));
             deinit_String(&str);
         }
     }
     else if (flags & alignRight_WidgetFlag) {
-        drawAlign_Text(
-            d->font,
-            add_I2(topRight_Rect(bounds), negX_I2(padding_(flags))),
-            fg,
-            right_Alignment,
-            cstr_String(&d->label));
+        drawRetained_Text(d->font,
+                          add_I2(topRight_Rect(bounds), negX_I2(padding_(flags))),
+                          fg,
+                          right_Alignment,
+                          range_String(&d->label));
     }
     else {
-        drawCentered_Text(d->font, bounds, d->alignVisual, fg, cstr_String(&d->label));
+        drawCenteredRetained_Text(d->font, bounds, d->alignVisual, fg, range_String(&d->label));
     }
     unsetClip_Paint(&p);
 }
@@ -275,6 +278,7 @@ void updateSize_LabelWidget(iLabelWidget *d) {
     if (~flags & fixedHeight_WidgetFlag) {
         w->rect.size.y = size.y;
     }
+    invalidateLayout_Widget(w);
 }
 
 void init_LabelWidget(iLabelWidget *d, const char *label, const char *cmd) {
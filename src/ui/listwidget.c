@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 void init_ListItem(iListItem *d) {
     d->isSeparator = iFalse;
     d->isSelected  = iFalse;
+    d->height      = 0;
 }
 
 void deinit_ListItem(iListItem *d) {
@@ -51,6 +52,7 @@ struct Impl_ListWidget {
     int scrollY;
     int itemHeight;
     iPtrArray items;
+    iArray itemTops; /* int; top of each item, plus the bottom of the last one */
     size_t hoverItem;
     iClick click;
     iIntSet invalidItems;
@@ -67,6 +69,8 @@ void init_ListWidget(iListWidget *d) {
     setThumb_ScrollWidget(d->scroll, 0, 0);
     d->scrollY = 0;
     init_PtrArray(&d->items);
+    init_Array(&d->itemTops, sizeof(int));
+    pushBack_Array(&d->itemTops, &(int){ 0 });
     d->hoverItem = iInvalidPos;
     init_Click(&d->click, d, SDL_BUTTON_LEFT);
     init_IntSet(&d->invalidItems);
@@ -76,10 +80,53 @@ void init_ListWidget(iListWidget *d) {
 void deinit_ListWidget(iListWidget *d) {
     clear_ListWidget(d);
     deinit_PtrArray(&d->items);
+    deinit_Array(&d->itemTops);
     delete_VisBuf(d->visBuf);
 }
 
+static int itemHeight_ListWidget_(const iListWidget *d, const iListItem *item) {
+    return item->height > 0 ? item->height : d->itemHeight;
+}
+
+static int itemTop_ListWidget_(const iListWidget *d, size_t index) {
+    return *(const int *) constAt_Array(&d->itemTops, index);
+}
+
+static int contentHeight_ListWidget_(const iListWidget *d) {
+    return itemTop_ListWidget_(d, size_PtrArray(&d->items));
+}
+
+static void updateItemTops_ListWidget_(iListWidget *d) {
+    int top = 0;
+    clear_Array(&d->itemTops);
+    pushBack_Array(&d->itemTops, &top);
+    iConstForEach(PtrArray, i, &d->items) {
+        top += itemHeight_ListWidget_(d, i.ptr);
+        pushBack_Array(&d->itemTops, &top);
+    }
+}
+
+static size_t findItem_ListWidget_(const iListWidget *d, int y) {
+    /* Binary search for the last item whose top is at or above `y`. */
+    size_t lo = 0, hi = size_PtrArray(&d->items);
+    while (lo + 1 < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (itemTop_ListWidget_(d, mid) <= y) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+iRangei itemSpan_ListWidget(const iListWidget *d, size_t index) {
+    return (iRangei){ itemTop_ListWidget_(d, index), itemTop_ListWidget_(d, index + 1) };
+}
+
 void invalidate_ListWidget(iListWidget *d) {
+    updateItemTops_ListWidget_(d);
     invalidate_VisBuf(d->visBuf);
     clear_IntSet(&d->invalidItems); /* all will be drawn */
     refresh_Widget(as_Widget(d));
@@ -95,11 +142,85 @@ void clear_ListWidget(iListWidget *d) {
         deref_Object(i.ptr);
     }
     clear_PtrArray(&d->items);
+    updateItemTops_ListWidget_(d);
     d->hoverItem = iInvalidPos;
 }
 
 void addItem_ListWidget(iListWidget *d, iAnyObject *item) {
+    /* Measured before adding, while the last entry of `itemTops` is the current bottom. */
+    const int bottom = contentHeight_ListWidget_(d) + itemHeight_ListWidget_(d, item);
     pushBack_PtrArray(&d->items, ref_Object(item));
+    pushBack_Array(&d->itemTops, &bottom);
+}
+
+static size_t findKey_ListWidget_(const iListWidget *d, size_t start, const iListItem *key,
+                                  iListItemCompareFunc isSameKey) {
+    /* Only look a short way ahead; a row that moved further is simply recreated. */
+    const size_t end = iMin(start + 32, size_PtrArray(&d->items));
+    for (size_t i = start; i < end; i++) {
+        if (isSameKey(constAt_PtrArray(&d->items, i), key)) {
+            return i;
+        }
+    }
+    return iInvalidPos;
+}
+
+void updateItems_ListWidget(iListWidget *d, const iPtrArray *items, iListItemCompareFunc isSameKey,
+                            iListItemCompareFunc isSameContent) {
+    const int oldHeight = contentHeight_ListWidget_(d);
+    iArray oldTops;
+    initCopy_Array(&oldTops, &d->itemTops);
+    size_t numChanged = 0;
+    size_t pos = 0;
+    iConstForEach(PtrArray, i, items) {
+        const iListItem *newItem = i.ptr;
+        const size_t     found   = findKey_ListWidget_(d, pos, newItem, isSameKey);
+        if (found == iInvalidPos) {
+            insert_PtrArray(&d->items, pos, ref_Object(newItem));
+            insert_IntSet(&d->invalidItems, (int) pos);
+            numChanged++;
+        }
+        else {
+            /* Rows in between were removed. */
+            for (size_t j = pos; j < found; j++) {
+                deref_Object(at_PtrArray(&d->items, pos));
+                remove_Array(&d->items, pos);
+            }
+            iListItem *oldItem = at_PtrArray(&d->items, pos);
+            if (!isSameContent(oldItem, newItem)) {
+                set_PtrArray(&d->items, pos, ref_Object(newItem));
+                deref_Object(oldItem);
+                insert_IntSet(&d->invalidItems, (int) pos);
+                numChanged++;
+            }
+        }
+        pos++;
+    }
+    while (size_PtrArray(&d->items) > pos) {
+        deref_Object(back_PtrArray(&d->items));
+        popBack_Array(&d->items);
+    }
+    updateItemTops_ListWidget_(d);
+    if (contentHeight_ListWidget_(d) < oldHeight) {
+        /* The area below the last row has stale contents. */
+        invalidate_ListWidget(d);
+    }
+    else {
+        /* Rows that kept their object and position are still valid in the buffers. */
+        for (size_t i = 0; i < size_PtrArray(&d->items); i++) {
+            if (i + 1 >= size_Array(&oldTops) ||
+                itemTop_ListWidget_(d, i) != *(const int *) constAt_Array(&oldTops, i) ||
+                itemTop_ListWidget_(d, i + 1) != *(const int *) constAt_Array(&oldTops, i + 1)) {
+                invalidateItem_ListWidget(d, i);
+            }
+        }
+    }
+    if (numChanged || size_Array(&oldTops) != size_Array(&d->itemTops)) {
+        d->hoverItem = iInvalidPos;
+    }
+    deinit_Array(&oldTops);
+    scrollOffset_ListWidget(d, 0); /* clamp to the new content height */
+    updateVisible_ListWidget(d);
 }
 
 iScrollWidget *scroll_ListWidget(iListWidget *d) {
@@ -112,12 +233,12 @@ size_t numItems_ListWidget(const iListWidget *d) {
 
 static int scrollMax_ListWidget_(const iListWidget *d) {
     return iMax(0,
-                (int) size_PtrArray(&d->items) * d->itemHeight -
+                contentHeight_ListWidget_(d) -
                     height_Rect(innerBounds_Widget(constAs_Widget(d))));
 }
 
 void updateVisible_ListWidget(iListWidget *d) {
-    const int   contentSize = size_PtrArray(&d->items) * d->itemHeight;
+    const int   contentSize = contentHeight_ListWidget_(d);
     const iRect bounds      = innerBounds_Widget(as_Widget(d));
     const iBool wasVisible  = isVisible_Widget(d->scroll);
     if (area_Rect(bounds) == 0) {
@@ -136,7 +257,7 @@ void updateVisible_ListWidget(iListWidget *d) {
 
 void setItemHeight_ListWidget(iListWidget *d, int itemHeight) {
     d->itemHeight = itemHeight;
-    invalidate_ListWidget(d);
+    invalidate_ListWidget(d); /* item tops are recalculated */
 }
 
 int scrollBarWidth_ListWidget(const iListWidget *d) {
@@ -176,9 +297,13 @@ void scrollOffset_ListWidget(iListWidget *d, int offset) {
 }
 
 void scrollToItem_ListWidget(iListWidget *d, size_t index) {
-    const iRect rect    = innerBounds_Widget(as_Widget(d));
-    int         yTop    = d->itemHeight * index - d->scrollY;
-    int         yBottom = yTop + d->itemHeight;
+    if (index >= size_PtrArray(&d->items)) {
+        return;
+    }
+    const iRect   rect    = innerBounds_Widget(as_Widget(d));
+    const iRangei span    = itemSpan_ListWidget(d, index);
+    int           yTop    = span.start - d->scrollY;
+    int           yBottom = span.end - d->scrollY;
     if (yBottom > height_Rect(rect)) {
         scrollOffset_ListWidget(d, yBottom - height_Rect(rect));
     }
@@ -192,22 +317,11 @@ int visCount_ListWidget(const iListWidget *d) {
                 (int) size_PtrArray(&d->items));
 }
 
-static iRanges visRange_ListWidget_(const iListWidget *d) {
-    if (d->itemHeight == 0) {
-        return (iRanges){ 0, 0 };
-    }
-    iRanges vis = { d->scrollY / d->itemHeight, 0 };
-    vis.end = iMin(size_PtrArray(&d->items), vis.start + visCount_ListWidget(d) + 1);
-    return vis;
-}
-
 size_t itemIndex_ListWidget(const iListWidget *d, iInt2 pos) {
     const iRect bounds = innerBounds_Widget(constAs_Widget(d));
     pos.y -= top_Rect(bounds) - d->scrollY;
-    if (pos.y < 0 || !d->itemHeight) return iInvalidPos;
-    size_t index = pos.y / d->itemHeight;
-    if (index >= size_Array(&d->items)) return iInvalidPos;
-    return index;
+    if (pos.y < 0 || pos.y >= contentHeight_ListWidget_(d)) return iInvalidPos;
+    return findItem_ListWidget_(d, pos.y);
 }
 
 const iAnyObject *constItem_ListWidget(const iListWidget *d, size_t index) {
@@ -258,6 +372,7 @@ void updateMouseHover_ListWidget(iListWidget *d) {
 
 void sort_ListWidget(iListWidget *d, int (*cmp)(const iListItem **item1, const iListItem **item2)) {
     sort_Array(&d->items, (iSortedArrayCompareElemFunc) cmp);
+    updateItemTops_ListWidget_(d);
 }
 
 static void redrawHoverItem_ListWidget_(iListWidget *d) {
@@ -345,7 +460,7 @@ static void draw_ListWidget_(const iListWidget *d) {
     iPaint p;
     init_Paint(&p);
     drawBackground_Widget(w);
-    alloc_VisBuf(d->visBuf, bounds.size, d->itemHeight);
+    alloc_VisBuf(d->visBuf, bounds.size, d->itemHeight, 3);
     /* Update invalid regions/items. */ {
         /* TODO: This seems to draw two items per each shift of the visible region, even though
            one should be enough. Probably an off-by-one error in the calculation of the
@@ -353,50 +468,62 @@ static void draw_ListWidget_(const iListWidget *d) {
         iAssert(d->visBuf->buffers[0].texture);
         iAssert(d->visBuf->buffers[1].texture);
         iAssert(d->visBuf->buffers[2].texture);
-        const int bg[3] = { w->bgColor, w->bgColor, w->bgColor };
-//        const int bg[3] = { red_ColorId, magenta_ColorId, blue_ColorId };
-        const int bottom = numItems_ListWidget(d) * d->itemHeight;
-        const iRangei vis = { d->scrollY / d->itemHeight * d->itemHeight,
-                             ((d->scrollY + bounds.size.y) / d->itemHeight + 1) * d->itemHeight };
+        const int bg = w->bgColor;
+        const int bottom = contentHeight_ListWidget_(d);
+        const size_t numItems = numItems_ListWidget(d);
+        const iRangei vis = { numItems ? itemTop_ListWidget_(d, findItem_ListWidget_(d, d->scrollY)) : 0,
+                              numItems ? itemSpan_ListWidget(
+                                             d, findItem_ListWidget_(d, d->scrollY + bounds.size.y))
+                                             .end
+                                       : bounds.size.y };
         reposition_VisBuf(d->visBuf, vis);
         /* Check which parts are invalid. */
-        iRangei invalidRange[3];
+        iRangei invalidRange[maxBuffers_VisBuf];
         invalidRanges_VisBuf(d->visBuf, (iRangei){ 0, bottom }, invalidRange);
-        iForIndices(i, d->visBuf->buffers) {
+        for (size_t i = 0; i < d->visBuf->numBuffers; i++) {
             iVisBufTexture *buf = &d->visBuf->buffers[i];
-            iRanges drawItems = { iMax(0, buf->origin) / d->itemHeight,
-                                  iMax(0, buf->origin + d->visBuf->texSize.y) / d->itemHeight };
+            const iRangei bufRange = { buf->origin, buf->origin + d->visBuf->texSize.y };
             if (isEmpty_Rangei(buf->validRange)) {
                 beginTarget_Paint(&p, buf->texture);
-                fillRect_Paint(&p, (iRect){ zero_I2(), d->visBuf->texSize }, bg[i]);
+                fillRect_Paint(&p, (iRect){ zero_I2(), d->visBuf->texSize }, bg);
             }
-            const iRect sbBlankRect =
-                { init_I2(d->visBuf->texSize.x - scrollBarWidth_ListWidget(d), 0),
-                         init_I2(scrollBarWidth_ListWidget(d), d->itemHeight) };
+            const int sbWidth = scrollBarWidth_ListWidget(d);
             iConstForEach(IntSet, v, &d->invalidItems) {
                 const size_t index = *v.value;
-                if (contains_Range(&drawItems, index)) {
+                if (index >= numItems) {
+                    continue;
+                }
+                const iRangei span = itemSpan_ListWidget(d, index);
+                if (span.end > bufRange.start && span.start < bufRange.end) {
                     const iListItem *item = constAt_PtrArray(&d->items, index);
-                    const iRect      itemRect = { init_I2(0, index * d->itemHeight - buf->origin),
-                                                  init_I2(d->visBuf->texSize.x, d->itemHeight) };
+                    const iRect      itemRect = { init_I2(0, span.start - buf->origin),
+                                                  init_I2(d->visBuf->texSize.x, size_Range(&span)) };
                     beginTarget_Paint(&p, buf->texture);
-                    fillRect_Paint(&p, itemRect, bg[i]);
+                    fillRect_Paint(&p, itemRect, bg);
                     class_ListItem(item)->draw(item, &p, itemRect, d);
-                    fillRect_Paint(&p, moved_Rect(sbBlankRect, init_I2(0, top_Rect(itemRect))), bg[i]);
+                    fillRect_Paint(&p,
+                                   (iRect){ init_I2(right_Rect(itemRect) - sbWidth, top_Rect(itemRect)),
+                                            init_I2(sbWidth, height_Rect(itemRect)) },
+                                   bg);
                 }
             }
             /* Visible range is not fully covered. Fill in the new items. */
-            if (!isEmpty_Rangei(invalidRange[i])) {
+            if (!isEmpty_Rangei(invalidRange[i]) && numItems) {
                 beginTarget_Paint(&p, buf->texture);
-                drawItems.start = invalidRange[i].start / d->itemHeight;
-                drawItems.end   = invalidRange[i].end   / d->itemHeight + 1;
-                for (size_t j = drawItems.start; j < drawItems.end && j < size_PtrArray(&d->items); j++) {
+                for (size_t j = findItem_ListWidget_(d, invalidRange[i].start); j < numItems; j++) {
+                    const iRangei span = itemSpan_ListWidget(d, j);
+                    if (span.start > invalidRange[i].end) {
+                        break;
+                    }
                     const iListItem *item     = constAt_PtrArray(&d->items, j);
-                    const iRect      itemRect = { init_I2(0, j * d->itemHeight - buf->origin),
-                                                  init_I2(d->visBuf->texSize.x, d->itemHeight) };
-                    fillRect_Paint(&p, itemRect, bg[i]);
+                    const iRect      itemRect = { init_I2(0, span.start - buf->origin),
+                                                  init_I2(d->visBuf->texSize.x, size_Range(&span)) };
+                    fillRect_Paint(&p, itemRect, bg);
                     class_ListItem(item)->draw(item, &p, itemRect, d);
-                    fillRect_Paint(&p, moved_Rect(sbBlankRect, init_I2(0, top_Rect(itemRect))), bg[i]);
+                    fillRect_Paint(&p,
+                                   (iRect){ init_I2(right_Rect(itemRect) - sbWidth, top_Rect(itemRect)),
+                                            init_I2(sbWidth, height_Rect(itemRect)) },
+                                   bg);
                 }
             }
             endTarget_Paint(&p);
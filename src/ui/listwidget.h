@@ -39,10 +39,13 @@ struct Impl_ListItem {
     iObject object;
     iBool   isSeparator;
     iBool   isSelected;
+    int     height; /* zero for the list's item height; call invalidate_ListWidget if changed */
 };
 
 iDeclareObjectConstruction(ListItem)
 
+typedef iBool (*iListItemCompareFunc)(const iListItem *, const iListItem *);
+
 iDeclareWidgetClass(ListWidget)
 iDeclareObjectConstruction(ListWidget)
 
@@ -52,6 +55,9 @@ void    invalidate_ListWidget       (iListWidget *);
 void    invalidateItem_ListWidget   (iListWidget *, size_t index);
 void    clear_ListWidget            (iListWidget *);
 void    addItem_ListWidget          (iListWidget *, iAnyObject *item);
+void    updateItems_ListWidget      (iListWidget *, const iPtrArray *items,
+                                     iListItemCompareFunc isSameKey,
+                                     iListItemCompareFunc isSameContent);
 
 iScrollWidget * scroll_ListWidget   (iListWidget *);
 
@@ -73,6 +79,7 @@ iAnyObject *        hoverItem_ListWidget        (iListWidget *);
 size_t              numItems_ListWidget         (const iListWidget *);
 int                 visCount_ListWidget         (const iListWidget *);
 size_t              itemIndex_ListWidget        (const iListWidget *, iInt2 pos);
+iRangei             itemSpan_ListWidget         (const iListWidget *, size_t index);
 const iAnyObject *  constItem_ListWidget        (const iListWidget *, size_t index);
 const iAnyObject *  constHoverItem_ListWidget   (const iListWidget *);
 size_t              hoverItemIndex_ListWidget   (const iListWidget *);
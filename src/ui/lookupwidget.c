@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "util.h"
 #include "visited.h"
 
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/thread.h>
 #include <the_Foundation/regexp.h>
@@ -43,16 +44,22 @@ iDeclareType(LookupJob)
 
 struct Impl_LookupJob {
     iRegExp *term;
+    iStringList *words; /* the words of term */
     iTime now;
     iObjectList *docs;
     iPtrArray results;
+    iAtomicInt *latestRevision; /* job is cancelled when this no longer matches */
+    int revision;
 };
 
 static void init_LookupJob(iLookupJob *d) {
     d->term = NULL;
+    d->words = new_StringList();
     initCurrent_Time(&d->now);
     d->docs = NULL;
     init_PtrArray(&d->results);
+    d->latestRevision = NULL;
+    d->revision = 0;
 }
 
 static void deinit_LookupJob(iLookupJob *d) {
@@ -62,6 +69,7 @@ static void deinit_LookupJob(iLookupJob *d) {
     deinit_PtrArray(&d->results);
     iRelease(d->docs);
     iRelease(d->term);
+    iRelease(d->words);
 }
 
 iDefineTypeConstruction(LookupJob)
@@ -125,6 +133,20 @@ iDefineObjectConstructionArgs(LookupItem, (const iLookupResult *res), res)
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(LookupCandidates)
+
+/* Entries that matched the previous term. */
+struct Impl_LookupCandidates {
+    iString term;
+    iBool   isValid;
+    iArray  bookmarks;  /* iBookmark */
+    iArray  visited;    /* iVisitedUrl */
+    iArray  identities; /* iGmIdentityInfo */
+    int     bookmarksRevision; /* revisions of the stores when the candidates were copied */
+    int     visitedRevision;
+    int     identsRevision;
+};
+
 struct Impl_LookupWidget {
     iWidget      widget;
     iListWidget *list;
@@ -132,9 +154,12 @@ struct Impl_LookupWidget {
     iThread *    work;
     iCondition   jobAvailable; /* wakes up the work thread */
     iMutex *     mtx;
+    iBool        isQuitting;
+    iAtomicInt   revision; /* incremented when a new term is submitted */
     iString      pendingTerm;
     iObjectList *pendingDocs;
     iLookupJob * finishedJob;
+    iLookupCandidates candidates;
 };
 
 static float scoreMatch_(const iRegExp *pattern, iRangecc text) {
@@ -158,11 +183,9 @@ static float bookmarkRelevance_LookupJob_(const iLookupJob *d, const iBookmark *
     return h + iMax(p, t) + 2 * g; /* extra weight for tags */
 }
 
-static float identityRelevance_LookupJob_(const iLookupJob *d, const iGmIdentity *identity) {
-    iString *cn = subject_TlsCertificate(identity->cert);
-    const float c = scoreMatch_(d->term, range_String(cn));
+static float identityRelevance_LookupJob_(const iLookupJob *d, const iGmIdentityInfo *identity) {
+    const float c = scoreMatch_(d->term, range_String(&identity->subject));
     const float n = scoreMatch_(d->term, range_String(&identity->notes));
-    delete_String(cn);
     return c + 2 * n; /* extra weight for notes */
 }
 
@@ -175,22 +198,39 @@ static float visitedRelevance_LookupJob_(const iLookupJob *d, const iVisitedUrl
     return iMax(h, p) / (age + 1); /* extra weight for recency */
 }
 
-static iBool matchBookmark_LookupJob_(void *context, const iBookmark *bm) {
-    return bookmarkRelevance_LookupJob_(context, bm) > 0;
+/* The searches are done on snapshots of the bookmarks, visited URLs, and identities, so
+   the stores are only locked while being copied and may be modified during the search.
+   Each search filters its array in place, keeping only the entries that matched. The
+   remaining entries are the candidates for the next term, if it extends this one. */
+
+static const size_t cancelCheckInterval_LookupJob_ = 64;
+
+static iBool isCancelled_LookupJob_(const iLookupJob *d) {
+    return value_Atomic(d->latestRevision) != d->revision;
 }
 
-static iBool matchIdentity_LookupJob_(void *context, const iGmIdentity *identity) {
-    return identityRelevance_LookupJob_(context, identity) > 0;
+static iBool isCancelledAt_LookupJob_(const iLookupJob *d, size_t index) {
+    return (index % cancelCheckInterval_LookupJob_) == 0 && isCancelled_LookupJob_(d);
 }
 
-static void searchBookmarks_LookupJob_(iLookupJob *d) {
+static iBool searchBookmarks_LookupJob_(iLookupJob *d, iArray *bookmarks) {
     /* Note: Called in a background thread. */
-    /* TODO: Thread safety! What if a bookmark gets deleted while its being accessed here? */
-    iConstForEach(PtrArray, i, list_Bookmarks(bookmarks_App(), NULL, matchBookmark_LookupJob_, d)) {
-        const iBookmark *bm  = i.ptr;
+    iBookmark *bms     = data_Array(bookmarks);
+    size_t     numKept = 0;
+    size_t     i       = 0;
+    for (; i < size_Array(bookmarks); i++) {
+        if (isCancelledAt_LookupJob_(d, i)) {
+            break;
+        }
+        const iBookmark *bm        = &bms[i];
+        const float      relevance = bookmarkRelevance_LookupJob_(d, bm);
+        if (relevance <= 0) {
+            deinit_Bookmark(&bms[i]);
+            continue;
+        }
         iLookupResult *  res = new_LookupResult();
         res->type            = bookmark_LookupResultType;
-        res->relevance       = bookmarkRelevance_LookupJob_(d, bm);
+        res->relevance       = relevance;
         appendChar_String(&res->label, bm->icon);
         appendChar_String(&res->label, ' ');
         append_String(&res->label, &bm->title);
@@ -199,14 +239,26 @@ static void searchBookmarks_LookupJob_(iLookupJob *d) {
         set_String(&res->url, &bm->url);
         res->when = bm->when;
         pushBack_PtrArray(&d->results, res);
+        bms[numKept++] = bms[i];
+    }
+    const iBool isComplete = (i == size_Array(bookmarks));
+    for (; i < size_Array(bookmarks); i++) {
+        deinit_Bookmark(&bms[i]);
     }
+    resize_Array(bookmarks, numKept);
+    return isComplete;
 }
 
-static void searchVisited_LookupJob_(iLookupJob *d) {
+static iBool searchVisited_LookupJob_(iLookupJob *d, iArray *visited) {
     /* Note: Called in a background thread. */
-    /* TODO: Thread safety! Visited URLs may be deleted while being accessed here. */
-    iConstForEach(PtrArray, i, list_Visited(visited_App(), 0)) {
-        const iVisitedUrl *vis = i.ptr;
+    iVisitedUrl *urls    = data_Array(visited);
+    size_t       numKept = 0;
+    size_t       i       = 0;
+    for (; i < size_Array(visited); i++) {
+        if (isCancelledAt_LookupJob_(d, i)) {
+            break;
+        }
+        const iVisitedUrl *vis = &urls[i];
         const float relevance = visitedRelevance_LookupJob_(d, vis);
         if (relevance > 0) {
             iLookupResult *res = new_LookupResult();
@@ -216,16 +268,29 @@ static void searchVisited_LookupJob_(iLookupJob *d) {
             set_String(&res->url, &vis->url);
             res->when = vis->when;
             pushBack_PtrArray(&d->results, res);
+            urls[numKept++] = urls[i];
+        }
+        else {
+            deinit_VisitedUrl(&urls[i]);
         }
     }
+    const iBool isComplete = (i == size_Array(visited));
+    for (; i < size_Array(visited); i++) {
+        deinit_VisitedUrl(&urls[i]);
+    }
+    resize_Array(visited, numKept);
+    return isComplete;
 }
 
-static void searchHistory_LookupJob_(iLookupJob *d) {
+static iBool searchHistory_LookupJob_(iLookupJob *d) {
     /* Note: Called in a background thread. */
     size_t index = 0;
     iForEach(ObjectList, i, d->docs) {
+        if (isCancelled_LookupJob_(d)) {
+            return iFalse;
+        }
         iConstForEach(StringArray, j,
-                      searchContents_History(history_DocumentWidget(i.object), d->term)) {
+                      searchContents_History(history_DocumentWidget(i.object), d->term, d->words)) {
             const char *match = cstr_String(j.value);
             const size_t matchLen = argLabel_Command(match, "len");
             iRangecc text;
@@ -242,37 +307,147 @@ static void searchHistory_LookupJob_(iLookupJob *d) {
             pushBack_PtrArray(&d->results, res);
         }
     }
+    return iTrue;
 }
 
-static void searchIdentities_LookupJob_(iLookupJob *d) {
+static iBool searchIdentities_LookupJob_(iLookupJob *d, iArray *identities) {
     /* Note: Called in a background thread. */
-    iConstForEach(PtrArray, i, listIdentities_GmCerts(certs_App(), matchIdentity_LookupJob_, d)) {
-        const iGmIdentity *identity = i.ptr;
+    iGmIdentityInfo *infos   = data_Array(identities);
+    size_t           numKept = 0;
+    size_t           i       = 0;
+    for (; i < size_Array(identities); i++) {
+        if (isCancelledAt_LookupJob_(d, i)) {
+            break;
+        }
+        const iGmIdentityInfo *identity  = &infos[i];
+        const float            relevance = identityRelevance_LookupJob_(d, identity);
+        if (relevance <= 0) {
+            deinit_GmIdentityInfo(&infos[i]);
+            continue;
+        }
         iLookupResult *res = new_LookupResult();
         res->type = identity_LookupResultType;
-        res->relevance = identityRelevance_LookupJob_(d, identity);
+        res->relevance = relevance;
         appendChar_String(&res->label, identity->icon);
         appendChar_String(&res->label, ' ');
-        iString *cn = subject_TlsCertificate(identity->cert);
-        append_String(&res->label, cn);
-        delete_String(cn);
-        set_String(&res->meta,
-                   collect_String(
-                       hexEncode_Block(collect_Block(fingerprint_TlsCertificate(identity->cert)))));
+        append_String(&res->label, &identity->subject);
+        set_String(&res->meta, collect_String(hexEncode_Block(&identity->fingerprint)));
         pushBack_PtrArray(&d->results, res);
+        infos[numKept++] = infos[i];
+    }
+    const iBool isComplete = (i == size_Array(identities));
+    for (; i < size_Array(identities); i++) {
+        deinit_GmIdentityInfo(&infos[i]);
     }
+    resize_Array(identities, numKept);
+    return isComplete;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void init_LookupCandidates(iLookupCandidates *d) {
+    init_String(&d->term);
+    d->isValid = iFalse;
+    init_Array(&d->bookmarks, sizeof(iBookmark));
+    init_Array(&d->visited, sizeof(iVisitedUrl));
+    init_Array(&d->identities, sizeof(iGmIdentityInfo));
+    d->bookmarksRevision = -1;
+    d->visitedRevision   = -1;
+    d->identsRevision    = -1;
+}
+
+static void clear_LookupCandidates(iLookupCandidates *d) {
+    iForEach(Array, i, &d->bookmarks) {
+        deinit_Bookmark(i.value);
+    }
+    iForEach(Array, j, &d->visited) {
+        deinit_VisitedUrl(j.value);
+    }
+    iForEach(Array, k, &d->identities) {
+        deinit_GmIdentityInfo(k.value);
+    }
+    clear_Array(&d->bookmarks);
+    clear_Array(&d->visited);
+    clear_Array(&d->identities);
+    clear_String(&d->term);
+    d->isValid = iFalse;
+}
+
+static void deinit_LookupCandidates(iLookupCandidates *d) {
+    clear_LookupCandidates(d);
+    deinit_Array(&d->identities);
+    deinit_Array(&d->visited);
+    deinit_Array(&d->bookmarks);
+    deinit_String(&d->term);
+}
+
+/* In fast-start mode, the history and identities may still be loading. Until they are
+   loaded, their revision is -1. */
+
+static int visitedRevision_LookupCandidates_(void) {
+    const iVisited *visited = loadedVisited_App();
+    return visited ? revision_Visited(visited) : -1;
+}
+
+static int identsRevision_LookupCandidates_(void) {
+    const iGmCerts *certs = loadedCerts_App();
+    return certs ? identitiesRevision_GmCerts(certs) : -1;
+}
+
+static iBool isRefinedBy_LookupCandidates_(const iLookupCandidates *d, const iString *term) {
+    /* Matches of an extended term are always a subset of the matches of the original, as
+       long as the stores haven't changed since the candidates were copied. */
+    return d->isValid && startsWithCase_String(term, cstr_String(&d->term)) &&
+           d->bookmarksRevision == revision_Bookmarks(bookmarks_App()) &&
+           d->visitedRevision == visitedRevision_LookupCandidates_() &&
+           d->identsRevision == identsRevision_LookupCandidates_();
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void publish_LookupWidget_(iLookupWidget *d, iLookupJob *job, iBool isFinal) {
+    /* Note: Called in a background thread. */
+    lock_Mutex(d->mtx);
+    if (isCancelled_LookupJob_(job)) {
+        /* A newer term has been submitted; these results are already stale. */
+        unlock_Mutex(d->mtx);
+        if (isFinal) {
+            delete_LookupJob(job);
+        }
+        return;
+    }
+    iLookupJob *published = job;
+    if (!isFinal) {
+        /* The job keeps collecting results, so the list gets a copy of the ones so far. */
+        published = new_LookupJob();
+        iConstForEach(PtrArray, i, &job->results) {
+            pushBack_PtrArray(&published->results, copy_LookupResult(i.ptr));
+        }
+    }
+    if (d->finishedJob) {
+        /* Previous results haven't been taken yet. */
+        delete_LookupJob(d->finishedJob);
+    }
+    d->finishedJob = published;
+    postCommand_Widget(as_Widget(d), "lookup.ready");
+    unlock_Mutex(d->mtx);
 }
 
 static iThreadResult worker_LookupWidget_(iThread *thread) {
     iLookupWidget *d = userData_Thread(thread);
+    iLookupCandidates *cands = &d->candidates; /* only accessed by the worker */
 //    printf("[LookupWidget] worker is running\n"); fflush(stdout);
     lock_Mutex(d->mtx);
     for (;;) {
-        wait_Condition(&d->jobAvailable, d->mtx);
-        if (isEmpty_String(&d->pendingTerm)) {
-            break; /* Time to quit. */
+        while (isEmpty_String(&d->pendingTerm) && !d->isQuitting) {
+            wait_Condition(&d->jobAvailable, d->mtx);
+        }
+        if (d->isQuitting) {
+            break;
         }
         iLookupJob *job = new_LookupJob();
+        job->latestRevision = &d->revision;
+        job->revision = value_Atomic(&d->revision);
         /* Make a regular expression to search for multiple alternative words. */ {
             iString *pattern = new_String();
             iRangecc word = iNullRange;
@@ -280,6 +455,9 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
             while (nextSplit_Rangecc(range_String(&d->pendingTerm), " ", &word)) {
                 if (isEmpty_Range(&word)) continue;
                 if (!isFirst) appendCStr_String(pattern, ".*");
+                iString *w = newRange_String(word);
+                pushBack_StringList(job->words, w);
+                delete_String(w);
                 for (const char *ch = word.start; ch != word.end; ch++) {
                     /* Escape regular expression characters. */
                     if (isSyntaxChar_RegExp(*ch)) {
@@ -293,29 +471,52 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
             job->term = new_RegExp(cstr_String(pattern), caseInsensitive_RegExpOption);
             delete_String(pattern);
         }
-        const size_t termLen = size_String(&d->pendingTerm);
+        iString *term = copy_String(&d->pendingTerm);
         clear_String(&d->pendingTerm);
         job->docs = d->pendingDocs;
         d->pendingDocs = NULL;
         unlock_Mutex(d->mtx);
-        /* Do the lookup. */ {
-            searchBookmarks_LookupJob_(job);
-            searchVisited_LookupJob_(job);
-            if (termLen >= 3) {
-                searchHistory_LookupJob_(job);
+        /* Search only the previous candidates if the term was extended. */
+        if (!isRefinedBy_LookupCandidates_(cands, term)) {
+            clear_LookupCandidates(cands);
+            /* A change made while copying only causes the next term to copy them again. */
+            cands->bookmarksRevision = revision_Bookmarks(bookmarks_App());
+            cands->visitedRevision   = visitedRevision_LookupCandidates_();
+            cands->identsRevision    = identsRevision_LookupCandidates_();
+            /* The trigram indexes narrow down what needs to be matched. */
+            snapshotMatching_Bookmarks(bookmarks_App(), job->words, &cands->bookmarks);
+            const iVisited *visited = loadedVisited_App();
+            const iGmCerts *certs   = loadedCerts_App();
+            if (visited) {
+                snapshotMatching_Visited(visited, job->words, &cands->visited);
+            }
+            if (certs) {
+                snapshotMatchingIdentities_GmCerts(certs, job->words, &cands->identities);
             }
-            searchIdentities_LookupJob_(job);
         }
-        /* Submit the result. */
-        lock_Mutex(d->mtx);
-        if (d->finishedJob) {
-            /* Previous results haven't been taken yet. */
-            delete_LookupJob(d->finishedJob);
+        set_String(&cands->term, term);
+        cands->isValid = iFalse;
+        /* Do the lookup, publishing results as each kind of search finishes. */ {
+            iBool ok = searchBookmarks_LookupJob_(job, &cands->bookmarks);
+            if (ok) {
+                publish_LookupWidget_(d, job, iFalse);
+                ok = searchVisited_LookupJob_(job, &cands->visited);
+            }
+            if (ok) {
+                publish_LookupWidget_(d, job, iFalse);
+                ok = searchIdentities_LookupJob_(job, &cands->identities);
+            }
+            cands->isValid = ok; /* incompletely filtered candidates can't be refined */
+            if (ok && size_String(term) >= 3) {
+                publish_LookupWidget_(d, job, iFalse);
+                ok = searchHistory_LookupJob_(job);
+            }
         }
+        delete_String(term);
+        /* Submit the result. */
 //        printf("[LookupWidget] worker has %zu results\n", size_PtrArray(&job->results));
-        fflush(stdout);
-        d->finishedJob = job;
-        postCommand_Widget(as_Widget(d), "lookup.ready");
+        publish_LookupWidget_(d, job, iTrue);
+        lock_Mutex(d->mtx);
     }
     unlock_Mutex(d->mtx);
 //    printf("[LookupWidget] worker has quit\n"); fflush(stdout);
@@ -336,9 +537,12 @@ void init_LookupWidget(iLookupWidget *d) {
     setUserData_Thread(d->work, d);
     init_Condition(&d->jobAvailable);
     d->mtx = new_Mutex();
+    d->isQuitting = iFalse;
+    set_Atomic(&d->revision, 0);
     init_String(&d->pendingTerm);
     d->pendingDocs = NULL;
     d->finishedJob = NULL;
+    init_LookupCandidates(&d->candidates);
     start_Thread(d->work);
 }
 
@@ -347,11 +551,14 @@ void deinit_LookupWidget(iLookupWidget *d) {
         iGuardMutex(d->mtx, {
             iReleasePtr(&d->pendingDocs);
             clear_String(&d->pendingTerm);
+            d->isQuitting = iTrue;
+            add_Atomic(&d->revision, 1); /* cancel the current job */
             signal_Condition(&d->jobAvailable);
         });
         join_Thread(d->work);
         iRelease(d->work);
     }
+    deinit_LookupCandidates(&d->candidates);
     delete_LookupJob(d->finishedJob);
     deinit_String(&d->pendingTerm);
     delete_Mutex(d->mtx);
@@ -363,11 +570,15 @@ void submit_LookupWidget(iLookupWidget *d, const iString *term) {
         set_String(&d->pendingTerm, term);
         trim_String(&d->pendingTerm);
         iReleasePtr(&d->pendingDocs);
+        add_Atomic(&d->revision, 1); /* cancel the current job */
         if (!isEmpty_String(&d->pendingTerm)) {
             d->pendingDocs = listDocuments_App(); /* holds reference to all open tabs */
             signal_Condition(&d->jobAvailable);
         }
         else {
+            /* Results of the earlier term are no longer wanted. */
+            delete_LookupJob(d->finishedJob);
+            d->finishedJob = NULL;
             setFlags_Widget(as_Widget(d), hidden_WidgetFlag, iTrue);
         }
     });
@@ -34,6 +34,26 @@ static void setColor_Paint_(const iPaint *d, int color) {
     SDL_SetRenderDrawColor(renderer_Paint_(d), clr.r, clr.g, clr.b, clr.a * d->alpha / 255);
 }
 
+/* When drawing in the window, everything is limited to the damaged region being redrawn. */
+static void setClipRect_Paint_(const iPaint *d, const SDL_Rect *rect) {
+    SDL_Renderer *render = renderer_Paint_(d);
+    const iRect   damage = d->dst->drawClip;
+    if (!isEmpty_Rect(damage) && SDL_GetRenderTarget(render) == d->dst->frame) {
+        SDL_Rect clip = { damage.pos.x, damage.pos.y, damage.size.x, damage.size.y };
+        if (rect && !SDL_IntersectRect(rect, &clip, &clip)) {
+            clip.w = clip.h = 0;
+        }
+        SDL_RenderSetClipRect(render, &clip);
+        return;
+    }
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+    SDL_RenderSetClipRect(render, rect);
+#else
+    const SDL_Rect winRect = { 0, 0, d->dst->root->rect.size.x, d->dst->root->rect.size.y };
+    SDL_RenderSetClipRect(render, rect ? rect : &winRect);
+#endif
+}
+
 void init_Paint(iPaint *d) {
     d->dst       = get_Window();
     d->setTarget = NULL;
@@ -44,7 +64,9 @@ void init_Paint(iPaint *d) {
 void beginTarget_Paint(iPaint *d, SDL_Texture *target) {
     SDL_Renderer *rend = renderer_Paint_(d);
     if (!d->setTarget) {
-        d->oldTarget = SDL_GetRenderTarget(rend);
+        d->oldTarget    = SDL_GetRenderTarget(rend);
+        d->isOldClipped = SDL_RenderIsClipEnabled(rend);
+        SDL_RenderGetClipRect(rend, &d->oldClip);
         SDL_SetRenderTarget(rend, target);
         d->setTarget = target;
     }
@@ -56,6 +78,7 @@ void beginTarget_Paint(iPaint *d, SDL_Texture *target) {
 void endTarget_Paint(iPaint *d) {
     if (d->setTarget) {
         SDL_SetRenderTarget(renderer_Paint_(d), d->oldTarget);
+        setClipRect_Paint_(d, d->isOldClipped ? &d->oldClip : NULL);
         d->oldTarget = NULL;
         d->setTarget = NULL;
     }
@@ -67,16 +90,11 @@ void setClip_Paint(iPaint *d, iRect rect) {
         rect.pos.y -= off;
         rect.size.y = iMax(0, rect.size.y + off);
     }
-    SDL_RenderSetClipRect(renderer_Paint_(d), (const SDL_Rect *) &rect);
+    setClipRect_Paint_(d, (const SDL_Rect *) &rect);
 }
 
 void unsetClip_Paint(iPaint *d) {
-#if SDL_VERSION_ATLEAST(2, 0, 12)
-    SDL_RenderSetClipRect(renderer_Paint_(d), NULL);
-#else
-    const SDL_Rect winRect = { 0, 0, d->dst->root->rect.size.x, d->dst->root->rect.size.y };
-    SDL_RenderSetClipRect(renderer_Paint_(d), &winRect);
-#endif
+    setClipRect_Paint_(d, NULL);
 }
 
 void drawRect_Paint(const iPaint *d, iRect rect, int color) {
@@ -72,23 +72,36 @@ static void drawPlayerButton_(iPaint *p, iRect rect, const char *label, int font
     drawCentered_Text(font, frameRect, iTrue, fg, "%s", label);
 }
 
-static int drawSevenSegmentTime_(iInt2 pos, int color, int align, int seconds) { /* returns width */
+static void sevenSegmentTime_(iString *num, int seconds) {
     const uint32_t sevenSegmentDigit = 0x1fbf0;
     const int hours = seconds / 3600;
     const int mins  = (seconds / 60) % 60;
     const int secs  = seconds % 60;
+    if (hours) {
+        appendChar_String(num, sevenSegmentDigit + (hours % 10));
+        appendChar_String(num, ':');
+    }
+    appendChar_String(num, sevenSegmentDigit + (mins / 10) % 10);
+    appendChar_String(num, sevenSegmentDigit + (mins % 10));
+    appendChar_String(num, ':');
+    appendChar_String(num, sevenSegmentDigit + (secs / 10) % 10);
+    appendChar_String(num, sevenSegmentDigit + (secs % 10));
+}
+
+static int sevenSegmentTimeWidth_(int seconds) {
+    iString num;
+    init_String(&num);
+    sevenSegmentTime_(&num, seconds);
+    const int width = advanceRange_Text(uiLabel_FontId, range_String(&num)).x;
+    deinit_String(&num);
+    return width;
+}
+
+static int drawSevenSegmentTime_(iInt2 pos, int color, int align, int seconds) { /* returns width */
     const int font  = uiLabel_FontId;
     iString   num;
     init_String(&num);
-    if (hours) {
-        appendChar_String(&num, sevenSegmentDigit + (hours % 10));
-        appendChar_String(&num, ':');
-    }
-    appendChar_String(&num, sevenSegmentDigit + (mins / 10) % 10);
-    appendChar_String(&num, sevenSegmentDigit + (mins % 10));
-    appendChar_String(&num, ':');
-    appendChar_String(&num, sevenSegmentDigit + (secs / 10) % 10);
-    appendChar_String(&num, sevenSegmentDigit + (secs % 10));
+    sevenSegmentTime_(&num, seconds);
     iInt2 size = advanceRange_Text(font, range_String(&num));
     if (align == right_Alignment) {
         pos.x -= size.x;
@@ -98,6 +111,37 @@ static int drawSevenSegmentTime_(iInt2 pos, int color, int align, int seconds) {
     return size.x;
 }
 
+static float scrubberDuration_PlayerUI_(const iPlayerUI *d) {
+    /* The length of an incomplete stream is unknown, so the scrubber spans what has been
+       downloaded so far. */
+    const float duration = duration_Player(d->player);
+    return duration > 0 ? duration : seekableTime_Player(d->player);
+}
+
+static iRangei scrubberRange_PlayerUI_(const iPlayerUI *d) {
+    const float totalTime  = duration_Player(d->player);
+    const int   leftWidth  = sevenSegmentTimeWidth_(iRound(time_Player(d->player)));
+    const int   rightWidth = totalTime > 0 ? sevenSegmentTimeWidth_(iRound(totalTime)) : 0;
+    return (iRangei){ left_Rect(d->scrubberRect) + leftWidth + 6 * gap_UI,
+                      right_Rect(d->scrubberRect) - rightWidth - 6 * gap_UI };
+}
+
+float scrubberTime_PlayerUI(const iPlayerUI *d, iInt2 pos) {
+    const iRangei range    = scrubberRange_PlayerUI_(d);
+    const float   duration = scrubberDuration_PlayerUI_(d);
+    if (duration <= 0 || range.end <= range.start || !contains_Rect(d->scrubberRect, pos)) {
+        return -1;
+    }
+    return duration * iClamp((float) (pos.x - range.start) / (range.end - range.start), 0, 1);
+}
+
+iString *bufferingLabel_PlayerUI(const iPlayerUI *d) {
+    return newFormat_String("Buffered: %d%%\nUnderruns: %d\nDecoding: %.2f ms per block",
+                            iRound(100 * bufferFill_Player(d->player)),
+                            numUnderruns_Player(d->player),
+                            decodeTimeMs_Player(d->player));
+}
+
 void draw_PlayerUI(iPlayerUI *d, iPaint *p) {
     const int   playerBackground_ColorId = uiBackground_ColorId;
     const int   playerFrame_ColorId      = uiSeparator_ColorId;
@@ -118,27 +162,30 @@ void draw_PlayerUI(iPlayerUI *d, iPaint *p) {
     const int   yMid      = mid_Rect(d->scrubberRect).y;
     const float playTime  = time_Player(d->player);
     const float totalTime = duration_Player(d->player);
+    const float scrubTime = scrubberDuration_PlayerUI_(d);
     const int   bright    = uiHeading_ColorId;
     const int   dim       = uiAnnotation_ColorId;
-    int leftWidth = drawSevenSegmentTime_(
-        init_I2(left_Rect(d->scrubberRect) + 2 * gap_UI, yMid - hgt / 2),
-        isPaused_Player(d->player) ? dim : bright,
-        left_Alignment,
-        iRound(playTime));
-    int rightWidth = 0;
+    /* The time turns to the caution color while playback is waiting for data. */
+    drawSevenSegmentTime_(init_I2(left_Rect(d->scrubberRect) + 2 * gap_UI, yMid - hgt / 2),
+                          isStarved_Player(d->player)  ? uiTextCaution_ColorId
+                          : isPaused_Player(d->player) ? dim
+                                                       : bright,
+                          left_Alignment,
+                          iRound(playTime));
     if (totalTime > 0) {
-        rightWidth =
-            drawSevenSegmentTime_(init_I2(right_Rect(d->scrubberRect) - 2 * gap_UI, yMid - hgt / 2),
-                                  dim,
-                                  right_Alignment,
-                                  iRound(totalTime));
+        drawSevenSegmentTime_(init_I2(right_Rect(d->scrubberRect) - 2 * gap_UI, yMid - hgt / 2),
+                              dim,
+                              right_Alignment,
+                              iRound(totalTime));
     }
     /* Scrubber. */
-    const int   s1      = left_Rect(d->scrubberRect) + leftWidth + 6 * gap_UI;
-    const int   s2      = right_Rect(d->scrubberRect) - rightWidth - 6 * gap_UI;
-    const float normPos = totalTime > 0 ? playTime / totalTime : 0.0f;
-    const int   part    = (s2 - s1) * normPos;
-    const int   scrubMax = (s2 - s1) * streamProgress_Player(d->player);
+    const iRangei scrub   = scrubberRange_PlayerUI_(d);
+    const int     s1      = scrub.start;
+    const int     s2      = scrub.end;
+    const float   normPos = scrubTime > 0 ? iMin(1.0f, playTime / scrubTime) : 0.0f;
+    const int     part    = (s2 - s1) * normPos;
+    const int     scrubMax =
+        (s2 - s1) * (totalTime > 0 ? streamProgress_Player(d->player) : scrubTime > 0 ? 1 : 0);
     drawHLine_Paint(p, init_I2(s1, yMid), part, bright);
     drawHLine_Paint(p, init_I2(s1 + part, yMid), scrubMax - part, dim);
     const char *dot = "\u23fa";
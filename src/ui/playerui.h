@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #pragma once
 
 #include <the_Foundation/rect.h>
+#include <the_Foundation/string.h>
 
 iDeclareType(Paint)
 iDeclareType(Player)
@@ -42,3 +43,6 @@ struct Impl_PlayerUI {
 
 void    init_PlayerUI   (iPlayerUI *, const iPlayer *player, iRect bounds);
 void    draw_PlayerUI   (iPlayerUI *, iPaint *p);
+
+float       scrubberTime_PlayerUI   (const iPlayerUI *, iInt2 pos); /* -1 if not seekable */
+iString *   bufferingLabel_PlayerUI (const iPlayerUI *);
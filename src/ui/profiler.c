@@ -0,0 +1,198 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+#include "profiler.h"
+
+#if defined (LAGRANGE_PROFILER)
+
+#include "paint.h"
+#include "text.h"
+#include "metrics.h"
+
+#include <the_Foundation/atomic.h>
+#include <SDL_timer.h>
+
+iDeclareType(ProfileFrame)
+iDeclareType(Profiler)
+
+enum iProfilerLimits {
+    maxFrames_Profiler = 120,
+};
+
+static const uint32_t frameBudget_Profiler_ = 16667; /* microseconds at 60 Hz */
+
+struct Impl_ProfileFrame {
+    uint32_t time[max_ProfileScope]; /* microseconds */
+    uint32_t count[max_ProfileScope];
+    uint32_t numGlyphHits;
+    uint32_t numGlyphMisses;
+};
+
+struct Impl_Profiler {
+    iAtomicInt    time[max_ProfileScope]; /* accumulated during the current frame */
+    iAtomicInt    count[max_ProfileScope];
+    iProfileFrame frames[maxFrames_Profiler];
+    size_t        frameIndex; /* next frame to write */
+    size_t        numFrames;
+    size_t        numGlyphHits; /* totals at the end of the previous frame */
+    size_t        numGlyphMisses;
+    iBool         isVisible;
+};
+
+static iProfiler profiler_;
+
+static const char *scopeNames_Profiler_[max_ProfileScope] = {
+    "draw_Window",
+    "draw_DocumentWidget",
+    "cache_Font",
+    "layout_GmDocument",
+    "texture_GmImage",
+    "processEvents_App",
+};
+
+uint64_t begin_Profiler(void) {
+    return SDL_GetPerformanceCounter();
+}
+
+void end_Profiler(enum iProfileScope scope, uint64_t startTime) {
+    /* May be called from background threads, e.g., during document layout. */
+    const uint64_t elapsed = SDL_GetPerformanceCounter() - startTime;
+    add_Atomic(&profiler_.time[scope],
+               (int) (elapsed * 1000000 / SDL_GetPerformanceFrequency()));
+    add_Atomic(&profiler_.count[scope], 1);
+}
+
+void endFrame_Profiler(void) {
+    iProfiler *d = &profiler_;
+    iProfileFrame *frame = &d->frames[d->frameIndex];
+    for (int i = 0; i < max_ProfileScope; i++) {
+        frame->time[i]  = exchange_Atomic(&d->time[i], 0);
+        frame->count[i] = exchange_Atomic(&d->count[i], 0);
+    }
+    const iTextCacheStats stats = cacheStats_Text();
+    frame->numGlyphHits   = (uint32_t) (stats.numHits - d->numGlyphHits);
+    frame->numGlyphMisses = (uint32_t) (stats.numMisses - d->numGlyphMisses);
+    d->numGlyphHits       = stats.numHits;
+    d->numGlyphMisses     = stats.numMisses;
+    d->frameIndex         = (d->frameIndex + 1) % maxFrames_Profiler;
+    d->numFrames          = iMin(d->numFrames + 1, maxFrames_Profiler);
+}
+
+iBool isVisible_Profiler(void) {
+    return profiler_.isVisible;
+}
+
+void setVisible_Profiler(iBool visible) {
+    profiler_.isVisible = visible;
+}
+
+static const iProfileFrame *frame_Profiler_(const iProfiler *d, size_t age) {
+    /* Age zero is the most recent frame. */
+    return &d->frames[(d->frameIndex + maxFrames_Profiler - 1 - age) % maxFrames_Profiler];
+}
+
+void draw_Profiler(void) {
+    const iProfiler *d = &profiler_;
+    if (!d->isVisible || d->numFrames == 0) {
+        return;
+    }
+    const int   font        = defaultMonospace_FontId;
+    const int   lineHeight  = lineHeight_Text(font);
+    const int   barWidth    = iMax(1, gap_UI / 2);
+    const int   graphHeight = 8 * lineHeight;
+    const int   textWidth   = advance_Text(font, "draw_DocumentWidget   00.000 ms  000.0/frame").x;
+    const iInt2 winSize     = rootSize_Window(get_Window());
+    iRect       rect        = init_Rect(0,
+                                        0,
+                                        iMax(maxFrames_Profiler * barWidth, textWidth) + 2 * gap_UI,
+                                        graphHeight + (max_ProfileScope + 2) * lineHeight +
+                                            3 * gap_UI);
+    rect.pos = init_I2(winSize.x - rect.size.x - gap_UI, gap_UI);
+    iPaint p;
+    init_Paint(&p);
+    p.alpha = 224;
+    SDL_SetRenderDrawBlendMode(renderer_Window(get_Window()), SDL_BLENDMODE_BLEND);
+    fillRect_Paint(&p, rect, uiBackground_ColorId);
+    SDL_SetRenderDrawBlendMode(renderer_Window(get_Window()), SDL_BLENDMODE_NONE);
+    p.alpha = 255;
+    drawRect_Paint(&p, rect, uiFrame_ColorId);
+    /* Frame time graph: two frame budgets fit in the full height. */ {
+        const iInt2 origin = add_I2(rect.pos, init_I2(gap_UI, gap_UI + graphHeight));
+        for (size_t age = 0; age < d->numFrames; age++) {
+            const uint32_t us = frame_Profiler_(d, age)->time[window_ProfileScope];
+            const int      h  = iMin(
+                graphHeight, (int) ((uint64_t) us * graphHeight / (2 * frameBudget_Profiler_)));
+            fillRect_Paint(&p,
+                           init_Rect(origin.x + (maxFrames_Profiler - 1 - age) * barWidth,
+                                     origin.y - h,
+                                     barWidth,
+                                     h),
+                           us > frameBudget_Profiler_ ? uiTextCaution_ColorId
+                                                      : uiTextAction_ColorId);
+        }
+        drawHLine_Paint(&p,
+                        addY_I2(origin, -graphHeight / 2),
+                        maxFrames_Profiler * barWidth,
+                        uiSeparator_ColorId);
+    }
+    /* Averages over the recorded frames. */
+    uint64_t total[max_ProfileScope] = { 0 };
+    uint64_t count[max_ProfileScope] = { 0 };
+    uint64_t hits = 0, misses = 0;
+    for (size_t age = 0; age < d->numFrames; age++) {
+        const iProfileFrame *frame = frame_Profiler_(d, age);
+        for (int i = 0; i < max_ProfileScope; i++) {
+            total[i] += frame->time[i];
+            count[i] += frame->count[i];
+        }
+        hits   += frame->numGlyphHits;
+        misses += frame->numGlyphMisses;
+    }
+    iInt2 pos = add_I2(rect.pos, init_I2(gap_UI, 2 * gap_UI + graphHeight));
+    const iProfileFrame *last = frame_Profiler_(d, 0);
+    draw_Text(font, pos, uiTextStrong_ColorId, "Frame: %.2f ms (%zu-frame avg %.2f ms)",
+              last->time[window_ProfileScope] / 1000.0,
+              d->numFrames,
+              total[window_ProfileScope] / 1000.0 / d->numFrames);
+    pos.y += lineHeight;
+    /* Top scopes by average time per frame. Scopes are nested, so times are inclusive. */
+    int order[max_ProfileScope];
+    for (int i = 0; i < max_ProfileScope; i++) {
+        int j = i;
+        for (; j > 0 && total[order[j - 1]] < total[i]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    for (int i = 0; i < max_ProfileScope; i++) {
+        const int scope = order[i];
+        draw_Text(font, pos, uiText_ColorId, "%-20s %7.3f ms %6.1f/frame",
+                  scopeNames_Profiler_[scope],
+                  total[scope] / 1000.0 / d->numFrames,
+                  (double) count[scope] / d->numFrames);
+        pos.y += lineHeight;
+    }
+    draw_Text(font, pos, uiText_ColorId, "Glyph cache: %.1f%% hits (%llu misses)",
+              hits + misses ? 100.0 * hits / (hits + misses) : 100.0,
+              (unsigned long long) misses);
+}
+
+#endif /* LAGRANGE_PROFILER */
@@ -0,0 +1,59 @@
+/* Copyright 2020 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+#pragma once
+
+#include <the_Foundation/defs.h>
+
+/* Frame profiling is compiled in for debug builds, or when explicitly enabled. */
+#if !defined (NDEBUG) || defined (LAGRANGE_ENABLE_PROFILER)
+#  define LAGRANGE_PROFILER 1
+#endif
+
+enum iProfileScope {
+    window_ProfileScope,          /* draw_Window */
+    document_ProfileScope,        /* draw_DocumentWidget_ */
+    glyphs_ProfileScope,          /* cache_Font_ */
+    layout_ProfileScope,          /* doLayout_GmDocument_ and lazy extensions */
+    imageTexture_ProfileScope,    /* uploading decoded images */
+    events_ProfileScope,          /* dispatching events in processEvents_App */
+    max_ProfileScope
+};
+
+#if defined (LAGRANGE_PROFILER)
+
+uint64_t    begin_Profiler      (void);
+void        end_Profiler        (enum iProfileScope scope, uint64_t startTime);
+void        endFrame_Profiler   (void);
+
+iBool       isVisible_Profiler  (void);
+void        setVisible_Profiler (iBool visible);
+void        draw_Profiler       (void); /* overlay on top of the window */
+
+#  define iBeginProfile(scope)  const uint64_t profile_##scope##_ = begin_Profiler()
+#  define iEndProfile(scope)    end_Profiler(scope##_ProfileScope, profile_##scope##_)
+
+#else
+
+#  define iBeginProfile(scope)
+#  define iEndProfile(scope)
+
+#endif
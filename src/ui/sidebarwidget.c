@@ -80,6 +80,19 @@ iEndDefineSubclass(SidebarItem)
 
 iDefineObjectConstruction(SidebarItem)
 
+static iBool isSameKey_SidebarItem_(const iSidebarItem *d, const iSidebarItem *other) {
+    return d->listItem.isSeparator == other->listItem.isSeparator && d->id == other->id &&
+           equal_String(&d->url, &other->url) &&
+           (!d->listItem.isSeparator || equal_String(&d->meta, &other->meta));
+}
+
+static iBool isSameContent_SidebarItem_(const iSidebarItem *d, const iSidebarItem *other) {
+    return d->listItem.isSelected == other->listItem.isSelected &&
+           d->listItem.height == other->listItem.height && d->indent == other->indent &&
+           d->icon == other->icon && equal_String(&d->label, &other->label) &&
+           equal_String(&d->meta, &other->meta);
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 struct Impl_SidebarWidget {
@@ -94,7 +107,8 @@ struct Impl_SidebarWidget {
     iWidget *         resizer;
     SDL_Cursor *      resizeCursor;
     iWidget *         menu;
-    iSidebarItem *    contextItem; /* list item accessed in the context menu */
+    iSidebarItem *    contextItem; /* list item accessed in the context menu (referenced) */
+    enum iSidebarMode itemsMode;   /* mode of the current list items */
 };
 
 iDefineObjectConstruction(SidebarWidget)
@@ -108,10 +122,17 @@ static int cmpTitle_Bookmark_(const iBookmark **a, const iBookmark **b) {
 }
 
 static void updateItems_SidebarWidget_(iSidebarWidget *d) {
-    clear_ListWidget(d->list);
+    /* Items are keyed, so only the changed rows need to be replaced in the list. Items from
+       another mode have unrelated keys, though. */
+    const iBool isNewMode = (d->itemsMode != d->mode);
+    if (isNewMode) {
+        clear_ListWidget(d->list);
+        destroy_Widget(d->menu);
+        d->menu = NULL;
+        d->itemsMode = d->mode;
+    }
     releaseChildren_Widget(d->blank);
-    destroy_Widget(d->menu);
-    d->menu = NULL;
+    iPtrArray *items = collectNew_PtrArray();
     switch (d->mode) {
         case feeds_SidebarMode: {
             const iString *docUrl = url_DocumentWidget(document_App());
@@ -138,15 +159,14 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                         iString *text = format_Date(&on, on.year == thisYear ? "%b. %d" : "%b. %d, %Y");
                         set_String(&sep->meta, text);
                         delete_String(text);
-                        addItem_ListWidget(d->list, sep);
-                        iRelease(sep);
+                        pushBack_PtrArray(items, sep);
                     }
                 }
                 iSidebarItem *item = new_SidebarItem();
                 if (equal_String(docUrl, &entry->url)) {
                     item->listItem.isSelected = iTrue; /* currently being viewed */
                 }
-                if (!containsUrl_Visited(visited_App(), &entry->url)) {
+                if (!entry->isRead) {
                     item->indent = 1; /* unread */
                 }
                 set_String(&item->url, &entry->url);
@@ -157,22 +177,23 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                     item->icon = bm->icon;
                     append_String(&item->meta, &bm->title);
                 }
-                addItem_ListWidget(d->list, item);
-                iRelease(item);
+                pushBack_PtrArray(items, item);
+            }
+            if (isNewMode) {
+                d->menu = makeMenu_Widget(
+                    as_Widget(d),
+                    (iMenuItem[]){ { "Open Entry in New Tab", 0, 0, "feed.entry.opentab" },
+                                   { "Open Feed Page", 0, 0, "feed.entry.openfeed" },
+                                   { "Mark as Read", 0, 0, "feed.entry.toggleread" },
+                                   { "Add Bookmark...", 0, 0, "feed.entry.bookmark" },
+                                   { "---", 0, 0, NULL },
+                                   { "Edit Feed...", 0, 0, "feed.entry.edit" },
+                                   { uiTextCaution_ColorEscape "Unsubscribe...", 0, 0, "feed.entry.unsubscribe" },
+                                   { "---", 0, 0, NULL },
+                                   { "Mark All as Read", SDLK_a, KMOD_SHIFT, "feeds.markallread" },
+                                   { "Refresh Feeds", SDLK_r, KMOD_PRIMARY | KMOD_SHIFT, "feeds.refresh" } },
+                    10);
             }
-            d->menu = makeMenu_Widget(
-                as_Widget(d),
-                (iMenuItem[]){ { "Open Entry in New Tab", 0, 0, "feed.entry.opentab" },
-                               { "Open Feed Page", 0, 0, "feed.entry.openfeed" },
-                               { "Mark as Read", 0, 0, "feed.entry.toggleread" },
-                               { "Add Bookmark...", 0, 0, "feed.entry.bookmark" },
-                               { "---", 0, 0, NULL },
-                               { "Edit Feed...", 0, 0, "feed.entry.edit" },
-                               { uiTextCaution_ColorEscape "Unsubscribe...", 0, 0, "feed.entry.unsubscribe" },
-                               { "---", 0, 0, NULL },
-                               { "Mark All as Read", SDLK_a, KMOD_SHIFT, "feeds.markallread" },
-                               { "Refresh Feeds", SDLK_r, KMOD_PRIMARY | KMOD_SHIFT, "feeds.refresh" } },
-                10);
             break;
         }
         case documentOutline_SidebarMode: {
@@ -183,8 +204,7 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                 item->id = index_ArrayConstIterator(&i);
                 setRange_String(&item->label, head->text);
                 item->indent = head->level * 5 * gap_UI;
-                addItem_ListWidget(d->list, item);
-                iRelease(item);
+                pushBack_PtrArray(items, item);
             }
             break;
         }
@@ -209,26 +229,29 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                         appendChar_String(&item->meta, 0x1f3e0);
                     }
                 }
-                addItem_ListWidget(d->list, item);
-                iRelease(item);
+                pushBack_PtrArray(items, item);
+            }
+            if (isNewMode) {
+                d->menu = makeMenu_Widget(
+                    as_Widget(d),
+                    (iMenuItem[]){ { "Edit Bookmark...", 0, 0, "bookmark.edit" },
+                                   { "Copy URL", 0, 0, "bookmark.copy" },
+                                   { "---", 0, 0, NULL },
+                                   { "Subscribe to Feed", 0, 0, "bookmark.tag tag:subscribed" },
+                                   { "", 0, 0, "bookmark.tag tag:homepage" },
+                                   { "---", 0, 0, NULL },
+                                   { uiTextCaution_ColorEscape "Delete Bookmark", 0, 0, "bookmark.delete" } },
+                   7);
             }
-            d->menu = makeMenu_Widget(
-                as_Widget(d),
-                (iMenuItem[]){ { "Edit Bookmark...", 0, 0, "bookmark.edit" },
-                               { "Copy URL", 0, 0, "bookmark.copy" },
-                               { "---", 0, 0, NULL },
-                               { "Subscribe to Feed", 0, 0, "bookmark.tag tag:subscribed" },
-                               { "", 0, 0, "bookmark.tag tag:homepage" },
-                               { "---", 0, 0, NULL },
-                               { uiTextCaution_ColorEscape "Delete Bookmark", 0, 0, "bookmark.delete" } },
-               7);
             break;
         }
         case history_SidebarMode: {
             iDate on;
             initCurrent_Date(&on);
             const int thisYear = on.year;
-            iConstForEach(PtrArray, i, list_Visited(visited_App(), 200)) {
+            const iVisited * visited = loadedVisited_App(); /* empty until loaded */
+            const iPtrArray *visits  = visited ? list_Visited(visited, 200) : collectNew_PtrArray();
+            iConstForEach(PtrArray, i, visits) {
                 const iVisitedUrl *visit = i.ptr;
                 iSidebarItem *item = new_SidebarItem();
                 set_String(&item->url, &visit->url);
@@ -244,34 +267,35 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                     set_String(&sep->meta, text);
                     const int yOffset = itemHeight_ListWidget(d->list) * 2 / 3;
                     sep->id = yOffset;
-                    addItem_ListWidget(d->list, sep);
-                    iRelease(sep);
+                    pushBack_PtrArray(items, sep);
                     /* Date separators are two items tall. */
                     sep = new_SidebarItem();
                     sep->listItem.isSeparator = iTrue;
                     sep->id = -itemHeight_ListWidget(d->list) + yOffset;
                     set_String(&sep->meta, text);
-                    addItem_ListWidget(d->list, sep);
-                    iRelease(sep);
+                    pushBack_PtrArray(items, sep);
                 }
-                addItem_ListWidget(d->list, item);
-                iRelease(item);
+                pushBack_PtrArray(items, item);
+            }
+            if (isNewMode) {
+                d->menu = makeMenu_Widget(
+                    as_Widget(d),
+                    (iMenuItem[]){
+                        { "Copy URL", 0, 0, "history.copy" },
+                        { "Add Bookmark...", 0, 0, "history.addbookmark" },
+                        { "---", 0, 0, NULL },
+                        { "Forget URL", 0, 0, "history.delete" },
+                        { "---", 0, 0, NULL },
+                        { uiTextCaution_ColorEscape "Clear History...", 0, 0, "history.clear confirm:1" },
+                    }, 6);
             }
-            d->menu = makeMenu_Widget(
-                as_Widget(d),
-                (iMenuItem[]){
-                    { "Copy URL", 0, 0, "history.copy" },
-                    { "Add Bookmark...", 0, 0, "history.addbookmark" },
-                    { "---", 0, 0, NULL },
-                    { "Forget URL", 0, 0, "history.delete" },
-                    { "---", 0, 0, NULL },
-                    { uiTextCaution_ColorEscape "Clear History...", 0, 0, "history.clear confirm:1" },
-                }, 6);
             break;
         }
         case identities_SidebarMode: {
-            const iString *tabUrl = url_DocumentWidget(document_App());
-            iConstForEach(PtrArray, i, identities_GmCerts(certs_App())) {
+            const iString *  tabUrl = url_DocumentWidget(document_App());
+            const iGmCerts * certs  = loadedCerts_App(); /* empty until loaded */
+            const iPtrArray *idents = certs ? identities_GmCerts(certs) : collectNew_PtrArray();
+            iConstForEach(PtrArray, i, idents) {
                 const iGmIdentity *ident = i.ptr;
                 iSidebarItem *item = new_SidebarItem();
                 item->id = index_PtrArrayConstIterator(&i);
@@ -302,8 +326,7 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                                         cstr_String(&ident->notes));
                 }
                 item->listItem.isSelected = isActive;
-                addItem_ListWidget(d->list, item);
-                iRelease(item);
+                pushBack_PtrArray(items, item);
             }
             const iMenuItem menuItems[] = {
                 { "Use on This Page", 0, 0, "ident.use arg:1" },
@@ -317,14 +340,21 @@ static void updateItems_SidebarWidget_(iSidebarWidget *d) {
                 { "Reveal Files", 0, 0, "ident.reveal" },
                 { uiTextCaution_ColorEscape "Delete Identity...", 0, 0, "ident.delete confirm:1" },
             };
-            d->menu = makeMenu_Widget(as_Widget(d), menuItems, iElemCount(menuItems));
+            if (isNewMode) {
+                d->menu = makeMenu_Widget(as_Widget(d), menuItems, iElemCount(menuItems));
+            }
             break;
         }
         default:
             break;
     }
-    updateVisible_ListWidget(d->list);
-    invalidate_ListWidget(d->list);
+    updateItems_ListWidget(d->list,
+                           items,
+                           (iListItemCompareFunc) isSameKey_SidebarItem_,
+                           (iListItemCompareFunc) isSameContent_SidebarItem_);
+    iForEach(PtrArray, i, items) {
+        iRelease(i.ptr);
+    }
     /* Content for a blank tab. */
     if (isEmpty_ListWidget(d->list)) {
         if (d->mode == feeds_SidebarMode) {
@@ -413,6 +443,7 @@ void init_SidebarWidget(iSidebarWidget *d) {
                     iTrue);
     iZap(d->modeScroll);
     d->mode  = -1;
+    d->itemsMode = -1;
     d->width = 60 * gap_UI;
     setFlags_Widget(w, fixedWidth_WidgetFlag, iTrue);
     d->maxButtonLabelWidth = 0;
@@ -452,10 +483,12 @@ void init_SidebarWidget(iSidebarWidget *d) {
     setBackgroundColor_Widget(d->resizer, none_ColorId);
     d->resizeCursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_SIZEWE);
     d->menu = NULL;
+    d->contextItem = NULL;
     addAction_Widget(w, SDLK_r, KMOD_PRIMARY | KMOD_SHIFT, "feeds.refresh");
 }
 
 void deinit_SidebarWidget(iSidebarWidget *d) {
+    iRelease(d->contextItem);
     SDL_FreeCursor(d->resizeCursor);
 }
 
@@ -544,6 +577,7 @@ void setWidth_SidebarWidget(iSidebarWidget *d, int width) {
     d->width = width;
     if (isVisible_Widget(w)) {
         w->rect.size.x = width;
+        invalidateLayout_Widget(w);
     }
     arrange_Widget(findWidget_App("doctabs"));
     checkModeButtonLayout_SidebarWidget_(d);
@@ -566,6 +600,7 @@ iBool handleBookmarkEditorCommands_SidebarWidget_(iWidget *editor, const char *c
             set_String(&bm->title, title);
             set_String(&bm->url, url);
             set_String(&bm->tags, tags);
+            markEdited_Bookmarks(bookmarks_App(), item->id);
             postCommand_App("bookmarks.changed");
         }
         setFlags_Widget(as_Widget(d), disabled_WidgetFlag, iFalse);
@@ -640,6 +675,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             setFlags_Widget(w, hidden_WidgetFlag, isVisible_Widget(w));
             if (isVisible_Widget(w)) {
                 w->rect.size.x = d->width;
+                invalidateLayout_Widget(w);
                 invalidate_ListWidget(d->list);
             }
             arrange_Widget(w->parent);
@@ -690,6 +726,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                 else {
                     addTag_Bookmark(bm, tag);
                 }
+                markEdited_Bookmarks(bookmarks_App(), item->id);
                 postCommand_App("bookmarks.changed");
             }
             return iTrue;
@@ -706,18 +743,14 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                  (d->mode == history_SidebarMode || d->mode == feeds_SidebarMode)) {
             updateItems_SidebarWidget_(d);
         }
-        else if (equal_Command(cmd, "feeds.update.finished") && d->mode == feeds_SidebarMode) {
+        else if ((equal_Command(cmd, "feeds.update.finished") ||
+                  equal_Command(cmd, "feeds.read.changed")) &&
+                 d->mode == feeds_SidebarMode) {
             updateItems_SidebarWidget_(d);
         }
         else if (equal_Command(cmd, "feeds.markallread") && d->mode == feeds_SidebarMode) {
-            iConstForEach(PtrArray, i, listEntries_Feeds()) {
-                const iFeedEntry *entry = i.ptr;
-                const iString *url = &entry->url;
-                if (!containsUrl_Visited(visited_App(), url)) {
-                    visitUrl_Visited(visited_App(), url, transient_VisitedUrlFlag);
-                }
-            }
-            postCommand_App("visited.changed");
+            markAllRead_Feeds();
+            postCommand_App("feeds.read.changed");
             return iTrue;
         }
         else if (startsWith_CStr(cmd, "feed.entry.") && d->mode == feeds_SidebarMode) {
@@ -728,14 +761,8 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                     return iTrue;
                 }
                 if (equal_Command(cmd, "feed.entry.toggleread")) {
-                    iVisited *vis = visited_App();
-                    if (containsUrl_Visited(vis, &item->url)) {
-                        removeUrl_Visited(vis, &item->url);
-                    }
-                    else {
-                        visitUrl_Visited(vis, &item->url, transient_VisitedUrlFlag);
-                    }
-                    postCommand_App("visited.changed");
+                    setEntryRead_Feeds(&item->url, !isEntryRead_Feeds(&item->url));
+                    postCommand_App("feeds.read.changed");
                     return iTrue;
                 }
                 if (equal_Command(cmd, "feed.entry.bookmark")) {
@@ -762,6 +789,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                     if (equal_Command(cmd, "feed.entry.unsubscribe")) {
                         if (arg_Command(cmd)) {
                             removeTag_Bookmark(feedBookmark, "subscribed");
+                            markEdited_Bookmarks(bookmarks_App(), id_Bookmark(feedBookmark));
                             removeEntries_Feeds(id_Bookmark(feedBookmark));
                             updateItems_SidebarWidget_(d);
                         }
@@ -827,7 +855,9 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
         else if (equal_Command(cmd, "ident.setnotes")) {
             iGmIdentity *ident = pointerLabel_Command(cmd, "ident");
             if (ident) {
-                setCStr_String(&ident->notes, suffixPtr_Command(cmd, "value"));
+                setNotes_GmCerts(certs_App(),
+                                 ident,
+                                 collectNewCStr_String(suffixPtr_Command(cmd, "value")));
                 updateItems_SidebarWidget_(d);
             }
             return iTrue;
@@ -931,7 +961,12 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                 updateMouseHover_ListWidget(d->list);
             }
             if (constHoverItem_ListWidget(d->list) || isVisible_Widget(d->menu)) {
+                /* The item is kept alive even if the list is updated while the menu is open. */
+                iRelease(d->contextItem);
                 d->contextItem = hoverItem_ListWidget(d->list);
+                if (d->contextItem) {
+                    ref_Object(d->contextItem);
+                }
                 /* Update menu items. */
                 /* TODO: Some callback-based mechanism would be nice for updating menus right
                    before they open? */
@@ -957,7 +992,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
                 }
                 else if (d->mode == feeds_SidebarMode && d->contextItem) {
                     iLabelWidget *menuItem = findMenuItem_Widget(d->menu, "feed.entry.toggleread");
-                    const iBool isRead = containsUrl_Visited(visited_App(), &d->contextItem->url);
+                    const iBool isRead = isEntryRead_Feeds(&d->contextItem->url);
                     setTextCStr_LabelWidget(menuItem, isRead ? "Mark as Unread" : "Mark as Read");
                 }
                 else if (d->mode == identities_SidebarMode) {
@@ -1059,12 +1094,13 @@ static void draw_SidebarItem_(const iSidebarItem *d, iPaint *p, iRect itemRect,
                                 width_Rect(itemRect) - scrollBarWidth,
                                 uiSeparator_ColorId);
             }
-            drawRange_Text(
+            drawRetained_Text(
                 uiLabelLarge_FontId,
                 add_I2(pos,
                        init_I2(3 * gap_UI,
                                itemHeight - lineHeight_Text(uiLabelLarge_FontId) - 1 * gap_UI)),
                 uiIcon_ColorId,
+                left_Alignment,
                 range_String(&d->meta));
         }
         else {
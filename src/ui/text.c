@@ -24,22 +24,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "color.h"
 #include "metrics.h"
 #include "embedded.h"
+#include "profiler.h"
 #include "app.h"
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "../stb_truetype.h"
 
 #include <the_Foundation/array.h>
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/math.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/stringlist.h>
-#include <the_Foundation/regexp.h>
 #include <the_Foundation/path.h>
+#include <the_Foundation/sortedarray.h>
+#include <the_Foundation/thread.h>
 #include <the_Foundation/vec2.h>
 
 #include <SDL_surface.h>
 #include <SDL_hints.h>
+#include <SDL_thread.h>
 #include <stdarg.h>
 
 iDeclareType(Font)
@@ -57,6 +62,7 @@ struct Impl_Glyph {
     uint32_t glyphIndex;
     const iFont *font; /* may come from symbols/emoji */
     iRect rect[2]; /* zero and half pixel offset */
+    uint8_t page[2]; /* glyph cache page of each rect */
     iInt2 d[2];
     float advance; /* scaled */
 };
@@ -67,6 +73,8 @@ void init_Glyph(iGlyph *d, iChar ch) {
     d->font       = NULL;
     d->rect[0]    = zero_Rect();
     d->rect[1]    = zero_Rect();
+    d->page[0]    = 0;
+    d->page[1]    = 0;
     d->advance    = 0.0f;
 }
 
@@ -84,38 +92,48 @@ iDefineTypeConstructionArgs(Glyph, (iChar ch), ch)
 
 struct Impl_Font {
     iBlock *       data;
-    stbtt_fontinfo font;
+    const iBlock * ttf;
+    const stbtt_fontinfo *font; /* shared by all sizes of the face; NULL until loaded */
+    iAtomicInt     isLoaded;
+    float          scaling;    /* glyph scaling (<=1.0) */
     float          scale;
     int            vertOffset; /* offset due to scaling */
     int            height;
     int            baseline;
-    iHash          glyphs;
+    iHash          glyphs;         /* glyphs outside the Basic Multilingual Plane */
+    iGlyph **      bmpGlyphs[256]; /* BMP glyphs in blocks of 256 codepoints */
+    uint8_t *      bmpFonts[256];  /* font ID (plus one) that has each BMP codepoint */
     iBool          isMonospaced;
     iBool          manualKernOnly;
     enum iFontId   symbolsFont;  /* font to use for symbols */
     enum iFontId   japaneseFont; /* font to use for Japanese glyphs */
     enum iFontId   koreanFont;   /* font to use for Korean glyphs */
     uint32_t       indexTable[128 - 32];
+    const iGlyph * asciiGlyphs[128 - 32]; /* cached glyphs of printable ASCII (main thread) */
 };
 
 static iFont *font_Text_(enum iFontId id);
 
+/* The font data is parsed only when the font is first used (see `load_Font_`). */
 static void init_Font(iFont *d, const iBlock *data, int height, float scale, enum iFontId symbolsFont) {
     init_Hash(&d->glyphs);
     d->data = NULL;
+    d->ttf = data;
+    d->font = NULL;
+    set_Atomic(&d->isLoaded, iFalse);
     d->height = height;
-    iZap(d->font);
-    stbtt_InitFont(&d->font, constData_Block(data), 0);
-    d->scale = stbtt_ScaleForPixelHeight(&d->font, height) * scale;
+    d->scaling = scale;
+    d->scale = 0.0f;
     d->vertOffset = height * (1.0f - scale) / 2;
-    int ascent;
-    stbtt_GetFontVMetrics(&d->font, &ascent, NULL, NULL);
-    d->baseline     = (int) ascent * d->scale;
+    d->baseline     = 0;
     d->symbolsFont  = symbolsFont;
     d->japaneseFont = regularJapanese_FontId;
     d->koreanFont   = regularKorean_FontId;
     d->isMonospaced = iFalse;
     memset(d->indexTable, 0xff, sizeof(d->indexTable));
+    memset(d->asciiGlyphs, 0, sizeof(d->asciiGlyphs));
+    memset(d->bmpGlyphs, 0, sizeof(d->bmpGlyphs));
+    memset(d->bmpFonts, 0, sizeof(d->bmpFonts));
 }
 
 static void deinit_Font(iFont *d) {
@@ -123,41 +141,216 @@ static void deinit_Font(iFont *d) {
         delete_Glyph((iGlyph *) i.value);
     }
     deinit_Hash(&d->glyphs);
+    iForIndices(b, d->bmpGlyphs) {
+        if (d->bmpGlyphs[b]) {
+            for (size_t j = 0; j < 256; j++) {
+                if (d->bmpGlyphs[b][j]) {
+                    delete_Glyph(d->bmpGlyphs[b][j]);
+                }
+            }
+            free(d->bmpGlyphs[b]);
+        }
+        free(d->bmpFonts[b]);
+    }
     delete_Block(d->data);
 }
 
-static uint32_t glyphIndex_Font_(iFont *d, iChar ch) {
+static iGlyph *findGlyph_Font_(const iFont *d, iChar ch) {
+    if (ch < 0x10000) {
+        iGlyph **block = d->bmpGlyphs[ch >> 8];
+        return block ? block[ch & 0xff] : NULL;
+    }
+    return (iGlyph *) value_Hash(&d->glyphs, ch);
+}
+
+static void insertGlyph_Font_(iFont *d, iGlyph *glyph) {
+    const iChar ch = codepoint_Glyph(glyph);
+    if (ch < 0x10000) {
+        iGlyph ***block = &d->bmpGlyphs[ch >> 8];
+        if (!*block) {
+            *block = calloc(256, sizeof(iGlyph *));
+        }
+        (*block)[ch & 0xff] = glyph;
+    }
+    else {
+        insert_Hash(&d->glyphs, &glyph->node);
+    }
+}
+
+/* Deletes the glyphs that have a rect on the given glyph cache page. */
+static void removeGlyphsOnPage_Font_(iFont *d, size_t page) {
+    iForEach(Hash, i, &d->glyphs) {
+        iGlyph *glyph = (iGlyph *) i.value;
+        if (glyph->page[0] == page || glyph->page[1] == page) {
+            remove_HashIterator(&i);
+            delete_Glyph(glyph);
+        }
+    }
+    iForIndices(b, d->bmpGlyphs) {
+        iGlyph **block = d->bmpGlyphs[b];
+        if (block) {
+            for (size_t j = 0; j < 256; j++) {
+                if (block[j] && (block[j]->page[0] == page || block[j]->page[1] == page)) {
+                    delete_Glyph(block[j]);
+                    block[j] = NULL;
+                }
+            }
+        }
+    }
+    memset(d->asciiGlyphs, 0, sizeof(d->asciiGlyphs));
+}
+
+static uint32_t glyphIndex_Font_(iFont *d, iChar ch, iBool useCache) {
     const size_t entry = ch - 32;
-    if (entry < iElemCount(d->indexTable)) {
+    if (useCache && entry < iElemCount(d->indexTable)) {
         if (d->indexTable[entry] == ~0u) {
-            d->indexTable[entry] = stbtt_FindGlyphIndex(&d->font, ch);
+            d->indexTable[entry] = stbtt_FindGlyphIndex(d->font, ch);
         }
         return d->indexTable[entry];
     }
-    return stbtt_FindGlyphIndex(&d->font, ch);
+    return stbtt_FindGlyphIndex(d->font, ch);
 }
 
+iDeclareType(FontFace)
+iDeclareType(RetainedText)
 iDeclareType(Text)
+
+struct Impl_FontFace {
+    const iBlock * ttf;
+    stbtt_fontinfo info;
+};
+
+/* Text drawn once into a texture of its own, so it can be blitted as a whole. */
+struct Impl_RetainedText {
+    iHashNode    node; /* hash of font and text */
+    int          fontId;
+    iString      text;
+    SDL_Texture *texture; /* white; colored when drawn */
+    iInt2        size;
+    int          left; /* texture's left edge relative to the text origin (zero or negative) */
+    uint32_t     lastUsed;
+};
+
+static const size_t maxRetainedPixels_Text_ = 2048 * 1024;
+
+iDeclareType(BlockChars)
+
+/* Result of `renderBlockChars_Text`. */
+struct Impl_BlockChars {
+    const iBlock *      fontData;
+    int                 height;
+    enum iTextBlockMode mode;
+    iString             text;
+    iString             rendered;
+};
+
+static const size_t maxBlockChars_Text_ = 16;
+
+static void deleteBlockChars_(iBlockChars *d) {
+    deinit_String(&d->text);
+    deinit_String(&d->rendered);
+    free(d);
+}
+
 iDeclareType(CacheRow)
+iDeclareType(CachePage)
 
 struct Impl_CacheRow {
     int   height;
     iInt2 pos;
 };
 
+/* The glyph cache consists of one or more pages of equal size. When all of them are full,
+   the least recently used page is emptied and its glyphs will be rasterized again when
+   they are next needed. */
+struct Impl_CachePage {
+    SDL_Texture *texture;
+    iArray       rows; /* CacheRow for each row height */
+    int          bottom;
+    uint32_t     lastUsed;
+    iBlock       pixels; /* RGBA4444 staging copy of the texture */
+    iRect        dirty;  /* area of `pixels` not yet uploaded to the texture */
+};
+
+static const size_t maxCachePages_Text_ = 8;
+
+iDeclareType(MeasureEntry)
+
+/* Result of measuring a text segment. Layout measures the same paragraphs over and over
+   again, so the results are kept in a direct-mapped cache, replacing colliding entries. */
+struct Impl_MeasureEntry {
+    uint64_t hash; /* of the text bytes; zero if the entry is unused */
+    uint32_t length;
+    uint16_t fontId;
+    int      width; /* wrap width, or zero if not wrapped */
+    iInt2    size;
+    int      advance;
+    uint32_t endOffset; /* where wrapping stopped */
+};
+
+#define numMeasureEntries_Text_ 16384
+
+iDeclareType(RasterRequest)
+iDeclareType(RasterGlyph)
+
+struct Impl_RasterRequest {
+    iFont *  font; /* the font that has the glyph */
+    iChar    ch;
+    uint32_t glyphIndex;
+    uint32_t key; /* in `rasterPending` */
+    uint32_t generation;
+};
+
+/* Glyph rasterized by the worker thread, waiting to be stored in the glyph cache. */
+struct Impl_RasterGlyph {
+    iFont *  font;
+    iChar    ch;
+    uint32_t key;
+    uint32_t generation;
+    uint32_t glyphIndex;
+    float    advance;
+    iInt2    d[2];
+    iInt2    size[2];
+    iBlock   coverage; /* 8-bit bitmaps of both offsets, one after the other */
+};
+
 struct Impl_Text {
     enum iTextFont contentFont;
     enum iTextFont headingFont;
     float          contentFontSize;
     iFont          fonts[max_FontId];
+    iFontFace      faces[max_FontId]; /* parsed font data, shared between font sizes */
+    size_t         numFaces;
+    iMutex *       loadMutex;
     SDL_Renderer * render;
-    SDL_Texture *  cache;
-    iInt2          cacheSize;
+    iArray         cachePages;
+    size_t         cachePage; /* page where new glyphs are placed */
+    iInt2          cacheSize; /* of each page */
     int            cacheRowAllocStep;
-    int            cacheBottom;
-    iArray         cacheRows;
-    SDL_Palette *  grayscale;
-    iRegExp *      ansiEscape;
+    uint32_t       cacheTick;
+    iColor         cacheColorMod;
+    uint8_t        cacheAlphaMod;
+    SDL_BlendMode  cacheBlendMode;
+    iTextCacheStats cacheStats;
+    iBlock         rasterBuf; /* 8-bit coverage of the glyph being rasterized */
+    iMeasureEntry *measureCache; /* numMeasureEntries_Text_ */
+    iMutex *       measureMutex;
+    iThread *      rasterThread; /* rasterizes glyphs ahead of use */
+    iMutex *       rasterMutex;
+    iCondition     rasterAvailable;
+    iArray         rasterQueue;   /* RasterRequests */
+    iSortedArray   rasterPending; /* keys of the requested glyphs not yet stored */
+    iPtrArray      rasterDone;    /* RasterGlyphs */
+    iAtomicInt     hasRasterDone;
+    uint32_t       rasterGeneration; /* incremented when fonts are reset (both locks held) */
+    iBool          rasterQuit;
+    iHash          retained; /* RetainedTexts */
+    iPtrArray      blockChars; /* recently rendered BlockChars, oldest first */
+    iMutex *       blockCharsMutex;
+    size_t         retainedPixels;
+    uint32_t       retainedTick;
+    SDL_threadID   mainThread;
+    iMutex *       fontsMutex; /* held by other threads while measuring */
 };
 
 static iText text_;
@@ -315,10 +508,49 @@ static void deinitFonts_Text_(iText *d) {
     iForIndices(i, d->fonts) {
         deinit_Font(&d->fonts[i]);
     }
+    d->numFaces = 0;
+}
+
+static void initCachePage_Text_(iText *d, iCachePage *page) {
+    init_Array(&page->rows, sizeof(iCacheRow));
+    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
+       once at least one glyph is stored. */
+    const int textSize = d->contentFontSize * fontSize_UI;
+    for (int h = d->cacheRowAllocStep; h <= 2 * textSize; h += d->cacheRowAllocStep) {
+        pushBack_Array(&page->rows, &(iCacheRow){ .height = 0 });
+    }
+    page->bottom   = 0;
+    page->lastUsed = d->cacheTick;
+    init_Block(&page->pixels, 2 * d->cacheSize.x * d->cacheSize.y);
+    memset(data_Block(&page->pixels), 0, size_Block(&page->pixels));
+    page->dirty    = zero_Rect();
+    page->texture  = SDL_CreateTexture(d->render,
+                                      SDL_PIXELFORMAT_RGBA4444,
+                                      SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
+                                      d->cacheSize.x,
+                                      d->cacheSize.y);
+    SDL_SetTextureBlendMode(page->texture, d->cacheBlendMode);
+    SDL_SetTextureColorMod(
+        page->texture, d->cacheColorMod.r, d->cacheColorMod.g, d->cacheColorMod.b);
+    SDL_SetTextureAlphaMod(page->texture, d->cacheAlphaMod);
+}
+
+static void resetCachePage_Text_(iText *d, iCachePage *page) {
+    iForEach(Array, i, &page->rows) {
+        ((iCacheRow *) i.value)->height = 0;
+    }
+    page->bottom   = 0;
+    page->lastUsed = d->cacheTick;
+}
+
+static void deinitCachePage_Text_(iCachePage *page) {
+    deinit_Block(&page->pixels);
+    deinit_Array(&page->rows);
+    SDL_DestroyTexture(page->texture);
 }
 
 static void initCache_Text_(iText *d) {
-    init_Array(&d->cacheRows, sizeof(iCacheRow));
+    init_Array(&d->cachePages, sizeof(iCachePage));
     const int textSize = d->contentFontSize * fontSize_UI;
     iAssert(textSize > 0);
     const iInt2 cacheDims = init_I2(16, 80);
@@ -330,55 +562,142 @@ static void initCache_Text_(iText *d) {
         d->cacheSize.x = renderInfo.max_texture_width;
     }    
     d->cacheRowAllocStep = iMax(2, textSize / 6);
-    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
-       once at least one glyph is stored. */
-    for (int h = d->cacheRowAllocStep; h <= 2 * textSize; h += d->cacheRowAllocStep) {
-        pushBack_Array(&d->cacheRows, &(iCacheRow){ .height = 0 });
-    }
-    d->cacheBottom = 0;
-    d->cache = SDL_CreateTexture(d->render,
-                                 SDL_PIXELFORMAT_RGBA4444,
-                                 SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
-                                 d->cacheSize.x,
-                                 d->cacheSize.y);    
-    SDL_SetTextureBlendMode(d->cache, SDL_BLENDMODE_BLEND);
+    d->cacheTick         = 0;
+    d->cacheColorMod     = (iColor){ 255, 255, 255, 255 };
+    d->cacheAlphaMod     = 255;
+    d->cacheBlendMode    = SDL_BLENDMODE_BLEND;
+    iZap(d->cacheStats);
+    /* Pages are added as needed. */
+    d->cachePage = 0;
+    resize_Array(&d->cachePages, 1);
+    initCachePage_Text_(d, front_Array(&d->cachePages));
+    d->cacheStats.numPages = 1;
 }
 
 static void deinitCache_Text_(iText *d) {
-    deinit_Array(&d->cacheRows);
-    SDL_DestroyTexture(d->cache);
+    iForEach(Array, i, &d->cachePages) {
+        deinitCachePage_Text_(i.value);
+    }
+    deinit_Array(&d->cachePages);
+}
+
+static void setCacheColorMod_Text_(iText *d, iColor clr) {
+    d->cacheColorMod = clr;
+    iForEach(Array, i, &d->cachePages) {
+        SDL_SetTextureColorMod(((iCachePage *) i.value)->texture, clr.r, clr.g, clr.b);
+    }
 }
 
+static void setCacheBlendMode_Text_(iText *d, SDL_BlendMode mode) {
+    d->cacheBlendMode = mode;
+    iForEach(Array, i, &d->cachePages) {
+        SDL_SetTextureBlendMode(((iCachePage *) i.value)->texture, mode);
+    }
+}
+
+static void initRaster_Text_(iText *d);
+static void deinitRaster_Text_(iText *d);
+static void resetRaster_Text_(iText *d);
+static void prewarm_Text_(iText *d);
+static void clearRetained_Text_(iText *d);
+
 void init_Text(SDL_Renderer *render) {
     iText *d = &text_;
     d->contentFont     = nunito_TextFont;
     d->headingFont     = nunito_TextFont;
     d->contentFontSize = contentScale_Text_;    
-    d->ansiEscape      = new_RegExp("\\[([0-9;]+)m", 0);
     d->render          = render;
-    /* A grayscale palette for rasterized glyphs. */ {
-        SDL_Color colors[256];
-        for (int i = 0; i < 256; ++i) {
-            colors[i] = (SDL_Color){ 255, 255, 255, i };
-        }
-        d->grayscale = SDL_AllocPalette(256);
-        SDL_SetPaletteColors(d->grayscale, colors, 0, 256);
-    }
+    d->mainThread      = SDL_ThreadID();
+    d->fontsMutex      = new_Mutex();
+    d->loadMutex       = new_Mutex();
+    d->numFaces        = 0;
+    init_Block(&d->rasterBuf, 0);
+    d->measureCache    = calloc(numMeasureEntries_Text_, sizeof(iMeasureEntry));
+    d->measureMutex    = new_Mutex();
+    init_Hash(&d->retained);
+    init_PtrArray(&d->blockChars);
+    d->blockCharsMutex = new_Mutex();
+    d->retainedPixels  = 0;
+    d->retainedTick    = 0;
     initCache_Text_(d);
     initFonts_Text_(d);
+    initRaster_Text_(d);
 }
 
 void deinit_Text(void) {
     iText *d = &text_;
-    SDL_FreePalette(d->grayscale);
+    deinitRaster_Text_(d);
+    clearRetained_Text_(d);
+    deinit_Hash(&d->retained);
+    iForEach(PtrArray, bc, &d->blockChars) {
+        deleteBlockChars_(bc.ptr);
+    }
+    deinit_PtrArray(&d->blockChars);
+    delete_Mutex(d->blockCharsMutex);
     deinitFonts_Text_(d);
     deinitCache_Text_(d);
+    deinit_Block(&d->rasterBuf);
+    free(d->measureCache);
+    delete_Mutex(d->measureMutex);
     d->render = NULL;
-    iRelease(d->ansiEscape);
+    delete_Mutex(d->fontsMutex);
+    delete_Mutex(d->loadMutex);
+}
+
+static void setCacheAlphaMod_Text_(iText *d, uint8_t alpha) {
+    d->cacheAlphaMod = alpha;
+    iForEach(Array, i, &d->cachePages) {
+        SDL_SetTextureAlphaMod(((iCachePage *) i.value)->texture, d->cacheAlphaMod);
+    }
 }
 
 void setOpacity_Text(float opacity) {
-    SDL_SetTextureAlphaMod(text_.cache, iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f);
+    setCacheAlphaMod_Text_(&text_, iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f);
+}
+
+iTextCacheStats cacheStats_Text(void) {
+    return text_.cacheStats;
+}
+
+static void addGlyphStats_(iFontCacheStats *stats, const iGlyph *glyph) {
+    stats->numGlyphs++;
+    for (int i = 0; i < 2; i++) {
+        stats->numPixels += (size_t) glyph->rect[i].size.x * glyph->rect[i].size.y;
+    }
+}
+
+iFontCacheStats fontCacheStats_Text(enum iFontId fontId) {
+    iFontCacheStats stats;
+    iZap(stats);
+    const iFont *font = &text_.fonts[fontId];
+    stats.height = font->height;
+    iConstForEach(Hash, i, &font->glyphs) {
+        addGlyphStats_(&stats, (const iGlyph *) i.value);
+    }
+    iForIndices(b, font->bmpGlyphs) {
+        iGlyph *const *block = font->bmpGlyphs[b];
+        if (block) {
+            for (size_t j = 0; j < 256; j++) {
+                if (block[j]) {
+                    addGlyphStats_(&stats, block[j]);
+                }
+            }
+        }
+    }
+    return stats;
+}
+
+size_t cacheBytes_Text(void) {
+    /* RGBA4444 pixels, both in the texture and in its staging copy. */
+    return size_Array(&text_.cachePages) * 4 * text_.cacheSize.x * text_.cacheSize.y;
+}
+
+size_t cachePageSize_Text(void) {
+    return (size_t) text_.cacheSize.x * text_.cacheSize.y;
+}
+
+size_t retainedBytes_Text(void) {
+    return text_.retainedPixels * 4;
 }
 
 void setContentFont_Text(enum iTextFont font) {
@@ -406,128 +725,233 @@ void setContentFontSize_Text(float fontSizeFactor) {
 
 void resetFonts_Text(void) {
     iText *d = &text_;
+    lock_Mutex(d->fontsMutex);
+    resetRaster_Text_(d);
+    iGuardMutex(d->measureMutex, {
+        memset(d->measureCache, 0, sizeof(iMeasureEntry) * numMeasureEntries_Text_);
+    });
     deinitFonts_Text_(d);
     deinitCache_Text_(d);
     initCache_Text_(d);
     initFonts_Text_(d);
+    unlock_Mutex(d->fontsMutex);
+    clearRetained_Text_(d);
+    prewarm_Text_(d);
 }
 
-iLocalDef iFont *font_Text_(enum iFontId id) {
-    return &text_.fonts[id];
+uint32_t fontsKey_Text(void) {
+    const iText *d = &text_;
+    return (uint32_t) d->contentFont | ((uint32_t) d->headingFont << 4) |
+           ((uint32_t) iRound(d->contentFontSize * 100) & 0xfff) << 8 |
+           ((uint32_t) fontSize_UI & 0xfff) << 20;
 }
 
-static void freeBmp_(void *ptr) {
-    stbtt_FreeBitmap(ptr, NULL);
+static const stbtt_fontinfo *face_Text_(iText *d, const iBlock *ttf) {
+    for (size_t i = 0; i < d->numFaces; i++) {
+        if (d->faces[i].ttf == ttf) {
+            return &d->faces[i].info;
+        }
+    }
+    iAssert(d->numFaces < iElemCount(d->faces));
+    iFontFace *face = &d->faces[d->numFaces++];
+    face->ttf = ttf;
+    iZap(face->info);
+    stbtt_InitFont(&face->info, constData_Block(ttf), 0);
+    return &face->info;
+}
+
+/* Fonts may be first used in any thread. */
+static void load_Font_(iFont *d) {
+    iText *txt = &text_;
+    lock_Mutex(txt->loadMutex);
+    if (!value_Atomic(&d->isLoaded)) {
+        d->font  = face_Text_(txt, d->ttf);
+        d->scale = stbtt_ScaleForPixelHeight(d->font, d->height) * d->scaling;
+        int ascent;
+        stbtt_GetFontVMetrics(d->font, &ascent, NULL, NULL);
+        d->baseline = (int) ascent * d->scale;
+        set_Atomic(&d->isLoaded, iTrue);
+    }
+    unlock_Mutex(txt->loadMutex);
 }
 
-static SDL_Surface *rasterizeGlyph_Font_(const iFont *d, uint32_t glyphIndex, float xShift) {
-    int w, h;
-    uint8_t *bmp = stbtt_GetGlyphBitmapSubpixel(
-        &d->font, d->scale, d->scale, xShift, 0.0f, glyphIndex, &w, &h, 0, 0);
-    collect_Garbage(bmp, freeBmp_); /* `bmp` must be freed afterwards. */
-    SDL_Surface *surface8 =
-        SDL_CreateRGBSurfaceWithFormatFrom(bmp, w, h, 8, w, SDL_PIXELFORMAT_INDEX8);
-    SDL_SetSurfacePalette(surface8, text_.grayscale);
-    SDL_PixelFormat *fmt = SDL_AllocFormat(SDL_PIXELFORMAT_RGBA8888);
-    SDL_Surface *surface = SDL_ConvertSurface(surface8, fmt, 0);
-    SDL_FreeFormat(fmt);
-    SDL_FreeSurface(surface8);
-    return surface;
+iLocalDef iFont *font_Text_(enum iFontId id) {
+    iFont *font = &text_.fonts[id];
+    if (!value_Atomic(&font->isLoaded)) {
+        load_Font_(font);
+    }
+    return font;
 }
 
 iLocalDef SDL_Rect sdlRect_(const iRect rect) {
     return (SDL_Rect){ rect.pos.x, rect.pos.y, rect.size.x, rect.size.y };
 }
 
-iLocalDef iCacheRow *cacheRow_Text_(iText *d, int height) {
-    return at_Array(&d->cacheRows, (height - 1) / d->cacheRowAllocStep);
+/* Uploads the rasterized but not yet uploaded glyphs of a page to its texture. All the
+   glyphs added since the previous upload are sent with a single update. */
+static void uploadCachePage_Text_(iText *d, iCachePage *page) {
+    if (isEmpty_Rect(page->dirty)) {
+        return;
+    }
+    const int      pitch = 2 * d->cacheSize.x;
+    const SDL_Rect rect  = sdlRect_(page->dirty);
+    SDL_UpdateTexture(page->texture,
+                      &rect,
+                      (const char *) constData_Block(&page->pixels) + rect.y * pitch + 2 * rect.x,
+                      pitch);
+    page->dirty = zero_Rect();
+}
+
+iLocalDef iCacheRow *cacheRow_CachePage_(iCachePage *d, int height, int allocStep) {
+    return at_Array(&d->rows, (height - 1) / allocStep);
 }
 
-static iInt2 assignCachePos_Text_(iText *d, iInt2 size) {
-    iCacheRow *cur = cacheRow_Text_(d, size.y);
-    if (cur->height == 0) {
-        /* Begin a new row height. */
-        cur->height = (1 + (size.y - 1) / d->cacheRowAllocStep) * d->cacheRowAllocStep;
-        cur->pos.y = d->cacheBottom;
-        d->cacheBottom = cur->pos.y + cur->height;
+/* Empties the least recently used page (other than the current one) so it can be reused.
+   Glyphs stored on the page are forgotten. */
+static size_t evictCachePage_Text_(iText *d) {
+    size_t evicted = iInvalidPos;
+    iConstForEach(Array, i, &d->cachePages) {
+        const size_t index = index_ArrayConstIterator(&i);
+        if (index != d->cachePage &&
+            (evicted == iInvalidPos ||
+             ((const iCachePage *) i.value)->lastUsed <
+                 ((const iCachePage *) constAt_Array(&d->cachePages, evicted))->lastUsed)) {
+            evicted = index;
+        }
     }
-    iAssert(cur->height >= size.y);
-    /* TODO: Automatically enlarge the cache if running out of space?
-       Maybe make it paged, but beware of texture swapping too often inside a text string. */
-    if (cur->pos.x + size.x > d->cacheSize.x) {
-        /* Does not fit on this row, advance to a new location in the cache. */
-        cur->pos.y = d->cacheBottom;
-        cur->pos.x = 0;
-        d->cacheBottom += cur->height;
-        iAssert(d->cacheBottom <= d->cacheSize.y);
+    iAssert(evicted != iInvalidPos);
+    iForIndices(f, d->fonts) {
+        removeGlyphsOnPage_Font_(&d->fonts[f], evicted);
+    }
+    resetCachePage_Text_(d, at_Array(&d->cachePages, evicted));
+    d->cacheStats.numEvictions++;
+    return evicted;
+}
+
+/* Returns the page where a new row of height `rowHeight` can be started. */
+static size_t nextCachePage_Text_(iText *d, int rowHeight) {
+    const iCachePage *cur = constAt_Array(&d->cachePages, d->cachePage);
+    if (cur->bottom + rowHeight <= d->cacheSize.y) {
+        return d->cachePage;
     }
+    if (size_Array(&d->cachePages) < maxCachePages_Text_) {
+        pushBack_Array(&d->cachePages, &(iCachePage){ .texture = NULL });
+        initCachePage_Text_(d, back_Array(&d->cachePages));
+        d->cacheStats.numPages = size_Array(&d->cachePages);
+        return size_Array(&d->cachePages) - 1;
+    }
+    return evictCachePage_Text_(d);
+}
+
+static iInt2 assignCachePos_Text_(iText *d, iInt2 size, uint8_t *page_out) {
+    iCachePage *page = at_Array(&d->cachePages, d->cachePage);
+    iCacheRow  *cur  = cacheRow_CachePage_(page, size.y, d->cacheRowAllocStep);
+    const int   rowHeight = (1 + (size.y - 1) / d->cacheRowAllocStep) * d->cacheRowAllocStep;
+    if (cur->height == 0 || cur->pos.x + size.x > d->cacheSize.x) {
+        /* Begin a new row, or the glyph does not fit on this row: advance to a new location
+           in the cache, on a different page if this one is full. */
+        const size_t next = nextCachePage_Text_(d, rowHeight);
+        if (next != d->cachePage) {
+            d->cachePage = next;
+            page = at_Array(&d->cachePages, next);
+            cur  = cacheRow_CachePage_(page, size.y, d->cacheRowAllocStep);
+        }
+        cur->height  = rowHeight;
+        cur->pos     = init_I2(0, page->bottom);
+        page->bottom += rowHeight;
+    }
+    iAssert(cur->height >= size.y);
+    iAssert(page->bottom <= d->cacheSize.y);
     const iInt2 assigned = cur->pos;
     cur->pos.x += size.x;
+    page->lastUsed = ++d->cacheTick;
+    *page_out = (uint8_t) d->cachePage;
     return assigned;
 }
 
-static void cache_Font_(iFont *d, iGlyph *glyph, int hoff) {
-    iText *txt = &text_;
-    SDL_Renderer *render = txt->render;
-    SDL_Texture *tex = NULL;
-    SDL_Surface *surface = NULL;
+static void measureBitmap_Font_(const iFont *d, uint32_t glyphIndex, int hoff, iInt2 *d_out,
+                                iInt2 *size_out) {
+    int x1, y1;
+    stbtt_GetGlyphBitmapBoxSubpixel(d->font,
+                                    glyphIndex,
+                                    d->scale,
+                                    d->scale,
+                                    hoff * 0.5f,
+                                    0.0f,
+                                    &d_out->x,
+                                    &d_out->y,
+                                    &x1,
+                                    &y1);
+    *size_out = init_I2(x1 - d_out->x, y1 - d_out->y);
+    d_out->y += d->vertOffset;
+}
+
+static void rasterize_Font_(const iFont *d, uint32_t glyphIndex, int hoff, iInt2 size,
+                            uint8_t *coverage_out) {
+    stbtt_MakeGlyphBitmapSubpixel(d->font, coverage_out, size.x, size.y, size.x,
+                                  d->scale, d->scale, hoff * 0.5f, 0.0f, glyphIndex);
+}
+
+/* Places a rasterized glyph in the glyph cache. It is copied to the staging copy of a cache
+   page, and the texture is updated when the page is next drawn from. */
+static void storeBitmap_Text_(iText *d, iGlyph *glyph, int hoff, const uint8_t *coverage) {
     iRect *glRect = &glyph->rect[hoff];
-    /* Rasterize the glyph using stbtt. */ {
-        surface = rasterizeGlyph_Font_(d, glyph->glyphIndex, hoff * 0.5f);
-        if (hoff == 0) { /* hoff==1 uses same `glyph` */
-            int adv;
-            const uint32_t gIndex = glyph->glyphIndex;
-            stbtt_GetGlyphHMetrics(&d->font, gIndex, &adv, NULL);
-            glyph->advance = d->scale * adv;
+    /* Determine placement in the glyph cache, advancing in rows. */
+    glRect->pos = assignCachePos_Text_(d, glRect->size, &glyph->page[hoff]);
+    iCachePage *page = at_Array(&d->cachePages, glyph->page[hoff]);
+    const int   w    = glRect->size.x;
+    const int   h    = glRect->size.y;
+    uint16_t *  dst  = (uint16_t *) data_Block(&page->pixels) + glRect->pos.y * d->cacheSize.x +
+                    glRect->pos.x;
+    for (int y = 0; y < h; y++, dst += d->cacheSize.x, coverage += w) {
+        for (int x = 0; x < w; x++) {
+            dst[x] = 0xfff0 | (coverage[x] >> 4); /* white, with coverage as alpha */
         }
-        stbtt_GetGlyphBitmapBoxSubpixel(&d->font,
-                                        glyph->glyphIndex,
-                                        d->scale,
-                                        d->scale,
-                                        hoff * 0.5f,
-                                        0.0f,
-                                        &glyph->d[hoff].x,
-                                        &glyph->d[hoff].y,
-                                        NULL,
-                                        NULL);
-        glyph->d[hoff].y += d->vertOffset;
-        tex = SDL_CreateTextureFromSurface(render, surface);
-        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_NONE);
-        glRect->size = init_I2(surface->w, surface->h);
-    }
-    if (tex) {
-        /* Determine placement in the glyph cache texture, advancing in rows. */
-        glRect->pos = assignCachePos_Text_(txt, glRect->size);
-        const SDL_Rect dstRect = sdlRect_(*glRect);
-        SDL_RenderCopy(render, tex, &(SDL_Rect){ 0, 0, dstRect.w, dstRect.h }, &dstRect);
-        SDL_DestroyTexture(tex);
-        iAssert(surface);
-        SDL_FreeSurface(surface);
-    }
-}
-
-iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
-    if ((*glyphIndex = glyphIndex_Font_(d, ch)) != 0) {
+    }
+    page->dirty = isEmpty_Rect(page->dirty) ? *glRect : union_Rect(page->dirty, *glRect);
+}
+
+static void cache_Font_(iFont *d, iGlyph *glyph, int hoff) {
+    iBeginProfile(glyphs);
+    iText *txt    = &text_;
+    iRect *glRect = &glyph->rect[hoff];
+    if (hoff == 0) { /* hoff==1 uses same `glyph` */
+        int adv;
+        stbtt_GetGlyphHMetrics(d->font, glyph->glyphIndex, &adv, NULL);
+        glyph->advance = d->scale * adv;
+    }
+    measureBitmap_Font_(d, glyph->glyphIndex, hoff, &glyph->d[hoff], &glRect->size);
+    if (!isEmpty_Rect(*glRect)) {
+        /* Rasterize the glyph using stbtt. */
+        resize_Block(&txt->rasterBuf, glRect->size.x * glRect->size.y);
+        rasterize_Font_(d, glyph->glyphIndex, hoff, glRect->size, data_Block(&txt->rasterBuf));
+        storeBitmap_Text_(txt, glyph, hoff, constData_Block(&txt->rasterBuf));
+    }
+    iEndProfile(glyphs);
+}
+
+iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex, iBool useCache) {
+    if ((*glyphIndex = glyphIndex_Font_(d, ch, useCache)) != 0) {
         return d;
     }
     /* Not defined in current font, try Noto Emoji (for selected characters). */
     if ((ch >= 0x1f300 && ch < 0x1f600) || (ch >= 0x1f680 && ch <= 0x1f6c5)) {
         iFont *emoji = font_Text_(d->symbolsFont + fromSymbolsToEmojiOffset_FontId);
-        if (emoji != d && (*glyphIndex = glyphIndex_Font_(emoji, ch)) != 0) {
+        if (emoji != d && (*glyphIndex = glyphIndex_Font_(emoji, ch, useCache)) != 0) {
             return emoji;
         }
     }
     /* Could be Korean. */
     if (ch >= 0x3000) {
         iFont *korean = font_Text_(d->koreanFont);
-        if (korean != d && (*glyphIndex = glyphIndex_Font_(korean, ch)) != 0) {
+        if (korean != d && (*glyphIndex = glyphIndex_Font_(korean, ch, useCache)) != 0) {
             return korean;
         }
     }
     /* Japanese perhaps? */
     if (ch > 0x3040) {
         iFont *japanese = font_Text_(d->japaneseFont);
-        if (japanese != d && (*glyphIndex = glyphIndex_Font_(japanese, ch)) != 0) {
+        if (japanese != d && (*glyphIndex = glyphIndex_Font_(japanese, ch, useCache)) != 0) {
             return japanese;
         }
     }
@@ -535,47 +959,54 @@ iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
     /* White up arrow is used for the Shift key on macOS. Symbola's glyph is not a great
        match to the other text, so use the UI font instead. */
     if ((ch == 0x2318 || ch == 0x21e7) && d == font_Text_(regular_FontId)) {
-        *glyphIndex = glyphIndex_Font_(d = font_Text_(defaultContentSized_FontId), ch);
+        *glyphIndex = glyphIndex_Font_(d = font_Text_(defaultContentSized_FontId), ch, useCache);
         return d;
     }
 #endif
     /* Fall back to Symbola for anything else. */
     iFont *font = font_Text_(d->symbolsFont);
-    *glyphIndex = glyphIndex_Font_(font, ch);
+    *glyphIndex = glyphIndex_Font_(font, ch, useCache);
 //    if (!*glyphIndex) {
 //        fprintf(stderr, "failed to find %08x (%lc)\n", ch, ch); fflush(stderr);
 //    }
     return font;
 }
 
+/* The glyph may actually come from a different font. For BMP codepoints, the font that
+   has the glyph is looked up only once; this includes codepoints that no font has. */
+static iFont *glyphFont_Font_(iFont *d, iChar ch) {
+    uint32_t glyphIndex;
+    if (ch >= 0x10000) {
+        return characterFont_Font_(d, ch, &glyphIndex, iTrue);
+    }
+    uint8_t **block = &d->bmpFonts[ch >> 8];
+    if (!*block) {
+        *block = calloc(256, 1);
+    }
+    uint8_t *entry = &(*block)[ch & 0xff];
+    if (!*entry) {
+        *entry = 1 + (uint8_t) (characterFont_Font_(d, ch, &glyphIndex, iTrue) - text_.fonts);
+    }
+    return &text_.fonts[*entry - 1];
+}
+
 static const iGlyph *glyph_Font_(iFont *d, iChar ch) {
-    uint32_t glyphIndex = 0;
-    /* The glyph may actually come from a different font; look up the right font. */
-    iFont *font = characterFont_Font_(d, ch, &glyphIndex);
-    const void *node = value_Hash(&font->glyphs, ch);
+    iFont *font = glyphFont_Font_(d, ch);
+    const iGlyph *node = findGlyph_Font_(font, ch);
     if (node) {
+        text_.cacheStats.numHits++;
         return node;
     }
+    text_.cacheStats.numMisses++;
     iGlyph *glyph     = new_Glyph(ch);
-    glyph->glyphIndex = glyphIndex;
+    glyph->glyphIndex = glyphIndex_Font_(font, ch, iTrue);
     glyph->font       = font;
-    SDL_Texture *oldTarget = SDL_GetRenderTarget(text_.render);
-    SDL_SetRenderTarget(text_.render, text_.cache);
     cache_Font_(font, glyph, 0);
     cache_Font_(font, glyph, 1); /* half-pixel offset */
-    SDL_SetRenderTarget(text_.render, oldTarget);
-    insert_Hash(&font->glyphs, &glyph->node);
+    insertGlyph_Font_(font, glyph);
     return glyph;
 }
 
-enum iRunMode {
-    measure_RunMode,
-    measureNoWrap_RunMode,
-    measureVisual_RunMode, /* actual visible bounding box of the glyph, e.g., for icons */
-    draw_RunMode,
-    drawPermanentColor_RunMode
-};
-
 static iChar nextChar_(const char **chPos, const char *end) {
     if (*chPos == end) {
         return 0;
@@ -590,6 +1021,268 @@ static iChar nextChar_(const char **chPos, const char *end) {
     return ch;
 }
 
+/*-----------------------------------------------------------------------------------------------*/
+
+/* Glyphs can be rasterized ahead of use in a worker thread: printable ASCII of the primary
+   fonts after the fonts are (re)initialized, and the characters of a document before it is
+   drawn. The main thread then only needs to store the bitmaps in the glyph cache. */
+
+static int cmpKey_RasterRequest_(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void delete_RasterGlyph_(iRasterGlyph *d) {
+    deinit_Block(&d->coverage);
+    free(d);
+}
+
+static iRasterGlyph *rasterize_RasterRequest_(const iRasterRequest *req) {
+    iRasterGlyph *d = calloc(1, sizeof(iRasterGlyph));
+    d->font       = req->font;
+    d->ch         = req->ch;
+    d->glyphIndex = req->glyphIndex;
+    d->key        = req->key;
+    d->generation = req->generation;
+    int adv;
+    stbtt_GetGlyphHMetrics(d->font->font, d->glyphIndex, &adv, NULL);
+    d->advance = d->font->scale * adv;
+    for (int hoff = 0; hoff < 2; hoff++) {
+        measureBitmap_Font_(d->font, d->glyphIndex, hoff, &d->d[hoff], &d->size[hoff]);
+    }
+    const size_t size0 = d->size[0].x * d->size[0].y;
+    init_Block(&d->coverage, size0 + d->size[1].x * d->size[1].y);
+    for (int hoff = 0; hoff < 2; hoff++) {
+        if (d->size[hoff].x > 0 && d->size[hoff].y > 0) {
+            rasterize_Font_(d->font, d->glyphIndex, hoff, d->size[hoff],
+                            (uint8_t *) data_Block(&d->coverage) + (hoff ? size0 : 0));
+        }
+    }
+    return d;
+}
+
+static iThreadResult rasterize_Text_(iThread *thread) {
+    iText *d = userData_Thread(thread);
+    lock_Mutex(d->rasterMutex);
+    for (;;) {
+        while (isEmpty_Array(&d->rasterQueue) && !d->rasterQuit) {
+            wait_Condition(&d->rasterAvailable, d->rasterMutex);
+        }
+        if (d->rasterQuit) {
+            break;
+        }
+        /* The newest requests are done first. */
+        const iRasterRequest req = *(const iRasterRequest *) constBack_Array(&d->rasterQueue);
+        popBack_Array(&d->rasterQueue);
+        unlock_Mutex(d->rasterMutex);
+        /* The fonts must not be reset while rasterizing. They may have been reset after the
+           request was taken from the queue, in which case its font is gone. */
+        lock_Mutex(d->fontsMutex);
+        iRasterGlyph *glyph = NULL;
+        if (req.generation == d->rasterGeneration) {
+            glyph = rasterize_RasterRequest_(&req);
+        }
+        unlock_Mutex(d->fontsMutex);
+        lock_Mutex(d->rasterMutex);
+        if (glyph) {
+            pushBack_PtrArray(&d->rasterDone, glyph);
+            set_Atomic(&d->hasRasterDone, iTrue);
+        }
+    }
+    unlock_Mutex(d->rasterMutex);
+    return 0;
+}
+
+static void initRaster_Text_(iText *d) {
+    d->rasterMutex = new_Mutex();
+    init_Condition(&d->rasterAvailable);
+    init_Array(&d->rasterQueue, sizeof(iRasterRequest));
+    init_SortedArray(&d->rasterPending, sizeof(uint32_t), cmpKey_RasterRequest_);
+    init_PtrArray(&d->rasterDone);
+    set_Atomic(&d->hasRasterDone, iFalse);
+    d->rasterGeneration = 0;
+    d->rasterQuit       = iFalse;
+    d->rasterThread     = new_Thread(rasterize_Text_);
+    setUserData_Thread(d->rasterThread, d);
+    start_Thread(d->rasterThread);
+    prewarm_Text_(d);
+}
+
+/* Forgets all requested and finished glyphs. Called with `fontsMutex` locked. */
+static void resetRaster_Text_(iText *d) {
+    lock_Mutex(d->rasterMutex);
+    d->rasterGeneration++;
+    clear_Array(&d->rasterQueue);
+    clear_SortedArray(&d->rasterPending);
+    iForEach(PtrArray, i, &d->rasterDone) {
+        delete_RasterGlyph_(i.ptr);
+    }
+    clear_PtrArray(&d->rasterDone);
+    set_Atomic(&d->hasRasterDone, iFalse);
+    unlock_Mutex(d->rasterMutex);
+}
+
+static void deinitRaster_Text_(iText *d) {
+    iGuardMutex(d->rasterMutex, {
+        d->rasterQuit = iTrue;
+        signal_Condition(&d->rasterAvailable);
+    });
+    join_Thread(d->rasterThread);
+    iRelease(d->rasterThread);
+    resetRaster_Text_(d);
+    deinit_PtrArray(&d->rasterDone);
+    deinit_SortedArray(&d->rasterPending);
+    deinit_Array(&d->rasterQueue);
+    deinit_Condition(&d->rasterAvailable);
+    delete_Mutex(d->rasterMutex);
+}
+
+/* Queues a glyph for rasterizing unless it is already cached or requested. Called with
+   `rasterMutex` locked. */
+static void request_Text_(iText *d, enum iFontId fontId, iChar ch) {
+    /* Glyphs are stored in the font that actually has them. */
+    iFont *font = glyphFont_Font_(font_Text_(fontId), ch);
+    if (findGlyph_Font_(font, ch)) {
+        return;
+    }
+    const uint32_t glyphIndex = glyphIndex_Font_(font, ch, iTrue);
+    const uint32_t key = (uint32_t) (font - d->fonts) << 24 | ch;
+    size_t pos;
+    if (locate_SortedArray(&d->rasterPending, &key, &pos)) {
+        return;
+    }
+    insert_SortedArray(&d->rasterPending, &key);
+    pushBack_Array(&d->rasterQueue,
+                   &(iRasterRequest){ font, ch, glyphIndex, key, d->rasterGeneration });
+}
+
+static void prewarm_Text_(iText *d) {
+    /* Only the UI font and the body text of the active content font are needed right
+       away. Other fonts rasterize their glyphs as they are used, and fonts that are never
+       used aren't even loaded. */
+    static const enum iFontId prewarmed[] = { regular_FontId, default_FontId }; /* LIFO */
+    lock_Mutex(d->rasterMutex);
+    iForIndices(i, prewarmed) {
+        for (iChar ch = 0x7e; ch >= 0x20; ch--) {
+            request_Text_(d, prewarmed[i], ch);
+        }
+    }
+    signal_Condition(&d->rasterAvailable);
+    unlock_Mutex(d->rasterMutex);
+}
+
+void prepareGlyphs_Text(int fontId, iRangecc text) {
+    iText *d = &text_;
+    size_t numRequested = 0;
+    lock_Mutex(d->rasterMutex);
+    for (const char *chPos = text.start; chPos < text.end; ) {
+        if ((unsigned char) *chPos < 0x80) {
+            chPos++; /* ASCII is prepared anyway */
+            continue;
+        }
+        const size_t oldCount = size_Array(&d->rasterQueue);
+        const iChar  ch       = nextChar_(&chPos, text.end);
+        if (ch && !isVariationSelector_Char(ch)) {
+            request_Text_(d, fontId, ch);
+        }
+        numRequested += size_Array(&d->rasterQueue) - oldCount;
+    }
+    if (numRequested) {
+        signal_Condition(&d->rasterAvailable);
+    }
+    unlock_Mutex(d->rasterMutex);
+}
+
+/* Moves glyphs rasterized by the worker to the glyph cache. */
+static void storeRasterGlyphs_Text_(iText *d) {
+    if (!value_Atomic(&d->hasRasterDone)) {
+        return;
+    }
+    iPtrArray done;
+    init_PtrArray(&done);
+    lock_Mutex(d->rasterMutex);
+    iSwap(iPtrArray, done, d->rasterDone);
+    set_Atomic(&d->hasRasterDone, iFalse);
+    iConstForEach(PtrArray, i, &done) {
+        const iRasterGlyph *ras = i.ptr;
+        size_t pos;
+        if (locate_SortedArray(&d->rasterPending, &ras->key, &pos)) {
+            remove_Array(&d->rasterPending.values, pos);
+        }
+    }
+    unlock_Mutex(d->rasterMutex);
+    iForEach(PtrArray, j, &done) {
+        iRasterGlyph *ras = j.ptr;
+        if (ras->generation == d->rasterGeneration && !findGlyph_Font_(ras->font, ras->ch)) {
+            iGlyph *glyph     = new_Glyph(ras->ch);
+            glyph->glyphIndex = ras->glyphIndex;
+            glyph->font       = ras->font;
+            glyph->advance    = ras->advance;
+            const uint8_t *coverage = constData_Block(&ras->coverage);
+            for (int hoff = 0; hoff < 2; hoff++) {
+                glyph->d[hoff]         = ras->d[hoff];
+                glyph->rect[hoff].size = ras->size[hoff];
+                if (!isEmpty_Rect(glyph->rect[hoff])) {
+                    storeBitmap_Text_(d, glyph, hoff, coverage);
+                }
+                coverage += ras->size[hoff].x * ras->size[hoff].y;
+            }
+            insertGlyph_Font_(ras->font, glyph);
+        }
+        delete_RasterGlyph_(ras);
+    }
+    deinit_PtrArray(&done);
+}
+
+/* Looks up the metrics of a glyph without rasterizing it or touching the glyph cache.
+   The result is written to `buf`. Safe to call in any thread, as long as `fontsMutex` is
+   held so the fonts don't get reset in the middle. */
+static const iGlyph *glyphMetrics_Font_(iFont *d, iChar ch, iGlyph *buf) {
+    uint32_t glyphIndex = 0;
+    iFont *font = characterFont_Font_(d, ch, &glyphIndex, iFalse);
+    init_Glyph(buf, ch);
+    buf->glyphIndex = glyphIndex;
+    buf->font       = font;
+    int adv;
+    stbtt_GetGlyphHMetrics(font->font, glyphIndex, &adv, NULL);
+    buf->advance = font->scale * adv;
+    for (int hoff = 0; hoff < 2; hoff++) {
+        int x0, y0, x1, y1;
+        stbtt_GetGlyphBitmapBoxSubpixel(
+            font->font, glyphIndex, font->scale, font->scale, hoff * 0.5f, 0.0f, &x0, &y0, &x1, &y1);
+        buf->d[hoff]    = init_I2(x0, y0 + font->vertOffset);
+        buf->rect[hoff] = init_Rect(0, 0, x1 - x0, y1 - y0);
+    }
+    return buf;
+}
+
+/* Only the main thread owns the glyph cache. Text measurements done in other threads
+   (e.g., background document layout) use glyph metrics directly from the font. */
+iLocalDef iBool isMetricsOnly_Text_(void) {
+    return SDL_ThreadID() != text_.mainThread;
+}
+
+/* Printable ASCII glyphs are looked up from a flat array instead of the glyph hash. */
+iLocalDef const iGlyph *asciiGlyph_Font_(iFont *d, char ch) {
+    const iGlyph **glyph = &d->asciiGlyphs[ch - 32];
+    if (!*glyph) {
+        *glyph = glyph_Font_(d, ch);
+    }
+    return *glyph;
+}
+
+iLocalDef const iGlyph *lookupGlyph_Font_(iFont *d, iChar ch, iGlyph *metricsBuf) {
+    return metricsBuf ? glyphMetrics_Font_(d, ch, metricsBuf) : glyph_Font_(d, ch);
+}
+
+enum iRunMode {
+    measure_RunMode,
+    measureNoWrap_RunMode,
+    measureVisual_RunMode, /* actual visible bounding box of the glyph, e.g., for icons */
+    draw_RunMode,
+    drawPermanentColor_RunMode
+};
+
 static enum iFontId fontId_Text_(const iFont *font) {
     return font - text_.fonts;
 }
@@ -616,6 +1309,22 @@ iLocalDef iBool isMeasuring_(enum iRunMode mode) {
            mode == measureVisual_RunMode;
 }
 
+/* Makes sure all the glyphs of `text` are in the glyph cache before drawing, so the ones
+   missing are rasterized together and uploaded with one texture update per page. */
+static void cacheGlyphs_Font_(iFont *d, iRangecc text) {
+    storeRasterGlyphs_Text_(&text_);
+    for (const char *chPos = text.start; chPos != text.end; ) {
+        const iChar ch = nextChar_(&chPos, text.end);
+        if (ch == '\r') {
+            nextChar_(&chPos, text.end); /* color escape */
+            continue;
+        }
+        if (ch >= 0x20 && ch != 0xad && !isVariationSelector_Char(ch)) {
+            glyph_Font_(d, ch);
+        }
+    }
+}
+
 static iRect run_Font_(iFont *d, enum iRunMode mode, iRangecc text, size_t maxLen, iInt2 pos,
                        int xposLimit, const char **continueFrom_out, int *runAdvance_out) {
     iRect bounds = zero_Rect();
@@ -629,78 +1338,98 @@ static iRect run_Font_(iFont *d, enum iRunMode mode, iRangecc text, size_t maxLe
         *continueFrom_out = text.end;
     }
     iChar prevCh = 0;
+    iGlyph metricsBuf[2];
+    const iBool isMetricsOnly = isMetricsOnly_Text_();
+    iAssert(!isMetricsOnly || isMeasuring_(mode));
+    if (isMetricsOnly) {
+        lock_Mutex(text_.fontsMutex);
+    }
+    iGlyph *mbuf[2] = { isMetricsOnly ? &metricsBuf[0] : NULL,
+                        isMetricsOnly ? &metricsBuf[1] : NULL };
     if (d->isMonospaced) {
-        monoAdvance = glyph_Font_(d, 'M')->advance;
+        monoAdvance = lookupGlyph_Font_(d, 'M', mbuf[0])->advance;
     }
+    if (!isMeasuring_(mode)) {
+        cacheGlyphs_Font_(d, text);
+    }
+    iColor ansiColor = text_.cacheColorMod; /* escapes modify the current color */
     for (const char *chPos = text.start; chPos != text.end; ) {
         iAssert(chPos < text.end);
         const char *currentPos = chPos;
         if (*chPos == 0x1b) {
             /* ANSI escape. */
-            chPos++;
-            iRegExpMatch m;
-            init_RegExpMatch(&m);
-            if (match_RegExp(text_.ansiEscape, chPos, text.end - chPos, &m)) {
+            const char *escEnd = ansiEscape_Color((iRangecc){ chPos, text.end },
+                                                  tmParagraph_ColorId,
+                                                  mode == draw_RunMode ? &ansiColor : NULL);
+            if (escEnd != chPos) {
                 if (mode == draw_RunMode) {
                     /* Change the color. */
-                    const iColor clr =
-                        ansiForeground_Color(capturedRange_RegExpMatch(&m, 1), tmParagraph_ColorId);
-                    SDL_SetTextureColorMod(text_.cache, clr.r, clr.g, clr.b);
+                    setCacheColorMod_Text_(&text_, ansiColor);
                 }
-                chPos = end_RegExpMatch(&m);
+                chPos = escEnd;
                 continue;
             }
         }
-        iChar ch = nextChar_(&chPos, text.end);
-        if (isVariationSelector_Char(ch)) {
-            /* TODO: VS15: Should peek ahead for this and prefer the Emoji font. */
-            ch = nextChar_(&chPos, text.end); /* just ignore */
+        iChar         ch;
+        const iGlyph *glyph;
+        if (!isMetricsOnly && *chPos >= 0x20 && *chPos < 0x7f) {
+            /* Fast path for printable ASCII: no decoding, no special characters, and the
+               glyph comes from a flat array. */
+            ch    = *chPos++;
+            glyph = asciiGlyph_Font_(d, (char) ch);
         }
-        /* Special instructions. */ {
-            if (ch == 0xad) { /* soft hyphen */
-                lastWordEnd = chPos;
-                if (isMeasuring_(mode)) {
-                    if (xposLimit > 0) {
-                        const char *postHyphen = chPos;
-                        iChar       nextCh     = nextChar_(&postHyphen, text.end);
-                        if ((int) xpos + glyph_Font_(d, ch)->rect[0].size.x +
-                            glyph_Font_(d, nextCh)->rect[0].size.x > xposLimit) {
-                            /* Wraps after hyphen, should show it. */
+        else {
+            ch = nextChar_(&chPos, text.end);
+            if (isVariationSelector_Char(ch)) {
+                /* TODO: VS15: Should peek ahead for this and prefer the Emoji font. */
+                ch = nextChar_(&chPos, text.end); /* just ignore */
+            }
+            /* Special instructions. */ {
+                if (ch == 0xad) { /* soft hyphen */
+                    lastWordEnd = chPos;
+                    if (isMeasuring_(mode)) {
+                        if (xposLimit > 0) {
+                            const char *postHyphen = chPos;
+                            iChar       nextCh     = nextChar_(&postHyphen, text.end);
+                            if ((int) xpos + lookupGlyph_Font_(d, ch, mbuf[0])->rect[0].size.x +
+                                lookupGlyph_Font_(d, nextCh, mbuf[1])->rect[0].size.x > xposLimit) {
+                                /* Wraps after hyphen, should show it. */
+                            }
+                            else continue;
                         }
                         else continue;
                     }
-                    else continue;
-                }
-                else {
-                    /* Only show it at the end. */
-                    if (chPos != text.end) {
-                        continue;
+                    else {
+                        /* Only show it at the end. */
+                        if (chPos != text.end) {
+                            continue;
+                        }
                     }
                 }
-            }
-            if (ch == '\n') {
-                xpos = pos.x;
-                pos.y += d->height;
-                prevCh = ch;
-                continue;
-            }
-            if (ch == '\t') {
-                const int tabStopWidth = d->height * 8;
-                xpos = pos.x + ((int) ((xpos - pos.x) / tabStopWidth) + 1) * tabStopWidth;
-                prevCh = 0;
-                continue;
-            }
-            if (ch == '\r') {
-                const iChar esc = nextChar_(&chPos, text.end);
-                if (mode == draw_RunMode) {
-                    const iColor clr = get_Color(esc - asciiBase_ColorEscape);
-                    SDL_SetTextureColorMod(text_.cache, clr.r, clr.g, clr.b);
+                if (ch == '\n') {
+                    xpos = pos.x;
+                    pos.y += d->height;
+                    prevCh = ch;
+                    continue;
+                }
+                if (ch == '\t') {
+                    const int tabStopWidth = d->height * 8;
+                    xpos = pos.x + ((int) ((xpos - pos.x) / tabStopWidth) + 1) * tabStopWidth;
+                    prevCh = 0;
+                    continue;
+                }
+                if (ch == '\r') {
+                    const iChar esc = nextChar_(&chPos, text.end);
+                    if (mode == draw_RunMode) {
+                        const iColor clr = get_Color(esc - asciiBase_ColorEscape);
+                        setCacheColorMod_Text_(&text_, clr);
+                    }
+                    prevCh = 0;
+                    continue;
                 }
-                prevCh = 0;
-                continue;
             }
+            glyph = lookupGlyph_Font_(d, ch, mbuf[0]);
         }
-        const iGlyph *glyph = glyph_Font_(d, ch);
         int x1 = xpos;
         const int hoff = enableHalfPixelGlyphs_Text ? (xpos - x1 > 0.5f ? 1 : 0) : 0;
         int x2 = x1 + glyph->rect[hoff].size.x;
@@ -738,7 +1467,10 @@ static iRect run_Font_(iFont *d, enum iRunMode mode, iRangecc text, size_t maxLe
             if (useMonoAdvance && dst.w > advance) {
                 dst.x -= (dst.w - advance) / 2;
             }
-            SDL_RenderCopy(text_.render, text_.cache, (const SDL_Rect *) &glyph->rect[hoff], &dst);
+            iCachePage *page = at_Array(&text_.cachePages, glyph->page[hoff]);
+            page->lastUsed = ++text_.cacheTick;
+            uploadCachePage_Text_(&text_, page);
+            SDL_RenderCopy(text_.render, page->texture, (const SDL_Rect *) &glyph->rect[hoff], &dst);
         }
         /* Symbols and emojis are NOT monospaced, so must conform when the primary font
            is monospaced. Except with Japanese script, that's larger than the normal monospace. */
@@ -754,7 +1486,7 @@ static iRect run_Font_(iFont *d, enum iRunMode mode, iRangecc text, size_t maxLe
             const char *peek = chPos;
             const iChar next = nextChar_(&peek, text.end);
             if (enableKerning_Text && !d->manualKernOnly && next) {
-                xpos += d->scale * stbtt_GetGlyphKernAdvance(&d->font, glyph->glyphIndex, next);
+                xpos += d->scale * stbtt_GetGlyphKernAdvance(d->font, glyph->glyphIndex, next);
             }
         }
 #endif
@@ -763,6 +1495,9 @@ static iRect run_Font_(iFont *d, enum iRunMode mode, iRangecc text, size_t maxLe
             break;
         }
     }
+    if (isMetricsOnly) {
+        unlock_Mutex(text_.fontsMutex);
+    }
     if (runAdvance_out) {
         *runAdvance_out = xposMax - orig.x;
     }
@@ -773,18 +1508,13 @@ int lineHeight_Text(int fontId) {
     return text_.fonts[fontId].height;
 }
 
+static iMeasureEntry measure_Text_(int fontId, iRangecc text, int width);
+
 iInt2 measureRange_Text(int fontId, iRangecc text) {
     if (isEmpty_Range(&text)) {
         return init_I2(0, lineHeight_Text(fontId));
     }
-    return run_Font_(&text_.fonts[fontId],
-                     measure_RunMode,
-                     text,
-                     iInvalidSize,
-                     zero_I2(),
-                     0,
-                     NULL,
-                     NULL).size;
+    return measure_Text_(fontId, text, 0).size;
 }
 
 iRect visualBounds_Text(int fontId, iRangecc text) {
@@ -796,37 +1526,116 @@ iInt2 measure_Text(int fontId, const char *text) {
     return measureRange_Text(fontId, range_CStr(text));
 }
 
+static uint64_t hashText_(iRangecc text, iBool *hasSoftHyphen_out) {
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint8_t  prev = 0;
+    *hasSoftHyphen_out = iFalse;
+    for (const char *ch = text.start; ch != text.end; ch++) {
+        const uint8_t byte = (uint8_t) *ch;
+        if (byte == 0xad && prev == 0xc2) {
+            *hasSoftHyphen_out = iTrue; /* U+00AD */
+        }
+        hash = (hash ^ byte) * 0x100000001b3ull;
+        prev = byte;
+    }
+    return hash ? hash : 1;
+}
+
+iLocalDef size_t measureSlot_Text_(uint64_t hash, int fontId, int width) {
+    return (size_t) ((hash ^ ((uint64_t) fontId << 32) ^ (uint64_t) width * 0x9e3779b97f4a7c15ull) %
+                     numMeasureEntries_Text_);
+}
+
+static iBool findMeasure_Text_(uint64_t hash, int fontId, iRangecc text, int width,
+                               iMeasureEntry *entry_out) {
+    iText *d = &text_;
+    iBool found = iFalse;
+    lock_Mutex(d->measureMutex);
+    const iMeasureEntry *entry = &d->measureCache[measureSlot_Text_(hash, fontId, width)];
+    if (entry->hash == hash && entry->length == size_Range(&text) && entry->fontId == fontId &&
+        entry->width == width) {
+        *entry_out = *entry;
+        found = iTrue;
+    }
+    unlock_Mutex(d->measureMutex);
+    return found;
+}
+
+static void storeMeasure_Text_(const iMeasureEntry *entry) {
+    iText *d = &text_;
+    iGuardMutex(d->measureMutex, {
+        d->measureCache[measureSlot_Text_(entry->hash, entry->fontId, entry->width)] = *entry;
+    });
+}
+
+/* Measures text in measure_RunMode, optionally wrapping at `width`. Results are cached
+   until the fonts are reset. */
+static iMeasureEntry measure_Text_(int fontId, iRangecc text, int width) {
+    iBool          hasSoftHyphen;
+    const uint64_t hash = hashText_(text, &hasSoftHyphen);
+    iMeasureEntry  entry;
+    if (findMeasure_Text_(hash, fontId, text, 0, &entry)) {
+        if (width == 0 || (entry.size.x <= width && !hasSoftHyphen)) {
+            /* No glyph reaches beyond `width`, so it would not be wrapped. Soft hyphens
+               are measured differently when wrapping. */
+            return entry;
+        }
+    }
+    if (width && findMeasure_Text_(hash, fontId, text, width, &entry)) {
+        return entry;
+    }
+    const char *endPos = text.end;
+    entry = (iMeasureEntry){ .hash = hash, .length = size_Range(&text), .fontId = fontId };
+    entry.size = run_Font_(font_Text_(fontId),
+                           measure_RunMode,
+                           text,
+                           iInvalidSize,
+                           zero_I2(),
+                           width,
+                           width ? &endPos : NULL,
+                           &entry.advance).size;
+    entry.endOffset = endPos - text.start;
+    if (endPos == text.end && !hasSoftHyphen) {
+        storeMeasure_Text_(&entry); /* same as without wrapping */
+    }
+    if (width) {
+        entry.width = width;
+        storeMeasure_Text_(&entry);
+    }
+    return entry;
+}
+
 iInt2 advanceRange_Text(int fontId, iRangecc text) {
-    int advance;
-    const int height = run_Font_(&text_.fonts[fontId],
-                                 measure_RunMode,
-                                 text,
-                                 iInvalidSize,
-                                 zero_I2(),
-                                 0,
-                                 NULL,
-                                 &advance)
-                           .size.y;
-    return init_I2(advance, height);
+    if (isEmpty_Range(&text)) {
+        return zero_I2();
+    }
+    const iMeasureEntry m = measure_Text_(fontId, text, 0);
+    return init_I2(m.advance, m.size.y);
 }
 
 iInt2 tryAdvance_Text(int fontId, iRangecc text, int width, const char **endPos) {
-    int advance;
-    const int height = run_Font_(&text_.fonts[fontId],
-                                 measure_RunMode,
-                                 text,
-                                 iInvalidSize,
-                                 zero_I2(),
-                                 width,
-                                 endPos,
-                                 &advance)
-                           .size.y;
-    return init_I2(advance, height);
+    if (isEmpty_Range(&text) || width <= 0) {
+        int advance;
+        const int height = run_Font_(font_Text_(fontId),
+                                     measure_RunMode,
+                                     text,
+                                     iInvalidSize,
+                                     zero_I2(),
+                                     width,
+                                     endPos,
+                                     &advance)
+                               .size.y;
+        return init_I2(advance, height);
+    }
+    const iMeasureEntry m = measure_Text_(fontId, text, width);
+    *endPos = text.start + m.endOffset;
+    return init_I2(m.advance, m.size.y);
 }
 
 iInt2 tryAdvanceNoWrap_Text(int fontId, iRangecc text, int width, const char **endPos) {
     int advance;
-    const int height = run_Font_(&text_.fonts[fontId],
+    const int height = run_Font_(font_Text_(fontId),
                                  measureNoWrap_RunMode,
                                  text,
                                  iInvalidSize,
@@ -848,15 +1657,15 @@ iInt2 advanceN_Text(int fontId, const char *text, size_t n) {
     }
     int advance;
     run_Font_(
-        &text_.fonts[fontId], measure_RunMode, range_CStr(text), n, zero_I2(), 0, NULL, &advance);
+        font_Text_(fontId), measure_RunMode, range_CStr(text), n, zero_I2(), 0, NULL, &advance);
     return init_I2(advance, lineHeight_Text(fontId));
 }
 
 static void draw_Text_(int fontId, iInt2 pos, int color, iRangecc text) {
     iText *d = &text_;
     const iColor clr = get_Color(color & mask_ColorId);
-    SDL_SetTextureColorMod(d->cache, clr.r, clr.g, clr.b);
-    run_Font_(&d->fonts[fontId],
+    setCacheColorMod_Text_(d, clr);
+    run_Font_(font_Text_(fontId),
               color & permanent_ColorId ? drawPermanentColor_RunMode : draw_RunMode,
               text,
               iInvalidSize,
@@ -943,16 +1752,152 @@ void drawCentered_Text(int fontId, iRect rect, iBool alignVisual, int color, con
     deinit_Block(&chars);
 }
 
+/*-----------------------------------------------------------------------------------------------*/
+
+static void deleteRetained_Text_(iText *d, iRetainedText *ret) {
+    d->retainedPixels -= ret->size.x * ret->size.y;
+    SDL_DestroyTexture(ret->texture);
+    deinit_String(&ret->text);
+    free(ret);
+}
+
+static void clearRetained_Text_(iText *d) {
+    iForEach(Hash, i, &d->retained) {
+        iRetainedText *ret = (iRetainedText *) i.value;
+        remove_HashIterator(&i);
+        deleteRetained_Text_(d, ret);
+    }
+    iAssert(d->retainedPixels == 0);
+}
+
+static void evictRetained_Text_(iText *d, size_t numPixels) {
+    while (d->retainedPixels + numPixels > maxRetainedPixels_Text_ && size_Hash(&d->retained)) {
+        iRetainedText *oldest = NULL;
+        iConstForEach(Hash, i, &d->retained) {
+            iRetainedText *ret = (iRetainedText *) i.value;
+            if (!oldest || ret->lastUsed < oldest->lastUsed) {
+                oldest = ret;
+            }
+        }
+        remove_Hash(&d->retained, oldest->node.key);
+        deleteRetained_Text_(d, oldest);
+    }
+}
+
+static const iRetainedText *retained_Text_(iText *d, int fontId, iRangecc text) {
+    iBool          hasSoftHyphen;
+    const uint64_t hash = hashText_(text, &hasSoftHyphen) * 31 + fontId;
+    const uint32_t key  = (uint32_t) (hash ^ (hash >> 32));
+    iRetainedText *ret  = (iRetainedText *) value_Hash(&d->retained, key);
+    if (ret) {
+        if (ret->fontId == fontId && equal_Rangecc(text, cstr_String(&ret->text))) {
+            ret->lastUsed = ++d->retainedTick;
+            return ret;
+        }
+        /* Colliding key, replace the old one. */
+        remove_Hash(&d->retained, key);
+        deleteRetained_Text_(d, ret);
+    }
+    const iMeasureEntry m      = measure_Text_(fontId, text, 0);
+    const iRect         visual = visualBounds_Text(fontId, text);
+    /* Glyphs may extend past the origin (negative left bearing) or the advance. */
+    const int           left   = iMin(0, left_Rect(visual));
+    const int           right  = iMax(iMax(m.size.x, m.advance), right_Rect(visual));
+    const iInt2         size   = init_I2(right - left, m.size.y);
+    if (size.x <= 0 || size.y <= 0 || size.x * size.y > maxRetainedPixels_Text_ / 8) {
+        return NULL;
+    }
+    evictRetained_Text_(d, size.x * size.y);
+    SDL_Texture *texture = SDL_CreateTexture(d->render,
+                                             SDL_PIXELFORMAT_RGBA4444,
+                                             SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
+                                             size.x,
+                                             size.y);
+    if (!texture) {
+        return NULL; /* drawn directly instead */
+    }
+    ret = iMalloc(RetainedText);
+    ret->node.key = key;
+    ret->fontId   = fontId;
+    initRange_String(&ret->text, text);
+    ret->size     = size;
+    ret->left     = left;
+    ret->lastUsed = ++d->retainedTick;
+    ret->texture  = texture;
+    /* Changing the render target resets the clip rectangle. */
+    SDL_Rect     oldClip;
+    const iBool  isClipped = SDL_RenderIsClipEnabled(d->render);
+    SDL_RenderGetClipRect(d->render, &oldClip);
+    SDL_Texture *oldTarget = SDL_GetRenderTarget(d->render);
+    const uint8_t oldAlpha = d->cacheAlphaMod; /* applied when the texture is drawn */
+    SDL_SetRenderTarget(d->render, ret->texture);
+    setCacheAlphaMod_Text_(d, 255);
+    setCacheBlendMode_Text_(d, SDL_BLENDMODE_NONE); /* blended when the texture is drawn */
+    SDL_SetRenderDrawColor(d->render, 255, 255, 255, 0);
+    SDL_RenderClear(d->render);
+    draw_Text_(fontId, init_I2(-left, 0), white_ColorId, text);
+    setCacheBlendMode_Text_(d, SDL_BLENDMODE_BLEND);
+    setCacheAlphaMod_Text_(d, oldAlpha);
+    SDL_SetRenderTarget(d->render, oldTarget);
+    SDL_RenderSetClipRect(d->render, isClipped ? &oldClip : NULL);
+    SDL_SetTextureBlendMode(ret->texture, SDL_BLENDMODE_BLEND);
+    d->retainedPixels += size.x * size.y;
+    insert_Hash(&d->retained, &ret->node);
+    return ret;
+}
+
+static iBool hasEscapes_(iRangecc text) {
+    for (const char *ch = text.start; ch != text.end; ch++) {
+        if (*ch == '\r' || *ch == '\x1b') {
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+void drawRetained_Text(int fontId, iInt2 pos, int color, enum iAlignment align, iRangecc text) {
+    iText *d = &text_;
+    const iRetainedText *ret = NULL;
+    if (!isEmpty_Range(&text) && !hasEscapes_(text)) {
+        ret = retained_Text_(d, fontId, text);
+    }
+    if (align == center_Alignment) {
+        pos.x -= measureRange_Text(fontId, text).x / 2;
+    }
+    else if (align == right_Alignment) {
+        pos.x -= measureRange_Text(fontId, text).x;
+    }
+    if (!ret) {
+        draw_Text_(fontId, pos, color, text);
+        return;
+    }
+    const iColor clr = get_Color(color & mask_ColorId);
+    SDL_SetTextureColorMod(ret->texture, clr.r, clr.g, clr.b);
+    SDL_SetTextureAlphaMod(ret->texture, d->cacheAlphaMod);
+    SDL_RenderCopy(d->render,
+                   ret->texture,
+                   &(SDL_Rect){ 0, 0, ret->size.x, ret->size.y },
+                   &(SDL_Rect){ pos.x + ret->left, pos.y, ret->size.x, ret->size.y });
+}
+
+void drawCenteredRetained_Text(int fontId, iRect rect, iBool alignVisual, int color,
+                               iRangecc text) {
+    iRect textBounds = alignVisual ? visualBounds_Text(fontId, text)
+                                   : (iRect){ zero_I2(), advanceRange_Text(fontId, text) };
+    textBounds.pos = sub_I2(mid_Rect(rect), mid_Rect(textBounds));
+    drawRetained_Text(fontId, textBounds.pos, color, left_Alignment, text);
+}
+
 SDL_Texture *glyphCache_Text(void) {
-    return text_.cache;
+    return ((const iCachePage *) constAt_Array(&text_.cachePages, text_.cachePage))->texture;
 }
 
 static void freeBitmap_(void *ptr) {
     stbtt_FreeBitmap(ptr, NULL);
 }
 
-iString *renderBlockChars_Text(const iBlock *fontData, int height, enum iTextBlockMode mode,
-                               const iString *text) {
+static iString *renderBlockChars_Text_(const iBlock *fontData, int height,
+                                      enum iTextBlockMode mode, const iString *text) {
     iBeginCollect();
     stbtt_fontinfo font;
     iZap(font);
@@ -1052,6 +1997,46 @@ iString *renderBlockChars_Text(const iBlock *fontData, int height, enum iTextBlo
     return joinCStr_StringList(iClob(lines), "\n");
 }
 
+iString *renderBlockChars_Text(const iBlock *fontData, int height, enum iTextBlockMode mode,
+                               const iString *text) {
+    /* Block characters are rendered for the same few banners over and over, e.g., when
+       about: pages are reopened, so the recently rendered ones are kept. */
+    iText *d = &text_;
+    iString *rendered = NULL;
+    lock_Mutex(d->blockCharsMutex);
+    for (size_t i = 0; i < size_PtrArray(&d->blockChars); i++) {
+        iBlockChars *bc = at_PtrArray(&d->blockChars, i);
+        if (bc->fontData == fontData && bc->height == height && bc->mode == mode &&
+            equal_String(&bc->text, text)) {
+            rendered = copy_String(&bc->rendered);
+            /* Most recently used ones are at the end. */
+            take_PtrArray(&d->blockChars, i, (void **) &bc);
+            pushBack_PtrArray(&d->blockChars, bc);
+            break;
+        }
+    }
+    unlock_Mutex(d->blockCharsMutex);
+    if (rendered) {
+        return rendered;
+    }
+    rendered = renderBlockChars_Text_(fontData, height, mode, text);
+    iBlockChars *bc = iMalloc(BlockChars);
+    bc->fontData = fontData;
+    bc->height   = height;
+    bc->mode     = mode;
+    initCopy_String(&bc->text, text);
+    initCopy_String(&bc->rendered, rendered);
+    lock_Mutex(d->blockCharsMutex);
+    if (size_PtrArray(&d->blockChars) == maxBlockChars_Text_) {
+        iBlockChars *oldest;
+        take_PtrArray(&d->blockChars, 0, (void **) &oldest);
+        deleteBlockChars_(oldest);
+    }
+    pushBack_PtrArray(&d->blockChars, bc);
+    unlock_Mutex(d->blockCharsMutex);
+    return rendered;
+}
+
 /*-----------------------------------------------------------------------------------------------*/
 
 iDefineTypeConstructionArgs(TextBuf, (int font, const char *text), font, text)
@@ -1064,14 +2049,18 @@ void init_TextBuf(iTextBuf *d, int font, const char *text) {
                                    SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
                                    d->size.x,
                                    d->size.y);
+    SDL_Rect     oldClip;
+    const iBool  isClipped = SDL_RenderIsClipEnabled(render);
+    SDL_RenderGetClipRect(render, &oldClip);
     SDL_Texture *oldTarget = SDL_GetRenderTarget(render);
     SDL_SetRenderTarget(render, d->texture);
-    SDL_SetTextureBlendMode(text_.cache, SDL_BLENDMODE_NONE); /* blended when TextBuf is drawn */
+    setCacheBlendMode_Text_(&text_, SDL_BLENDMODE_NONE); /* blended when TextBuf is drawn */
     SDL_SetRenderDrawColor(text_.render, 255, 255, 255, 0);
     SDL_RenderClear(text_.render);
     draw_Text_(font, zero_I2(), white_ColorId, range_CStr(text));
-    SDL_SetTextureBlendMode(text_.cache, SDL_BLENDMODE_BLEND);
+    setCacheBlendMode_Text_(&text_, SDL_BLENDMODE_BLEND);
     SDL_SetRenderTarget(render, oldTarget);
+    SDL_RenderSetClipRect(render, isClipped ? &oldClip : NULL);
     SDL_SetTextureBlendMode(d->texture, SDL_BLENDMODE_BLEND);
 }
 
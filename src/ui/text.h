@@ -136,6 +136,7 @@ void    setContentFont_Text     (enum iTextFont font);
 void    setHeadingFont_Text     (enum iTextFont font);
 void    setContentFontSize_Text (float fontSizeFactor); /* affects all except `default*` fonts */
 void    resetFonts_Text         (void);
+uint32_t fontsKey_Text         (void); /* identifies the current set and size of fonts */
 
 int     lineHeight_Text     (int fontId);
 iInt2   measure_Text        (int fontId, const char *text);
@@ -164,7 +165,38 @@ void    drawString_Text     (int fontId, iInt2 pos, int color, const iString *te
 void    drawRange_Text      (int fontId, iInt2 pos, int color, iRangecc text);
 int     drawWrapRange_Text  (int fontId, iInt2 pos, int maxWidth, int color, iRangecc text); /* returns new Y */
 
-SDL_Texture *   glyphCache_Text     (void);
+/* Retained drawing keeps a texture of each text, for labels that are redrawn often.
+   Text with color escapes is drawn normally. */
+void    drawRetained_Text   (int fontId, iInt2 pos, int color, enum iAlignment align, iRangecc text);
+void    drawCenteredRetained_Text (int fontId, iRect rect, iBool alignVisual, int color, iRangecc text);
+
+void            prepareGlyphs_Text  (int fontId, iRangecc text); /* rasterized in the background */
+SDL_Texture *   glyphCache_Text     (void); /* current page of the glyph cache */
+
+iDeclareType(TextCacheStats)
+
+struct Impl_TextCacheStats {
+    size_t numHits;
+    size_t numMisses; /* glyph had to be rasterized */
+    size_t numEvictions;
+    size_t numPages;
+};
+
+iTextCacheStats cacheStats_Text (void);
+
+iDeclareType(FontCacheStats)
+
+/* Glyphs of one font in the glyph cache, which all fonts share. */
+struct Impl_FontCacheStats {
+    int    height;
+    size_t numGlyphs;
+    size_t numPixels; /* area of the cache pages occupied by the glyphs */
+};
+
+iFontCacheStats fontCacheStats_Text (enum iFontId fontId);
+size_t          cacheBytes_Text     (void); /* glyph cache pages and their staging copies */
+size_t          cachePageSize_Text  (void); /* in pixels */
+size_t          retainedBytes_Text  (void); /* textures of retained text */
 
 enum iTextBlockMode { quadrants_TextBlockMode, shading_TextBlockMode };
 
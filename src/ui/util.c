@@ -55,6 +55,15 @@ const char *command_UserEvent(const SDL_Event *d) {
     return "";
 }
 
+int commandId_UserEvent(const SDL_Event *d) {
+    if (d->type == SDL_USEREVENT && d->user.code == command_UserEventCode) {
+        /* Interned when posted; events composed elsewhere are looked up now. */
+        const int id = (int) (intptr_t) d->user.data2;
+        return id != unknown_CommandId ? id : id_Command(d->user.data1);
+    }
+    return none_CommandId;
+}
+
 void toString_Sym(int key, int kmods, iString *str) {
 #if defined (iPlatformApple)
     if (kmods & KMOD_CTRL) {
@@ -801,6 +810,7 @@ static void updateValueInputWidth_(iWidget *dlg) {
     iWidget *   prompt   = findChild_Widget(dlg, "valueinput.prompt");
     dlg->rect.size.x     = iMaxi(iMaxi(rootSize.x / 2, title->rect.size.x), prompt->rect.size.x);
     as_Widget(findChild_Widget(dlg, "input"))->rect.size.x = dlg->rect.size.x;
+    invalidateLayout_Widget(findChild_Widget(dlg, "input"));
     centerSheet_Widget(dlg);
 }
 
@@ -1037,6 +1047,8 @@ iWidget *makePreferences_Widget(void) {
         addChild_Widget(values, iClob(makeToggle_Widget("prefs.smoothscroll")));
         addChild_Widget(headings, iClob(makeHeading_Widget("Load image on scroll:")));
         addChild_Widget(values, iClob(makeToggle_Widget("prefs.imageloadscroll")));
+        addChild_Widget(headings, iClob(makeHeading_Widget("Prefetch links:")));
+        addChild_Widget(values, iClob(makeToggle_Widget("prefs.prefetch")));
     }
     /* Window. */ {
         appendTwoColumnPage_(tabs, "Window", '2', &headings, &values);
@@ -1191,6 +1203,7 @@ iWidget *makeBookmarkEditor_Widget(void) {
     arrange_Widget(dlg);
     for (int i = 0; i < 3; ++i) {
         as_Widget(inputs[i])->rect.size.x = 100 * gap_UI - headings->rect.size.x;
+        invalidateLayout_Widget(as_Widget(inputs[i]));
     }
     iWidget *div = new_Widget(); {
         setFlags_Widget(div, arrangeHorizontal_WidgetFlag | arrangeSize_WidgetFlag, iTrue);
@@ -1297,6 +1310,7 @@ iWidget *makeIdentityCreation_Widget(void) {
     arrange_Widget(dlg);
     for (size_t i = 0; i < iElemCount(inputs); ++i) {
         as_Widget(inputs[i])->rect.size.x = 100 * gap_UI - headings->rect.size.x;
+        invalidateLayout_Widget(as_Widget(inputs[i]));
     }
     iWidget *div = new_Widget(); {
         setFlags_Widget(div, arrangeHorizontal_WidgetFlag | arrangeSize_WidgetFlag, iTrue);
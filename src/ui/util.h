@@ -35,6 +35,7 @@ iDeclareType(LabelWidget)
 iBool           isCommand_SDLEvent  (const SDL_Event *d);
 iBool           isCommand_UserEvent (const SDL_Event *, const char *cmd);
 const char *    command_UserEvent   (const SDL_Event *);
+int             commandId_UserEvent (const SDL_Event *);
 
 iLocalDef iBool isResize_UserEvent(const SDL_Event *d) {
     return isCommand_UserEvent(d, "window.resized");
@@ -27,7 +27,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDefineTypeConstruction(VisBuf)
 
 void init_VisBuf(iVisBuf *d) {
-    d->texSize = zero_I2();
+    d->texSize    = zero_I2();
+    d->scrollDir  = 1;
+    d->numBuffers = 3;
+    iZap(d->vis);
     iZap(d->buffers);
 }
 
@@ -36,21 +39,22 @@ void deinit_VisBuf(iVisBuf *d) {
 }
 
 void invalidate_VisBuf(iVisBuf *d) {
-    iForIndices(i, d->buffers) {
+    for (size_t i = 0; i < d->numBuffers; i++) {
         d->buffers[i].origin = i * d->texSize.y;
         iZap(d->buffers[i].validRange);
     }
 }
 
-void alloc_VisBuf(iVisBuf *d, const iInt2 size, int granularity) {
+void alloc_VisBuf(iVisBuf *d, const iInt2 size, int granularity, size_t numBuffers) {
     const iInt2 texSize = init_I2(size.x, (size.y / 2 / granularity + 1) * granularity);
-    if (!d->buffers[0].texture || !isEqual_I2(texSize, d->texSize)) {
-        d->texSize = texSize;
-        iForIndices(i, d->buffers) {
+    numBuffers = iClamp(numBuffers, 3, maxBuffers_VisBuf);
+    if (!d->buffers[0].texture || !isEqual_I2(texSize, d->texSize) ||
+        numBuffers != d->numBuffers) {
+        dealloc_VisBuf(d);
+        d->texSize    = texSize;
+        d->numBuffers = numBuffers;
+        for (size_t i = 0; i < numBuffers; i++) {
             iVisBufTexture *tex = &d->buffers[i];
-            if (tex->texture) {
-                SDL_DestroyTexture(tex->texture);
-            }
             tex->texture =
                 SDL_CreateTexture(renderer_Window(get_Window()),
                                   SDL_PIXELFORMAT_RGBA8888,
@@ -67,74 +71,170 @@ void alloc_VisBuf(iVisBuf *d, const iInt2 size, int granularity) {
 void dealloc_VisBuf(iVisBuf *d) {
     d->texSize = zero_I2();
     iForIndices(i, d->buffers) {
-        SDL_DestroyTexture(d->buffers[i].texture);
+        if (d->buffers[i].texture) {
+            SDL_DestroyTexture(d->buffers[i].texture);
+        }
         d->buffers[i].texture = NULL;
     }
 }
 
+static iRangei region_VisBuf_(const iVisBuf *d, size_t index) {
+    const int origin = d->buffers[index].origin;
+    return (iRangei){ origin, origin + d->texSize.y };
+}
+
 void reposition_VisBuf(iVisBuf *d, const iRangei vis) {
+    if (vis.start != d->vis.start) {
+        d->scrollDir = (vis.start > d->vis.start ? 1 : -1);
+    }
     d->vis = vis;
+    /* The buffers that are not needed for the visible range are kept ahead of it in the
+       scrolling direction, so they can be prerendered. */
+    const int numForVis = (size_Range(&vis) + d->texSize.y - 1) / d->texSize.y + 1;
+    const int ahead     = iMax(0, (int) d->numBuffers - numForVis) * d->texSize.y;
+    const iRangei wanted = d->scrollDir > 0 ? (iRangei){ vis.start, vis.end + ahead }
+                                            : (iRangei){ vis.start - ahead, vis.end };
     iRangei good = { 0, 0 };
-    size_t avail[3], numAvail = 0;
+    size_t avail[maxBuffers_VisBuf], numAvail = 0;
     /* Check which buffers are available for reuse. */ {
-        iForIndices(i, d->buffers) {
+        for (size_t i = 0; i < d->numBuffers; i++) {
             iVisBufTexture *buf = d->buffers + i;
-            const iRangei region = { buf->origin, buf->origin + d->texSize.y };
-            if (region.start >= vis.end || region.end <= vis.start) {
+            const iRangei region = region_VisBuf_(d, i);
+            if (region.start >= wanted.end || region.end <= wanted.start) {
                 avail[numAvail++] = i;
                 iZap(buf->validRange);
             }
             else {
-                good = union_Rangei(good, region);
+                good = isEmpty_Rangei(good) ? region : union_Rangei(good, region);
             }
         }
     }
-    if (numAvail == iElemCount(d->buffers)) {
-        /* All buffers are outside the visible range, do a reset. */
-        d->buffers[0].origin = vis.start;
-        d->buffers[1].origin = vis.start + d->texSize.y;
-        d->buffers[2].origin = vis.start + 2 * d->texSize.y;
-    }
-    else {
-        /* Extend to cover the visible range. */
-        while (vis.start < good.start) {
-            iAssert(numAvail > 0);
-            d->buffers[avail[--numAvail]].origin = good.start - d->texSize.y;
-            good.start -= d->texSize.y;
+    if (numAvail == d->numBuffers) {
+        /* All buffers are outside the wanted range, do a reset. */
+        for (size_t i = 0; i < d->numBuffers; i++) {
+            d->buffers[i].origin = wanted.start + i * d->texSize.y;
         }
-        while (vis.end > good.end) {
-            iAssert(numAvail > 0);
+        return;
+    }
+    /* Extend to cover the wanted range. */
+    while (wanted.start < good.start && numAvail > 0) {
+        d->buffers[avail[--numAvail]].origin = good.start - d->texSize.y;
+        good.start -= d->texSize.y;
+    }
+    while (wanted.end > good.end && numAvail > 0) {
+        d->buffers[avail[--numAvail]].origin = good.end;
+        good.end += d->texSize.y;
+    }
+    /* Keep the remaining buffers contiguous with the others. */
+    while (numAvail > 0) {
+        if (d->scrollDir > 0) {
             d->buffers[avail[--numAvail]].origin = good.end;
             good.end += d->texSize.y;
         }
+        else {
+            d->buffers[avail[--numAvail]].origin = good.start - d->texSize.y;
+            good.start -= d->texSize.y;
+        }
+    }
+}
+
+/* Returns the parts of `within` before and after the valid range of a buffer. These
+   include any gap to the valid range, so it stays contiguous when they are validated. */
+static void invalidParts_VisBufTexture_(const iVisBufTexture *d, const iRangei within,
+                                        iRangei *before, iRangei *after) {
+    iZap(*before);
+    iZap(*after);
+    if (isEmpty_Rangei(within)) {
+        return;
+    }
+    if (isEmpty_Rangei(d->validRange)) {
+        *after = within;
+        return;
+    }
+    if (within.start < d->validRange.start) {
+        *before = (iRangei){ within.start, d->validRange.start };
+    }
+    if (within.end > d->validRange.end) {
+        *after = (iRangei){ d->validRange.end, within.end };
     }
 }
 
 void invalidRanges_VisBuf(const iVisBuf *d, const iRangei full, iRangei *out_invalidRanges) {
-    iForIndices(i, d->buffers) {
-        const iVisBufTexture *buf = d->buffers + i;
-        const iRangei before = { full.start, buf->validRange.start };
-        const iRangei after  = { buf->validRange.end, full.end };
-        const iRangei region = intersect_Rangei(d->vis, (iRangei){ buf->origin,
-                                                                   buf->origin + d->texSize.y });
-        out_invalidRanges[i] = intersect_Rangei(before, region);
-        if (isEmpty_Rangei(out_invalidRanges[i])) {
-            out_invalidRanges[i] = intersect_Rangei(after, region);
+    for (size_t i = 0; i < d->numBuffers; i++) {
+        const iRangei region = intersect_Rangei(intersect_Rangei(d->vis, region_VisBuf_(d, i)),
+                                                full);
+        iRangei before, after;
+        invalidParts_VisBufTexture_(d->buffers + i, region, &before, &after);
+        /* Only one range per buffer: if both ends are missing, the valid middle is redrawn. */
+        out_invalidRanges[i] = isEmpty_Rangei(before) ? after
+                               : isEmpty_Rangei(after) ? before
+                                                       : (iRangei){ before.start, after.end };
+    }
+}
+
+iBool prerenderRange_VisBuf(const iVisBuf *d, const iRangei full, int maxSize,
+                            size_t *out_index, iRangei *out_range) {
+    /* Find the invalid range nearest to the visible range, preferring the ones ahead in
+       the scrolling direction. Visible ranges are drawn normally. */
+    iBool found    = iFalse;
+    int   bestDist = 0;
+    for (size_t i = 0; i < d->numBuffers; i++) {
+        iRangei parts[2];
+        invalidParts_VisBufTexture_(
+            d->buffers + i, intersect_Rangei(region_VisBuf_(d, i), full), &parts[0], &parts[1]);
+        for (int side = 0; side < 2; side++) {
+            iRangei range = parts[side];
+            if (isEmpty_Rangei(range) || isOverlapping_Rangei(range, d->vis)) {
+                continue;
+            }
+            const iBool isBelow = range.start >= d->vis.end;
+            int dist = isBelow ? range.start - d->vis.end : d->vis.start - range.end;
+            if (isBelow != (d->scrollDir > 0)) {
+                dist += size_Range(&full); /* behind */
+            }
+            if (found && dist >= bestDist) {
+                continue;
+            }
+            /* Limit the amount of work per frame. The chunk must be adjacent to the valid
+               range; an empty buffer is filled starting from the side nearest to view. */
+            if (maxSize > 0 && size_Range(&range) > maxSize) {
+                const iBool fromStart = isEmpty_Rangei(d->buffers[i].validRange) ? isBelow
+                                                                                 : side == 1;
+                if (fromStart) {
+                    range.end = range.start + maxSize;
+                }
+                else {
+                    range.start = range.end - maxSize;
+                }
+            }
+            found      = iTrue;
+            bestDist   = dist;
+            *out_index = i;
+            *out_range = range;
         }
     }
+    return found;
+}
+
+void validateRange_VisBuf(iVisBuf *d, size_t index, const iRangei range) {
+    iVisBufTexture *buf = &d->buffers[index];
+    const iRangei   valid = intersect_Rangei(range, region_VisBuf_(d, index));
+    if (isEmpty_Rangei(valid)) {
+        return;
+    }
+    buf->validRange =
+        isEmpty_Rangei(buf->validRange) ? valid : union_Rangei(buf->validRange, valid);
 }
 
 void validate_VisBuf(iVisBuf *d) {
-    iForIndices(i, d->buffers) {
-        iVisBufTexture *buf = &d->buffers[i];
-        buf->validRange =
-            intersect_Rangei(d->vis, (iRangei){ buf->origin, buf->origin + d->texSize.y });
+    for (size_t i = 0; i < d->numBuffers; i++) {
+        validateRange_VisBuf(d, i, d->vis);
     }
 }
 
 void draw_VisBuf(const iVisBuf *d, iInt2 topLeft) {
     SDL_Renderer *render = renderer_Window(get_Window());
-    iForIndices(i, d->buffers) {
+    for (size_t i = 0; i < d->numBuffers; i++) {
         const iVisBufTexture *buf = d->buffers + i;
         SDL_RenderCopy(render,
                        buf->texture,
@@ -29,6 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDeclareType(VisBuf)
 iDeclareType(VisBufTexture)
 
+#define maxBuffers_VisBuf   8
+
 struct Impl_VisBufTexture {
     SDL_Texture *texture;
     int origin;
@@ -38,16 +40,21 @@ struct Impl_VisBufTexture {
 struct Impl_VisBuf {
     iInt2 texSize;
     iRangei vis;
-    iVisBufTexture buffers[3];
+    int scrollDir; /* direction of the last reposition: buffers are kept ahead of it */
+    size_t numBuffers;
+    iVisBufTexture buffers[maxBuffers_VisBuf];
 };
 
 iDeclareTypeConstruction(VisBuf)
 
 void    invalidate_VisBuf       (iVisBuf *);
-void    alloc_VisBuf            (iVisBuf *, const iInt2 size, int granularity);
+void    alloc_VisBuf            (iVisBuf *, const iInt2 size, int granularity, size_t numBuffers);
 void    dealloc_VisBuf          (iVisBuf *);
 void    reposition_VisBuf       (iVisBuf *, const iRangei vis);
 void    validate_VisBuf         (iVisBuf *);
+void    validateRange_VisBuf    (iVisBuf *, size_t index, const iRangei range);
 
 void    invalidRanges_VisBuf    (const iVisBuf *, const iRangei full, iRangei *out_invalidRanges);
+iBool   prerenderRange_VisBuf   (const iVisBuf *, const iRangei full, int maxSize,
+                                 size_t *out_index, iRangei *out_range);
 void    draw_VisBuf             (const iVisBuf *, iInt2 topLeft);
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "util.h"
 #include "window.h"
 
+#include <the_Foundation/hash.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/ptrset.h>
 #include <SDL_mouse.h>
@@ -41,10 +42,60 @@ struct Impl_RootData {
     iWidget *focus;
     iPtrArray *onTop; /* order is important; last one is topmost */
     iPtrSet *pendingDestruction;
+    iHash *ids; /* WidgetIds */
 };
 
 static iRootData rootData_;
 
+iDeclareType(WidgetIds)
+
+struct Impl_WidgetIds {
+    iHashNode node; /* key is the hash of the ID */
+    iPtrArray widgets; /* all widgets whose ID has the same hash */
+};
+
+static uint32_t hashId_Widget_(const char *id) {
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    for (; *id; id++) {
+        hash = (hash ^ (uint8_t) *id) * 16777619u;
+    }
+    return hash;
+}
+
+static void addId_Widget_(iWidget *d) {
+    if (isEmpty_String(&d->id)) {
+        return;
+    }
+    if (!rootData_.ids) {
+        rootData_.ids = new_Hash();
+    }
+    const uint32_t key = hashId_Widget_(cstr_String(&d->id));
+    iWidgetIds *ids = (iWidgetIds *) value_Hash(rootData_.ids, key);
+    if (!ids) {
+        ids = iMalloc(WidgetIds);
+        ids->node.key = key;
+        init_PtrArray(&ids->widgets);
+        insert_Hash(rootData_.ids, &ids->node);
+    }
+    pushBack_PtrArray(&ids->widgets, d);
+}
+
+static void removeId_Widget_(iWidget *d) {
+    if (isEmpty_String(&d->id) || !rootData_.ids) {
+        return;
+    }
+    const uint32_t key = hashId_Widget_(cstr_String(&d->id));
+    iWidgetIds *ids = (iWidgetIds *) value_Hash(rootData_.ids, key);
+    if (ids) {
+        removeOne_PtrArray(&ids->widgets, d);
+        if (size_PtrArray(&ids->widgets) == 0) {
+            remove_Hash(rootData_.ids, key);
+            deinit_PtrArray(&ids->widgets);
+            free(ids);
+        }
+    }
+}
+
 iPtrArray *onTop_RootData_(void) {
     if (!rootData_.onTop) {
         rootData_.onTop = new_PtrArray();
@@ -73,10 +124,12 @@ iDefineObjectConstruction(Widget)
 
 void init_Widget(iWidget *d) {
     init_String(&d->id);
-    d->flags          = 0;
+    d->flags          = needsArrange_WidgetFlag;
     d->rect           = zero_Rect();
     d->bgColor        = none_ColorId;
     d->frameColor     = none_ColorId;
+    d->arrangedSize   = zero_I2();
+    d->arrangedParentSize = zero_I2();
     d->children       = NULL;
     d->parent         = NULL;
     d->commandHandler = NULL;
@@ -85,6 +138,7 @@ void init_Widget(iWidget *d) {
 
 void deinit_Widget(iWidget *d) {
     releaseChildren_Widget(d);
+    removeId_Widget_(d);
     deinit_String(&d->id);
 }
 
@@ -107,7 +161,7 @@ static void aboutToBeDestroyed_Widget_(iWidget *d) {
 void destroy_Widget(iWidget *d) {
     if (d) {
         if (isVisible_Widget(d)) {
-            postRefresh_App();
+            refresh_Widget(d);
         }
         aboutToBeDestroyed_Widget_(d);
         if (!rootData_.pendingDestruction) {
@@ -118,7 +172,9 @@ void destroy_Widget(iWidget *d) {
 }
 
 void setId_Widget(iWidget *d, const char *id) {
+    removeId_Widget_(d);
     setCStr_String(&d->id, id);
+    addId_Widget_(d);
 }
 
 const iString *id_Widget(const iWidget *d) {
@@ -129,9 +185,28 @@ int64_t flags_Widget(const iWidget *d) {
     return d->flags;
 }
 
+static const int64_t layoutFlags_Widget_ =
+    hidden_WidgetFlag | fixedPosition_WidgetFlag | arrangeHorizontal_WidgetFlag |
+    arrangeVertical_WidgetFlag | arrangeSize_WidgetFlag | resizeChildren_WidgetFlag |
+    expand_WidgetFlag | fixedSize_WidgetFlag | resizeChildrenToWidestChild_WidgetFlag |
+    resizeToParentWidth_WidgetFlag | resizeToParentHeight_WidgetFlag | collapse_WidgetFlag |
+    centerHorizontal_WidgetFlag | moveToParentRightEdge_WidgetFlag | wrapText_WidgetFlag;
+
+void invalidateLayout_Widget(iWidget *d) {
+    /* Ancestors are marked as well so that arranging from any of them reaches the
+       changed widget. */
+    for (; d; d = d->parent) {
+        d->flags |= needsArrange_WidgetFlag;
+    }
+}
+
 void setFlags_Widget(iWidget *d, int64_t flags, iBool set) {
     if (d) {
+        const int64_t oldFlags = d->flags;
         iChangeFlags(d->flags, flags, set);
+        if ((oldFlags ^ d->flags) & layoutFlags_Widget_) {
+            invalidateLayout_Widget(d);
+        }
         if (flags & keepOnTop_WidgetFlag) {
             if (set) {
                 pushBack_PtrArray(onTop_RootData_(), d);
@@ -151,6 +226,7 @@ void setPos_Widget(iWidget *d, iInt2 pos) {
 void setSize_Widget(iWidget *d, iInt2 size) {
     d->rect.size = size;
     setFlags_Widget(d, fixedSize_WidgetFlag, iTrue);
+    invalidateLayout_Widget(d);
 }
 
 void setPadding_Widget(iWidget *d, int left, int top, int right, int bottom) {
@@ -158,6 +234,7 @@ void setPadding_Widget(iWidget *d, int left, int top, int right, int bottom) {
     d->padding[1] = top;
     d->padding[2] = right;
     d->padding[3] = bottom;
+    invalidateLayout_Widget(d);
 }
 
 void setBackgroundColor_Widget(iWidget *d, int bgColor) {
@@ -258,7 +335,22 @@ static void centerHorizontal_Widget_(iWidget *d) {
                     2;
 }
 
-void arrange_Widget(iWidget *d) {
+static void arrange_Widget_(iWidget *d);
+
+static iBool isArrangeNeeded_Widget_(const iWidget *d) {
+    /* Nothing inside a clean subtree has changed, so it only needs arranging if the
+       size given to it, or the space available in the parent, is different. */
+    return (d->flags & needsArrange_WidgetFlag) || !isEqual_I2(d->rect.size, d->arrangedSize) ||
+           (d->parent && !isEqual_I2(innerRect_Widget_(d->parent).size, d->arrangedParentSize));
+}
+
+static void arrangeChild_Widget_(iWidget *d) {
+    if (isArrangeNeeded_Widget_(d)) {
+        arrange_Widget_(d);
+    }
+}
+
+static void doArrange_Widget_(iWidget *d) {
     if (isCollapsed_Widget_(d)) {
         setFlags_Widget(d, wasCollapsed_WidgetFlag, iTrue);
         return;
@@ -303,13 +395,13 @@ void arrange_Widget(iWidget *d) {
                 setFlags_Widget(child, wasCollapsed_WidgetFlag, iFalse);
                 /* Undo collapse and determine the normal size again. */
                 if (child->flags & arrangeSize_WidgetFlag) {
-                    arrange_Widget(d);
+                    arrange_Widget_(d);
                     uncollapsed = iTrue;
                 }
             }
         }
         if (uncollapsed) {
-            arrange_Widget(d); /* Redo with the next child sizes. */
+            arrange_Widget_(d); /* Redo with the next child sizes. */
             return;
         }
         const int expCount = numExpandingChildren_Widget_(d);
@@ -380,7 +472,7 @@ void arrange_Widget(iWidget *d) {
     iInt2 pos = initv_I2(d->padding);
     iForEach(ObjectList, i, d->children) {
         iWidget *child = as_Widget(i.object);
-        arrange_Widget(child);
+        arrangeChild_Widget_(child);
         if (child->flags & fixedPosition_WidgetFlag) {
             continue;
         }
@@ -423,7 +515,7 @@ void arrange_Widget(iWidget *d) {
                 iWidget *child = as_Widget(j.object);
                 if (child->flags &
                     (resizeToParentWidth_WidgetFlag | moveToParentRightEdge_WidgetFlag)) {
-                    arrange_Widget(child);
+                    arrangeChild_Widget_(child);
                 }
             }
         }
@@ -433,7 +525,7 @@ void arrange_Widget(iWidget *d) {
             iForEach(ObjectList, j, d->children) {
                 iWidget *child = as_Widget(j.object);
                 if (child->flags & resizeToParentHeight_WidgetFlag) {
-                    arrange_Widget(child);
+                    arrangeChild_Widget_(child);
                 }
             }
         }
@@ -443,6 +535,19 @@ void arrange_Widget(iWidget *d) {
     }
 }
 
+static void arrange_Widget_(iWidget *d) {
+    doArrange_Widget_(d);
+    d->flags &= ~needsArrange_WidgetFlag;
+    d->arrangedSize       = d->rect.size;
+    d->arrangedParentSize = d->parent ? innerRect_Widget_(d->parent).size : zero_I2();
+}
+
+void arrange_Widget(iWidget *d) {
+    /* An explicit request always arranges the widget itself; children are only visited
+       if they have changed. */
+    arrange_Widget_(d);
+}
+
 iRect bounds_Widget(const iWidget *d) {
     iRect bounds = d->rect;
     for (const iWidget *w = d->parent; w; w = w->parent) {
@@ -642,14 +747,18 @@ void drawChildren_Widget(const iWidget *d) {
     if (d->flags & hidden_WidgetFlag) return;
     iConstForEach(ObjectList, i, d->children) {
         const iWidget *child = constAs_Widget(i.object);
-        if (~child->flags & keepOnTop_WidgetFlag && ~child->flags & hidden_WidgetFlag) {
+        if (~child->flags & keepOnTop_WidgetFlag && ~child->flags & hidden_WidgetFlag &&
+            isDamaged_Window(get_Window(), bounds_Widget(child))) {
             class_Widget(child)->draw(child);
         }
     }
     /* Root draws the on-top widgets on top of everything else. */
     if (!d->parent) {
         iConstForEach(PtrArray, i, onTop_RootData_()) {
-            draw_Widget(*i.value);
+            const iWidget *top = *i.value;
+            if (isDamaged_Window(get_Window(), bounds_Widget(top))) {
+                draw_Widget(top);
+            }
         }
     }
 }
@@ -678,6 +787,8 @@ iAny *addChildPos_Widget(iWidget *d, iAnyObject *child, enum iWidgetAddPos addPo
         pushFront_ObjectList(d->children, widget); /* ref */
     }
     widget->parent = d;
+    invalidateLayout_Widget(widget);
+    invalidateLayout_Widget(d);
     return child;
 }
 
@@ -699,7 +810,8 @@ iAny *removeChild_Widget(iWidget *d, iAnyObject *child) {
     }
     iAssert(found);
     ((iWidget *) child)->parent = NULL;
-    postRefresh_App();
+    invalidateLayout_Widget(d);
+    refresh_Widget(d);
     return child;
 }
 
@@ -723,17 +835,41 @@ size_t childIndex_Widget(const iWidget *d, const iAnyObject *child) {
     return iInvalidPos;
 }
 
-iAny *findChild_Widget(const iWidget *d, const char *id) {
+static iAny *findChildRecursive_Widget_(const iWidget *d, const char *id) {
     if (cmp_String(id_Widget(d), id) == 0) {
         return iConstCast(iAny *, d);
     }
     iConstForEach(ObjectList, i, d->children) {
-        iAny *found = findChild_Widget(constAs_Widget(i.object), id);
+        iAny *found = findChildRecursive_Widget_(constAs_Widget(i.object), id);
         if (found) return found;
     }
     return NULL;
 }
 
+iAny *findChild_Widget(const iWidget *d, const char *id) {
+    if (!*id) {
+        return findChildRecursive_Widget_(d, id);
+    }
+    const iWidgetIds *ids =
+        rootData_.ids ? (const iWidgetIds *) value_Hash(rootData_.ids, hashId_Widget_(id)) : NULL;
+    if (!ids) {
+        return NULL;
+    }
+    /* Only the candidates with a matching ID need to be checked. If more than one of them
+       is in the tree, the tree walk decides which one comes first. */
+    iWidget *found = NULL;
+    iConstForEach(PtrArray, i, &ids->widgets) {
+        iWidget *widget = i.ptr;
+        if ((widget == d || hasParent_Widget(widget, d)) && cmp_String(&widget->id, id) == 0) {
+            if (found) {
+                return findChildRecursive_Widget_(d, id);
+            }
+            found = widget;
+        }
+    }
+    return found;
+}
+
 iAny *findParentClass_Widget(const iWidget *d, const iAnyClass *class) {
     if (!d) return NULL;
     iWidget *i = d->parent;
@@ -905,12 +1041,13 @@ void postCommand_Widget(const iAnyObject *d, const char *cmd, ...) {
 }
 
 void refresh_Widget(const iAnyObject *d) {
-    /* TODO: Could be widget specific, if parts of the tree are cached. */
     /* TODO: The visbuffer in DocumentWidget and ListWidget could be moved to be a general
        purpose feature of Widget. */
     iAssert(isInstance_Object(d, &Class_Widget));
-    iUnused(d);
-    postRefresh_App();
+    if (get_Window()) {
+        addDamage_Window(get_Window(), bounds_Widget(d));
+    }
+    postRefreshDamage_App();
 }
 
 iBeginDefineClass(Widget)
@@ -89,6 +89,7 @@ enum iWidgetFlag {
 #define wrapText_WidgetFlag                 iBit64(35)
 #define borderTop_WidgetFlag                iBit64(36)
 #define overflowScrollable_WidgetFlag       iBit64(37)
+#define needsArrange_WidgetFlag             iBit64(38) /* subtree must be arranged again */
 
 enum iWidgetAddPos {
     back_WidgetAddPos,
@@ -108,6 +109,8 @@ struct Impl_Widget {
     int          padding[4]; /* left, top, right, bottom */
     int          bgColor;
     int          frameColor;
+    iInt2        arrangedSize;       /* size after the most recent arrangement */
+    iInt2        arrangedParentSize; /* parent's inner size at the time */
     iObjectList *children;
     iWidget *    parent;
     iBool (*commandHandler)(iWidget *, const char *);
@@ -196,10 +199,11 @@ iAny *  removeChild_Widget  (iWidget *, iAnyObject *child); /* returns a ref */
 iAny *  child_Widget        (iWidget *, size_t index); /* O(n) */
 size_t  childIndex_Widget   (const iWidget *, const iAnyObject *child); /* O(n) */
 void    arrange_Widget      (iWidget *);
+void    invalidateLayout_Widget     (iWidget *);
 iBool   dispatchEvent_Widget(iWidget *, const SDL_Event *);
 iBool   processEvent_Widget (iWidget *, const SDL_Event *);
 void    postCommand_Widget  (const iAnyObject *, const char *cmd, ...);
-void    refresh_Widget      (const iAnyObject *);
+void    refresh_Widget      (const iAnyObject *); /* main thread only */
 
 void    setFocus_Widget     (iWidget *);
 iWidget *focus_Widget       (void);
@@ -30,9 +30,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "embedded.h"
 #include "command.h"
 #include "paint.h"
+#include "profiler.h"
 #include "util.h"
 #include "keys.h"
 #include "../app.h"
+#include "../feeds.h"
 #include "../visited.h"
 #include "../gmcerts.h"
 #include "../gmutil.h"
@@ -85,9 +87,6 @@ static iBool handleRootCommands_(iWidget *root, const char *cmd) {
         setFocus_Widget(NULL);
         return iFalse;
     }
-    else if (handleCommand_App(cmd)) {
-        return iTrue;
-    }
     return iFalse;
 }
 
@@ -194,8 +193,9 @@ static const char *reloadCStr_ = "\U0001f503";
 static const char *stopCStr_   = uiTextCaution_ColorEscape "\U0001f310";
 
 static void updateNavBarIdentity_(iWidget *navBar) {
+    const iGmCerts *   certs = loadedCerts_App();
     const iGmIdentity *ident =
-        identityForUrl_GmCerts(certs_App(), url_DocumentWidget(document_App()));
+        certs ? identityForUrl_GmCerts(certs, url_DocumentWidget(document_App())) : NULL;
     iWidget *button = findChild_Widget(navBar, "navbar.ident");
     setFlags_Widget(button, selected_WidgetFlag, ident != NULL);
     /* Update menu. */
@@ -269,7 +269,8 @@ static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
             if (equal_Command(cmd, "document.changed")) {
                 iInputWidget *url = findWidget_App("url");
                 const iString *urlStr = collect_String(suffix_Command(cmd, "url"));
-                visitUrl_Visited(visited_App(), urlStr, 0);
+                visitUrl_App(urlStr, 0);
+                setEntryRead_Feeds(urlStr, iTrue);
                 postCommand_App("visited.changed"); /* sidebar will update */
                 setText_InputWidget(url, urlStr);
                 updateTextCStr_LabelWidget(reloadButton, reloadCStr_);
@@ -288,6 +289,10 @@ static iBool handleNavBarCommands_(iWidget *navBar, const char *cmd) {
             }
         }
     }
+    else if (equal_Command(cmd, "idents.changed")) {
+        updateNavBarIdentity_(navBar);
+        return iFalse;
+    }
     else if (equal_Command(cmd, "tabs.changed")) {
         /* Update navbar according to the current tab. */
         iDocumentWidget *doc = document_App();
@@ -484,6 +489,10 @@ static void setupUserInterface_Window(iWindow *d) {
         iInputWidget *input = new_InputWidget(0);
         setId_Widget(addChildFlags_Widget(searchBar, iClob(input), expand_WidgetFlag),
                      "find.input");
+        iLabelWidget *matches = new_LabelWidget("0000 of 0000", NULL);
+        setId_Widget(addChildFlags_Widget(searchBar, iClob(matches), frameless_WidgetFlag),
+                     "find.matches");
+        updateTextCStr_LabelWidget(matches, "");
         addChild_Widget(searchBar, iClob(newIcon_LabelWidget("  \u2b9f  ", 'g', KMOD_PRIMARY, "find.next")));
         addChild_Widget(searchBar, iClob(newIcon_LabelWidget("  \u2b9d  ", 'g', KMOD_PRIMARY | KMOD_SHIFT, "find.prev")));
         addChild_Widget(searchBar, iClob(newIcon_LabelWidget("\u2a2f", SDLK_ESCAPE, 0, "find.close")));
@@ -563,6 +572,10 @@ void init_Window(iWindow *d, iRect rect) {
     d->initialPos = rect.pos;
     d->lastRect = rect;
     d->pendingCursor = NULL;
+    d->frame = NULL;
+    set_Atomic(&d->isFullDamage, iTrue);
+    d->numDamage = 0;
+    d->drawClip = zero_Rect();
     d->isDrawFrozen = iTrue;
     d->isMouseInside = iTrue;
     d->focusGainedAt = 0;
@@ -650,6 +663,9 @@ void deinit_Window(iWindow *d) {
     }
     iReleasePtr(&d->root);
     deinit_Text();
+    if (d->frame) {
+        SDL_DestroyTexture(d->frame);
+    }
     SDL_DestroyRenderer(d->render);
     SDL_DestroyWindow(d->win);
 }
@@ -740,6 +756,7 @@ iBool processEvent_Window(iWindow *d, const SDL_Event *ev) {
         }
         case SDL_RENDER_TARGETS_RESET:
         case SDL_RENDER_DEVICE_RESET: {
+            invalidate_Window(d); /* retained frame was lost */
             resetFonts_Text();
             postCommand_App("theme.changed"); /* forces UI invalidation */
             break;
@@ -819,12 +836,58 @@ void draw_Window(iWindow *d) {
 //#if !defined (NDEBUG)
 //    printf("draw %d\n", d->frameTime); fflush(stdout);
 //#endif
-    /* Clear the window. */
+    iBeginProfile(window);
+    const iInt2 size = d->root->rect.size;
+    iBool isFull = exchange_Atomic(&d->isFullDamage, iFalse);
+    /* Widgets may request more refreshes while being drawn. */
+    iRect  damage[maxDamageRects_Window];
+    size_t numDamage = d->numDamage;
+    memcpy(damage, d->damage, sizeof(iRect) * numDamage);
+    d->numDamage = 0;
+    /* The window contents are retained in a texture, so only the damaged regions need
+       to be redrawn. */ {
+        int fw = 0, fh = 0;
+        if (d->frame) {
+            SDL_QueryTexture(d->frame, NULL, NULL, &fw, &fh);
+        }
+        if (!d->frame || fw != size.x || fh != size.y) {
+            if (d->frame) {
+                SDL_DestroyTexture(d->frame);
+            }
+            d->frame = SDL_CreateTexture(d->render,
+                                         SDL_PIXELFORMAT_RGBA8888,
+                                         SDL_TEXTUREACCESS_TARGET,
+                                         iMax(1, size.x),
+                                         iMax(1, size.y));
+            SDL_SetTextureBlendMode(d->frame, SDL_BLENDMODE_NONE);
+            isFull = iTrue;
+        }
+    }
+    SDL_SetRenderTarget(d->render, d->frame);
     SDL_SetRenderDrawColor(d->render, 0, 0, 0, 255);
-    SDL_RenderClear(d->render);
     /* Draw widgets. */
     d->frameTime = SDL_GetTicks();
-    draw_Widget(d->root);
+    if (isFull) {
+        d->drawClip = zero_Rect();
+        SDL_RenderSetClipRect(d->render, NULL);
+        SDL_RenderClear(d->render);
+        draw_Widget(d->root);
+    }
+    else {
+        for (size_t i = 0; i < numDamage; i++) {
+            d->drawClip = damage[i];
+            SDL_RenderSetClipRect(d->render, (const SDL_Rect *) &damage[i]);
+            SDL_SetRenderDrawColor(d->render, 0, 0, 0, 255);
+            SDL_RenderFillRect(d->render, (const SDL_Rect *) &damage[i]);
+            draw_Widget(d->root);
+        }
+        d->drawClip = zero_Rect();
+        SDL_RenderSetClipRect(d->render, NULL);
+    }
+    SDL_SetRenderTarget(d->render, NULL);
+    SDL_SetRenderDrawColor(d->render, 0, 0, 0, 255);
+    SDL_RenderClear(d->render);
+    SDL_RenderCopy(d->render, d->frame, NULL, &(SDL_Rect){ 0, 0, size.x, size.y });
 #if 0
     /* Text cache debugging. */ {
         SDL_Texture *cache = glyphCache_Text();
@@ -833,10 +896,67 @@ void draw_Window(iWindow *d) {
         SDL_RenderFillRect(d->render, &rect);
         SDL_RenderCopy(d->render, glyphCache_Text(), NULL, &rect);
     }
+#endif
+    iEndProfile(window);
+#if defined (LAGRANGE_PROFILER)
+    endFrame_Profiler();
+    draw_Profiler();
 #endif
     SDL_RenderPresent(d->render);
 }
 
+void invalidate_Window(iWindow *d) {
+    set_Atomic(&d->isFullDamage, iTrue);
+}
+
+static iBool isOverlapping_Rect_(const iRect a, const iRect b) {
+    return a.pos.x < right_Rect(b) && b.pos.x < right_Rect(a) && a.pos.y < bottom_Rect(b) &&
+           b.pos.y < bottom_Rect(a);
+}
+
+static iRect boundingRect_(const iRect a, const iRect b) {
+    const iInt2 tl = min_I2(topLeft_Rect(a), topLeft_Rect(b));
+    const iInt2 br = max_I2(bottomRight_Rect(a), bottomRight_Rect(b));
+    return (iRect){ tl, sub_I2(br, tl) };
+}
+
+void addDamage_Window(iWindow *d, iRect rect) {
+    /* Main thread only; the damage list is not locked. Other threads post events. */
+    /* Some widgets draw slightly outside their bounds. */
+    rect = adjusted_Rect(rect, init1_I2(-gap_UI), init1_I2(gap_UI));
+    /* Clip to the window. */ {
+        const iInt2 tl = max_I2(topLeft_Rect(rect), zero_I2());
+        const iInt2 br = min_I2(bottomRight_Rect(rect), d->root->rect.size);
+        if (br.x <= tl.x || br.y <= tl.y) {
+            return;
+        }
+        rect = (iRect){ tl, sub_I2(br, tl) };
+    }
+    /* Merge overlapping regions so nothing is drawn twice. */
+    for (size_t i = 0; i < d->numDamage; ) {
+        if (isOverlapping_Rect_(d->damage[i], rect)) {
+            rect = boundingRect_(d->damage[i], rect);
+            d->damage[i] = d->damage[--d->numDamage];
+            i = 0; /* the merged region may overlap others */
+        }
+        else {
+            i++;
+        }
+    }
+    if (d->numDamage == maxDamageRects_Window) {
+        /* Too many separate regions, combine them all. */
+        for (size_t i = 0; i < d->numDamage; i++) {
+            rect = boundingRect_(d->damage[i], rect);
+        }
+        d->numDamage = 0;
+    }
+    d->damage[d->numDamage++] = rect;
+}
+
+iBool isDamaged_Window(const iWindow *d, iRect rect) {
+    return isEmpty_Rect(d->drawClip) || isOverlapping_Rect_(d->drawClip, rect);
+}
+
 void resize_Window(iWindow *d, int w, int h) {
     SDL_SetWindowSize(d->win, w, h);
     updateRootSize_Window_(d, iFalse);
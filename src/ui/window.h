@@ -24,6 +24,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "widget.h"
 
+#include <the_Foundation/atomic.h>
 #include <the_Foundation/rect.h>
 #include <SDL_events.h>
 #include <SDL_render.h>
@@ -32,6 +33,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDeclareType(Window)
 iDeclareTypeConstructionArgs(Window, iRect rect)
 
+#define maxDamageRects_Window   8
+
 struct Impl_Window {
     SDL_Window *  win;
     iInt2         initialPos;
@@ -47,10 +50,18 @@ struct Impl_Window {
     double        presentTime;
     SDL_Cursor *  cursors[SDL_NUM_SYSTEM_CURSORS];
     SDL_Cursor *  pendingCursor;
+    SDL_Texture * frame; /* retained window contents; only damaged regions are redrawn */
+    iAtomicInt    isFullDamage;
+    iRect         damage[maxDamageRects_Window];
+    size_t        numDamage;
+    iRect         drawClip; /* damaged region currently being drawn (empty if everything) */
 };
 
 iBool       processEvent_Window     (iWindow *, const SDL_Event *);
 void        draw_Window             (iWindow *);
+void        invalidate_Window       (iWindow *); /* everything is redrawn */
+void        addDamage_Window        (iWindow *, iRect rect);
+iBool       isDamaged_Window        (const iWindow *, iRect rect);
 void        drawWhileResizing_Window(iWindow *d, int w, int h); /* workaround for SDL bug */
 void        resize_Window           (iWindow *, int w, int h);
 void        setTitle_Window         (iWindow *, const iString *title);
@@ -22,18 +22,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "visited.h"
 #include "app.h"
+#include "defs.h"
+#include "journal.h"
+#include "saver.h"
+#include "trigramindex.h"
 
+#include <the_Foundation/atomic.h>
+#include <the_Foundation/buffer.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/sortedarray.h>
+#include <stdio.h>
+#include <string.h>
 
 const int maxAge_Visited = 2 * 3600 * 24 * 30; /* two months */
 
 void init_VisitedUrl(iVisitedUrl *d) {
     initCurrent_Time(&d->when);
     init_String(&d->url);
+    d->urlHash = 0;
     d->flags = 0;
 }
 
@@ -41,8 +50,36 @@ void deinit_VisitedUrl(iVisitedUrl *d) {
     deinit_String(&d->url);
 }
 
+static uint32_t urlHash_(iRangecc url) {
+    uint32_t hash = 0x811c9dc5; /* FNV-1a */
+    for (const char *ch = url.start; ch != url.end; ch++) {
+        hash = (hash ^ (uint8_t) *ch) * 0x01000193;
+    }
+    return hash;
+}
+
+static void setUrl_VisitedUrl_(iVisitedUrl *d, const iString *url) {
+    set_String(&d->url, url);
+    d->urlHash = urlHash_(range_String(url));
+}
+
+static int cmpKey_(uint32_t hashA, const iString *urlA, uint32_t hashB, const iString *urlB) {
+    /* Hashes are compared first so most comparisons don't need to look at the URLs. */
+    if (hashA != hashB) {
+        return hashA < hashB ? -1 : 1;
+    }
+    return cmpString_String(urlA, urlB);
+}
+
 static int cmpUrl_VisitedUrl_(const void *a, const void *b) {
-    return cmpString_String(&((const iVisitedUrl *) a)->url, &((const iVisitedUrl *) b)->url);
+    const iVisitedUrl *s = a, *t = b;
+    return cmpKey_(s->urlHash, &s->url, t->urlHash, &t->url);
+}
+
+static int cmpWhenDescending_VisitedUrl_(const void *a, const void *b) {
+    const iVisitedUrl *s = a, *t = b;
+    const int cmp = -cmp_Time(&s->when, &t->when);
+    return cmp ? cmp : cmpUrl_VisitedUrl_(a, b);
 }
 
 static int cmpNewer_VisitedUrl_(const void *insert, const void *existing) {
@@ -52,9 +89,24 @@ static int cmpNewer_VisitedUrl_(const void *insert, const void *existing) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* The visited URLs are prefiltered with a Bloom filter. Most URLs looked up during layout
+   haven't been visited, and the filter answers that without taking the lock. Bits are only
+   set while the filter is in use; it is rebuilt when loading. Removed URLs remain in the
+   filter until then, but those lookups just fall through to the sorted array. */
+
+static const size_t bloomMinBits_Visited_ = 1 << 20;
+static const int    bloomNumHashes_Visited_ = 4;
+
 struct Impl_Visited {
     iMutex *mtx;
-    iSortedArray visited;
+    iSortedArray visited; /* sorted by URL hash, then URL */
+    iSortedArray recent;  /* copies of the visited entries, newest first; URLs are shared */
+    uint32_t *bloom;
+    size_t    bloomMask; /* number of bits minus one */
+    iTrigramIndex *trigrams; /* URL hashes by trigrams of the URLs */
+    iAtomicInt revision; /* incremented when URLs are visited or removed */
+    iString saveDir;
+    iJournal *journal; /* changes since the file was last saved */
 };
 
 iDefineTypeConstruction(Visited)
@@ -62,45 +114,262 @@ iDefineTypeConstruction(Visited)
 void init_Visited(iVisited *d) {
     d->mtx = new_Mutex();
     init_SortedArray(&d->visited, sizeof(iVisitedUrl), cmpUrl_VisitedUrl_);
+    init_SortedArray(&d->recent, sizeof(iVisitedUrl), cmpWhenDescending_VisitedUrl_);
+    init_String(&d->saveDir);
+    d->journal = NULL;
+    d->bloomMask = bloomMinBits_Visited_ - 1;
+    d->bloom = calloc(bloomMinBits_Visited_ / 32, sizeof(uint32_t));
+    d->trigrams = new_TrigramIndex();
+    set_Atomic(&d->revision, 0);
+}
+
+static uint32_t bloomBit_Visited_(const iVisited *d, uint32_t hash, int index) {
+    /* Double hashing derives the bit positions from a single hash. */
+    const uint32_t second = (hash * 0x9e3779b1u) | 1;
+    return (hash + index * second) & d->bloomMask;
+}
+
+static void addToBloom_Visited_(iVisited *d, uint32_t hash) {
+    for (int i = 0; i < bloomNumHashes_Visited_; i++) {
+        const uint32_t bit = bloomBit_Visited_(d, hash, i);
+        d->bloom[bit / 32] |= 1u << (bit % 32);
+    }
+}
+
+static iBool mayContain_Visited_(const iVisited *d, uint32_t hash) {
+    for (int i = 0; i < bloomNumHashes_Visited_; i++) {
+        const uint32_t bit = bloomBit_Visited_(d, hash, i);
+        if (~d->bloom[bit / 32] & (1u << (bit % 32))) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+static void rebuildBloom_Visited_(iVisited *d) {
+    /* Called while locked, before the filter is being used by other threads. */
+    size_t numBits = bloomMinBits_Visited_;
+    while (numBits < 16 * size_SortedArray(&d->visited)) {
+        numBits *= 2;
+    }
+    free(d->bloom);
+    d->bloom     = calloc(numBits / 32, sizeof(uint32_t));
+    d->bloomMask = numBits - 1;
+    iConstForEach(Array, i, &d->visited.values) {
+        addToBloom_Visited_(d, ((const iVisitedUrl *) i.value)->urlHash);
+    }
+}
+
+/* The recency index lets the most recently visited URLs be listed without sorting the
+   whole set. The index has its own copies of the entries, but the URL strings are shared
+   with the set. */
+
+static void indexRecent_Visited_(iVisited *d, const iVisitedUrl *item) {
+    /* Called while locked. */
+    iVisitedUrl copy = *item;
+    initCopy_String(&copy.url, &item->url);
+    insert_SortedArray(&d->recent, &copy);
+}
+
+static void unindexRecent_Visited_(iVisited *d, const iVisitedUrl *item) {
+    /* Called while locked, before the entry's time is updated. */
+    size_t pos;
+    if (locate_SortedArray(&d->recent, item, &pos)) {
+        deinit_VisitedUrl(at_SortedArray(&d->recent, pos));
+        remove_Array(&d->recent.values, pos);
+    }
+}
+
+static void clearRecent_Visited_(iVisited *d) {
+    iForEach(Array, i, &d->recent.values) {
+        deinit_VisitedUrl(i.value);
+    }
+    clear_SortedArray(&d->recent);
+}
+
+static void rebuildRecent_Visited_(iVisited *d) {
+    /* Called while locked. */
+    clearRecent_Visited_(d);
+    reserve_Array(&d->recent.values, size_SortedArray(&d->visited));
+    iConstForEach(Array, i, &d->visited.values) {
+        const iVisitedUrl *item = i.value;
+        iVisitedUrl copy = *item;
+        initCopy_String(&copy.url, &item->url);
+        pushBack_Array(&d->recent.values, &copy);
+    }
+    sort_Array(&d->recent.values, cmpWhenDescending_VisitedUrl_);
+}
+
+/* The trigram index finds the URLs that may match a lookup. The URL hash is used as the ID
+   of an entry, so a hash may refer to more than one URL. */
+
+static void rebuildTrigrams_Visited_(iVisited *d) {
+    /* Called while locked. */
+    clear_TrigramIndex(d->trigrams);
+    iConstForEach(Array, i, &d->visited.values) {
+        const iVisitedUrl *item = i.value;
+        add_TrigramIndex(d->trigrams, range_String(&item->url), item->urlHash);
+    }
 }
 
 void deinit_Visited(iVisited *d) {
+    /* Any ongoing compaction needs the lock to finish. */
+    delete_Journal(d->journal);
+    d->journal = NULL;
     iGuardMutex(d->mtx, {
         clear_Visited(d);
         deinit_SortedArray(&d->visited);
+        deinit_SortedArray(&d->recent);
     });
+    deinit_String(&d->saveDir);
+    free(d->bloom);
+    delete_TrigramIndex(d->trigrams);
     delete_Mutex(d->mtx);
 }
 
+static void journal_Visited_(iVisited *d, const char *type, const iString *url,
+                             const iTime *when, uint16_t flags) {
+    /* Called while locked so the journal is ordered the same way as the changes. */
+    if (!d->journal) return;
+    iStringList *fields = new_StringList();
+    pushBackCStr_StringList(fields, type);
+    if (url) {
+        pushBack_StringList(fields,
+                            collect_String(newFormat_String("%lld %x",
+                                                            (long long) when->ts.tv_sec,
+                                                            flags)));
+        pushBack_StringList(fields, url);
+    }
+    append_Journal(d->journal, fields);
+    iRelease(fields);
+}
+
+static void compact_Visited_(void *context) {
+    iVisited *d = context;
+    save_Visited(d, cstr_String(&d->saveDir));
+}
+
+/* The visited URLs are saved in a binary file, in sorted order: a header with the number of
+   entries and the size of the URL string pool, a packed record for each entry, and finally
+   the pool of concatenated URLs. Loading needs no parsing and no sorting. */
+
+static const char *filename_Visited_    = "visited.binary";
+static const char *oldFilename_Visited_ = "visited.txt";
+static const char *magic_Visited_       = "lgVU";
+
 void save_Visited(const iVisited *d, const char *dirPath) {
-    iString *line = new_String();
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.txt"));
-    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
-        iConstForEach(Array, i, &d->visited.values) {
-            const iVisitedUrl *item = i.value;
-            iDate date;
-            init_Date(&date, &item->when);
-            format_String(line,
-                          "%04d-%02d-%02dT%02d:%02d:%02d %04x %s\n",
-                          date.year,
-                          date.month,
-                          date.day,
-                          date.hour,
-                          date.minute,
-                          date.second,
-                          item->flags,
-                          cstr_String(&item->url));
-            writeData_File(f, cstr_String(line), size_String(line));
+    /* The file is replaced only when it has been completely written. */
+    iBuffer *buf = new_Buffer();
+    openEmpty_Buffer(buf);
+    iStream *outs = stream_Buffer(buf);
+    lock_Mutex(d->mtx);
+    size_t poolSize = 0;
+    iConstForEach(Array, i, &d->visited.values) {
+        poolSize += size_String(&((const iVisitedUrl *) i.value)->url);
+    }
+    writeData_Stream(outs, magic_Visited_, 4);
+    writeU32_Stream(outs, latest_FileVersion);
+    writeU32_Stream(outs, (uint32_t) size_SortedArray(&d->visited));
+    writeU32_Stream(outs, (uint32_t) poolSize);
+    iConstForEach(Array, j, &d->visited.values) {
+        const iVisitedUrl *item = j.value;
+        writeU64_Stream(outs, (uint64_t) item->when.ts.tv_sec);
+        writeU16_Stream(outs, item->flags);
+        writeU32_Stream(outs, (uint32_t) size_String(&item->url));
+    }
+    iConstForEach(Array, k, &d->visited.values) {
+        const iVisitedUrl *item = k.value;
+        writeData_Stream(outs, cstr_String(&item->url), size_String(&item->url));
+    }
+    /* Still locked, so no changes are journaled in between. */
+    const iBool ok = writeAtomically_Saver(
+        collectNewCStr_String(concatPath_CStr(dirPath, filename_Visited_)), data_Buffer(buf));
+    if (ok && d->journal) {
+        clear_Journal(d->journal); /* all changes are in the file now */
+    }
+    unlock_Mutex(d->mtx);
+    if (ok) {
+        /* The old text file has been migrated. */
+        remove(concatPath_CStr(dirPath, oldFilename_Visited_));
+    }
+    iRelease(buf);
+}
+
+static uint64_t decodeLE_(const char *bytes, size_t size) {
+    /* Stream integers are written in little-endian byte order. */
+    uint64_t value = 0;
+    for (size_t i = size; i-- > 0; ) {
+        value = (value << 8) | (uint8_t) bytes[i];
+    }
+    return value;
+}
+
+static iBool loadBinary_Visited_(iVisited *d, const char *dirPath) {
+    iFile *f = newCStr_File(concatPath_CStr(dirPath, filename_Visited_));
+    iBool  ok = iFalse;
+    if (open_File(f, readOnly_FileMode)) {
+        const iBlock *data = collect_Block(readAll_File(f));
+        const char *  pos  = constBegin_Block(data);
+        const char *  end  = constEnd_Block(data);
+        uint32_t      header[3]; /* version, count, pool size */
+        if (size_Block(data) >= 16 && !memcmp(pos, magic_Visited_, 4)) {
+            for (int i = 0; i < 3; i++) {
+                header[i] = (uint32_t) decodeLE_(pos + 4 + 4 * i, 4);
+            }
+            pos += 16;
+        }
+        else {
+            header[0] = latest_FileVersion + 1; /* not valid */
+        }
+        const size_t recordSize = 8 + 2 + 4;
+        if (header[0] <= latest_FileVersion &&
+            (size_t) (end - pos) == (size_t) header[1] * recordSize + header[2]) {
+            const char *pool = pos + (size_t) header[1] * recordSize;
+            iTime       now;
+            initCurrent_Time(&now);
+            iBool isSorted = iTrue;
+            lock_Mutex(d->mtx);
+            reserve_Array(&d->visited.values, header[1]);
+            for (uint32_t i = 0; i < header[1]; i++, pos += recordSize) {
+                const uint64_t seconds = decodeLE_(pos, 8);
+                const uint16_t flags   = (uint16_t) decodeLE_(pos + 8, 2);
+                const uint32_t len     = (uint32_t) decodeLE_(pos + 10, 4);
+                if (pool + len > end) {
+                    break;
+                }
+                iVisitedUrl item;
+                iZap(item.when);
+                item.when.ts.tv_sec = (time_t) seconds;
+                item.flags = flags;
+                const iRangecc url = { pool, pool + len };
+                pool += len;
+                if (secondsSince_Time(&now, &item.when) > maxAge_Visited) {
+                    continue; /* Too old. */
+                }
+                initRange_String(&item.url, url);
+                item.urlHash = urlHash_(url);
+                /* Entries were saved in sorted order, so they can just be appended. */
+                const size_t count = size_SortedArray(&d->visited);
+                if (count > 0 &&
+                    cmpUrl_VisitedUrl_(constAt_SortedArray(&d->visited, count - 1), &item) >= 0) {
+                    isSorted = iFalse;
+                }
+                pushBack_Array(&d->visited.values, &item);
+            }
+            if (!isSorted) {
+                /* Saved with a different sort order. */
+                sort_Array(&d->visited.values, cmpUrl_VisitedUrl_);
+            }
+            unlock_Mutex(d->mtx);
+            ok = iTrue;
         }
-        unlock_Mutex(d->mtx);
     }
     iRelease(f);
-    delete_String(line);
+    return ok;
 }
 
-void load_Visited(iVisited *d, const char *dirPath) {
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.txt"));
+static void loadText_Visited_(iVisited *d, const char *dirPath) {
+    iFile *f = newCStr_File(concatPath_CStr(dirPath, oldFilename_Visited_));
     if (open_File(f, readOnly_FileMode | text_FileMode)) {
         lock_Mutex(d->mtx);
         const iRangecc src  = range_Block(collect_Block(readAll_File(f)));
@@ -126,6 +395,7 @@ void load_Visited(iVisited *d, const char *dirPath) {
                 continue; /* Too old. */
             }
             initRange_String(&item.url, (iRangecc){ urlStart, line.end });
+            item.urlHash = urlHash_(range_String(&item.url));
             insert_SortedArray(&d->visited, &item);
         }
         unlock_Mutex(d->mtx);
@@ -133,19 +403,73 @@ void load_Visited(iVisited *d, const char *dirPath) {
     iRelease(f);
 }
 
+static void visit_Visited_(iVisited *d, const iString *url, const iTime *when,
+                           uint16_t visitFlags);
+static void remove_Visited_(iVisited *d, const iString *url);
+
+static void replay_Visited_(void *context, const iStringList *fields) {
+    iVisited *d = context;
+    const iString *type = constAt_StringList(fields, 0);
+    if (!cmp_String(type, "clear")) {
+        clear_Visited(d);
+    }
+    else if (size_StringList(fields) == 3) {
+        const iString *url = constAt_StringList(fields, 2);
+        if (!cmp_String(type, "visit")) {
+            long long seconds = 0;
+            unsigned int flags = 0;
+            sscanf(cstr_String(constAt_StringList(fields, 1)), "%lld %x", &seconds, &flags);
+            iTime when;
+            iZap(when);
+            when.ts.tv_sec = (time_t) seconds;
+            visit_Visited_(d, url, &when, (uint16_t) flags);
+        }
+        else if (!cmp_String(type, "remove")) {
+            remove_Visited_(d, url);
+        }
+    }
+}
+
+void load_Visited(iVisited *d, const char *dirPath) {
+    if (!loadBinary_Visited_(d, dirPath)) {
+        loadText_Visited_(d, dirPath);
+    }
+    /* Apply the changes made after the file was saved. */
+    setCStr_String(&d->saveDir, dirPath);
+    delete_Journal(d->journal);
+    d->journal = NULL;
+    iJournal *journal =
+        new_Journal(collect_String(newCStr_String(concatPath_CStr(dirPath, "visited.journal"))),
+                    compact_Visited_,
+                    d);
+    replay_Journal(journal, replay_Visited_, d);
+    iGuardMutex(d->mtx, {
+        rebuildBloom_Visited_(d);
+        rebuildRecent_Visited_(d);
+        rebuildTrigrams_Visited_(d);
+        add_Atomic(&d->revision, 1);
+    });
+    d->journal = journal;
+}
+
 void clear_Visited(iVisited *d) {
     lock_Mutex(d->mtx);
     iForEach(Array, v, &d->visited.values) {
         deinit_VisitedUrl(v.value);
     }
     clear_SortedArray(&d->visited);
+    clearRecent_Visited_(d);
+    clear_TrigramIndex(d->trigrams);
+    memset(d->bloom, 0, (d->bloomMask + 1) / 8);
+    add_Atomic(&d->revision, 1);
+    journal_Visited_(d, "clear", NULL, NULL, 0);
     unlock_Mutex(d->mtx);
 }
 
 static size_t find_Visited_(const iVisited *d, const iString *url) {
     iVisitedUrl visit;
     init_VisitedUrl(&visit);
-    set_String(&visit.url, url);
+    setUrl_VisitedUrl_(&visit, url);
     size_t pos = iInvalidPos;
     iGuardMutex(d->mtx, {
         locate_SortedArray(&d->visited, &visit, &pos);
@@ -154,45 +478,88 @@ static size_t find_Visited_(const iVisited *d, const iString *url) {
     return pos;
 }
 
-void visitUrl_Visited(iVisited *d, const iString *url, uint16_t visitFlags) {
-    if (isEmpty_String(url)) return;
+static void visit_Visited_(iVisited *d, const iString *url, const iTime *when,
+                           uint16_t visitFlags) {
     iVisitedUrl visit;
     init_VisitedUrl(&visit);
+    visit.when  = *when;
     visit.flags = visitFlags;
-    set_String(&visit.url, url);
+    setUrl_VisitedUrl_(&visit, url);
     size_t pos;
     lock_Mutex(d->mtx);
+    addToBloom_Visited_(d, visit.urlHash);
     if (locate_SortedArray(&d->visited, &visit, &pos)) {
         iVisitedUrl *old = at_SortedArray(&d->visited, pos);
         if (cmpNewer_VisitedUrl_(&visit, old)) {
+            unindexRecent_Visited_(d, old);
             old->when = visit.when;
             old->flags = visitFlags;
-            unlock_Mutex(d->mtx);
-            deinit_VisitedUrl(&visit);
-            return;
+            indexRecent_Visited_(d, old);
+            add_Atomic(&d->revision, 1);
         }
+        unlock_Mutex(d->mtx);
+        deinit_VisitedUrl(&visit);
+        return;
     }
     insert_SortedArray(&d->visited, &visit);
+    indexRecent_Visited_(d, &visit);
+    add_TrigramIndex(d->trigrams, range_String(&visit.url), visit.urlHash);
+    add_Atomic(&d->revision, 1);
     unlock_Mutex(d->mtx);
 }
 
-void removeUrl_Visited(iVisited *d, const iString *url) {
+void visitUrl_Visited(iVisited *d, const iString *url, uint16_t visitFlags) {
+    if (isEmpty_String(url)) return;
+    iTime now;
+    initCurrent_Time(&now);
+    iGuardMutex(d->mtx, {
+        visit_Visited_(d, url, &now, visitFlags);
+        journal_Visited_(d, "visit", url, &now, visitFlags);
+    });
+}
+
+static void remove_Visited_(iVisited *d, const iString *url) {
     iGuardMutex(d->mtx, {
         size_t pos = find_Visited_(d, url);
         if (pos < size_SortedArray(&d->visited)) {
             iVisitedUrl *visUrl = at_SortedArray(&d->visited, pos);
             if (equal_String(&visUrl->url, url)) {
+                const uint32_t hash = visUrl->urlHash;
+                unindexRecent_Visited_(d, visUrl);
+                /* Other URLs with the same hash still need the hash in the index. */
+                const iBool isHashShared =
+                    (pos > 0 &&
+                     ((const iVisitedUrl *) constAt_SortedArray(&d->visited, pos - 1))->urlHash ==
+                         hash) ||
+                    (pos + 1 < size_SortedArray(&d->visited) &&
+                     ((const iVisitedUrl *) constAt_SortedArray(&d->visited, pos + 1))->urlHash ==
+                         hash);
+                if (!isHashShared) {
+                    remove_TrigramIndex(d->trigrams, range_String(url), hash);
+                }
                 deinit_VisitedUrl(visUrl);
                 remove_Array(&d->visited.values, pos);
+                add_Atomic(&d->revision, 1);
             }
         }
     });
 }
 
+void removeUrl_Visited(iVisited *d, const iString *url) {
+    iGuardMutex(d->mtx, {
+        remove_Visited_(d, url);
+        journal_Visited_(d, "remove", url, &(iTime){ 0 }, 0);
+    });
+}
+
 iTime urlVisitTime_Visited(const iVisited *d, const iString *url) {
     iVisitedUrl item;
     size_t pos;
     iZap(item);
+    item.urlHash = urlHash_(range_String(url));
+    if (!mayContain_Visited_(d, item.urlHash)) {
+        return item.when; /* definitely not visited */
+    }
     initCopy_String(&item.url, url);
     lock_Mutex(d->mtx);
     if (locate_SortedArray(&d->visited, &item, &pos)) {
@@ -203,29 +570,155 @@ iTime urlVisitTime_Visited(const iVisited *d, const iString *url) {
     return item.when;
 }
 
+iDeclareType(VisitQuery)
+
+struct Impl_VisitQuery {
+    const iString *url;
+    uint32_t       urlHash;
+    size_t         index;
+};
+
+static int cmpUrl_VisitQuery_(const void *a, const void *b) {
+    const iVisitQuery *s = a, *t = b;
+    return cmpKey_(s->urlHash, s->url, t->urlHash, t->url);
+}
+
+void visitTimes_Visited(const iVisited *d, const iPtrArray *urls, iTime *times_out) {
+    const size_t count = size_PtrArray(urls);
+    if (count == 0) {
+        return;
+    }
+    /* The queried URLs are sorted so they can be merged with the sorted set of visited URLs.
+       Each search only needs to cover the part of the set after the previous match. */
+    iArray queries;
+    init_Array(&queries, sizeof(iVisitQuery));
+    for (size_t i = 0; i < count; i++) {
+        const iString *url  = constAt_PtrArray(urls, i);
+        const uint32_t hash = urlHash_(range_String(url));
+        iZap(times_out[i]);
+        if (mayContain_Visited_(d, hash)) {
+            pushBack_Array(&queries, &(iVisitQuery){ url, hash, i });
+        }
+    }
+    sort_Array(&queries, cmpUrl_VisitQuery_);
+    lock_Mutex(d->mtx);
+    const size_t numVisited = size_SortedArray(&d->visited);
+    size_t       lo         = 0;
+    iConstForEach(Array, i, &queries) {
+        const iVisitQuery *query = i.value;
+        size_t hi = numVisited;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            const iVisitedUrl *item = constAt_SortedArray(&d->visited, mid);
+            if (cmpKey_(item->urlHash, &item->url, query->urlHash, query->url) < 0) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        if (lo == numVisited) {
+            break; /* the rest are not in the set */
+        }
+        const iVisitedUrl *visit = constAt_SortedArray(&d->visited, lo);
+        if (visit->urlHash == query->urlHash && equal_String(&visit->url, query->url)) {
+            times_out[query->index] = visit->when;
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_Array(&queries);
+}
+
 iBool containsUrl_Visited(const iVisited *d, const iString *url) {
     const iTime time = urlVisitTime_Visited(d, url);
     return isValid_Time(&time);
 }
 
-static int cmpWhenDescending_VisitedUrlPtr_(const void *a, const void *b) {
-    const iVisitedUrl *s = *(const void **) a, *t = *(const void **) b;
-    return -cmp_Time(&s->when, &t->when);
+size_t size_Visited(const iVisited *d) {
+    size_t size;
+    iGuardMutex(d->mtx, size = size_SortedArray(&d->visited));
+    return size;
+}
+
+size_t memorySize_Visited(const iVisited *d) {
+    size_t size = (d->bloomMask + 1) / 8;
+    lock_Mutex(d->mtx);
+    size += (size_SortedArray(&d->visited) + size_SortedArray(&d->recent)) * sizeof(iVisitedUrl);
+    iConstForEach(Array, i, &d->visited.values) {
+        size += size_String(&((const iVisitedUrl *) i.value)->url); /* shared with `recent` */
+    }
+    unlock_Mutex(d->mtx);
+    return size;
+}
+
+static void snapshot_Visited_(const iVisited *d, size_t count, iArray *urls_out) {
+    /* Called while locked. */
+    iConstForEach(Array, i, &d->recent.values) {
+        const iVisitedUrl *vis = i.value;
+        if (~vis->flags & transient_VisitedUrlFlag) {
+            iVisitedUrl copy = *vis;
+            initCopy_String(&copy.url, &vis->url);
+            pushBack_Array(urls_out, &copy);
+            if (size_Array(urls_out) == count) {
+                break;
+            }
+        }
+    }
+}
+
+void snapshot_Visited(const iVisited *d, size_t count, iArray *urls_out) {
+    iGuardMutex(d->mtx, snapshot_Visited_(d, count, urls_out));
+}
+
+void snapshotMatching_Visited(const iVisited *d, const iStringList *words, iArray *urls_out) {
+    iArray hashes;
+    init_Array(&hashes, sizeof(uint32_t));
+    lock_Mutex(d->mtx);
+    if (query_TrigramIndex(d->trigrams, words, &hashes)) {
+        const size_t numVisited = size_SortedArray(&d->visited);
+        iVisitedUrl  key;
+        init_VisitedUrl(&key); /* empty URL sorts first among equal hashes */
+        iConstForEach(Array, i, &hashes) {
+            size_t pos;
+            key.urlHash = *(const uint32_t *) i.value;
+            locate_SortedArray(&d->visited, &key, &pos);
+            for (; pos < numVisited; pos++) {
+                const iVisitedUrl *vis = constAt_SortedArray(&d->visited, pos);
+                if (vis->urlHash != key.urlHash) {
+                    break;
+                }
+                if (~vis->flags & transient_VisitedUrlFlag) {
+                    iVisitedUrl copy = *vis;
+                    initCopy_String(&copy.url, &vis->url);
+                    pushBack_Array(urls_out, &copy);
+                }
+            }
+        }
+        deinit_VisitedUrl(&key);
+    }
+    else {
+        snapshot_Visited_(d, 0, urls_out);
+    }
+    unlock_Mutex(d->mtx);
+    deinit_Array(&hashes);
+}
+
+int revision_Visited(const iVisited *d) {
+    return value_Atomic(&d->revision);
 }
 
 const iArray *list_Visited(const iVisited *d, size_t count) {
     iPtrArray *urls = collectNew_PtrArray();
     iGuardMutex(d->mtx, {
-        iConstForEach(Array, i, &d->visited.values) {
+        iConstForEach(Array, i, &d->recent.values) {
             const iVisitedUrl *vis = i.value;
             if (~vis->flags & transient_VisitedUrlFlag) {
                 pushBack_PtrArray(urls, vis);
+                if (size_PtrArray(urls) == count) {
+                    break;
+                }
             }
         }
     });
-    sort_Array(urls, cmpWhenDescending_VisitedUrlPtr_);
-    if (count > 0 && size_Array(urls) > count) {
-        resize_Array(urls, count);
-    }
     return urls;
 }
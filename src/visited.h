@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/string.h>
+#include <the_Foundation/stringlist.h>
 #include <the_Foundation/time.h>
 
 iDeclareType(VisitedUrl)
@@ -35,6 +36,7 @@ extern const int maxAge_Visited; /* seconds */
 
 struct Impl_VisitedUrl {
     iString  url;
+    uint32_t urlHash;
     iTime    when;
     uint16_t flags;
 };
@@ -51,8 +53,28 @@ void    load_Visited            (iVisited *, const char *dirPath);
 void    save_Visited            (const iVisited *, const char *dirPath);
 
 iTime   urlVisitTime_Visited    (const iVisited *, const iString *url);
+void    visitTimes_Visited      (const iVisited *, const iPtrArray *urls, iTime *times_out); /* single lock */
 void    visitUrl_Visited        (iVisited *, const iString *url, uint16_t visitFlags); /* adds URL to the visited URLs set */
 void    removeUrl_Visited       (iVisited *, const iString *url);
 iBool   containsUrl_Visited     (const iVisited *, const iString *url);
+size_t  size_Visited            (const iVisited *); /* number of URLs */
+size_t  memorySize_Visited      (const iVisited *); /* approximate, excluding the index */
 
 const iPtrArray *  list_Visited (const iVisited *, size_t count); /* returns collected */
+
+/**
+ * Copies the non-transient visited URLs, newest first. The copies share their strings with
+ * the originals, so this is cheap, and they remain valid even if the set is modified.
+ *
+ * @param count      Maximum number of copies. Zero for all of them.
+ * @param urls_out   Array of VisitedUrl. Each element must be deinitialized by the caller.
+ */
+void    snapshot_Visited        (const iVisited *, size_t count, iArray *urls_out);
+
+/**
+ * Copies the non-transient visited URLs that may contain all of the words, found with a
+ * trigram index. The copies still need to be matched against the words. If the words are
+ * too short to be looked up in the index, all the URLs are copied as in snapshot_Visited().
+ */
+void    snapshotMatching_Visited(const iVisited *, const iStringList *words, iArray *urls_out);
+int     revision_Visited        (const iVisited *); /* changes when any visit changes */